@@ -18,15 +18,22 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <utility>
+
 #include "mibview.h"
 #include "agent.h"
 #include "mibmodule.h"
 #include "preferences.h"
 #include "mibselection.h"
+#include "trapgen.h"
 
-#define ASYNC_TIMER_MSEC 5
+// Period at which the trap listener threads check for their abort
 #define TRAP_TIMER_MSEC 100
 
+// Room left in a response for the message header around the PDU
+// (community or v3 security parameters) when sizing a walk request
+#define WALK_MSG_HEADER 128
+
 typedef struct
 {
     Vb vb;
@@ -64,6 +71,16 @@ void callback_trap(int reason, Snmp *, Pdu &pdu, SnmpTarget &target, void *cd)
     }
 }
 
+void callback_trap_listener(int reason, Snmp *, Pdu &pdu, 
+                            SnmpTarget &target, void *cd)
+{
+    if (cd)
+    {
+        // just call the real callback member function...
+        ((TrapListener*)cd)->CallbackTrap(reason, pdu, target);
+    }
+}
+
 void callback(int reason, Snmp *, Pdu &pdu, SnmpTarget &target, void *cd)
 {
     if (cd)
@@ -76,6 +93,15 @@ void callback(int reason, Snmp *, Pdu &pdu, SnmpTarget &target, void *cd)
 Agent::Agent(Snmpb *snmpb)
 {
     s = snmpb;
+    events = NULL;
+    coalescer = NULL;
+    tvreply = NULL;
+    tvtarget = NULL;
+    tvpdu = NULL;
+    sireply = NULL;
+    sitarget = NULL;
+    sipdu = NULL;
+    silist = NULL;
 
     int status, status2;
 
@@ -152,6 +178,17 @@ Agent::Agent(Snmpb *snmpb)
         return;
     }
 
+    // Use several listeners sharing the trap ports, if configured.
+    // The transports may have been disabled above for this run.
+    int count = s->PreferencesObj()->GetTrapListeners();
+    if (count > 1)
+    {
+        StartTrapListeners(count, s->PreferencesObj()->GetEnableIPv4(),
+                           s->PreferencesObj()->GetEnableIPv6(), port4, port6);
+        if (listeners.isEmpty() == false)
+            return;
+    }
+
     // Bind on the SNMP trap ports
     snmp->notify_set_listen_port(port4);
     snmp->notify_set_listen_port6(port6);
@@ -170,22 +207,134 @@ Agent::Agent(Snmpb *snmpb)
     }
 }
 
+void Agent::StartTrapListeners(int count, bool v4, bool v6, 
+                               int port4, int port6)
+{
+    for (int i = 0; i < count; i++)
+    {
+        TrapListener *tl = new TrapListener(this, v4, v6, port4, port6);
+
+        if (tl->GetStatus() != SNMP_CLASS_SUCCESS)
+        {
+            start_err = QString("Could not start %1 trap listeners on IPv4 \
+trap\nport %2 or IPv6 trap port %3.\n\n%4\nUsing a single trap listener.")
+                .arg(count)
+                .arg(port4)
+                .arg(port6)
+                .arg(Snmp::error_msg(tl->GetStatus()));
+            delete tl;
+            qDeleteAll(listeners);
+            listeners.clear();
+            return;
+        }
+
+        listeners.append(tl);
+    }
+}
+
+void Agent::StopTrapListeners(void)
+{
+    for (int i = 0; i < listeners.size(); i++)
+        listeners[i]->Abort();
+    for (int i = 0; i < listeners.size(); i++)
+        listeners[i]->wait();
+    qDeleteAll(listeners);
+    listeners.clear();
+}
+
+// Secret the USM key cache file is encrypted with, created on first use
+// and only readable by the user
+QByteArray Agent::KeyCacheSecret(void)
+{
+    QFile file(s->GetKeyCacheSecretFile());
+    QByteArray secret;
+
+    if (file.open(QIODevice::ReadOnly))
+    {
+        secret = file.readAll();
+        file.close();
+        if (secret.size() >= 16)
+            return secret;
+    }
+
+    secret = QUuid::createUuid().toRfc4122() + QUuid::createUuid().toRfc4122();
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return QByteArray();
+    file.setPermissions(QFile::ReadOwner | QFile::WriteOwner);
+    if (file.write(secret) != secret.size())
+        secret.clear();
+    file.close();
+
+    return secret;
+}
+
+// Keys generated from the USM passwords are kept from one run to the
+// next, so that they are only localized for each new engine id
+void Agent::LoadKeyCache(void)
+{
+    keycachesecret = KeyCacheSecret();
+    if (!keycachesecret.isEmpty())
+        v3mp->get_usm()->load_key_cache(
+            s->GetKeyCacheFile().toLatin1().data(),
+            (const unsigned char *)keycachesecret.data(),
+            keycachesecret.size());
+
+    DeriveUserKeys();
+}
+
+// Generate the keys of the users missing from the cache, in parallel
+void Agent::DeriveUserKeys(void)
+{
+    if (v3mp->get_usm()->derive_user_keys(QThread::idealThreadCount()) > 0)
+        SaveKeyCache();
+}
+
+void Agent::SaveKeyCache(void)
+{
+    if (keycachesecret.isEmpty())
+        return;
+
+    QString file = s->GetKeyCacheFile();
+    if (v3mp->get_usm()->save_key_cache(file.toLatin1().data(),
+            (const unsigned char *)keycachesecret.data(),
+            keycachesecret.size()) == SNMPv3_USM_OK)
+        QFile::setPermissions(file, QFile::ReadOwner | QFile::WriteOwner);
+}
+
 bool Agent::GetStartupResult(QString &err)
 {
     err = start_err;
     return start_result;
 }
 
-void Agent::StartTrapTimer(void)
+void Agent::StartEvents(void)
+{
+    // Handle responses and traps from the Qt event loop
+    events = new SnmpEventNotifier(snmp, this);
+    events->Update();
+
+    // Merges the GETs of the graphs and table views
+    coalescer = new SnmpCoalescer(snmp, events, this);
+    ConfigureCoalescing();
+    ConfigureTimeouts();
+}
+
+void Agent::ConfigureCoalescing(void)
 {
-    // Start the timer
-    timer.start(TRAP_TIMER_MSEC);
+    if (coalescer)
+        coalescer->SetWindow(s->PreferencesObj()->GetCoalesceWindow());
 }
 
-void Agent::StopTimer(void)
+void Agent::ConfigureTimeouts(void)
 {
-    // Stop the timer
-    timer.stop();
+    if (snmp)
+        snmp->set_adaptive_timeout(s->PreferencesObj()->GetAdaptiveTimeout());
+}
+
+void Agent::StopEvents(void)
+{
+    if (events)
+        events->Stop();
 }
 
 void Agent::Init(void)
@@ -219,6 +368,12 @@ void Agent::Init(void)
              this, SLOT( Stop() ) );
     connect( s->MainUI()->actionMultipleVarbinds, SIGNAL( triggered() ),
              this, SLOT( Varbinds() ) );
+    connect( this, SIGNAL( TrapsQueued() ),
+             this, SLOT( DequeueTraps() ) );
+    connect( qApp, SIGNAL( aboutToQuit() ),
+             this, SLOT( StopTrapListeners() ) );
+    connect( qApp, SIGNAL( aboutToQuit() ),
+             this, SLOT( SaveKeyCache() ) );
 
     // Select the default profile from preferences
     QString cp;
@@ -258,8 +413,6 @@ void Agent::Init(void)
     connect( vbui->VarbindsList, SIGNAL( itemDoubleClicked(QTreeWidgetItem*, int) ), 
              this, SLOT( VarbindsEdit() ));
 
-    connect(&timer, SIGNAL(timeout()), this, SLOT(TimerExpired()));
-    
     // get the Boot counter (you may use any own method for this)
     char *engineId = (char*)"SnmpB_engine";
     unsigned int snmpEngineBoots = 0;
@@ -303,6 +456,13 @@ void Agent::Init(void)
     
     // Load the USM users from a file, if any
     usm->load_users(s->GetUsmUsersConfigFile().toLatin1().data());
+
+    // ... and the keys already generated from their passwords
+    LoadKeyCache();
+
+    // The v3MP object exists now, the trap listeners can decode messages
+    for (int i = 0; i < listeners.size(); i++)
+        listeners[i]->start();
 }
 
 void Agent::ShowAgentSettings(void)
@@ -503,6 +663,9 @@ void Agent::ConfigTargetFromSettings(snmp_version v, SnmpTarget *t,
     // Set retries and timeout values
     t->set_retry(ap->GetRetries());
     t->set_timeout(100 * ap->GetTimeout());
+
+    // Largest message sent to or accepted from the agent
+    t->set_max_msg_size(ap->GetMaxMsgSize());
 }
 
 Oid Agent::ConfigPduFromSettings(snmp_version v, const QString& oid, 
@@ -542,14 +705,6 @@ Oid Agent::ConfigPduFromSettings(snmp_version v, const QString& oid,
     return oidobj;
 }
 
-void Agent::TimerExpired(void)
-{
-  // When using async requests or if we are waiting for traps or
-  // informs, we must call this member function periodically, as
-  // snmp++ does not use an internal thread.
-  snmp->get_eventListHolder()->SNMPProcessPendingEvents();
-}
-
 char *Agent::GetPrintableValue(SmiNode *node, Vb *vb)
 {  
     SmiValue myvalue;
@@ -649,47 +804,60 @@ SmiNode* Agent::GetNodeFromOid(Oid &oid)
     if (oidlen <= 0)
         return node; 
 
-    SmiSubid *ioid = new SmiSubid[oidlen];
+    // libsmi subids are 32 bits, convert on the stack for usual lengths
+    SmiSubid buf[OID_INLINE_LEN];
+    SmiSubid *ioid = (oidlen <= OID_INLINE_LEN) ? buf : new SmiSubid[oidlen];
+    const SmiUINT32 *subids = oid.oidval()->ptr;
 
     for (int idx = 0; idx < oidlen; idx++)
-        ioid[idx] = oid[idx];
+        ioid[idx] = subids[idx];
 
     node = smiGetNodeByOID(oidlen, &ioid[0]);
 
-    delete [] ioid;
+    if (ioid != buf)
+        delete [] ioid;
 
     return node;
 }
 
 void Agent::AsyncCallbackTrap(int reason, Pdu &pdu, SnmpTarget &target)
+{
+    // Bad message type or if there's an error in the pdu, bail out ...
+    if ((reason != SNMP_CLASS_NOTIFICATION) || pdu.get_error_status())
+        return;
+
+    AddTrap(pdu, target);
+
+    // If its an inform, we have to reply ...
+    ReplyInform(snmp, pdu, target);
+}
+
+void Agent::AddTrap(Pdu &pdu, SnmpTarget &target)
 {
     static unsigned int nbr = 1;
-    Vb vb;
     GenAddress addr;
     TimeTicks ts;
     Oid id;
     int status = 0;
-                
-    // Bad message type or if there's an error in the pdu, bail out ...
-    if ((reason != SNMP_CLASS_NOTIFICATION) || pdu.get_error_status())
-        return;
-    
-    // Create string objects and collect info below
-    QString no, date, time, timestamp, nottype, 
-            msgtype, version, agtaddr, agtport, 
-            community, seclevel, ctxname, ctxid, msgid;
+
+    // Collect the trap info below
+    trap_info ti;
     
     target.get_address(addr);
     IpAddress agent(addr);
     UdpAddress agentUDP(addr);
     
-    char buf[10];
-    sprintf(buf, "%.4u", nbr);
-    no = QString("%1").arg(buf);
-    date = QDate::currentDate().toString(Qt::ISODate);
-    time = QTime::currentTime().toString(Qt::ISODate);  
+    ti.nbr = nbr;
+    ti.agent = agent;
+    ti.msgid = 0;
+
+    // Account for traps sent by our own trap generator (benchmark mode)
+    if (s->TrapGenObj())
+        s->TrapGenObj()->Received(pdu);
+
+    ti.received = QDateTime::currentMSecsSinceEpoch();
     pdu.get_notify_timestamp(ts);
-    timestamp = ts.get_printable();
+    ti.timestamp = (unsigned long)ts;
   
     pdu.get_notify_id(id);
     SmiNode *node = GetNodeFromOid(id);
@@ -702,44 +870,44 @@ void Agent::AsyncCallbackTrap(int reason, Pdu &pdu, SnmpTarget &target)
         /* f is now the remaining part */
       
         // Print the OID part
-        nottype = node->name;
-        if (*f != '\0') nottype += QString(f);
+        ti.nottype = node->name;
+        if (*f != '\0') ti.nottype += QString(f);
     }
     else
-        nottype = id.get_printable();
+        ti.nottype = id.get_printable();
       
     switch(pdu.get_type())
     {
     case sNMP_PDU_V1TRAP:
-        msgtype = "Trap(v1)";
+        ti.msgtype = "Trap(v1)";
         break;
     case sNMP_PDU_TRAP:
-        msgtype = "Trap(v2)";
+        ti.msgtype = "Trap(v2)";
         break;
     case sNMP_PDU_INFORM:
-        msgtype = "Inform";
+        ti.msgtype = "Inform";
         break;
     case sNMP_PDU_REPORT:
-        msgtype = "Report";
+        ti.msgtype = "Report";
         break;
     default:
-        msgtype = "Unknown";
+        ti.msgtype = "Unknown";
         break;
     }
   
     switch(target.get_version())
     {
     case version1:
-        version = "SNMPv1";
+        ti.version = "SNMPv1";
         break;
     case version2c:
-        version = "SNMPv2c";
+        ti.version = "SNMPv2c";
         break;
     case version3:
-        version = "SNMPv3";
+        ti.version = "SNMPv3";
         break;
     default:
-        version = "Unknown";
+        ti.version = "Unknown";
         break;
     }
     
@@ -749,69 +917,155 @@ void Agent::AsyncCallbackTrap(int reason, Pdu &pdu, SnmpTarget &target)
     if ((s->PreferencesObj()->GetShowAgentName() == true) &&
         ((name = agent.friendly_name(status)) != NULL) &&
         (strlen(name) != 0))
-        agtaddr = QString("%1/%2").arg(name).arg(add);
+        ti.agtaddr = QString("%1/%2").arg(name).arg(add);
     else
-        agtaddr = add;
+        ti.agtaddr = add;
     
-    agtport = QString("%1").arg(agentUDP.get_port());
+    ti.agtport = agentUDP.get_port();
             
     if (target.get_type() == SnmpTarget::type_ctarget)
     {
-        community = ((CTarget*)&target)->get_readcommunity();
+        ti.community = ((CTarget*)&target)->get_readcommunity();
     }
     else
     {
-        ctxname = pdu.get_context_name().get_printable();
-        ctxid = pdu.get_context_engine_id().get_printable();
-        msgid = pdu.get_message_id();
+        ti.ctxname = pdu.get_context_name().get_printable();
+        ti.ctxid = pdu.get_context_engine_id().get_printable();
+        ti.msgid = pdu.get_message_id();
         switch(pdu.get_security_level())
         {
             case SNMP_SECURITY_LEVEL_NOAUTH_NOPRIV:
-                seclevel = "NoAuthNoPriv";
+                ti.seclevel = "NoAuthNoPriv";
             break;
             case SNMP_SECURITY_LEVEL_AUTH_NOPRIV:
-                seclevel = "AuthNoPriv";
+                ti.seclevel = "AuthNoPriv";
             break;
             case SNMP_SECURITY_LEVEL_AUTH_PRIV:
-                seclevel = "AuthPriv";
+                ti.seclevel = "AuthPriv";
             break;
             default:
-                seclevel = "Unknown";
+                ti.seclevel = "Unknown";
         }
     }
 
-    // Add the trap ...
-    QStringList values;
-    values << no << date << time << timestamp << nottype 
-           << msgtype << version << agtaddr << agtport;
-    TrapItem *ti = s->TrapObj()->Add(id, values, community, seclevel, 
-                                     ctxname, ctxid, msgid);
- 
-    // Now, loop thru all varbinds and extract info ...
+    // Add the trap, with its varbinds ...
+    s->TrapObj()->Add(id, ti, pdu);
+  
+    nbr++;
+}
+
+void Agent::ReplyInform(Snmp *session, Pdu &pdu, SnmpTarget &target)
+{
+    if (pdu.get_type() != sNMP_PDU_INFORM)
+        return;
+
+    TimeTicks ts;
+    Oid id;
+    pdu.get_notify_timestamp(ts);
+    pdu.get_notify_id(id);
+
+    // Copy the PDU object to feed back in the response
+    Pdu ipdu = pdu;
+    Vb t(Oid("1.3.6.1.2.1.1.3.0"));
+    t.set_value(ts);
+    Vb d(Oid("1.3.6.1.6.3.1.1.4.1.0"));
+    d.set_value(id);
+    ipdu.trim(pdu.get_vb_count()); // Remove all varbinds first
+    ipdu += t; ipdu += d;
     for (int i=0; i < pdu.get_vb_count(); i++)
+        ipdu += pdu.get_vb(i);
+
+    session->response(ipdu, target, session->get_notify_callback_fd());
+}
+
+// Called from the trap listener threads, the pdu is moved to the queue
+void Agent::QueueTrap(Pdu &pdu, SnmpTarget &target)
+{
+    SnmpTarget *t = target.clone();
+
+    trapqueue_mutex.lock();
+    bool wasempty = trapqueue.isEmpty();
+    // QList copies what is appended: append an empty entry, then move
+    trapqueue.append(trap_data());
+    trapqueue.last().pdu = std::move(pdu);
+    trapqueue.last().target = t;
+    trapqueue_mutex.unlock();
+
+    // One queued signal per batch of traps is enough
+    if (wasempty)
+        emit TrapsQueued();
+}
+
+void Agent::DequeueTraps(void)
+{
+    QList<trap_data> traps;
+
+    trapqueue_mutex.lock();
+    traps.swap(trapqueue);
+    trapqueue_mutex.unlock();
+
+    for (int i = 0; i < traps.size(); i++)
     {
-        pdu.get_vb(vb, i);
-        ti->AddVarBind(vb);
+        AddTrap(traps[i].pdu, *traps[i].target);
+        delete traps[i].target;
     }
-  
-    // If its an inform, we have to reply ...
-    if (pdu.get_type() == sNMP_PDU_INFORM)
-    {
-        // Copy the PDU object to feed back in the response
-        Pdu ipdu = pdu;
-        Vb t(Oid("1.3.6.1.2.1.1.3.0"));
-        t.set_value(ts);
-        Vb d(Oid("1.3.6.1.6.3.1.1.4.1.0"));
-        d.set_value(id);
-        ipdu.trim(pdu.get_vb_count()); // Remove all varbinds first
-        ipdu += t; ipdu += d;
-        for (int i=0; i < pdu.get_vb_count(); i++)
-            ipdu += pdu[i];
+}
 
-        snmp->response(ipdu, target, snmp->get_notify_callback_fd());
-    }
-  
-    nbr++;
+TrapListener::TrapListener(Agent *agent, bool v4, bool v6, 
+                           int port4, int port6)
+{
+    a = agent;
+    snmp = NULL;
+    aborting.storeRelease(0);
+
+    if (v4 && v6)
+        snmp = new Snmp(status, UdpAddress("0.0.0.0"), UdpAddress("::"));
+    else if (v4)
+        snmp = new Snmp(status, UdpAddress("0.0.0.0"));
+    else
+        snmp = new Snmp(status, UdpAddress("::"));
+
+    if (status != SNMP_CLASS_SUCCESS)
+        return;
+
+    // Share the trap ports with the other listeners
+    snmp->notify_set_listen_port(port4);
+    snmp->notify_set_listen_port6(port6);
+    snmp->notify_set_reuse_port(true);
+
+    OidCollection oidc;
+    TargetCollection targetc;
+
+    status = snmp->notify_register(oidc, targetc, callback_trap_listener, this);
+}
+
+TrapListener::~TrapListener()
+{
+    if (snmp)
+        delete snmp;
+}
+
+void TrapListener::run()
+{
+    while (!aborting.loadAcquire())
+        snmp->get_eventListHolder()->SNMPProcessEvents(TRAP_TIMER_MSEC);
+}
+
+void TrapListener::Abort()
+{
+    aborting.storeRelease(1);
+}
+
+void TrapListener::CallbackTrap(int reason, Pdu &pdu, SnmpTarget &target)
+{
+    // Bad message type or if there's an error in the pdu, bail out ...
+    if ((reason != SNMP_CLASS_NOTIFICATION) || pdu.get_error_status())
+        return;
+
+    // Reply from the session that received the inform, then hand over
+    // the decoded trap to the GUI thread
+    Agent::ReplyInform(snmp, pdu, target);
+    a->QueueTrap(pdu, target);
 }
 
 void Agent::AsyncCallback(int reason, Pdu &pdu,
@@ -832,6 +1086,14 @@ void Agent::AsyncCallback(int reason, Pdu &pdu,
     case SNMP_CLASS_SESSION_DESTROYED:
         break;
     case SNMP_CLASS_TIMEOUT:
+        // A walk that grew its requests may have lost a large response
+        // on the way (dropped fragments), retry with the initial size
+        if (iswalk && (stop == false) && (walkreps > walkinitreps))
+        {
+            walkreps = walkinitreps;
+            walkgrow = false;
+            goto next;
+        }
         msg = "<font color=red>Timeout</font>";
         goto cleanup;
     default:
@@ -848,6 +1110,15 @@ void Agent::AsyncCallback(int reason, Pdu &pdu,
         if (iswalk && (pdu_error == SNMP_ERROR_NO_SUCH_NAME))
             goto end;
 
+        // The agent could not fit the response, ask for less
+        if (iswalk && (stop == false) && 
+            (pdu_error == SNMP_ERROR_TOO_BIG) && (walkreps > 1))
+        {
+            walkreps /= 2;
+            walkgrow = false;
+            goto next;
+        }
+
         pdu_index = pdu.get_error_index();
         if (pdu_index > 0)
             start_index = objects = pdu_index-1;
@@ -870,6 +1141,14 @@ void Agent::AsyncCallback(int reason, Pdu &pdu,
  
     for ( z=start_index; z < pdu.get_vb_count(); z++)
     {
+        // Stop at the first received varbind out of scope, before
+        // decoding it
+        VbView view;
+        if (iswalk && pdu.get_vb_view(view, z) &&
+            (view.get_syntax() != sNMP_SYNTAX_ENDOFMIBVIEW) &&
+            view.nCompare(theoid.len(), theoid))
+            goto end;
+
         pdu.get_vb( vb, z );
 
         // look for var bind exception, applies to v2 only   
@@ -883,7 +1162,7 @@ void Agent::AsyncCallback(int reason, Pdu &pdu,
                 vb_error = 0;
 
             // Stop there if we're out of scope
-            if (iswalk && tmp.nCompare(theoid.len(), theoid))
+            if (iswalk && !tmp.in_subtree_of(theoid))
             {
                 goto end;
             }
@@ -1013,19 +1292,21 @@ node_restart:
     {
         // Issue next get_bulk ...
         // last vb becomes seed of next request
-        pdu.set_vblist(&vb, 1);
+        WalkRepetitions(pdu, target);
+        walkseed = vb;
+next:
+        pdu.set_vblist(&walkseed, 1);
  
         // Now do an async get_bulk
         AgentProfile *ap = s->APManagerObj()->GetAgentProfile
                             (s->MainUI()->AgentProfile->currentText());
         status = snmp->get_bulk(pdu, target, ap?ap->GetNonRepeaters():0, 
-                                ap?ap->GetMaxRepetitions():10, 
-                                callback_walk, this);
+                                walkreps, callback_walk, this);
 
         // Could we send it?
         if (status == SNMP_CLASS_SUCCESS)
         {
-            timer.start(ASYNC_TIMER_MSEC);
+            events->Update();
             return;
         }
         else
@@ -1042,17 +1323,66 @@ end:
     else
         msg += "-----SNMP query finished-----<br>";
     msg += "<font color=#009000>Total # of Requests = ";    
-    msg += QString("%1<br>Total # of Objects = %2</font>")
+    msg += QString("%1<br>Total # of Objects = %2")
                     .arg(requests).arg(objects);
+    msg += RoundTripTime(target);
+    msg += "</font>";
 cleanup:
     s->MainUI()->Query->append(msg);
-    // Dont stop the timer, but put it back to the lower-rate trap timer value
-    timer.start(TRAP_TIMER_MSEC);
+    // Keep handling traps, and events again if they were stopped
+    events->Update();
     s->MibModuleObj()->SetLoadingPolicy(MibModule::MIBLOAD_DEFAULT);
     emit StartWalk(false);
     s->MainUI()->actionStop->setEnabled(false);
 }
 
+// Max-repetitions of the next request of a walk. As long as the agent
+// returns all the varbinds asked for, ask for as many as the size of
+// the last ones suggests fit in the maximum message size of the target.
+// An agent that returns fewer has reached its own limit.
+void Agent::WalkRepetitions(const Pdu &pdu, const SnmpTarget &target)
+{
+    int count = pdu.get_vb_count();
+    if (count <= 0)
+        return;
+
+    if (count < walkreps)
+    {
+        walkreps = count;
+        walkgrow = false;
+        return;
+    }
+
+    if (walkgrow == false)
+        return;
+
+    int space = target.get_max_msg_size() - WALK_MSG_HEADER;
+    int length = pdu.get_asn1_length();
+    if ((space <= 0) || (length <= 0))
+        return;
+
+    int reps = (int)((long)space * count / length);
+    if (reps > walkreps)
+        walkreps = reps;
+}
+
+// Round-trip times measured on the agent of the target, for the
+// query summary
+QString Agent::RoundTripTime(SnmpTarget &target)
+{
+    SnmpRttStats stats;
+
+    if (!snmp->get_rtt_stats(target.get_address(), stats) || !stats.samples)
+        return "";
+
+    return QString("<br>Round-trip time = %1 ms (smoothed %2 ms, "
+                   "variation %3 ms)<br>Retransmission timeout = %4 ms, "
+                   "%5 retransmission(s), %6 timeout(s)")
+                   .arg(stats.last_rtt).arg(stats.srtt).arg(stats.rttvar)
+                   .arg(stats.rto).arg(stats.retransmissions)
+                   .arg(stats.timeouts);
+}
+
 void Agent::AsyncCallbackSet(int reason, Pdu &pdu, SnmpTarget &target)
 {
     int pdu_error;
@@ -1196,8 +1526,8 @@ end:
 
 cleanup:
     s->MainUI()->Query->append(msg);
-    // Dont stop the timer, but put it back to the lower-rate trap timer value
-    timer.start(TRAP_TIMER_MSEC);
+    // Keep handling traps, and events again if they were stopped
+    events->Update();
 }
 
 
@@ -1223,17 +1553,22 @@ void Agent::WalkFrom(const QString& oid)
     emit StartWalk(true);
     s->MainUI()->actionStop->setEnabled(true);
  
-    // Now do an async get_bulk
+    // Now do an async get_bulk, starting with the max-repetitions of
+    // the profile
     AgentProfile *ap = s->APManagerObj()->GetAgentProfile
                         (s->MainUI()->AgentProfile->currentText());
+    walkinitreps = walkreps = ap?ap->GetMaxRepetitions():10;
+    if (walkreps < 1)
+        walkinitreps = walkreps = 1;
+    walkgrow = true;
+    pdu->get_vb(walkseed, 0);
     status = snmp->get_bulk(*pdu, *target, ap?ap->GetNonRepeaters():0, 
-                            ap?ap->GetMaxRepetitions():10, 
-                            callback_walk, this);
+                            walkreps, callback_walk, this);
 
     // Could we send it?
     if (status == SNMP_CLASS_SUCCESS)
     {
-        timer.start(ASYNC_TIMER_MSEC);
+        events->Update();
     }
     else
     {
@@ -1290,7 +1625,7 @@ void Agent::Get(const QString& oid, bool usevblist)
     // Could we send it?
     if (status == SNMP_CLASS_SUCCESS)
     {
-        timer.start(ASYNC_TIMER_MSEC);
+        events->Update();
     }
     else
     {
@@ -1329,7 +1664,7 @@ void Agent::GetNext(const QString& oid, bool usevblist)
     // Could we send it?
     if (status == SNMP_CLASS_SUCCESS)
     {
-        timer.start(ASYNC_TIMER_MSEC);
+        events->Update();
     }
     else
     {
@@ -1372,7 +1707,7 @@ void Agent::GetBulk(const QString& oid, bool usevblist)
     // Could we send it?
     if (status == SNMP_CLASS_SUCCESS)
     {
-        timer.start(ASYNC_TIMER_MSEC);
+        events->Update();
     }
     else
     {
@@ -1411,7 +1746,7 @@ void Agent::Set(const QString& oid, bool usevblist)
     // Could we send it?
     if (status == SNMP_CLASS_SUCCESS)
     {
-        timer.start(ASYNC_TIMER_MSEC);
+        events->Update();
     }
     else
     {
@@ -1445,17 +1780,20 @@ void Agent::SetFrom(const QString& oid)
 void Agent::Stop(void)
 {
     stop = true;
+
+    if (tvreply)
+        TableViewFinish("<font color=red>-----SNMP query stopped-----</font><br>");
 }
 
-/* TODO: make it async */
 void Agent::TableViewFrom(const QString& oid)
 {
     // Initialize agent & pdu objects
     SnmpTarget *target;
     Pdu *pdu;
-    Vb tvb;
-    Oid toid;
-    int rows = 0;
+
+    // Replaces the table view in progress, if any
+    if (tvreply)
+        TableViewFinish("<font color=red>-----SNMP query stopped-----</font><br>");
     
     if (Setup(oid, &target, &pdu) < 0)
         return;
@@ -1500,91 +1838,164 @@ void Agent::TableViewFrom(const QString& oid)
         msg += QString("<td>%1</td>").arg(node->name);
     }    
     msg += QString("</tr>");
+
+    tvtarget = target;
+    tvpdu = pdu;
+    tvnode = pnode;
+    tvpoid = poid;
+    tvroid = poid;
+    tvrows = 0;
     
     /* Get next on the parent to get the first entry ... */
-    tvb.set_oid(poid);
-    pdu->set_vblist(&tvb, 1);
+    tvvb.set_oid(poid);
+    tvpdu->set_vblist(&tvvb, 1);
     
-    Oid roid(poid);
-    int first = 1;
+    // Now do an async get_next, the rows are read one at a time
+    tvreply = SendRequest(sNMP_PDU_GETNEXT, tvtarget, tvpdu, this);
+    connect(tvreply, SIGNAL(finished(SnmpReply*)), 
+            this, SLOT(TableViewReply(SnmpReply*)));
+
+    emit StartWalk(true);
+    s->MainUI()->actionStop->setEnabled(true);
+}
+
+void Agent::TableViewReply(SnmpReply *reply)
+{
+    // Reply of a table view that was replaced or stopped
+    if (reply != tvreply)
+        return;
+
+    const Pdu &pdu = reply->GetPdu();
+
+    // Response to the get_next: the first column of the next row
+    if ((reply->GetStatus() != SNMP_CLASS_SUCCESS) ||
+        (pdu.get_error_status() != SNMP_ERROR_SUCCESS))
+    {
+        TableViewFinish("-----SNMP query finished-----<br>");
+        return;
+    }
+
+    pdu.get_vb(tvvb, 0);
+    Oid toid = tvvb.get_oid();
     
-    // Now do a sync get_next
-    while (snmp->get_next(*pdu, *target) == SNMP_CLASS_SUCCESS)
+    // look for var bind exception, applies to v2 only   
+    if ((tvvb.get_syntax() == sNMP_SYNTAX_ENDOFMIBVIEW) ||
+        (toid.len() <= tvpoid.len()) ||
+        !toid.in_subtree_of(tvpoid))
     {
-        pdu->get_vb(tvb, 0);
-        toid = tvb.get_oid();
-        
-        if (first) /* Get the column id we'll iterate on */
-        {
-            first = 0; /* reset the flag */
-            roid += toid[poid.len()];
-        }
+        TableViewFinish("-----SNMP query finished-----<br>");
+        return;
+    }
 
-        // look for var bind exception, applies to v2 only   
-        if ( tvb.get_syntax() == sNMP_SYNTAX_ENDOFMIBVIEW )
-            break;
-        
-        /* Make sure we dont get out of table scope ... */
-        if (toid.nCompare(roid.len(), roid))
-            break;
-        
-        /* Get & print the instance part */
-        char *b = (char*)roid.get_printable();
-        char *f = (char*)tvb.get_printable_oid();
-        while ((*b++ == *f++) && (*b != '\0') && (*f != '\0')) ;
-        /* f is now the remaining part */
-        f++; /* skip . */
-        if (*f != '\0') msg += QString("<tr><td bgcolor=pink>%1</td>").arg(f);
-        
-        /* Loop thru all columns of that instance and build the row */
-        for (SmiNode *node = smiGetFirstChildNode(pnode); node != NULL;
-             node = smiGetNextChildNode(node))
-        {
-            Vb svb;
-            toid = Oid (smiRenderOID(node->oidlen, node->oid, SMI_RENDER_NUMERIC));
-            toid += f;
-            svb.set_oid(toid);    
-            pdu->set_vblist(&svb, 1);
-            
-            // Now do an sync get
-            int status = snmp->get(*pdu, *target);
+    if (tvroid.len() == tvpoid.len()) /* Get the column id we'll iterate on */
+        tvroid += toid[tvpoid.len()];
+    
+    /* Make sure we dont get out of table scope ... */
+    if (!toid.in_subtree_of(tvroid))
+    {
+        TableViewFinish("-----SNMP query finished-----<br>");
+        return;
+    }
+    
+    /* Get & print the instance part */
+    char *b = (char*)tvroid.get_printable();
+    char *f = (char*)tvvb.get_printable_oid();
+    while ((*b++ == *f++) && (*b != '\0') && (*f != '\0')) ;
+    /* f is now the remaining part */
+    f++; /* skip . */
+    if (*f != '\0') msg += QString("<tr><td bgcolor=pink>%1</td>").arg(f);
+    
+    /* Get all columns of that instance at once, merged by the coalescer */
+    for (SmiNode *node = smiGetFirstChildNode(tvnode); node != NULL;
+         node = smiGetNextChildNode(node))
+    {
+        Vb svb;
+        Oid coid(smiRenderOID(node->oidlen, node->oid, SMI_RENDER_NUMERIC));
+        coid += f;
+        svb.set_oid(coid);    
+        tvpdu->set_vblist(&svb, 1);
 
-            pdu->get_vb(svb, 0);
+        SnmpReply *cell = coalescer->Get(*tvpdu, *tvtarget, this);
+        connect(cell, SIGNAL(finished(SnmpReply*)), 
+                this, SLOT(TableViewCell(SnmpReply*)));
+        tvcells.append(cell);
+    }
 
-            if ((pdu->get_error_status() == SNMP_ERROR_NO_SUCH_NAME) || // For v1
-                (svb.get_syntax() == sNMP_SYNTAX_NOSUCHOBJECT) ||       // For v2
-                (svb.get_syntax() == sNMP_SYNTAX_NOSUCHINSTANCE)) 
-            {
-                msg += QString("<td>not available</td>");
-            }
-            else
-            if (status != SNMP_CLASS_SUCCESS)
-            {
-                msg += QString("<td>not available</td>");
-            }
-            else
-                msg += QString("<td>%1</td>")
+    tvpending = tvcells.size();
+    if (tvpending == 0)
+        TableViewRow();
+}
+
+void Agent::TableViewCell(SnmpReply *reply)
+{
+    // Cell of a table view that was replaced or stopped
+    if (!tvcells.contains(reply))
+        return;
+
+    if (--tvpending == 0)
+        TableViewRow();
+}
+
+void Agent::TableViewRow(void)
+{
+    /* Build the row from the cells, in column order */
+    SmiNode *node = smiGetFirstChildNode(tvnode);
+    for (int i = 0; i < tvcells.size(); i++, node = smiGetNextChildNode(node))
+    {
+        SnmpReply *cell = tvcells[i];
+        const Pdu &pdu = cell->GetPdu();
+        Vb svb;
+        pdu.get_vb(svb, 0);
+
+        if ((cell->GetStatus() != SNMP_CLASS_SUCCESS) ||
+            (pdu.get_error_status() == SNMP_ERROR_NO_SUCH_NAME) || // For v1
+            (svb.get_syntax() == sNMP_SYNTAX_NOSUCHOBJECT) ||       // For v2
+            (svb.get_syntax() == sNMP_SYNTAX_NOSUCHINSTANCE)) 
+        {
+            msg += QString("<td>not available</td>");
+        }
+        else
+            msg += QString("<td>%1</td>")
 #if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
-                                   .arg(Qt::escape(GetPrintableValue(node, &svb)));
+                               .arg(Qt::escape(GetPrintableValue(node, &svb)));
 #else
-                                   .arg(QString(GetPrintableValue(node, &svb)).toHtmlEscaped());
+                               .arg(QString(GetPrintableValue(node, &svb)).toHtmlEscaped());
 #endif
 
-        }
-        msg += QString("</tr>");
-        rows++;
-        
-        // Next get_next ...
-        pdu->set_vblist(&tvb, 1);   
+        cell->deleteLater();
     }
+    tvcells.clear();
+
+    msg += QString("</tr>");
+    tvrows++;
     
+    // Next get_next ...
+    tvpdu->set_vblist(&tvvb, 1);
+    tvreply->deleteLater();
+    tvreply = SendRequest(sNMP_PDU_GETNEXT, tvtarget, tvpdu, this);
+    connect(tvreply, SIGNAL(finished(SnmpReply*)), 
+            this, SLOT(TableViewReply(SnmpReply*)));
+}
+
+void Agent::TableViewFinish(const QString& result)
+{
+    tvreply->deleteLater();
+    tvreply = NULL;
+    for (int i = 0; i < tvcells.size(); i++)
+        tvcells[i]->deleteLater();
+    tvcells.clear();
+    delete tvtarget;
+    delete tvpdu;
+    tvtarget = NULL;
+    tvpdu = NULL;
+
     msg += QString("</table>");
-    msg += "-----SNMP query finished-----<br>";
-    msg += QString("<font color=#009000>Total # of rows = %1<br>").arg(rows);
+    msg += result;
+    msg += QString("<font color=#009000>Total # of rows = %1<br>").arg(tvrows);
     s->MainUI()->Query->append(msg);
-    
-    delete target;
-    delete pdu;
+
+    emit StartWalk(false);
+    s->MainUI()->actionStop->setEnabled(false);
 }
 
 QString Agent::GetValueString(MibSelection &ms, Vb* vb)
@@ -1901,7 +2312,6 @@ int Agent::SelectTableInstance(const QString& oid, QString& outinstance)
     SnmpTarget *target;
     Pdu *pdu;
     Vb tvb;
-    Oid toid;
     int res = 0;
 
     if (Setup(oid, &target, &pdu) < 0)
@@ -1945,34 +2355,28 @@ int Agent::SelectTableInstance(const QString& oid, QString& outinstance)
     dlist.raise();
     dlist.activateWindow();
 
-    // Now do a sync get_next
-    while (snmp->get_next(*pdu, *target) == SNMP_CLASS_SUCCESS)
-    {
-        pdu->get_vb(tvb, 0);
-        toid = tvb.get_oid();
-
-        // look for var bind exception, applies to v2 only   
-        if ( tvb.get_syntax() == sNMP_SYNTAX_ENDOFMIBVIEW )
-            break;
-
-        /* Make sure we dont get out of table scope ... */
-        if (toid.nCompare(roid.len(), roid))
-            break;
-
-        /* Get & print the instance part */
-        char *b = (char*)roid.get_printable();
-        char *f = (char*)tvb.get_printable_oid();
-        while ((*b++ == *f++) && (*b != '\0') && (*f != '\0')) ;
-        /* f is now the remaining part */
-        if (*++f != '\0')
-            ilist.addItem(f);
-        // Next get_next ...
-        pdu->set_vblist(&tvb, 1);   
-    }
+    // Now do an async get_next, the instances are listed as they arrive
+    sitarget = target;
+    sipdu = pdu;
+    sioid = roid;
+    silist = &ilist;
+    sireply = SendRequest(sNMP_PDU_GETNEXT, sitarget, sipdu, this);
+    connect(sireply, SIGNAL(finished(SnmpReply*)), 
+            this, SLOT(SelectInstanceReply(SnmpReply*)));
 
     // Wait for the result
     dlist.exec();
 
+    // The instances may not all be listed yet
+    if (sireply)
+    {
+        delete sireply;
+        sireply = NULL;
+    }
+    sitarget = NULL;
+    sipdu = NULL;
+    silist = NULL;
+
     if (ilist.selectedItems().size() != 0)
     {
         outinstance = ilist.selectedItems().at(0)->text();
@@ -1990,6 +2394,49 @@ int Agent::SelectTableInstance(const QString& oid, QString& outinstance)
     return res;
 }
 
+void Agent::SelectInstanceReply(SnmpReply *reply)
+{
+    // Reply of a selection dialog that was closed
+    if (reply != sireply)
+        return;
+
+    sireply = NULL;
+    reply->deleteLater();
+
+    const Pdu &pdu = reply->GetPdu();
+    Vb tvb;
+    Oid toid;
+
+    if ((reply->GetStatus() != SNMP_CLASS_SUCCESS) ||
+        (pdu.get_error_status() != SNMP_ERROR_SUCCESS))
+        return;
+
+    pdu.get_vb(tvb, 0);
+    toid = tvb.get_oid();
+
+    // look for var bind exception, applies to v2 only   
+    if ( tvb.get_syntax() == sNMP_SYNTAX_ENDOFMIBVIEW )
+        return;
+
+    /* Make sure we dont get out of table scope ... */
+    if (!toid.in_subtree_of(sioid))
+        return;
+
+    /* Get & print the instance part */
+    char *b = (char*)sioid.get_printable();
+    char *f = (char*)tvb.get_printable_oid();
+    while ((*b++ == *f++) && (*b != '\0') && (*f != '\0')) ;
+    /* f is now the remaining part */
+    if (*++f != '\0')
+        silist->addItem(f);
+
+    // Next get_next ...
+    sipdu->set_vblist(&tvb, 1);   
+    sireply = SendRequest(sNMP_PDU_GETNEXT, sitarget, sipdu, this);
+    connect(sireply, SIGNAL(finished(SnmpReply*)), 
+            this, SLOT(SelectInstanceReply(SnmpReply*)));
+}
+
 void Agent::GetFromSelectInstance(const QString& oid, int op)
 {
     int res = 0;
@@ -2061,37 +2508,61 @@ void Agent::GetFromPromptInstance(const QString& oid, int op)
     delete le;
 }
 
-unsigned long Agent::GetSyncValue(const QString& oid)
+SnmpReply *Agent::SendRequest(unsigned short type, SnmpTarget *target,
+                              Pdu *pdu, QObject *parent)
+{
+    SnmpRequest *request;
+
+    if (type == sNMP_PDU_GETNEXT)
+        request = snmp->get_next_async(*pdu, *target);
+    else
+        request = snmp->get_async(*pdu, *target);
+
+    // For the timeout of the request
+    events->Update();
+
+    return new SnmpReply(request, parent);
+}
+
+SnmpReply *Agent::AsyncGet(const QString& oid, QObject *parent)
 {
     // Initialize agent & pdu objects
     SnmpTarget *target;
     Pdu *pdu;
-    Vb vb;
     if (Setup(oid, &target, &pdu) < 0)
+        return NULL;
+
+    // Now do an async get, merged with the other gets to that agent
+    SnmpReply *reply = coalescer->Get(*pdu, *target, parent);
+
+    delete target;
+    delete pdu;
+
+    return reply;
+}
+
+unsigned long Agent::GetNumericValue(const Pdu &pdu)
+{
+    Vb vb;
+    unsigned long _uint32 = 0;
+    long _int32 = 0;
+
+    if (!pdu.get_vb(vb, 0))
         return 0;
-        
-    // Now do a sync get
-    if (snmp->get(*pdu, *target) == SNMP_CLASS_SUCCESS)
-    {
-        pdu->get_vb(vb, 0);
-        
-        unsigned long _uint32 = 0;
-        long _int32 = 0;
-        
-        switch(vb.get_syntax())
-        {
-        case sNMP_SYNTAX_INT32:
-            vb.get_value(_int32);
-            return _int32;
-        case sNMP_SYNTAX_CNTR32:
-        case sNMP_SYNTAX_GAUGE32: /* also sNMP_SYNTAX_UINT32*/
-        case sNMP_SYNTAX_TIMETICKS:
-            vb.get_value(_uint32);
-            return _uint32;
-        /* TODO: case sNMP_SYNTAX_CNTR64: */
-        default:
-            break;
-        }
+
+    switch(vb.get_syntax())
+    {
+    case sNMP_SYNTAX_INT32:
+        vb.get_value(_int32);
+        return _int32;
+    case sNMP_SYNTAX_CNTR32:
+    case sNMP_SYNTAX_GAUGE32: /* also sNMP_SYNTAX_UINT32*/
+    case sNMP_SYNTAX_TIMETICKS:
+        vb.get_value(_uint32);
+        return _uint32;
+    /* TODO: case sNMP_SYNTAX_CNTR64: */
+    default:
+        break;
     }
     
     return 0;
@@ -27,8 +27,39 @@
 #include "trap.h"
 #include "mibselection.h"
 #include "agentprofile.h"
+#include "snmpevents.h"
 #include "ui_varbinds.h"
 
+class Agent;
+
+typedef struct
+{
+    Pdu pdu;
+    SnmpTarget *target;
+} trap_data;
+
+// One of several trap receivers sharing the trap ports (SO_REUSEPORT).
+// Each has its own snmp++ session and thread to receive and decode
+// traps and to reply to informs. Decoded traps go to the Agent.
+class TrapListener: public QThread
+{
+    Q_OBJECT
+
+public:
+    TrapListener(Agent *agent, bool v4, bool v6, int port4, int port6);
+    ~TrapListener();
+    void run();
+    void Abort();
+    int GetStatus(void) { return status; };
+    void CallbackTrap(int reason, Pdu &pdu, SnmpTarget &target);
+
+protected:
+    Agent *a;
+    Snmp *snmp;
+    int status;
+    QAtomicInt aborting;        // set by the GUI thread
+};
+
 class Agent: public QObject
 {
     Q_OBJECT
@@ -36,12 +67,16 @@ class Agent: public QObject
 public:
     Agent(Snmpb *snmpb);
     bool GetStartupResult(QString &Err);
-    void StartTrapTimer(void);
+    void StartEvents(void);
+    void ConfigureCoalescing(void);
+    void ConfigureTimeouts(void);
     void Init(void);
     void AsyncCallback(int reason, Pdu &pdu, 
                        SnmpTarget &target, int iswalk);
     void AsyncCallbackTrap(int reason, Pdu &pdu, SnmpTarget &target);
     void AsyncCallbackSet(int reason, Pdu &pdu, SnmpTarget &target);
+    void QueueTrap(Pdu &pdu, SnmpTarget &target);
+    static void ReplyInform(Snmp *session, Pdu &pdu, SnmpTarget &target);
     
     static char *GetPrintableValue(SmiNode *node, Vb *vb);
     void ConfigTargetFromSettings(snmp_version v,
@@ -49,10 +84,12 @@ public:
     Oid ConfigPduFromSettings(snmp_version v, const QString& oid, 
                               Pdu *p, AgentProfile *ap, bool usevblist = false);
     
-    // Used by graph update timer
-    unsigned long GetSyncValue(const QString& oid);
+    // Used by graph update timer, NULL if the request could not be set up
+    SnmpReply *AsyncGet(const QString& oid, QObject *parent);
+    static unsigned long GetNumericValue(const Pdu &pdu);
 
     inline USM *GetUSMObj(void) { return v3mp->get_usm(); };
+    void DeriveUserKeys(void);
 
     int SelectTableInstance(const QString& oid, QString& outinstance);
 
@@ -63,7 +100,17 @@ protected:
 
 private:
     QString GetValueString(MibSelection &ms, Vb* vb);
+    void AddTrap(Pdu &pdu, SnmpTarget &target);
+    void StartTrapListeners(int count, bool v4, bool v6, int port4, int port6);
+    SnmpReply *SendRequest(unsigned short type, SnmpTarget *target,
+                           Pdu *pdu, QObject *parent);
+    QString RoundTripTime(SnmpTarget &target);
+    void WalkRepetitions(const Pdu &pdu, const SnmpTarget &target);
+    void TableViewRow(void);
+    void TableViewFinish(const QString& result);
     void VarbindsBuildList(void);
+    QByteArray KeyCacheSecret(void);
+    void LoadKeyCache(void);
 
 public slots:
     void WalkFrom(const QString& oid);
@@ -80,10 +127,15 @@ public slots:
     void Varbinds(void);
     void VarbindsFrom(const QString& oid);
     void GetTypedTableInstance(void);
-    void StopTimer(void);
+    void StopEvents(void);
+    void StopTrapListeners(void);
+    void SaveKeyCache(void);
 
 protected slots:
-    void TimerExpired(void);    
+    void DequeueTraps(void);
+    void TableViewReply(SnmpReply *reply);
+    void TableViewCell(SnmpReply *reply);
+    void SelectInstanceReply(SnmpReply *reply);
     void ShowAgentSettings(void);
     void SelectAgentProfile(QString *prefprofile = NULL, int prefproto = -1);
     void SelectAgentProto(void);
@@ -103,6 +155,7 @@ protected slots:
 
 signals:
     void StartWalk(bool);
+    void TrapsQueued(void);
 
 private:
     Snmpb *s;
@@ -111,15 +164,48 @@ private:
  
     Snmp *snmp;
     v3MP *v3mp;
-    QTimer timer;
+    QByteArray keycachesecret;
+    SnmpEventNotifier *events;
+    SnmpCoalescer *coalescer;
+
+    QList<TrapListener*> listeners;
+    QMutex trapqueue_mutex;
+    QList<trap_data> trapqueue;
     
     int requests;
     int objects;
     QString msg;
     Oid theoid;
 
+    // Walk in progress: max-repetitions of the next GETBULK, adapted
+    // to the responses, and the varbind the request starts from
+    int walkreps;
+    int walkinitreps;
+    bool walkgrow;
+    Vb walkseed;
+
     QLineEdit *le;
     QString tinstresult;
+
+    // Table view in progress: a GETNEXT for the next row, then a GET
+    // per column of the row, all sent together
+    SnmpReply *tvreply;
+    SnmpTarget *tvtarget;
+    Pdu *tvpdu;
+    SmiNode *tvnode;
+    Oid tvpoid;
+    Oid tvroid;
+    Vb tvvb;
+    QList<SnmpReply*> tvcells;
+    int tvpending;
+    int tvrows;
+
+    // Instances listed while the selection dialog is shown
+    SnmpReply *sireply;
+    SnmpTarget *sitarget;
+    Pdu *sipdu;
+    Oid sioid;
+    QListWidget *silist;
  
     bool stop;
 
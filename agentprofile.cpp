@@ -68,6 +68,8 @@ AgentProfileManager::AgentProfileManager(Snmpb *snmpb)
              this, SLOT ( SetAddress() ) );
     connect( ap.Port, SIGNAL( editingFinished() ), 
              this, SLOT ( SetPort() ) );
+    connect( ap.MaxMsgSize, SIGNAL( valueChanged( int ) ),
+             this, SLOT ( SetMaxMsgSize() ) );
     connect( ap.Retries, SIGNAL( valueChanged( int ) ),
              this, SLOT ( SetRetries() ) );
     connect( ap.Timeout, SIGNAL( valueChanged( int ) ), 
@@ -127,6 +129,8 @@ void AgentProfileManager::ReadConfigFile (void)
                                        settings->value("v3").toBool());
         newagent->SetTarget(settings->value("address").toString(),
                             settings->value("port").toString());
+        newagent->SetMaxMsgSize(settings->value("maxmsgsize",
+                                                MAX_SNMP_PACKET).toInt());
         newagent->SetRetriesTimeout(settings->value("retries").toInt(),
                                     settings->value("timeout").toInt());
         newagent->SetComms(settings->value("readcomm").toString(),
@@ -157,6 +161,7 @@ void AgentProfileManager::WriteConfigFile (void)
         settings->setValue("v3", v3);
         settings->setValue("address", agents[i]->GetAddress());
         settings->setValue("port", agents[i]->GetPort());
+        settings->setValue("maxmsgsize", agents[i]->GetMaxMsgSize());
         settings->setValue("retries", agents[i]->GetRetries());
         settings->setValue("timeout", agents[i]->GetTimeout());
         settings->setValue("readcomm", agents[i]->GetReadComm());
@@ -252,6 +257,12 @@ void AgentProfileManager::SetPort(void)
         currentprofile->SetPort();
 }
 
+void AgentProfileManager::SetMaxMsgSize(void)
+{
+    if (currentprofile)
+        currentprofile->SetMaxMsgSize();
+}
+
 void AgentProfileManager::SetRetries(void)
 {
     if (currentprofile)
@@ -328,6 +339,7 @@ void AgentProfileManager::Add(void)
     // Set default values
     newagent->SetSupportedProtocol(true, false, false); // SNMPV1 only
     newagent->SetTarget("127.0.0.1", "161");
+    newagent->SetMaxMsgSize(MAX_SNMP_PACKET);
     newagent->SetRetriesTimeout(1, 3);
     newagent->SetComms("public", "private");
     newagent->SetBulk(10, 0);
@@ -357,6 +369,7 @@ void AgentProfileManager::Add(QString name, QString address, QString port,
     newagent->SetTarget(address, port);
 
     // Copy all other values from the clone 
+    newagent->SetMaxMsgSize(clone->GetMaxMsgSize());
     newagent->SetRetriesTimeout(clone->GetRetries(), clone->GetTimeout());
     newagent->SetComms(clone->GetReadComm(), clone->GetWriteComm());
     newagent->SetBulk(clone->GetMaxRepetitions(), clone->GetNonRepeaters());
@@ -563,6 +576,7 @@ int AgentProfile::SelectAgentProfile(QTreeWidgetItem * item)
         ap->ProfileName->setText(name);
         ap->Address->setText(address);
         ap->Port->setText(port);
+        ap->MaxMsgSize->setValue(maxmsgsize);
         ap->Retries->setValue(retries);
         ap->Timeout->setValue(timeout);
 
@@ -712,6 +726,16 @@ void AgentProfile::SetTarget(QString a, QString p)
     port = p; 
 }
 
+void AgentProfile::SetMaxMsgSize(void)
+{
+    maxmsgsize = ap->MaxMsgSize->value();
+}
+
+int AgentProfile::GetMaxMsgSize(void)
+{
+    return maxmsgsize;
+}
+
 void AgentProfile::SetRetries(void)
 {
     retries = ap->Retries->value();
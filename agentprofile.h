@@ -54,6 +54,9 @@ public:
     void SetPort(void);
     QString GetPort(void);
     void SetTarget(QString a, QString p);
+    void SetMaxMsgSize(void);
+    void SetMaxMsgSize(int m) {maxmsgsize = m;};
+    int GetMaxMsgSize(void);
 
     void SetRetries(void);
     int GetRetries(void);
@@ -99,6 +102,7 @@ protected:
     QString name;
     QString address;
     QString port;
+    int maxmsgsize;
     int retries;
     int timeout;
     QString readcomm;
@@ -138,6 +142,7 @@ protected slots:
     void SetProfileName(void);
     void SetAddress(void);
     void SetPort(void);
+    void SetMaxMsgSize(void);
     void SetRetries(void);
     void SetTimeout(void);
     void SetReadComm(void);
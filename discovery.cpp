@@ -19,6 +19,7 @@
 */
 
 #include "discovery.h"
+#include "discprobe.h"
 #include "preferences.h"
 #include "agent.h"
 
@@ -26,6 +27,12 @@
 #define DISC_SNMP_V2C "V2c"
 #define DISC_SNMP_V3  "V3"
 
+/* Refresh period of the output during a discovery */
+#define DISC_DISPLAY_MSEC 250
+
+/* Detail OIDs are shown after the system group columns */
+#define DISC_DETAILS_COLUMN 7
+
 /* Conversion routines to/from bytes array to integer value for IP addresses */
 #define IPV4_FROM_UCHAR(array, integer)                         \
     do {                                                        \
@@ -57,37 +64,25 @@
         }                                                 \
     } while(0)
 
+/* Probes waiting for a reply, at most */
+#define DISC_MAX_WINDOW 262144
+
+/* Longest sleep of the send/receive loop, for progress and abort */
+#define DISC_MAX_WAIT_USEC 100000
+
+/* Socket receive buffer, replies arrive during the whole sweep */
+#define DISC_RCVBUF_SIZE (4*1024*1024)
+
+/* Detail queries in flight, at most */
+#define DISC_ENRICH_MAX_OUTSTANDING 32
+
+/* Longest sleep of the detail queries thread, for new agents and abort */
+#define DISC_ENRICH_WAIT_MSEC 10
+
 /* Internal SNMP++ routine */
-extern int receive_snmp_response(SnmpSocket sock, Snmp &snmp_session,
-                                 Pdu &pdu, UdpAddress &fromaddress,
-                                 OctetStr &engine_id, bool process_msg = true);
-
-static unsigned char snmpv3_broadcast_message[] =
-{
-    0x30, 0x3a,
-    0x02, 0x01, 0x03,             // Version: 3
-    0x30, 0x0f,                   // global header length 15
-    0x02, 0x03, 0x01, 0x00, 0x00, // message id
-    0x02, 0x02, 0x10, 0x00,       // message max size
-    0x04, 0x01, 0x04,             // flags (reportable set)
-    0x02, 0x01, 0x03,             // security model USM
-    0x04, 0x10,                   // security params
-    0x30, 0x0e,
-    0x04, 0x00,                   // no engine id
-    0x02, 0x01, 0x00,             // boots 0
-    0x02, 0x01, 0x00,             // time 0
-    0x04, 0x00,                   // no user name
-    0x04, 0x00,                   // no auth par
-    0x04, 0x00,                   // no priv par
-    0x30, 0x12,
-    0x04, 0x00,                   // no context engine id
-    0x04, 0x00,                   // no context name
-    0xa0, 0x0c,                   // GET PDU
-    0x02, 0x02, 0x34, 0x26,       // request id
-    0x02, 0x01, 0x00,             // error status no error
-    0x02, 0x01, 0x00,             // error index 0
-    0x30, 0x00                    // no data
-};
+extern int receive_snmp_response(SnmpRecvBatch &batch, const int index,
+                                 Snmp &snmp_session, Pdu &pdu,
+                                 UdpAddress &fromaddress, OctetStr &engine_id);
 
 static const char *info_oids[] =
 {
@@ -122,12 +117,12 @@ Discovery::Discovery(Snmpb *snmpb)
     // Create the discovery thread (not started)
     dt = new DiscoveryThread(s);
 
-    connect( dt, SIGNAL( SendAgent(QStringList) ), 
-             this, SLOT( DisplayAgent(QStringList) ));
     connect( dt, SIGNAL( SignalStartStop(int) ), 
              this, SLOT( StartStop(int) ));
     connect( dt, SIGNAL( SignalProgress(int) ), 
              this, SLOT( DisplayProgress(int) ));
+    connect( &display_timer, SIGNAL( timeout() ), 
+             this, SLOT( DisplayResults() ));
 
     // Create context menu actions
     s->MainUI()->DiscoveryOutput->setContextMenuPolicy (Qt::CustomContextMenu);
@@ -174,11 +169,15 @@ DiscoveryThread::DiscoveryThread(QObject *parent):QThread(parent)
         status = SNMP_CLASS_ERROR;
 
     snmp->aborting = false;
+
+    enrich = false;
+    enricher = new DiscoveryEnricher(s);
 };
 
-void DiscoveryThread::SendAgentInfo(Pdu pdu, UdpAddress a, snmp_version v)
+void DiscoveryThread::SendAgentInfo(const Pdu &pdu, const UdpAddress &a,
+                                    snmp_version v)
 {
-    QStringList agent_info;
+    disc_reply r;
     QString name;
     QString address;
     QString protocol;
@@ -220,21 +219,240 @@ void DiscoveryThread::SendAgentInfo(Pdu pdu, UdpAddress a, snmp_version v)
     protocol = (v == version3)?DISC_SNMP_V3: 
                ((v == version2c)?DISC_SNMP_V2C:DISC_SNMP_V1);
 
-    agent_info.clear();
-    agent_info << name << address << protocol << uptime 
-               << contact << location << description;
+    r.info << name << address << protocol << uptime 
+           << contact << location << description;
+    r.version = (v == version3)?DISC_VERSION_V3: 
+                ((v == version2c)?DISC_VERSION_V2C:DISC_VERSION_V1);
 
-    emit SendAgent(agent_info);
+    results_mutex.lock();
+    results.append(r);
+    results_mutex.unlock();
+
+    // Query the details of the agent while the sweep goes on
+    if (enrich)
+        enricher->Add(a, v);
 }
 
-void DiscoveryThread::Progress()
+// Replies received since the last call
+void DiscoveryThread::TakeAgents(QList<disc_reply> &agents)
 {
-    emit SignalProgress(++current_progress);
+    results_mutex.lock();
+    agents.swap(results);
+    results_mutex.unlock();
+}
+
+// Progress of the sweep, in 1/1000
+void DiscoveryThread::Progress(int permille)
+{
+    emit SignalProgress(permille);
 }
 
 void DiscoveryThread::Abort()
 {
     snmp->aborting = true;
+    enricher->Abort();
+}
+
+// C Callback function for snmp++
+void callback_enrich(int reason, Snmp *, Pdu &pdu, SnmpTarget &target, void *cd)
+{
+    if (cd)
+    {
+        // just call the real callback member function...
+        ((DiscoveryEnricher*)cd)->Reply(reason, pdu, target);
+    }
+}
+
+DiscoveryEnricher::DiscoveryEnricher(QObject *parent):QThread(parent)
+{
+    s = (Snmpb *)parent;
+    snmp = NULL;
+    profile = NULL;
+    finishing = false;
+    aborting = false;
+    outstanding = 0;
+
+    // Our own session, its events are processed by the enricher thread
+    bool v4 = s->PreferencesObj()->GetEnableIPv4();
+    bool v6 = s->PreferencesObj()->GetEnableIPv6();
+
+    if (v4 && v6)
+        snmp = new Snmp(status, UdpAddress("0.0.0.0"), UdpAddress("::"));
+    else if (v4)
+        snmp = new Snmp(status, UdpAddress("0.0.0.0"));
+    else if (v6)
+        snmp = new Snmp(status, UdpAddress("::"));
+    else
+        status = SNMP_CLASS_ERROR;
+}
+
+// Called before start()
+void DiscoveryEnricher::Setup(AgentProfile *ap, const QList<Oid> &oids)
+{
+    profile = ap;
+    detail_oids = oids;
+
+    mutex.lock();
+    queue.clear();
+    seen.clear();
+    finishing = false;
+    aborting = false;
+    mutex.unlock();
+}
+
+// Queue an agent that replied to the discovery, once per address
+void DiscoveryEnricher::Add(const UdpAddress &a, snmp_version v)
+{
+    QString address = a.get_printable();
+    disc_enrich_req r;
+
+    r.address = a;
+    r.version = v;
+
+    mutex.lock();
+    if (!aborting && !seen.contains(address))
+    {
+        seen.insert(address);
+        queue.append(r);
+        cond.wakeOne();
+    }
+    mutex.unlock();
+}
+
+// No more agents: the thread ends when the queued agents are done
+void DiscoveryEnricher::Finish()
+{
+    mutex.lock();
+    finishing = true;
+    cond.wakeOne();
+    mutex.unlock();
+}
+
+void DiscoveryEnricher::Abort()
+{
+    mutex.lock();
+    aborting = true;
+    queue.clear();
+    cond.wakeOne();
+    mutex.unlock();
+}
+
+void DiscoveryEnricher::Send(const disc_enrich_req &r)
+{
+    SnmpTarget *target;
+    Pdu pdu;
+    Vb vb;
+
+    if (r.version == version3)
+        target = new UTarget(r.address);
+    else
+        target = new CTarget(r.address);
+
+    s->AgentObj()->ConfigTargetFromSettings(r.version, target, profile);
+    s->AgentObj()->ConfigPduFromSettings(r.version, 
+                                         detail_oids[0].get_printable(), 
+                                         &pdu, profile);
+    for (int i = 1; i < detail_oids.size(); i++)
+    {
+        vb.set_oid(detail_oids[i]);
+        pdu += vb;
+    }
+
+    int res = snmp->get(pdu, *target, callback_enrich, this);
+
+    if (res == SNMP_CLASS_SUCCESS)
+        outstanding++;
+    else
+    {
+        QStringList details;
+        details << r.address.get_printable() << Snmp::error_msg(res);
+        AddDetails(details);
+    }
+
+    delete target;
+}
+
+void DiscoveryEnricher::Reply(int reason, Pdu &pdu, SnmpTarget &target)
+{
+    GenAddress ga;
+    QStringList details;
+    Vb vb;
+
+    outstanding--;
+
+    target.get_address(ga);
+    details << UdpAddress(ga).get_printable();
+
+    if (reason != SNMP_CLASS_ASYNC_RESPONSE)
+        details << Snmp::error_msg(reason);
+    else if (pdu.get_error_status() != SNMP_CLASS_SUCCESS)
+        details << Snmp::error_msg(pdu.get_error_status());
+    else
+    {
+        for (int i = 0; i < pdu.get_vb_count(); i++)
+        {
+            pdu.get_vb(vb, i);
+            if (vb.get_exception_status() != SNMP_CLASS_SUCCESS)
+                details << "-";
+            else
+                details << vb.get_printable_value();
+        }
+    }
+
+    AddDetails(details);
+}
+
+void DiscoveryEnricher::AddDetails(const QStringList &d)
+{
+    mutex.lock();
+    results.append(d);
+    mutex.unlock();
+}
+
+// Details received since the last call
+void DiscoveryEnricher::TakeDetails(QList<QStringList> &details)
+{
+    mutex.lock();
+    details.swap(results);
+    mutex.unlock();
+}
+
+void DiscoveryEnricher::run()
+{
+    if ((status != SNMP_CLASS_SUCCESS) || !profile || detail_oids.isEmpty())
+        return;
+
+    outstanding = 0;
+
+    for (;;)
+    {
+        mutex.lock();
+
+        while (!aborting && (outstanding < DISC_ENRICH_MAX_OUTSTANDING) &&
+               !queue.isEmpty())
+        {
+            disc_enrich_req r = queue.takeFirst();
+            mutex.unlock();
+            Send(r);
+            mutex.lock();
+        }
+
+        // Aborted requests still get their reply or timeout
+        bool done = (outstanding == 0) && (aborting || 
+                                           (finishing && queue.isEmpty()));
+
+        // Nothing in flight: wait for the next agent
+        if (!done && (outstanding == 0) && queue.isEmpty())
+            cond.wait(&mutex, DISC_ENRICH_WAIT_MSEC);
+
+        mutex.unlock();
+
+        if (done)
+            break;
+
+        if (outstanding > 0)
+            snmp->get_eventListHolder()->SNMPProcessEvents(DISC_ENRICH_WAIT_MSEC);
+    }
 }
 
 DiscoverySnmp::DiscoverySnmp(int &status, const UdpAddress &addr)
@@ -247,200 +465,453 @@ DiscoverySnmp::DiscoverySnmp(int &status, const UdpAddress &addr_v4,
 {
 }
 
-void DiscoverySnmp::discover(const UdpAddress &start_addr, unsigned long long num_addr,
-                             const int timeout_sec, const snmp_version version,
+// Range holding the address at the given index of the sweep
+static int find_range(const QList<disc_range> &ranges, unsigned long long index)
+{
+    int lo = 0, hi = ranges.size() - 1;
+
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+        if (ranges[mid].first <= index)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    return lo;
+}
+
+// Address at the given offset in a range
+static void range_address(UdpAddress &a, const disc_range &r,
+                          unsigned long long offset)
+{
+    if (r.ipv4)
+    {
+        unsigned int addr = (unsigned int)(r.lo + offset);
+        IPV4_TO_UCHAR(a, addr);
+    }
+    else
+    {
+        unsigned long long lo = r.lo + offset;
+        unsigned long long hi = r.hi + ((lo < r.lo) ? 1 : 0);
+        IPV6_TO_UCHAR(a, hi, lo);
+    }
+}
+
+// True if a is the address at the given offset in a range
+static bool range_match(const disc_range &r, unsigned long long offset,
+                        const UdpAddress &a)
+{
+    if (a.get_ip_version() != (r.ipv4 ? Address::version_ipv4 :
+                                        Address::version_ipv6))
+        return false;
+
+    if (r.ipv4)
+    {
+        unsigned int addr = 0;
+        IPV4_FROM_UCHAR(a, addr);
+        return (addr == (unsigned int)(r.lo + offset));
+    }
+    else
+    {
+        unsigned long long hi = 0, lo = 0;
+        unsigned long long elo = r.lo + offset;
+        IPV6_FROM_UCHAR(a, hi, lo);
+        return ((lo == elo) && (hi == r.hi + ((elo < r.lo) ? 1 : 0)));
+    }
+}
+
+// SNMP version of a received message, from its header
+static bool message_version(const unsigned char *buf, long len, snmp_version &v)
+{
+    int i = 2;
+
+    if ((len < 5) || (buf[0] != 0x30))
+        return false;
+    if (buf[1] & 0x80)
+        i += buf[1] & 0x7F;
+    if ((i + 3 > len) || (buf[i] != 0x02) || (buf[i+1] != 0x01))
+        return false;
+
+    switch (buf[i+2])
+    {
+        case 0: v = version1; break;
+        case 1: v = version2c; break;
+        case 3: v = version3; break;
+        default: return false;
+    }
+
+    return true;
+}
+
+void DiscoverySnmp::discover(const QList<disc_range> &ranges,
+                             const QList<snmp_version> &versions,
+                             unsigned short port,
+                             const int timeout_sec, const int rate,
+                             const int retries,
                              QString readcomm, QString secname, int seclevel, 
                              QString ctxname, QString ctxengineid, 
                              bool use_snmpv3_probe, DiscoveryThread *thread)
 {
     unsigned char *message = NULL;
     int message_length = 0;
-    unsigned int sock;
     SnmpMessage *snmpmsg = NULL;
-    Pdu pdu;
-    OctetStr get_community;
-    unsigned long long hicuraddr = 0, locuraddr = 0;
-    unsigned int curaddr = 0;
+    Pdu pdu, v3pdu;
+    Vb vb;
+    OctetStr get_community = readcomm.toLatin1().data();
+    int nv = versions.size();
+
+    if ((nv < 1) || ranges.isEmpty())
+        return;
 
     // Prepare pdu
-    if ((version != version3) || (use_snmpv3_probe == false))
-    {
-        Vb vb;
+    for (int k = 0; k < 5; k++)
+    { 
+        vb.set_oid(Oid(info_oids[k]));
+        pdu += vb;
+    }
 
-        for (int k = 0; k < 5; k++)
-        { 
-            vb.set_oid(Oid(info_oids[k]));
-            pdu += vb;
-        }
+    pdu.set_error_index(0);            // set error index to none
+    pdu.set_type(sNMP_PDU_GET);        // set pdu type
+    pdu.set_request_id(DISC_REQID_MARKER);
+
+    v3pdu = pdu;
+
+    // set the security level to use
+    if (seclevel == 0/*"noAuthNoPriv"*/)
+        v3pdu.set_security_level(SNMP_SECURITY_LEVEL_NOAUTH_NOPRIV);
+    else if (seclevel == 1/*"authNoPriv"*/)
+        v3pdu.set_security_level(SNMP_SECURITY_LEVEL_AUTH_NOPRIV);
+    else
+        v3pdu.set_security_level(SNMP_SECURITY_LEVEL_AUTH_PRIV);
 
-        pdu.set_error_index(0);            // set error index to none
-        pdu.set_type(sNMP_PDU_GET);        // set pdu type
+    v3pdu.set_context_name(ctxname.toLatin1().data());
+    v3pdu.set_context_engine_id(ctxengineid.toLatin1().data());
 
-        if (version != version3)
+    // One probe per version, encoded once: only its request id is
+    // patched per address
+    QList<QByteArray> probes;
+    QList<int> reqid_offsets;
+
+    for (int vi = 0; vi < nv; vi++)
+    {
+        SnmpMessage probemsg;
+        QByteArray probebuf;
+
+        if (versions[vi] != version3)
         {
-            get_community = readcomm.toLatin1().data();
+            if (probemsg.load(pdu, get_community, versions[vi]) != SNMP_CLASS_SUCCESS)
+                return;
+            probebuf = QByteArray((const char *)probemsg.data(), probemsg.len());
         }
-        else
+        else if (use_snmpv3_probe == false)
         {
-            // set the security level to use
-            if (seclevel == 0/*"noAuthNoPriv"*/)
-                pdu.set_security_level(SNMP_SECURITY_LEVEL_NOAUTH_NOPRIV);
-            else if (seclevel == 1/*"authNoPriv"*/)
-                pdu.set_security_level(SNMP_SECURITY_LEVEL_AUTH_NOPRIV);
-            else
-                pdu.set_security_level(SNMP_SECURITY_LEVEL_AUTH_PRIV);
-
-            pdu.set_context_name(ctxname.toLatin1().data());
-            pdu.set_context_engine_id(ctxengineid.toLatin1().data());
+            // Agents whose engine id is unknown all get the same
+            // unauthenticated engine discovery message
+            if (probemsg.loadv3(v3pdu, OctetStr(), secname.toLatin1().data(),
+                                SNMP_SECURITY_MODEL_USM, 
+                                version3) != SNMP_CLASS_SUCCESS)
+                return;
+            probebuf = QByteArray((const char *)probemsg.data(), probemsg.len());
         }
-    }
+        else
+            probebuf = QByteArray((const char *)disc_v3_probe,
+                                  disc_v3_probe_len);
 
-    // Send probe packets
-    UdpAddress cur_address = start_addr;
+        int offset = disc_find_reqid((const unsigned char *)probebuf.constData(),
+                                     probebuf.size());
+        if (offset < 0)
+            return;
 
-    // First, convert the address to incrementable integer(s)
-    if (cur_address.get_ip_version() == Address::version_ipv4)
-    {
-        sock = iv_snmp_session;
-        IPV4_FROM_UCHAR(cur_address, curaddr);
+        probes.append(probebuf);
+        reqid_offsets.append(offset);
     }
-    else
+
+    // One socket and one send batch per transport
+    SnmpSocket socks[2] = { iv_snmp_session, iv_snmp_session_ipv6 };
+    SnmpSendBatch send_batch[2];
+    UdpAddress cur_address[2] = { UdpAddress("0.0.0.0"), UdpAddress("::") };
+
+    for (int t = 0; t < 2; t++)
     {
-        sock = iv_snmp_session_ipv6;
-        IPV6_FROM_UCHAR(cur_address, hicuraddr, locuraddr);
+        cur_address[t].set_port(port);
+
+        // Replies arrive while probes are still being sent
+        int rcvbuf = DISC_RCVBUF_SIZE;
+        if (socks[t] != INVALID_SOCKET)
+            setsockopt(socks[t], SOL_SOCKET, SO_RCVBUF, (const char *)&rcvbuf,
+                       sizeof(rcvbuf));
     }
 
-    for(unsigned long long j = 0; j < num_addr; j++)
+    // Every version of an address is probed before the next address
+    const disc_range &last = ranges.last();
+    unsigned long long num_addr = last.first + last.count;
+    unsigned long long num_probes = num_addr * nv;
+
+    // Pacing: token bucket of at most 10 ms worth of probes, and enough
+    // probes in flight to keep that rate during a whole reply timeout
+    qint64 try_timeout = (qint64)timeout_sec * 1000000 / (retries + 1);
+    int burst = qBound(1, rate / 100, SNMP_PP_BATCH_SIZE);
+    int window = (int)qBound((qint64)burst, (qint64)rate * timeout_sec,
+                             (qint64)DISC_MAX_WINDOW);
+    double tokens = burst;
+    qint64 refill = 0;
+
+    QHash<unsigned int, disc_probe> inflight; // by request id
+    QList<disc_probe> deadlines;          // in send order
+    QList<unsigned int> resend;           // timed out, waiting for tokens
+    unsigned long long next = 0;          // next probe never sent
+    unsigned long long done = 0;          // answered or given up
+    unsigned long long sent = 0, retried = 0, encoded = 0, replies = 0;
+    int permille = 0;
+
+    Pdu in_pdu;
+    SnmpRecvBatch recv_batch;
+    fd_set readfds;
+    struct timeval fd_timeout;
+    QElapsedTimer clock;
+
+    clock.start();
+
+    while (aborting == false)
     {
-        if (version != version3)
+        qint64 now = clock.nsecsElapsed() / 1000;
+
+        tokens = qMin((double)burst, tokens + (double)(now - refill) * rate / 1e6);
+        refill = now;
+
+        // Probes without reply: retry them or give up
+        while (!deadlines.isEmpty() && (deadlines.first().sent + try_timeout <= now))
         {
-            pdu.set_request_id(MyMakeReqId()); // determine request id to use
+            disc_probe p = deadlines.takeFirst();
+            unsigned int reqid = disc_probe_reqid(p.id);
+            QHash<unsigned int, disc_probe>::iterator i = inflight.find(reqid);
 
-            snmpmsg = new SnmpMessage();
-            if (snmpmsg->load(pdu, get_community, version) != SNMP_CLASS_SUCCESS)
-                goto next_addr;
+            // Answered, or sent again since
+            if ((i == inflight.end()) || (i.value().tries != p.tries))
+                continue;
 
-            message        = snmpmsg->data();
-            message_length = snmpmsg->len();
+            if (p.tries <= retries)
+                resend.append(reqid);
+            else
+            {
+                inflight.erase(i);
+                done++;
+            }
         }
-        else
+
+        // Send what the pacer allows, retries first
+        while ((tokens >= 1.0) && 
+               (!resend.isEmpty() || 
+                ((next < num_probes) && (inflight.size() < window))))
         {
-            if (use_snmpv3_probe == true)
+            disc_probe p;
+
+            if (!resend.isEmpty())
             {
-                unsigned short v3reqid = MyMakeReqId();
-                message = (unsigned char *)snmpv3_broadcast_message;
-                message_length = sizeof(snmpv3_broadcast_message);
-                message[50] = v3reqid >> 8;
-                message[51] = v3reqid & 0xFF;
+                unsigned int reqid = resend.takeFirst();
+
+                // Answered while waiting to be sent again
+                if (!inflight.contains(reqid))
+                    continue;
+
+                p = inflight.value(reqid);
+                p.tries++;
+                retried++;
             }
             else
             {
+                p.id = next++;
+                p.tries = 1;
+            }
+
+            unsigned long long index = p.id / nv;
+            int vi = (int)(p.id % nv);
+            unsigned int reqid = disc_probe_reqid(p.id);
+            const disc_range &r = ranges[find_range(ranges, index)];
+            int t = r.ipv4 ? 0 : 1;
+
+            // Transport not available
+            if (socks[t] == INVALID_SOCKET)
+            {
+                inflight.remove(reqid);
+                done++;
+                continue;
+            }
+
+            p.sent = now;
+            inflight.insert(reqid, p);
+            deadlines.append(p);
+            tokens -= 1.0;
+
+            range_address(cur_address[t], r, index - r.first);
+            message = (unsigned char *)probes[vi].data();
+            message_length = probes[vi].size();
+
+            if ((versions[vi] == version3) && (use_snmpv3_probe == false))
+            {
+                // Messages to known engines are authenticated (and maybe
+                // encrypted) for that engine: they cannot be patched
                 OctetStr engine_id;
-                pdu.set_request_id(MyMakeReqId()); // determine request id to use
-                v3MP::I->get_from_engine_id_table(engine_id, 
-                                                  cur_address.get_printable());
-
-                snmpmsg = new SnmpMessage();
-                if (snmpmsg->loadv3( pdu, engine_id, secname.toLatin1().data(),
-                                     SNMP_SECURITY_MODEL_USM, 
-                                     version) != SNMP_CLASS_SUCCESS)
-                    goto next_addr;
-
-                message        = snmpmsg->data();
-                message_length = snmpmsg->len();
+                if ((v3MP::I->get_from_engine_id_table(engine_id,
+                         cur_address[t].get_printable()) == SNMPv3_MP_OK) &&
+                    (engine_id.len() > 0))
+                {
+                    v3pdu.set_request_id(reqid);
+
+                    snmpmsg = new SnmpMessage();
+                    if (snmpmsg->loadv3( v3pdu, engine_id, secname.toLatin1().data(),
+                                         SNMP_SECURITY_MODEL_USM, 
+                                         version3) != SNMP_CLASS_SUCCESS)
+                    {
+                        delete snmpmsg;
+                        snmpmsg = NULL;
+                        continue;
+                    }
+
+                    message        = snmpmsg->data();
+                    message_length = snmpmsg->len();
+                    encoded++;
+                }
             }
-        }
 
-        if (send_raw_data(message, message_length, cur_address) < 0)
-        {
-            if (snmpmsg) delete snmpmsg;
-            return;
-        }
+            if (snmpmsg == NULL)
+                disc_patch_reqid(message, reqid_offsets[vi], reqid);
 
-next_addr:
-        if (snmpmsg)
-        {
-            delete snmpmsg;
-            snmpmsg = NULL;
+            // Probes are sent in batches, one system call per batch
+            send_batch[t].add(message, message_length, cur_address[t]);
+            if (snmpmsg)
+            {
+                delete snmpmsg;
+                snmpmsg = NULL;
+            }
+
+            if (send_batch[t].is_full())
+            {
+                int n = send_batch[t].flush(socks[t]);
+                if (n < 0)
+                    return;
+                sent += n;
+            }
         }
 
-        // Increment the address according to transport protocol version
-        if (cur_address.get_ip_version() == Address::version_ipv4)
+        for (int t = 0; t < 2; t++)
         {
-            curaddr++;
-            IPV4_TO_UCHAR(cur_address, curaddr);
+            if (send_batch[t].get_count() > 0)
+            {
+                int n = send_batch[t].flush(socks[t]);
+                if (n < 0)
+                    return;
+                sent += n;
+            }
         }
-        else
+
+        // Finished when every probe was answered or timed out
+        if ((next >= num_probes) && inflight.isEmpty())
+            break;
+
+        // Sleep until the next token, the next deadline or a reply
+        qint64 wait = DISC_MAX_WAIT_USEC;
+        if (!resend.isEmpty() || ((next < num_probes) && (inflight.size() < window)))
+            wait = qMin(wait, (qint64)((1.0 - tokens) * 1e6 / rate) + 1);
+        if (!deadlines.isEmpty())
+            wait = qMin(wait, deadlines.first().sent + try_timeout - now);
+        if (wait < 0)
+            wait = 0;
+
+        fd_timeout.tv_sec = (long)(wait / 1000000);
+        fd_timeout.tv_usec = (long)(wait % 1000000);
+
+        SnmpSocket maxfd = 0;
+        FD_ZERO(&readfds);
+        for (int t = 0; t < 2; t++)
         {
-            if (locuraddr == 0xFFFFFFFFFFFFFFFFULL) // locuraddr overflow
-                hicuraddr++;
-            locuraddr++;
-            IPV6_TO_UCHAR(cur_address, hicuraddr, locuraddr);
+            if (socks[t] == INVALID_SOCKET)
+                continue;
+            FD_SET(socks[t], &readfds);
+            if (socks[t] > maxfd)
+                maxfd = socks[t];
         }
 
-        if (aborting == true)
-            return;
-    }
+        if (select((int)(maxfd + 1), &readfds, NULL, NULL, &fd_timeout) > 0)
+        {
+            lock();
 
-    // Now wait for the responses
-    Pdu in_pdu;
-    fd_set readfds;
-    int nfound = 0;
-    struct timeval fd_timeout;
-    msec end_time;
+            for (int t = 0; t < 2; t++)
+            {
+                if ((socks[t] == INVALID_SOCKET) || !FD_ISSET(socks[t], &readfds))
+                    continue;
+
+                // Received one or more messages
+                int count = recv_batch.receive(socks[t]);
+
+                for (int i = 0; i < count; i++)
+                {
+                    UdpAddress from;
+                    OctetStr engine_id;
+                    snmp_version version;
+                    int res = receive_snmp_response(recv_batch, i, *this, in_pdu,
+                                                    from, engine_id);
+
+                    if((res != SNMPv3_MP_UNKNOWN_PDU_HANDLERS) && // SNMPv3
+                       (res != SNMP_CLASS_SUCCESS)) // SNMPv1 or SNMPv2c
+                        continue;
 
-    end_time += 1000;
-    int num_sec = 1;
+                    if (!message_version(recv_batch.get_data(i), 
+                                         recv_batch.get_length(i), version))
+                        continue;
 
-    lock();
-    do
-    {
-new_loop:
-        FD_ZERO(&readfds);
-        FD_SET(sock, &readfds);
+                    replies++;
+                    thread->SendAgentInfo(in_pdu, from, version);
 
-        end_time.GetDeltaFromNow(fd_timeout);
+                    // The request id tells which probe, hence which version,
+                    // was answered. Broadcast probes keep waiting for other
+                    // agents.
+                    QHash<unsigned int, disc_probe>::iterator p = 
+                        inflight.find((unsigned int)in_pdu.get_request_id());
+                    if (p == inflight.end())
+                        continue;
 
-        nfound = select((int)(sock + 1), &readfds, NULL, NULL, &fd_timeout);
+                    unsigned long long index = p.value().id / nv;
+                    const disc_range &r = ranges[find_range(ranges, index)];
 
-        if ((nfound > 0) && (FD_ISSET(sock, &readfds)))
-        {
-            // Received a message
-            UdpAddress from;
-            OctetStr engine_id;
-            int res = receive_snmp_response(sock, *this, in_pdu, from, 
-                                            engine_id, true);
-
-            if((res == SNMPv3_MP_UNKNOWN_PDU_HANDLERS) || // SNMPv3
-               (res == SNMP_CLASS_SUCCESS)) // SNMPv1 or SNMPv2c
-                thread->SendAgentInfo(in_pdu, from, version);
-        }
+                    if (!r.broadcast && range_match(r, index - r.first, from))
+                    {
+                        inflight.erase(p);
+                        done++;
+                    }
+                }
+            }
 
-        if (aborting == true)
-        {
             unlock();
-            return;
         }
 
-        // A second as elapsed, show progress
-        if ((fd_timeout.tv_sec == 0) && (fd_timeout.tv_usec == 0))
+        int pm = (int)((double)done * 1000 / num_probes);
+        if (pm != permille)
         {
-            thread->Progress();
-            if (num_sec < timeout_sec)
-            {
-                end_time += 1000;
-                num_sec++;
-                goto new_loop;
-            }
+            permille = pm;
+            thread->Progress(permille);
         }
+    }
 
-    } while ((fd_timeout.tv_sec > 0) || (fd_timeout.tv_usec > 0));
-    unlock();
+    // Pipeline statistics, shown in the log tab
+    qint64 elapsed = clock.nsecsElapsed();
+    LOG_BEGIN(INFO_LOG | 1);
+    LOG("Discovery: done (addresses) (versions) (probes sent) (retries) (encoded per address) (replies) (msec) (probes/s)");
+    LOG((long)num_addr);
+    LOG((long)nv);
+    LOG((long)sent);
+    LOG((long)retried);
+    LOG((long)encoded);
+    LOG((long)replies);
+    LOG((long)(elapsed / 1000000));
+    LOG((long)(elapsed ? (sent * 1000000000ULL) / elapsed : 0));
+    LOG_END;
 }
 
 void DiscoveryThread::run()
 {
-    snmp_version cur_version  = version1;
     AgentProfile *ap = s->APManagerObj()->GetAgentProfile
                         (s->MainUI()->DiscoveryAgentProfile->currentText());
 
@@ -452,122 +923,113 @@ void DiscoveryThread::run()
 
     emit SignalStartStop(1);
 
-    bool v4 = s->PreferencesObj()->GetEnableIPv4();
-    bool v6 = s->PreferencesObj()->GetEnableIPv6();
-
-    current_progress = 0;
-
-    for (int t = 0; t < 2; t++) // for all transports
+    if (enrich)
     {
-        QString address_str;
-
-        if (s->MainUI()->DiscoveryLocal->isChecked())
-        {
-            if ((t == 0) && (v4 == true))
-                address_str = "255.255.255.255/";
-            else if ((t == 1) && (v6 == true))
-                address_str = "ff02::1/";
-            else 
-                continue;
-            address_str += ap->GetPort();
-        }
-        else
-        {
-            address_str = s->MainUI()->DiscoveryFrom->text() + "/" + ap->GetPort();
+        enricher->Setup(ap, enrich_oids);
+        enricher->start();
+    }
 
-            Address::version_type v = 
-                UdpAddress(address_str.toLatin1().data()).get_ip_version(); 
-            if (!(((t == 0) && (v == Address::version_ipv4) && (v4 == true)) ||
-                  ((t == 1) && (v == Address::version_ipv6) && (v6 == true))))
-                continue;
-        }
+    // A single sweep over all the ranges and versions
+    snmp->aborting = false;
+    snmp->discover(ranges, versions, ap->GetPort().toUShort(),
+                   wait_time, rate, retries, ap->GetReadComm(), 
+                   ap->GetSecName(), ap->GetSecLevel(), 
+                   ap->GetContextName(), ap->GetContextEngineID(), 
+                   use_snmpv3_probe, this);
+
+    // Then wait for the last details
+    if (enrich)
+    {
+        enricher->Finish();
+        enricher->wait();
+    }
 
-        UdpAddress start_address(address_str.toLatin1().data());
+    emit SignalStartStop(0);
+}
 
-        for (int i = 0; i < 3; i++) // For all SNMP protocols
-        {
-            switch(i)
-            {
-                case 0:
-                    if (s->MainUI()->DiscoveryV1->isChecked())
-                    {
-                        cur_version  = version1;
-                        break;
-                    }
-                    else
-                        continue;
-                case 1:
-                    if (s->MainUI()->DiscoveryV2c->isChecked())
-                    {
-                        cur_version  = version2c;
-                        break;
-                    }
-                    else
-                        continue;
-                case 2:
-                    if (s->MainUI()->DiscoveryV3->isChecked())
-                    {
-                        cur_version  = version3;
-                        break;
-                    }
-                    else
-                        continue;
-                default:
-                    break;
-            }
+static QString protocol_text(unsigned int versions)
+{
+    QStringList l;
 
-            snmp->aborting = false;
-            snmp->discover(start_address, num_addresses, 
-                    wait_time, cur_version, ap->GetReadComm(), 
-                    ap->GetSecName(), ap->GetSecLevel(), 
-                    ap->GetContextName(), ap->GetContextEngineID(), 
-                    s->MainUI()->DiscoverySNMPv3Probe->isChecked(), this);
-            if (snmp->aborting == true) goto discover_end;
-        }
-    }
+    if (versions & DISC_VERSION_V1) l << DISC_SNMP_V1;
+    if (versions & DISC_VERSION_V2C) l << DISC_SNMP_V2C;
+    if (versions & DISC_VERSION_V3) l << DISC_SNMP_V3;
 
-discover_end:
-    emit SignalStartStop(0);
+    return l.join("/");
 }
 
-void Discovery::DisplayAgent(QStringList agent_info)
+void Discovery::DisplayAgent(const disc_reply &r, QList<QTreeWidgetItem *> &added)
 {
-    // Check if the agent already exists in the list
-    QList<QTreeWidgetItem *> laddr = 
-        s->MainUI()->DiscoveryOutput->findItems(agent_info[1], 
-                                                Qt::MatchExactly, 1);
+    QHash<QString, disc_agent>::iterator i = agents.find(r.info[1]);
 
     // If it exists, add the new supported protocol to its list.
-    if (!laddr.isEmpty())
+    if (i != agents.end())
     {
-        if (!((agent_info[2] == DISC_SNMP_V1) && 
-              strstr(laddr[0]->text(2).toLatin1().data(), DISC_SNMP_V1)) && 
-            !((agent_info[2] == DISC_SNMP_V2C) && 
-              strstr(laddr[0]->text(2).toLatin1().data(), DISC_SNMP_V2C)) && 
-            !((agent_info[2] == DISC_SNMP_V3) && 
-              strstr(laddr[0]->text(2).toLatin1().data(), DISC_SNMP_V3)))
-        laddr[0]->setText(2,  laddr[0]->text(2) + "/" + agent_info[2]);
+        if ((i.value().versions & r.version) == 0)
+        {
+            i.value().versions |= r.version;
+            i.value().item->setText(2, protocol_text(i.value().versions));
+        }
     }
     else
     {
         // Else add the new agent to the list, as is.
-        QTreeWidgetItem *val = new QTreeWidgetItem(s->MainUI()->DiscoveryOutput,
-                                                   agent_info);
-        s->MainUI()->DiscoveryOutput->addTopLevelItem(val);
+        disc_agent a;
+        a.item = new QTreeWidgetItem(r.info);
+        a.versions = r.version;
+        agents.insert(r.info[1], a);
+        added.append(a.item);
     }
 }
 
+// Address, then one value per detail OID (or a single error message)
+void Discovery::DisplayDetails(const QStringList &details)
+{
+    QHash<QString, disc_agent>::iterator i = agents.find(details[0]);
+
+    if (i == agents.end())
+        return;
+
+    for (int k = 1; k < details.size(); k++)
+        i.value().item->setText(DISC_DETAILS_COLUMN + k - 1, details[k]);
+}
+
+// Show the replies and details received since the last refresh, all at
+// once: one insertion in the tree per refresh rather than per reply
+void Discovery::DisplayResults()
+{
+    QList<disc_reply> replies;
+    QList<QStringList> details;
+    QList<QTreeWidgetItem *> added;
+
+    dt->TakeAgents(replies);
+    dt->enricher->TakeDetails(details);
+
+    for (int i = 0; i < replies.size(); i++)
+        DisplayAgent(replies[i], added);
+
+    // Agents are always queued for details after being reported
+    for (int i = 0; i < details.size(); i++)
+        DisplayDetails(details[i]);
+
+    if (!added.isEmpty())
+        s->MainUI()->DiscoveryOutput->addTopLevelItems(added);
+}
+
 void Discovery::StartStop(int isstart)
 {
     if (isstart)
     {
         s->MainUI()->DiscoveryButton->setEnabled(false);
         s->MainUI()->DiscoveryAbortButton->setEnabled(true);
+        display_timer.start(DISC_DISPLAY_MSEC);
     }
     else
     {
         s->MainUI()->DiscoveryButton->setEnabled(true);
         s->MainUI()->DiscoveryAbortButton->setEnabled(false);
+        display_timer.stop();
+        DisplayResults();
     }
 }
 
@@ -616,34 +1078,305 @@ void Discovery::AddAgentToProfiles()
 }
 
 
+// Single address range starting at a
+static void make_range(const IpAddress &a, unsigned long long count, 
+                       disc_range &r)
+{
+    r.ipv4 = (a.get_ip_version() == Address::version_ipv4);
+    r.hi = r.lo = 0;
+    r.count = count;
+    r.first = 0;
+
+    if (r.ipv4)
+    {
+        unsigned int addr = 0;
+        IPV4_FROM_UCHAR(a, addr);
+        r.lo = addr;
+        r.broadcast = (addr == 0xFFFFFFFF);
+    }
+    else
+    {
+        IPV6_FROM_UCHAR(a, r.hi, r.lo);
+        r.broadcast = (a[0] == 0xFF);
+    }
+}
+
+// Number of addresses from 'from' to 'to', false if 'to' is lower or if
+// there are 2^64 addresses or more
+static bool address_count(const IpAddress &from, const IpAddress &to,
+                          unsigned long long &count)
+{
+    if (from.get_ip_version() == Address::version_ipv4)
+    {
+        unsigned int ifrom = 0, ito = 0;
+
+        IPV4_FROM_UCHAR(from, ifrom);
+        IPV4_FROM_UCHAR(to, ito);
+
+        if (ifrom > ito)
+            return false;
+        count = (unsigned long long)(ito - ifrom) + 1;
+    }
+    else
+    {
+        unsigned long long lofrom = 0, hifrom = 0, loto = 0, hito = 0;
+
+        IPV6_FROM_UCHAR(from, hifrom, lofrom);
+        IPV6_FROM_UCHAR(to, hito, loto);
+
+        if (((hito - hifrom) == 0) && (lofrom <= loto))
+            count = loto - lofrom + 1;
+        else if (((hito - hifrom) == 1) && (lofrom > loto))
+            count = ~lofrom + loto + 1;
+        else
+            return false;
+    }
+
+    return (count != 0);
+}
+
+// Numerical address, as opposed to a host name that may contain dashes
+static bool is_numeric(const QString &a)
+{
+    static const QRegExp numeric("[0-9.]+|[0-9a-fA-F.]*:[0-9a-fA-F:.]*");
+
+    return numeric.exactMatch(a);
+}
+
+// Parse a list of networks (a.b.c.d/n, x::y/n), ranges (a.b.c.d-e.f.g.h)
+// and hosts separated by commas, semicolons or spaces
+bool Discovery::ParseTargets(const QString &text, QList<disc_range> &ranges,
+                             QString &err)
+{
+    QStringList targets = text.split(QRegExp("[,;\\s]+"), 
+                                     QString::SkipEmptyParts);
+
+    if (targets.isEmpty())
+    {
+        err = QString("No address specified");
+        return false;
+    }
+
+    for (int i = 0; i < targets.size(); i++)
+    {
+        const QString &t = targets[i];
+        disc_range r;
+
+        if (t.contains('/'))
+        {
+            bool ok;
+            int prefix = t.section('/', 1).toInt(&ok);
+            IpAddress a(t.section('/', 0, 0).toLatin1().data());
+
+            if (!a.valid())
+            {
+                err = QString("Invalid address: %1").arg(t);
+                return false;
+            }
+
+            make_range(a, 1, r);
+
+            if (r.ipv4)
+            {
+                if (!ok || (prefix < 0) || (prefix > 32))
+                {
+                    err = QString("Invalid prefix length: %1").arg(t);
+                    return false;
+                }
+
+                r.count = 1ULL << (32 - prefix);
+                r.lo &= ~(r.count - 1);
+
+                // Skip the network and broadcast addresses
+                if (prefix <= 30)
+                {
+                    r.lo++;
+                    r.count -= 2;
+                }
+                r.broadcast = ((r.count == 1) && (r.lo == 0xFFFFFFFF));
+            }
+            else
+            {
+                if (!ok || (prefix < 65) || (prefix > 128))
+                {
+                    err = QString("IPv6 prefix length must be between 65 and 128: %1")
+                                  .arg(t);
+                    return false;
+                }
+
+                r.count = 1ULL << (128 - prefix);
+                r.lo &= ~(r.count - 1);
+            }
+        }
+        else if ((t.count('-') == 1) && 
+                 is_numeric(t.section('-', 0, 0)) && is_numeric(t.section('-', 1)))
+        {
+            IpAddress from(t.section('-', 0, 0).toLatin1().data());
+            IpAddress to(t.section('-', 1).toLatin1().data());
+            unsigned long long count = 0;
+
+            if (!from.valid() || !to.valid() || 
+                (from.get_ip_version() != to.get_ip_version()))
+            {
+                err = QString("Invalid address range: %1").arg(t);
+                return false;
+            }
+
+            if (!address_count(from, to, count))
+            {
+                err = QString("Second address must be greater than the first one") +
+                      QString(" with a range smaller than 2^64 addresses: %1").arg(t);
+                return false;
+            }
+
+            make_range(from, count, r);
+        }
+        else
+        {
+            IpAddress a(t.toLatin1().data());
+
+            if (!a.valid())
+            {
+                err = QString("Invalid address: %1").arg(t);
+                return false;
+            }
+
+            make_range(a, 1, r);
+        }
+
+        ranges.append(r);
+    }
+
+    return true;
+}
+
+// Parse the detail OIDs, numerical or MIB names with an optional
+// instance (sysObjectID.0), and name the matching columns
+bool Discovery::ParseDetailOids(const QString &text, QList<Oid> &oids,
+                                QStringList &labels, QString &err)
+{
+    QStringList l = text.split(QRegExp("[,;\\s]+"), QString::SkipEmptyParts);
+
+    for (int i = 0; i < l.size(); i++)
+    {
+        QString numeric = l[i];
+
+        if (!l[i].at(0).isDigit())
+        {
+            SmiNode *node = smiGetNode(NULL, 
+                                       l[i].section('.', 0, 0).toLatin1().data());
+            if (!node)
+            {
+                err = QString("Unknown object: %1").arg(l[i]);
+                return false;
+            }
+
+            numeric = smiRenderOID(node->oidlen, node->oid, SMI_RENDER_NUMERIC);
+            if (l[i].contains('.'))
+                numeric += "." + l[i].section('.', 1);
+        }
+
+        Oid oid(numeric.toLatin1().data());
+        if (!oid.valid() || (oid.len() < 2))
+        {
+            err = QString("Invalid OID: %1").arg(l[i]);
+            return false;
+        }
+
+        // Longest known prefix, then the instance
+        QString label = numeric;
+        SmiNode *node = Agent::GetNodeFromOid(oid);
+        if (node && (node->oidlen > 0))
+        {
+            label = node->name;
+            for (unsigned int k = node->oidlen; k < oid.len(); k++)
+                label += QString(".%1").arg(oid[k]);
+        }
+
+        oids.append(oid);
+        labels.append(label);
+    }
+
+    return true;
+}
+
 void Discovery::Discover()
 {
-    int num_transport = 0;
-    dt->num_proto = 0;
-    dt->num_addresses = 0;
+    bool v4 = s->PreferencesObj()->GetEnableIPv4();
+    bool v6 = s->PreferencesObj()->GetEnableIPv6();
+
+    dt->versions.clear();
+    dt->ranges.clear();
 
-    if (s->MainUI()->DiscoveryV1->isChecked()) dt->num_proto++;
-    if (s->MainUI()->DiscoveryV2c->isChecked()) dt->num_proto++;
-    if (s->MainUI()->DiscoveryV3->isChecked()) dt->num_proto++;
+    if (s->MainUI()->DiscoveryV1->isChecked()) dt->versions.append(version1);
+    if (s->MainUI()->DiscoveryV2c->isChecked()) dt->versions.append(version2c);
+    if (s->MainUI()->DiscoveryV3->isChecked()) dt->versions.append(version3);
 
-    if (dt->num_proto < 1)
+    if (dt->versions.isEmpty())
         return;
 
-    dt->wait_time = s->MainUI()->DiscoveryWaitTime->value();
+    dt->enrich_oids.clear();
+    dt->enrich = s->MainUI()->DiscoveryDetails->isChecked();
 
-    s->MainUI()->DiscoveryProgress->reset();
-    s->MainUI()->DiscoveryOutput->clear();
+    QStringList columns;
+    columns << "Name" << "Address/Port" << "Protocol" << "Up Time" 
+            << "Contact Person" << "System Location" << "System Description";
+
+    if (dt->enrich)
+    {
+        QString err;
+        QStringList labels;
+
+        if (!ParseDetailOids(s->MainUI()->DiscoveryDetailOids->text(), 
+                             dt->enrich_oids, labels, err))
+        {
+            QMessageBox::critical ( NULL, "Details", err, 
+                                    QMessageBox::Ok, Qt::NoButton);
+            return;
+        }
+
+        dt->enrich = !dt->enrich_oids.isEmpty();
+        columns << labels;
+    }
+
+    dt->use_snmpv3_probe = s->MainUI()->DiscoverySNMPv3Probe->isChecked();
+    dt->wait_time = s->MainUI()->DiscoveryWaitTime->value();
+    dt->rate = s->MainUI()->DiscoveryRate->value();
+    dt->retries = s->MainUI()->DiscoveryRetries->value();
 
     if (s->MainUI()->DiscoveryLocal->isChecked())
     {
-        if (s->PreferencesObj()->GetEnableIPv4()) num_transport++;
-        if (s->PreferencesObj()->GetEnableIPv6()) num_transport++;
-        dt->num_addresses = 1;
+        disc_range r;
+
+        if (v4)
+        {
+            make_range(IpAddress("255.255.255.255"), 1, r);
+            dt->ranges.append(r);
+        }
+        if (v6)
+        {
+            make_range(IpAddress("ff02::1"), 1, r);
+            dt->ranges.append(r);
+        }
+    }
+    else if (s->MainUI()->DiscoveryTargets->isChecked())
+    {
+        QString err;
+
+        if (!ParseTargets(s->MainUI()->DiscoveryTargetList->text(), 
+                          dt->ranges, err))
+        {
+            QMessageBox::critical ( NULL, "Address list", err, 
+                                    QMessageBox::Ok, Qt::NoButton);
+            return;
+        }
     }
     else
     {
         IpAddress addr_from(s->MainUI()->DiscoveryFrom->text().toLatin1().data());
         IpAddress addr_to(s->MainUI()->DiscoveryTo->text().toLatin1().data());
+        unsigned long long count = 0;
+        disc_range r;
 
         // From must be a valid IP address
         if (!addr_from.valid() || (addr_from[0] == 0))
@@ -679,77 +1412,58 @@ void Discovery::Discover()
             return;
         }
 
-        // Do checks based on IP version and compute the number of addresses
-        if (vfrom == Address::version_ipv4)
+        if (!address_count(addr_from, addr_to, count))
         {
-            unsigned int from = 0, to = 0;
-
-            if (s->PreferencesObj()->GetEnableIPv4() == false)
-            {
-                QString err = QString("IPv4 address specified but transport is ") +
-                    QString("unavailable (see Options menu->preferences->transport)");
-                QMessageBox::critical ( NULL, "IP transport", err, 
-                                        QMessageBox::Ok, Qt::NoButton);
-                return;
-            }
-
-            IPV4_FROM_UCHAR(addr_from, from);
-            IPV4_FROM_UCHAR(addr_to, to);
-
-            if (from <= to)
-                dt->num_addresses = to - from + 1;
-            else
-            {
-                QString err = QString("'To address' must be greater than 'From address'");
-                QMessageBox::critical ( NULL, "Invalid address range", err, 
-                                        QMessageBox::Ok, Qt::NoButton);
-                return;
-            }
+            QString err = QString("'To address' must be greater than 'From") +
+                QString(" address' with a range smaller than 2^64 addresses");
+            QMessageBox::critical ( NULL, "Invalid address range", err, 
+                    QMessageBox::Ok, Qt::NoButton);
+            return;
         }
-        else
-        if (vfrom == Address::version_ipv6)
-        {
-            unsigned long long lofrom = 0, hifrom = 0, loto = 0, hito = 0;
 
-            if (s->PreferencesObj()->GetEnableIPv6() == false)
-            {
-                QString err = QString("IPv6 address specified but transport is ") +
-                    QString("unavailable (see Options menu->preferences->transport)");
-                QMessageBox::critical ( NULL, "IP transport", err, 
-                                        QMessageBox::Ok, Qt::NoButton);
-                return;
-            }
+        make_range(addr_from, count, r);
+        dt->ranges.append(r);
+    }
 
-            IPV6_FROM_UCHAR(addr_from, hifrom, lofrom);
-            IPV6_FROM_UCHAR(addr_to, hito, loto);
+    // Number the addresses of the sweep, and check the transports
+    unsigned long long total = 0;
+    unsigned long long max_total = (1ULL << 62) / dt->versions.size();
 
-            if (((hito - hifrom) == 0) && (lofrom <= loto))
-                dt->num_addresses = loto - lofrom + 1;
-            else if (((hito - hifrom) == 1) && (lofrom > loto))
-                dt->num_addresses = ~lofrom + loto + 1;
-            else
-            {
-                QString err = QString("'To address' must be greater than 'From") +
-                    QString(" address' with a range no larger than 2^64 addresses");
-                QMessageBox::critical ( NULL, "Invalid address range", err, 
-                        QMessageBox::Ok, Qt::NoButton);
-                return;
-            }
+    for (int i = 0; i < dt->ranges.size(); i++)
+    {
+        disc_range &r = dt->ranges[i];
+
+        if ((r.ipv4 && !v4) || (!r.ipv4 && !v6))
+        {
+            QString err = QString("%1 address specified but transport is ")
+                                  .arg(r.ipv4?"IPv4":"IPv6") +
+                QString("unavailable (see Options menu->preferences->transport)");
+            QMessageBox::critical ( NULL, "IP transport", err, 
+                                    QMessageBox::Ok, Qt::NoButton);
+            return;
         }
-        else
+
+        if (r.count > max_total - total)
         {
-            QString err = QString("Unsupported transport type");
-            QMessageBox::critical ( NULL, "Transport", err, 
+            QString err = QString("Too many addresses to discover");
+            QMessageBox::critical ( NULL, "Invalid address range", err, 
                                     QMessageBox::Ok, Qt::NoButton);
             return;
         }
 
-        num_transport = 1;
+        r.first = total;
+        total += r.count;
     }
 
-    s->MainUI()->DiscoveryProgress->setRange(0, 
-        num_transport*dt->num_proto*dt->wait_time);
+    if (dt->ranges.isEmpty())
+        return;
+
+    s->MainUI()->DiscoveryProgress->reset();
+    s->MainUI()->DiscoveryOutput->clear();
+    s->MainUI()->DiscoveryOutput->setColumnCount(columns.size());
+    s->MainUI()->DiscoveryOutput->setHeaderLabels(columns);
+    s->MainUI()->DiscoveryProgress->setRange(0, 1000);
+    agents.clear();
 
     dt->start();
 }
-
@@ -25,6 +25,25 @@
 #include "snmpb.h"
 
 class DiscoveryThread;
+class AgentProfile;
+
+// Addresses to probe, IPv4 addresses are stored in lo
+typedef struct
+{
+    bool ipv4;
+    unsigned long long hi, lo;  // first address
+    unsigned long long count;
+    unsigned long long first;   // index of the first address in the sweep
+    bool broadcast;             // broadcast or multicast, many replies
+} disc_range;
+
+// Probe waiting for a reply
+typedef struct
+{
+    unsigned long long id;      // address index * versions + version index
+    qint64 sent;                // usec, last try
+    int tries;
+} disc_probe;
 
 class DiscoverySnmp: public Snmp
 {
@@ -32,8 +51,10 @@ public:
     DiscoverySnmp(int &status, const UdpAddress &addr);
     DiscoverySnmp(int &status,  const UdpAddress &addr_v4, const UdpAddress &addr_v6);
 
-    void discover(const UdpAddress &start_addr, unsigned long long num_addr,
-                  const int timeout_sec, const snmp_version version,
+    void discover(const QList<disc_range> &ranges,
+                  const QList<snmp_version> &versions,
+                  unsigned short port,
+                  const int timeout_sec, const int rate, const int retries,
                   QString readcomm, QString secname, int seclevel, 
                   QString cxtname, QString ctxengineid, bool use_snmpv3_probe,
                   DiscoveryThread *thread);
@@ -41,6 +62,70 @@ public:
     bool aborting;
 };
 
+// SNMP versions an agent replied to
+#define DISC_VERSION_V1  0x1
+#define DISC_VERSION_V2C 0x2
+#define DISC_VERSION_V3  0x4
+
+// Reply to a probe, waiting to be displayed
+typedef struct
+{
+    QStringList info;           // one string per output column
+    unsigned int version;       // DISC_VERSION_* bit
+} disc_reply;
+
+// Agent in the output, by address
+typedef struct
+{
+    QTreeWidgetItem *item;
+    unsigned int versions;      // DISC_VERSION_* bits
+} disc_agent;
+
+// Agent waiting for its details
+typedef struct
+{
+    UdpAddress address;
+    snmp_version version;
+} disc_enrich_req;
+
+// Queries the details of the agents found by a discovery while the sweep
+// goes on: one GET of all the detail OIDs per agent, a bounded number
+// of them in flight
+class DiscoveryEnricher: public QThread
+{
+    Q_OBJECT
+
+public:
+    DiscoveryEnricher(QObject *parent);
+    void Setup(AgentProfile *ap, const QList<Oid> &oids);
+    void Add(const UdpAddress &a, snmp_version v);
+    void Finish();
+    void Abort();
+    void Reply(int reason, Pdu &pdu, SnmpTarget &target);
+    void TakeDetails(QList<QStringList> &details);
+    void run();
+
+protected:
+    void Send(const disc_enrich_req &r);
+    void AddDetails(const QStringList &d);
+
+protected:
+    Snmpb *s;
+    Snmp *snmp;
+    int status;
+    AgentProfile *profile;
+    QList<Oid> detail_oids;
+
+    QMutex mutex;
+    QWaitCondition cond;
+    QList<disc_enrich_req> queue;
+    QSet<QString> seen;
+    QList<QStringList> results;  // not displayed yet
+    bool finishing;
+    bool aborting;
+    int outstanding;            // enricher thread only
+};
+
 class DiscoveryThread: public QThread
 {
     Q_OBJECT
@@ -48,17 +133,23 @@ class DiscoveryThread: public QThread
 public:
     DiscoveryThread(QObject *parent);
     void run();
-    void SendAgentInfo(Pdu pdu, UdpAddress a, snmp_version v);
-    void Progress();
+    void SendAgentInfo(const Pdu &pdu, const UdpAddress &a, snmp_version v);
+    void TakeAgents(QList<disc_reply> &agents);
+    void Progress(int permille);
     void Abort();
 
 public:
-    int num_proto;
-    unsigned long long num_addresses;
+    QList<disc_range> ranges;
+    QList<snmp_version> versions;
+    bool use_snmpv3_probe;
     int wait_time;
+    int rate;           // probes per second
+    int retries;
+    bool enrich;
+    QList<Oid> enrich_oids;
+    DiscoveryEnricher *enricher;
 
 signals:
-    void SendAgent(QStringList agent_info);
     void SignalStartStop(int isstart);
     void SignalProgress(int value);
 
@@ -66,7 +157,10 @@ protected:
     Snmpb *s;
     DiscoverySnmp *snmp;
     int status;
-    int current_progress;
+
+    // Replies not displayed yet, taken in batches by the GUI thread
+    QMutex results_mutex;
+    QList<disc_reply> results;
 };
 
 class Discovery: public QObject
@@ -76,10 +170,19 @@ class Discovery: public QObject
 public:
     Discovery(Snmpb *snmpb);
 
+    static bool ParseTargets(const QString &text, QList<disc_range> &ranges,
+                             QString &err);
+    static bool ParseDetailOids(const QString &text, QList<Oid> &oids,
+                                QStringList &labels, QString &err);
+
+protected:
+    void DisplayAgent(const disc_reply &r, QList<QTreeWidgetItem *> &added);
+    void DisplayDetails(const QStringList &details);
+
 protected slots:
     void Discover();
     void Abort();
-    void DisplayAgent(QStringList agent_info);
+    void DisplayResults();
     void StartStop(int isstart);
     void DisplayProgress(int value);
     void ShowAgentSettings();
@@ -91,6 +194,8 @@ private:
     Snmpb *s;
     DiscoveryThread *dt;
     QAction *addAgentAct;
+    QHash<QString, disc_agent> agents;   // by address/port
+    QTimer display_timer;
 };
 
 #endif /* DISCOVERY_H */
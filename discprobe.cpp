@@ -0,0 +1,79 @@
+/*
+    Copyright (C) 2004-2011 Martin Jolicoeur (snmpb1@gmail.com)
+
+    This file is part of the SnmpB project
+    (http://sourceforge.net/projects/snmpb)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "discprobe.h"
+
+static const unsigned char reqid_marker[] =
+    { 0x02, 0x04, 0x5A, 0xA5, 0xC3, 0x3C };
+
+const unsigned char disc_v3_probe[] =
+{
+    0x30, 0x3c,
+    0x02, 0x01, 0x03,             // Version: 3
+    0x30, 0x0f,                   // global header length 15
+    0x02, 0x03, 0x01, 0x00, 0x00, // message id
+    0x02, 0x02, 0x10, 0x00,       // message max size
+    0x04, 0x01, 0x04,             // flags (reportable set)
+    0x02, 0x01, 0x03,             // security model USM
+    0x04, 0x10,                   // security params
+    0x30, 0x0e,
+    0x04, 0x00,                   // no engine id
+    0x02, 0x01, 0x00,             // boots 0
+    0x02, 0x01, 0x00,             // time 0
+    0x04, 0x00,                   // no user name
+    0x04, 0x00,                   // no auth par
+    0x04, 0x00,                   // no priv par
+    0x30, 0x14,
+    0x04, 0x00,                   // no context engine id
+    0x04, 0x00,                   // no context name
+    0xa0, 0x0e,                   // GET PDU
+    0x02, 0x04, 0x5A, 0xA5, 0xC3, 0x3C, // request id (marker)
+    0x02, 0x01, 0x00,             // error status no error
+    0x02, 0x01, 0x00,             // error index 0
+    0x30, 0x00                    // no data
+};
+
+const int disc_v3_probe_len = sizeof(disc_v3_probe);
+
+// The request id follows the community or the context name, which
+// could contain the marker too: the last occurrence is the one. The
+// varbinds after it hold OIDs and NULLs only.
+int disc_find_reqid(const unsigned char *buf, int len)
+{
+    for (int i = len - (int)sizeof(reqid_marker); i >= 0; i--)
+        if (memcmp(buf + i, reqid_marker, sizeof(reqid_marker)) == 0)
+            return i + 2;
+    return -1;
+}
+
+void disc_patch_reqid(unsigned char *buf, int offset, unsigned int reqid)
+{
+    buf[offset]     = (reqid >> 24) & 0xFF;
+    buf[offset + 1] = (reqid >> 16) & 0xFF;
+    buf[offset + 2] = (reqid >> 8) & 0xFF;
+    buf[offset + 3] = reqid & 0xFF;
+}
+
+unsigned int disc_probe_reqid(unsigned long long id)
+{
+    return DISC_REQID_BASE + (unsigned int)(id % DISC_REQID_RANGE);
+}
@@ -0,0 +1,49 @@
+/*
+    Copyright (C) 2004-2011 Martin Jolicoeur (snmpb1@gmail.com)
+
+    This file is part of the SnmpB project
+    (http://sourceforge.net/projects/snmpb)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DISCPROBE_H
+#define DISCPROBE_H
+
+/* Request id encoded in the probe templates, then searched for */
+#define DISC_REQID_MARKER 0x5AA5C33C
+
+/* Patched request ids stay in 0x40000000-0x7FFFFFFE: always 4 bytes long */
+#define DISC_REQID_BASE  0x40000000
+#define DISC_REQID_RANGE 0x3FFFFFFF
+
+/* Unauthenticated SNMPv3 GET, to find agents and their engine ids */
+extern const unsigned char disc_v3_probe[];
+extern const int disc_v3_probe_len;
+
+/*
+ * Discovery probes are encoded once with DISC_REQID_MARKER as request id.
+ * For each address, a copy gets the request id of its probe patched in.
+ */
+
+/* Offset of the request id value in an encoded probe, or -1 */
+int disc_find_reqid(const unsigned char *buf, int len);
+
+/* Write a request id returned by disc_probe_reqid() at that offset */
+void disc_patch_reqid(unsigned char *buf, int offset, unsigned int reqid);
+
+/* Request id of the probe with the given sequence number */
+unsigned int disc_probe_reqid(unsigned long long id);
+
+#endif /* DISCPROBE_H */
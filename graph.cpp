@@ -49,6 +49,7 @@ GraphItem::GraphItem(Snmpb *snmpb):QwtPlot(snmpb->MainUI()->GraphName->text())
     s->MainUI()->GraphTab->addTab(this, s->MainUI()->GraphName->text());
     dataCount = 0;
     timerID = 0;
+    reply = NULL;
 
     new tracker(canvas());
     
@@ -124,6 +125,14 @@ void GraphItem::RemoveCurve(QString name)
 
 void GraphItem::timerEvent(QTimerEvent *)
 {
+    // The previous sample did not arrive within a period
+    if (reply)
+    {
+        delete reply;
+        reply = NULL;
+        curves[0].data[dataCount-1] = 0;
+    }
+
     if ( dataCount < PLOT_HISTORY )
     {
         dataCount++;
@@ -143,9 +152,11 @@ void GraphItem::timerEvent(QTimerEvent *)
         }    
     }
     
-    /* Set the data */
-    curves[0].data[dataCount-1] = 
-        s->AgentObj()->GetSyncValue(curves[0].object->title().text());
+    /* Set the data once the response arrives */
+    reply = s->AgentObj()->AsyncGet(curves[0].object->title().text(), this);
+    if (reply)
+        connect(reply, SIGNAL(finished(SnmpReply*)), 
+                this, SLOT(ValueReceived(SnmpReply*)));
     
     setAxisScale(QwtPlot::xBottom, timeData[0], timeData[PLOT_HISTORY - 1]);
     
@@ -158,6 +169,24 @@ void GraphItem::timerEvent(QTimerEvent *)
     replot();
 }
 
+void GraphItem::ValueReceived(SnmpReply *r)
+{
+    if (r != reply)
+        return;
+
+    reply = NULL;
+    r->deleteLater();
+
+    if (!curves[0].object)
+        return;
+
+    if (r->GetStatus() == SNMP_CLASS_SUCCESS)
+        curves[0].data[dataCount-1] = Agent::GetNumericValue(r->GetPdu());
+    else
+        curves[0].data[dataCount-1] = 0;
+    replot();
+}
+
 Graph::Graph(Snmpb *snmpb)
 {
     s = snmpb;
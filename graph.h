@@ -25,6 +25,7 @@
 #include "snmpb.h"
 #include "mibview.h"
 #include "comboboxes.h"
+#include "snmpevents.h"
 
 #define NUM_PLOT_PER_GRAPH 10
 #define PLOT_HISTORY 30
@@ -42,6 +43,9 @@ public:
 
 protected:
     void timerEvent(QTimerEvent *);
+
+protected slots:
+    void ValueReceived(SnmpReply *r);
     
 private:
     Snmpb *s;
@@ -49,6 +53,7 @@ private:
     int dataCount;
     double timeData[PLOT_HISTORY];
     int timerID;
+    SnmpReply *reply;
     
     struct
     {
@@ -134,8 +134,8 @@ MibModule::MibModule(Snmpb *snmpb)
              SIGNAL( clicked() ), this, SLOT( AddModule() ));
     connect( s->MainUI()->ModuleDelete, 
              SIGNAL( clicked() ), this, SLOT( RemoveModule() ));
-    connect( this, SIGNAL( StopAgentTimer() ), 
-             s->AgentObj(), SLOT( StopTimer() ));
+    connect( this, SIGNAL( StopAgentEvents() ), 
+             s->AgentObj(), SLOT( StopEvents() ));
 
     for(SmiModule *mod = smiGetFirstModule(); 
         mod; mod = smiGetNextModule(mod))
@@ -339,7 +339,7 @@ QString MibModule::LoadBestModule(QString oid)
         if ((s->PreferencesObj()->GetAutomaticLoading() == 2) &&
             (Policy != MIBLOAD_ALL))
         {
-            emit StopAgentTimer();
+            emit StopAgentEvents();
             int ret = QMessageBox::question (
                         s->MainUI()->MIBTree,
                         "SnmpB automatic MIB loading",
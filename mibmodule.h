@@ -62,7 +62,7 @@ public slots:
 signals:
     void ModuleProperties(const QString& text);
     void LogError(const QString& text);
-    void StopAgentTimer(void);
+    void StopAgentEvents(void);
 
 private:
     void InitLib(int restart);
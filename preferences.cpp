@@ -21,6 +21,8 @@
 #include "preferences.h"
 
 #include "mibmodule.h"
+#include "agent.h"
+#include "trap.h"
 // For DEFAULT_SMIPATH
 #ifdef WIN32
 #include "../libsmi/win/config.h"
@@ -38,6 +40,30 @@ Preferences::Preferences(Snmpb *snmpb)
     trapport = settings->value("trapport", 162).toInt();
     enableipv6 = settings->value("enableipv6", true).toBool();
     trapport6 = settings->value("trapport6", 162).toInt();
+    traplisteners = settings->value("traplisteners", 1).toInt();
+    coalescewindow = settings->value("coalescewindow", 10).toInt();
+    adaptivetimeout = settings->value("adaptivetimeout", false).toBool();
+
+    // Needed before the GUI is set up, when the trap log starts
+    QDir dir = QFileInfo(s->GetPrefsConfigFile()).dir();
+    exportcfg.json = settings->value("exportjson", false).toBool();
+    exportcfg.jsonfile = settings->value("exportjsonfile", 
+                                         dir.filePath("traps.json")).toString();
+    exportcfg.csv = settings->value("exportcsv", false).toBool();
+    exportcfg.csvfile = settings->value("exportcsvfile", 
+                                        dir.filePath("traps.csv")).toString();
+    exportcfg.maxsize = settings->value("exportmaxsize", 10).toInt();
+    exportcfg.maxfiles = settings->value("exportmaxfiles", 5).toInt();
+    exportcfg.syslog = settings->value("exportsyslog", false).toBool();
+#ifdef WIN32
+    exportcfg.syslogdest = settings->value("exportsyslogdest", 
+                                           "localhost:514").toString();
+#else
+    exportcfg.syslogdest = settings->value("exportsyslogdest", 
+                                           "/dev/log").toString();
+#endif
+    exportcfg.facility = settings->value("exportsyslogfacility", 16).toInt();
+    exportcfg.queuesize = settings->value("exportqueuesize", 10000).toInt();
 }
 
 void Preferences::Init(void)
@@ -64,6 +90,8 @@ void Preferences::Init(void)
     modules->setText(0, "Modules");
     traps = new QTreeWidgetItem(p->PreferencesTree);
     traps->setText(0, "Traps");
+    trapexport = new QTreeWidgetItem(p->PreferencesTree);
+    trapexport->setText(0, "Trap Export");
 
     connect( p->PreferencesTree, 
              SIGNAL( currentItemChanged( QTreeWidgetItem *, QTreeWidgetItem * ) ),
@@ -74,12 +102,42 @@ void Preferences::Init(void)
              this, SLOT ( SetTrapPort() ) );
     connect( p->TrapPort6, SIGNAL( valueChanged( int ) ), 
              this, SLOT ( SetTrapPort6() ) );
+    connect( p->TrapListeners, SIGNAL( valueChanged( int ) ), 
+             this, SLOT ( SetTrapListeners() ) );
+    connect( p->CoalesceWindow, SIGNAL( valueChanged( int ) ), 
+             this, SLOT ( SetCoalesceWindow() ) );
+    connect( p->AdaptiveTimeout, SIGNAL( toggled(bool) ),
+             this, SLOT( SetAdaptiveTimeout(bool) ) );
     connect( p->EnableIPv4, SIGNAL( toggled(bool) ),
              this, SLOT( SetEnableIPv4(bool) ) );
     connect( p->EnableIPv6, SIGNAL( toggled(bool) ),
              this, SLOT( SetEnableIPv6(bool) ) );
     connect( p->ExpandTrapBinding, SIGNAL( toggled(bool) ),
              this, SLOT( SetExpandTrapBinding(bool) ) );
+    connect( p->ExportJson, SIGNAL( toggled(bool) ),
+             this, SLOT( SetTrapExport() ) );
+    connect( p->ExportJsonFile, SIGNAL( textChanged(const QString&) ),
+             this, SLOT( SetTrapExport() ) );
+    connect( p->ExportJsonBrowse, SIGNAL( clicked() ),
+             this, SLOT( TrapExportJsonBrowse() ) );
+    connect( p->ExportCsv, SIGNAL( toggled(bool) ),
+             this, SLOT( SetTrapExport() ) );
+    connect( p->ExportCsvFile, SIGNAL( textChanged(const QString&) ),
+             this, SLOT( SetTrapExport() ) );
+    connect( p->ExportCsvBrowse, SIGNAL( clicked() ),
+             this, SLOT( TrapExportCsvBrowse() ) );
+    connect( p->ExportMaxSize, SIGNAL( valueChanged( int ) ), 
+             this, SLOT ( SetTrapExport() ) );
+    connect( p->ExportMaxFiles, SIGNAL( valueChanged( int ) ), 
+             this, SLOT ( SetTrapExport() ) );
+    connect( p->ExportSyslog, SIGNAL( toggled(bool) ),
+             this, SLOT( SetTrapExport() ) );
+    connect( p->ExportSyslogDest, SIGNAL( textChanged(const QString&) ),
+             this, SLOT( SetTrapExport() ) );
+    connect( p->ExportSyslogFacility, SIGNAL( valueChanged( int ) ), 
+             this, SLOT ( SetTrapExport() ) );
+    connect( p->ExportQueueSize, SIGNAL( valueChanged( int ) ), 
+             this, SLOT ( SetTrapExport() ) );
     connect( p->MibLoadingEnable, SIGNAL( toggled(bool) ),
              this, SLOT( SelectAutomaticLoading() ) );
     connect( p->MibLoadingEnablePrompt, SIGNAL( toggled(bool) ),
@@ -143,6 +201,7 @@ void Preferences::Execute (void)
         // Warn if trap port or transport changed ...
         if((trapport != settings->value("trapport", 162).toInt()) ||
            (trapport6 != settings->value("trapport6", 162).toInt()) ||
+           (traplisteners != settings->value("traplisteners", 1).toInt()) ||
            (enableipv4 != settings->value("enableipv4", true).toBool()) ||
            (enableipv6 != settings->value("enableipv6", true).toBool()))
             QMessageBox::information(NULL, "SnmpB transport protocol or trap port changed", 
@@ -153,12 +212,49 @@ void Preferences::Execute (void)
         settings->setValue("horizontalsplit", horizontalsplit);
         settings->setValue("trapport", trapport);
         settings->setValue("trapport6", trapport6);
+        settings->setValue("traplisteners", traplisteners);
+        if (coalescewindow != settings->value("coalescewindow", 10).toInt())
+        {
+            settings->setValue("coalescewindow", coalescewindow);
+            s->AgentObj()->ConfigureCoalescing();
+        }
+        if (adaptivetimeout != settings->value("adaptivetimeout", false).toBool())
+        {
+            settings->setValue("adaptivetimeout", adaptivetimeout);
+            s->AgentObj()->ConfigureTimeouts();
+        }
         settings->setValue("enableipv4", enableipv4);
         settings->setValue("enableipv6", enableipv6);
         settings->setValue("expandtrapbinding", expandtrapbinding);
         settings->setValue("showagentname", showagentname);
         settings->setValue("automaticloading", automaticloading);
 
+        // Restart the trap export sinks if their settings changed
+        if ((exportcfg.json != settings->value("exportjson").toBool()) ||
+            (exportcfg.jsonfile != settings->value("exportjsonfile").toString()) ||
+            (exportcfg.csv != settings->value("exportcsv").toBool()) ||
+            (exportcfg.csvfile != settings->value("exportcsvfile").toString()) ||
+            (exportcfg.maxsize != settings->value("exportmaxsize").toInt()) ||
+            (exportcfg.maxfiles != settings->value("exportmaxfiles").toInt()) ||
+            (exportcfg.syslog != settings->value("exportsyslog").toBool()) ||
+            (exportcfg.syslogdest != settings->value("exportsyslogdest").toString()) ||
+            (exportcfg.facility != settings->value("exportsyslogfacility").toInt()) ||
+            (exportcfg.queuesize != settings->value("exportqueuesize").toInt()))
+        {
+            settings->setValue("exportjson", exportcfg.json);
+            settings->setValue("exportjsonfile", exportcfg.jsonfile);
+            settings->setValue("exportcsv", exportcfg.csv);
+            settings->setValue("exportcsvfile", exportcfg.csvfile);
+            settings->setValue("exportmaxsize", exportcfg.maxsize);
+            settings->setValue("exportmaxfiles", exportcfg.maxfiles);
+            settings->setValue("exportsyslog", exportcfg.syslog);
+            settings->setValue("exportsyslogdest", exportcfg.syslogdest);
+            settings->setValue("exportsyslogfacility", exportcfg.facility);
+            settings->setValue("exportqueuesize", exportcfg.queuesize);
+
+            s->TrapObj()->ConfigureExport();
+        }
+
         if (pathschanged == true)
         {
             // Store modules in local list
@@ -271,6 +367,21 @@ void Preferences::SetTrapPort6(void)
     trapport6 = p->TrapPort6->value();
 }
 
+void Preferences::SetTrapListeners(void)
+{
+    traplisteners = p->TrapListeners->value();
+}
+
+void Preferences::SetCoalesceWindow(void)
+{
+    coalescewindow = p->CoalesceWindow->value();
+}
+
+void Preferences::SetAdaptiveTimeout(bool checked)
+{
+    adaptivetimeout = checked;
+}
+
 void Preferences::SetEnableIPv4(bool checked)
 {
     if ((checked == false) && (enableipv6 == false))
@@ -309,6 +420,38 @@ void Preferences::SetShowAgentName(bool checked)
     showagentname = checked;
 }
 
+void Preferences::SetTrapExport(void)
+{
+    exportcfg.json = p->ExportJson->isChecked();
+    exportcfg.jsonfile = p->ExportJsonFile->text();
+    exportcfg.csv = p->ExportCsv->isChecked();
+    exportcfg.csvfile = p->ExportCsvFile->text();
+    exportcfg.maxsize = p->ExportMaxSize->value();
+    exportcfg.maxfiles = p->ExportMaxFiles->value();
+    exportcfg.syslog = p->ExportSyslog->isChecked();
+    exportcfg.syslogdest = p->ExportSyslogDest->text();
+    exportcfg.facility = p->ExportSyslogFacility->value();
+    exportcfg.queuesize = p->ExportQueueSize->value();
+}
+
+void Preferences::TrapExportJsonBrowse(void)
+{
+    QString file = QFileDialog::getSaveFileName(pw, "JSON lines file",
+                                                p->ExportJsonFile->text(),
+                                                "JSON lines (*.json *.jsonl)");
+    if (!file.isEmpty())
+        p->ExportJsonFile->setText(file);
+}
+
+void Preferences::TrapExportCsvBrowse(void)
+{
+    QString file = QFileDialog::getSaveFileName(pw, "CSV file",
+                                                p->ExportCsvFile->text(),
+                                                "CSV (*.csv)");
+    if (!file.isEmpty())
+        p->ExportCsvFile->setText(file);
+}
+
 void Preferences::SelectAutomaticLoading(void)
 {
     if (p->MibLoadingEnable->isChecked()) automaticloading = 1;
@@ -336,6 +479,11 @@ bool Preferences::GetEnableIPv6(void)
     return enableipv6;
 }
 
+void Preferences::GetTrapExport(trap_export_config &cfg)
+{
+    cfg = exportcfg;
+}
+
 int Preferences::GetAutomaticLoading(void)
 {
     return automaticloading;
@@ -351,6 +499,21 @@ int Preferences::GetTrapPort6(void)
     return trapport6;
 }
 
+int Preferences::GetTrapListeners(void)
+{
+    return traplisteners;
+}
+
+int Preferences::GetCoalesceWindow(void)
+{
+    return coalescewindow;
+}
+
+bool Preferences::GetAdaptiveTimeout(void)
+{
+    return adaptivetimeout;
+}
+
 void Preferences::SaveCurrentProfile(QString &name, int proto)
 {
     curprofile = name;
@@ -384,6 +547,8 @@ void Preferences::SelectedPreferences(QTreeWidgetItem * item, QTreeWidgetItem *)
 
         p->EnableIPv4->setCheckState(enableipv4==true?Qt::Checked:Qt::Unchecked);
         p->EnableIPv6->setCheckState(enableipv6==true?Qt::Checked:Qt::Unchecked);
+        p->CoalesceWindow->setValue(coalescewindow);
+        p->AdaptiveTimeout->setCheckState(adaptivetimeout==true?Qt::Checked:Qt::Unchecked);
     }
     else
     if (item == mibtree)
@@ -409,8 +574,31 @@ void Preferences::SelectedPreferences(QTreeWidgetItem * item, QTreeWidgetItem *)
 
         p->TrapPort->setValue(trapport);
         p->TrapPort6->setValue(trapport6);
+        p->TrapListeners->setValue(traplisteners);
         p->ExpandTrapBinding->setCheckState(expandtrapbinding==true?Qt::Checked:Qt::Unchecked);
         p->ShowAgentName->setCheckState(showagentname==true?Qt::Checked:Qt::Unchecked);
     }
+    else
+    if (item == trapexport)
+    {
+        p->PreferencesProps->setCurrentIndex(4);
+
+        // Each widget change reloads the whole configuration from the page
+        trap_export_config cfg = exportcfg;
+        p->ExportJson->setChecked(cfg.json);
+        p->ExportJsonFile->setText(cfg.jsonfile);
+        p->ExportCsv->setChecked(cfg.csv);
+        p->ExportCsvFile->setText(cfg.csvfile);
+        p->ExportMaxSize->setValue(cfg.maxsize);
+        p->ExportMaxFiles->setValue(cfg.maxfiles);
+        p->ExportSyslog->setChecked(cfg.syslog);
+        p->ExportSyslogDest->setText(cfg.syslogdest);
+        p->ExportSyslogFacility->setValue(cfg.facility);
+        p->ExportQueueSize->setValue(cfg.queuesize);
+
+        QString stats;
+        s->TrapObj()->GetExportStats(stats);
+        p->ExportStats->setText(stats);
+    }
 }
 
@@ -24,6 +24,7 @@
 
 #include "snmpb.h"
 #include "ui_preferences.h"
+#include "trapexport.h"
 
 class Preferences: public QObject
 {
@@ -35,10 +36,14 @@ public:
     void Execute(void);
     int GetTrapPort(void);
     int GetTrapPort6(void);
+    int GetTrapListeners(void);
+    int GetCoalesceWindow(void);
+    bool GetAdaptiveTimeout(void);
     bool GetEnableIPv4(void);
     bool GetEnableIPv6(void);
     bool GetExpandTrapBinding(void);
     bool GetShowAgentName(void);
+    void GetTrapExport(trap_export_config &cfg);
     int GetAutomaticLoading(void);
     void SaveCurrentProfile(QString &name, int proto);
     int GetCurrentProfile(QString &name);
@@ -52,8 +57,14 @@ protected slots:
     void SetHorizontalSplit(bool checked);
     void SetTrapPort(void);
     void SetTrapPort6(void);
+    void SetTrapListeners(void);
+    void SetCoalesceWindow(void);
+    void SetAdaptiveTimeout(bool checked);
     void SetExpandTrapBinding(bool checked);
     void SetShowAgentName(bool checked);
+    void SetTrapExport(void);
+    void TrapExportJsonBrowse(void);
+    void TrapExportCsvBrowse(void);
     void SelectAutomaticLoading(void);
     void ModuleReset(void);
     void ModuleAdd(void);
@@ -72,14 +83,19 @@ private:
     QTreeWidgetItem *mibtree;
     QTreeWidgetItem *modules;
     QTreeWidgetItem *traps;
+    QTreeWidgetItem *trapexport;
 
     bool horizontalsplit;
     int trapport;
     int trapport6;
+    int traplisteners;
+    int coalescewindow;
+    bool adaptivetimeout;
     bool enableipv4;
     bool enableipv6;
     bool expandtrapbinding;
     bool showagentname;
+    trap_export_config exportcfg;
     int automaticloading;
     QString curprofile;
     int curproto;
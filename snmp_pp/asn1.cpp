@@ -400,6 +400,13 @@ unsigned char *asn_parse_header(unsigned char *data,
   register int header_len;
   unsigned long asn_length;
 
+  /* type and length octets must be within data */
+  if ((*datalength < 2) ||
+      ((bufp[1] & ASN_LONG_LEN) &&
+       (2 + (bufp[1] & ~ASN_LONG_LEN) > *datalength))) {
+    ASNERROR("header too short");
+    return NULL;
+  }
   /* this only works on data types < 30, i.e. no extension octets */
   if (IS_EXTENSION_ID(*bufp)) {
     ASNERROR("can't process ID >= 30");
@@ -993,6 +1000,250 @@ unsigned char *asn_build_unsigned_int64(unsigned char *data,
 }
 
 
+/*
+ * asn_rbuild_length - builds an ASN length field that ends right before
+ * data. Same encoding as asn_build_length().
+ *
+ *  Returns a pointer to the first byte of the length field.
+ *  Returns NULL on any error.
+ */
+unsigned char *asn_rbuild_length(unsigned char *data,
+                                 int *datalength,
+                                 int length)
+{
+  int bytes = 0;
+
+  if (length < 0x80) {
+    if (*datalength < 1) {
+      ASNERROR("rbuild_length");
+      return NULL;
+    }
+    *--data = (unsigned char)length;
+    (*datalength)--;
+    return data;
+  }
+
+  for (unsigned int l = (unsigned int)length; l; l >>= 8)
+    bytes++;
+
+  if (*datalength < bytes + 1) {
+    ASNERROR("rbuild_length");
+    return NULL;
+  }
+  for (int i = 0; i < bytes; i++, length >>= 8)
+    *--data = (unsigned char)(length & 0xFF);
+  *--data = (unsigned char)(bytes | ASN_LONG_LEN);
+  *datalength -= bytes + 1;
+  return data;
+}
+
+/*
+ * asn_rbuild_header - builds an ASN header for an object with the ID and
+ * length specified that ends right before data.
+ *
+ *  This only works on data types < 30, i.e. no extension octets.
+ *
+ *  Returns a pointer to the first byte of the header.
+ *  Returns NULL on any error.
+ */
+unsigned char *asn_rbuild_header(unsigned char *data,
+                                 int *datalength,
+                                 unsigned char type,
+                                 int length)
+{
+  data = asn_rbuild_length(data, datalength, length);
+  if ((data == NULL) || (*datalength < 1))
+    return NULL;
+  *--data = type;
+  (*datalength)--;
+  return data;
+}
+
+/*
+ * asn_rbuild_int - builds an ASN object containing an integer that ends
+ * right before data. Same encoding as asn_build_int().
+ *
+ *  Returns a pointer to the first byte of this object.
+ *  Returns NULL on any error.
+ */
+unsigned char *asn_rbuild_int(unsigned char *data,
+                              int *datalength,
+                              unsigned char type,
+                              long value)
+{
+  unsigned char *end = data;
+  unsigned char last;
+
+  /* Emit bytes starting with the least significant one, until the rest
+   * is only the sign extension of the last byte written.
+   */
+  do {
+    if (*datalength < 1) return NULL;
+    last = (unsigned char)(value & 0xFF);
+    *--data = last;
+    (*datalength)--;
+    value >>= 8;
+  } while ((end - data < (int)sizeof(long)) &&
+           !(((value == 0) && !(last & 0x80)) ||
+             ((value == -1) && (last & 0x80))));
+
+  return asn_rbuild_header(data, datalength, type, SAFE_INT_CAST(end - data));
+}
+
+/*
+ * asn_rbuild_unsigned_int - builds an ASN object containing an unsigned
+ * 32 bit integer that ends right before data. Same encoding as
+ * asn_build_unsigned_int().
+ *
+ *  Returns a pointer to the first byte of this object.
+ *  Returns NULL on any error.
+ */
+unsigned char *asn_rbuild_unsigned_int(unsigned char *data,
+                                       int *datalength,
+                                       unsigned char type,
+                                       unsigned long value)
+{
+  unsigned char *end = data;
+
+  value &= 0xFFFFFFFFul;
+  do {
+    if (*datalength < 1) return NULL;
+    *--data = (unsigned char)(value & 0xFF);
+    (*datalength)--;
+    value >>= 8;
+  } while (value);
+
+  // add a null byte if the MSB is set
+  if (*data & 0x80) {
+    if (*datalength < 1) return NULL;
+    *--data = 0;
+    (*datalength)--;
+  }
+
+  return asn_rbuild_header(data, datalength, type, SAFE_INT_CAST(end - data));
+}
+
+/*
+ * asn_rbuild_unsigned_int64 - builds an ASN object containing a 64 bit
+ * unsigned integer that ends right before data. Same encoding as
+ * asn_build_unsigned_int64().
+ *
+ *  Returns a pointer to the first byte of this object.
+ *  Returns NULL on any error.
+ */
+unsigned char *asn_rbuild_unsigned_int64(unsigned char *data,
+                                         int *datalength,
+                                         unsigned char type,
+                                         unsigned long high,
+                                         unsigned long low)
+{
+  unsigned char *end = data;
+
+  high &= 0xFFFFFFFFul;
+  low &= 0xFFFFFFFFul;
+  do {
+    if (*datalength < 1) return NULL;
+    *--data = (unsigned char)(low & 0xFF);
+    (*datalength)--;
+    low = (low >> 8) | ((high & 0xFF) << 24);
+    high >>= 8;
+  } while (high || low);
+
+  // add a null byte if the MSB is set
+  if (*data & 0x80) {
+    if (*datalength < 1) return NULL;
+    *--data = 0;
+    (*datalength)--;
+  }
+
+  return asn_rbuild_header(data, datalength, type, SAFE_INT_CAST(end - data));
+}
+
+/*
+ * asn_rbuild_string - builds an ASN octet string object that ends right
+ * before data.
+ *
+ *  Returns a pointer to the first byte of this object.
+ *  Returns NULL on any error.
+ */
+unsigned char *asn_rbuild_string(unsigned char *data,
+                                 int *datalength,
+                                 unsigned char type,
+                                 const unsigned char *string,
+                                 int strlength)
+{
+  if (*datalength < strlength) return NULL;
+
+  data -= strlength;
+  *datalength -= strlength;
+  if (strlength)
+    memcpy(data, string, strlength);
+
+  return asn_rbuild_header(data, datalength, type, strlength);
+}
+
+/*
+ * asn_rbuild_objid - builds an ASN object identifier object that ends
+ * right before data. Same encoding as asn_build_objid().
+ *
+ *  Returns a pointer to the first byte of this object.
+ *  Returns NULL on any error.
+ */
+unsigned char *asn_rbuild_objid(unsigned char *data,
+                                int *datalength,
+                                unsigned char type,
+                                const oid *objid,
+                                int objidlength)
+{
+  /*
+   * ASN.1 objid ::= 0x06 asnlength subidentifier {subidentifier}*
+   * subidentifier ::= {leadingbyte}* lastbyte
+   * leadingbyte ::= 1 7bitvalue
+   * lastbyte ::= 0 7bitvalue
+   */
+  unsigned char *end = data;
+  unsigned long subid;
+
+  if (objidlength < 2) {
+    if (*datalength < 1) return NULL;
+    *--data = 0;
+    (*datalength)--;
+    return asn_rbuild_header(data, datalength, type, 1);
+  }
+
+  // the first two subidentifiers are encoded as (X * 40) + Y
+  for (int i = objidlength - 1; i > 0; i--) {
+    subid = (i == 1) ? (objid[0] * 40 + objid[1]) : objid[i];
+    subid &= 0xFFFFFFFFul;
+
+    /* last byte has high bit clear */
+    if (*datalength < 1) return NULL;
+    *--data = (unsigned char)(subid & 0x7F);
+    (*datalength)--;
+    for (subid >>= 7; subid; subid >>= 7) {
+      if (*datalength < 1) return NULL;
+      *--data = (unsigned char)((subid & 0x7F) | ASN_BIT8);
+      (*datalength)--;
+    }
+  }
+
+  return asn_rbuild_header(data, datalength, type, SAFE_INT_CAST(end - data));
+}
+
+/*
+ * asn_rbuild_null - Builds an ASN null object that ends right before data.
+ *
+ *  Returns a pointer to the first byte of this object.
+ *  Returns NULL on any error.
+ */
+unsigned char *asn_rbuild_null(unsigned char *data,
+                               int *datalength,
+                               unsigned char type)
+{
+  return asn_rbuild_header(data, datalength, type, 0);
+}
+
+
 // create a pdu
 struct snmp_pdu *snmp_pdu_create(int command)
 {
@@ -1028,6 +1279,8 @@ void clear_pdu(struct snmp_pdu *pdu, bool clear_all)
     free((char *)ovp);     // free up vb itself
   }
   pdu->variables = NULL;
+  pdu->vb_data = NULL;
+  pdu->vb_data_len = 0;
 
   // if enterprise free it up
   if (pdu->enterprise)
@@ -1646,6 +1899,205 @@ int snmp_parse_vb(struct snmp_pdu *pdu, unsigned char *&data, int &data_len)
 }
 
 
+int snmp_parse_vb_list(struct snmp_pdu *pdu, unsigned char *&data, int &data_len)
+{
+  unsigned char type;
+
+  data = asn_parse_header(data, &data_len, &type);
+  if (data == NULL)
+    return SNMP_CLASS_ASN1ERROR;
+  if (type != ASN_SEQ_CON)
+    return SNMP_CLASS_ASN1ERROR;
+
+  pdu->vb_data = data;
+  pdu->vb_data_len = data_len;
+  data += data_len;
+  data_len = 0;
+  return SNMP_CLASS_SUCCESS;
+}
+
+// Count the subids of the contents of an object identifier.
+// Returns -1 if the encoding is invalid.
+static int asn_check_objid(const unsigned char *data, int length)
+{
+  int count = 1;  // first byte holds two subids
+
+  if (length == 0)
+    return 1;     // handle 06 00 as asn_parse_objid() does
+
+  while (length > 0)
+  {
+    int bytes = 0;
+    unsigned long subid = 0;
+    do {
+      if ((length == 0) || (++bytes > 5)) {
+        ASNERROR("bad subidentifier");
+        return -1;
+      }
+      subid = (subid << 7) + (*data & ~ASN_BIT8);
+      length--;
+    } while (*data++ & ASN_BIT8);
+    if (subid > (unsigned long)MAX_SUBID) {
+      ASNERROR("subidentifier too long");
+      return -1;
+    }
+    if (++count > ASN_MAX_NAME_LEN) {
+      ASNERROR("too many subidentifiers");
+      return -1;
+    }
+  }
+  return count;
+}
+
+int asn_decode_objid(const unsigned char *data, int length,
+                     oid *objid, int max_len)
+{
+  int count = 1;
+
+  if (max_len < 2)
+    return -1;
+  if (length == 0)
+  {
+    objid[0] = 0;
+    return 1;
+  }
+
+  while (length > 0)
+  {
+    unsigned long subid = 0;
+    do {
+      subid = (subid << 7) + (*data & ~ASN_BIT8);
+      length--;
+    } while (*data++ & ASN_BIT8);
+
+    if (count == 1)
+    {
+      // first two subids are encoded as (X * 40) + Y
+      if (subid < 80) {
+        objid[0] = (oid)(subid / 40);
+        objid[1] = (oid)(subid % 40);
+      }
+      else {
+        objid[0] = 2;
+        objid[1] = (oid)(subid - 80);
+      }
+      count = 2;
+    }
+    else
+    {
+      if (count >= max_len)
+        return -1;
+      objid[count++] = (oid)subid;
+    }
+  }
+  return count;
+}
+
+unsigned char *asn_parse_vb_view(unsigned char *data, int *datalength,
+                                 struct vb_view *view)
+{
+  unsigned char type;
+  int length = *datalength;
+  int val_len;
+  unsigned char *vb_start = data;
+
+  data = asn_parse_header(data, &length, &type);
+  if ((data == NULL) || (type != ASN_SEQ_CON)) {
+    ASNERROR("bad vb header");
+    return NULL;
+  }
+  view->ber = vb_start;
+  view->ber_len = SAFE_INT_CAST(data - vb_start) + length;
+
+  // name
+  val_len = length;
+  view->name = asn_parse_header(data, &val_len, &type);
+  if ((view->name == NULL) || (type != (ASN_UNI_PRIM | ASN_OBJECT_ID))) {
+    ASNERROR("bad vb name");
+    return NULL;
+  }
+  view->name_len = val_len;
+  view->name_length = asn_check_objid(view->name, val_len);
+  if (view->name_length < 0)
+    return NULL;
+  length -= SAFE_INT_CAST(view->name - data) + val_len;
+  data = view->name + val_len;
+
+  // value
+  val_len = length;
+  view->val = asn_parse_header(data, &val_len, &view->type);
+  if (view->val == NULL) {
+    ASNERROR("bad vb value");
+    return NULL;
+  }
+  if (SAFE_INT_CAST(view->val - data) + val_len != length) {
+    ASNERROR("bad vb length");
+    return NULL;
+  }
+  view->val_len = val_len;
+
+  switch (view->type) {
+  case ASN_INTEGER:
+    if (val_len > (int)sizeof(long)) {
+      ASNERROR("I don't support such large integers");
+      return NULL;
+    }
+    break;
+
+  case SMI_COUNTER:
+  case SMI_GAUGE:
+  case SMI_TIMETICKS:
+  case SMI_UINTEGER:
+    if ((val_len > 5) || ((val_len > 4) && (*view->val != 0x00))) {
+      ASNERROR("I don't support such large integers");
+      return NULL;
+    }
+    break;
+
+  case SMI_COUNTER64:
+    if ((val_len > 9) || ((val_len > 8) && (*view->val != 0x00))) {
+      ASNERROR("I don't support such large integers");
+      return NULL;
+    }
+    break;
+
+  case SMI_IPADDRESS:
+    if ((val_len != 4) && (val_len != 16)) {
+      ASNERROR("bad ip address length");
+      return NULL;
+    }
+    break;
+
+  case ASN_OCTET_STR:
+  case SMI_OPAQUE:
+  case SMI_NSAP:
+    break;
+
+  case ASN_OBJECT_ID:
+    if (asn_check_objid(view->val, val_len) < 0)
+      return NULL;
+    break;
+
+  case SNMP_NOSUCHOBJECT:
+  case SNMP_NOSUCHINSTANCE:
+  case SNMP_ENDOFMIBVIEW:
+  case ASN_NULL:
+    if (val_len != 0) {
+      ASNERROR("Malformed NULL");
+      return NULL;
+    }
+    break;
+
+  default:
+    ASNERROR("bad type returned ");
+    return NULL;
+  }
+
+  *datalength -= view->ber_len;
+  return vb_start + view->ber_len;
+}
+
+
 int snmp_parse_data_pdu(snmp_pdu *pdu, unsigned char *&data, int &length)
 {
   oid	    objid[ASN_MAX_NAME_LEN];
@@ -1737,7 +2189,7 @@ int snmp_parse(struct snmp_pdu *pdu,
   if (res != SNMP_CLASS_SUCCESS)
     return res;
 
-  return snmp_parse_vb(pdu, data, data_length);
+  return snmp_parse_vb_list(pdu, data, data_length);
 }
 
 
@@ -153,6 +153,11 @@ struct snmp_pdu {
 
     // vb list
     struct variable_list *variables;
+
+    // encoded vb list (contents of the SEQUENCE) of a parsed pdu,
+    // points into the parsed message
+    unsigned char *vb_data;
+    int        vb_data_len;
 };
 
 // vb list
@@ -171,6 +176,19 @@ struct variable_list {
     int        val_len;
 };
 
+// A variable binding of a received message that has been checked,
+// but not decoded. All pointers point into the encoded vb list.
+struct vb_view {
+    unsigned char  *ber;                    // start of the variable binding
+    int        ber_len;                     // length of the whole encoding
+    unsigned char  *name;                   // contents of the name (OID)
+    int        name_len;                    // length of the contents
+    int        name_length;                 // number of subid's in name
+    unsigned char   type;                   // ASN type of the value
+    unsigned char  *val;                    // contents of the value
+    int        val_len;                     // length of the contents
+};
+
 struct counter64 {
     unsigned long high;
     unsigned long low;
@@ -274,6 +292,51 @@ DLLOPT unsigned char *asn_build_unsigned_int64(unsigned char *data,
                                                unsigned char type,
                                                struct counter64 *cp);
 
+/*
+ * Back to front builders.
+ *
+ * The asn_rbuild_* functions encode an object so that it ends right
+ * before "data". A message is built from its last byte to its first one,
+ * so the length of every constructed object is known when its header is
+ * written and no temporary buffers are needed.
+ *  On entry, datalength is the number of free bytes in front of "data".
+ *  On exit, it is decreased by the number of bytes used.
+ *
+ *  Returns a pointer to the first byte of the new object.
+ *  Returns NULL if there is not enough space.
+ */
+DLLOPT unsigned char *asn_rbuild_length(unsigned char *data, int *datalength,
+                                        int length);
+
+DLLOPT unsigned char *asn_rbuild_header(unsigned char *data, int *datalength,
+                                        unsigned char type, int length);
+
+DLLOPT unsigned char *asn_rbuild_int(unsigned char *data, int *datalength,
+                                     unsigned char type, long value);
+
+DLLOPT unsigned char *asn_rbuild_unsigned_int(unsigned char *data,
+                                              int *datalength,
+                                              unsigned char type,
+                                              unsigned long value);
+
+DLLOPT unsigned char *asn_rbuild_unsigned_int64(unsigned char *data,
+                                                int *datalength,
+                                                unsigned char type,
+                                                unsigned long high,
+                                                unsigned long low);
+
+DLLOPT unsigned char *asn_rbuild_string(unsigned char *data, int *datalength,
+                                        unsigned char type,
+                                        const unsigned char *string,
+                                        int strlength);
+
+DLLOPT unsigned char *asn_rbuild_objid(unsigned char *data, int *datalength,
+                                       unsigned char type,
+                                       const oid *objid, int objidlength);
+
+DLLOPT unsigned char *asn_rbuild_null(unsigned char *data, int *datalength,
+                                      unsigned char type);
+
 DLLOPT struct snmp_pdu *snmp_pdu_create(int command);
 
 DLLOPT void snmp_free_pdu(struct snmp_pdu *pdu);
@@ -320,6 +383,49 @@ DLLOPT int snmp_parse_data_pdu(struct snmp_pdu *pdu,
 DLLOPT int snmp_parse_vb(struct snmp_pdu *pdu,
                          unsigned char *&data, int &data_len);
 
+/**
+ * Locate the vb list of a pdu without decoding it.
+ *
+ * Only the header of the vb list is parsed. pdu->vb_data is set to
+ * the contents of the list, which are checked and decoded later by
+ * asn_parse_vb_view().
+ */
+DLLOPT int snmp_parse_vb_list(struct snmp_pdu *pdu,
+                              unsigned char *&data, int &data_len);
+
+/**
+ * Check the encoding of one variable binding and fill a view of it.
+ *
+ * Name and value are checked as far as they would be decoded, so
+ * decoding the view afterwards can not fail. Nothing is copied.
+ *
+ * @param data       - Start of the encoded variable binding
+ * @param datalength - IN: number of valid bytes following data
+ *                     OUT: number of valid bytes following the
+ *                          variable binding
+ * @param view       - OUT: the view
+ *
+ * @return Pointer to the first byte past the variable binding or
+ *         NULL on any error.
+ */
+DLLOPT unsigned char *asn_parse_vb_view(unsigned char *data,
+                                        int *datalength,
+                                        struct vb_view *view);
+
+/**
+ * Decode the contents of an object identifier that has been checked
+ * by asn_parse_vb_view().
+ *
+ * @param data    - Contents of the object identifier
+ * @param length  - Length of the contents
+ * @param objid   - OUT: the subids
+ * @param max_len - Size of the objid array
+ *
+ * @return Number of subids or -1 if objid is too small
+ */
+DLLOPT int asn_decode_objid(const unsigned char *data, int length,
+                            oid *objid, int max_len);
+
 DLLOPT void clear_pdu(struct snmp_pdu *pdu, bool clear_all = false);
 
 /**
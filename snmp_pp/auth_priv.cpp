@@ -668,9 +668,40 @@ int AuthPriv::password_to_key_auth(const int            auth_prot,
   if (!a)
     return SNMPv3_USM_UNSUPPORTED_AUTHPROTOCOL;
 
-  int res = a->password_to_key(password, password_len,
-                               engine_id, engine_id_len,
-                               key, key_len);
+  // Look for the localized key, then for the master key in the cache
+  unsigned char digest[SNMPv3_KEYCACHE_DIGEST_LEN];
+  key_cache.get_digest(auth_prot, password, password_len, digest);
+
+  if (key_cache.get_localized_key(auth_prot, digest,
+                                  engine_id, engine_id_len, key, key_len))
+    return SNMPv3_USM_OK;
+
+  unsigned char master_key[SNMPv3_USM_MAX_KEY_LEN];
+  unsigned int master_key_len = SNMPv3_USM_MAX_KEY_LEN;
+  int res;
+
+  if (!key_cache.get_master_key(auth_prot, digest,
+                                master_key, &master_key_len))
+  {
+    res = a->password_to_master_key(password, password_len,
+                                    master_key, &master_key_len);
+    if (res != SNMPv3_USM_OK)
+    {
+      // The protocol does not support caching
+      return a->password_to_key(password, password_len,
+                                engine_id, engine_id_len,
+                                key, key_len);
+    }
+    key_cache.add_master_key(auth_prot, digest, master_key, master_key_len);
+  }
+
+  res = a->localize_key(master_key, master_key_len,
+                        engine_id, engine_id_len, key, key_len);
+  memset(master_key, 0, sizeof(master_key));
+
+  if (res == SNMPv3_USM_OK)
+    key_cache.add_localized_key(auth_prot, digest,
+                                engine_id, engine_id_len, key, *key_len);
 
   return res;
 }
@@ -740,6 +771,722 @@ int AuthPriv::password_to_key_priv(const int            auth_prot,
 
 
 
+/* ----------------------- KeyCache ---------------------------------------*/
+
+/* Header of a saved key cache: magic, engine time and privacy params
+   of the AES encryption, followed by the encrypted keys and the
+   HMAC-SHA of all of it */
+#define KEYCACHE_FILE_MAGIC      "SNMPKC01"
+#define KEYCACHE_FILE_MAGIC_LEN  8
+#define KEYCACHE_FILE_HEADER_LEN (KEYCACHE_FILE_MAGIC_LEN + 4 + 8)
+#define KEYCACHE_FILE_MAC_LEN    12
+#define KEYCACHE_FILE_MAX_LEN    (16 * 1024 * 1024)
+
+KeyCache::KeyCache()
+  : entries(0), entry_count(0), entry_size(0), buckets(0), bucket_count(0),
+    max_entries(SNMPv3_KEYCACHE_MAX_ENTRIES), hits(0), misses(0)
+{
+  /* The salt only has to differ between caches.
+     srand() has been already done in Snmp::init() */
+  for (int i = 0; i < SNMPv3_KEYCACHE_SALT_LEN; i++)
+    salt[i] = (unsigned char)(rand() >> 3);
+}
+
+KeyCache::~KeyCache()
+{
+  clear();
+  delete [] entries;
+  delete [] buckets;
+}
+
+void KeyCache::get_digest(const int auth_prot,
+                          const unsigned char *password,
+                          const unsigned int   password_len,
+                          unsigned char       *digest)
+{
+  SHAHashStateType sha_hash_state;
+  unsigned char prot[4];
+
+  prot[0] = (unsigned char)(auth_prot >> 24);
+  prot[1] = (unsigned char)(auth_prot >> 16);
+  prot[2] = (unsigned char)(auth_prot >> 8);
+  prot[3] = (unsigned char)(auth_prot);
+
+  lock();
+  SHA1_INIT(&sha_hash_state);
+  SHA1_PROCESS(&sha_hash_state, salt, SNMPv3_KEYCACHE_SALT_LEN);
+  unlock();
+  SHA1_PROCESS(&sha_hash_state, prot, 4);
+  SHA1_PROCESS(&sha_hash_state, password, password_len);
+  SHA1_DONE(&sha_hash_state, digest);
+}
+
+bool KeyCache::get_master_key(const int auth_prot,
+                              const unsigned char *digest,
+                              unsigned char *key, unsigned int *key_len)
+{
+  return get(auth_prot, false, digest, 0, 0, key, key_len);
+}
+
+void KeyCache::add_master_key(const int auth_prot,
+                              const unsigned char *digest,
+                              const unsigned char *key,
+                              const unsigned int   key_len)
+{
+  lock();
+  add(auth_prot, false, digest, 0, 0, key, key_len);
+  unlock();
+}
+
+bool KeyCache::get_localized_key(const int auth_prot,
+                                 const unsigned char *digest,
+                                 const unsigned char *engine_id,
+                                 const unsigned int   engine_id_len,
+                                 unsigned char *key, unsigned int *key_len)
+{
+  return get(auth_prot, true, digest, engine_id, engine_id_len,
+             key, key_len);
+}
+
+void KeyCache::add_localized_key(const int auth_prot,
+                                 const unsigned char *digest,
+                                 const unsigned char *engine_id,
+                                 const unsigned int   engine_id_len,
+                                 const unsigned char *key,
+                                 const unsigned int   key_len)
+{
+  lock();
+  add(auth_prot, true, digest, engine_id, engine_id_len, key, key_len);
+  unlock();
+}
+
+void KeyCache::clear()
+{
+  lock();
+  clear_entries();
+  unlock();
+}
+
+// Wipe all entries, the cache must be locked
+void KeyCache::clear_entries()
+{
+  if (entries)
+    memset(entries, 0, entry_size * sizeof(KeyCacheEntry));
+  for (int i = 0; i < bucket_count; i++)
+    buckets[i] = -1;
+  entry_count = 0;
+}
+
+unsigned int KeyCache::hash(const unsigned char *digest,
+                            const unsigned char *engine_id,
+                            const unsigned int   engine_id_len) const
+{
+  // The digest is already well distributed, mix in the engine id (FNV-1a)
+  unsigned int h = (digest[0] << 24) | (digest[1] << 16) |
+                   (digest[2] << 8) | digest[3];
+
+  for (unsigned int i = 0; i < engine_id_len; i++)
+    h = (h ^ engine_id[i]) * 16777619U;
+
+  return h;
+}
+
+int KeyCache::find(const int auth_prot, const bool localized,
+                   const unsigned char *digest,
+                   const unsigned char *engine_id,
+                   const unsigned int   engine_id_len) const
+{
+  if (bucket_count == 0)
+    return -1;
+
+  int i = buckets[hash(digest, engine_id, engine_id_len) & (bucket_count - 1)];
+  for (; i >= 0; i = entries[i].next)
+  {
+    const KeyCacheEntry &e = entries[i];
+
+    if ((e.auth_prot == auth_prot) && (e.localized == localized) &&
+        (e.engine_id_len == engine_id_len) &&
+        !memcmp(e.digest, digest, SNMPv3_KEYCACHE_DIGEST_LEN) &&
+        (!engine_id_len || !memcmp(e.engine_id, engine_id, engine_id_len)))
+      return i;
+  }
+  return -1;
+}
+
+bool KeyCache::get(const int auth_prot, const bool localized,
+                   const unsigned char *digest,
+                   const unsigned char *engine_id,
+                   const unsigned int   engine_id_len,
+                   unsigned char *key, unsigned int *key_len)
+{
+  if (engine_id_len > MAXLENGTH_ENGINEID)
+    return false;
+
+  lock();
+  int i = find(auth_prot, localized, digest, engine_id, engine_id_len);
+  if (i < 0)
+  {
+    misses++;
+    unlock();
+    return false;
+  }
+
+  memcpy(key, entries[i].key, entries[i].key_len);
+  *key_len = entries[i].key_len;
+  hits++;
+  unlock();
+
+  return true;
+}
+
+// Add or replace an entry, the cache must be locked
+void KeyCache::add(const int auth_prot, const bool localized,
+                   const unsigned char *digest,
+                   const unsigned char *engine_id,
+                   const unsigned int   engine_id_len,
+                   const unsigned char *key, const unsigned int key_len)
+{
+  if ((engine_id_len > MAXLENGTH_ENGINEID) ||
+      (key_len > SNMPv3_USM_MAX_KEY_LEN))
+    return;
+
+  int i = find(auth_prot, localized, digest, engine_id, engine_id_len);
+  if (i < 0)
+  {
+    if ((entry_count >= max_entries) ||
+        ((entry_count == entry_size) && !grow()))
+      return;
+
+    i = entry_count++;
+    KeyCacheEntry &e = entries[i];
+    e.auth_prot = auth_prot;
+    e.localized = localized;
+    memcpy(e.digest, digest, SNMPv3_KEYCACHE_DIGEST_LEN);
+    if (engine_id_len)  // master keys have no engine id
+      memcpy(e.engine_id, engine_id, engine_id_len);
+    e.engine_id_len = engine_id_len;
+
+    unsigned int b = hash(digest, engine_id, engine_id_len) & (bucket_count - 1);
+    e.next = buckets[b];
+    buckets[b] = i;
+  }
+
+  memcpy(entries[i].key, key, key_len);
+  entries[i].key_len = key_len;
+}
+
+// Double the entries, there is one bucket per entry. The cache must be
+// locked
+bool KeyCache::grow()
+{
+  int new_size = entry_size ? entry_size * 2 : 64;
+
+  KeyCacheEntry *new_entries = new KeyCacheEntry[new_size];
+  int *new_buckets = new int[new_size];
+  if (!new_entries || !new_buckets)
+  {
+    delete [] new_entries;
+    delete [] new_buckets;
+    return false;
+  }
+
+  if (entries)
+  {
+    memcpy(new_entries, entries, entry_count * sizeof(KeyCacheEntry));
+    memset(entries, 0, entry_size * sizeof(KeyCacheEntry));
+    delete [] entries;
+  }
+  delete [] buckets;
+
+  entries = new_entries;
+  entry_size = new_size;
+  buckets = new_buckets;
+  bucket_count = new_size;
+
+  for (int i = 0; i < bucket_count; i++)
+    buckets[i] = -1;
+  for (int i = 0; i < entry_count; i++)
+  {
+    unsigned int b = hash(entries[i].digest, entries[i].engine_id,
+                          entries[i].engine_id_len) & (bucket_count - 1);
+    entries[i].next = buckets[b];
+    buckets[b] = i;
+  }
+  return true;
+}
+
+// AES128 and HMAC-SHA keys of a saved cache
+void KeyCache::derive_file_keys(const unsigned char *file_key,
+                                const unsigned int   file_key_len,
+                                unsigned char *enc_key, unsigned char *mac_key)
+{
+  SHAHashStateType sha_hash_state;
+  unsigned char digest[SNMPv3_AP_OUTPUT_LENGTH_SHA];
+  unsigned char label;
+
+  label = 1;
+  SHA1_INIT(&sha_hash_state);
+  SHA1_PROCESS(&sha_hash_state, &label, 1);
+  SHA1_PROCESS(&sha_hash_state, file_key, file_key_len);
+  SHA1_DONE(&sha_hash_state, digest);
+  memcpy(enc_key, digest, 16);
+
+  label = 2;
+  SHA1_INIT(&sha_hash_state);
+  SHA1_PROCESS(&sha_hash_state, &label, 1);
+  SHA1_PROCESS(&sha_hash_state, file_key, file_key_len);
+  SHA1_DONE(&sha_hash_state, mac_key);
+
+  memset(digest, 0, sizeof(digest));
+}
+
+// Save all keys, encrypted, into a file.
+int KeyCache::save_to_file(const char *name, AuthPriv *ap,
+                           const unsigned char *file_key,
+                           const unsigned int   file_key_len)
+{
+  char tmp_file_name[MAXLENGTH_FILENAME];
+
+  if (!name || !ap || !file_key || !file_key_len)
+  {
+    LOG_BEGIN(ERROR_LOG | 1);
+    LOG("KeyCache: save_to_file called with illegal param");
+    LOG_END;
+
+    return SNMPv3_USM_ERROR;
+  }
+
+  if (!ap->get_priv(SNMP_PRIVPROTOCOL_AES128) ||
+      !ap->get_auth(SNMP_AUTHPROTOCOL_HMACSHA))
+    return SNMPv3_USM_UNSUPPORTED_PRIVPROTOCOL;
+
+  lock();
+
+  // Serialize the keys
+  unsigned int plain_len = SNMPv3_KEYCACHE_SALT_LEN + 4;
+  for (int i = 0; i < entry_count; i++)
+    plain_len += 4 + 1 + SNMPv3_KEYCACHE_DIGEST_LEN +
+                 1 + entries[i].engine_id_len + 1 + entries[i].key_len;
+
+  unsigned int file_len = KEYCACHE_FILE_HEADER_LEN + plain_len +
+                          KEYCACHE_FILE_MAC_LEN;
+  Buffer<unsigned char> plain(plain_len);
+  Buffer<unsigned char> file_buf(file_len);
+  unsigned char *p = plain.get_ptr();
+
+  if (!p || !file_buf.get_ptr())
+  {
+    unlock();
+    return SNMPv3_USM_ERROR;
+  }
+
+  memcpy(p, salt, SNMPv3_KEYCACHE_SALT_LEN);
+  p += SNMPv3_KEYCACHE_SALT_LEN;
+  *p++ = (unsigned char)(entry_count >> 24);
+  *p++ = (unsigned char)(entry_count >> 16);
+  *p++ = (unsigned char)(entry_count >> 8);
+  *p++ = (unsigned char)(entry_count);
+
+  for (int i = 0; i < entry_count; i++)
+  {
+    const KeyCacheEntry &e = entries[i];
+
+    *p++ = (unsigned char)(e.auth_prot >> 24);
+    *p++ = (unsigned char)(e.auth_prot >> 16);
+    *p++ = (unsigned char)(e.auth_prot >> 8);
+    *p++ = (unsigned char)(e.auth_prot);
+    *p++ = e.localized ? 1 : 0;
+    memcpy(p, e.digest, SNMPv3_KEYCACHE_DIGEST_LEN);
+    p += SNMPv3_KEYCACHE_DIGEST_LEN;
+    *p++ = (unsigned char)e.engine_id_len;
+    memcpy(p, e.engine_id, e.engine_id_len);
+    p += e.engine_id_len;
+    *p++ = (unsigned char)e.key_len;
+    memcpy(p, e.key, e.key_len);
+    p += e.key_len;
+  }
+  int count = entry_count;
+  unlock();
+
+  // Encrypt and authenticate
+  unsigned char enc_key[16];
+  unsigned char mac_key[SNMPv3_AP_OUTPUT_LENGTH_SHA];
+  derive_file_keys(file_key, file_key_len, enc_key, mac_key);
+
+  unsigned char *f = file_buf.get_ptr();
+  unsigned long engine_time = (unsigned long)time(0);
+  unsigned int params_len = 8;
+  unsigned int enc_len = plain_len;
+
+  memcpy(f, KEYCACHE_FILE_MAGIC, KEYCACHE_FILE_MAGIC_LEN);
+  f[KEYCACHE_FILE_MAGIC_LEN]     = (unsigned char)(engine_time >> 24);
+  f[KEYCACHE_FILE_MAGIC_LEN + 1] = (unsigned char)(engine_time >> 16);
+  f[KEYCACHE_FILE_MAGIC_LEN + 2] = (unsigned char)(engine_time >> 8);
+  f[KEYCACHE_FILE_MAGIC_LEN + 3] = (unsigned char)(engine_time);
+
+  int res = ap->encrypt_msg(SNMP_PRIVPROTOCOL_AES128, enc_key, 16,
+                            plain.get_ptr(), plain_len,
+                            f + KEYCACHE_FILE_HEADER_LEN, &enc_len,
+                            f + KEYCACHE_FILE_MAGIC_LEN + 4, &params_len,
+                            0, engine_time & 0xFFFFFFFF);
+  plain.clear();
+  if (res == SNMPv3_USM_OK)
+    res = ap->auth_out_msg(SNMP_AUTHPROTOCOL_HMACSHA, mac_key, f, file_len,
+                           f + file_len - KEYCACHE_FILE_MAC_LEN);
+  memset(enc_key, 0, sizeof(enc_key));
+  memset(mac_key, 0, sizeof(mac_key));
+
+  if (res != SNMPv3_USM_OK)
+  {
+    LOG_BEGIN(ERROR_LOG | 1);
+    LOG("KeyCache: Could not encrypt keys, error code");
+    LOG(res);
+    LOG_END;
+
+    return res;
+  }
+
+  // Write the file
+  sprintf(tmp_file_name, "%s.tmp", name);
+  FILE *file_out = fopen(tmp_file_name, "wb");
+  if (!file_out)
+  {
+    LOG_BEGIN(ERROR_LOG | 1);
+    LOG("KeyCache: could not create tmpfile");
+    LOG(tmp_file_name);
+    LOG_END;
+
+    return SNMPv3_USM_FILECREATE_ERROR;
+  }
+
+  bool failed = (fwrite(f, file_len, 1, file_out) != 1);
+  if (fclose(file_out))
+    failed = true;
+
+  if (failed)
+  {
+    LOG_BEGIN(ERROR_LOG | 1);
+    LOG("KeyCache: Failed to write keys.");
+    LOG_END;
+
+#ifdef WIN32
+    _unlink(tmp_file_name);
+#else
+    unlink(tmp_file_name);
+#endif
+    return SNMPv3_USM_FILEWRITE_ERROR;
+  }
+#ifdef WIN32
+  _unlink(name);
+#endif
+  if (rename(tmp_file_name, name))
+  {
+    LOG_BEGIN(ERROR_LOG | 1);
+    LOG("KeyCache: Could not rename file (from) (to)");
+    LOG(tmp_file_name);
+    LOG(name);
+    LOG_END;
+
+    return SNMPv3_USM_FILERENAME_ERROR;
+  }
+
+  LOG_BEGIN(INFO_LOG | 4);
+  LOG("KeyCache: Saved keys (file) (count)");
+  LOG(name);
+  LOG(count);
+  LOG_END;
+
+  return SNMPv3_USM_OK;
+}
+
+// Load the keys from a file.
+int KeyCache::load_from_file(const char *name, AuthPriv *ap,
+                             const unsigned char *file_key,
+                             const unsigned int   file_key_len)
+{
+  if (!name || !ap || !file_key || !file_key_len)
+  {
+    LOG_BEGIN(ERROR_LOG | 1);
+    LOG("KeyCache: load_from_file called with illegal param");
+    LOG_END;
+
+    return SNMPv3_USM_ERROR;
+  }
+
+  if (!ap->get_priv(SNMP_PRIVPROTOCOL_AES128) ||
+      !ap->get_auth(SNMP_AUTHPROTOCOL_HMACSHA))
+    return SNMPv3_USM_UNSUPPORTED_PRIVPROTOCOL;
+
+  FILE *file_in = fopen(name, "rb");
+  if (!file_in)
+  {
+    LOG_BEGIN(INFO_LOG | 4);
+    LOG("KeyCache: could not open file");
+    LOG(name);
+    LOG_END;
+
+    return SNMPv3_USM_FILEOPEN_ERROR;
+  }
+
+  long file_len = -1;
+  if (fseek(file_in, 0, SEEK_END) == 0)
+    file_len = ftell(file_in);
+  if ((file_len < KEYCACHE_FILE_HEADER_LEN + SNMPv3_KEYCACHE_SALT_LEN + 4 +
+                  KEYCACHE_FILE_MAC_LEN) ||
+      (file_len > KEYCACHE_FILE_MAX_LEN) ||
+      fseek(file_in, 0, SEEK_SET))
+  {
+    fclose(file_in);
+    return SNMPv3_USM_FILEREAD_ERROR;
+  }
+
+  Buffer<unsigned char> file_buf((unsigned int)file_len);
+  unsigned char *f = file_buf.get_ptr();
+  bool failed = (!f || (fread(f, file_len, 1, file_in) != 1));
+  fclose(file_in);
+
+  if (failed || memcmp(f, KEYCACHE_FILE_MAGIC, KEYCACHE_FILE_MAGIC_LEN))
+    return SNMPv3_USM_FILEREAD_ERROR;
+
+  // Check the file was saved with the same secret, then decrypt it
+  unsigned char enc_key[16];
+  unsigned char mac_key[SNMPv3_AP_OUTPUT_LENGTH_SHA];
+  derive_file_keys(file_key, file_key_len, enc_key, mac_key);
+
+  unsigned int plain_len = (unsigned int)file_len -
+                           KEYCACHE_FILE_HEADER_LEN - KEYCACHE_FILE_MAC_LEN;
+  Buffer<unsigned char> plain(plain_len);
+  unsigned long engine_time = (f[KEYCACHE_FILE_MAGIC_LEN]     << 24) |
+                              (f[KEYCACHE_FILE_MAGIC_LEN + 1] << 16) |
+                              (f[KEYCACHE_FILE_MAGIC_LEN + 2] << 8) |
+                               f[KEYCACHE_FILE_MAGIC_LEN + 3];
+
+  int res = ap->auth_inc_msg(SNMP_AUTHPROTOCOL_HMACSHA, mac_key,
+                             f, (int)file_len,
+                             f + file_len - KEYCACHE_FILE_MAC_LEN,
+                             KEYCACHE_FILE_MAC_LEN);
+  if (res != SNMPv3_USM_OK)
+    res = SNMPv3_USM_AUTHENTICATION_ERROR;
+  else if (!plain.get_ptr())
+    res = SNMPv3_USM_ERROR;
+  else
+    res = ap->decrypt_msg(SNMP_PRIVPROTOCOL_AES128, enc_key, 16,
+                          f + KEYCACHE_FILE_HEADER_LEN, plain_len,
+                          plain.get_ptr(), &plain_len,
+                          f + KEYCACHE_FILE_MAGIC_LEN + 4, 8,
+                          0, engine_time);
+  memset(enc_key, 0, sizeof(enc_key));
+  memset(mac_key, 0, sizeof(mac_key));
+
+  if (res != SNMPv3_USM_OK)
+  {
+    LOG_BEGIN(WARNING_LOG | 2);
+    LOG("KeyCache: Could not decrypt keys (file) (error code)");
+    LOG(name);
+    LOG(res);
+    LOG_END;
+
+    return res;
+  }
+
+  // Replace the contents of the cache
+  const unsigned char *p = plain.get_ptr();
+  const unsigned char *end = p + plain_len;
+
+  lock();
+  clear_entries();
+  memcpy(salt, p, SNMPv3_KEYCACHE_SALT_LEN);
+  p += SNMPv3_KEYCACHE_SALT_LEN;
+  int count = (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+  p += 4;
+
+  for (int i = 0; i < count; i++)
+  {
+    if (end - p < 4 + 1 + SNMPv3_KEYCACHE_DIGEST_LEN + 1)
+    { failed = true; break; }
+
+    int auth_prot = (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    bool localized = (p[4] != 0);
+    const unsigned char *digest = p + 5;
+    p += 5 + SNMPv3_KEYCACHE_DIGEST_LEN;
+
+    unsigned int engine_id_len = *p++;
+    if ((engine_id_len > MAXLENGTH_ENGINEID) ||
+        (end - p < (int)engine_id_len + 1))
+    { failed = true; break; }
+    const unsigned char *engine_id = p;
+    p += engine_id_len;
+
+    unsigned int key_len = *p++;
+    if ((key_len > SNMPv3_USM_MAX_KEY_LEN) || (end - p < (int)key_len))
+    { failed = true; break; }
+
+    add(auth_prot, localized, digest, engine_id, engine_id_len, p, key_len);
+    p += key_len;
+  }
+
+  if (failed)
+    clear_entries();
+  count = entry_count;
+  unlock();
+  plain.clear();
+
+  if (failed)
+  {
+    LOG_BEGIN(ERROR_LOG | 1);
+    LOG("KeyCache: Failed to read keys (file)");
+    LOG(name);
+    LOG_END;
+
+    return SNMPv3_USM_FILEREAD_ERROR;
+  }
+
+  LOG_BEGIN(INFO_LOG | 4);
+  LOG("KeyCache: Loaded keys (file) (count)");
+  LOG(name);
+  LOG(count);
+  LOG_END;
+
+  return SNMPv3_USM_OK;
+}
+
+/* Passwords handled by AuthPriv::derive_master_keys(), shared by its
+   threads */
+struct KeyDerivation
+{
+  AuthPriv *ap;
+  const int *auth_prots;
+  const OctetStr *passwords;
+  int count;
+  int next;                 ///< next password to handle
+  int derived;              ///< keys generated
+  SnmpSynchronized sync;
+};
+
+static void key_derivation_run(KeyDerivation *kd)
+{
+  KeyCache *kc = kd->ap->get_key_cache();
+  unsigned char digest[SNMPv3_KEYCACHE_DIGEST_LEN];
+  unsigned char key[SNMPv3_USM_MAX_KEY_LEN];
+  unsigned int key_len;
+
+  for (;;)
+  {
+    kd->sync.lock();
+    int i = kd->next++;
+    kd->sync.unlock();
+
+    if (i >= kd->count)
+      break;
+
+    const OctetStr &password = kd->passwords[i];
+    Auth *a = kd->ap->get_auth(kd->auth_prots[i]);
+    if (!a || (password.len() == 0))
+      continue;
+
+    kc->get_digest(kd->auth_prots[i], password.data(), password.len(),
+                   digest);
+    key_len = SNMPv3_USM_MAX_KEY_LEN;
+    if (kc->get_master_key(kd->auth_prots[i], digest, key, &key_len))
+      continue;
+
+    if (a->password_to_master_key(password.data(), password.len(),
+                                  key, &key_len) == SNMPv3_USM_OK)
+    {
+      kc->add_master_key(kd->auth_prots[i], digest, key, key_len);
+
+      kd->sync.lock();
+      kd->derived++;
+      kd->sync.unlock();
+    }
+  }
+  memset(key, 0, sizeof(key));
+}
+
+#if defined(_THREADS) && !(defined (CPU) && CPU == PPC603)
+#define KEY_DERIVATION_THREADS
+
+#ifdef WIN32
+static DWORD WINAPI key_derivation_thread(LPVOID arg)
+{
+  key_derivation_run((KeyDerivation *)arg);
+  return 0;
+}
+#else
+static void *key_derivation_thread(void *arg)
+{
+  key_derivation_run((KeyDerivation *)arg);
+  return 0;
+}
+#endif
+#endif
+
+int AuthPriv::derive_master_keys(const int      *auth_prots,
+                                 const OctetStr *passwords,
+                                 const int       count,
+                                 const int       threads)
+{
+  KeyDerivation kd;
+
+  kd.ap         = this;
+  kd.auth_prots = auth_prots;
+  kd.passwords  = passwords;
+  kd.count      = count;
+  kd.next       = 0;
+  kd.derived    = 0;
+
+  if (count <= 0)
+    return 0;
+
+#ifdef KEY_DERIVATION_THREADS
+  // The calling thread takes its share of the passwords too
+  int started = 0;
+  int wanted = ((threads < count) ? threads : count) - 1;
+#ifdef WIN32
+  HANDLE *handles = (wanted > 0) ? new HANDLE[wanted] : 0;
+#else
+  pthread_t *handles = (wanted > 0) ? new pthread_t[wanted] : 0;
+#endif
+
+  for (; handles && (started < wanted); started++)
+  {
+#ifdef WIN32
+    DWORD id;
+    handles[started] = CreateThread(NULL, 0, key_derivation_thread,
+                                    &kd, 0, &id);
+    if (handles[started] == NULL)
+      break;
+#else
+    if (pthread_create(&handles[started], NULL, key_derivation_thread, &kd))
+      break;
+#endif
+  }
+
+  key_derivation_run(&kd);
+
+  for (int i = 0; i < started; i++)
+  {
+#ifdef WIN32
+    WaitForSingleObject(handles[i], INFINITE);
+    CloseHandle(handles[i]);
+#else
+    pthread_join(handles[i], NULL);
+#endif
+  }
+  delete [] handles;
+#else
+  key_derivation_run(&kd);
+#endif
+
+  LOG_BEGIN(INFO_LOG | 4);
+  LOG("AuthPriv: Generated master keys (passwords) (generated)");
+  LOG(count);
+  LOG(kd.derived);
+  LOG_END;
+
+  return kd.derived;
+}
+
 int AuthPriv::encrypt_msg(const int            priv_prot,
                           const unsigned char *key,
                           const unsigned int   key_len,
@@ -902,11 +1649,41 @@ int AuthPriv::get_priv_params_len(const int priv_prot)
   return p->get_priv_params_len();
 }
 
+unsigned char *AuthPriv::new_hmac_state(const int            auth_prot,
+                                        const unsigned char *key,
+                                        const long int       key_len,
+                                        long int            &state_len)
+{
+  state_len = 0;
+
+  Auth *a = get_auth(auth_prot);
+
+  if (!a || !key)
+    return 0;
+
+  int len = a->get_hmac_state_len();
+  if (len <= 0)
+    return 0;
+
+  unsigned char *state = new unsigned char[len];
+  if (!state)
+    return 0;
+
+  if (a->precompute_hmac(key, key_len, state) != SNMPv3_USM_OK)
+  {
+    delete [] state;
+    return 0;
+  }
+  state_len = len;
+  return state;
+}
+
 int AuthPriv::auth_out_msg(const int            auth_prot,
                            const unsigned char *key,
                            unsigned char       *msg,
                            const int            msg_len,
-                           unsigned char       *auth_par_ptr)
+                           unsigned char       *auth_par_ptr,
+                           const unsigned char *hmac_state)
 {
   if (auth_prot == SNMP_AUTHPROTOCOL_NONE)
     return SNMPv3_USM_UNSUPPORTED_SECURITY_LEVEL;
@@ -916,6 +1693,9 @@ int AuthPriv::auth_out_msg(const int            auth_prot,
   if (!a)
     return SNMPv3_USM_UNSUPPORTED_AUTHPROTOCOL;
 
+  if (hmac_state)
+    return a->hmac_out_msg(hmac_state, msg, msg_len, auth_par_ptr);
+
   return a->auth_out_msg(key, msg, msg_len, auth_par_ptr);
 }
 
@@ -924,7 +1704,8 @@ int AuthPriv::auth_inc_msg(const int            auth_prot,
                            unsigned char       *msg,
                            const int            msg_len,
                            unsigned char       *auth_par_ptr,
-                           const int            auth_par_len)
+                           const int            auth_par_len,
+                           const unsigned char *hmac_state)
 {
   if (auth_prot == SNMP_AUTHPROTOCOL_NONE)
     return SNMPv3_USM_UNSUPPORTED_SECURITY_LEVEL;
@@ -950,6 +1731,10 @@ int AuthPriv::auth_inc_msg(const int            auth_prot,
   }
   */
 
+  if (hmac_state)
+    return a->hmac_inc_msg(hmac_state, msg, msg_len,
+                           auth_par_ptr, auth_par_len);
+
   return a->auth_inc_msg(key, msg, msg_len, auth_par_ptr, auth_par_len);
 }
 
@@ -964,8 +1749,6 @@ int AuthSHA::password_to_key(const unsigned char *password,
                              unsigned char *key,
                              unsigned int *key_len)
 {
-  *key_len = 20; /* All SHA keys have 20 bytes length */
-
 #ifdef __DEBUG
   debugprintf(5,"password_to_key SHA: password: (%s).",
 	      OctetStr(password, password_len).get_printable());
@@ -973,8 +1756,27 @@ int AuthSHA::password_to_key(const unsigned char *password,
 	      OctetStr(engine_id, engine_id_len).get_printable());
 #endif
 
+  unsigned char master_key[SNMPv3_AP_OUTPUT_LENGTH_SHA];
+  unsigned int master_key_len;
+
+  password_to_master_key(password, password_len, master_key, &master_key_len);
+
+  int res = localize_key(master_key, master_key_len,
+                         engine_id, engine_id_len, key, key_len);
+  memset(master_key, 0, sizeof(master_key));
+
+  return res;
+}
+
+int AuthSHA::password_to_master_key(const unsigned char *password,
+                                    const unsigned int   password_len,
+                                    unsigned char *key,
+                                    unsigned int *key_len)
+{
+  *key_len = 20; /* All SHA keys have 20 bytes length */
+
   SHAHashStateType sha_hash_state;
-  unsigned char *cp, password_buf[72];
+  unsigned char *cp, password_buf[64];
   unsigned long  password_index = 0;
   unsigned long  count = 0, i;
 
@@ -1003,18 +1805,35 @@ int AuthSHA::password_to_key(const unsigned char *password,
   debughexcprintf(21, "key", key, *key_len);
 #endif
 
+  return SNMPv3_USM_OK;
+}
+
+int AuthSHA::localize_key(const unsigned char *master_key,
+                          const unsigned int   master_key_len,
+                          const unsigned char *engine_id,
+                          const unsigned int   engine_id_len,
+                          unsigned char *key,
+                          unsigned int *key_len)
+{
+  SHAHashStateType sha_hash_state;
+  unsigned char buf[2 * SNMPv3_AP_OUTPUT_LENGTH_SHA + MAXLENGTH_ENGINEID];
+
+  if ((master_key_len != SNMPv3_AP_OUTPUT_LENGTH_SHA) ||
+      (engine_id_len > MAXLENGTH_ENGINEID))
+    return SNMPv3_USM_ERROR;
+
+  *key_len = 20; /* All SHA keys have 20 bytes length */
+
   /*****************************************************/
   /* Now localize the key with the engine_id and pass  */
   /* through SHA to produce final key                  */
-  /* May want to ensure that engine_id_len <= 32,      */
-  /* otherwise need to use a buffer larger than 72     */
   /*****************************************************/
-  memcpy(password_buf,                            key,       *key_len);
-  memcpy(password_buf + *key_len,                 engine_id, engine_id_len);
-  memcpy(password_buf + *key_len + engine_id_len, key,       *key_len);
+  memcpy(buf,                                  master_key, master_key_len);
+  memcpy(buf + master_key_len,                 engine_id,  engine_id_len);
+  memcpy(buf + master_key_len + engine_id_len, master_key, master_key_len);
 
   SHA1_INIT(&sha_hash_state);
-  SHA1_PROCESS(&sha_hash_state, password_buf, (2 * *key_len) + engine_id_len);
+  SHA1_PROCESS(&sha_hash_state, buf, (2 * master_key_len) + engine_id_len);
   SHA1_DONE(&sha_hash_state, key);
 
 #ifdef __DEBUG
@@ -1037,18 +1856,22 @@ int AuthSHA::hash(const unsigned char *data,
   return SNMPv3_USM_OK;
 }
 
-int AuthSHA::auth_out_msg(const unsigned char *key,
-                          unsigned char *msg,
-                          const int msg_len,
-                          unsigned char *auth_par_ptr)
+int AuthSHA::get_hmac_state_len() const
+{
+  /* hash states after the inner and after the outer pad */
+  return 2 * sizeof(SHAHashStateType);
+}
+
+int AuthSHA::precompute_hmac(const unsigned char *key,
+                             const unsigned int   key_len,
+                             unsigned char       *state) const
 {
   SHAHashStateType sha_hash_state;
-  int           key_len = 20; /* We use only 20 Byte Key! */
-  unsigned char digest[20];
   unsigned char k_ipad[65];   /* inner padding - key XORd with ipad */
   unsigned char k_opad[65];   /* outer padding - key XORd with opad */
 
-  memset((char*)(auth_par_ptr), 0, 12);
+  if (key_len < 20) /* We use only 20 Byte Key! */
+    return SNMPv3_USM_ERROR;
 
 #ifdef __DEBUG
   debughexcprintf(21, "key", key, 16);
@@ -1063,6 +1886,9 @@ int AuthSHA::auth_out_msg(const unsigned char *key,
    * ipad is the byte 0x36 repeated 64 times
    * opad is the byte 0x5c repeated 64 times
    * and text is the data being protected
+   *
+   * The hash states after the K XOR ipad and K XOR opad blocks only
+   * depend on the key, so they are computed once here.
    */
 
   /* start out by storing ipads and opads in pads */
@@ -1070,19 +1896,44 @@ int AuthSHA::auth_out_msg(const unsigned char *key,
   memset( (char*)k_opad, 0x5c, sizeof k_opad);
 
   /* XOR pads with key */
-  for (int i=0; i < key_len; ++i) {
+  for (int i=0; i < 20; ++i) {
     k_ipad[i] ^= key[i];
     k_opad[i] ^= key[i];
   }
 
-  /* perform inner SHA */
   SHA1_INIT(&sha_hash_state);           /* init sha_hash_state for 1st pass */
   SHA1_PROCESS(&sha_hash_state, k_ipad, 64);   /* start with inner pad      */
+  memcpy(state, &sha_hash_state, sizeof(sha_hash_state));
+
+  SHA1_INIT(&sha_hash_state);           /* init sha_hash_state for 2nd pass */
+  SHA1_PROCESS(&sha_hash_state, k_opad, 64);   /* start with outer pad      */
+  memcpy(state + sizeof(sha_hash_state), &sha_hash_state,
+         sizeof(sha_hash_state));
+
+  memset(&sha_hash_state, 0, sizeof(sha_hash_state));
+  memset(k_ipad, 0, sizeof(k_ipad));
+  memset(k_opad, 0, sizeof(k_opad));
+
+  return SNMPv3_USM_OK;
+}
+
+int AuthSHA::hmac_out_msg(const unsigned char *state,
+                          unsigned char *msg,
+                          const int msg_len,
+                          unsigned char *auth_par_ptr)
+{
+  SHAHashStateType sha_hash_state;
+  unsigned char digest[20];
+
+  memset((char*)(auth_par_ptr), 0, 12);
+
+  /* perform inner SHA */
+  memcpy(&sha_hash_state, state, sizeof(sha_hash_state)); /* inner pad done */
   SHA1_PROCESS(&sha_hash_state, msg, msg_len); /* then text of datagram     */
   SHA1_DONE(&sha_hash_state, digest);          /* finish up 1st pass        */
   /* perform outer SHA */
-  SHA1_INIT(&sha_hash_state);           /* init sha_hash_state for 2nd pass */
-  SHA1_PROCESS(&sha_hash_state, k_opad, 64);   /* start with outer pad      */
+  memcpy(&sha_hash_state, state + sizeof(sha_hash_state),
+         sizeof(sha_hash_state));                     /* outer pad done */
   SHA1_PROCESS(&sha_hash_state, digest, 20);   /* then results of 1st hash  */
   SHA1_DONE(&sha_hash_state, digest);          /* finish up 2nd pass        */
 
@@ -1095,12 +1946,41 @@ int AuthSHA::auth_out_msg(const unsigned char *key,
   return SNMPv3_USM_OK;
 }
 
+int AuthSHA::auth_out_msg(const unsigned char *key,
+                          unsigned char *msg,
+                          const int msg_len,
+                          unsigned char *auth_par_ptr)
+{
+  unsigned char state[2 * sizeof(SHAHashStateType)];
+
+  precompute_hmac(key, 20, state);
+  int res = hmac_out_msg(state, msg, msg_len, auth_par_ptr);
+  memset(state, 0, sizeof(state));
+
+  return res;
+}
+
 
 int AuthSHA::auth_inc_msg(const unsigned char *key,
                           unsigned char *msg,
                           const int msg_len,
                           unsigned char *auth_par_ptr,
                           const int      auth_par_len)
+{
+  unsigned char state[2 * sizeof(SHAHashStateType)];
+
+  precompute_hmac(key, 20, state);
+  int res = hmac_inc_msg(state, msg, msg_len, auth_par_ptr, auth_par_len);
+  memset(state, 0, sizeof(state));
+
+  return res;
+}
+
+int AuthSHA::hmac_inc_msg(const unsigned char *state,
+                          unsigned char *msg,
+                          const int msg_len,
+                          unsigned char *auth_par_ptr,
+                          const int      auth_par_len)
 {
   unsigned char receivedDigest[20];
 
@@ -1113,13 +1993,12 @@ int AuthSHA::auth_inc_msg(const unsigned char *key,
 
 #ifdef __DEBUG
   debughexcprintf(21, "digest in Message", auth_par_ptr, 12);
-  debughexcprintf(21, "key", key, 20);
 #endif
 
   /* Save received digest */
   memcpy(receivedDigest, auth_par_ptr, 12);
 
-  if (SNMPv3_USM_OK != auth_out_msg(key, msg, msg_len, auth_par_ptr))
+  if (SNMPv3_USM_OK != hmac_out_msg(state, msg, msg_len, auth_par_ptr))
   {
     /* copy digest back into message and return error */
     memcpy(auth_par_ptr, receivedDigest, 12);
@@ -1152,8 +2031,6 @@ int AuthMD5::password_to_key(const unsigned char *password,
                              unsigned char *key,
                              unsigned int *key_len)
 {
-  *key_len = 16; /* All MD5 keys have 16 bytes length */
-
 #ifdef __DEBUG
   debugprintf(5,"password: %s.",
               OctetStr(password, password_len).get_printable());
@@ -1161,8 +2038,27 @@ int AuthMD5::password_to_key(const unsigned char *password,
               OctetStr(engine_id, engine_id_len).get_printable());
 #endif
 
+  unsigned char master_key[SNMPv3_AP_OUTPUT_LENGTH_MD5];
+  unsigned int master_key_len;
+
+  password_to_master_key(password, password_len, master_key, &master_key_len);
+
+  int res = localize_key(master_key, master_key_len,
+                         engine_id, engine_id_len, key, key_len);
+  memset(master_key, 0, sizeof(master_key));
+
+  return res;
+}
+
+int AuthMD5::password_to_master_key(const unsigned char *password,
+                                    const unsigned int   password_len,
+                                    unsigned char *key,
+                                    unsigned int *key_len)
+{
+  *key_len = 16; /* All MD5 keys have 16 bytes length */
+
   MD5HashStateType md5_hash_state;
-  unsigned char  *cp, password_buf[65];
+  unsigned char  *cp, password_buf[64];
   unsigned long   password_index = 0;
   unsigned long   count = 0, i;
 
@@ -1189,18 +2085,35 @@ int AuthMD5::password_to_key(const unsigned char *password,
   debughexcprintf(21, "key", key, *key_len);
 #endif
 
+  return SNMPv3_USM_OK;
+}
+
+int AuthMD5::localize_key(const unsigned char *master_key,
+                          const unsigned int   master_key_len,
+                          const unsigned char *engine_id,
+                          const unsigned int   engine_id_len,
+                          unsigned char *key,
+                          unsigned int *key_len)
+{
+  MD5HashStateType md5_hash_state;
+  unsigned char buf[2 * SNMPv3_AP_OUTPUT_LENGTH_MD5 + MAXLENGTH_ENGINEID];
+
+  if ((master_key_len != SNMPv3_AP_OUTPUT_LENGTH_MD5) ||
+      (engine_id_len > MAXLENGTH_ENGINEID))
+    return SNMPv3_USM_ERROR;
+
+  *key_len = 16; /* All MD5 keys have 16 bytes length */
+
   /*****************************************************/
   /* Now localize the key with the engine_id and pass  */
   /* through MD5 to produce final key                  */
-  /* May want to ensure that engine_id_len <= 32,      */
-  /* otherwise need to use a buffer larger than 64     */
   /*****************************************************/
-  memcpy(password_buf,                            key,       *key_len);
-  memcpy(password_buf + *key_len,                 engine_id, engine_id_len);
-  memcpy(password_buf + *key_len + engine_id_len, key,       *key_len);
+  memcpy(buf,                                  master_key, master_key_len);
+  memcpy(buf + master_key_len,                 engine_id,  engine_id_len);
+  memcpy(buf + master_key_len + engine_id_len, master_key, master_key_len);
 
   MD5_INIT(&md5_hash_state);
-  MD5_PROCESS(&md5_hash_state, password_buf, (2 * *key_len) + engine_id_len);
+  MD5_PROCESS(&md5_hash_state, buf, (2 * master_key_len) + engine_id_len);
   MD5_DONE(&md5_hash_state, key);
 
 #ifdef __DEBUG
@@ -1223,18 +2136,22 @@ int AuthMD5::hash(const unsigned char *data,
   return SNMPv3_USM_OK;
 }
 
-int AuthMD5::auth_out_msg(const unsigned char *key,
-                          unsigned char *msg,
-                          const int      msg_len,
-                          unsigned char *auth_par_ptr)
+int AuthMD5::get_hmac_state_len() const
+{
+  /* hash states after the inner and after the outer pad */
+  return 2 * sizeof(MD5HashStateType);
+}
+
+int AuthMD5::precompute_hmac(const unsigned char *key,
+                             const unsigned int   key_len,
+                             unsigned char       *state) const
 {
   MD5HashStateType md5_hash_state;
-  int           key_len = 16; /* We use only 16 Byte Key! */
-  unsigned char digest[16];
   unsigned char k_ipad[65];   /* inner padding - key XORd with ipad */
   unsigned char k_opad[65];   /* outer padding - key XORd with opad */
 
-  memset((char*)(auth_par_ptr), 0, 12);
+  if (key_len < 16) /* We use only 16 Byte Key! */
+    return SNMPv3_USM_ERROR;
 
 #ifdef __DEBUG
   debughexcprintf(21, "key", key, 16);
@@ -1249,13 +2166,16 @@ int AuthMD5::auth_out_msg(const unsigned char *key,
    * ipad is the byte 0x36 repeated 64 times
    * opad is the byte 0x5c repeated 64 times
    * and text is the data being protected
+   *
+   * The hash states after the K XOR ipad and K XOR opad blocks only
+   * depend on the key, so they are computed once here.
    */
 
   /* start out by storing key in pads */
   memset( (char*)k_ipad, 0, sizeof k_ipad);
   memset( (char*)k_opad, 0, sizeof k_opad);
-  memcpy( (char*)k_ipad, (char*)key, key_len);
-  memcpy( (char*)k_opad, (char*)key, key_len);
+  memcpy( (char*)k_ipad, (char*)key, 16);
+  memcpy( (char*)k_opad, (char*)key, 16);
 
   /* XOR key with ipad and opad values */
   for (int i=0; i<64; i++) {
@@ -1263,14 +2183,39 @@ int AuthMD5::auth_out_msg(const unsigned char *key,
     k_opad[i] ^= 0x5c;
   }
 
-  /* perform inner MD5 */
   MD5_INIT(&md5_hash_state);            /* init md5_hash_state for 1st pass */
   MD5_PROCESS(&md5_hash_state, k_ipad, 64);    /* start with inner pad      */
+  memcpy(state, &md5_hash_state, sizeof(md5_hash_state));
+
+  MD5_INIT(&md5_hash_state);            /* init md5_hash_state for 2nd pass */
+  MD5_PROCESS(&md5_hash_state, k_opad, 64);    /* start with outer pad      */
+  memcpy(state + sizeof(md5_hash_state), &md5_hash_state,
+         sizeof(md5_hash_state));
+
+  memset(&md5_hash_state, 0, sizeof(md5_hash_state));
+  memset(k_ipad, 0, sizeof(k_ipad));
+  memset(k_opad, 0, sizeof(k_opad));
+
+  return SNMPv3_USM_OK;
+}
+
+int AuthMD5::hmac_out_msg(const unsigned char *state,
+                          unsigned char *msg,
+                          const int      msg_len,
+                          unsigned char *auth_par_ptr)
+{
+  MD5HashStateType md5_hash_state;
+  unsigned char digest[16];
+
+  memset((char*)(auth_par_ptr), 0, 12);
+
+  /* perform inner MD5 */
+  memcpy(&md5_hash_state, state, sizeof(md5_hash_state)); /* inner pad done */
   MD5_PROCESS(&md5_hash_state, msg, msg_len);  /* then text of datagram     */
   MD5_DONE(&md5_hash_state, digest);           /* finish up 1st pass        */
   /* perform outer MD5 */
-  MD5_INIT(&md5_hash_state);            /* init md5_hash_state for 2nd pass */
-  MD5_PROCESS(&md5_hash_state, k_opad, 64);    /* start with outer pad      */
+  memcpy(&md5_hash_state, state + sizeof(md5_hash_state),
+         sizeof(md5_hash_state));                     /* outer pad done */
   MD5_PROCESS(&md5_hash_state, digest, 16);    /* then results of 1st hash  */
   MD5_DONE(&md5_hash_state, digest);           /* finish up 2nd pass        */
 
@@ -1283,11 +2228,40 @@ int AuthMD5::auth_out_msg(const unsigned char *key,
   return SNMPv3_USM_OK;
 }
 
+int AuthMD5::auth_out_msg(const unsigned char *key,
+                          unsigned char *msg,
+                          const int      msg_len,
+                          unsigned char *auth_par_ptr)
+{
+  unsigned char state[2 * sizeof(MD5HashStateType)];
+
+  precompute_hmac(key, 16, state);
+  int res = hmac_out_msg(state, msg, msg_len, auth_par_ptr);
+  memset(state, 0, sizeof(state));
+
+  return res;
+}
+
 int AuthMD5::auth_inc_msg(const unsigned char *key,
                           unsigned char *msg,
                           const int msg_len,
                           unsigned char *auth_par_ptr,
                           const int      auth_par_len)
+{
+  unsigned char state[2 * sizeof(MD5HashStateType)];
+
+  precompute_hmac(key, 16, state);
+  int res = hmac_inc_msg(state, msg, msg_len, auth_par_ptr, auth_par_len);
+  memset(state, 0, sizeof(state));
+
+  return res;
+}
+
+int AuthMD5::hmac_inc_msg(const unsigned char *state,
+                          unsigned char *msg,
+                          const int msg_len,
+                          unsigned char *auth_par_ptr,
+                          const int      auth_par_len)
 {
   unsigned char receivedDigest[16];
 
@@ -1300,12 +2274,11 @@ int AuthMD5::auth_inc_msg(const unsigned char *key,
 
 #ifdef __DEBUG
   debughexcprintf(21, "digest in Message", auth_par_ptr, 12);
-  debughexcprintf(21, "key", key, 16);
 #endif
 
   memcpy(receivedDigest, auth_par_ptr, 12);
 
-  if (SNMPv3_USM_OK != auth_out_msg(key, msg, msg_len, auth_par_ptr))
+  if (SNMPv3_USM_OK != hmac_out_msg(state, msg, msg_len, auth_par_ptr))
   {
     /* copy digest back into message and return error */
     memcpy(auth_par_ptr, receivedDigest, 12);
@@ -36,6 +36,8 @@
 #ifdef _SNMPv3
 
 #include "snmp_pp/usm_v3.h"
+#include "snmp_pp/v3.h"
+#include "snmp_pp/reentrant.h"
 
 #ifdef SNMP_PP_NAMESPACE
 namespace Snmp_pp {
@@ -87,6 +89,49 @@ public:
                               unsigned char       *key,
                               unsigned int        *key_len) = 0;
 
+  /**
+   * Generate the master key (not localized) for the given password.
+   *
+   * Protocols that implement password_to_master_key() and
+   * localize_key() get their keys cached by AuthPriv. The default
+   * implementation returns SNMPv3_USM_ERROR: password_to_key() is
+   * called for every engine id.
+   *
+   * @param password      - the password
+   * @param password_len  - the length of the password
+   * @param key           - pointer to a buffer of SNMPv3_USM_MAX_KEY_LEN
+   *                        bytes that will be filled with the key
+   * @param key_len       - OUT: length of the key
+   *
+   * @return SNMPv3_USM_OK on success
+   */
+  virtual int password_to_master_key(const unsigned char *password,
+                                     const unsigned int   password_len,
+                                     unsigned char       *key,
+                                     unsigned int        *key_len)
+    { return SNMPv3_USM_ERROR; };
+
+  /**
+   * Localize a master key with the given engine id.
+   *
+   * @param master_key     - the key from password_to_master_key()
+   * @param master_key_len - the length of the master key
+   * @param engine_id      - pointer to snmpEngineID
+   * @param engine_id_len  - length of snmpEngineID
+   * @param key            - pointer to a buffer of SNMPv3_USM_MAX_KEY_LEN
+   *                         bytes that will be filled with the key
+   * @param key_len        - OUT: length of the key
+   *
+   * @return SNMPv3_USM_OK on success
+   */
+  virtual int localize_key(const unsigned char *master_key,
+                           const unsigned int   master_key_len,
+                           const unsigned char *engine_id,
+                           const unsigned int   engine_id_len,
+                           unsigned char       *key,
+                           unsigned int        *key_len)
+    { return SNMPv3_USM_ERROR; };
+
   /**
    * Generate a hash value for the given data.
    *
@@ -151,6 +196,60 @@ public:
                            unsigned char       *auth_par_ptr,
                            const int            auth_par_len) = 0;
 
+  /**
+   * Get the length of the HMAC state precomputed by precompute_hmac().
+   *
+   * The default implementation returns 0: the protocol does not
+   * support precomputed states and auth_out_msg() and auth_inc_msg()
+   * are always called with the key.
+   */
+  virtual int get_hmac_state_len() const { return 0; };
+
+  /**
+   * Precompute the HMAC state of a localized key.
+   *
+   * The state holds the hash states after the inner (key XOR ipad) and
+   * outer (key XOR opad) blocks, so messages can be authenticated
+   * without hashing these two blocks again for every message.
+   *
+   * @param key     - pointer to the (fixed length) key
+   * @param key_len - the length of the key
+   * @param state   - pointer to a buffer of get_hmac_state_len() bytes
+   *
+   * @return SNMPv3_USM_OK on success
+   */
+  virtual int precompute_hmac(const unsigned char *key,
+                              const unsigned int   key_len,
+                              unsigned char       *state) const
+    { return SNMPv3_USM_ERROR; };
+
+  /**
+   * Authenticate an outgoing message with a precomputed HMAC state.
+   *
+   * @see auth_out_msg()
+   *
+   * @param state        - the state from precompute_hmac()
+   */
+  virtual int hmac_out_msg(const unsigned char *state,
+                           unsigned char       *msg,
+                           const int            msg_len,
+                           unsigned char       *auth_par_ptr)
+    { return SNMPv3_USM_ERROR; };
+
+  /**
+   * Authenticate an incoming message with a precomputed HMAC state.
+   *
+   * @see auth_inc_msg()
+   *
+   * @param state        - the state from precompute_hmac()
+   */
+  virtual int hmac_inc_msg(const unsigned char *state,
+                           unsigned char       *msg,
+                           const int            msg_len,
+                           unsigned char       *auth_par_ptr,
+                           const int            auth_par_len)
+    { return SNMPv3_USM_ERROR; };
+
   /**
    * Get the unique id of the authentication protocol.
    */
@@ -330,6 +429,182 @@ public:
 typedef Auth* AuthPtr;
 typedef Priv* PrivPtr;
 
+class AuthPriv;
+
+/* Default number of master and localized keys kept by a KeyCache */
+#define SNMPv3_KEYCACHE_MAX_ENTRIES   65536
+#define SNMPv3_KEYCACHE_DIGEST_LEN    20
+#define SNMPv3_KEYCACHE_SALT_LEN      16
+
+/**
+ * Cache of the keys generated from passwords.
+ *
+ * Generating a key from a password hashes one megabyte of data. The
+ * cache keeps the master key (Ku) of each password and authentication
+ * protocol, and the keys localized (Kul) for each engine id, so that
+ * the expensive part is done once per password instead of once per
+ * engine.
+ *
+ * Passwords are not kept: entries are found through a salted digest of
+ * the password. The cache can be saved to a file, encrypted with
+ * AES128 and authenticated with HMAC-SHA using a key that the
+ * application has to provide and protect.
+ */
+class DLLOPT KeyCache: public SnmpSynchronized
+{
+public:
+  KeyCache();
+  ~KeyCache();
+
+  /**
+   * Compute the digest identifying a password in the cache.
+   *
+   * @param auth_prot    - the authentication protocol
+   * @param password     - the password
+   * @param password_len - the length of the password
+   * @param digest       - OUT: SNMPv3_KEYCACHE_DIGEST_LEN bytes
+   */
+  void get_digest(const int auth_prot,
+                  const unsigned char *password,
+                  const unsigned int   password_len,
+                  unsigned char       *digest);
+
+  /**
+   * Get the master key of a password.
+   *
+   * @param auth_prot - the authentication protocol
+   * @param digest    - digest of the password (see get_digest())
+   * @param key       - OUT: buffer of SNMPv3_USM_MAX_KEY_LEN bytes
+   * @param key_len   - OUT: length of the key
+   *
+   * @return true if the key was found
+   */
+  bool get_master_key(const int auth_prot,
+                      const unsigned char *digest,
+                      unsigned char *key, unsigned int *key_len);
+
+  /**
+   * Add the master key of a password.
+   */
+  void add_master_key(const int auth_prot,
+                      const unsigned char *digest,
+                      const unsigned char *key, const unsigned int key_len);
+
+  /**
+   * Get the key of a password localized for an engine id.
+   *
+   * @return true if the key was found
+   */
+  bool get_localized_key(const int auth_prot,
+                         const unsigned char *digest,
+                         const unsigned char *engine_id,
+                         const unsigned int   engine_id_len,
+                         unsigned char *key, unsigned int *key_len);
+
+  /**
+   * Add the key of a password localized for an engine id.
+   */
+  void add_localized_key(const int auth_prot,
+                         const unsigned char *digest,
+                         const unsigned char *engine_id,
+                         const unsigned int   engine_id_len,
+                         const unsigned char *key, const unsigned int key_len);
+
+  /**
+   * Remove all keys.
+   */
+  void clear();
+
+  /**
+   * Set the maximum number of keys kept. When the cache is full, new
+   * keys are not added.
+   */
+  void set_max_entries(const int max) { max_entries = max; };
+
+  /**
+   * Get the number of keys in the cache.
+   */
+  int get_entries() const { return entry_count; };
+
+  /**
+   * Get the number of keys found and not found in the cache.
+   */
+  unsigned long get_hits() const { return hits; };
+  unsigned long get_misses() const { return misses; };
+
+  /**
+   * Save the cache into a file.
+   *
+   * @param name         - filename including path
+   * @param ap           - the AuthPriv providing AES128 and HMAC-SHA
+   * @param file_key     - secret the file is protected with
+   * @param file_key_len - length of the secret
+   *
+   * @return SNMPv3_USM_OK, SNMPv3_USM_FILECREATE_ERROR,
+   *         SNMPv3_USM_FILEWRITE_ERROR, SNMPv3_USM_FILERENAME_ERROR,
+   *         SNMPv3_USM_UNSUPPORTED_PRIVPROTOCOL or SNMPv3_USM_ERROR
+   */
+  int save_to_file(const char *name, AuthPriv *ap,
+                   const unsigned char *file_key,
+                   const unsigned int   file_key_len);
+
+  /**
+   * Replace the contents of the cache with the keys saved in a file.
+   * A file that was not saved with the same secret is rejected.
+   *
+   * @return SNMPv3_USM_OK, SNMPv3_USM_FILEOPEN_ERROR,
+   *         SNMPv3_USM_FILEREAD_ERROR, SNMPv3_USM_AUTHENTICATION_ERROR,
+   *         SNMPv3_USM_UNSUPPORTED_PRIVPROTOCOL or SNMPv3_USM_ERROR
+   */
+  int load_from_file(const char *name, AuthPriv *ap,
+                     const unsigned char *file_key,
+                     const unsigned int   file_key_len);
+
+private:
+  struct KeyCacheEntry
+  {
+    int auth_prot;
+    bool localized;
+    unsigned char digest[SNMPv3_KEYCACHE_DIGEST_LEN];
+    unsigned char engine_id[MAXLENGTH_ENGINEID];
+    unsigned int engine_id_len;
+    unsigned char key[SNMPv3_USM_MAX_KEY_LEN];
+    unsigned int key_len;
+    int next;      ///< next entry of the same bucket or -1
+  };
+
+  unsigned int hash(const unsigned char *digest,
+                    const unsigned char *engine_id,
+                    const unsigned int   engine_id_len) const;
+  int find(const int auth_prot, const bool localized,
+           const unsigned char *digest,
+           const unsigned char *engine_id,
+           const unsigned int   engine_id_len) const;
+  bool get(const int auth_prot, const bool localized,
+           const unsigned char *digest,
+           const unsigned char *engine_id, const unsigned int engine_id_len,
+           unsigned char *key, unsigned int *key_len);
+  void add(const int auth_prot, const bool localized,
+           const unsigned char *digest,
+           const unsigned char *engine_id, const unsigned int engine_id_len,
+           const unsigned char *key, const unsigned int key_len);
+  bool grow();
+  void clear_entries();
+  void derive_file_keys(const unsigned char *file_key,
+                        const unsigned int   file_key_len,
+                        unsigned char *enc_key, unsigned char *mac_key);
+
+  KeyCacheEntry *entries;   ///< array of entry_size entries
+  int entry_count;          ///< entries in use
+  int entry_size;           ///< allocated entries
+  int *buckets;             ///< first entry of each bucket or -1
+  int bucket_count;         ///< power of two
+  int max_entries;
+  unsigned char salt[SNMPv3_KEYCACHE_SALT_LEN];
+  unsigned long hits;
+  unsigned long misses;
+};
+
 
 /**
  * Class that holds all authentication and privacy protocols
@@ -430,6 +705,28 @@ public:
                            unsigned char *key,
                            unsigned int  *key_len);
 
+  /**
+   * Generate the master keys of several passwords, using up to the
+   * given number of threads, and add them to the key cache. Passwords
+   * whose key is already cached are skipped.
+   *
+   * @param auth_prots - authentication protocol of each password
+   * @param passwords  - the passwords
+   * @param count      - number of passwords
+   * @param threads    - maximum number of threads, including the caller
+   *
+   * @return the number of keys generated
+   */
+  int derive_master_keys(const int      *auth_prots,
+                         const OctetStr *passwords,
+                         const int       count,
+                         const int       threads);
+
+  /**
+   * Get the cache of the keys generated from passwords.
+   */
+  KeyCache *get_key_cache() { return &key_cache; };
+
   /**
    * Get the keyChange value for the specified keys using the given
    * authentication protocol.
@@ -509,24 +806,50 @@ public:
    */
   int get_priv_params_len(const int priv_prot);
 
+  /**
+   * Precompute the HMAC state of a localized authentication key.
+   *
+   * @param auth_prot - the authentication protocol
+   * @param key       - the localized key
+   * @param key_len   - the length of the key
+   * @param state_len - OUT: the length of the returned state
+   *
+   * @return - the state (to be deleted with delete []) or NULL if
+   *           the protocol does not support precomputed states
+   */
+  unsigned char *new_hmac_state(const int            auth_prot,
+                                const unsigned char *key,
+                                const long int       key_len,
+                                long int            &state_len);
+
   /**
    * Fill in the authentication field of an outgoing message
+   *
+   * If hmac_state is not NULL, it must have been returned by
+   * new_hmac_state() for the same protocol and key. It is used
+   * instead of the key.
    */
   int auth_out_msg(const int            auth_prot,
                    const unsigned char *key,
                    unsigned char       *msg,
                    const int            msg_len,
-                   unsigned char       *auth_par_ptr);
+                   unsigned char       *auth_par_ptr,
+                   const unsigned char *hmac_state = 0);
 
   /**
    * Check the authentication field of an incoming message
+   *
+   * If hmac_state is not NULL, it must have been returned by
+   * new_hmac_state() for the same protocol and key. It is used
+   * instead of the key.
    */
   int auth_inc_msg(const int            auth_prot,
                    const unsigned char *key,
                    unsigned char       *msg,
                    const int            msg_len,
                    unsigned char       *auth_par_ptr,
-                   const int            auth_par_len);
+                   const int            auth_par_len,
+                   const unsigned char *hmac_state = 0);
 
 private:
 
@@ -535,6 +858,7 @@ private:
   int   auth_size; ///< current size of the auth array
   int   priv_size; ///< current size of the priv array
   pp_uint64 salt;  ///< current salt value (64 bits)
+  KeyCache key_cache; ///< keys generated from passwords
 };
 
 
@@ -553,6 +877,18 @@ public:
 		      unsigned char       *key,
 		      unsigned int        *key_len);
 
+  int password_to_master_key(const unsigned char *password,
+			     const unsigned int   password_len,
+			     unsigned char       *key,
+			     unsigned int        *key_len);
+
+  int localize_key(const unsigned char *master_key,
+		   const unsigned int   master_key_len,
+		   const unsigned char *engine_id,
+		   const unsigned int   engine_id_len,
+		   unsigned char       *key,
+		   unsigned int        *key_len);
+
   int hash(const unsigned char *data,
 	   const unsigned int   data_len,
 	   unsigned char       *digest) const;
@@ -568,6 +904,23 @@ public:
 		   unsigned char       *auth_par_ptr,
                    const int            auth_par_len);
 
+  int get_hmac_state_len() const;
+
+  int precompute_hmac(const unsigned char *key,
+		      const unsigned int   key_len,
+		      unsigned char       *state) const;
+
+  int hmac_out_msg(const unsigned char *state,
+		   unsigned char       *msg,
+		   const int            msg_len,
+		   unsigned char       *auth_par_ptr);
+
+  int hmac_inc_msg(const unsigned char *state,
+		   unsigned char       *msg,
+		   const int            msg_len,
+		   unsigned char       *auth_par_ptr,
+		   const int            auth_par_len);
+
   int get_id() const { return SNMP_AUTHPROTOCOL_HMACSHA; };
 
   const char *get_id_string() const { return "HMAC-SHA"; };
@@ -592,6 +945,18 @@ public:
 		      unsigned char       *key,
 		      unsigned int        *key_len);
 
+  int password_to_master_key(const unsigned char *password,
+			     const unsigned int   password_len,
+			     unsigned char       *key,
+			     unsigned int        *key_len);
+
+  int localize_key(const unsigned char *master_key,
+		   const unsigned int   master_key_len,
+		   const unsigned char *engine_id,
+		   const unsigned int   engine_id_len,
+		   unsigned char       *key,
+		   unsigned int        *key_len);
+
   int hash(const unsigned char *data,
 	   const unsigned int   data_len,
 	   unsigned char       *digest) const;
@@ -608,6 +973,23 @@ public:
 		   unsigned char       *auth_par_ptr,
                    const int            auth_par_len);
 
+  int get_hmac_state_len() const;
+
+  int precompute_hmac(const unsigned char *key,
+		      const unsigned int   key_len,
+		      unsigned char       *state) const;
+
+  int hmac_out_msg(const unsigned char *state,
+		   unsigned char       *msg,
+		   const int            msg_len,
+		   unsigned char       *auth_par_ptr);
+
+  int hmac_inc_msg(const unsigned char *state,
+		   unsigned char       *msg,
+		   const int            msg_len,
+		   unsigned char       *auth_par_ptr,
+		   const int            auth_par_len);
+
   int get_id() const { return SNMP_AUTHPROTOCOL_HMACMD5; };
 
   const char *get_id_string() const { return "HMAC-MD5"; };
@@ -43,9 +43,16 @@
 #define SNMP_PP_RELEASE 2
 #define SNMP_PP_PATCHLEVEL 25
 
-//! The maximum size of a message that can be sent or received.
+//! The default maximum size of a message that can be sent or received.
 #define MAX_SNMP_PACKET 4096
 
+//! The largest message size that can be set for a target or session
+//! (largest UDP payload over IPv4).
+#define MAX_SNMP_PACKET_LIMIT 65507
+
+//! The smallest message size every SNMP entity must accept (RFC 3417).
+#define MIN_SNMP_PACKET 484
+
 #ifndef DLLOPT
 #if defined (WIN32) && defined (SNMP_PP_DLL)
 #ifdef SNMP_PP_EXPORTS
@@ -110,6 +117,30 @@
 // Not fully tested!
 //#define HAVE_POLL_SYSCALL
 
+// Receive and send several datagrams per system call with recvmmsg()
+// and sendmmsg(). Without them, one recvfrom()/sendto() is done per
+// datagram. SNMP_PP_BATCH_SIZE is the number of pooled buffers.
+//
+// Every buffer of a receive batch holds a message of the maximum size
+// of the session (see Snmp::set_max_msg_size()). With 32 slots a batch
+// takes about 128 KB at the default 4096 bytes, but about 2 MB once a
+// target with a max message size of 65507 raised it. A session has a
+// batch for responses and one for notifications, and one more of each
+// per nesting level of callbacks that process events again.
+#if defined(__linux__) && !defined(__ANDROID__)
+#define HAVE_RECVMMSG
+#define HAVE_SENDMMSG
+#endif
+#define SNMP_PP_BATCH_SIZE 32
+
+// Wait for events with epoll() instead of select(). The sockets stay
+// registered and are read edge triggered, until recvmmsg() reports
+// that they are empty. The backend can still be changed at runtime,
+// see EventListHolder::set_backend().
+#if defined(HAVE_RECVMMSG)
+#define HAVE_EPOLL
+#endif
+
 // Some older(?) compilers need a special declaration of
 // template classes
 // #define _OLD_TEMPLATE_COLLECTION
@@ -215,6 +246,10 @@ typedef unsigned long long pp_uint64;
 #include <poll.h>
 #endif
 
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 ///////////////////////////////////////////////////////////////////////
 // Changes below this line should not be necessary
 ///////////////////////////////////////////////////////////////////////
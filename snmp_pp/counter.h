@@ -107,6 +107,12 @@ class DLLOPT Counter32: public SnmpUInt32
    */
   SnmpSyntax *clone() const { return (SnmpSyntax *)new Counter32(*this); };
 
+  /**
+   * Clone into memory of the caller, see SnmpSyntax::clone_into().
+   */
+  SnmpSyntax *clone_into(void *buf, const size_t size) const
+    { return (sizeof(Counter32) <= size) ? new (buf) Counter32(*this) : 0; };
+
   /**
    * Map other SnmpSyntax objects to Counter32.
    */
@@ -193,6 +193,12 @@ class DLLOPT Counter64: public  SnmpSyntax
    */
   SnmpSyntax *clone() const { return (SnmpSyntax *) new Counter64(*this); };
 
+  /**
+   * Clone into memory of the caller, see SnmpSyntax::clone_into().
+   */
+  SnmpSyntax *clone_into(void *buf, const size_t size) const
+    { return (sizeof(Counter64) <= size) ? new (buf) Counter64(*this) : 0; };
+
   /**
    * Overloaded assignement operator.
    *
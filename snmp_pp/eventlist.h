@@ -88,6 +88,10 @@ namespace Snmp_pp {
 
 #define MAX_UINT32 MAXLONG
 
+// Batches read from one socket by CEvents::HandleSocket() before the
+// other sockets get their turn
+#define EVENT_LIST_MAX_BATCHES 16
+
 class msec;
 class Pdu;
 
@@ -115,6 +119,12 @@ class DLLOPT CEvents: public SnmpSynchronized {
 			   const fd_set &writefds,
 			   const fd_set &exceptfds) = 0;
 #endif
+
+  // read the messages pending on a socket registered with
+  // EventListHolder::RegisterSocket(). Returns false if the socket
+  // may not be empty yet and must be polled again.
+  virtual bool HandleSocket(const SnmpSocket /*fd*/) { return true; };
+
   // return number of outstanding messages
   virtual int GetCount() = 0;
 
@@ -36,12 +36,32 @@ char event_list_holder_version[]="@(#) SNMP++ $Id$";
 #include "snmp_pp/mp_v3.h"
 #include "snmp_pp/v3.h"
 
+#ifdef HAVE_EPOLL
+#include <errno.h>
+#include <unistd.h>
+#endif
+
 #ifdef SNMP_PP_NAMESPACE
 namespace Snmp_pp {
 #endif
 
+#ifdef HAVE_EPOLL
+EventListHolder::EventBackend EventListHolder::default_backend =
+  EventListHolder::backend_epoll;
+#else
+EventListHolder::EventBackend EventListHolder::default_backend =
+  EventListHolder::backend_select;
+#endif
+
 EventListHolder::EventListHolder(Snmp *snmp_session)
+  : m_socketCount(0), m_backend(backend_select), m_epollFd(-1)
 {
+  for (int i = 0; i < EVENT_LIST_MAX_SOCKETS; i++)
+  {
+    m_sockets[i].fd = INVALID_SOCKET;
+    m_sockets[i].events = 0;
+  }
+
   // Automaticly add the SNMP message queue
   m_snmpMessageQueue = new CSNMPMessageQueue(this, snmp_session);
   m_eventList.AddEntry(m_snmpMessageQueue);
@@ -49,8 +69,281 @@ EventListHolder::EventListHolder(Snmp *snmp_session)
   // Automatically add the SNMP notification queue
   m_notifyEventQueue = new CNotifyEventQueue(this, snmp_session);
   m_eventList.AddEntry(m_notifyEventQueue);
+
+  if (!set_backend(default_backend))
+    debugprintf(0, "Event backend %d not available, using select.",
+		default_backend);
+}
+
+EventListHolder::~EventListHolder()
+{
+  set_backend(backend_select);
+}
+
+//---------[ Event Backend ]----------------------------------------
+// Not to be called while another thread processes events.
+bool EventListHolder::set_backend(const EventBackend backend)
+{
+  SnmpSynchronize _synchronize(m_socketsLock);
+
+  if (backend == m_backend)
+    return true;
+
+  if (backend == backend_select)
+  {
+#ifdef HAVE_EPOLL
+    close(m_epollFd);
+    m_epollFd = -1;
+#endif
+    m_backend = backend_select;
+    return true;
+  }
+
+#ifdef HAVE_EPOLL
+  m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+  if (m_epollFd < 0)
+  {
+    debugprintf(0, "epoll_create1 failed, errno %d.", errno);
+    return false;
+  }
+
+  for (int i = 0; i < EVENT_LIST_MAX_SOCKETS; i++)
+    if (m_sockets[i].fd != INVALID_SOCKET)
+      EpollControl(EPOLL_CTL_ADD, i);
+
+  m_backend = backend_epoll;
+  return true;
+#else
+  return false;
+#endif
+}
+
+//---------[ Socket Registration ]----------------------------------
+bool EventListHolder::RegisterSocket(const SnmpSocket fd, CEvents *events)
+{
+  SnmpSynchronize _synchronize(m_socketsLock);
+  int slot = -1;
+
+  for (int i = 0; i < EVENT_LIST_MAX_SOCKETS; i++)
+  {
+    if (m_sockets[i].fd == fd)
+    {
+      m_sockets[i].events = events; // already registered
+      return true;
+    }
+    if ((slot < 0) && (m_sockets[i].fd == INVALID_SOCKET))
+      slot = i;
+  }
+
+  if (slot < 0)
+  {
+    debugprintf(0, "Too many sockets registered, fd %d not watched.", fd);
+    return false;
+  }
+
+  m_sockets[slot].fd = fd;
+  m_sockets[slot].events = events;
+  m_socketCount++;
+
+#ifdef HAVE_EPOLL
+  if (m_backend == backend_epoll)
+    EpollControl(EPOLL_CTL_ADD, slot);
+#endif
+  return true;
+}
+
+// Must be called before the socket is closed
+void EventListHolder::UnregisterSocket(const SnmpSocket fd)
+{
+  SnmpSynchronize _synchronize(m_socketsLock);
+
+  for (int i = 0; i < EVENT_LIST_MAX_SOCKETS; i++)
+  {
+    if (m_sockets[i].fd != fd)
+      continue;
+
+#ifdef HAVE_EPOLL
+    if (m_backend == backend_epoll)
+      EpollControl(EPOLL_CTL_DEL, i);
+#endif
+    m_sockets[i].fd = INVALID_SOCKET;
+    m_sockets[i].events = 0;
+    m_socketCount--;
+    return;
+  }
+}
+
+void EventListHolder::RearmSocket(const SnmpSocket fd)
+{
+#ifdef HAVE_EPOLL
+  SnmpSynchronize _synchronize(m_socketsLock);
+
+  if (m_backend != backend_epoll)
+    return;
+
+  // EPOLL_CTL_MOD queues the socket again if it is readable
+  for (int i = 0; i < EVENT_LIST_MAX_SOCKETS; i++)
+    if (m_sockets[i].fd == fd)
+      EpollControl(EPOLL_CTL_MOD, i);
+#endif
+}
+
+int EventListHolder::GetSockets(SnmpSocket *fds, const int max_fds)
+{
+  SnmpSynchronize _synchronize(m_socketsLock);
+  int count = 0;
+
+  for (int i = 0; (i < EVENT_LIST_MAX_SOCKETS) && (count < max_fds); i++)
+    if (m_sockets[i].fd != INVALID_SOCKET)
+      fds[count++] = m_sockets[i].fd;
+
+  return count;
+}
+
+//---------[ Process Socket ]----------------------------------------
+int EventListHolder::SNMPProcessSocket(const SnmpSocket fd)
+{
+  CEvents *queue = 0;
+  msec now(0, 0);
+  int status;
+
+  m_socketsLock.lock();
+  for (int i = 0; i < EVENT_LIST_MAX_SOCKETS; i++)
+    if (m_sockets[i].fd == fd)
+      queue = m_sockets[i].events;
+  m_socketsLock.unlock();
+
+  pevents_mutex.lock();
+
+  // a socket that is not empty yet is reported again by the caller
+  if (queue)
+    queue->HandleSocket(fd);
+
+  now.refresh();
+  status = m_eventList.DoRetries(now);
+
+  pevents_mutex.unlock();
+
+  return status;
 }
 
+#ifdef HAVE_EPOLL
+
+// The registration carries its slot and fd, so that events of a
+// socket that was unregistered meanwhile can be recognized.
+bool EventListHolder::EpollControl(const int op, const int slot)
+{
+  struct epoll_event ev;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN | EPOLLET;
+  ev.data.u64 = ((pp_uint64)slot << 32) | (unsigned int)m_sockets[slot].fd;
+
+  if (epoll_ctl(m_epollFd, op, m_sockets[slot].fd, &ev) < 0)
+  {
+    debugprintf(0, "epoll_ctl %d on fd %d failed, errno %d.",
+		op, m_sockets[slot].fd, errno);
+    return false;
+  }
+  return true;
+}
+
+// Pass the ready sockets to their queues. A queue that stopped
+// reading before the socket was empty gets it reported again.
+void EventListHolder::HandleSocketEvents(const struct epoll_event *events,
+					 const int count)
+{
+  for (int i = 0; i < count; i++)
+  {
+    int slot = (int)(events[i].data.u64 >> 32);
+    SnmpSocket fd = (SnmpSocket)(events[i].data.u64 & 0xFFFFFFFF);
+    CEvents *queue = 0;
+
+    m_socketsLock.lock();
+    if ((slot < EVENT_LIST_MAX_SOCKETS) && (m_sockets[slot].fd == fd))
+      queue = m_sockets[slot].events;
+    m_socketsLock.unlock();
+
+    if (queue && !queue->HandleSocket(fd))
+      RearmSocket(fd);
+  }
+}
+
+// Only the sockets that received something are visited; the queues
+// are not asked for their fds.
+int EventListHolder::EpollProcessPendingEvents()
+{
+  struct epoll_event events[EVENT_LIST_MAX_SOCKETS];
+  int nfound;
+  msec now(0, 0);
+  int status;
+
+  pevents_mutex.lock();
+
+  nfound = epoll_wait(m_epollFd, events, EVENT_LIST_MAX_SOCKETS, 0);
+  if (nfound > 0)
+    HandleSocketEvents(events, nfound);
+
+  // go through the message queue and resend any messages
+  // which are past the timeout.
+  now.refresh();
+  status = m_eventList.DoRetries(now);
+
+  pevents_mutex.unlock();
+
+  return status;
+}
+
+// The events reported by epoll_wait() are consumed, so they are
+// handled here and not left to SNMPProcessPendingEvents().
+int EventListHolder::EpollProcessEvents(const int max_block_milliseconds)
+{
+  struct epoll_event events[EVENT_LIST_MAX_SOCKETS];
+  struct timeval fd_timeout;
+  int nfound;
+  int timeout;
+  msec now; // automatcally calls msec::refresh()
+  msec sendTime;
+  int status;
+
+  // the message queue keeps its timeouts in a heap, so this does
+  // not depend on the number of outstanding messages
+  m_eventList.GetNextTimeout(sendTime);
+  now.GetDelta(sendTime, fd_timeout);
+
+  if ((max_block_milliseconds > 0) &&
+      ((fd_timeout.tv_sec > max_block_milliseconds / 1000) ||
+       ((fd_timeout.tv_sec == max_block_milliseconds / 1000) &&
+	(fd_timeout.tv_usec > (max_block_milliseconds % 1000) * 1000))))
+  {
+    fd_timeout.tv_sec = max_block_milliseconds / 1000;
+    fd_timeout.tv_usec = (max_block_milliseconds % 1000) * 1000;
+  }
+
+  /* Prevent endless sleep in case no fd is open */
+  if ((m_socketCount == 0) && (fd_timeout.tv_sec > 5))
+    fd_timeout.tv_sec = 5; /* sleep at max 5.99 seconds */
+
+  // round up, waking up before the timeout would only spin
+  timeout = fd_timeout.tv_sec * 1000 + (fd_timeout.tv_usec + 999) / 1000;
+
+  nfound = epoll_wait(m_epollFd, events, EVENT_LIST_MAX_SOCKETS, timeout);
+
+  pevents_mutex.lock();
+
+  if (nfound > 0)
+    HandleSocketEvents(events, nfound);
+
+  now.refresh();
+  status = m_eventList.DoRetries(now);
+
+  pevents_mutex.unlock();
+
+  return status;
+}
+
+#endif // HAVE_EPOLL
+
 //---------[ Block For Response ]-----------------------------------
 // Wait for the completion of an outstanding SNMP event (msg).
 // Handle any other events as they occur.
@@ -95,6 +388,11 @@ int EventListHolder::SNMPProcessPendingEvents()
   msec now(0, 0);
   int status;
 
+#ifdef HAVE_EPOLL
+  if (m_backend == backend_epoll)
+    return EpollProcessPendingEvents();
+#endif
+
   pevents_mutex.lock();
 
   timeout = 1;  // chosen a very small timeout
@@ -150,6 +448,11 @@ int EventListHolder::SNMPProcessEvents(const int max_block_milliseconds)
   msec sendTime;
   int status = 0;
 
+#ifdef HAVE_EPOLL
+  if (m_backend == backend_epoll)
+    return EpollProcessEvents(max_block_milliseconds);
+#endif
+
   m_eventList.GetNextTimeout(sendTime);
   now.GetDelta(sendTime, fd_timeout);
 
@@ -199,6 +502,11 @@ int EventListHolder::SNMPProcessPendingEvents()
   msec now(0, 0);
   int status;
 
+#ifdef HAVE_EPOLL
+  if (m_backend == backend_epoll)
+    return EpollProcessPendingEvents();
+#endif
+
   pevents_mutex.lock();
 
   // do not allow select to block
@@ -249,6 +557,11 @@ int EventListHolder::SNMPProcessEvents(const int max_block_milliseconds)
   msec sendTime;
   int status = 0;
 
+#ifdef HAVE_EPOLL
+  if (m_backend == backend_epoll)
+    return EpollProcessEvents(max_block_milliseconds);
+#endif
+
   m_eventList.GetNextTimeout(sendTime);
   now.GetDelta(sendTime, fd_timeout);
 
@@ -48,11 +48,62 @@ class Snmp;
 
 typedef unsigned long Uint32;
 
+// Sockets that can be registered with one EventListHolder: the two
+// session sockets and the two notification sockets of a Snmp object
+#define EVENT_LIST_MAX_SOCKETS 8
+
 class DLLOPT EventListHolder
 {
  public:
+  /**
+   * How SNMPProcessEvents() waits for incoming messages.
+   *
+   * backend_select rebuilds the fd sets of all event queues on each
+   * call. backend_epoll keeps the registered sockets in an epoll set
+   * and only visits the sockets that received something.
+   */
+  enum EventBackend { backend_select, backend_epoll };
+
   EventListHolder(Snmp *snmp_session);
-  ~EventListHolder() {};
+  ~EventListHolder();
+
+  /**
+   * Select the event backend of this object.
+   *
+   * @return false if the backend is not available on this platform,
+   *         the current backend is kept then
+   */
+  bool set_backend(const EventBackend backend);
+  EventBackend get_backend() const { return m_backend; };
+
+  /**
+   * Set the backend used by EventListHolder objects created afterwards.
+   * Defaults to backend_epoll if available.
+   */
+  static void set_default_backend(const EventBackend backend)
+    { default_backend = backend; };
+
+  /**
+   * Register a socket whose messages are read by the given queue.
+   * With backend_epoll, the socket is watched until it is unregistered.
+   *
+   * @return false if too many sockets are registered
+   */
+  bool RegisterSocket(const SnmpSocket fd, CEvents *events);
+  void UnregisterSocket(const SnmpSocket fd);
+
+  /**
+   * Report a registered socket again if data is pending on it. Must be
+   * called after reading from the socket outside of the event loop.
+   */
+  void RearmSocket(const SnmpSocket fd);
+
+  /**
+   * Get the registered sockets, for use with an external event loop.
+   *
+   * @return the number of sockets copied to fds
+   */
+  int GetSockets(SnmpSocket *fds, const int max_fds);
 
   CSNMPMessageQueue *&snmpEventList()   { return m_snmpMessageQueue; };
   CNotifyEventQueue *&notifyEventList() { return m_notifyEventQueue; };
@@ -96,6 +147,12 @@ class DLLOPT EventListHolder
   // Pull all available events out of their sockets - do not block
   int SNMPProcessPendingEvents();
 
+  //---------[ Process Socket ]----------------------------------------
+  // Read the messages pending on one registered socket, which an
+  // external event loop reported as readable, and handle the timeouts.
+  // Only the queue of the socket is visited, whatever the backend.
+  int SNMPProcessSocket(const SnmpSocket fd);
+
   //---------[ Block For Response ]-----------------------------------
   // Wait for the completion of an outstanding SNMP event (msg).
   // Handle any other events as they occur.
@@ -104,11 +161,32 @@ class DLLOPT EventListHolder
 
  private:
 
+#ifdef HAVE_EPOLL
+  bool EpollControl(const int op, const int slot);
+  void HandleSocketEvents(const struct epoll_event *events, const int count);
+  int EpollProcessPendingEvents();
+  int EpollProcessEvents(const int max_block_milliseconds);
+#endif
+
   CSNMPMessageQueue *m_snmpMessageQueue;  // contains all outstanding messages
   CNotifyEventQueue *m_notifyEventQueue; // contains all sessions waiting for notifications
   CEventList   m_eventList;  // contains all expected events
 
   SnmpSynchronized      pevents_mutex;
+
+  struct registered_socket
+  {
+    SnmpSocket fd;
+    CEvents *events;
+  };
+
+  registered_socket m_sockets[EVENT_LIST_MAX_SOCKETS];
+  int               m_socketCount;
+  SnmpSynchronized  m_socketsLock;  // not held while reading the sockets
+  EventBackend      m_backend;
+  int               m_epollFd;
+
+  static EventBackend default_backend;
 };
 
 #ifdef SNMP_PP_NAMESPACE
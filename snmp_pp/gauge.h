@@ -116,6 +116,12 @@ class DLLOPT Gauge32: public SnmpUInt32
    */
   SnmpSyntax *clone() const { return (SnmpSyntax *) new Gauge32(*this); };
 
+  /**
+   * Clone into memory of the caller, see SnmpSyntax::clone_into().
+   */
+  SnmpSyntax *clone_into(void *buf, const size_t size) const
+    { return (sizeof(Gauge32) <= size) ? new (buf) Gauge32(*this) : 0; };
+
   //-----------[ Overload some operators ]----------------------
 
   /**
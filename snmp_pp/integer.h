@@ -152,6 +152,12 @@ class DLLOPT SnmpUInt32 : public SnmpSyntax
   virtual SnmpSyntax *clone() const
     { return (SnmpSyntax *)new SnmpUInt32(*this); };
 
+  /**
+   * Clone into memory of the caller, see SnmpSyntax::clone_into().
+   */
+  virtual SnmpSyntax *clone_into(void *buf, const size_t size) const
+    { return (sizeof(SnmpUInt32) <= size) ? new (buf) SnmpUInt32(*this) : 0; };
+
   /**
    * Return validity of the object.
    * An SnmpUInt32 will only be invalid after a failed asignment
@@ -255,6 +261,12 @@ class DLLOPT SnmpInt32 : public SnmpSyntax
    */
   SnmpSyntax *clone() const { return (SnmpSyntax *)new SnmpInt32(*this); };
 
+  /**
+   * Clone into memory of the caller, see SnmpSyntax::clone_into().
+   */
+  SnmpSyntax *clone_into(void *buf, const size_t size) const
+    { return (sizeof(SnmpInt32) <= size) ? new (buf) SnmpInt32(*this) : 0; };
+
   /**
    * Return validity of the object.
    * An SnmpUInt32 will only be invalid after a failed asignment
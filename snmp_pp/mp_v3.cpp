@@ -56,13 +56,20 @@ namespace Snmp_pp {
 v3MP *v3MP::I = 0;
 
 // Use locking on access methods in an multithreaded environment.
+// The locks are not recursive: a method that holds the lock of a table
+// must not call a method of the same table that takes it again.
 #ifdef _THREADS
 #define BEGIN_REENTRANT_CODE_BLOCK SnmpSynchronize auto_lock(lock)
 #define BEGIN_REENTRANT_CODE_BLOCK_CONST  \
           SnmpSynchronize auto_lock(*(PP_CONST_CAST(SnmpSynchronized*, &lock)))
+#define BEGIN_WRITE_CODE_BLOCK SnmpWriteSynchronize auto_lock(lock)
+#define BEGIN_READ_CODE_BLOCK_CONST  \
+          SnmpReadSynchronize auto_lock(*(PP_CONST_CAST(SnmpRWSynchronized*, &lock)))
 #else
 #define BEGIN_REENTRANT_CODE_BLOCK
 #define BEGIN_REENTRANT_CODE_BLOCK_CONST
+#define BEGIN_WRITE_CODE_BLOCK
+#define BEGIN_READ_CODE_BLOCK_CONST
 #endif
 
 // ========================[ Engine id table ]=============================
@@ -103,33 +110,38 @@ int v3MP::EngineIdTable::add_entry(const OctetStr &engine_id,
   LOG(port);
   LOG_END;
 
-  BEGIN_REENTRANT_CODE_BLOCK;
+  BEGIN_WRITE_CODE_BLOCK;
 
-  for (int i = 0; i < entries; i++)
-    if (((table[i].port == port) &&
-         (table[i].host == host)) ||
-	(table[i].engine_id == engine_id))
-    {
-      LOG_BEGIN(INFO_LOG | 2);
-      LOG("v3MP::EngineIdTable: replace entry (old id) (old host) (old port) (id) (host) (port)");
-      LOG(table[i].engine_id.get_printable());
-      LOG(table[i].host.get_printable());
-      LOG(table[i].port);
-      LOG(engine_id.get_printable());
-      LOG(host.get_printable());
-      LOG(port);
-      LOG_END;
+  // replace the first entry with this host/port or engine id
+  int i = find(host, port);
+  int j = find(engine_id);
+  if ((i < 0) || ((j >= 0) && (j < i)))
+    i = j;
 
-      table[i].engine_id = engine_id;
-      table[i].host = host;
-      table[i].port = port;
+  if (i >= 0)
+  {
+    LOG_BEGIN(INFO_LOG | 2);
+    LOG("v3MP::EngineIdTable: replace entry (old id) (old host) (old port) (id) (host) (port)");
+    LOG(table[i].engine_id.get_printable());
+    LOG(table[i].host.get_printable());
+    LOG(table[i].port);
+    LOG(engine_id.get_printable());
+    LOG(host.get_printable());
+    LOG(port);
+    LOG_END;
 
-      return SNMPv3_MP_OK;         // host is in table
-    }
+    table[i].engine_id = engine_id;
+    table[i].host = host;
+    table[i].port = port;
+    index_entry(i);
+
+    return SNMPv3_MP_OK;         // host is in table
+  }
 
   table[entries].engine_id = engine_id;
   table[entries].host = host;
   table[entries].port = port;
+  index_entry(entries);
 
   entries++;
   if (entries == max_entries)
@@ -137,12 +149,16 @@ int v3MP::EngineIdTable::add_entry(const OctetStr &engine_id,
     // resize Table
     struct Entry_T *tmp;
     tmp = new struct Entry_T[2 * max_entries];
-    if (!tmp)
+    if (!tmp || !engine_id_index.resize(2 * max_entries) ||
+        !host_index.resize(2 * max_entries))
     {
+      if (tmp) delete [] tmp;
       entries--;
+      engine_id_index.remove(entries);
+      host_index.remove(entries);
       return SNMPv3_MP_ERROR;
     }
-    for (int i = 0; i < entries; i++)
+    for (i = 0; i < entries; i++)
       tmp[i] = table[i];
 
     delete [] table;
@@ -196,18 +212,10 @@ int v3MP::EngineIdTable::get_entry(OctetStr &engine_id,
   if (!table)
     return SNMPv3_MP_NOT_INITIALIZED;
 
-  BEGIN_REENTRANT_CODE_BLOCK_CONST;
-
-  int i, found = 0;
+  BEGIN_READ_CODE_BLOCK_CONST;
 
-  for (i = 0; i < entries; i++)
-    if ((table[i].port == port) &&
-        (table[i].host == host))
-    {
-      found=1;
-      break;
-    }
-  if (!found)
+  int i = find(host, port);
+  if (i < 0)
   {
     LOG_BEGIN(INFO_LOG | 4);
     LOG("v3MP::EngineIdTable: Dont know engine id for (host) (port)");
@@ -233,9 +241,11 @@ int v3MP::EngineIdTable::reset()
   LOG("v3MP::EngineIdTable: Resetting table.");
   LOG_END;
 
-  BEGIN_REENTRANT_CODE_BLOCK;
+  BEGIN_WRITE_CODE_BLOCK;
 
   entries = 0;
+  engine_id_index.clear();
+  host_index.clear();
 
   return SNMPv3_MP_OK;
 }
@@ -246,17 +256,10 @@ int v3MP::EngineIdTable::delete_entry(const OctetStr &engine_id)
   if (!table)
     return SNMPv3_MP_NOT_INITIALIZED;
 
-  int i, found = 0;
+  BEGIN_WRITE_CODE_BLOCK;
 
-  BEGIN_REENTRANT_CODE_BLOCK;
-
-  for (i = 0; i < entries; i++)
-    if (table[i].engine_id == engine_id)
-    {
-      found=1;
-      break;
-    }
-  if (!found)
+  int i = find(engine_id);
+  if (i < 0)
   {
     LOG_BEGIN(WARNING_LOG | 4);
     LOG("v3MP::EngineIdTable: cannot remove nonexisting entry (engine id)");
@@ -268,7 +271,16 @@ int v3MP::EngineIdTable::delete_entry(const OctetStr &engine_id)
 
   /* i is the entry to remove */
   if (i != entries - 1)
+  {
     table[i] = table[entries-1];
+    engine_id_index.move(entries - 1, i);
+    host_index.move(entries - 1, i);
+  }
+  else
+  {
+    engine_id_index.remove(i);
+    host_index.remove(i);
+  }
 
   entries--;
 
@@ -281,18 +293,10 @@ int v3MP::EngineIdTable::delete_entry(const OctetStr &host, int port)
   if (!table)
     return SNMPv3_MP_NOT_INITIALIZED;
 
-  int i, found = 0;
+  BEGIN_WRITE_CODE_BLOCK;
 
-  BEGIN_REENTRANT_CODE_BLOCK;
-
-  for (i = 0; i < entries; i++)
-    if ((table[i].port == port) &&
-        (table[i].host == host))
-    {
-      found=1;
-      break;
-    }
-  if (!found)
+  int i = find(host, port);
+  if (i < 0)
   {
     LOG_BEGIN(WARNING_LOG | 4);
     LOG("v3MP::EngineIdTable: cannot remove nonexisting entry (host) (port)");
@@ -305,7 +309,16 @@ int v3MP::EngineIdTable::delete_entry(const OctetStr &host, int port)
 
   /* i is the entry to remove */
   if (i != entries - 1)
+  {
     table[i] = table[entries-1];
+    engine_id_index.move(entries - 1, i);
+    host_index.move(entries - 1, i);
+  }
+  else
+  {
+    engine_id_index.remove(i);
+    host_index.remove(i);
+  }
 
   entries--;
 
@@ -316,8 +329,10 @@ int v3MP::EngineIdTable::initialize_table(const int size)
 {
   table = new struct Entry_T[size];
   entries = 0;
-  if (!table)
+  if (!table || !engine_id_index.resize(size) || !host_index.resize(size))
   {
+    if (table) delete [] table;
+    table = 0;
     max_entries = 0;
     return FALSE;
   }
@@ -325,6 +340,45 @@ int v3MP::EngineIdTable::initialize_table(const int size)
   return TRUE;
 }
 
+static inline unsigned int host_hash(const OctetStr &host, int port)
+{
+  unsigned char p[2];
+  p[0] = (unsigned char)(port >> 8);
+  p[1] = (unsigned char)port;
+  return v3hash(p, 2, v3hash(host.data(), host.len()));
+}
+
+// Duplicates are possible after add_entry() replaced an entry, so
+// always return the first position like a scan of the table would
+int v3MP::EngineIdTable::find(const OctetStr &engine_id) const
+{
+  int res = -1;
+  for (int i = engine_id_index.first(v3hash(engine_id.data(),
+                                            engine_id.len()));
+       i >= 0; i = engine_id_index.next(i))
+    if (((res < 0) || (i < res)) && (table[i].engine_id == engine_id))
+      res = i;
+  return res;
+}
+
+int v3MP::EngineIdTable::find(const OctetStr &host, int port) const
+{
+  int res = -1;
+  for (int i = host_index.first(host_hash(host, port));
+       i >= 0; i = host_index.next(i))
+    if (((res < 0) || (i < res)) &&
+        (table[i].port == port) && (table[i].host == host))
+      res = i;
+  return res;
+}
+
+void v3MP::EngineIdTable::index_entry(const int nr)
+{
+  engine_id_index.add(nr, v3hash(table[nr].engine_id.data(),
+                                 table[nr].engine_id.len()));
+  host_index.add(nr, host_hash(table[nr].host, table[nr].port));
+}
+
 // ===============================[ Cache ]==================================
 
 v3MP::Cache::Cache()
@@ -722,7 +776,7 @@ int v3MP::send_report(unsigned char* scopedPDU, int scopedPDULength,
   int cEngineIDLength = MAXLENGTH_ENGINEID+1;
   int cNameLength = MAXLENGTH_CONTEXT_NAME+1;
 
-  if (scopedPDULength != MAX_SNMP_PACKET)
+  if (scopedPDU && (scopedPDULength > 0))
   {
     // try to get scopedPDU and PDU
     data = asn1_parse_scoped_pdu(scopedPDU, &scopedPDULength,
@@ -749,13 +803,16 @@ int v3MP::send_report(unsigned char* scopedPDU, int scopedPDULength,
         debugprintf(0, "mp: Error while trying to parse PDU!");
       }
     } // end of: if (data == NULL)
-  } // end if (scopedPDULength != MAX_SNMP_PACKET)
-  else { // scopedPDULength == MAX_SNMP_PACKET
+  } // end if (scopedPDU && (scopedPDULength > 0))
+  else { // no scopedPDU
     cEngineID[0] = '\0';
     cEngineIDLength = 0;
     cName[0] = '\0';
     cNameLength = 0;
     pdu->reqid = 0;
+    // the message could not be decrypted
+    if (sLevel == SNMP_SECURITY_LEVEL_AUTH_PRIV)
+      sLevel = SNMP_SECURITY_LEVEL_AUTH_NOPRIV;
   }
 
   clear_pdu(pdu);   // Clear pdu and free all content
@@ -893,7 +950,7 @@ int v3MP::snmp_parse(Snmp *snmp_session,
   debugprintf(3, "mp is parsing incoming message:");
   debughexprintf(25, inBuf, inBufLength);
 
-  if (inBufLength > MAX_SNMP_PACKET)
+  if (inBufLength > MAX_SNMP_PACKET_LIMIT)
     return  SNMPv3_MP_ERROR;
 
   unsigned char type;
@@ -902,11 +959,12 @@ int v3MP::snmp_parse(Snmp *snmp_session,
   unsigned char *inBufPtr = inBuf;
   long msgID, msgMaxSize;
   unsigned char msgFlags;
-  Buffer<unsigned char> msgSecurityParameters(MAX_SNMP_PACKET);
-  Buffer<unsigned char> msgData(MAX_SNMP_PACKET);
+  // the parts of the message are never longer than the message
+  Buffer<unsigned char> msgSecurityParameters(inBufLength);
+  Buffer<unsigned char> msgData(inBufLength);
   int msgSecurityParametersLength = inBufLength,   msgDataLength = inBufLength;
-  Buffer<unsigned char> scopedPDU(MAX_SNMP_PACKET);
-  int scopedPDULength = MAX_SNMP_PACKET;
+  Buffer<unsigned char> scopedPDU(inBufLength);
+  int scopedPDULength = 0;  // set by USM::process_msg() once filled
   long  maxSizeResponseScopedPDU = 0;
   struct SecurityStateReference *securityStateReference = NULL;
   int securityParametersPosition;
@@ -960,7 +1018,7 @@ int v3MP::snmp_parse(Snmp *snmp_session,
   }
 
   // do not allow larger messages than this entity can handle
-  if (msgMaxSize > MAX_SNMP_PACKET) msgMaxSize = MAX_SNMP_PACKET;
+  if (msgMaxSize > MAX_SNMP_PACKET_LIMIT) msgMaxSize = MAX_SNMP_PACKET_LIMIT;
   pdu->maxsize_scopedpdu = msgMaxSize;
 
   inBuf = asn_parse_string( inBuf, &inBufLength, &type,
@@ -1079,11 +1137,15 @@ int v3MP::snmp_parse(Snmp *snmp_session,
       usm->delete_sec_state_reference(securityStateReference);
       return SNMPv3_MP_PARSE_ERROR;
     }
-    if (SNMP_CLASS_SUCCESS != snmp_parse_vb(pdu, data, dataLength)) {
+    if (SNMP_CLASS_SUCCESS != snmp_parse_vb_list(pdu, data, dataLength)) {
       debugprintf(0, "mp: Error parsing Vb");
       usm->delete_sec_state_reference(securityStateReference);
       return SNMPv3_MP_PARSE_ERROR;
     }
+    // The scopedPDU buffer is freed on return: keep the vb list in
+    // inBuf, which is no longer needed and large enough
+    memmove(inBufPtr, pdu->vb_data, pdu->vb_data_len);
+    pdu->vb_data = inBufPtr;
     if ((tmp_contextEngineIDLength == 0) &&
         ((pdu->command == GET_REQ_MSG) || (pdu->command == GETNEXT_REQ_MSG) ||
          (pdu->command == SET_REQ_MSG) || (pdu->command == GETBULK_REQ_MSG) ||
@@ -1209,7 +1271,7 @@ int v3MP::snmp_parse(Snmp *snmp_session,
 			    SNMPv3_MP_INVALID_ENGINEID,
 			    CACHE_REMOTE_REQ);
 
-	    send_report(0, MAX_SNMP_PACKET, pdu, SNMPv3_MP_INVALID_ENGINEID,
+	    send_report(0, 0, pdu, SNMPv3_MP_INVALID_ENGINEID,
 			SNMP_SECURITY_LEVEL_NOAUTH_NOPRIV, msgSecurityModel,
 			securityName, from_address, snmp_session);
 	    clear_pdu(pdu, true);  // Clear pdu and free all content AND IDs!
@@ -1307,23 +1369,89 @@ int v3MP::snmp_build(struct snmp_pdu *pdu,
 		     const OctetStr &contextEngineID,
 		     const OctetStr &contextName)
 {
-  Buffer<unsigned char> scopedPDU(MAX_SNMP_PACKET);
-  unsigned char *scopedPDUPtr = scopedPDU.get_ptr();
+  Buffer<unsigned char> vbs(MAX_SNMP_PACKET);
+  unsigned char *vbsPtr = vbs.get_ptr();
+  unsigned char *bufPtr;
+  int maxLen = *out_length;
+  int vbsLength, pduLength;
+
+  if ((securityEngineID.len() == 0) &&
+      ((pdu->command == GET_REQ_MSG) || (pdu->command == GETNEXT_REQ_MSG) ||
+       (pdu->command == SET_REQ_MSG) || (pdu->command == GETBULK_REQ_MSG) ||
+       (pdu->command == TRP_REQ_MSG) || (pdu->command == INFORM_REQ_MSG)  ||
+       (pdu->command == TRP2_REQ_MSG)))
+  {
+    // First Contact => we do not send any management information
+    //  => delete VariableBinding
+    clear_pdu(pdu);
+  }
+
+  // encode vb in buf
+  vbsPtr = build_vb(pdu, vbsPtr, &maxLen);
+  if (!vbsPtr)
+  {
+    LOG_BEGIN(WARNING_LOG | 1);
+    LOG("v3MP: Error encoding vbs into buffer");
+    LOG_END;
+
+    return SNMPv3_MP_BUILD_ERROR;
+  }
+  vbsLength = SAFE_INT_CAST(vbsPtr - vbs.get_ptr());
+
+  // build dataPDU at the start of packet and move it to the end
+  maxLen = *out_length;
+  bufPtr = build_data_pdu(pdu, packet, &maxLen, vbs.get_ptr(), vbsLength);
+  if (!bufPtr)
+  {
+    LOG_BEGIN(WARNING_LOG | 1);
+    LOG("v3MP: Error encoding data pdu into buffer");
+    LOG_END;
+
+    return SNMPv3_MP_BUILD_ERROR;
+  }
+  pduLength = SAFE_INT_CAST(bufPtr - packet);
+  memmove(packet + *out_length - pduLength, packet, pduLength);
+
+  return snmp_build(packet, out_length, pduLength,
+		    pdu->command, pdu->reqid, pdu->msgid,
+		    securityEngineID, securityName, securityModel,
+		    securityLevel, contextEngineID, contextName);
+}
+
+// Encode the message around the data pdu at the end of packet. The
+// scopedPDU, the security parameters and the headers are prepended
+// in place, so the data pdu is never copied.
+int v3MP::snmp_build(unsigned char *packet,
+		     int *out_length,             // maximum Bytes in packet
+		     int pdu_length,
+		     int command,
+		     unsigned long reqid,
+		     unsigned long msgid,
+		     const OctetStr &securityEngineID,
+		     const OctetStr &securityName,
+		     int securityModel,
+		     int securityLevel,
+		     const OctetStr &contextEngineID,
+		     const OctetStr &contextName)
+{
   unsigned char globalData[MAXLENGTH_GLOBALDATA];
   int globalDataLength = MAXLENGTH_GLOBALDATA;
-  int scopedPDULength, maxLen = *out_length;
-  Buffer<unsigned char> buf(MAX_SNMP_PACKET);
-  unsigned char *bufPtr = buf.get_ptr();
-  long bufLength = 0, rc;
+  unsigned char *scopedPDUEnd = packet + *out_length;
+  unsigned char *scopedPDUPtr = scopedPDUEnd - pdu_length;
+  int scopedPDULength, maxLen = *out_length - pdu_length;
+  long rc;
   int msgID;
   int cachedErrorCode = SNMPv3_MP_OK;
   struct SecurityStateReference *securityStateReference = NULL;
   int isRequestMessage = 0;
 
-  if ((pdu->command == GET_REQ_MSG) || (pdu->command == GETNEXT_REQ_MSG) ||
-      (pdu->command == SET_REQ_MSG) || (pdu->command == GETBULK_REQ_MSG) ||
-      (pdu->command == TRP_REQ_MSG) || (pdu->command == INFORM_REQ_MSG)  ||
-      (pdu->command == TRP2_REQ_MSG))
+  if (maxLen < 0)
+    return SNMPv3_MP_BUILD_ERROR;
+
+  if ((command == GET_REQ_MSG) || (command == GETNEXT_REQ_MSG) ||
+      (command == SET_REQ_MSG) || (command == GETBULK_REQ_MSG) ||
+      (command == TRP_REQ_MSG) || (command == INFORM_REQ_MSG)  ||
+      (command == TRP2_REQ_MSG))
     isRequestMessage = 1;
 
   if (isRequestMessage) {
@@ -1347,18 +1475,11 @@ int v3MP::snmp_build(struct snmp_pdu *pdu,
 
     msgID = 0xdead;
 #endif
-
-    if (securityEngineID.len() == 0) {
-      // length==0 => SecurityLevel == noAuthNoPriv
-      //  => we do not send any management information
-      //  => delete VariableBinding
-      clear_pdu(pdu);
-    }
   }
   else {
     // it is a response => search for request
     debugprintf(3, "Looking up cache");
-    msgID = pdu->msgid;
+    msgID = msgid;
     rc = cache.get_entry(msgID, CACHE_REMOTE_REQ,
                          &cachedErrorCode, &securityStateReference);
 
@@ -1378,42 +1499,18 @@ int v3MP::snmp_build(struct snmp_pdu *pdu,
   LOG(contextName.get_printable());
   LOG_END;
 
-  // encode vb in buf
-  scopedPDUPtr = build_vb(pdu, scopedPDUPtr, &maxLen);
-  if (!scopedPDUPtr)
-  {
-    LOG_BEGIN(WARNING_LOG | 1);
-    LOG("v3MP: Error encoding vbs into buffer");
-    LOG_END;
-
-    return SNMPv3_MP_BUILD_ERROR;
-  }
-  scopedPDULength = SAFE_INT_CAST(scopedPDUPtr - scopedPDU.get_ptr());
-
-  //build dataPDU in buf
-  maxLen = *out_length;
-  scopedPDUPtr = scopedPDU.get_ptr();
-  bufPtr = build_data_pdu(pdu, bufPtr, &maxLen, scopedPDUPtr, scopedPDULength);
-
-  if (!bufPtr)
-  {
-    LOG_BEGIN(WARNING_LOG | 1);
-    LOG("v3MP: Error encoding data pdu into buffer");
-    LOG_END;
-
-    return SNMPv3_MP_BUILD_ERROR;
-  }
-
-  bufLength = SAFE_INT_CAST(bufPtr - buf.get_ptr());
-
-  //  serialize scopedPDU
-  maxLen = *out_length;
-  scopedPDUPtr = asn1_build_scoped_pdu(scopedPDUPtr, &maxLen,
-				       contextEngineID.data(),
-				       contextEngineID.len(),
-				       contextName.data(), contextName.len(),
-				       buf.get_ptr(), bufLength);
-
+  //  serialize scopedPDU in front of the data pdu
+  scopedPDUPtr = asn_rbuild_string(scopedPDUPtr, &maxLen,
+				   ASN_UNI_PRIM | ASN_OCTET_STR,
+				   contextName.data(), contextName.len());
+  if (scopedPDUPtr)
+    scopedPDUPtr = asn_rbuild_string(scopedPDUPtr, &maxLen,
+				     ASN_UNI_PRIM | ASN_OCTET_STR,
+				     contextEngineID.data(),
+				     contextEngineID.len());
+  if (scopedPDUPtr)
+    scopedPDUPtr = asn_rbuild_header(scopedPDUPtr, &maxLen, ASN_SEQ_CON,
+				     SAFE_INT_CAST(scopedPDUEnd - scopedPDUPtr));
   if (!scopedPDUPtr)
   {
     LOG_BEGIN(WARNING_LOG | 1);
@@ -1423,7 +1520,7 @@ int v3MP::snmp_build(struct snmp_pdu *pdu,
     return SNMPv3_MP_BUILD_ERROR;
   }
 
-  scopedPDULength = SAFE_INT_CAST(scopedPDUPtr - scopedPDU.get_ptr());
+  scopedPDULength = SAFE_INT_CAST(scopedPDUEnd - scopedPDUPtr);
 
   // build msgGlobalData
   unsigned char *globalDataPtr = (unsigned char *)&globalData;
@@ -1446,9 +1543,9 @@ int v3MP::snmp_build(struct snmp_pdu *pdu,
     }
   }
 
-  if ((pdu->command == GET_REQ_MSG) || (pdu->command == GETNEXT_REQ_MSG) ||
-      (pdu->command == SET_REQ_MSG) || (pdu->command == GETBULK_REQ_MSG) ||
-      (pdu->command == INFORM_REQ_MSG))
+  if ((command == GET_REQ_MSG) || (command == GETNEXT_REQ_MSG) ||
+      (command == SET_REQ_MSG) || (command == GETBULK_REQ_MSG) ||
+      (command == INFORM_REQ_MSG))
     msgFlags = msgFlags | SNMPv3_REPORTABLEFLAG;
 
   globalDataPtr = asn1_build_header_data(globalDataPtr, &globalDataLength,
@@ -1467,8 +1564,8 @@ int v3MP::snmp_build(struct snmp_pdu *pdu,
   switch (securityModel) {
     case SNMP_SECURITY_MODEL_USM: {
       int use_own_engine_id = 0;
-      if ((pdu->command == TRP_REQ_MSG) || (pdu->command == GET_RSP_MSG) ||
-          (pdu->command == REPORT_MSG)  || (pdu->command == TRP2_REQ_MSG)) {
+      if ((command == TRP_REQ_MSG) || (command == GET_RSP_MSG) ||
+          (command == REPORT_MSG)  || (command == TRP2_REQ_MSG)) {
         use_own_engine_id = 1;
       }
 
@@ -1476,14 +1573,14 @@ int v3MP::snmp_build(struct snmp_pdu *pdu,
                              (use_own_engine_id ?
                                         own_engine_id_oct : securityEngineID),
                              securityName, securityLevel,
-                             scopedPDU.get_ptr(), scopedPDULength,
+                             scopedPDULength,
                              securityStateReference, packet, out_length);
 
       if ( rc == SNMPv3_USM_OK ) {
         // build cache
-        if (!((pdu->command == TRP_REQ_MSG) || (pdu->command == GET_RSP_MSG) ||
-              (pdu->command == REPORT_MSG) || (pdu->command == TRP2_REQ_MSG)))
-          cache.add_entry(msgID, pdu->reqid, securityEngineID,
+        if (!((command == TRP_REQ_MSG) || (command == GET_RSP_MSG) ||
+              (command == REPORT_MSG) || (command == TRP2_REQ_MSG)))
+          cache.add_entry(msgID, reqid, securityEngineID,
                           securityModel, securityName, securityLevel,
                           contextEngineID, contextName, securityStateReference,
                           SNMPv3_MP_OK, CACHE_LOCAL_REQ);
@@ -38,6 +38,7 @@
 
 #include "snmp_pp/reentrant.h"
 #include "snmp_pp/target.h"
+#include "snmp_pp/v3.h"
 
 #ifdef SNMP_PP_NAMESPACE
 namespace Snmp_pp {
@@ -305,6 +306,9 @@ class DLLOPT v3MP
    * @param from_address     - Where the message came from (used to send
    *                           a report if neccessary)
    *
+   * @note The vb list is not decoded. It is moved to the start of inBuf
+   *       and pdu->vb_data points to it.
+   *
    * @return - SNMPv3_MP_OK or any error listed in snmperr.h
    */
   int snmp_parse(Snmp *snmp_session,
@@ -360,6 +364,44 @@ class DLLOPT v3MP
 		 const OctetStr &contextEngineID,
 		 const OctetStr &contextName);
 
+  /**
+   * Do the complete process of encoding a message around a data pdu
+   * that has already been serialized into the end of the buffer.
+   * The message is built in place, back to front.
+   *
+   * @note If securityEngineID is empty for a request (discovery), the
+   *       data pdu must not contain any variable bindings.
+   *
+   * @param packet           - The buffer, the serialized data pdu fills
+   *                           its last pdu_length bytes
+   * @param out_length       - IN: Length of the buffer,
+   *                           OUT: Length of the message, which starts
+   *                                at packet
+   * @param pdu_length       - The length of the serialized data pdu
+   * @param command          - The pdu type
+   * @param reqid            - The request id of the pdu
+   * @param msgid            - The message id of the request (responses only)
+   * @param securityEngineID - The securityEngineID
+   * @param securityNameIn   - The securityName
+   * @param securityModel    - Use this security model
+   * @param securityLevel    - Use this security level
+   * @param contextEngineID  - The contextEngineID
+   * @param contextName      - The contextName
+   *
+   * @return - SNMPv3_MP_OK or any error listed in snmperr.h
+   */
+  int snmp_build(unsigned char *packet,
+		 int *out_length,           // maximum Bytes in packet
+		 int pdu_length,
+		 int command,
+		 unsigned long reqid,
+		 unsigned long msgid,
+		 const OctetStr &securityEngineID,
+		 const OctetStr &securityNameIn,
+		 int securityModel, int securityLevel,
+		 const OctetStr &contextEngineID,
+		 const OctetStr &contextName);
+
   /**
    * Delete the entry with the given request id from the cache.
    * This function is used in eventlist.cpp when a request
@@ -495,6 +537,20 @@ class DLLOPT v3MP
   private:
     int initialize_table(const int size);
 
+    /**
+     * Get the first position of the engine id or host/port in the
+     * table, the table must be locked.
+     *
+     * @return - position or -1 if not found
+     */
+    int find(const OctetStr &engine_id) const;
+    int find(const OctetStr &host, int port) const;
+
+    /**
+     * Add the entry at the given position to the indexes.
+     */
+    void index_entry(const int nr);
+
     struct Entry_T
     {
       OctetStr engine_id;
@@ -505,7 +561,9 @@ class DLLOPT v3MP
     struct Entry_T *table;
     int max_entries;      ///< the maximum number of entries
     int entries;          ///< the current amount of entries
-    SNMP_PP_MUTABLE SnmpSynchronized lock;
+    HashIndex engine_id_index; ///< positions by engine id
+    HashIndex host_index;      ///< positions by host and port
+    SNMP_PP_MUTABLE SnmpRWSynchronized lock;
   };
 
 
@@ -74,6 +74,9 @@ extern int send_snmp_request(SnmpSocket sock, unsigned char *send_buf,
 extern int receive_snmp_response(SnmpSocket sock, Snmp &snmp_session,
                                  Pdu &pdu, UdpAddress &fromaddress,
 				 OctetStr &engine_id, bool process_msg = true);
+extern int receive_snmp_response(SnmpRecvBatch &batch, const int index,
+                                 Snmp &snmp_session, Pdu &pdu,
+                                 UdpAddress &fromaddress, OctetStr &engine_id);
 
 //----[ CSNMPMessage class ]-------------------------------------------
 
@@ -87,7 +90,8 @@ CSNMPMessage::CSNMPMessage(unsigned long id,
 			   const Address & address,
 			   snmp_callback callBack,
 			   void * callData):
-  m_uniqueId(id), m_snmp(snmp), m_socket(socket), m_pdu(pdu),
+  m_uniqueId(id), m_backoff(false), m_resends(0),
+  m_snmp(snmp), m_socket(socket), m_pdu(pdu),
   m_rawPduLen(rawPduLen), m_callBack(callBack), m_callData(callData),
   m_reason(0), m_received(0)
 {
@@ -101,6 +105,13 @@ CSNMPMessage::CSNMPMessage(unsigned long id,
   m_address = (Address *)address.clone();
   m_target = target.clone();
 
+  // Kludge: When this was first designed the units were millisecs
+  // However, later on the units for the target class were changed
+  // to hundreths of secs.  Multiply the hundreths of secs by 10
+  // to create the millisecs which the rest of the objects use.
+  // 11-Dec-95 TM
+  m_timeout = m_target->get_timeout() * 10;
+
   SetSendTime();
 }
 
@@ -114,16 +125,26 @@ CSNMPMessage::~CSNMPMessage()
 void CSNMPMessage::SetSendTime()
 {
   m_sendTime.refresh();
+  m_sendTime += m_timeout;
+}
 
-  // Kludge: When this was first designed the units were millisecs
-  // However, later on the units for the target class were changed
-  // to hundreths of secs.  Multiply the hundreths of secs by 10
-  // to create the millisecs which the rest of the objects use.
-  // 11-Dec-95 TM
-  m_sendTime += (m_target->get_timeout() * 10);
+void CSNMPMessage::SetTimeout(const unsigned long timeout, const bool backoff)
+{
+  m_timeout = timeout;
+  m_backoff = backoff;
+  SetSendTime();
 }
 
-int CSNMPMessage::SetPdu(const int reason, const Pdu &pdu,
+unsigned long CSNMPMessage::GetRoundTrip() const
+{
+  msec now;
+  timeval delta;
+
+  m_firstSendTime.GetDelta(now, delta);
+  return delta.tv_sec * 1000 + delta.tv_usec / 1000;
+}
+
+int CSNMPMessage::SetPdu(const int reason, Pdu &pdu,
 			 const UdpAddress &fromaddress)
 {
   if (Pdu::match_type(m_pdu.get_type(), pdu.get_type()) == false)
@@ -159,15 +180,15 @@ int CSNMPMessage::SetPdu(const int reason, const Pdu &pdu,
     }
   }
   m_received = 1;
-  m_pdu = pdu;
+  m_pdu = static_cast<Pdu&&>(pdu);
   m_reason = reason;
 
   LOG_BEGIN(DEBUG_LOG | 10);
   LOG("MsgQueue: Response received (req id) (status) (msg id)");
-  LOG(pdu.get_request_id());
+  LOG(m_pdu.get_request_id());
   LOG(reason);
 #ifdef _SNMPv3
-  LOG(pdu.get_message_id());
+  LOG(m_pdu.get_message_id());
 #endif
   LOG_END;
 
@@ -228,6 +249,13 @@ int CSNMPMessage::ResendMessage()
   }
 
   m_target->set_retry(m_target->get_retry() - 1);
+  m_resends++;
+  if (m_backoff && (m_timeout < MSGQUEUE_RTO_MAX))
+  {
+    m_timeout *= 2;
+    if (m_timeout > MSGQUEUE_RTO_MAX)
+      m_timeout = MSGQUEUE_RTO_MAX;
+  }
   SetSendTime();
   int status = send_snmp_request(m_socket, m_rawPdu, m_rawPduLen, *m_address);
   if (status != 0)
@@ -256,7 +284,8 @@ CSNMPMessageQueue::CSNMPMessageQueueElt::CSNMPMessageQueueElt(
                                            CSNMPMessage *message,
 					   CSNMPMessageQueueElt *next,
 					   CSNMPMessageQueueElt *previous):
-  m_message(message), m_Next(next), m_previous(previous)
+  m_message(message), m_Next(next), m_previous(previous),
+  m_hashNext(0), m_heapIndex(-1)
 {
   /* Finish insertion into doubly linked list */
   if (m_Next)     m_Next->m_previous = this;
@@ -283,8 +312,14 @@ CSNMPMessage *CSNMPMessageQueue::CSNMPMessageQueueElt::TestId(const unsigned lon
 //----[ CSNMPMessageQueue class ]--------------------------------------
 
 CSNMPMessageQueue::CSNMPMessageQueue(EventListHolder *holder, Snmp *session)
-  : m_head(0, 0, 0), m_msgCount(0), my_holder(holder), m_snmpSession(session)
+  : m_head(0, 0, 0), m_msgCount(0), my_holder(holder), m_snmpSession(session),
+    m_hashSize(MSGQUEUE_INITIAL_SIZE), m_heapSize(0),
+    m_adaptive(false), m_rttCount(0)
 {
+  m_hash = new CSNMPMessageQueueElt *[m_hashSize];
+  m_heap = new CSNMPMessageQueueElt *[m_hashSize];
+  memset(m_hash, 0, m_hashSize * sizeof(CSNMPMessageQueueElt *));
+  memset(m_rtt, 0, sizeof(m_rtt));
 }
 
 CSNMPMessageQueue::~CSNMPMessageQueue()
@@ -297,9 +332,339 @@ CSNMPMessageQueue::~CSNMPMessageQueue()
   while ((leftOver = m_head.GetNext()))
     delete leftOver;
 
+  delete [] m_hash;
+  delete [] m_heap;
+
+  for (int i = 0; i < MSGQUEUE_RTT_BUCKETS; i++)
+  {
+    CSNMPRttEntry *entry;
+    while ((entry = m_rtt[i]))
+    {
+      m_rtt[i] = entry->next;
+      delete entry;
+    }
+  }
+
   unlock();
 }
 
+//----[ request id index ]---------------------------------------------
+
+CSNMPMessageQueue::CSNMPMessageQueueElt *
+CSNMPMessageQueue::FindElt(const unsigned long uniqueId)
+{
+  CSNMPMessageQueueElt *elt = m_hash[HashIndex(uniqueId)];
+
+  while (elt && !elt->TestId(uniqueId))
+    elt = elt->m_hashNext;
+
+  return elt;
+}
+
+void CSNMPMessageQueue::HashInsert(CSNMPMessageQueueElt *elt)
+{
+  unsigned int i = HashIndex(elt->m_message->GetId());
+
+  elt->m_hashNext = m_hash[i];
+  m_hash[i] = elt;
+}
+
+void CSNMPMessageQueue::HashRemove(CSNMPMessageQueueElt *elt)
+{
+  CSNMPMessageQueueElt **link = &m_hash[HashIndex(elt->m_message->GetId())];
+
+  while (*link && (*link != elt))
+    link = &(*link)->m_hashNext;
+
+  if (*link)
+    *link = elt->m_hashNext;
+  elt->m_hashNext = 0;
+}
+
+// Double the hash table and the heap capacity
+void CSNMPMessageQueue::Grow()
+{
+  CSNMPMessageQueueElt **old_hash = m_hash;
+  CSNMPMessageQueueElt **old_heap = m_heap;
+  unsigned int old_size = m_hashSize;
+
+  m_hashSize *= 2;
+  m_hash = new CSNMPMessageQueueElt *[m_hashSize];
+  m_heap = new CSNMPMessageQueueElt *[m_hashSize];
+  memset(m_hash, 0, m_hashSize * sizeof(CSNMPMessageQueueElt *));
+  memcpy(m_heap, old_heap, m_heapSize * sizeof(CSNMPMessageQueueElt *));
+
+  for (unsigned int i = 0; i < old_size; i++)
+  {
+    CSNMPMessageQueueElt *elt = old_hash[i];
+    while (elt)
+    {
+      CSNMPMessageQueueElt *next = elt->m_hashNext;
+      HashInsert(elt);
+      elt = next;
+    }
+  }
+
+  delete [] old_hash;
+  delete [] old_heap;
+}
+
+//----[ timeout heap ]-------------------------------------------------
+
+void CSNMPMessageQueue::HeapUp(int pos)
+{
+  CSNMPMessageQueueElt *elt = m_heap[pos];
+
+  while (pos > 0)
+  {
+    int parent = (pos - 1) / 2;
+    if (!(elt->m_timeout < m_heap[parent]->m_timeout))
+      break;
+    HeapSet(pos, m_heap[parent]);
+    pos = parent;
+  }
+  HeapSet(pos, elt);
+}
+
+void CSNMPMessageQueue::HeapDown(int pos)
+{
+  CSNMPMessageQueueElt *elt = m_heap[pos];
+
+  for (;;)
+  {
+    int child = 2 * pos + 1;
+    if (child >= m_heapSize)
+      break;
+    if ((child + 1 < m_heapSize) &&
+        (m_heap[child + 1]->m_timeout < m_heap[child]->m_timeout))
+      child++;
+    if (!(m_heap[child]->m_timeout < elt->m_timeout))
+      break;
+    HeapSet(pos, m_heap[child]);
+    pos = child;
+  }
+  HeapSet(pos, elt);
+}
+
+void CSNMPMessageQueue::HeapInsert(CSNMPMessageQueueElt *elt)
+{
+  elt->m_message->GetSendTime(elt->m_timeout);
+  HeapSet(m_heapSize++, elt);
+  HeapUp(elt->m_heapIndex);
+}
+
+void CSNMPMessageQueue::HeapRemove(CSNMPMessageQueueElt *elt)
+{
+  int pos = elt->m_heapIndex;
+
+  if (pos < 0)
+    return;
+
+  elt->m_heapIndex = -1;
+  if (--m_heapSize == pos)
+    return;
+
+  // Move the last element into the hole, then restore the order
+  CSNMPMessageQueueElt *last = m_heap[m_heapSize];
+  HeapSet(pos, last);
+  HeapUp(pos);
+  HeapDown(last->m_heapIndex);
+}
+
+// The send time of the message changed (resend)
+void CSNMPMessageQueue::HeapUpdate(CSNMPMessageQueueElt *elt)
+{
+  elt->m_message->GetSendTime(elt->m_timeout);
+  HeapUp(elt->m_heapIndex);
+  HeapDown(elt->m_heapIndex);
+}
+
+bool CSNMPMessageQueue::CheckIndexes()
+{
+  SnmpSynchronize _synchronize(*this); // REENTRANT
+  bool ok = (m_heapSize == m_msgCount);
+  int count = 0;
+
+  for (int i = 1; i < m_heapSize; i++)
+    if (m_heap[i]->m_timeout < m_heap[(i - 1) / 2]->m_timeout)
+      ok = false;
+
+  for (CSNMPMessageQueueElt *elt = m_head.GetNext(); elt;
+       elt = elt->GetNext(), count++)
+  {
+    msec sendTime;
+
+    elt->GetMessage()->GetSendTime(sendTime);
+    if ((FindElt(elt->GetMessage()->GetId()) != elt) ||
+        (elt->m_heapIndex < 0) || (elt->m_heapIndex >= m_heapSize) ||
+        (m_heap[elt->m_heapIndex] != elt) || !(sendTime == elt->m_timeout))
+      ok = false;
+  }
+
+  return ok && (count == m_msgCount);
+}
+
+void CSNMPMessageQueue::RemoveElt(CSNMPMessageQueueElt *elt)
+{
+  HashRemove(elt);
+  HeapRemove(elt);
+  delete elt;
+  m_msgCount--;
+}
+
+//----[ round trip time estimator ]------------------------------------
+
+unsigned int CSNMPMessageQueue::RttHash(const Address &address) const
+{
+  unsigned int h = 0;
+
+  for (int i = 0; i < address.get_length(); i++)
+    h = h * 31 + address[i];
+
+  return h % MSGQUEUE_RTT_BUCKETS;
+}
+
+CSNMPMessageQueue::CSNMPRttEntry *
+CSNMPMessageQueue::RttFind(const Address &address, const bool create)
+{
+  int len = address.get_length();
+  unsigned int i = RttHash(address);
+  CSNMPRttEntry *entry;
+
+  for (entry = m_rtt[i]; entry; entry = entry->next)
+  {
+    if (entry->addressLen != len)
+      continue;
+
+    int pos = 0;
+    while ((pos < len) && (entry->address[pos] == address[pos]))
+      pos++;
+    if (pos == len)
+      return entry;
+  }
+
+  if (!create)
+    return 0;
+
+  if (m_rttCount >= MSGQUEUE_RTT_MAX)
+    RttEvict();
+
+  entry = new CSNMPRttEntry;
+  for (int pos = 0; pos < len; pos++)
+    entry->address[pos] = address[pos];
+  entry->addressLen = len;
+  entry->srtt = 0;
+  entry->rttvar = 0;
+  entry->rto = 0;
+  entry->backoff = 0;
+  memset(&entry->stats, 0, sizeof(entry->stats));
+
+  entry->next = m_rtt[i];
+  m_rtt[i] = entry;
+  m_rttCount++;
+
+  return entry;
+}
+
+// Forget the address that has not answered for the longest time
+void CSNMPMessageQueue::RttEvict()
+{
+  CSNMPRttEntry **oldest = 0;
+
+  for (int i = 0; i < MSGQUEUE_RTT_BUCKETS; i++)
+    for (CSNMPRttEntry **link = &m_rtt[i]; *link; link = &(*link)->next)
+      if (!oldest || ((*link)->updated < (*oldest)->updated))
+	oldest = link;
+
+  if (oldest)
+  {
+    CSNMPRttEntry *entry = *oldest;
+    *oldest = entry->next;
+    delete entry;
+    m_rttCount--;
+  }
+}
+
+unsigned long CSNMPMessageQueue::RttTimeout(const CSNMPRttEntry *entry) const
+{
+  unsigned long rto = entry->rto << entry->backoff;
+
+  return (rto > MSGQUEUE_RTO_MAX) ? MSGQUEUE_RTO_MAX : rto;
+}
+
+void CSNMPMessageQueue::RttSample(const CSNMPMessage *msg)
+{
+  // Karn: the response of a resent request may answer any of the sends
+  if (msg->GetResends())
+    return;
+
+  CSNMPRttEntry *entry = RttFind(*msg->GetAddress(), true);
+  long rtt = (long)msg->GetRoundTrip();
+
+  if (!entry->stats.samples)
+  {
+    entry->srtt = rtt << 3;    // SRTT = R
+    entry->rttvar = rtt << 1;  // RTTVAR = R/2
+  }
+  else
+  {
+    long delta = rtt - (entry->srtt >> 3);
+
+    entry->srtt += delta;      // SRTT += (R - SRTT) / 8
+    if (delta < 0)
+      delta = -delta;
+    entry->rttvar += delta - (entry->rttvar >> 2); // RTTVAR += (|d| - RTTVAR) / 4
+  }
+
+  // RTO = SRTT + max(G, 4 * RTTVAR), G is one millisec
+  unsigned long rto = (entry->srtt >> 3) + (entry->rttvar ? entry->rttvar : 1);
+  if (rto < MSGQUEUE_RTO_MIN)
+    rto = MSGQUEUE_RTO_MIN;
+  if (rto > MSGQUEUE_RTO_MAX)
+    rto = MSGQUEUE_RTO_MAX;
+
+  entry->rto = rto;
+  entry->backoff = 0;
+  entry->updated.refresh();
+  entry->stats.samples++;
+  entry->stats.last_rtt = rtt;
+}
+
+void CSNMPMessageQueue::RttExpired(const CSNMPMessage *msg, const bool final)
+{
+  CSNMPRttEntry *entry = RttFind(*msg->GetAddress(), true);
+
+  if (!entry->rto)
+  {
+    // no sample yet, keep the timeout that expired for the next
+    // requests so that they may be answered before they are resent
+    entry->rto = msg->GetTimeout();
+    entry->updated.refresh();
+  }
+  else if (entry->backoff < MSGQUEUE_RTO_BACKOFF)
+    entry->backoff++;
+
+  if (final)
+    entry->stats.timeouts++;
+  else
+    entry->stats.retransmissions++;
+}
+
+bool CSNMPMessageQueue::GetRttStats(const UdpAddress &address,
+				    SnmpRttStats &stats)
+{
+  CSNMPRttEntry *entry = RttFind(address, false);
+
+  if (!entry)
+    return false;
+
+  stats = entry->stats;
+  stats.srtt = entry->srtt >> 3;
+  stats.rttvar = entry->rttvar >> 2;
+  stats.rto = RttTimeout(entry);
+  return true;
+}
+
 CSNMPMessage * CSNMPMessageQueue::AddEntry(unsigned long id,
 					   Snmp * snmp,
 					   SnmpSocket socket,
@@ -323,11 +688,23 @@ CSNMPMessage * CSNMPMessageQueue::AddEntry(unsigned long id,
 					  callBack, callData);
 
   lock();
+  if ((unsigned int)m_msgCount >= m_hashSize)
+    Grow();
+
     /*---------------------------------------------------------*/
     /* Insert entry at head of list, done automagically by the */
-    /* constructor function, so don't use the return value.    */
+    /* constructor function.                                   */
     /*---------------------------------------------------------*/
-  (void) new CSNMPMessageQueueElt(newMsg, m_head.GetNext(), &m_head);
+  CSNMPMessageQueueElt *elt =
+    new CSNMPMessageQueueElt(newMsg, m_head.GetNext(), &m_head);
+  if (m_adaptive)
+  {
+    // unknown addresses get the timeout of the target
+    CSNMPRttEntry *entry = RttFind(address, false);
+    newMsg->SetTimeout(entry ? RttTimeout(entry) : newMsg->GetTimeout(), true);
+  }
+  HashInsert(elt);
+  HeapInsert(elt);
   ++m_msgCount;
 
   LOG_BEGIN(DEBUG_LOG | 10);
@@ -343,34 +720,24 @@ CSNMPMessage * CSNMPMessageQueue::AddEntry(unsigned long id,
 
 CSNMPMessage *CSNMPMessageQueue::GetEntry(const unsigned long uniqueId)
 {
-  CSNMPMessageQueueElt *msgEltPtr = m_head.GetNext();
-  CSNMPMessage *returnVal = NULL;
+  CSNMPMessageQueueElt *elt = FindElt(uniqueId);
 
-  while (msgEltPtr){
-    if ((returnVal = msgEltPtr->TestId(uniqueId)))
-      return returnVal;
-    msgEltPtr = msgEltPtr->GetNext();
-  }
-  return 0;
+  return elt ? elt->GetMessage() : 0;
 }
 
 int CSNMPMessageQueue::DeleteEntry(const unsigned long uniqueId)
 {
-  CSNMPMessageQueueElt *msgEltPtr = m_head.GetNext();
+  CSNMPMessageQueueElt *elt = FindElt(uniqueId);
 
-  while (msgEltPtr){
-    if (msgEltPtr->TestId(uniqueId)) {
-      delete msgEltPtr;
-      m_msgCount--;
-      LOG_BEGIN(DEBUG_LOG | 10);
-      LOG("MsgQueue: Removed entry (req id)");
-      LOG(uniqueId);
-      LOG_END;
-      return SNMP_CLASS_SUCCESS;
-    }
-    msgEltPtr = msgEltPtr->GetNext();
-  }
-  return SNMP_CLASS_INVALID_REQID;
+  if (!elt)
+    return SNMP_CLASS_INVALID_REQID;
+
+  RemoveElt(elt);
+  LOG_BEGIN(DEBUG_LOG | 10);
+  LOG("MsgQueue: Removed entry (req id)");
+  LOG(uniqueId);
+  LOG_END;
+  return SNMP_CLASS_SUCCESS;
 }
 
 void CSNMPMessageQueue::DeleteSocketEntry(const SnmpSocket socket)
@@ -387,7 +754,7 @@ REENTRANT({
       tmp_msgEltPtr = msgEltPtr;
       msgEltPtr = tmp_msgEltPtr->GetNext();
       // delete the entry
-      delete tmp_msgEltPtr;
+      RemoveElt(tmp_msgEltPtr);
     }
     else
       msgEltPtr = msgEltPtr->GetNext();
@@ -396,37 +763,14 @@ REENTRANT({
 
 CSNMPMessage * CSNMPMessageQueue::GetNextTimeoutEntry()
 {
-  CSNMPMessageQueueElt *msgEltPtr = m_head.GetNext();
-  msec bestTime;
-  msec sendTime(bestTime);
-  CSNMPMessage *msg;
-  CSNMPMessage *bestmsg = NULL;
-
-  if (msgEltPtr) {
-    bestmsg = msgEltPtr->GetMessage();
-    bestmsg->GetSendTime(bestTime);
-  }
-
-  // This would be much simpler if the queue was an ordered list!
-  while (msgEltPtr){
-    msg = msgEltPtr->GetMessage();
-    msg->GetSendTime(sendTime);
-    if (bestTime  > sendTime) {
-      bestTime = sendTime;
-      bestmsg = msg;
-    }
-    msgEltPtr = msgEltPtr->GetNext();
-  }
-  return bestmsg;
+  return m_heapSize ? m_heap[0]->GetMessage() : 0;
 }
 
 int CSNMPMessageQueue::GetNextTimeout(msec &sendTime)
 {
-  CSNMPMessage *msg = GetNextTimeoutEntry();
-
-  if (!msg)  return 1;    // nothing in the queue...
+  if (!m_heapSize)  return 1;    // nothing in the queue...
 
-  msg->GetSendTime(sendTime);
+  sendTime = m_heap[0]->m_timeout;
   return 0;
 }
 
@@ -506,87 +850,8 @@ int CSNMPMessageQueue::HandleEvents(const struct pollfd *readfds,
   {
     if (readfds[i].revents & POLLIN)
     {
-      CSNMPMessage *msg;
-      UdpAddress fromaddress;
-      Pdu tmppdu;
-      unsigned long temp_req_id;
-      int status;
-      int recv_status;
-      OctetStr engine_id;
-
-      tmppdu.set_request_id(0);
-
-      // get the response and put it into a Pdu
-      recv_status = receive_snmp_response(readfds[i].fd, *m_snmpSession,
-                                          tmppdu, fromaddress, engine_id);
-
-      lock();
-      // find the corresponding msg in the message queue
-      temp_req_id = tmppdu.get_request_id();
-      msg = GetEntry(temp_req_id);
-      if (!msg)
-      {
-	unlock();
-	LOG_BEGIN(INFO_LOG | 7);
-	LOG("MsgQueue: Ignore received message without outstanding request (req id)");
-	LOG(tmppdu.get_request_id());
-	LOG_END;
-	// the sent message is gone! probably was canceled, ignore it
-	continue;
-      }
-
-      if (tmppdu.get_request_id())
-      {
-	// we correctly received the pdu
-
-	// save it back into the message
-	status = msg->SetPdu(recv_status, tmppdu, fromaddress);
-
-	if (status != 0)
-	{
-	  // received pdu does not match
-	  // @todo if version is SNMPv3 we must return a report
-	  //       unknown pdu handler!
-	  unlock();
-	  continue;
-	}
-
-#ifdef _SNMPv3
-	if (engine_id.len() > 0)
-	{
-	  SnmpTarget *target = msg->GetTarget();
-	  if ((target->get_type() == SnmpTarget::type_utarget) &&
-	      (target->get_version() == version3))
-	  {
-	    UdpAddress addr = target->get_address();
-
-	    LOG_BEGIN(DEBUG_LOG | 14);
-	    LOG("MsgQueue: Adding engine id to table (addr) (id)");
-	    LOG(addr.get_printable());
-	    LOG(engine_id.get_printable());
-	    LOG_END;
-
-	    v3MP::I->add_to_engine_id_table(engine_id,
-					    (char*)addr.IpAddress::get_printable(),
-					    addr.get_port());
-	  }
-	}
-#endif
-
-	// Do the callback
-	unlock();
-	status = msg->Callback(SNMP_CLASS_ASYNC_RESPONSE);
-	lock();
-
-	if (!status)
-	{
-	  // this is an asynch response and the callback is done.
-	  // no need to keep this message around;
-	  // Dequeue the message
-	  DeleteEntry(temp_req_id);
-	}
-      }
-      unlock();
+      // get all pending responses with one call
+      ReceiveResponses(readfds[i].fd);
     }
   }
   return SNMP_CLASS_SUCCESS;
@@ -615,12 +880,6 @@ int CSNMPMessageQueue::HandleEvents(const int maxfds,
 				    const fd_set &,
 				    const fd_set &)
 {
-  CSNMPMessage *msg;
-  UdpAddress fromaddress;
-  Pdu tmppdu;
-  unsigned long temp_req_id;
-  int status;
-  int recv_status;
   fd_set snmp_readfds, snmp_writefds, snmp_errfds;
   int tmp_maxfds = maxfds;
 
@@ -635,85 +894,129 @@ int CSNMPMessageQueue::HandleEvents(const int maxfds,
     if ((FD_ISSET(fd, &snmp_readfds)) &&
 	(FD_ISSET(fd, (fd_set*)&readfds)))
     {
-      OctetStr engine_id;
+      // get all pending responses with one call
+      ReceiveResponses(fd);
+    } // if socket has data
+  } // for all sockets
+  return SNMP_CLASS_SUCCESS;
+}
 
-      tmppdu.set_request_id(0);
+#endif // HAVE_POLL_SYSCALL
 
-      // get the response and put it into a Pdu
-      recv_status = receive_snmp_response(fd, *m_snmpSession,
-                                          tmppdu, fromaddress, engine_id);
+// The socket is registered edge triggered, so read until recvmmsg()
+// does not fill the batch anymore.
+bool CSNMPMessageQueue::HandleSocket(const SnmpSocket fd)
+{
+  for (int batches = 0; batches < EVENT_LIST_MAX_BATCHES; batches++)
+  {
+    if (ReceiveResponses(fd) < SNMP_PP_BATCH_SIZE)
+      return true;
+  }
+  return false;
+}
 
-      lock();
-      // find the corresponding msg in the message queue
-      temp_req_id = tmppdu.get_request_id();
-      msg = GetEntry(temp_req_id);
-      if (!msg) {
-	     unlock();
-	     LOG_BEGIN(INFO_LOG | 7);
-	     LOG("MsgQueue: Ignore received message without outstanding "
-		 "request (req id)");
-	     LOG(tmppdu.get_request_id());
-	     LOG_END;
-	     // the sent message is gone! probably was canceled, ignore it
-	     continue;
-      }
+// Receive the pending responses into a batch of our own: the
+// callbacks may process events again and receive into another batch.
+int CSNMPMessageQueue::ReceiveResponses(const SnmpSocket fd)
+{
+  SnmpRecvBatch *batch = m_recvBatches.claim();
+  int count = batch->receive(fd);
+
+  for (int index = 0; index < count; index++)
+    HandleResponse(*batch, index);
+
+  m_recvBatches.release(batch);
+  return count;
+}
+
+// Match one received response of the batch to its outstanding
+// message and call the callback of the message.
+void CSNMPMessageQueue::HandleResponse(SnmpRecvBatch &batch, const int index)
+{
+  CSNMPMessage *msg;
+  UdpAddress fromaddress;
+  Pdu tmppdu;
+  unsigned long temp_req_id;
+  int status;
+  int recv_status;
+  OctetStr engine_id;
+
+  tmppdu.set_request_id(0);
+
+  // decode the response and put it into a Pdu
+  recv_status = receive_snmp_response(batch, index, *m_snmpSession,
+                                      tmppdu, fromaddress, engine_id);
+
+  lock();
+  // find the corresponding msg in the message queue
+  temp_req_id = tmppdu.get_request_id();
+  msg = GetEntry(temp_req_id);
+  if (!msg)
+  {
+    unlock();
+    LOG_BEGIN(INFO_LOG | 7);
+    LOG("MsgQueue: Ignore received message without outstanding request (req id)");
+    LOG(tmppdu.get_request_id());
+    LOG_END;
+    // the sent message is gone! probably was canceled, ignore it
+    return;
+  }
 
-      if (tmppdu.get_request_id()) {
-	     // we correctly received the pdu
+  if (tmppdu.get_request_id())
+  {
+    // we correctly received the pdu
 
-	     // save it back into the message
-	     status = msg->SetPdu(recv_status, tmppdu, fromaddress);
+    // save it back into the message
+    status = msg->SetPdu(recv_status, tmppdu, fromaddress);
+
+    if (status != 0)
+    {
+      // received pdu does not match
+      // @todo if version is SNMPv3 we must return a report
+      //       unknown pdu handler!
+      unlock();
+      return;
+    }
 
-             if (status != 0)
-             {
-               // received pdu does not match
-               // @todo if version is SNMPv3 we must return a report
-               //       unknown pdu handler!
-               unlock();
-               continue;
-             }
+    RttSample(msg);
 
 #ifdef _SNMPv3
-	     if (engine_id.len() > 0)
-	     {
-		 SnmpTarget *target = msg->GetTarget();
-		 if ((target->get_type() == SnmpTarget::type_utarget) &&
-		     (target->get_version() == version3))
-		 {
-		   UdpAddress addr = target->get_address();
-
-		   LOG_BEGIN(DEBUG_LOG | 14);
-		   LOG("MsgQueue: Adding engine id to table (addr) (id)");
-		   LOG(addr.get_printable());
-		   LOG(engine_id.get_printable());
-		   LOG_END;
-
-		   v3MP::I->add_to_engine_id_table(engine_id,
-			       (char*)addr.IpAddress::get_printable(),
-			       addr.get_port());
-		 }
-	     }
-#endif
+    if (engine_id.len() > 0)
+    {
+      SnmpTarget *target = msg->GetTarget();
+      if ((target->get_type() == SnmpTarget::type_utarget) &&
+	  (target->get_version() == version3))
+      {
+	UdpAddress addr = target->get_address();
+
+	LOG_BEGIN(DEBUG_LOG | 14);
+	LOG("MsgQueue: Adding engine id to table (addr) (id)");
+	LOG(addr.get_printable());
+	LOG(engine_id.get_printable());
+	LOG_END;
 
-	     // Do the callback
-             unlock();
-	     status = msg->Callback(SNMP_CLASS_ASYNC_RESPONSE);
-             lock();
-
-	     if (!status) {
-	       // this is an asynch response and the callback is done.
-	       // no need to keep this message around;
-	       // Dequeue the message
-	       DeleteEntry(temp_req_id);
-	     }
+	v3MP::I->add_to_engine_id_table(engine_id,
+					(char*)addr.IpAddress::get_printable(),
+					addr.get_port());
       }
-      unlock();
-    } // if socket has data
-  } // for all sockets
-  return SNMP_CLASS_SUCCESS;
-}
+    }
+#endif
 
-#endif // HAVE_POLL_SYSCALL
+    // Do the callback
+    unlock();
+    status = msg->Callback(SNMP_CLASS_ASYNC_RESPONSE);
+    lock();
+
+    if (!status)
+    {
+      // this is an asynch response and the callback is done.
+      // no need to keep this message around;
+      // Dequeue the message
+      DeleteEntry(temp_req_id);
+    }
+  }
+  unlock();
+}
 
 int CSNMPMessageQueue::DoRetries(const msec &now)
 {
@@ -727,6 +1030,9 @@ int CSNMPMessageQueue::DoRetries(const msec &now)
 
     if (sendTime <= now)
     {
+      unsigned long req_id = msg->GetId();
+      bool expired = !msg->GetReceived();
+
       // send out the message again
       unlock();
       status = msg->ResendMessage();
@@ -735,7 +1041,9 @@ int CSNMPMessageQueue::DoRetries(const msec &now)
       {
 	if (status == SNMP_CLASS_TIMEOUT)
 	{
-	  unsigned long req_id = msg->GetId();
+	  CSNMPMessageQueueElt *elt = FindElt(req_id);
+	  if (elt)
+	    RttExpired(elt->GetMessage(), true);
 
 	  // Dequeue the message
 	  DeleteEntry(req_id);
@@ -753,10 +1061,25 @@ int CSNMPMessageQueue::DoRetries(const msec &now)
 	else {
 	  // Some other send error, should we dequeue the message?
 	  // do we really want to return without processing the rest?
+	  CSNMPMessageQueueElt *elt = FindElt(req_id);
+	  if (elt)
+	    HeapUpdate(elt);
           unlock();
 	  return status;
 	}
       }
+      else
+      {
+	// The message has a new send time, unless it was removed
+	// while the queue was unlocked
+	CSNMPMessageQueueElt *elt = FindElt(req_id);
+	if (elt)
+	{
+	  if (expired)
+	    RttExpired(elt->GetMessage(), false);
+	  HeapUpdate(elt);
+	}
+      }
     }
     else {
       break;  // the next timeout is still in the future...so we are done
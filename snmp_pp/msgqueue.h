@@ -90,6 +90,16 @@ namespace Snmp_pp {
 
 //----[ defines ]------------------------------------------------------
 
+// initial size of the request id hash table and timeout heap
+#define MSGQUEUE_INITIAL_SIZE 64
+
+// round trip time estimator (RFC 6298), times in millisecs
+#define MSGQUEUE_RTO_MIN     100    // lower bound of the estimated timeout
+#define MSGQUEUE_RTO_MAX     60000  // upper bound, also for the backoff
+#define MSGQUEUE_RTO_BACKOFF 6      // max doublings kept for an address
+#define MSGQUEUE_RTT_BUCKETS 64     // hash buckets of the address table
+#define MSGQUEUE_RTT_MAX     1024   // max addresses remembered
+
 
 
 //----[ CSNMPMessage class ]-------------------------------------------
@@ -117,10 +127,19 @@ class DLLOPT CSNMPMessage
   void ResetId(const unsigned long newId) { m_uniqueId = newId; };
   void SetSendTime();
   void GetSendTime(msec &sendTime) const { sendTime = m_sendTime; };
+  // set the timeout in millisecs, doubled on each resend if backoff is set
+  void SetTimeout(const unsigned long timeout, const bool backoff);
+  unsigned long GetTimeout() const { return m_timeout; };
+  // millisecs since the first send, only valid if GetResends() is 0
+  unsigned long GetRoundTrip() const;
+  int GetResends() const { return m_resends; };
+  const Address *GetAddress() const { return m_address; };
   SnmpSocket GetSocket() const { return m_socket; };
-  int SetPdu(const int reason, const Pdu &pdu, const UdpAddress &fromaddress);
+  // the received pdu is moved into the message, if it matches the request
+  int SetPdu(const int reason, Pdu &pdu, const UdpAddress &fromaddress);
+  // moves the pdu out of the message
   int GetPdu(int &reason, Pdu &pdu)
-                                 { pdu = m_pdu; reason = m_reason; return 0; };
+     { pdu = static_cast<Pdu&&>(m_pdu); reason = m_reason; return 0; };
   int GetReceived() const { return m_received; };
   int ResendMessage();
   int Callback(const int reason);
@@ -130,6 +149,10 @@ class DLLOPT CSNMPMessage
 
   unsigned long	  m_uniqueId;
   msec		  m_sendTime;
+  msec		  m_firstSendTime;
+  unsigned long	  m_timeout;
+  bool		  m_backoff;
+  int		  m_resends;
   Snmp *	  m_snmp;
   SnmpSocket	  m_socket;
   SnmpTarget *	  m_target;
@@ -176,21 +199,41 @@ class DLLOPT CSNMPMessageQueue: public CEvents
 		     const fd_set &writefds,
 		     const fd_set &exceptfds);
 #endif
+  // read the responses pending on a session socket
+    bool HandleSocket(const SnmpSocket fd);
 
   // return number of outstanding messages
     int GetCount() { return m_msgCount; };
 
+  // check that the list, the request id index and the timeout heap
+  // agree and that the heap is ordered, for tests
+    bool CheckIndexes();
+
     int DoRetries(const msec &sendtime);
 
     int Done();
     int Done(unsigned long);
 
+  // retransmission timeouts estimated from the round trip time
+    void SetAdaptiveTimeout(const bool enable) { m_adaptive = enable; };
+    bool GetAdaptiveTimeout() const { return m_adaptive; };
+    bool GetRttStats(const UdpAddress &address, SnmpRttStats &stats);
+
+  // largest response that can be received
+    void SetMaxMsgSize(const int size) { m_recvBatches.set_buffer_size(size); };
+    int GetMaxMsgSize() { return m_recvBatches.get_buffer_size(); };
+
  protected:
+  // receive and process the datagrams pending on a socket
+    int ReceiveResponses(const SnmpSocket fd);
+  // process one datagram of a batch
+    void HandleResponse(SnmpRecvBatch &batch, const int index);
 
     /*---------------------------------------------------------*/
     /* CSNMPMessageQueueElt				       */
     /*   a container for a single item on a linked lists of    */
-    /*  CSNMPMessages.					       */
+    /*  CSNMPMessages. Each element is also on a hash chain of */
+    /*  its request id and in the timeout heap.		       */
     /*---------------------------------------------------------*/
     class DLLOPT CSNMPMessageQueueElt
     {
@@ -205,16 +248,77 @@ class DLLOPT CSNMPMessageQueue: public CEvents
       CSNMPMessage *TestId(const unsigned long uniqueId);
 
      private:
+      friend class CSNMPMessageQueue;
 
       CSNMPMessage *m_message;
       class CSNMPMessageQueueElt *m_Next;
       class CSNMPMessageQueueElt *m_previous;
+      class CSNMPMessageQueueElt *m_hashNext; // same hash bucket
+      int m_heapIndex;                        // position in m_heap
+      msec m_timeout;                         // heap key, send time of msg
+    };
+
+  // request id index
+    CSNMPMessageQueueElt *FindElt(const unsigned long uniqueId);
+    void HashInsert(CSNMPMessageQueueElt *elt);
+    void HashRemove(CSNMPMessageQueueElt *elt);
+    void Grow();
+    unsigned int HashIndex(const unsigned long uniqueId) const
+      { return (unsigned int)(uniqueId ^ (uniqueId >> 16)) & (m_hashSize - 1); };
+
+  // binary min-heap of the elements, ordered by timeout
+    void HeapInsert(CSNMPMessageQueueElt *elt);
+    void HeapRemove(CSNMPMessageQueueElt *elt);
+    void HeapUpdate(CSNMPMessageQueueElt *elt);
+    void HeapUp(int pos);
+    void HeapDown(int pos);
+    void HeapSet(int pos, CSNMPMessageQueueElt *elt)
+      { m_heap[pos] = elt; elt->m_heapIndex = pos; };
+
+  // unlink an element from the list and indexes and delete it
+    void RemoveElt(CSNMPMessageQueueElt *elt);
+
+    /*---------------------------------------------------------*/
+    /* CSNMPRttEntry					       */
+    /*   round trip time estimate of one address. srtt is kept */
+    /*  scaled by 8 and rttvar by 4 (millisecs), as in BSD.    */
+    /*---------------------------------------------------------*/
+    struct CSNMPRttEntry
+    {
+      unsigned char address[ADDRBUF]; // binary address and port
+      int addressLen;
+      CSNMPRttEntry *next;        // same hash bucket
+      msec updated;               // time of the last sample
+      long srtt;
+      long rttvar;
+      unsigned long rto;          // without backoff
+      int backoff;                // timeouts since the last sample
+      SnmpRttStats stats;
     };
 
+  // address table of the estimator
+    CSNMPRttEntry *RttFind(const Address &address, const bool create);
+    unsigned int RttHash(const Address &address) const;
+    void RttEvict();
+    unsigned long RttTimeout(const CSNMPRttEntry *entry) const;
+  // account a response or a timeout of msg
+    void RttSample(const CSNMPMessage *msg);
+    void RttExpired(const CSNMPMessage *msg, const bool final);
+
     CSNMPMessageQueueElt m_head;
     int m_msgCount;
     EventListHolder *my_holder;
     Snmp *m_snmpSession;
+    SnmpRecvBatchPool m_recvBatches;
+
+    CSNMPMessageQueueElt **m_hash;
+    unsigned int m_hashSize;     // power of 2, also the heap capacity
+    CSNMPMessageQueueElt **m_heap;
+    int m_heapSize;
+
+    bool m_adaptive;
+    CSNMPRttEntry *m_rtt[MSGQUEUE_RTT_BUCKETS];
+    int m_rttCount;
 };
 
 #ifdef SNMP_PP_NAMESPACE
@@ -95,6 +95,9 @@ namespace Snmp_pp {
 //--------[ externs ]---------------------------------------------------
 extern int receive_snmp_notification(SnmpSocket sock, Snmp &snmp_session,
                                      Pdu &pdu, SnmpTarget **target);
+extern int receive_snmp_notification(SnmpRecvBatch &batch, const int index,
+                                     Snmp &snmp_session, Pdu &pdu,
+                                     SnmpTarget **target);
 
 //-----[ macros ]------------------------------------------------------
 // should be in snmp.h...
@@ -310,7 +313,8 @@ CNotifyEvent *CNotifyEventQueue::CNotifyEventQueueElt::TestId(Snmp *snmp)
 CNotifyEventQueue::CNotifyEventQueue(EventListHolder *holder, Snmp *session)
   : m_head(NULL,NULL,NULL), m_msgCount(0), m_notify_fd(INVALID_SOCKET),
     m_listen_port(SNMP_TRAP_PORT), m_notify_fd6(INVALID_SOCKET),
-    m_listen_port6(SNMP_TRAP_PORT), my_holder(holder), m_snmpSession(session)
+    m_listen_port6(SNMP_TRAP_PORT), m_reuse_port(false), my_holder(holder),
+    m_snmpSession(session)
 {
 //TM: could do the trap registration setup here but seems better to
 //wait until the app actually requests trap receives by calling
@@ -338,6 +342,24 @@ SnmpSocket CNotifyEventQueue::get_notify_fd6() const
   return m_notify_fd6;
 }
 
+// Allow other sockets to bind the same trap port. The kernel then
+// distributes the received notifications between these sockets.
+static int enable_reuse_port(SnmpSocket fd)
+{
+#ifdef SO_REUSEPORT
+  int on = 1;
+
+  if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (char *)&on, sizeof(on)) == 0)
+    return SNMP_CLASS_SUCCESS;
+
+  debugprintf(0, "Error: could not set SO_REUSEPORT option on trap socket.");
+  return SNMP_CLASS_TL_FAILED;
+#else
+  debugprintf(0, "Error: SO_REUSEPORT is not supported on this platform.");
+  return SNMP_CLASS_TL_UNSUPPORTED;
+#endif
+}
+
 int CNotifyEventQueue::AddEntry(Snmp *snmp,
 				const OidCollection &trapids,
 				const TargetCollection &targets)
@@ -388,6 +410,16 @@ int CNotifyEventQueue::AddEntry(Snmp *snmp,
 	return status;
       }
 
+      if (m_reuse_port)
+      {
+	status = enable_reuse_port(m_notify_fd);
+	if (status != SNMP_CLASS_SUCCESS)
+	{
+	  cleanup();
+	  return status;
+	}
+      }
+
       // set up the manager socket attributes
       unsigned long inaddr = inet_addr(IpAddress(m_notify_addr).get_printable());
       memset(&mgr_addr, 0, sizeof(mgr_addr));
@@ -442,6 +474,7 @@ int CNotifyEventQueue::AddEntry(Snmp *snmp,
 
       debugprintf(3, "Bind to %s for notifications, fd %d.",
 		  m_notify_addr.get_printable(), m_notify_fd);
+      my_holder->RegisterSocket(m_notify_fd, this);
     }
 
     // Do ipv6
@@ -521,6 +554,16 @@ int CNotifyEventQueue::AddEntry(Snmp *snmp,
       }
 #endif
 
+      if (m_reuse_port)
+      {
+	status = enable_reuse_port(m_notify_fd6);
+	if (status != SNMP_CLASS_SUCCESS)
+	{
+	  cleanup();
+	  return status;
+	}
+      }
+
       mgr_addr6.sin6_family = AF_INET6;
       mgr_addr6.sin6_port = htons(m_notify_addr6.get_port());
       mgr_addr6.sin6_scope_id = scope;
@@ -569,6 +612,7 @@ int CNotifyEventQueue::AddEntry(Snmp *snmp,
       }
       debugprintf(3, "Bind to %s for notifications, fd %d.",
 		  m_notify_addr6.get_printable(), m_notify_fd6);
+      my_holder->RegisterSocket(m_notify_fd6, this);
 #else
       debugprintf(0, "User error: Enable IPv6 and recompile snmp++.");
       cleanup();
@@ -593,12 +637,14 @@ void CNotifyEventQueue::cleanup()
 {
   if (m_notify_fd != INVALID_SOCKET)
   {
+    my_holder->UnregisterSocket(m_notify_fd);
     close(m_notify_fd);
     m_notify_fd = INVALID_SOCKET;
   }
   m_notify_addr.clear();
   if (m_notify_fd6 != INVALID_SOCKET)
   {
+    my_holder->UnregisterSocket(m_notify_fd6);
     close(m_notify_fd6);
     m_notify_fd6 = INVALID_SOCKET;
   }
@@ -638,6 +684,7 @@ void CNotifyEventQueue::DeleteEntry(Snmp *snmp)
     {
       debugprintf(3, "Closing notifications port %s, fd %d.",
 		  m_notify_addr.get_printable(), m_notify_fd);
+      my_holder->UnregisterSocket(m_notify_fd);
       close(m_notify_fd);
       m_notify_fd = INVALID_SOCKET;
     }
@@ -646,6 +693,7 @@ void CNotifyEventQueue::DeleteEntry(Snmp *snmp)
     {
       debugprintf(3, "Closing notifications port %s, fd %d.",
 		  m_notify_addr6.get_printable(), m_notify_fd6);
+      my_holder->UnregisterSocket(m_notify_fd6);
       close(m_notify_fd6);
       m_notify_fd6 = INVALID_SOCKET;
     }
@@ -654,6 +702,88 @@ void CNotifyEventQueue::DeleteEntry(Snmp *snmp)
   unlock();
 }
 
+// Receive all pending notifications from the socket with one call
+// and pass each of them to the registered callbacks. When draining
+// the socket, an empty socket is not a transport layer failure.
+// The batch is our own while the callbacks run, they may process
+// events again.
+int CNotifyEventQueue::HandleNotifications(SnmpSocket fd, const bool drain,
+                                           int *received)
+{
+  int status = SNMP_CLASS_SUCCESS;
+  SnmpRecvBatch *batch = m_recvBatches.claim();
+  int count = batch->receive(fd);
+
+  if (received)
+    *received = count;
+
+  if ((count < 0) && drain && ((EAGAIN == errno) || (EWOULDBLOCK == errno)))
+  {
+    m_recvBatches.release(batch);
+    return status;
+  }
+
+  // On a receive error the batch is empty and the callbacks are
+  // called once with a transport layer failure
+  if (count < 0)
+    count = 1;
+
+  for (int index = 0; index < count; index++)
+  {
+    Pdu pdu;
+    SnmpTarget *target = NULL;
+
+    status = receive_snmp_notification(*batch, index, *m_snmpSession,
+                                       pdu, &target);
+
+    if ((SNMP_CLASS_SUCCESS == status) ||
+	(SNMP_CLASS_TL_FAILED == status))
+    {
+      // If we have transport layer failure, the app will want to
+      // know about it.
+      // Go through each snmp object and check the filters, making
+      // callbacks as necessary
+
+      // On failure target will be NULL
+      if (!target)
+	target = new SnmpTarget();
+
+      CNotifyEventQueueElt *notifyEltPtr = m_head.GetNext();
+      while (notifyEltPtr)
+      {
+	notifyEltPtr->GetNotifyEvent()->Callback(*target, pdu, fd, status);
+	notifyEltPtr = notifyEltPtr->GetNext();
+      } // for each snmp object
+    }
+    if (target) // receive_snmp_notification calls new
+      delete target;
+  }
+  m_recvBatches.release(batch);
+  return status;
+}
+
+// The socket is registered edge triggered, so read until recvmmsg()
+// does not fill the batch anymore.
+bool CNotifyEventQueue::HandleSocket(const SnmpSocket fd)
+{
+  SnmpSynchronize _synchronize(*this); // REENTRANT
+
+  if ((fd == INVALID_SOCKET) ||
+      ((fd != m_notify_fd) && (fd != m_notify_fd6)))
+    return true; // not our socket (anymore)
+
+  for (int batches = 0; batches < EVENT_LIST_MAX_BATCHES; batches++)
+  {
+    int received = 0;
+
+    HandleNotifications(fd, true, &received);
+
+    if (received < SNMP_PP_BATCH_SIZE)
+      return true;
+  }
+  return false;
+}
+
 #ifdef HAVE_POLL_SYSCALL
 int CNotifyEventQueue::GetFdCount()
 {
@@ -702,9 +832,6 @@ int CNotifyEventQueue::HandleEvents(const struct pollfd *readfds,
 
   for (int i=0; i < fds; i++)
   {
-    Pdu pdu;
-    SnmpTarget *target = NULL;
-
     if ((readfds[i].revents & POLLIN) == 0)
       continue; // nothing to receive
 
@@ -712,31 +839,7 @@ int CNotifyEventQueue::HandleEvents(const struct pollfd *readfds,
         (readfds[i].fd != m_notify_fd6))
       continue; // not our socket
 
-    status = receive_snmp_notification(
-                 (readfds[i].fd==m_notify_fd?m_notify_fd:m_notify_fd6),
-                 *m_snmpSession,
-				       pdu, &target);
-
-    if ((SNMP_CLASS_SUCCESS == status) ||
-	(SNMP_CLASS_TL_FAILED == status))
-    {
-      // If we have transport layer failure, the app will want to
-      // know about it.
-      // Go through each snmp object and check the filters, making
-      // callbacks as necessary
-      if (!target) target = new SnmpTarget();
-
-      CNotifyEventQueueElt *notifyEltPtr = m_head.GetNext();
-      while (notifyEltPtr)
-      {
-	notifyEltPtr->GetNotifyEvent()->Callback(*target, pdu,
-                 (readfds[i].fd==m_notify_fd?m_notify_fd:m_notify_fd6),
-                 status);
-	notifyEltPtr = notifyEltPtr->GetNext();
-      } // for each snmp object
-    }
-    if (target) // receive_snmp_notification calls new
-      delete target;
+    status = HandleNotifications(readfds[i].fd);
   }
 
   return status;
@@ -777,48 +880,15 @@ int CNotifyEventQueue::HandleEvents(const int /*maxfds*/,
       )
     return status;
 
-  Pdu pdu;
-  SnmpTarget *target = NULL;
-
-  // pull the notifiaction off the socket
-  if (((m_notify_fd != INVALID_SOCKET) && 
-        FD_ISSET(m_notify_fd, (fd_set*)&readfds))
-      ||
-      ((m_notify_fd6 != INVALID_SOCKET) && 
-        FD_ISSET(m_notify_fd6, (fd_set*)&readfds)))
-  {
-    int not_fd;
-    if ((m_notify_fd != INVALID_SOCKET) && 
-         (FD_ISSET(m_notify_fd, (fd_set*)&readfds)))
-        not_fd = m_notify_fd;
-    else
-        not_fd = m_notify_fd6; 
-    status = receive_snmp_notification(not_fd, *m_snmpSession,
-				       pdu, &target);
+  // pull the notifications off the sockets
+  if ((m_notify_fd != INVALID_SOCKET) &&
+      FD_ISSET(m_notify_fd, (fd_set*)&readfds))
+    status = HandleNotifications(m_notify_fd);
 
-    if ((SNMP_CLASS_SUCCESS == status) ||
-	(SNMP_CLASS_TL_FAILED == status))
-    {
-      // If we have transport layer failure, the app will want to
-      // know about it.
-      // Go through each snmp object and check the filters, making
-      // callbacks as necessary
+  if ((m_notify_fd6 != INVALID_SOCKET) &&
+      FD_ISSET(m_notify_fd6, (fd_set*)&readfds))
+    status = HandleNotifications(m_notify_fd6);
 
-      // On failure target will be NULL
-      if (!target)
-	target = new SnmpTarget();
-
-      CNotifyEventQueueElt *notifyEltPtr = m_head.GetNext();
-      while (notifyEltPtr)
-      {
-	notifyEltPtr->GetNotifyEvent()->Callback(*target, pdu,
-                                             not_fd, status);
-	notifyEltPtr = notifyEltPtr->GetNext();
-      } // for each snmp object
-    }
-    if (target) // receive_snmp_notification calls new
-      delete target;
-  }
   return status;
 }
 
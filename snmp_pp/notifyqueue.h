@@ -80,6 +80,7 @@
 #include "snmp_pp/config_snmp_pp.h"
 #include "snmp_pp/oid.h"
 #include "snmp_pp/target.h"
+#include "snmp_pp/uxsnmp.h"
 #include "snmp_pp/eventlist.h"
 
 #ifdef SNMP_PP_NAMESPACE
@@ -148,6 +149,9 @@ class DLLOPT CNotifyEventQueue: public CEvents
                      const fd_set &writefds,
                      const fd_set &exceptfds);
 #endif
+    // read the notifications pending on a notify socket
+    bool HandleSocket(const SnmpSocket fd);
+
     // return number of outstanding messages
     int GetCount() { return m_msgCount; };
 
@@ -158,8 +162,12 @@ class DLLOPT CNotifyEventQueue: public CEvents
     int get_listen_port() { return m_listen_port; };
     void set_listen_port6(int port) { m_listen_port6 = port; };
     int get_listen_port6() { return m_listen_port6; };
+    void set_reuse_port(bool reuse) { m_reuse_port = reuse; };
+    bool get_reuse_port() { return m_reuse_port; };
     SnmpSocket get_notify_fd() const;
     SnmpSocket get_notify_fd6() const;
+    // largest trap or inform that can be received
+    void SetMaxMsgSize(const int size) { m_recvBatches.set_buffer_size(size); };
 
   protected:
 
@@ -188,6 +196,8 @@ class DLLOPT CNotifyEventQueue: public CEvents
     };
 
     void cleanup();
+    int HandleNotifications(SnmpSocket fd, const bool drain = false,
+                            int *received = 0);
 
     CNotifyEventQueueElt m_head;
     int                  m_msgCount;
@@ -196,9 +206,11 @@ class DLLOPT CNotifyEventQueue: public CEvents
     SnmpSocket           m_notify_fd6;
     UdpAddress           m_notify_addr6;
     int                  m_listen_port6;
+    bool                 m_reuse_port;
     EventListHolder *my_holder;
     Snmp *m_snmpSession;
     UdpAddress m_notify_addr;
+    SnmpRecvBatchPool m_recvBatches;
 };
 
 #ifdef SNMP_PP_NAMESPACE
@@ -77,7 +77,8 @@ char OctetStr::nonprintable_char = '.';
 
 //============[ constructor using no arguments ]======================
 OctetStr::OctetStr()
-  : output_buffer(0), output_buffer_len(0), m_changed(true), validity(true)
+  : output_buffer(0), output_buffer_len(0), m_changed(true), validity(true),
+    m_capacity(0)
 {
   smival.syntax = sNMP_SYNTAX_OCTETS;
   smival.value.string.ptr = 0;
@@ -86,7 +87,8 @@ OctetStr::OctetStr()
 
 //============[ constructor using a  string ]=========================
 OctetStr::OctetStr(const char *str)
-  : output_buffer(0), output_buffer_len(0), m_changed(true), validity(true)
+  : output_buffer(0), output_buffer_len(0), m_changed(true), validity(true),
+    m_capacity(0)
 {
   smival.syntax = sNMP_SYNTAX_OCTETS;
   smival.value.string.ptr = 0;
@@ -99,9 +101,7 @@ OctetStr::OctetStr(const char *str)
     return;
 
   // get mem needed
-  smival.value.string.ptr = (SmiLPBYTE) new unsigned char[z];
-
-  if (smival.value.string.ptr)
+  if (alloc_data(z))
   {
     MEMCPY(smival.value.string.ptr, str, z);
     smival.value.string.len = SAFE_INT_CAST(z);
@@ -113,7 +113,8 @@ OctetStr::OctetStr(const char *str)
 
 //============[ constructor using an unsigned char * ]================
 OctetStr::OctetStr(const unsigned char *str, unsigned long len)
-  : output_buffer(0), output_buffer_len(0), m_changed(true), validity(true)
+  : output_buffer(0), output_buffer_len(0), m_changed(true), validity(true),
+    m_capacity(0)
 {
   smival.syntax = sNMP_SYNTAX_OCTETS;
   smival.value.string.ptr = 0;
@@ -122,9 +123,7 @@ OctetStr::OctetStr(const unsigned char *str, unsigned long len)
   if (!str || !len)  return;   // check for zero len
 
   // get the mem needed
-  smival.value.string.ptr = (SmiLPBYTE) new unsigned char[len];
-
-  if (smival.value.string.ptr)
+  if (alloc_data(len))
   {
     MEMCPY(smival.value.string.ptr, str, (size_t) len);
     smival.value.string.len = len;
@@ -135,7 +134,8 @@ OctetStr::OctetStr(const unsigned char *str, unsigned long len)
 
 //============[ constructor using another octet object ]==============
 OctetStr::OctetStr (const OctetStr &octet)
-  : output_buffer(0), output_buffer_len(0), m_changed(true), validity(true)
+  : output_buffer(0), output_buffer_len(0), m_changed(true), validity(true),
+    m_capacity(0)
 {
   smival.syntax = sNMP_SYNTAX_OCTETS;
   smival.value.string.ptr = 0;
@@ -151,9 +151,7 @@ OctetStr::OctetStr (const OctetStr &octet)
   }
 
   // get the mem needed
-  smival.value.string.ptr = (SmiLPBYTE) new unsigned char[octet.smival.value.string.len];
-
-  if (smival.value.string.ptr)
+  if (alloc_data(octet.smival.value.string.len))
   {
     MEMCPY(smival.value.string.ptr,
 	   octet.smival.value.string.ptr,
@@ -164,13 +162,23 @@ OctetStr::OctetStr (const OctetStr &octet)
     validity = false;
 }
 
+//============[ move constructor ]====================================
+OctetStr::OctetStr(OctetStr &&octet)
+  : output_buffer(0), output_buffer_len(0), m_changed(true), validity(true),
+    m_capacity(0)
+{
+  smival.syntax = sNMP_SYNTAX_OCTETS;
+  smival.value.string.ptr = 0;
+  smival.value.string.len = 0;
+
+  *this = static_cast<OctetStr&&>(octet);
+}
+
 //=============[ destructor ]=========================================
 OctetStr::~OctetStr()
 {
   // if not empty, free it up
-  if (smival.value.string.ptr) delete [] smival.value.string.ptr;
-  smival.value.string.len = 0;
-  smival.value.string.ptr = 0;
+  free_data();
   if (output_buffer)           delete [] output_buffer;
   output_buffer = 0;
   output_buffer_len = 0;
@@ -180,28 +188,20 @@ OctetStr::~OctetStr()
 //============[ set the data on an already constructed Octet ]============
 void OctetStr::set_data(const unsigned char *str, unsigned long len)
 {
-  // free up already used space
-  if (smival.value.string.ptr)
-  {
-    delete [] smival.value.string.ptr;
-    smival.value.string.ptr = 0;
-  }
-  smival.value.string.len = 0;
   m_changed = true;
 
   // check for zero len
   if (!str || !len)
   {
+    free_data();
     validity = true;
     return;
   }
 
-  // get the mem needed
-  smival.value.string.ptr = (SmiLPBYTE) new unsigned char[len];
-
-  if (smival.value.string.ptr)
+  // get the mem needed, the current buffer is reused if large enough
+  if (alloc_data(len))
   {
-    MEMCPY(smival.value.string.ptr, str, len);
+    memmove(smival.value.string.ptr, str, len);
     smival.value.string.len = len;
     validity = true;
   }
@@ -212,36 +212,7 @@ void OctetStr::set_data(const unsigned char *str, unsigned long len)
 //=============[ assignment to a string operator overloaded ]=========
 OctetStr& OctetStr::operator=(const char *str)
 {
-  size_t nz;
-
-  // free up previous memory if needed
-  if (smival.value.string.ptr)
-  {
-    delete [] smival.value.string.ptr;
-    smival.value.string.ptr = 0;
-    smival.value.string.len = 0;
-  }
-
-  m_changed = true;
-
-  // if empty then we are done; get the string size
-  if (!str || !((nz = strlen(str))))
-  {
-    validity = true;
-    return *this;
-  }
-
-  // get memory needed
-  smival.value.string.ptr = (SmiLPBYTE) new unsigned char[nz];
-
-  if (smival.value.string.ptr)
-  {
-    MEMCPY(smival.value.string.ptr, str, nz);
-    smival.value.string.len = SAFE_INT_CAST(nz);
-    validity = true;
-  }
-  else
-    validity = false;
+  set_data((const unsigned char *)str, str ? strlen(str) : 0);
 
   return *this;	     // return self reference
 }
@@ -258,6 +229,35 @@ OctetStr& OctetStr::operator=(const OctetStr &octet)
   return *this;		       // return self reference
 }
 
+//=============[ move assignment ]====================================
+// take over the heap buffer of the source, short strings are copied
+OctetStr& OctetStr::operator=(OctetStr &&octet)
+{
+  if (this == &octet)  return *this; // protect against assignment from self
+
+  if (!octet.validity) return *this; // don't assign from invalid objs
+
+  if (octet.smival.value.string.ptr &&
+      (octet.smival.value.string.ptr != octet.iv_inline_data))
+  {
+    free_data();
+    smival.value.string = octet.smival.value.string;
+    m_capacity = octet.m_capacity;
+    octet.smival.value.string.ptr = 0;
+    octet.smival.value.string.len = 0;
+    octet.m_capacity = 0;
+    octet.m_changed = true;
+    m_changed = true;
+    validity = true;
+  }
+  else
+  {
+    set_data(octet.smival.value.string.ptr, octet.smival.value.string.len);
+    octet.free_data();
+  }
+  return *this;
+}
+
 //==============[ equivlence operator overloaded ]====================
 int operator==(const OctetStr &lhs, const OctetStr &rhs)
 {
@@ -363,85 +363,30 @@ int operator>=(const OctetStr &lhs, const char *rhs)
 //===============[ append operator, appends a string ]================
 OctetStr& OctetStr::operator+=(const char *a)
 {
-  unsigned char *tmp;
-  size_t slen, nlen;
+  size_t slen;
 
   // get len of string
   if (!a || ((slen = strlen(a)) == 0))
     return *this;
 
-  nlen = slen + (size_t) smival.value.string.len;  // total len of new octet
-  tmp = (SmiLPBYTE) new unsigned char[nlen];  // get mem needed
-
-  if (tmp)
-  {
-    // copy in the original 1st
-    MEMCPY(tmp, smival.value.string.ptr, smival.value.string.len);
-    // copy in the string
-    MEMCPY(tmp + smival.value.string.len, a, slen);
-    // delete the original
-    if (smival.value.string.ptr)
-      delete [] smival.value.string.ptr;
-    // point to the new one
-    smival.value.string.ptr = tmp;
-    smival.value.string.len = SAFE_INT_CAST(nlen);
-
-    m_changed = true;
-  }
+  append((const unsigned char *)a, SAFE_INT_CAST(slen));
   return *this;
 }
 
 //================[ append one OctetStr to another ]==================
 OctetStr& OctetStr::operator+=(const OctetStr& octet)
 {
-  unsigned char *tmp;
-  size_t slen, nlen;
-
-  if (!octet.validity || !((slen = (size_t)octet.len())))
+  if (!octet.validity || !octet.len())
     return *this;
 
-  nlen = slen + (size_t) smival.value.string.len;  // total len of new octet
-  tmp = (SmiLPBYTE) new unsigned char[nlen];  // get mem needed
-
-  if (tmp)
-  {
-    // copy in the original 1st
-    MEMCPY(tmp, smival.value.string.ptr, smival.value.string.len);
-    // copy in the string
-    MEMCPY(tmp + smival.value.string.len, octet.data(), slen);
-    // delete the original
-    if (smival.value.string.ptr )
-      delete [] smival.value.string.ptr;
-    // point to the new one
-    smival.value.string.ptr = tmp;
-    smival.value.string.len = SAFE_INT_CAST(nlen);
-
-    m_changed = true;
-  }
+  append(octet.data(), octet.len());
   return *this;
 }
 
 //================[ appends a char ]==================================
 OctetStr& OctetStr::operator+=(const unsigned char c)
 {
-  unsigned char *tmp;
-
-  // get the memory needed plus one extra byte
-  tmp = (SmiLPBYTE) new unsigned char[smival.value.string.len + 1];
-
-  if (tmp)
-  {
-    MEMCPY(tmp, smival.value.string.ptr, smival.value.string.len);
-    tmp[smival.value.string.len] = c; 	// assign in new byte
-
-    if (smival.value.string.ptr)	// delete the original
-      delete [] smival.value.string.ptr;
-
-    smival.value.string.ptr = tmp;	// point to new one
-    smival.value.string.len++;	   	// up the len
-
-    m_changed = true;
-  }
+  append(&c, 1);
   return *this;		   		  // return self reference
 }
 
@@ -593,12 +538,7 @@ SnmpSyntax& OctetStr::operator=(const SnmpSyntax &val)
   if (this == &val) return *this;  // protect against assignment from self
 
   // blow away the old value
-  if (smival.value.string.ptr)
-  {
-    delete [] smival.value.string.ptr;
-    smival.value.string.ptr = 0;
-  }
-  smival.value.string.len = 0;
+  free_data();
   validity = false;
 
   if (val.valid()){
@@ -811,32 +751,33 @@ bool OctetStr::set_linefeed_chars(const char* lf_chars)
 //===============[ append or shorten the data buffer ]================
 bool OctetStr::set_len(const unsigned long new_len)
 {
-  unsigned char *tmp;
-
   if (new_len <= smival.value.string.len)
   {
     smival.value.string.len = new_len;
     m_changed = true;
 
     if (new_len == 0)
-    {
-      if (smival.value.string.ptr) delete [] smival.value.string.ptr;
-      smival.value.string.ptr = 0;
-    }
+      free_data();
 
     return true;
   }
 
-  tmp = (SmiLPBYTE) new unsigned char[new_len];  // get mem needed
-
-  if (!tmp) return false;
+  unsigned long old_len = smival.value.string.len;
 
-  if (smival.value.string.ptr)
-    MEMCPY(tmp, smival.value.string.ptr, smival.value.string.len);
-  memset(tmp + smival.value.string.len, 0, new_len - smival.value.string.len);
-  if (smival.value.string.ptr)
-    delete [] smival.value.string.ptr;
-  smival.value.string.ptr = tmp;
+  if (new_len > capacity())
+  {
+    unsigned char *tmp = (new_len <= OCTETSTR_INLINE_LEN)
+                       ? iv_inline_data
+                       : (SmiLPBYTE) new unsigned char[new_len];
+    if (!tmp) return false;
+
+    if (old_len)
+      MEMCPY(tmp, smival.value.string.ptr, old_len);
+    free_data();
+    smival.value.string.ptr = tmp;
+    m_capacity = (tmp != iv_inline_data) ? new_len : 0;
+  }
+  memset(smival.value.string.ptr + old_len, 0, new_len - old_len);
   smival.value.string.len = new_len;
 
   m_changed = true;
@@ -844,6 +785,69 @@ bool OctetStr::set_len(const unsigned long new_len)
   return true;
 }
 
+//===============[ manage the data buffer ]===========================
+// Strings of up to OCTETSTR_INLINE_LEN bytes are stored in the object
+bool OctetStr::alloc_data(const unsigned long len)
+{
+  // reuse the current buffer if it is large enough
+  if (!smival.value.string.ptr || (len > capacity()))
+  {
+    free_data();
+
+    if (len <= OCTETSTR_INLINE_LEN)
+      smival.value.string.ptr = iv_inline_data;
+    else
+    {
+      smival.value.string.ptr = (SmiLPBYTE) new unsigned char[len];
+      m_capacity = len;
+    }
+  }
+  smival.value.string.len = 0;
+  m_changed = true;
+  return (smival.value.string.ptr != 0);
+}
+
+void OctetStr::free_data()
+{
+  if (smival.value.string.ptr)
+  {
+    if (smival.value.string.ptr != iv_inline_data)
+      delete [] smival.value.string.ptr;
+    smival.value.string.ptr = 0;
+  }
+  smival.value.string.len = 0;
+  m_capacity = 0;
+  m_changed = true;
+}
+
+void OctetStr::append(const unsigned char *str, const unsigned long len)
+{
+  unsigned long old_len = smival.value.string.len;
+  unsigned long new_len = old_len + len;
+
+  if (!smival.value.string.ptr || (new_len > capacity()))
+  {
+    // a new buffer, str is still valid while copying
+    unsigned char *tmp = (new_len <= OCTETSTR_INLINE_LEN)
+                       ? iv_inline_data
+                       : (SmiLPBYTE) new unsigned char[new_len];
+    if (!tmp) return;
+
+    if (old_len)
+      MEMCPY(tmp, smival.value.string.ptr, old_len);
+    MEMCPY(tmp + old_len, str, len);
+    if (smival.value.string.ptr && (smival.value.string.ptr != iv_inline_data))
+      delete [] smival.value.string.ptr;
+    smival.value.string.ptr = tmp;
+    m_capacity = (tmp != iv_inline_data) ? new_len : 0;
+  }
+  else
+    MEMCPY(smival.value.string.ptr + old_len, str, len);
+
+  smival.value.string.len = new_len;
+  m_changed = true;
+}
+
 
 
 #ifdef SNMP_PP_NAMESPACE
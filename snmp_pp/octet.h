@@ -65,6 +65,8 @@
 namespace Snmp_pp {
 #endif
 
+#define OCTETSTR_INLINE_LEN 32  // strings up to this length need no heap memory
+
 //------------[ SNMP++ OCTETSTR CLASS DEF  ]-----------------------------
 class DLLOPT OctetStr: public  SnmpSyntax
 {
@@ -112,6 +114,13 @@ class DLLOPT OctetStr: public  SnmpSyntax
    */
   OctetStr(const OctetStr &octet);
 
+  /**
+   * Move constructor, the source OctetStr is empty afterwards.
+   *
+   * @param octet - Value for the new object
+   */
+  OctetStr(OctetStr &&octet);
+
   /**
    * Destructor, frees allocated space.
    */
@@ -129,6 +138,11 @@ class DLLOPT OctetStr: public  SnmpSyntax
    */
   OctetStr& operator=(const OctetStr &octet);
 
+  /**
+   * Move a OctetStr to a OctetStr, the source is empty afterwards.
+   */
+  OctetStr& operator=(OctetStr &&octet);
+
   /**
    * Equal operator for two OctetStr.
    */
@@ -243,6 +257,14 @@ class DLLOPT OctetStr: public  SnmpSyntax
    */
   SnmpSyntax *clone() const { return (SnmpSyntax *) new OctetStr(*this); };
 
+  /**
+   * Clone a short string into memory of the caller, see
+   * SnmpSyntax::clone_into(). Longer strings are not cloned.
+   */
+  SnmpSyntax *clone_into(void *buf, const size_t size) const
+    { return ((sizeof(OctetStr) <= size) && fits_inline())
+                                ? new (buf) OctetStr(*this) : 0; };
+
   /**
    * Map other SnmpSyntax objects to OctetStr.
    */
@@ -374,6 +396,39 @@ class DLLOPT OctetStr: public  SnmpSyntax
 
 
   bool validity;		         // validity boolean
+  unsigned long m_capacity;              // bytes in the heap buffer
+  unsigned char iv_inline_data[OCTETSTR_INLINE_LEN]; // value of short strings
+
+  /**
+   * Make room for len bytes. The current value is lost and the length
+   * is set to zero.
+   *
+   * @return false if no memory could be allocated
+   */
+  bool alloc_data(const unsigned long len);
+
+  /**
+   * Free the value, the string is empty afterwards.
+   */
+  void free_data();
+
+  /**
+   * Append len bytes to the value, str may point into the value.
+   */
+  void append(const unsigned char *str, const unsigned long len);
+
+  /**
+   * Get the number of bytes that fit into the current buffer.
+   */
+  unsigned long capacity() const
+    { return (smival.value.string.ptr == iv_inline_data)
+                            ? OCTETSTR_INLINE_LEN : m_capacity; };
+
+  /**
+   * Check if the value of a copy needs no heap memory.
+   */
+  bool fits_inline() const
+    { return (smival.value.string.len <= OCTETSTR_INLINE_LEN); };
 
   static enum OutputType hex_output_type;
   static char nonprintable_char;
@@ -433,6 +488,14 @@ class OpaqueStr: public OctetStr
   OpaqueStr(const OpaqueStr& opaque) : OctetStr(opaque)
     { smival.syntax = sNMP_SYNTAX_OPAQUE; };
 
+  /**
+   * Move constructor, the source OpaqueStr is empty afterwards.
+   *
+   * @param opaque - Value for the new object
+   */
+  OpaqueStr(OpaqueStr &&opaque) : OctetStr(static_cast<OctetStr&&>(opaque))
+    { smival.syntax = sNMP_SYNTAX_OPAQUE; };
+
   /**
    * Clone this object.
    *
@@ -440,6 +503,14 @@ class OpaqueStr: public OctetStr
    */
   virtual SnmpSyntax *clone() const { return new OpaqueStr(*this); }
 
+  /**
+   * Clone a short string into memory of the caller, see
+   * SnmpSyntax::clone_into(). Longer strings are not cloned.
+   */
+  virtual SnmpSyntax *clone_into(void *buf, const size_t size) const
+    { return ((sizeof(OpaqueStr) <= size) && fits_inline())
+                                ? new (buf) OpaqueStr(*this) : 0; };
+
   /**
    * Return the syntax.
    *
@@ -73,6 +73,7 @@ namespace Snmp_pp {
 
 #define  SNMPBUFFSIZE 11          // size of scratch buffer
 #define  SNMPCHARSIZE 11          // an individual oid instance as a string
+#define  SNMPTEMPSIZE 128         // subids parsed without heap memory
 
 /* Borlands isdigit has a bug */
 #ifdef __BCPLUSPLUS__
@@ -85,7 +86,8 @@ namespace Snmp_pp {
 // constructor using no arguments
 // initialize octet ptr and string
 // ptr to null
-Oid::Oid() : iv_str(0), iv_part_str(0), m_changed(true)
+Oid::Oid()
+  : iv_str(0), iv_part_str(0), m_changed(true), m_capacity(0)
 {
   smival.syntax = sNMP_SYNTAX_OID;
   smival.value.oid.len = 0;
@@ -98,7 +100,7 @@ Oid::Oid() : iv_str(0), iv_part_str(0), m_changed(true)
 //
 // do a string to oid using the string passed in
 Oid::Oid(const char *oid_string, const bool is_dotted_oid_string)
-  : iv_str(0), iv_part_str(0), m_changed(true)
+  : iv_str(0), iv_part_str(0), m_changed(true), m_capacity(0)
 {
   smival.syntax = sNMP_SYNTAX_OID;
   smival.value.oid.len = 0;
@@ -116,7 +118,7 @@ Oid::Oid(const char *oid_string, const bool is_dotted_oid_string)
 //
 // do an oid copy using the oid object passed in
 Oid::Oid(const Oid &oid)
-  : iv_str(0), iv_part_str(0), m_changed(true)
+  : iv_str(0), iv_part_str(0), m_changed(true), m_capacity(0)
 {
   smival.syntax = sNMP_SYNTAX_OID;
   smival.value.oid.len = 0;
@@ -126,19 +128,33 @@ Oid::Oid(const Oid &oid)
   // in this case the size to allocate is the same size as the source oid
   if (oid.smival.value.oid.len)
   {
-    smival.value.oid.ptr = (SmiLPUINT32) new unsigned long[oid.smival.value.oid.len];
-    if (smival.value.oid.ptr)
+    if (alloc_oid_ptr(oid.smival.value.oid.len))
       OidCopy((SmiLPOID)&(oid.smival.value.oid), (SmiLPOID)&smival.value.oid);
   }
 }
 
 
+//=============[Oid::Oid(Oid &&oid) ]=====================================
+// move constructor
+//
+// take over the heap buffer of the source, inline values are copied
+Oid::Oid(Oid &&oid)
+  : iv_str(0), iv_part_str(0), m_changed(true), m_capacity(0)
+{
+  smival.syntax = sNMP_SYNTAX_OID;
+  smival.value.oid.len = 0;
+  smival.value.oid.ptr = 0;
+
+  *this = static_cast<Oid&&>(oid);
+}
+
+
 //=============[Oid::Oid(const unsigned long *raw_oid, int oid_len) ]====
 // constructor using raw numeric form
 //
 // copy the integer values into the private member
 Oid::Oid(const unsigned long *raw_oid, int oid_len)
-  : iv_str(0), iv_part_str(0), m_changed(true)
+  : iv_str(0), iv_part_str(0), m_changed(true), m_capacity(0)
 {
   smival.syntax = sNMP_SYNTAX_OID;
   smival.value.oid.len = 0;
@@ -146,12 +162,12 @@ Oid::Oid(const unsigned long *raw_oid, int oid_len)
 
   if (raw_oid && (oid_len > 0))
   {
-    smival.value.oid.ptr = (SmiLPUINT32) new unsigned long[oid_len];
-    if (smival.value.oid.ptr)
+    if (alloc_oid_ptr(oid_len))
     {
       smival.value.oid.len = oid_len;
-      for (int i=0; i < oid_len; i++)
-        smival.value.oid.ptr[i] = raw_oid[i];
+      MEMCPY((SmiLPBYTE) smival.value.oid.ptr,
+             (SmiLPBYTE) raw_oid,
+             (size_t) (oid_len*sizeof(SmiUINT32)));
     }
   }
 }
@@ -190,20 +206,48 @@ Oid& Oid::operator=(const Oid &oid)
 {
   if (this == &oid) return *this;  // protect against assignment from self
 
-  delete_oid_ptr();
-
   // check for zero len on source
   if (oid.smival.value.oid.len == 0)
+  {
+    delete_oid_ptr();
     return *this;
+  }
 
-  // allocate some memory for the oid
-  smival.value.oid.ptr = (SmiLPUINT32) new unsigned long[oid.smival.value.oid.len];
-  if (smival.value.oid.ptr)
+  // allocate some memory for the oid, if the current is too small
+  if (alloc_oid_ptr(oid.smival.value.oid.len))
     OidCopy((SmiLPOID)&(oid.smival.value.oid), (SmiLPOID)&smival.value.oid);
   return *this;
 }
 
 
+//=============[Oid:: operator = Oid &&oid ]===============================
+// move assignment
+//
+// take over the heap buffer of the source, inline values are copied
+Oid& Oid::operator=(Oid &&oid)
+{
+  if (this == &oid) return *this;  // protect against assignment from self
+
+  if (oid.smival.value.oid.ptr &&
+      (oid.smival.value.oid.ptr != oid.iv_inline_oid))
+  {
+    delete_oid_ptr();
+    smival.value.oid = oid.smival.value.oid;
+    m_capacity = oid.m_capacity;
+    oid.smival.value.oid.ptr = 0;
+    oid.smival.value.oid.len = 0;
+    oid.m_capacity = 0;
+    oid.m_changed = true;
+  }
+  else
+  {
+    *this = (const Oid &)oid;
+    oid.delete_oid_ptr();
+  }
+  return *this;
+}
+
+
 //==============[Oid:: operator += const char *a ]=========================
 // append operator, appends a string
 //
@@ -215,28 +259,16 @@ Oid& Oid::operator=(const Oid &oid)
 // delete allocated space
 Oid& Oid::operator+=(const char *a)
 {
-  unsigned int n;
-
   if (!a) return *this;
 
   if (*a == '.') ++a;
+  if (!*a) return *this;
 
-  n = (smival.value.oid.len * SNMPCHARSIZE) + (smival.value.oid.len)
-       + 1 + SAFE_UINT_CAST(strlen(a));
-  char *ptr = new char[n];
-  if (ptr)
-  {
-    /// @todo optimze this function (avoid conversion to string)
-    OidToStr(&smival.value.oid, n, ptr);
-    if (ptr[0])
-      STRCAT(ptr,".");
-    STRCAT(ptr,a);
-
-    delete_oid_ptr();
-
-    StrToOid(ptr, &smival.value.oid);
-    delete [] ptr;
-  }
+  Oid other(a);
+  if (other.valid())
+    (*this) += other;
+  else
+    delete_oid_ptr();  // an invalid string makes the Oid invalid
   return *this;
 }
 
@@ -316,13 +348,11 @@ int operator>=(const Oid &x,const char *dotted_oid_string)
 void Oid::set_data(const unsigned long *raw_oid,
                    const unsigned int oid_len)
 {
-  if (smival.value.oid.len < oid_len)
+  if (oid_len > capacity())
   {
-    delete_oid_ptr();
-
-    smival.value.oid.ptr = (SmiLPUINT32) new unsigned long[oid_len];
-    if (!smival.value.oid.ptr) return;
+    if (!alloc_oid_ptr(oid_len)) return;
   }
+
   MEMCPY((SmiLPBYTE) smival.value.oid.ptr,
          (SmiLPBYTE) raw_oid,
          (size_t) (oid_len*sizeof(SmiUINT32)));
@@ -333,12 +363,9 @@ void Oid::set_data(const unsigned long *raw_oid,
 // Set the data from raw form.
 void Oid::set_data(const char *str, const unsigned int str_len)
 {
-  if (smival.value.oid.len < str_len)
+  if (str_len > capacity())
   {
-    delete_oid_ptr();
-
-    smival.value.oid.ptr = (SmiLPUINT32) new unsigned long[str_len];
-    if (!smival.value.oid.ptr) return;
+    if (!alloc_oid_ptr(str_len)) return;
   }
 
   if ((!str) || (str_len == 0))
@@ -389,11 +416,27 @@ Oid& Oid::operator+=(const unsigned long i)
 Oid& Oid::operator+=(const Oid &o)
 {
   SmiLPUINT32 new_oid;
+  unsigned long new_len = smival.value.oid.len + o.smival.value.oid.len;
 
   if (o.smival.value.oid.len == 0)
     return *this;
 
-  new_oid = (SmiLPUINT32) new unsigned long[smival.value.oid.len + o.smival.value.oid.len];
+  if (smival.value.oid.ptr && (new_len <= capacity()))
+  {
+    // append in place
+    MEMCPY((SmiLPBYTE) &smival.value.oid.ptr[smival.value.oid.len],
+           (SmiLPBYTE) o.smival.value.oid.ptr,
+           (size_t) (o.smival.value.oid.len*sizeof(SmiUINT32)));
+
+    smival.value.oid.len = new_len;
+    m_changed = true;
+    return *this;
+  }
+
+  if (new_len <= OID_INLINE_LEN)
+    new_oid = iv_inline_oid;
+  else
+    new_oid = (SmiLPUINT32) new unsigned long[new_len];
   if (new_oid == 0)
   {
     delete_oid_ptr();
@@ -401,22 +444,21 @@ Oid& Oid::operator+=(const Oid &o)
   }
 
   if (smival.value.oid.ptr)
-  {
     MEMCPY((SmiLPBYTE) new_oid,
            (SmiLPBYTE) smival.value.oid.ptr,
            (size_t) (smival.value.oid.len*sizeof(SmiUINT32)));
 
-    delete [] smival.value.oid.ptr;
-  }
-
-  // out with the old, in with the new...
-  smival.value.oid.ptr = new_oid;
-
+  // o may be this Oid, so free the old values after copying it
   MEMCPY((SmiLPBYTE) &new_oid[smival.value.oid.len],
          (SmiLPBYTE) o.smival.value.oid.ptr,
          (size_t) (o.smival.value.oid.len*sizeof(SmiUINT32)));
 
-  smival.value.oid.len += o.smival.value.oid.len;
+  // out with the old, in with the new...
+  if (smival.value.oid.ptr && (smival.value.oid.ptr != iv_inline_oid))
+    delete [] smival.value.oid.ptr;
+  smival.value.oid.ptr = new_oid;
+  smival.value.oid.len = new_len;
+  m_capacity = (new_oid != iv_inline_oid) ? new_len : 0;
 
   m_changed = true;
   return *this;
@@ -483,6 +525,7 @@ int Oid::StrToOid(const char *str, SmiLPOID dstOid) const
   unsigned int index = 0;
 
   // make a temp buffer to copy the data into first
+  SmiUINT32 stack_temp[SNMPTEMPSIZE];
   SmiLPUINT32 temp;
   unsigned int nz;
 
@@ -496,7 +539,10 @@ int Oid::StrToOid(const char *str, SmiLPOID dstOid) const
     dstOid->ptr = 0;
     return -1;
   }
-  temp = (SmiLPUINT32) new unsigned long[nz];
+  if (nz <= SNMPTEMPSIZE)
+    temp = stack_temp;
+  else
+    temp = (SmiLPUINT32) new unsigned long[nz];
 
   if (temp == 0) return -1;   // return if can't get the mem
 
@@ -520,7 +566,7 @@ int Oid::StrToOid(const char *str, SmiLPOID dstOid) const
       // there must be a dot or end of string now
       if ((*str) && (*str != '.'))
       {
-        delete [] temp;
+        if (temp != stack_temp) delete [] temp;
         return -1;
       }
     }
@@ -531,7 +577,7 @@ int Oid::StrToOid(const char *str, SmiLPOID dstOid) const
       // found String -> converting it into an oid
       if (*str != '$')
       {
-        delete [] temp;
+        if (temp != stack_temp) delete [] temp;
         return -1;
       }
 
@@ -548,7 +594,7 @@ int Oid::StrToOid(const char *str, SmiLPOID dstOid) const
 
       if (*str != '$')
       {
-        delete [] temp;
+        if (temp != stack_temp) delete [] temp;
         return -1;
       }
 
@@ -558,18 +604,21 @@ int Oid::StrToOid(const char *str, SmiLPOID dstOid) const
       // there must be a dot or end of string now
       if ((*str) && (*str != '.'))
       {
-        delete [] temp;
+        if (temp != stack_temp) delete [] temp;
         return -1;
       }
     }
   }
 
-  // get some space for the real oid
-  dstOid->ptr = (SmiLPUINT32) new unsigned long[index];
+  // get some space for the real oid, our own value may be inline
+  if (dstOid == &smival.value.oid)
+    PP_CONST_CAST(Oid*, this)->alloc_oid_ptr(index);
+  else
+    dstOid->ptr = (SmiLPUINT32) new unsigned long[index];
   // return if can't get the mem needed
   if(dstOid->ptr == 0)
   {
-    delete [] temp;
+    if (temp != stack_temp) delete [] temp;
     return -1;
   }
 
@@ -582,7 +631,7 @@ int Oid::StrToOid(const char *str, SmiLPOID dstOid) const
   dstOid->len = index;
 
   // free up temp data
-  delete [] temp;
+  if (temp != stack_temp) delete [] temp;
 
   return (int) index;
 }
@@ -636,14 +685,16 @@ int Oid::nCompare(const unsigned long n,
     reduced_len = true;
   }
 
-  unsigned long z = 0;
-  while (z < length)
+  // memcmp() checks for equality many bytes at a time, only on a
+  // difference the subids are compared one by one
+  const SmiUINT32 *a = smival.value.oid.ptr;
+  const SmiUINT32 *b = o.smival.value.oid.ptr;
+  if (length && memcmp(a, b, length * sizeof(SmiUINT32)))
   {
-    if (smival.value.oid.ptr[z] < o.smival.value.oid.ptr[z])
-      return -1;                              // less than
-    if (smival.value.oid.ptr[z] > o.smival.value.oid.ptr[z])
-      return 1;                               // greater than
-    ++z;
+    unsigned long z = 0;
+    while (a[z] == b[z])
+      ++z;
+    return (a[z] < b[z]) ? -1 : 1;
   }
 
   // if we truncated the len then these may not be equal
@@ -655,6 +706,19 @@ int Oid::nCompare(const unsigned long n,
   return 0;                                 // equal
 }
 
+//===============[Oid::in_subtree_of(Oid) ]===============================
+// check if root is a prefix of this oid
+bool Oid::in_subtree_of(const Oid &root) const
+{
+  if (smival.value.oid.len < root.smival.value.oid.len)
+    return false;
+  if (root.smival.value.oid.len == 0)
+    return true;
+
+  return (memcmp(smival.value.oid.ptr, root.smival.value.oid.ptr,
+                 root.smival.value.oid.len * sizeof(SmiUINT32)) == 0);
+}
+
 //================[Oid::OidToStr ]=========================================
 // convert an oid to a string
 int Oid::OidToStr(const SmiOID *srcOid,
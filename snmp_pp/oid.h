@@ -69,6 +69,7 @@
 namespace Snmp_pp {
 #endif
 
+#define OID_INLINE_LEN 24  // Oids up to this length need no heap memory
 
 /**
  * The Object Identifier Class.
@@ -90,6 +91,9 @@ namespace Snmp_pp {
  *       Oid object is modified. The functions get_printable(len) and
  *       get_printable(start, len) share the same buffer which is
  *       freed and newly allocated for each call.
+ *
+ * @note The values of Oids with up to OID_INLINE_LEN subids are
+ *       stored inside the object, longer Oids are stored on the heap.
  */
 class DLLOPT Oid : public SnmpSyntax
 {
@@ -125,6 +129,13 @@ class DLLOPT Oid : public SnmpSyntax
    */
   Oid(const Oid &oid);
 
+  /**
+   * Move constructor, the source Oid is invalid afterwards.
+   *
+   * @param oid - Source Oid
+   */
+  Oid(Oid &&oid);
+
   /**
    * Constructor from array.
    *
@@ -157,6 +168,11 @@ class DLLOPT Oid : public SnmpSyntax
    */
   virtual Oid& operator=(const Oid &oid);
 
+  /**
+   * Move one Oid to another, the source Oid is invalid afterwards.
+   */
+  Oid& operator=(Oid &&oid);
+
   /**
    * Return the space needed for serialization.
    */
@@ -324,6 +340,16 @@ class DLLOPT Oid : public SnmpSyntax
    */
   int nCompare(const unsigned long n, const Oid &o) const;
 
+  /**
+   * Check if this Oid is within the subtree of another Oid, that is
+   * if it starts with all subids of the other Oid.
+   *
+   * @param root - The root Oid of the subtree
+   *
+   * @return true if root is a prefix of (or equal to) this Oid
+   */
+  bool in_subtree_of(const Oid &root) const;
+
   /**
    * Return validity of the object.
    */
@@ -426,11 +452,30 @@ class DLLOPT Oid : public SnmpSyntax
    */
   inline void delete_oid_ptr();
 
+  /**
+   * Make room for n subids. The current values are lost and the
+   * length is set to zero.
+   *
+   * @param n - Number of subids
+   *
+   * @return false if no memory could be allocated
+   */
+  inline bool alloc_oid_ptr(const unsigned long n);
+
+  /**
+   * Get the number of subids that fit into the current buffer.
+   */
+  unsigned long capacity() const
+    { return (smival.value.oid.ptr == iv_inline_oid) ? OID_INLINE_LEN
+                                                     : m_capacity; };
+
   //----[ instance variables ]
 
   SNMP_PP_MUTABLE char *iv_str;      // used for returning complete oid string
   SNMP_PP_MUTABLE char *iv_part_str; // used for returning part oid string
   SNMP_PP_MUTABLE bool m_changed;
+  unsigned long m_capacity;                // subids in the heap buffer
+  SmiUINT32 iv_inline_oid[OID_INLINE_LEN]; // value of short oids
 };
 
 //-----------[ End Oid Class ]-------------------------------------
@@ -443,11 +488,33 @@ inline void Oid::delete_oid_ptr()
   // delete the old value
   if (smival.value.oid.ptr)
   {
-    delete [] smival.value.oid.ptr;
+    if (smival.value.oid.ptr != iv_inline_oid)
+      delete [] smival.value.oid.ptr;
     smival.value.oid.ptr = 0;
   }
   smival.value.oid.len = 0;
+  m_capacity = 0;
+  m_changed = true;
+}
+
+inline bool Oid::alloc_oid_ptr(const unsigned long n)
+{
+  // reuse the current buffer if it is large enough
+  if (!smival.value.oid.ptr || (n > capacity()))
+  {
+    delete_oid_ptr();
+
+    if (n <= OID_INLINE_LEN)
+      smival.value.oid.ptr = iv_inline_oid;
+    else
+    {
+      smival.value.oid.ptr = (SmiLPUINT32) new unsigned long[n];
+      m_capacity = n;
+    }
+  }
+  smival.value.oid.len = 0;
   m_changed = true;
+  return (smival.value.oid.ptr != 0);
 }
 
 #ifdef SNMP_PP_NAMESPACE
@@ -65,11 +65,14 @@ char pdu_cpp_version[]="@(#) SNMP++ $Id$";
 namespace Snmp_pp {
 #endif
 
-#define PDU_INITIAL_SIZE 25
+#define PDU_INITIAL_SIZE 10  // the array holds Vb objects, not pointers
 
 //=====================[ constructor no args ]=========================
 Pdu::Pdu()
-  : vbs(0), vbs_size(0), vb_count(0), error_status(0), error_index(0),
+  : vbs(0), vbs_size(0), vb_count(0),
+    vb_views(0), vb_views_size(0), vb_views_count(0), vb_decoded(0),
+    vb_ber(0), vb_ber_len(0),
+    error_status(0), error_index(0),
     validity(true), request_id(0), pdu_type(0), notify_timestamp(0),
     v1_trap_address_set(false)
 #ifdef _SNMPv3
@@ -81,7 +84,10 @@ Pdu::Pdu()
 
 //=====================[ constructor with vbs and count ]==============
 Pdu::Pdu(Vb* pvbs, const int pvb_count)
-  : vbs(0), vbs_size(0), vb_count(0), error_status(0), error_index(0),
+  : vbs(0), vbs_size(0), vb_count(0),
+    vb_views(0), vb_views_size(0), vb_views_count(0), vb_decoded(0),
+    vb_ber(0), vb_ber_len(0),
+    error_status(0), error_index(0),
     validity(true), request_id(0), pdu_type(0), notify_timestamp(0),
     v1_trap_address_set(false)
 #ifdef _SNMPv3
@@ -91,53 +97,20 @@ Pdu::Pdu(Vb* pvbs, const int pvb_count)
 {
   if (pvb_count == 0) return;    // zero is ok
 
-  vbs = new Vb*[pvb_count];
-  if (vbs)
-    vbs_size = pvb_count;
-  else
-  {
-    vbs_size = 0;
+  // assign internal vbs
+  if (!copy_vbs(pvbs, pvb_count))
     validity = false;
-    return;
-  }
-
-  // loop through and assign internal vbs
-  for (int z = 0; z < pvb_count; ++z)
-  {
-    if (pvbs[z].valid())
-      vbs[z] = new Vb(pvbs[z]);
-    else
-      vbs[z] = 0;
-
-    if ((vbs[z]) && !vbs[z]->valid())
-    {
-      delete vbs[z];
-      vbs[z] = 0;
-    }
-
-    if (vbs[z] == 0)     // check for new fail
-    {
-      for (int y = 0; y < z; ++y) delete vbs[y]; // free vbs
-      validity = false;
-      return;
-    }
-  }
-
-  vb_count = pvb_count;   // assign the vb count
 }
 
 //=====================[ destructor ]====================================
 Pdu::~Pdu()
 {
-  for (int z = 0; z < vb_count; ++z)
-  {
-    delete vbs[z];
-    vbs[z] = 0;
-  }
+  free_views();
+  free_vbs();
 
   if (vbs)
   {
-    delete [] vbs;
+    delete [] (unsigned char *)vbs;
     vbs = 0;
     vbs_size = 0;
   }
@@ -149,72 +122,104 @@ Pdu& Pdu::operator=(const Pdu &pdu)
   if (this == &pdu) return *this; // check for self assignment
 
   // Initialize all mv's
-  error_status      = pdu.error_status;
-  error_index       = pdu.error_index;
-  request_id        = pdu.request_id;
-  pdu_type          = pdu.pdu_type;
-  notify_id         = pdu.notify_id;
-  notify_timestamp  = pdu.notify_timestamp;
-  notify_enterprise = pdu.notify_enterprise;
-#ifdef _SNMPv3
-  security_level    = pdu.security_level;
-  message_id        = pdu.message_id;
-  context_name      = pdu.context_name;
-  context_engine_id = pdu.context_engine_id;
-  maxsize_scopedpdu = pdu.maxsize_scopedpdu;
-#endif
-  if (pdu.v1_trap_address_set)
-  {
-    v1_trap_address = pdu.v1_trap_address;
-    v1_trap_address_set = true;
-  }
-  else
-    v1_trap_address_set = false;
+  copy_members(pdu);
 
   validity = true;
 
   // free up old vbs
-  for (int z = 0; z < vb_count; ++z)  delete vbs[z];
-  vb_count = 0;
+  free_views();
+  free_vbs();
 
   // check for zero case
   if (pdu.vb_count == 0) return *this;
 
   // allocate array
-  if (vbs_size < pdu.vb_count)
+  if (!reserve_vbs(pdu.vb_count))
+  {
+    validity = false;
+    return *this;
+  }
+
+  // copy the encoded vbs, vbs that still have a view are not decoded
+  if (pdu.vb_views_count)
   {
-    delete [] vbs;
-    vbs = new Vb*[pdu.vb_count];
-    if (vbs)
-      vbs_size = pdu.vb_count;
-    else
+    vb_ber = new unsigned char[pdu.vb_ber_len];
+    vb_views = new VbView[pdu.vb_views_count];
+    vb_decoded = new bool[pdu.vb_views_count];
+    if (!vb_ber || !vb_views || !vb_decoded)
     {
-      vbs_size = 0;
+      free_views();
       validity = false;
       return *this;
     }
+    memcpy(vb_ber, pdu.vb_ber, pdu.vb_ber_len);
+    vb_ber_len = pdu.vb_ber_len;
+    vb_views_size = pdu.vb_views_count;
+    for (int v = 0; v < pdu.vb_views_count; ++v)
+    {
+      vb_views[v] = pdu.vb_views[v];
+      vb_views[v].rebase(pdu.vb_ber, vb_ber);
+      vb_decoded[v] = !vb_views[v].valid();
+    }
+    vb_views_count = pdu.vb_views_count;
   }
 
   // loop through and fill em up
   for (int y = 0; y < pdu.vb_count; ++y)
   {
-    vbs[y] = new Vb(*(pdu.vbs[y]));
-
-    if ((vbs[y]) && !vbs[y]->valid())
+    if (is_encoded(y))
     {
-      delete vbs[y];
-      vbs[y] = 0;
+      new (&vbs[y]) Vb;
+      ++vb_count;
+      continue;
     }
 
-    if (!vbs[y])
+    new (&vbs[y]) Vb(pdu.vbs[y]);
+    ++vb_count;
+
+    if (!vbs[y].valid())
     {
-      for (int x = 0; x < y; ++x) delete vbs[x]; // free vbs
+      free_vbs();
+      free_views();
       validity = false;
       return *this;
     }
   }
 
-  vb_count = pdu.vb_count;
+  return *this;
+}
+
+//=====================[ move a Pdu object ]============================
+Pdu& Pdu::operator=(Pdu &&pdu)
+{
+  if (this == &pdu) return *this; // check for self assignment
+
+  copy_members(pdu);
+  validity = pdu.validity;
+
+  // take over the vbs and the encoded vbs
+  free_views();
+  free_vbs();
+  if (vbs)
+    delete [] (unsigned char *)vbs;
+
+  vbs            = pdu.vbs;
+  vbs_size       = pdu.vbs_size;
+  vb_count       = pdu.vb_count;
+  vb_views       = pdu.vb_views;
+  vb_views_size  = pdu.vb_views_size;
+  vb_views_count = pdu.vb_views_count;
+  vb_decoded     = pdu.vb_decoded;
+  vb_ber         = pdu.vb_ber;
+  vb_ber_len     = pdu.vb_ber_len;
+
+  pdu.vbs        = 0;
+  pdu.vb_views   = 0;
+  pdu.vb_decoded = 0;
+  pdu.vb_ber     = 0;
+  pdu.vbs_size = pdu.vb_count = 0;
+  pdu.vb_views_size = pdu.vb_views_count = pdu.vb_ber_len = 0;
+
   return *this;
 }
 
@@ -228,22 +233,33 @@ Pdu& Pdu::operator+=(const Vb &vb)
     if (!extend_vbs()) return *this;
   }
 
-  vbs[vb_count] = new Vb(vb);  // add the new one
+  new (&vbs[vb_count]) Vb(vb);  // add the new one
 
-  if (vbs[vb_count])   // up the vb count on success
+  if (vbs[vb_count].valid())   // up the vb count on success
   {
-    if (vbs[vb_count]->valid())
-    {
-      ++vb_count;
-      validity = true;   // set up validity
-    }
-    else
-    {
-      delete vbs[vb_count];
-      vbs[vb_count] = 0;
-    }
+    ++vb_count;
+    validity = true;   // set up validity
+  }
+  else
+    vbs[vb_count].~Vb();
+
+  return *this;        // return self reference
+}
+
+// append operator, moves a variable binding into the pdu
+Pdu& Pdu::operator+=(Vb &&vb)
+{
+  if (!vb.valid())                return *this; // dont add invalid Vbs
+
+  if (vb_count + 1 > vbs_size)
+  {
+    if (!extend_vbs()) return *this;
   }
 
+  new (&vbs[vb_count]) Vb(static_cast<Vb&&>(vb));  // add the new one
+  ++vb_count;
+  validity = true;   // set up validity
+
   return *this;        // return self reference
 }
 
@@ -256,8 +272,7 @@ int Pdu::get_vblist(Vb* pvbs, const int pvb_count) const
   // loop through all vbs and assign to params
   for (int z = 0; z < pvb_count; ++z)
   {
-    pvbs[z] = *vbs[z];
-    if (!pvbs[z].valid())
+    if (!get_vb(pvbs[z], z))
       return false;
   }
 
@@ -273,8 +288,8 @@ int Pdu::set_vblist(Vb* pvbs, const int pvb_count)
     return false;
 
   // free up current vbs
-  for (int z = 0; z < vb_count; ++z)  delete vbs[z];
-  vb_count = 0;
+  free_views();
+  free_vbs();
 
   // check for zero case
   if (pvb_count == 0)
@@ -286,47 +301,13 @@ int Pdu::set_vblist(Vb* pvbs, const int pvb_count)
     return false;
   }
 
-  // allocate array
-  if (vbs_size < pvb_count)
+  // reassign all vbs
+  if (!copy_vbs(pvbs, pvb_count))
   {
-    delete [] vbs;
-    vbs = new Vb*[pvb_count];
-    if (vbs)
-      vbs_size = pvb_count;
-    else
-    {
-      vbs_size = 0;
-      validity = false;
-      return false;
-    }
-  }
-
-  // loop through all vbs and reassign them
-  for (int y = 0; y < pvb_count; ++y)
-  {
-    if (pvbs[y].valid())
-    {
-      vbs[y] = new Vb(pvbs[y]);
-      if ((vbs[y]) && !vbs[y]->valid())
-      {
-	delete vbs[y];
-	vbs[y] = 0;
-      }
-    }
-    else
-      vbs[y] = 0;
-
-    // check for errors
-    if (!vbs[y])
-    {
-      for (int x = 0; x < y; ++x) delete vbs[x]; // free vbs
-      validity = false;
-      return false;
-    }
+    validity = false;
+    return false;
   }
 
-  vb_count = pvb_count;
-
   // clear error status and index since no longer valid
   // request id may still apply so don't reassign it
   error_status = 0;
@@ -344,38 +325,103 @@ int Pdu::get_vb(Vb &vb, const int index) const
    if (index < 0)         return false; // can't have an index less than 0
    if (index >= vb_count) return false; // can't ask for something not there
 
-   vb = *vbs[index];   // asssign it
+   if (is_encoded(index))
+     return vb_views[index].get_vb(vb);
 
+   vb = vbs[index];   // asssign it
    return vb.valid();
 }
 
-//===================[ set a particular vb ]=============================
-int Pdu::set_vb(Vb &vb, const int index)
+//===================[ deposit encoded Vbs ]============================
+int Pdu::set_vblist_ber(const unsigned char *data, const int len)
 {
-  if (index < 0)         return false; // can't have an index less than 0
-  if (index >= vb_count) return false; // can't ask for something not there
-  if (!vb.valid())       return false; // don't set invalid vbs
-
-  Vb *victim = vbs[index]; // save in case new fails
-  vbs[index] = new Vb(vb);
-  if (vbs[index])
+  // free up current vbs
+  free_views();
+  free_vbs();
+
+  if ((len < 0) || (!data && len)) return false;
+  if (len == 0) return true;
+
+  vb_ber = new unsigned char[len];
+  if (!vb_ber) return false;
+  memcpy(vb_ber, data, len);
+  vb_ber_len = len;
+
+  // a vb needs at least 6 bytes, most need 16 or more
+  unsigned char *ptr = vb_ber;
+  int ptr_len = len;
+  int count = 0;
+  while (ptr_len > 0)
   {
-    if (vbs[index]->valid())
+    if (count == vb_views_size)
     {
-      delete victim;
+      int new_size = vb_views_size ? vb_views_size * 2 : len / 16 + 1;
+      VbView *tmp = new VbView[new_size];
+      if (!tmp)
+      {
+        free_views();
+        return false;
+      }
+      for (int v = 0; v < count; ++v) tmp[v] = vb_views[v];
+      delete [] vb_views;
+      vb_views = tmp;
+      vb_views_size = new_size;
     }
-    else
+
+    ptr = asn_parse_vb_view(ptr, &ptr_len, &vb_views[count].view);
+    if (!ptr)
     {
-      delete vbs[index];
-      vbs[index] = victim;
+      debugprintf(0, "set_vblist_ber: invalid vb at index (%d)", count);
+      free_views();
       return false;
     }
+    ++count;
   }
-  else
+
+  vb_decoded = new bool[count];
+  if (!vb_decoded || !reserve_vbs(count))
   {
-    vbs[index] = victim;
+    free_views();
     return false;
   }
+
+  // the vbs stay empty until they are decoded
+  for (int y = 0; y < count; ++y)
+  {
+    new (&vbs[y]) Vb;
+    vb_decoded[y] = false;
+  }
+
+  vb_count = vb_views_count = count;
+  return true;
+}
+
+//===================[ get a view of an encoded vb ]====================
+int Pdu::get_vb_view(VbView &view, const int index) const
+{
+  if ((index < 0) || (index >= vb_views_count)) return false;
+  if (!vb_views[index].valid())                  return false;
+
+  view = vb_views[index];
+  return true;
+}
+
+//===================[ set a particular vb ]=============================
+int Pdu::set_vb(Vb &vb, const int index)
+{
+  if (index < 0)         return false; // can't have an index less than 0
+  if (index >= vb_count) return false; // can't ask for something not there
+  if (!vb.valid())       return false; // don't set invalid vbs
+
+  Vb copy(vb);             // keep the old vb in case new fails
+  if (!copy.valid())     return false;
+
+  vbs[index] = static_cast<Vb&&>(copy);
+  if (index < vb_views_count)
+  {
+    vb_views[index] = VbView();  // the view is outdated now
+    vb_decoded[index] = true;
+  }
   return true;
 }
 
@@ -391,12 +437,12 @@ int Pdu::trim(const int count)
   {
     if (vb_count > 0)
     {
-      delete vbs[vb_count-1];
-      vbs[vb_count-1] = 0;
+      vbs[vb_count-1].~Vb();
       vb_count--;
     }
     lp--;
   }
+  if (vb_views_count > vb_count) vb_views_count = vb_count;
   return true;
 }
 
@@ -406,10 +452,20 @@ int Pdu::delete_vb(const int p)
   // position has to be in range
   if ((p<0) || (p > vb_count - 1)) return false;
 
-  delete vbs[p];   // safe to remove it
-
   for (int z = p; z < vb_count - 1; ++z)
-    vbs[z] = vbs[z+1];
+    vbs[z] = static_cast<Vb&&>(vbs[z+1]);
+
+  vbs[vb_count-1].~Vb();   // safe to remove the last one
+
+  if (p < vb_views_count)
+  {
+    for (int v = p; v < vb_views_count - 1; ++v)
+    {
+      vb_views[v] = vb_views[v+1];
+      vb_decoded[v] = vb_decoded[v+1];
+    }
+    vb_views_count--;
+  }
 
   vb_count--;
 
@@ -442,7 +498,8 @@ int Pdu::get_asn1_length() const
 
   // length for all vbs
   for (int i = 0; i < vb_count; ++i)
-    length += vbs[i]->get_asn1_length();
+    length += (is_encoded(i) ? vb_views[i].get_ber_len()
+                             : vbs[i].get_asn1_length());
 
   // header for vbs
   if      (length < 0x80)      length += 2;
@@ -487,31 +544,119 @@ int Pdu::get_asn1_length() const
 // extend the vbs array
 bool Pdu::extend_vbs()
 {
-  if (vbs_size == 0)
+  return reserve_vbs(vbs_size ? vbs_size * 2 : PDU_INITIAL_SIZE);
+}
+
+// Make room for count vbs, the array holds the Vb objects themselves,
+// so they are moved to the new array
+bool Pdu::reserve_vbs(const int count)
+{
+  if (count <= vbs_size) return true;
+
+  Vb *tmp = (Vb *) new unsigned char[count * sizeof(Vb)];
+  if (!tmp) return false;
+
+  for (int y = 0; y < vb_count; ++y)
+  {
+    new (&tmp[y]) Vb(static_cast<Vb&&>(vbs[y]));
+    vbs[y].~Vb();
+  }
+  if (vbs)
+    delete [] (unsigned char *)vbs;
+  vbs = tmp;
+  vbs_size = count;
+  return true;
+}
+
+// Append copies of the vbs, all or none
+bool Pdu::copy_vbs(const Vb *pvbs, const int count)
+{
+  int old_count = vb_count;
+
+  if (!reserve_vbs(vb_count + count)) return false;
+
+  for (int z = 0; z < count; ++z)
   {
-    vbs = new Vb*[PDU_INITIAL_SIZE];
-    if (vbs)
+    new (&vbs[vb_count]) Vb(pvbs[z]);
+    ++vb_count;
+
+    if (!vbs[vb_count-1].valid())  // invalid source or new failed
     {
-      vbs_size = PDU_INITIAL_SIZE;
-      return true;
+      while (vb_count > old_count) vbs[--vb_count].~Vb();
+      return false;
     }
-    else
-       return false;
   }
+  return true;
+}
+
+// Destroy the vbs, keep the array
+void Pdu::free_vbs()
+{
+  for (int z = 0; z < vb_count; ++z)  vbs[z].~Vb();
+  vb_count = 0;
+}
 
-  Vb **tmp = vbs;
-  vbs = new Vb*[vbs_size * 2];
-  if (!vbs)
+// Copy all members except the vbs
+void Pdu::copy_members(const Pdu &pdu)
+{
+  error_status      = pdu.error_status;
+  error_index       = pdu.error_index;
+  request_id        = pdu.request_id;
+  pdu_type          = pdu.pdu_type;
+  notify_id         = pdu.notify_id;
+  notify_timestamp  = pdu.notify_timestamp;
+  notify_enterprise = pdu.notify_enterprise;
+#ifdef _SNMPv3
+  security_level    = pdu.security_level;
+  message_id        = pdu.message_id;
+  context_name      = pdu.context_name;
+  context_engine_id = pdu.context_engine_id;
+  maxsize_scopedpdu = pdu.maxsize_scopedpdu;
+#endif
+  if (pdu.v1_trap_address_set)
   {
-    vbs = tmp;
-    return false;
+    v1_trap_address = pdu.v1_trap_address;
+    v1_trap_address_set = true;
   }
+  else
+    v1_trap_address_set = false;
+}
 
-  for (int y = 0; y < vb_count; ++y)
-    vbs[y] = tmp[y];
-  vbs_size *= 2;
-  delete [] tmp;
-  return true;
+// Decode a vb from its view
+Vb *Pdu::decode_vb(const int index) const
+{
+  vb_views[index].get_vb(vbs[index]);
+  vb_decoded[index] = true;
+  return &vbs[index];
+}
+
+// Decode a vb and drop its view
+void Pdu::detach_vb(const int index)
+{
+  if (!vb_decoded[index]) decode_vb(index);
+  vb_views[index] = VbView();
+}
+
+// Free the views and the encoded vbs, the caller frees the vbs
+void Pdu::free_views()
+{
+  if (vb_views)
+  {
+    delete [] vb_views;
+    vb_views = 0;
+  }
+  if (vb_decoded)
+  {
+    delete [] vb_decoded;
+    vb_decoded = 0;
+  }
+  vb_views_size = vb_views_count = 0;
+  if (vb_ber)
+  {
+    delete [] vb_ber;
+    vb_ber = 0;
+  }
+  vb_ber_len = 0;
 }
 
 // Clear all members of the object
@@ -527,8 +672,8 @@ void Pdu::clear()
   v1_trap_address_set = false;
   validity            = true;
 
-  for (int z = 0; z < vb_count; ++z)  delete vbs[z];
-  vb_count = 0;
+  free_views();
+  free_vbs();
 
 #ifdef _SNMPv3
   security_level    = SNMP_SECURITY_LEVEL_NOAUTH_NOPRIV;
@@ -64,13 +64,12 @@
 #include "snmp_pp/timetick.h"
 #include "snmp_pp/octet.h"
 #include "snmp_pp/oid.h"
+#include "snmp_pp/vb.h"
 
 #ifdef SNMP_PP_NAMESPACE
 namespace Snmp_pp {
 #endif
 
-class Vb;
-
 #define PDU_MAX_RID 32767         ///< max request id to use
 #define PDU_MIN_RID 1000          ///< min request id to use
 
@@ -108,7 +107,23 @@ class DLLOPT Pdu
    *
    * @param pdu - source pdu object
    */
-  Pdu(const Pdu &pdu) : vbs(0), vbs_size(0), vb_count(0) { *this = pdu; };
+  Pdu(const Pdu &pdu)
+    : vbs(0), vbs_size(0), vb_count(0),
+      vb_views(0), vb_views_size(0), vb_views_count(0), vb_decoded(0),
+      vb_ber(0), vb_ber_len(0)
+    { *this = pdu; };
+
+  /**
+   * Move constructor, takes over the vbs of the source Pdu, which is
+   * empty afterwards.
+   *
+   * @param pdu - source pdu object
+   */
+  Pdu(Pdu &&pdu)
+    : vbs(0), vbs_size(0), vb_count(0),
+      vb_views(0), vb_views_size(0), vb_views_count(0), vb_decoded(0),
+      vb_ber(0), vb_ber_len(0)
+    { *this = static_cast<Pdu&&>(pdu); };
 
   /**
    * Destructor
@@ -122,6 +137,14 @@ class DLLOPT Pdu
    */
   Pdu& operator=(const Pdu &pdu);
 
+  /**
+   * Move assignment, takes over the vbs of the source Pdu, which is
+   * empty afterwards.
+   *
+   * @param pdu - Pdu that should be moved to this object
+   */
+  Pdu& operator=(Pdu &&pdu);
+
   /**
    * Append a vb to the pdu.
    *
@@ -129,6 +152,14 @@ class DLLOPT Pdu
    */
   Pdu& operator+=(const Vb &vb);
 
+  /**
+   * Append a vb to the pdu, moving its value.
+   *
+   * @param vb - The Vb that should be added (as last vb) to the pdu,
+   *             it is empty afterwards
+   */
+  Pdu& operator+=(Vb &&vb);
+
   /**
    * Clone a Pdu object.
    *
@@ -185,7 +216,8 @@ class DLLOPT Pdu
    * @param index - The Vb to return starting with 0.
    * @return A const reference to the Vb
    */
-  const Vb &get_vb(const int index) const { return *vbs[index]; };
+  const Vb &get_vb(const int index) const
+    { return (is_encoded(index) ? *decode_vb(index) : vbs[index]); };
 
   /**
    * Set a particular vb.
@@ -199,6 +231,33 @@ class DLLOPT Pdu
    */
   int set_vb(Vb &vb, const int index);
 
+  /**
+   * Set the vbs from their BER encoding.
+   *
+   * The current vbs are freed. The encoded vbs are copied and checked
+   * once, but decoded into Vb objects only when they are accessed
+   * (for example through get_vb()). Use get_vb_view() to read them
+   * without decoding.
+   *
+   * @param data - The encoded vbs (the contents of a vb list SEQUENCE)
+   * @param len  - Length of data
+   *
+   * @return TRUE on success, FALSE if the encoding is invalid. The pdu
+   *         has no vbs then.
+   */
+  int set_vblist_ber(const unsigned char *data, const int len);
+
+  /**
+   * Get a view of a vb that was set through set_vblist_ber().
+   *
+   * @param view - Object to store the view
+   * @param index - The vb to get (zero is the first vb)
+   *
+   * @return TRUE if the vb is still the unmodified encoded vb, FALSE
+   *         if it was added or changed through the Vb interface
+   */
+  int get_vb_view(VbView &view, const int index) const;
+
   /**
    * Get the number of vbs.
    *
@@ -213,7 +272,8 @@ class DLLOPT Pdu
    *
    * @param i zero based index
    */
-  Vb& operator[](const int i) { return *vbs[i]; };
+  Vb& operator[](const int i)
+    { if (i < vb_views_count) detach_vb(i); return vbs[i]; };
 
   /**
    * Get the error status.
@@ -329,6 +389,11 @@ class DLLOPT Pdu
   bool get_notify_id(Oid &id) const
     { id = notify_id; return (notify_id.len() == id.len()); };
 
+  /**
+   * Get the notify id.
+   */
+  const Oid &get_notify_id() const { return notify_id; };
+
   /**
    * Set the notify enterprise.
    *
@@ -345,6 +410,11 @@ class DLLOPT Pdu
   bool get_notify_enterprise(Oid & e) const
     { e = notify_enterprise;  return (notify_enterprise.len() == e.len()); };
 
+  /**
+   * Get the notify enterprise.
+   */
+  const Oid &get_notify_enterprise() const { return notify_enterprise; };
+
 #ifdef _SNMPv3
   /**
    * Set the security level that should be used when this Pdu is sent.
@@ -494,9 +564,66 @@ class DLLOPT Pdu
    */
   bool extend_vbs();
 
-  Vb **vbs;                    // pointer to array of Vbs
+  /**
+   * Make room for count vbs, moving the current vbs if needed.
+   *
+   * @return true on success
+   */
+  bool reserve_vbs(const int count);
+
+  /**
+   * Append copies of count vbs, all of them must be valid.
+   *
+   * @return true on success, else no vbs are appended
+   */
+  bool copy_vbs(const Vb *pvbs, const int count);
+
+  /**
+   * Destroy all vbs, the array is kept for reuse.
+   */
+  void free_vbs();
+
+  /**
+   * Copy all members except the vbs.
+   */
+  void copy_members(const Pdu &pdu);
+
+  /**
+   * Check if the vb at index has not been decoded from its view yet.
+   */
+  bool is_encoded(const int index) const
+    { return ((index < vb_views_count) && !vb_decoded[index]); };
+
+  /**
+   * Decode the vb at index from its view.
+   *
+   * @return Pointer to the decoded vb, which is vbs[index]
+   */
+  Vb *decode_vb(const int index) const;
+
+  /**
+   * Decode the vb at index and drop its view, before it is modified.
+   */
+  void detach_vb(const int index);
+
+  /**
+   * Free the views and the encoded vbs.
+   */
+  void free_views();
+
+  Vb *vbs;                     // array of Vbs, the first vb_count
+                               // are constructed
   int vbs_size;                // Size of array
   int vb_count;                // count of Vbs
+  // Vbs set through set_vblist_ber(): the first vb_views_count vbs
+  // have a view into vb_ber. Such a vb is decoded into vbs[] on
+  // first access, until then vbs[] is an empty Vb.
+  VbView *vb_views;            // views of the encoded vbs
+  int vb_views_size;           // size of the views array
+  int vb_views_count;          // count of views
+  bool *vb_decoded;            // vbs[i] has been decoded from vb_views[i]
+  unsigned char *vb_ber;       // copy of the encoded vbs
+  int vb_ber_len;              // length of vb_ber
   int error_status;            // SMI error status
   int error_index;             // SMI error index
   bool validity;               // valid boolean
@@ -87,6 +87,102 @@ void SnmpSynchronized::unlock()
 #endif
 }	
 
+#if defined(_THREADS) && defined(WIN32) && \
+    defined(_WIN32_WINNT) && (_WIN32_WINNT >= 0x0600)
+#define SNMP_PP_SRWLOCK
+#endif
+
+SnmpRWSynchronized::SnmpRWSynchronized()
+{
+#ifdef _THREADS
+#ifdef SNMP_PP_SRWLOCK
+	InitializeSRWLock(&_rwlock);
+#elif defined (WIN32)
+	InitializeCriticalSection(&_rwlock);
+#elif defined (CPU) && CPU == PPC603
+	_rwlock = semMCreate(SEM_Q_PRIORITY | SEM_DELETE_SAFE | SEM_INVERSION_SAFE );
+#else
+	pthread_rwlock_init(&_rwlock, 0);
+#endif
+#endif
+}
+
+SnmpRWSynchronized::~SnmpRWSynchronized()
+{
+#ifdef _THREADS
+#ifdef SNMP_PP_SRWLOCK
+	// nothing to free
+#elif defined (WIN32)
+	DeleteCriticalSection(&_rwlock);
+#elif defined (CPU) && CPU == PPC603
+	semTake(_rwlock, WAIT_FOREVER);
+	semDelete(_rwlock);
+#else
+	pthread_rwlock_destroy(&_rwlock);
+#endif
+#endif
+}
+
+void SnmpRWSynchronized::lock()
+{
+#ifdef _THREADS
+#ifdef SNMP_PP_SRWLOCK
+	AcquireSRWLockExclusive(&_rwlock);
+#elif defined (WIN32)
+	EnterCriticalSection(&_rwlock);
+#elif defined (CPU) && CPU == PPC603
+	semTake(_rwlock, WAIT_FOREVER);
+#else
+	pthread_rwlock_wrlock(&_rwlock);
+#endif
+#endif
+}
+
+void SnmpRWSynchronized::unlock()
+{
+#ifdef _THREADS
+#ifdef SNMP_PP_SRWLOCK
+	ReleaseSRWLockExclusive(&_rwlock);
+#elif defined (WIN32)
+	LeaveCriticalSection(&_rwlock);
+#elif defined (CPU) && CPU == PPC603
+	semGive(_rwlock);
+#else
+	pthread_rwlock_unlock(&_rwlock);
+#endif
+#endif
+}
+
+void SnmpRWSynchronized::lock_read()
+{
+#ifdef _THREADS
+#ifdef SNMP_PP_SRWLOCK
+	AcquireSRWLockShared(&_rwlock);
+#elif defined (WIN32)
+	EnterCriticalSection(&_rwlock);
+#elif defined (CPU) && CPU == PPC603
+	semTake(_rwlock, WAIT_FOREVER);
+#else
+	pthread_rwlock_rdlock(&_rwlock);
+#endif
+#endif
+}
+
+void SnmpRWSynchronized::unlock_read()
+{
+#ifdef _THREADS
+#ifdef SNMP_PP_SRWLOCK
+	ReleaseSRWLockShared(&_rwlock);
+#elif defined (WIN32)
+	LeaveCriticalSection(&_rwlock);
+#elif defined (CPU) && CPU == PPC603
+	semGive(_rwlock);
+#else
+	pthread_rwlock_unlock(&_rwlock);
+#endif
+#endif
+}
+
 #ifdef SNMP_PP_NAMESPACE
 }; // end of namespace Snmp_pp
 #endif 
@@ -79,6 +79,64 @@ class DLLOPT SnmpSynchronize {
 
 #define REENTRANT(x) { SnmpSynchronize _synchronize(*this); x }
 
+/**
+ * Lock that can be held by several readers or by one writer.
+ *
+ * lock() and unlock() take the lock exclusively, so classes that
+ * derived from SnmpSynchronized before keep their semantics. Read
+ * only access should use lock_read() and unlock_read(). Neither mode
+ * is recursive: a thread that already holds the lock in any mode must
+ * not take it again, on most platforms this deadlocks.
+ * Where the platform has no reader/writer lock, readers are serialized
+ * too.
+ */
+class DLLOPT SnmpRWSynchronized {
+
+ public:
+  SnmpRWSynchronized();
+  virtual ~SnmpRWSynchronized();
+
+  void lock();
+  void unlock();
+  void lock_read();
+  void unlock_read();
+
+ private:
+#ifdef _THREADS
+#ifdef WIN32
+#if defined(_WIN32_WINNT) && (_WIN32_WINNT >= 0x0600)
+  SRWLOCK               _rwlock;
+#else
+  CRITICAL_SECTION      _rwlock;
+#endif
+#elif defined (CPU) && CPU == PPC603
+  SEM_ID            	_rwlock;
+#else
+  pthread_rwlock_t      _rwlock;
+#endif
+#endif
+};
+
+class DLLOPT SnmpReadSynchronize {
+
+ public:
+  SnmpReadSynchronize(SnmpRWSynchronized& sync) : s(sync) { s.lock_read(); };
+  ~SnmpReadSynchronize() { s.unlock_read(); }
+
+ protected:
+  SnmpRWSynchronized& s;
+};
+
+class DLLOPT SnmpWriteSynchronize {
+
+ public:
+  SnmpWriteSynchronize(SnmpRWSynchronized& sync) : s(sync) { s.lock(); };
+  ~SnmpWriteSynchronize() { s.unlock(); }
+
+ protected:
+  SnmpRWSynchronized& s;
+};
+
 #ifdef SNMP_PP_NAMESPACE
 } // end of namespace Snmp_pp
 #endif 
@@ -61,6 +61,7 @@
 #define _SMIVALUE
 
 //----[ includes ]-----------------------------------------------------
+#include <new>              // placement new for clone_into()
 #include "snmp_pp/smi.h"
 
 #ifdef SNMP_PP_NAMESPACE
@@ -138,6 +139,22 @@ public:
    */
   virtual  SnmpSyntax * clone() const = 0;
 
+  /**
+   * Clone the value into memory provided by the caller, for containers
+   * that store small values without allocating them (like Vb).
+   *
+   * @note Classes that override clone() and are small enough to be
+   *       stored inline must override this method too.
+   *
+   * @param buf  - Suitably aligned memory for the new object
+   * @param size - Size of buf
+   *
+   * @return The object constructed in buf, or NULL if it does not fit.
+   *         The caller MUST call the destructor (not delete) when done.
+   */
+  virtual SnmpSyntax *clone_into(void * /*buf*/, const size_t /*size*/) const
+    { return 0; };
+
   /**
    * Virtual destructor to ensure deletion of derived classes...
    */
@@ -166,6 +183,12 @@ public:
    */
   virtual void clear() = 0;
 
+  /**
+   * Return the SMI value structure of the object, for encoders that
+   * read the value without copying it.
+   */
+  const SmiVALUE &get_smival() const { return smival; };
+
 protected:
 
   SmiVALUE smival;
@@ -130,6 +130,7 @@ namespace Snmp_pp {
 
 // extras
 #define SNMP_CLASS_SHUTDOWN          -24 //!< used for back door shutdown
+#define SNMP_CLASS_CANCELLED         -25 //!< async request was cancelled
 
 // ASN.1 parse errors
 #define SNMP_CLASS_BADVERSION        -50 //!< unsupported version
@@ -137,7 +138,7 @@ namespace Snmp_pp {
 //@}
 
 #define MAX_POS_ERROR                    SNMP_ERROR_INCONSIS_NAME
-#define MAX_NEG_ERROR                    SNMP_CLASS_SHUTDOWN
+#define MAX_NEG_ERROR                    SNMP_CLASS_CANCELLED
 
 
 #ifdef _INCLUDE_SNMP_ERR_STRINGS
@@ -261,6 +262,7 @@ static const char * nErrs[] =
   "SNMP++: Transport operation failed",  // 22 SNMP_CLASS_TL_FAILED
   "SNMP++: Transport access denied",     // 23 SNMP_CLASS_TL_ACCESS_DENIED
   "SNMP++: Blocked Mode Shutdown",       // 24 SNMP_CLASS_SHUTDOWN
+  "SNMP++: Request cancelled",           // 25 SNMP_CLASS_CANCELLED
 
   "Unknown error code",  // unknown error code
 };
@@ -194,6 +194,39 @@ void freeSmivalDescriptor( SmiVALUE *smival )
   smival->syntax = sNMP_SYNTAX_NULL;
 }
 
+SnmpMessage::SnmpMessage(const unsigned int max_size)
+  : databuff(inline_buff), buffsize(MAX_SNMP_PACKET),
+    bufflen(MAX_SNMP_PACKET), valid_flag(false)
+{
+  set_max_size(max_size);
+}
+
+SnmpMessage::~SnmpMessage()
+{
+  if (databuff != inline_buff)
+    delete [] databuff;
+}
+
+// Messages up to MAX_SNMP_PACKET use the buffer inside the object, so
+// only larger messages cost an allocation. The content is not kept.
+bool SnmpMessage::set_max_size(const unsigned int size)
+{
+  if ((size > MAX_SNMP_PACKET_LIMIT) || (size == 0))
+    return false;
+
+  if (size > buffsize)
+  {
+    unsigned char *buff = new unsigned char[size];
+    if (databuff != inline_buff)
+      delete [] databuff;
+    databuff = buff;
+  }
+  buffsize = size;
+  bufflen = size;
+  valid_flag = false;
+  return true;
+}
+
 #ifdef _SNMPv3
 
 int SnmpMessage::unloadv3( Pdu &pdu,                // Pdu returned
@@ -211,6 +244,87 @@ int SnmpMessage::unloadv3( Pdu &pdu,                // Pdu returned
 
 #endif
 
+// oids of the first two vbs of SNMPv2 traps and informs
+static const oid sysUpTimeOid[] = { 1, 3, 6, 1, 2, 1, 1, 3, 0 };
+static const oid trapIdOid[] = { 1, 3, 6, 1, 6, 3, 1, 1, 4, 1, 0 };
+
+//------------[ encode a vb back to front ]----------------------------
+// The vb is encoded so that it ends right before data. The value is read
+// from the smival of the SNMP++ object, so nothing is copied.
+static int rbuild_vb(unsigned char *&data, int *length,
+                     const oid *name, const int name_len,
+                     const SmiUINT32 syntax, const SnmpSyntax *value)
+{
+  unsigned char *end = data;
+
+  switch (syntax) {
+
+  case sNMP_SYNTAX_NULL:
+  case sNMP_SYNTAX_NOSUCHOBJECT:
+  case sNMP_SYNTAX_NOSUCHINSTANCE:
+  case sNMP_SYNTAX_ENDOFMIBVIEW:
+    data = asn_rbuild_null(data, length, (unsigned char)syntax);
+    break;
+
+  case sNMP_SYNTAX_INT:
+    data = asn_rbuild_int(data, length, (unsigned char)syntax,
+                          value->get_smival().value.sNumber);
+    break;
+
+  case sNMP_SYNTAX_GAUGE32:
+  case sNMP_SYNTAX_CNTR32:
+  case sNMP_SYNTAX_TIMETICKS:
+    data = asn_rbuild_unsigned_int(data, length, (unsigned char)syntax,
+                                   value->get_smival().value.uNumber);
+    break;
+
+  case sNMP_SYNTAX_CNTR64:
+    data = asn_rbuild_unsigned_int64(data, length, (unsigned char)syntax,
+                                     value->get_smival().value.hNumber.hipart,
+                                     value->get_smival().value.hNumber.lopart);
+    break;
+
+  case sNMP_SYNTAX_BITS: // BITS are sent as OCTET STRING (RFC 2578)
+  case sNMP_SYNTAX_OCTETS:
+  case sNMP_SYNTAX_OPAQUE:
+  case sNMP_SYNTAX_IPADDR:
+    {
+      const SmiOCTETS &os = value->get_smival().value.string;
+      unsigned char type = (unsigned char)syntax;
+
+      if (syntax == sNMP_SYNTAX_BITS)
+        type = (unsigned char)sNMP_SYNTAX_OCTETS;
+      if (value->valid())
+        data = asn_rbuild_string(data, length, type, os.ptr, (int)os.len);
+      else
+        data = asn_rbuild_string(data, length, type, 0, 0);
+    }
+    break;
+
+  case sNMP_SYNTAX_OID:
+    data = asn_rbuild_objid(data, length, (unsigned char)syntax,
+                            value->get_smival().value.oid.ptr,
+                            (int)value->get_smival().value.oid.len);
+    break;
+
+  default:
+    return SNMP_CLASS_INTERNAL_ERROR;
+  }
+
+  if (data)
+    data = asn_rbuild_objid(data, length, ASN_UNI_PRIM | ASN_OBJECT_ID,
+                            name, name_len);
+  if (data)
+    data = asn_rbuild_header(data, length, ASN_SEQ_CON,
+                             SAFE_INT_CAST(end - data));
+
+  return data ? SNMP_CLASS_SUCCESS : SNMP_ERROR_TOO_BIG;
+}
+
+// The Pdu is encoded straight into databuff, back to front: first the
+// last vb at the end of the buffer, then the other vbs, the pdu fields
+// and the message headers in front of it. The message is moved to the
+// start of databuff when it is complete.
 int SnmpMessage::load(const Pdu &cpdu,
                       const OctetStr &community,
                       const snmp_version version,
@@ -218,31 +332,92 @@ int SnmpMessage::load(const Pdu &cpdu,
                       const OctetStr* security_name,
                       const int security_model)
 {
-  int status;
+  int status = SNMP_CLASS_SUCCESS;
   const Pdu *pdu = &cpdu;
-  Pdu temppdu;
+  const int command = pdu->get_type();
+  int max_len = (int)buffsize;
+  int length = max_len;
+  unsigned char *end = databuff + max_len;
+  unsigned char *cp = end;
+  bool send_vbs = true;
 
   // make sure pdu is valid
   if ( !pdu->valid())
     return SNMP_CLASS_INVALID_PDU;
 
-  // create a raw pdu
-  snmp_pdu *raw_pdu;
-  raw_pdu = snmp_pdu_create( (int) pdu->get_type());
+#ifdef _SNMPv3
+  if (version == version3)
+  {
+    if ((!engine_id) || (!security_name))
+    {
+      LOG_BEGIN(ERROR_LOG | 4);
+      LOG("SNMPMessage: Need security name and engine id for v3 message");
+      LOG_END;
 
-  Oid enterprise;
+      return SNMP_CLASS_INVALID_TARGET;
+    }
 
-  // load it up
-  raw_pdu->reqid = pdu->get_request_id();
-#ifdef _SNMPv3
-  raw_pdu->msgid = pdu->get_message_id();
+    // First Contact => we do not send any management information
+    if ((engine_id->len() == 0) &&
+        ((command == sNMP_PDU_GET) || (command == sNMP_PDU_GETNEXT) ||
+         (command == sNMP_PDU_SET) || (command == sNMP_PDU_GETBULK) ||
+         (command == sNMP_PDU_V1TRAP) || (command == sNMP_PDU_INFORM) ||
+         (command == sNMP_PDU_TRAP)))
+      send_vbs = false;
+  }
 #endif
-  raw_pdu->errstat= (unsigned long) pdu->get_error_status();
-  raw_pdu->errindex= (unsigned long) pdu->get_error_index();
+
+  // load up the payload, starting with the last vb
+  // the value portion is not sent in case its a get,next or bulk
+  bool null_values = ((command == sNMP_PDU_GET) ||
+                      (command == sNMP_PDU_GETNEXT) ||
+                      (command == sNMP_PDU_GETBULK));
+
+  for (int z = pdu->get_vb_count() - 1; send_vbs && (z >= 0); z--)
+  {
+    const Vb &vb = pdu->get_vb(z);
+    const SmiOID &name = vb.get_oid().get_smival().value.oid;
+
+    if (null_values)
+      status = rbuild_vb(cp, &length, name.ptr, (int)name.len,
+                         sNMP_SYNTAX_NULL, 0);
+    else
+      status = rbuild_vb(cp, &length, name.ptr, (int)name.len,
+                         vb.get_syntax(), vb.get_value_ptr());
+    if (status != SNMP_CLASS_SUCCESS)
+      break;
+  }
+
+  // if its a v2 trap then we need to make a few adjustments
+  // vb #1 is the timestamp
+  // vb #2 is the id, represented as an Oid, if one was set
+  if (send_vbs && (status == SNMP_CLASS_SUCCESS) &&
+      ((command == sNMP_PDU_TRAP) || (command == sNMP_PDU_INFORM)))
+  {
+    TimeTicks timestamp;
+    pdu->get_notify_timestamp(timestamp);
+
+    if (pdu->get_notify_id().valid())
+      status = rbuild_vb(cp, &length,
+                         trapIdOid, sizeof(trapIdOid) / sizeof(oid),
+                         sNMP_SYNTAX_OID, &pdu->get_notify_id());
+    if (status == SNMP_CLASS_SUCCESS)
+      status = rbuild_vb(cp, &length,
+                         sysUpTimeOid, sizeof(sysUpTimeOid) / sizeof(oid),
+                         sNMP_SYNTAX_TIMETICKS, &timestamp);
+  }
+
+  if (status == SNMP_CLASS_INTERNAL_ERROR)
+    return status;
+
+  if (status == SNMP_CLASS_SUCCESS)
+    cp = asn_rbuild_header(cp, &length, ASN_SEQ_CON, SAFE_INT_CAST(end - cp));
+  else
+    cp = 0;
 
   // if its a V1 trap then load up other values
   // for v2, use normal pdu format
-  if (raw_pdu->command == sNMP_PDU_V1TRAP)
+  if (cp && (command == sNMP_PDU_V1TRAP))
   {
     // DON'T forget about the v1 trap agent address (changed by Frank Fock)
     GenAddress gen_addr;
@@ -260,7 +435,6 @@ int SnmpMessage::load(const Pdu &cpdu,
 	LOG(gen_addr.get_type());
 	LOG_END;
 
-        snmp_free_pdu( raw_pdu);
         return SNMP_CLASS_INVALID_PDU;
       }
 
@@ -271,7 +445,6 @@ int SnmpMessage::load(const Pdu &cpdu,
 	LOG("SNMPMessage: Copied v1 trap address not valid");
 	LOG_END;
 
-        snmp_free_pdu( raw_pdu);
         return SNMP_CLASS_RESOURCE_UNAVAIL;
       }
       addr_set = TRUE;
@@ -299,7 +472,6 @@ int SnmpMessage::load(const Pdu &cpdu,
       LOG(((IpAddress &)ip_addr).IpAddress::get_printable());
       LOG_END;
     }
-    raw_pdu->agent_addr = agent_addr;
 
     //-----[ compute generic trap value ]-------------------------------
     // determine the generic value
@@ -310,148 +482,96 @@ int SnmpMessage::load(const Pdu &cpdu,
     // 4 - authentication failure
     // 5 - egpneighborloss
     // 6 - enterprise specific
-    Oid trapid;
-    pdu->get_notify_id( trapid);
+    const Oid &trapid = pdu->get_notify_id();
     if ( !trapid.valid() || trapid.len() < 2 )
-      {
-        snmp_free_pdu( raw_pdu);
-        return SNMP_CLASS_INVALID_NOTIFYID;
-      }
-    raw_pdu->specific_type=0;
+      return SNMP_CLASS_INVALID_NOTIFYID;
+
+    long trap_type;
+    long specific_type = 0;
+    const oid *enterprise = pdu->get_notify_enterprise().get_smival().value.oid.ptr;
+    int enterprise_len = (int)pdu->get_notify_enterprise().len();
+
     if ( trapid == coldStart)
-      raw_pdu->trap_type = 0;  // cold start
+      trap_type = 0;  // cold start
     else if ( trapid == warmStart)
-      raw_pdu->trap_type = 1;  // warm start
+      trap_type = 1;  // warm start
     else if( trapid == linkDown)
-      raw_pdu->trap_type = 2;  // link down
+      trap_type = 2;  // link down
     else if ( trapid == linkUp)
-      raw_pdu->trap_type = 3;  // link up
+      trap_type = 3;  // link up
     else if ( trapid == authenticationFailure )
-      raw_pdu->trap_type = 4;  // authentication failure
+      trap_type = 4;  // authentication failure
     else if ( trapid == egpNeighborLoss)
-      raw_pdu->trap_type = 5;  // egp neighbor loss
+      trap_type = 5;  // egp neighbor loss
     else {
-      raw_pdu->trap_type = 6;     // enterprise specific
+      trap_type = 6;     // enterprise specific
       // last oid subid is the specific value
       // if 2nd to last subid is "0", remove it
       // enterprise is always the notify oid prefix
-      raw_pdu->specific_type = (int) trapid[(int) (trapid.len()-1)];
-
-      trapid.trim(1);
-      if ( trapid[(int)(trapid.len()-1)] == 0 )
-        trapid.trim(1);
-      enterprise = trapid;
-    }
+      specific_type = (int) trapid[(int) (trapid.len()-1)];
 
-    if ( raw_pdu->trap_type !=6)
-      pdu->get_notify_enterprise( enterprise);
-    if ( enterprise.len() >0) {
-      // note!!
-      // these are hooks into an SNMP++ oid
-      // and therefor the raw_pdu enterprise
-      // should not free them. null them out!!
-      SmiLPOID rawOid;
-      rawOid = enterprise.oidval();
-      raw_pdu->enterprise = rawOid->ptr;
-      raw_pdu->enterprise_length = (int) rawOid->len;
+      enterprise = trapid.get_smival().value.oid.ptr;
+      enterprise_len = (int) trapid.len() - 1;
+      if ( trapid[enterprise_len - 1] == 0 )
+        enterprise_len--;
     }
 
     // timestamp
     TimeTicks timestamp;
     pdu->get_notify_timestamp( timestamp);
-    raw_pdu->time = ( unsigned long) timestamp;
 
+    // built in reverse order: timestamp, specific trap, generic trap,
+    // agent-addr and enterprise
+    cp = asn_rbuild_unsigned_int(cp, &length, SMI_TIMETICKS,
+                                 (unsigned long) timestamp);
+    if (cp)
+      cp = asn_rbuild_int(cp, &length, ASN_UNI_PRIM | ASN_INTEGER,
+                          specific_type);
+    if (cp)
+      cp = asn_rbuild_int(cp, &length, ASN_UNI_PRIM | ASN_INTEGER, trap_type);
+    // agent-addr ; must be IPADDRESS changed by Frank Fock
+    if (cp)
+      cp = asn_rbuild_string(cp, &length, SMI_IPADDRESS,
+                             (unsigned char *)&agent_addr.sin_addr.s_addr,
+                             sizeof(agent_addr.sin_addr.s_addr));
+    if (cp)
+      cp = asn_rbuild_objid(cp, &length, ASN_UNI_PRIM | ASN_OBJECT_ID,
+                            enterprise, enterprise_len);
   }
-
-  // if its a v2 trap then we need to make a few adjustments
-  // vb #1 is the timestamp
-  // vb #2 is the id, represented as an Oid
-  if (( raw_pdu->command == sNMP_PDU_TRAP) ||
-      ( raw_pdu->command == sNMP_PDU_INFORM))
+  else if (cp)
   {
-    Vb tempvb;
-
-    temppdu = *pdu;
-    temppdu.trim(temppdu.get_vb_count());
-
-    // vb #1 is the timestamp
-    TimeTicks timestamp;
-    tempvb.set_oid(SNMP_MSG_OID_SYSUPTIME);   // sysuptime
-    pdu->get_notify_timestamp( timestamp);
-    tempvb.set_value ( timestamp);
-    temppdu += tempvb;
-
-    // vb #2 is the id
-    Oid trapid;
-    tempvb.set_oid(SNMP_MSG_OID_TRAPID);
-    pdu->get_notify_id( trapid);
-    tempvb.set_value( trapid);
-    temppdu += tempvb;
-
-    // append the remaining vbs
-    for (int z=0; z<pdu->get_vb_count(); z++) {
-      pdu->get_vb( tempvb,z);
-      temppdu += tempvb;
-    }
-
-    pdu = &temppdu;          // reassign the pdu to the temp one
+    // error index, error status and request id
+    cp = asn_rbuild_int(cp, &length, ASN_UNI_PRIM | ASN_INTEGER,
+                        (long)pdu->get_error_index());
+    if (cp)
+      cp = asn_rbuild_int(cp, &length, ASN_UNI_PRIM | ASN_INTEGER,
+                          (long)pdu->get_error_status());
+    if (cp)
+      cp = asn_rbuild_int(cp, &length, ASN_UNI_PRIM | ASN_INTEGER,
+                          (long)pdu->get_request_id());
   }
-  // load up the payload
-  // for all Vbs in list, add them to the pdu
-  int vb_count;
-  Vb tempvb;
-  Oid tempoid;
-  SmiLPOID smioid;
-  SmiVALUE smival;
-
-  vb_count = pdu->get_vb_count();
-  for (int z=0;z<vb_count;z++) {
-    pdu->get_vb( tempvb,z);
-    tempvb.get_oid( tempoid);
-    smioid = tempoid.oidval();
-    // clear the value portion, in case its
-    // not already been done so by the app writer
-    // only do it in the case its a get,next or bulk
-    if ((raw_pdu->command == sNMP_PDU_GET) ||
-        (raw_pdu->command == sNMP_PDU_GETNEXT) ||
-        (raw_pdu->command == sNMP_PDU_GETBULK))
-      tempvb.set_null();
-    status = convertVbToSmival( tempvb, &smival );
-    if ( status != SNMP_CLASS_SUCCESS) {
-      snmp_free_pdu( raw_pdu);
-      return status;
-    }
-    // add the vb to the raw pdu
-    snmp_add_var( raw_pdu, smioid->ptr, (int) smioid->len, &smival);
 
-    freeSmivalDescriptor( &smival);
-  }
+  // header of the data pdu
+  if (cp)
+    cp = asn_rbuild_header(cp, &length, (unsigned char)command,
+                           SAFE_INT_CAST(end - cp));
 
-  // ASN1 encode the pdu
+  // ASN1 encode the message headers
+  if (!cp)
+    status = -1;
 #ifdef _SNMPv3
-  if (version == version3)
+  else if (version == version3)
   {
-    if ((!engine_id) || (!security_name))
-    {
-      LOG_BEGIN(ERROR_LOG | 4);
-      LOG("SNMPMessage: Need security name and engine id for v3 message");
-      LOG_END;
-
-      // prevention of SNMP++ Enterprise Oid death
-      if ( enterprise.len() >0) {
-	raw_pdu->enterprise = 0;
-	raw_pdu->enterprise_length=0;
-      }
-      snmp_free_pdu( raw_pdu);
-      return SNMP_CLASS_INVALID_TARGET;
-    }
-
-    status = v3MP::I->snmp_build(raw_pdu, databuff, (int *)&bufflen,
+    status = v3MP::I->snmp_build(databuff, &max_len,
+                                 SAFE_INT_CAST(end - cp), command,
+                                 pdu->get_request_id(),
+                                 pdu->get_message_id(),
 				 *engine_id, *security_name, security_model,
 				 pdu->get_security_level(),
 				 pdu->get_context_engine_id(),
 				 pdu->get_context_name());
     if (status == SNMPv3_MP_OK) {
+      bufflen = max_len;
       if ((pdu->get_type() == sNMP_PDU_RESPONSE) &&
           ((int)pdu->get_maxsize_scopedpdu() < pdu->get_asn1_length())) {
 
@@ -461,20 +581,30 @@ int SnmpMessage::load(const Pdu &cpdu,
 	LOG(pdu->get_maxsize_scopedpdu());
 	LOG_END;
 
-        // prevention of SNMP++ Enterprise Oid death
-        if ( enterprise.len() >0) {
-          raw_pdu->enterprise = 0;
-          raw_pdu->enterprise_length=0;
-        }
-        snmp_free_pdu( raw_pdu);
         return SNMP_ERROR_TOO_BIG;
       }
     }
   }
-  else
 #endif
-    status = snmp_build( raw_pdu, databuff, (int *) &bufflen, version,
-                         community.data(), (int) community.len());
+  else
+  {
+    cp = asn_rbuild_string(cp, &length, ASN_UNI_PRIM | ASN_OCTET_STR,
+                           community.data(), (int) community.len());
+    if (cp)
+      cp = asn_rbuild_int(cp, &length, ASN_UNI_PRIM | ASN_INTEGER,
+                          (long) version);
+    if (cp)
+      cp = asn_rbuild_header(cp, &length, ASN_SEQ_CON,
+                             SAFE_INT_CAST(end - cp));
+    if (cp)
+    {
+      bufflen = SAFE_INT_CAST(end - cp);
+      memmove(databuff, cp, bufflen);
+      status = 0;
+    }
+    else
+      status = -1;
+  }
 
   LOG_BEGIN(DEBUG_LOG | 4);
   LOG("SNMPMessage: return value for build message");
@@ -487,14 +617,8 @@ int SnmpMessage::load(const Pdu &cpdu,
 #endif
       ) {
     valid_flag = false;
-    // prevention of SNMP++ Enterprise Oid death
-    if ( enterprise.len() >0) {
-      raw_pdu->enterprise = 0;
-      raw_pdu->enterprise_length=0;
-    }
-    snmp_free_pdu( raw_pdu);
 #ifdef _SNMPv3
-    if (version == version3)
+    if ((version == version3) && (status != -1))
       return status;
     else
 #endif
@@ -505,14 +629,6 @@ int SnmpMessage::load(const Pdu &cpdu,
   }
   valid_flag = true;
 
-  // prevention of SNMP++ Enterprise Oid death
-  if ( enterprise.len() >0) {
-    raw_pdu->enterprise = 0;
-    raw_pdu->enterprise_length=0;
-  }
-
-  snmp_free_pdu( raw_pdu);
-
   return SNMP_CLASS_SUCCESS;
 }
 
@@ -520,10 +636,11 @@ int SnmpMessage::load(const Pdu &cpdu,
 int SnmpMessage::load( unsigned char *data,
                        unsigned long len)
 {
-  bufflen = MAX_SNMP_PACKET;
+  bufflen = buffsize;
   valid_flag = false;
 
-  if (len <= MAX_SNMP_PACKET)
+  if ((len <= buffsize) ||
+      ((len <= MAX_SNMP_PACKET_LIMIT) && set_max_size((unsigned int)len)))
   {
     memcpy( (unsigned char *) databuff, (unsigned char *) data,
             (unsigned int) len);
@@ -671,155 +788,45 @@ int SnmpMessage::unload(Pdu &pdu,                 // Pdu object
     }
   }
 
-  // vbs
-  Vb tempvb;
-  Oid tempoid;
-  struct   variable_list *vp;
-  int vb_nr = 1;
-
-  for(vp = raw_pdu->variables; vp; vp = vp->next_variable, vb_nr++) {
-
-    // extract the oid portion
-    tempoid.set_data( (unsigned long *)vp->name,
-                      ( unsigned int) vp->name_length);
-    tempvb.set_oid( tempoid);
-
-    // extract the value portion
-    switch(vp->type){
-
-      // octet string
-    case sNMP_SYNTAX_OCTETS:
-      {
-	OctetStr octets( (unsigned char *) vp->val.string,
-			 (unsigned long) vp->val_len);
-	tempvb.set_value( octets);
-      }
-      break;
-    case sNMP_SYNTAX_OPAQUE:
-      {
-	OpaqueStr octets( (unsigned char *) vp->val.string,
-		          (unsigned long) vp->val_len);
-	tempvb.set_value( octets);
-      }
-      break;
-
-      // object id
-    case sNMP_SYNTAX_OID:
-      {
-	Oid oid( (unsigned long*) vp->val.objid,
-		 (int) vp->val_len);
-	tempvb.set_value( oid);
-        if ((vb_nr == 2) &&
-            ((raw_pdu->command == sNMP_PDU_TRAP) ||
-             (raw_pdu->command == sNMP_PDU_INFORM)) &&
-            (tempoid == SNMP_MSG_OID_TRAPID))
-        {
-          // set notify_id
-          pdu.set_notify_id(oid);
-	  continue; // don't add vb to pdu
-        }
-      }
-      break;
-
-      // timeticks
-    case sNMP_SYNTAX_TIMETICKS:
-      {
-	TimeTicks timeticks( (unsigned long) *(vp->val.integer));
-	tempvb.set_value( timeticks);
-        if ((vb_nr == 1) &&
-            ((raw_pdu->command == sNMP_PDU_TRAP) ||
-             (raw_pdu->command == sNMP_PDU_INFORM)) &&
-            (tempoid == SNMP_MSG_OID_SYSUPTIME))
-        {
-          // set notify_timestamp
-          pdu.set_notify_timestamp( timeticks);
-	  continue; // don't add vb to pdu
-        }
-      }
-      break;
-
-      // 32 bit counter
-    case sNMP_SYNTAX_CNTR32:
-      {
-	Counter32 counter32( (unsigned long) *(vp->val.integer));
-	tempvb.set_value( counter32);
-      }
-      break;
-
-      // 32 bit gauge
-    case sNMP_SYNTAX_GAUGE32:
-      {
-	Gauge32 gauge32( (unsigned long) *(vp->val.integer));
-	tempvb.set_value( gauge32);
-      }
-      break;
-
-      // ip address
-    case sNMP_SYNTAX_IPADDR:
-      {
-	char buffer[42];
-
-	if (vp->val_len == 16)
-	  sprintf( buffer, "%02x%02x:%02x%02x:%02x%02x:%02x%02x:"
-		   "%02x%02x:%02x%02x:%02x%02x:%02x%02x",
-		   vp->val.string[ 0], vp->val.string[ 1], vp->val.string[ 2],
-		   vp->val.string[ 3], vp->val.string[ 4], vp->val.string[ 5],
-		   vp->val.string[ 6], vp->val.string[ 7], vp->val.string[ 8],
-		   vp->val.string[ 9], vp->val.string[10], vp->val.string[11],
-		   vp->val.string[12], vp->val.string[13], vp->val.string[14],
-		   vp->val.string[15]);
-	else
-	  sprintf( buffer,"%d.%d.%d.%d",
-		   vp->val.string[0], vp->val.string[1],
-		   vp->val.string[2], vp->val.string[3]);
-	IpAddress ipaddress( buffer);
-	tempvb.set_value( ipaddress);
-      }
-      break;
-
-      // 32 bit integer
-    case sNMP_SYNTAX_INT:
-      {
-	SnmpInt32 int32( (long) *(vp->val.integer));
-	tempvb.set_value( int32);
-      }
-      break;
-
-      // 32 bit unsigned integer
-/* Not distinguishable from Gauge32
-    case sNMP_SYNTAX_UINT32:
-      {
-	SnmpUInt32 uint32( (unsigned long) *(vp->val.integer));
-	tempvb.set_value( uint32);
-      }
-      break;
-*/
-      // v2 counter 64's
-    case sNMP_SYNTAX_CNTR64:
-      { // Frank Fock (was empty before)
-	Counter64 c64(((counter64*)vp->val.counter64)->high,
-		      ((counter64*)vp->val.counter64)->low);
-	tempvb.set_value( c64);
-	break;
-      }
-    case sNMP_SYNTAX_NULL:
-	    tempvb.set_null();
-	    break;
-	
-	    // v2 vb exceptions
-    case sNMP_SYNTAX_NOSUCHOBJECT:
-    case sNMP_SYNTAX_NOSUCHINSTANCE:
-    case sNMP_SYNTAX_ENDOFMIBVIEW:
-      tempvb.set_exception_status(vp->type);
-      break;
-
-    default:
-      tempvb.set_null();
-
-    } // end switch
+  // vbs, decoded by the Pdu when they are accessed
+  if (!pdu.set_vblist_ber(raw_pdu->vb_data, raw_pdu->vb_data_len)) {
+    snmp_free_pdu( raw_pdu);
+    return SNMP_CLASS_ASN1ERROR;
+  }
 
-    // append the vb to the pdu
-    pdu += tempvb;
+  if ((raw_pdu->command == sNMP_PDU_TRAP) ||
+      (raw_pdu->command == sNMP_PDU_INFORM)) {
+    // the first two vbs hold timestamp and id of the notification
+    VbView view;
+    int vb_nr = 0;
+    unsigned long ticks;
+
+    if (pdu.get_vb_view(view, vb_nr) &&
+        (view.get_syntax() == sNMP_SYNTAX_TIMETICKS) &&
+        (view.get_oid_len() == sizeof(sysUpTimeOid) / sizeof(oid)) &&
+        (view.nCompare(sizeof(sysUpTimeOid) / sizeof(oid),
+                       Oid(sysUpTimeOid,
+                           sizeof(sysUpTimeOid) / sizeof(oid))) == 0) &&
+        (view.get_value(ticks) == SNMP_CLASS_SUCCESS)) {
+      // set notify_timestamp
+      pdu.set_notify_timestamp(TimeTicks(ticks));
+      pdu.delete_vb(vb_nr); // don't keep vb in pdu
+    }
+    else
+      ++vb_nr;
+
+    if (pdu.get_vb_view(view, vb_nr) &&
+        (view.get_syntax() == sNMP_SYNTAX_OID) &&
+        (view.get_oid_len() == sizeof(trapIdOid) / sizeof(oid)) &&
+        (view.nCompare(sizeof(trapIdOid) / sizeof(oid),
+                       Oid(trapIdOid,
+                           sizeof(trapIdOid) / sizeof(oid))) == 0)) {
+      // set notify_id
+      Oid id;
+      view.get_value(id);
+      pdu.set_notify_id(id);
+      pdu.delete_vb(vb_nr); // don't keep vb in pdu
+    }
   }
 
   snmp_free_pdu( raw_pdu);
@@ -83,8 +83,10 @@ class DLLOPT SnmpMessage
 {
  public:
 
-  // construct a SnmpMessage object
-  SnmpMessage() : bufflen(MAX_SNMP_PACKET), valid_flag(false) {};
+  // construct a SnmpMessage object for messages of up to max_size
+  // bytes, larger buffers than MAX_SNMP_PACKET are allocated
+  SnmpMessage(const unsigned int max_size = MAX_SNMP_PACKET);
+  ~SnmpMessage();
 	// load up using a Pdu, community and SNMP version
 	// performs ASN.1 serialization
 	// result status returned
@@ -156,11 +158,24 @@ class DLLOPT SnmpMessage
 	// check validity
 	unsigned long len() const { return bufflen; };
 
+	// returns the maximum message size
+	unsigned int max_size() const { return buffsize; };
+
 protected:
 
-	unsigned char databuff[MAX_SNMP_PACKET];
+	// make room for messages of up to size bytes
+	bool set_max_size(const unsigned int size);
+
+	unsigned char *databuff;
+	unsigned int buffsize;      // size of databuff
 	unsigned int bufflen;
 	bool valid_flag;
+	unsigned char inline_buff[MAX_SNMP_PACKET];
+
+private:
+	// not copyable
+	SnmpMessage(const SnmpMessage &);
+	SnmpMessage &operator=(const SnmpMessage &);
 };
 
 #ifdef SNMP_PP_NAMESPACE
@@ -62,6 +62,7 @@ namespace Snmp_pp {
 // class variables for default behavior control
 unsigned long SnmpTarget::default_timeout = 100;
 int SnmpTarget::default_retries = 1;
+int SnmpTarget::default_max_msg_size = MAX_SNMP_PACKET;
 
 //----------------------------------------------------------------------
 //--------[ Abstract SnmpTarget Member Functions ]----------------------
@@ -88,12 +89,33 @@ int SnmpTarget::set_address(const Address &address)
    return validity;
 }
 
+// keep a message size every SNMP entity and UDP can carry
+static int clamp_msg_size(const int size)
+{
+  if (size < MIN_SNMP_PACKET)
+    return MIN_SNMP_PACKET;
+  if (size > MAX_SNMP_PACKET_LIMIT)
+    return MAX_SNMP_PACKET_LIMIT;
+  return size;
+}
+
+void SnmpTarget::set_max_msg_size(const int size)
+{
+  max_msg_size = clamp_msg_size(size);
+}
+
+void SnmpTarget::set_default_max_msg_size(const int size)
+{
+  default_max_msg_size = clamp_msg_size(size);
+}
+
 SnmpTarget* SnmpTarget::clone() const
 {
   GenAddress addr = my_address;
   SnmpTarget* res = new SnmpTarget;
   res->set_timeout(timeout);
   res->set_retry(retries);
+  res->set_max_msg_size(max_msg_size);
   res->set_address(addr);
   res->set_version(version);
   return res;
@@ -107,6 +129,7 @@ int SnmpTarget::operator==( const SnmpTarget &rhs) const
   if (version    != rhs.version)    return 0;
   if (timeout    != rhs.timeout)    return 0;
   if (retries    != rhs.retries)    return 0;
+  if (max_msg_size != rhs.max_msg_size) return 0;
   return 1;  // they are equal
 }
 
@@ -116,6 +139,7 @@ void SnmpTarget::clear()
   validity = false;
   timeout  = default_timeout;
   retries  = default_retries;
+  max_msg_size = default_max_msg_size;
   version  = version1;
   ttype    = type_base;
   my_address.clear();
@@ -173,6 +197,7 @@ CTarget::CTarget( const CTarget &target)
    my_address      = target.my_address;
    timeout         = target.timeout;
    retries         = target.retries;
+   max_msg_size    = target.max_msg_size;
    version         = target.version;
    validity        = target.validity;
    ttype           = type_ctarget;
@@ -210,6 +235,7 @@ CTarget& CTarget::operator=( const CTarget& target)
 
   timeout         = target.timeout;
   retries         = target.retries;
+  max_msg_size    = target.max_msg_size;
   read_community  = target.read_community;
   write_community = target.write_community;
   validity        = target.validity;
@@ -318,6 +344,7 @@ UTarget::UTarget( const UTarget &target)
   my_address = target.my_address;
   timeout = target.timeout;
   retries = target.retries;
+  max_msg_size = target.max_msg_size;
   version = target.version;
   validity = target.validity;
   ttype = type_utarget;
@@ -362,6 +389,7 @@ UTarget& UTarget::operator=(const UTarget& target)
 
   timeout = target.timeout;
   retries = target.retries;
+  max_msg_size = target.max_msg_size;
 
 #ifdef _SNMPv3
   engine_id = target.engine_id;
@@ -111,14 +111,16 @@ class DLLOPT SnmpTarget
    */
   SnmpTarget()
     : validity(false), timeout(default_timeout), retries(default_retries),
-      version(version1), ttype(type_base) {};
+      max_msg_size(default_max_msg_size), version(version1),
+      ttype(type_base) {};
 
   /**
    * Create a SnmpTarget object with the given Address.
    */
   SnmpTarget(const Address &address)
     : validity(false), timeout(default_timeout), retries(default_retries),
-      version(version1), ttype(type_base), my_address(address)
+      max_msg_size(default_max_msg_size), version(version1),
+      ttype(type_base), my_address(address)
     { if (my_address.valid()) validity = true; };
 
   /**
@@ -195,6 +197,35 @@ class DLLOPT SnmpTarget
    */
   static void set_default_retries(const int r) { default_retries = r; };
 
+  /**
+   * Set the maximum size of the messages exchanged with this target.
+   *
+   * Requests that do not fit are not sent, SNMPv3 requests announce
+   * the size as msgMaxSize and the session makes room to receive
+   * responses of this size. The default is MAX_SNMP_PACKET (4096).
+   *
+   * @param size - Size in bytes, it is clamped to the range
+   *               MIN_SNMP_PACKET..MAX_SNMP_PACKET_LIMIT (484..65507)
+   */
+  void set_max_msg_size(const int size);
+
+  /**
+   * Get the maximum message size.
+   *
+   * @return The maximum size of the messages exchanged with this target.
+   */
+  int get_max_msg_size() const { return max_msg_size; };
+
+  /**
+   * Change the default maximum message size.
+   *
+   * Changing the default value will only have an effect for
+   * target objects that are created after setting this value.
+   *
+   * @param size - The new default maximum message size
+   */
+  static void set_default_max_msg_size(const int size);
+
   /**
    * Clone operator.
    *
@@ -265,12 +296,14 @@ class DLLOPT SnmpTarget
   bool validity;         ///< Validity of the object
   unsigned long timeout; ///< xmit timeout in 10 milli secs
   int retries;           ///< number of retries
+  int max_msg_size;      ///< max size of sent and received messages
   snmp_version version;  ///< SNMP version to use
   target_type ttype;     ///< Type of the target
   GenAddress my_address; ///< Address object
 
   static unsigned long default_timeout; ///< default timeout for new objects
   static int default_retries;           ///< default retries for new objects
+  static int default_max_msg_size;      ///< default max message size
 };
 
 //----[  CTarget class ]----------------------------------------------
@@ -120,6 +120,12 @@ class DLLOPT TimeTicks : public SnmpUInt32
    */
   SnmpSyntax *clone() const { return (SnmpSyntax *) new TimeTicks(*this); };
 
+  /**
+   * Clone into memory of the caller, see SnmpSyntax::clone_into().
+   */
+  SnmpSyntax *clone_into(void *buf, const size_t size) const
+    { return (sizeof(TimeTicks) <= size) ? new (buf) TimeTicks(*this) : 0; };
+
   /**
    * Map other SnmpSyntax objects to TimeTicks.
    */
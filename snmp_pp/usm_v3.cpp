@@ -58,15 +58,20 @@ namespace Snmp_pp {
 #endif
 
 // Use locking on access methods in an multithreading enviroment.
+// The table locks are not recursive: a method that holds the lock of a
+// table must not call a method of the same table that takes it again.
+// find_*() and delete_entry(int) expect the caller to hold the lock.
 #ifdef _THREADS
-#define BEGIN_REENTRANT_CODE_BLOCK SnmpSynchronize auto_lock(*this)
+#define BEGIN_REENTRANT_CODE_BLOCK SnmpWriteSynchronize auto_lock(*this)
 #define BEGIN_REENTRANT_CODE_BLOCK_CONST  \
-          SnmpSynchronize auto_lock(*(PP_CONST_CAST(SnmpSynchronized*, this)))
-#define BEGIN_AUTO_LOCK(obj) SnmpSynchronize auto_lock(*obj)
+          SnmpWriteSynchronize auto_lock(*(PP_CONST_CAST(SnmpRWSynchronized*, this)))
+#define BEGIN_READ_CODE_BLOCK SnmpReadSynchronize auto_lock(*this)
+#define BEGIN_AUTO_READ_LOCK(obj) SnmpReadSynchronize auto_lock(*obj)
 #else
 #define BEGIN_REENTRANT_CODE_BLOCK
 #define BEGIN_REENTRANT_CODE_BLOCK_CONST
-#define BEGIN_AUTO_LOCK(obj)
+#define BEGIN_READ_CODE_BLOCK
+#define BEGIN_AUTO_READ_LOCK(obj)
 #endif
 
 #ifndef min
@@ -74,6 +79,7 @@ namespace Snmp_pp {
 #endif
 
 #define MAX_LINE_LEN 2048  // Max line length in usm user files
+#define USM_MAX_PRIV_PADDING 16 // Max bytes added by encryption (block size)
 
 // structure for key update
 struct UsmKeyUpdate
@@ -94,7 +100,7 @@ struct UsmKeyUpdate
  *
  * @author Jochen Katz
  */
-class USMTimeTable : public SnmpSynchronized
+class USMTimeTable : public SnmpRWSynchronized
 {
 public:
 
@@ -213,10 +219,19 @@ private:
     long int latest_received_time;
   };
 
+  /**
+   * Get the position of the engine id in the table, the table
+   * must be locked.
+   *
+   * @return - position or -1 if not found
+   */
+  int find(const OctetStr &engine_id) const;
+
   struct Entry_T *table; ///< Array of entries
   const USM *usm;  ///< Pointer to the USM, this table belongs to
   int max_entries; ///< the maximum number of entries
   int entries;     ///< the current amount of entries
+  HashIndex index; ///< positions by engine id
 };
 
 
@@ -230,7 +245,7 @@ private:
  * properties of the user. If the user is found, a localized entry
  * for the USMUserTable is created and used for processing the message.
  */
-class USMUserNameTable : public SnmpSynchronized
+class USMUserNameTable : public SnmpRWSynchronized
 {
 public:
   USMUserNameTable(int &result);
@@ -278,7 +293,7 @@ public:
   /**
    * Get the entry with the given securityName from the usmUserNameTable
    *
-   * @note Use lock() and unlock() for thread synchronizytion.
+   * @note Use lock_read() and unlock_read() for thread synchronizytion.
    *
    * @param security_name     -
    *
@@ -351,10 +366,29 @@ public:
   const UsmUserNameTableEntry *peek_next(const UsmUserNameTableEntry *e) const;
 
 private:
+  /**
+   * Get the position of the user with the given userName or
+   * securityName, the table must be locked.
+   *
+   * @return - position or -1 if not found
+   */
+  int find_user_name(const unsigned char *user_name,
+                     const long int user_name_len) const;
+  int find_security_name(const unsigned char *security_name,
+                         const long int security_name_len) const;
+
+  /**
+   * Remove the entry at the given position from the indexes and
+   * move the last entry there, the table must be locked.
+   */
+  void delete_entry(const int nr);
+
   struct UsmUserNameTableEntry *table;
 
   int max_entries; ///< the maximum number of entries
   int entries;     ///< the current amount of entries
+  HashIndex user_name_index;     ///< positions by userName
+  HashIndex security_name_index; ///< positions by securityName
 };
 
 
@@ -363,10 +397,16 @@ private:
 /**
  * This class holds USM users with localized KEYS.
  */
-class USMUserTable : public SnmpSynchronized
+class USMUserTable : public SnmpRWSynchronized
 {
 public:
-  USMUserTable(int &result);
+  /**
+   * Constructor.
+   *
+   * @param ap     - used to precompute the HMAC state of the auth keys
+   * @param result - OUT: construct status, should be SNMPv3_USM_OK
+   */
+  USMUserTable(AuthPriv *ap, int &result);
 
   ~USMUserTable();
 
@@ -444,7 +484,7 @@ public:
    *
    * Get the user at the specified position of the usmUserTable.
    *
-   * @note Use lock() and unlock() for thread synchronization.
+   * @note Use lock_read() and unlock_read() for thread synchronization.
    *
    * @param number - get the entry at position number (1...)
    *
@@ -456,7 +496,7 @@ public:
   /**
    * Get a user of the usmUserTable.
    *
-   * @note Use lock() and unlock() for thread synchronization.
+   * @note Use lock_read() and unlock_read() for thread synchronization.
    *
    * @param engine_id - Get a user for this engine id
    * @param sec_name  - Get the user with this security name
@@ -494,7 +534,7 @@ public:
    * There could be more than one entry with the given
    * sec_name. Always the first entry that is found is returned.
    *
-   * @note Use lock() and unlock() for thread synchronization.
+   * @note Use lock_read() and unlock_read() for thread synchronization.
    *
    * @param sec_name - security name to search for
    *
@@ -566,12 +606,44 @@ public:
   const UsmUserTableEntry *peek_next(const UsmUserTableEntry *e) const;
 
 private:
+  /**
+   * Get the position of the entry with the given keys, the table
+   * must be locked.
+   *
+   * @return - position or -1 if not found
+   */
+  int find(const unsigned char *engine_id, const long engine_id_len,
+           const unsigned char *sec_name, const long sec_name_len) const;
+  int find_user(const unsigned char *engine_id, const long engine_id_len,
+                const unsigned char *user_name,
+                const long user_name_len) const;
+  int find_security_name(const unsigned char *sec_name,
+                         const long sec_name_len) const;
+  int find_user_name(const unsigned char *user_name,
+                     const long user_name_len) const;
+
+  /**
+   * Add the entry at the given position to the indexes.
+   */
+  void index_entry(const int nr);
+
   void delete_entry(const int nr);
 
+  /**
+   * Replace the HMAC state of the entry at the given position with
+   * the one of its current auth key.
+   */
+  void set_hmac_state(const int nr);
+
   struct UsmUserTableEntry *table;
+  AuthPriv *auth_priv;
 
   int max_entries; ///< the maximum number of entries
   int entries;     ///< the current amount of entries
+  HashIndex engine_sec_name_index;  ///< positions by engineID, securityName
+  HashIndex engine_user_name_index; ///< positions by engineID, userName
+  HashIndex sec_name_index;         ///< positions by securityName
+  HashIndex user_name_index;        ///< positions by userName
 };
 
 
@@ -715,7 +787,7 @@ USM::USM(unsigned int engine_boots, const OctetStr &engine_id,
   if (result != SNMPv3_USM_OK)
     return;
 
-  usm_user_table = new USMUserTable(result);
+  usm_user_table = new USMUserTable(auth_priv, result);
   if (result != SNMPv3_USM_OK)
     return;
 
@@ -1251,7 +1323,7 @@ struct UsmUser *USM::get_user(const OctetStr &engine_id,
     {
       const struct UsmUserTableEntry *entry;
 
-      BEGIN_AUTO_LOCK(usm_user_table);
+      BEGIN_AUTO_READ_LOCK(usm_user_table);
 
       entry = usm_user_table->get_entry(security_name);
 
@@ -1275,6 +1347,7 @@ struct UsmUser *USM::get_user(const OctetStr &engine_id,
         res->authKey = 0;        res->authKeyLength = 0;
         res->privProtocol = SNMP_PRIVPROTOCOL_NONE;
         res->privKey = 0;        res->privKeyLength = 0;
+        res->authHmacState = 0;  res->authHmacStateLength = 0;
 
 	if ((res->usmUserNameLength  && !res->usmUserName) ||
 	    (res->securityNameLength && !res->securityName))
@@ -1314,6 +1387,8 @@ struct UsmUser *USM::get_user(const OctetStr &engine_id,
       res->privProtocol       = SNMP_PRIVPROTOCOL_NONE;
       res->privKey            = 0;
       res->privKeyLength      = 0;
+      res->authHmacState      = 0;
+      res->authHmacStateLength = 0;
 
       if ((res->usmUserNameLength  && !res->usmUserName) ||
 	  (res->securityNameLength && !res->securityName))
@@ -1407,12 +1482,15 @@ struct UsmUser *USM::get_user(const OctetStr &engine_id,
   res->privProtocol       = user_table_entry->usmUserPrivProtocol;
   res->privKey            = user_table_entry->usmUserPrivKey;
   res->privKeyLength      = user_table_entry->usmUserPrivKeyLength;
+  res->authHmacState      = user_table_entry->authHmacState;
+  res->authHmacStateLength = user_table_entry->authHmacStateLength;
 
   user_table_entry->usmUserEngineID = 0;
   user_table_entry->usmUserName = 0;
   user_table_entry->usmUserSecurityName = 0;
   user_table_entry->usmUserAuthKey = 0;
   user_table_entry->usmUserPrivKey = 0;
+  user_table_entry->authHmacState = 0;
 
   usm_user_table->delete_cloned_entry(user_table_entry);
 
@@ -1440,11 +1518,29 @@ void USM::free_user(struct UsmUser *&user)
     delete [] user->privKey;
   }
 
+  if (user->authHmacState)
+  {
+    memset(user->authHmacState, 0, user->authHmacStateLength);
+    delete [] user->authHmacState;
+  }
+
   delete user;
 
   user = 0;
 }
 
+// Release the user of an outgoing message
+void USM::release_user(struct UsmUser *&user, const bool table_locked)
+{
+  if (table_locked)
+  {
+    usm_user_table->unlock_read();
+    user = 0;
+  }
+  else
+    free_user(user);
+}
+
 void USM::delete_usm_user(const OctetStr& security_name)
 {
   usm_user_name_table->delete_security_name(security_name);
@@ -1852,29 +1948,54 @@ int USM::generate_msg(
              unsigned char *wholeMsg,         // OUT complete generated message
              int *wholeMsgLength)             // OUT length of generated message
 {
-  Buffer<unsigned char> buffer(MAX_SNMP_PACKET);
-  Buffer<unsigned char> buffer2(MAX_SNMP_PACKET);
-  unsigned char *bufPtr = buffer.get_ptr();
-  unsigned char *buf2Ptr = buffer2.get_ptr();
-
-  if (!bufPtr || !buf2Ptr)
+  if ((scopedPDULength < 0) || (scopedPDULength > maxMessageSize))
+  {
+    debugprintf(0, "usm: scopedPDU too long (%i > %i)",
+                scopedPDULength, maxMessageSize);
+    if (securityStateReference)
+      delete securityStateReference;
     return SNMPv3_USM_ERROR;
+  }
 
-  unsigned char *wholeMsgPtr;
-  int startAuthPar = 0;
-  struct UsmUser *user = NULL;
-  struct UsmSecurityParameters usmSecurityParams;
+  // the message is built back to front around the scopedPDU
+  memmove(wholeMsg + maxMessageSize - scopedPDULength,
+          scopedPDU, scopedPDULength);
 
-  int bufLength = 0;
-  unsigned int buf2Length = 0;
-  int totalLength = 0;             // Bytes encoded
-  int restLength = maxMessageSize; // max Bytes left in packet-buffer
+  return generate_msg(globalData, globalDataLength, maxMessageSize,
+                      securityEngineID, securityName, securityLevel,
+                      scopedPDULength, securityStateReference,
+                      wholeMsg, wholeMsgLength);
+}
+
+int USM::generate_msg(
+             unsigned char *globalData,       // message header, admin data
+             int globalDataLength,
+             int maxMessageSize,              // of the sending SNMP entity
+             const OctetStr &securityEngineID,// authoritative SNMP entity
+             const OctetStr &securityName,    // on behalf of this principal
+             int  securityLevel,              // Level of Security requested
+             int scopedPDULength,             // at the end of wholeMsg
+             struct SecurityStateReference *securityStateReference,
+             unsigned char *wholeMsg,         // IN/OUT buffer for the message
+             int *wholeMsgLength)             // OUT length of generated message
+{
+  unsigned char privParams[SNMPv3_AP_MAXLENGTH_PRIVPARAM];
+  unsigned char authParams[SNMPv3_AP_MAXLENGTH_AUTHPARAM];
+  unsigned int privParamsLength = 0;
+  int authParamsLength = 0;
+  long int engineBoots = 0;
+  long int engineTime = 0;
+  unsigned char *msgEnd = wholeMsg + maxMessageSize;
+  unsigned char *msgPtr = msgEnd - scopedPDULength;
+  unsigned char *secParEnd;
+  unsigned char *authParPtr = NULL;
+  int restLength = maxMessageSize - scopedPDULength; // free Bytes in front
+  struct UsmUser *user = NULL;
+  struct UsmUser table_user;          // refers to the locked usmUserTable
+  bool table_locked = false;
   int rc;
-  int responseMsg = 0;
 
   if (securityStateReference) {
-    // this is a response message
-    responseMsg = 1;
     user = new UsmUser;
     if (!user)
       return SNMPv3_USM_ERROR;
@@ -1921,6 +2042,8 @@ int USM::generate_msg(
     user->privProtocol       = securityStateReference->privProtocol;
     user->privKeyLength      = securityStateReference->privKeyLength;
     user->privKey            = securityStateReference->privKey;
+    user->authHmacState      = 0;
+    user->authHmacStateLength = 0;
 
     delete securityStateReference;
     securityStateReference = NULL;
@@ -1937,12 +2060,40 @@ int USM::generate_msg(
     }
     else
     {
-      // search for user in usmUserTable
-      user = get_user(securityEngineID, securityName);
+      // A localized user is used in place, the usmUserTable stays read
+      // locked until the message is complete. Other users are localized
+      // and copied by get_user().
+      usm_user_table->lock_read();
+      const struct UsmUserTableEntry *entry =
+        usm_user_table->get_entry(securityEngineID, securityName);
+      if (entry)
+      {
+        table_user.engineID            = entry->usmUserEngineID;
+        table_user.engineIDLength      = entry->usmUserEngineIDLength;
+        table_user.usmUserName         = entry->usmUserName;
+        table_user.usmUserNameLength   = entry->usmUserNameLength;
+        table_user.securityName        = entry->usmUserSecurityName;
+        table_user.securityNameLength  = entry->usmUserSecurityNameLength;
+        table_user.authProtocol        = entry->usmUserAuthProtocol;
+        table_user.authKey             = entry->usmUserAuthKey;
+        table_user.authKeyLength       = entry->usmUserAuthKeyLength;
+        table_user.privProtocol        = entry->usmUserPrivProtocol;
+        table_user.privKey             = entry->usmUserPrivKey;
+        table_user.privKeyLength       = entry->usmUserPrivKeyLength;
+        table_user.authHmacState       = entry->authHmacState;
+        table_user.authHmacStateLength = entry->authHmacStateLength;
+        user = &table_user;
+        table_locked = true;
+      }
+      else
+      {
+        usm_user_table->unlock_read();
+        user = get_user(securityEngineID, securityName);
 
-      if (!user) {
-	debugprintf(0, "USM: User unknown!");
-	return SNMPv3_USM_UNKNOWN_SECURITY_NAME;
+        if (!user) {
+          debugprintf(0, "USM: User unknown!");
+          return SNMPv3_USM_UNKNOWN_SECURITY_NAME;
+        }
       }
     }
   }
@@ -1951,7 +2102,7 @@ int USM::generate_msg(
   {
     debugprintf(0, "engine_id too long %i > %i",
 		securityEngineID.len(), MAXLENGTH_ENGINEID);
-    free_user(user);
+    release_user(user, table_locked);
     return SNMPv3_USM_ERROR;
   }
 
@@ -1959,59 +2110,62 @@ int USM::generate_msg(
   {
     debugprintf(0, "user name too long %i > %i",
 		user->usmUserNameLength, MAXLEN_USMUSERNAME);
-    free_user(user);
+    release_user(user, table_locked);
     return SNMPv3_USM_ERROR;
   }
 
-  usmSecurityParams.msgAuthoritativeEngineIDLength = securityEngineID.len();
-  usmSecurityParams.msgUserNameLength = user->usmUserNameLength;
-  memcpy(usmSecurityParams.msgUserName,
-         user->usmUserName, user->usmUserNameLength);
-  memcpy(usmSecurityParams.msgAuthoritativeEngineID,
-         securityEngineID.data(), securityEngineID.len());
-
-  usmSecurityParams.msgPrivacyParametersLength = 0;
-  usmSecurityParams.msgPrivacyParameters = NULL;
-
-  usmSecurityParams.msgAuthenticationParametersLength = 0;
-  usmSecurityParams.msgAuthenticationParameters = NULL;
 
   if (securityLevel >= SNMP_SECURITY_LEVEL_AUTH_NOPRIV)
   {
     // get engineBoots, engineTime
-    rc = usm_time_table->get_time(
-                           securityEngineID,
-                           usmSecurityParams.msgAuthoritativeEngineBoots,
-                           usmSecurityParams.msgAuthoritativeEngineTime);
+    rc = usm_time_table->get_time(securityEngineID, engineBoots, engineTime);
     if (rc == SNMPv3_USM_UNKNOWN_ENGINEID) {
-      usm_time_table->add_entry(securityEngineID,
-                                usmSecurityParams.msgAuthoritativeEngineBoots,
-                                usmSecurityParams.msgAuthoritativeEngineTime);
+      usm_time_table->add_entry(securityEngineID, engineBoots, engineTime);
     }
     if (rc == SNMPv3_USM_ERROR) {
       debugprintf(0, "usm: usmGetTime error.");
-      free_user(user);
+      release_user(user, table_locked);
+      return SNMPv3_USM_ERROR;
+    }
+
+    authParamsLength = auth_priv->get_auth_params_len(user->authProtocol);
+    if (authParamsLength > SNMPv3_AP_MAXLENGTH_AUTHPARAM)
+    {
+      debugprintf(0, "usm: Encoding Error");
+      release_user(user, table_locked);
       return SNMPv3_USM_ERROR;
     }
+    memset(authParams, 0, authParamsLength);
   }
 
   if (securityLevel == SNMP_SECURITY_LEVEL_AUTH_PRIV)
   {
-    usmSecurityParams.msgPrivacyParametersLength
-             = auth_priv->get_priv_params_len(user->privProtocol);
-    usmSecurityParams.msgPrivacyParameters
-             = new unsigned char[usmSecurityParams.msgPrivacyParametersLength];
+    unsigned int encryptedLength = 0;
+
+    privParamsLength = auth_priv->get_priv_params_len(user->privProtocol);
+    if ((privParamsLength > SNMPv3_AP_MAXLENGTH_PRIVPARAM) ||
+        (restLength < USM_MAX_PRIV_PADDING))
+    {
+      debugprintf(0, "usm: Encoding Error");
+      release_user(user, table_locked);
+      return SNMPv3_USM_ERROR;
+    }
+
+    // All ciphers encrypt block by block, so the scopedPDU is
+    // encrypted in place. Move it to the front first to make room
+    // for the padding.
+    memmove(msgPtr - USM_MAX_PRIV_PADDING, msgPtr, scopedPDULength);
+    msgPtr -= USM_MAX_PRIV_PADDING;
+    restLength -= USM_MAX_PRIV_PADDING;
 
     // encrypt Message
     int enc_result = auth_priv->encrypt_msg(
                                user->privProtocol,
 			       user->privKey, user->privKeyLength,
-                               scopedPDU, scopedPDULength,
-                               buf2Ptr, &buf2Length,
-                               usmSecurityParams.msgPrivacyParameters,
-                               &usmSecurityParams.msgPrivacyParametersLength,
-                               usmSecurityParams.msgAuthoritativeEngineBoots,
-			       usmSecurityParams.msgAuthoritativeEngineTime);
+                               msgPtr, scopedPDULength,
+                               msgPtr, &encryptedLength,
+                               privParams, &privParamsLength,
+                               engineBoots, engineTime);
     if (enc_result != SNMPv3_USM_OK)
     {
       int return_value;
@@ -2028,117 +2182,115 @@ int USM::generate_msg(
 
       debugprintf(0, "usm: Encryption error (result %i).", enc_result);
 
-      delete_sec_parameters(&usmSecurityParams);
-      free_user(user);
+      release_user(user, table_locked);
       return return_value;
     }
+    if (encryptedLength > (unsigned int)scopedPDULength + USM_MAX_PRIV_PADDING)
+    {
+      debugprintf(0, "usm: Encryption error (length %i).", encryptedLength);
+      release_user(user, table_locked);
+      return SNMPv3_USM_ENCRYPTION_ERROR;
+    }
+    msgEnd = msgPtr + encryptedLength;
 
-    bufPtr = asn_build_string(bufPtr, &restLength, ASN_UNI_PRIM | ASN_OCTET_STR,
-                              buf2Ptr, buf2Length);
-    if (!bufPtr) {
+    msgPtr = asn_rbuild_header(msgPtr, &restLength,
+                               ASN_UNI_PRIM | ASN_OCTET_STR, encryptedLength);
+    if (!msgPtr) {
       debugprintf(0, "usm: Encoding Error");
-      free_user(user);
+      release_user(user, table_locked);
       return SNMPv3_USM_ERROR;
     }
-    bufLength = SAFE_INT_CAST(bufPtr - buffer.get_ptr());
-    totalLength =  bufLength;
-    bufPtr = buffer.get_ptr();
-    memcpy(buf2Ptr, bufPtr, bufLength);
-    buf2Length = bufLength;
-
-  } else { // (securityLevel != SNMP_SECURITY_LEVEL_AUTH_PRIV)
-    buf2Ptr = scopedPDU;
-    buf2Length = scopedPDULength;
-    totalLength = scopedPDULength;
-  }
-  if (!bufPtr) {
-    debugprintf(0, "usm: Encoding Error");
-    free_user(user);
-    return SNMPv3_USM_ERROR;
   }
 
-  totalLength += SAFE_INT_CAST(bufPtr - buffer.get_ptr());
-  memcpy(bufPtr, buf2Ptr, buf2Length);
-  bufLength = totalLength;
-
   debugprintf(21, "buf after privacy:");
-  debughexprintf(21, buffer.get_ptr(), bufLength);
+  debughexprintf(21, msgPtr, SAFE_INT_CAST(msgEnd - msgPtr));
+
+  // msgSecurityParameters, the authentication parameters are zero
+  // until the digest of the whole message is computed
+  secParEnd = msgPtr;
+  msgPtr = asn_rbuild_string(msgPtr, &restLength, ASN_UNI_PRIM | ASN_OCTET_STR,
+                             privParams, privParamsLength);
+  if (msgPtr) {
+    authParPtr = msgPtr - authParamsLength;
+    msgPtr = asn_rbuild_string(msgPtr, &restLength,
+                               ASN_UNI_PRIM | ASN_OCTET_STR,
+                               authParams, authParamsLength);
+  }
+  if (msgPtr)
+    msgPtr = asn_rbuild_string(msgPtr, &restLength,
+                               ASN_UNI_PRIM | ASN_OCTET_STR,
+                               user->usmUserName, user->usmUserNameLength);
+  if (msgPtr)
+    msgPtr = asn_rbuild_int(msgPtr, &restLength, ASN_UNI_PRIM | ASN_INTEGER,
+                            engineTime);
+  if (msgPtr)
+    msgPtr = asn_rbuild_int(msgPtr, &restLength, ASN_UNI_PRIM | ASN_INTEGER,
+                            engineBoots);
+  if (msgPtr)
+    msgPtr = asn_rbuild_string(msgPtr, &restLength,
+                               ASN_UNI_PRIM | ASN_OCTET_STR,
+                               securityEngineID.data(), securityEngineID.len());
+  if (msgPtr)
+    msgPtr = asn_rbuild_header(msgPtr, &restLength, ASN_SEQ_CON,
+                               SAFE_INT_CAST(secParEnd - msgPtr));
+  if (msgPtr)
+    msgPtr = asn_rbuild_header(msgPtr, &restLength,
+                               ASN_UNI_PRIM | ASN_OCTET_STR,
+                               SAFE_INT_CAST(secParEnd - msgPtr));
+
+  // globalData is already encoded as sequence
+  if (msgPtr) {
+    if (restLength < globalDataLength)
+      msgPtr = NULL;
+    else {
+      msgPtr -= globalDataLength;
+      restLength -= globalDataLength;
+      memcpy(msgPtr, globalData, globalDataLength);
+    }
+  }
+  if (msgPtr)
+    msgPtr = asn_rbuild_int(msgPtr, &restLength, ASN_UNI_PRIM | ASN_INTEGER,
+                            SNMP_VERSION_3);
+  if (msgPtr)
+    msgPtr = asn_rbuild_header(msgPtr, &restLength, ASN_SEQ_CON,
+                               SAFE_INT_CAST(msgEnd - msgPtr));
+  if (!msgPtr) {
+    debugprintf(0, "usm: could not generate wholeMsg");
+    release_user(user, table_locked);
+    return SNMPv3_USM_ERROR;
+  }
 
-  wholeMsgPtr = wholeMsg;
+  *wholeMsgLength = SAFE_INT_CAST(msgEnd - msgPtr);
+  if (msgPtr != wholeMsg)
+  {
+    memmove(wholeMsg, msgPtr, *wholeMsgLength);
+    authParPtr -= msgPtr - wholeMsg;
+  }
 
   if (securityLevel >= SNMP_SECURITY_LEVEL_AUTH_NOPRIV)
   {
-    /* Build message with authentication */
-    usmSecurityParams.msgAuthenticationParametersLength
-                         = auth_priv->get_auth_params_len(user->authProtocol);
-    usmSecurityParams.msgAuthenticationParameters
-      = new unsigned char[usmSecurityParams.msgAuthenticationParametersLength];
-    memset((char*)(usmSecurityParams.msgAuthenticationParameters), 0,
-           usmSecurityParams.msgAuthenticationParametersLength);
-
-    wholeMsgPtr = build_whole_msg(wholeMsgPtr, &maxMessageSize,
-				  globalData, globalDataLength,
-				  &startAuthPar, // for MD5, SHA,...
-				  usmSecurityParams,
-				  buffer.get_ptr(),
-				  bufLength);   // the msgData
-    if (wholeMsgPtr == NULL)
-    {
-      debugprintf(0, "usm: could not generate wholeMsg");
-      delete_sec_parameters(&usmSecurityParams);
-      free_user(user);
-      return SNMPv3_USM_ERROR;
-    }
-    *wholeMsgLength = SAFE_INT_CAST(wholeMsgPtr - wholeMsg);
-
     rc = auth_priv->auth_out_msg(user->authProtocol,
                                  user->authKey,
                                  wholeMsg, *wholeMsgLength,
-                                 wholeMsg + startAuthPar);
+                                 authParPtr, user->authHmacState);
 
     if (rc!=SNMPv3_USM_OK)
     {
       debugprintf(0, "usm: Authentication error for outgoing message."
                   " error code (%i).", rc);
-      delete_sec_parameters(&usmSecurityParams);
-      free_user(user);
+      release_user(user, table_locked);
       return rc;
     }
   }
-  else
-  {
-    //build Message without authentication
-
-    // Set engineBoots and enigneTime to zero!
-    usmSecurityParams.msgAuthoritativeEngineBoots = 0;
-    usmSecurityParams.msgAuthoritativeEngineTime  = 0;
-
-    usmSecurityParams.msgAuthenticationParametersLength = 0;
-    usmSecurityParams.msgAuthenticationParameters = 0;
-
-    wholeMsgPtr = build_whole_msg(wholeMsgPtr, &maxMessageSize,
-				  globalData, globalDataLength,
-				  &startAuthPar, // dummy ( no auth)
-				  usmSecurityParams,
-				  buffer.get_ptr(),
-				  bufLength);   // the msgData
-    if (wholeMsgPtr == NULL) {
-      debugprintf(0, "usm: could not generate wholeMsg");
-      delete_sec_parameters(&usmSecurityParams);
-      free_user(user);
-      return SNMPv3_USM_ERROR;
-    }
-    *wholeMsgLength = SAFE_INT_CAST(wholeMsgPtr - wholeMsg);
-  }
 
   debugprintf(21, "Complete Whole Msg:");
   debughexprintf(21, wholeMsg, *wholeMsgLength);
 
-  delete_sec_parameters(&usmSecurityParams);
-  free_user(user);
+  release_user(user, table_locked);
   return SNMPv3_USM_OK;
 }
 
+
 int USM::process_msg(
             int maxMessageSize,               // of the sending SNMP entity
             unsigned char *securityParameters,// for the received message
@@ -2167,12 +2319,16 @@ int USM::process_msg(
   unsigned char privParam[SNMPv3_AP_MAXLENGTH_PRIVPARAM];
   int authParamLength = SNMPv3_AP_MAXLENGTH_AUTHPARAM;
   int privParamLength = SNMPv3_AP_MAXLENGTH_PRIVPARAM;
-  Buffer<unsigned char> encryptedScopedPDU(MAX_SNMP_PACKET);
+  Buffer<unsigned char> encryptedScopedPDU(msgDataLength);
   int encryptedScopedPDULength = msgDataLength;
+  int scopedPDUBufferLength = msgDataLength;
   struct UsmUser *user = NULL;
   int rc;
   int notInTime = 0;
 
+  // nothing in the scopedPDU buffer yet, v3MP must not parse it
+  *scopedPDULength = 0;
+
   // check securityParameters
   sp = asn_parse_header( sp, &spLength, &type);
   if (sp == NULL){
@@ -2361,7 +2517,7 @@ int USM::process_msg(
                                  user->authKey,
                                  wholeMsg, wholeMsgLength,
                                  wholeMsg + authParametersPosition,
-				 authParamLength);
+				 authParamLength, user->authHmacState);
     if (rc != SNMPv3_USM_OK)
     {
       switch (rc)
@@ -2402,8 +2558,6 @@ int USM::process_msg(
     }
   }
 
-  *scopedPDULength = MAX_SNMP_PACKET;
-
   // decrypt ScopedPDU if message is in time window
   if ((securityLevel == SNMP_SECURITY_LEVEL_AUTH_PRIV)
       && (!notInTime)) {
@@ -2416,8 +2570,9 @@ int USM::process_msg(
       return SNMPv3_USM_PARSE_ERROR;
     }
 
-    // decrypt Message
-    unsigned int tmp_length = *scopedPDULength;
+    // decrypt Message, the plaintext is not longer than the message data
+    unsigned int tmp_length = scopedPDUBufferLength;
+    *scopedPDULength = 0;
     int dec_result = auth_priv->decrypt_msg(
                                   user->privProtocol,
                                   user->privKey, user->privKeyLength,
@@ -2426,7 +2581,6 @@ int USM::process_msg(
                                   scopedPDU, &tmp_length,
                                   (unsigned char*)&privParam, privParamLength,
 				  engineBoots, engineTime);
-    *scopedPDULength = tmp_length;
     if (dec_result != SNMPv3_USM_OK)
     {
       int return_value;
@@ -2448,16 +2602,18 @@ int USM::process_msg(
     }
 
     debugprintf(21, "scopedPDU(1):");
-    debughexprintf(21, scopedPDU, *scopedPDULength);
+    debughexprintf(21, scopedPDU, tmp_length);
 
     // test for decryption error
     // first byte 0x30
-    if (scopedPDU[0] != (ASN_CONSTRUCTOR | ASN_SEQUENCE)) {
+    if ((tmp_length == 0) ||
+        (scopedPDU[0] != (ASN_CONSTRUCTOR | ASN_SEQUENCE))) {
       debugprintf(0, "Decryption error detected");
       inc_stats_decryption_errors();
       free_user(user);
       return SNMPv3_USM_DECRYPTION_ERROR;
     }
+    *scopedPDULength = tmp_length;
   }
   else {
     // message was not encrypted
@@ -2489,202 +2645,6 @@ int USM::process_msg(
   return SNMPv3_USM_OK;
 }
 
-unsigned char *USM::build_sec_params(unsigned char *outBuf, int *maxLength,
-				     struct UsmSecurityParameters sp,
-				     int *position)
-{
-  Buffer<unsigned char> buf(MAX_SNMP_PACKET);
-  unsigned char *bufPtr = buf.get_ptr();
-  unsigned char *outBufPtr = outBuf;
-  int length = *maxLength;
-  int totalLength;
-
-  debugprintf(5, "Coding octstr sp.msgAuthoritativeEngineID, length = 0x%lx",
-	      sp.msgAuthoritativeEngineIDLength);
-  bufPtr = asn_build_string(bufPtr, &length,
-                            ASN_UNI_PRIM | ASN_OCTET_STR,
-                            sp.msgAuthoritativeEngineID,
-                            sp.msgAuthoritativeEngineIDLength);
-  if (bufPtr == NULL) {
-    debugprintf(0, "usmBuildSecurityParameters error coding engineid");
-    return NULL;
-  }
-
-  debugprintf(5, "Coding int sp.msgAuthoritativeEngineBoots = 0x%lx",
-	      sp.msgAuthoritativeEngineBoots);
-  bufPtr = asn_build_int(bufPtr, &length, ASN_UNI_PRIM | ASN_INTEGER,
-                         &sp.msgAuthoritativeEngineBoots);
-
-  if (bufPtr == NULL) {
-    debugprintf(0, "usmBuildSecurityParameters error coding engineboots");
-    return NULL;
-  }
-
-  debugprintf(5, "Coding int sp.msgAuthoritativeEngineTime = 0x%lx",
-	      sp.msgAuthoritativeEngineTime);
-  bufPtr = asn_build_int(bufPtr, &length, ASN_UNI_PRIM | ASN_INTEGER,
-                         &sp.msgAuthoritativeEngineTime);
-
-  if (bufPtr == NULL) {
-    debugprintf(0, "usmBuildSecurityParameters error coding enginetime");
-    return NULL;
-  }
-
-  debugprintf(5, "Coding octstr sp.msgUserName, length = 0x%lx",
-	      sp.msgUserNameLength);
-  bufPtr = asn_build_string(bufPtr, &length, ASN_UNI_PRIM | ASN_OCTET_STR,
-                            sp.msgUserName, sp.msgUserNameLength);
-  if (bufPtr == NULL) {
-    debugprintf(0, "usmBuildSecurityParameters error coding msgusername");
-    return NULL;
-  }
-
-  *position = SAFE_INT_CAST(bufPtr - buf.get_ptr()) + 2;
-
-  debugprintf(5, "Coding octstr sp.msgAu..Para.. , length = 0x%lx",
-	      sp.msgAuthenticationParametersLength);
-  bufPtr = asn_build_string(bufPtr, &length, ASN_UNI_PRIM | ASN_OCTET_STR,
-                            sp.msgAuthenticationParameters,
-                            sp.msgAuthenticationParametersLength);
-
-  if (bufPtr == NULL) {
-    debugprintf(0, "usmBuildSecurityParameters error coding authparams");
-    return NULL;
-  }
-
-  debugprintf(5, "Coding octstr sp.msgPr..Para.. , length = 0x%lx",
-	      sp.msgPrivacyParametersLength);
-  bufPtr = asn_build_string(bufPtr, &length, ASN_UNI_PRIM | ASN_OCTET_STR,
-                            sp.msgPrivacyParameters,
-                            sp.msgPrivacyParametersLength);
-
-  if (bufPtr == NULL) {
-    debugprintf(0, "usmBuildSecurityParameters error coding privparams");
-    return NULL;
-  }
-
-  totalLength = SAFE_INT_CAST(bufPtr - buf.get_ptr());
-
-  debugprintf(5, "Coding sequence (securityPar), length = 0x%x", totalLength);
-  outBufPtr = asn_build_sequence(outBufPtr, maxLength, ASN_SEQ_CON,
-                                 totalLength);
-
-  if (outBufPtr == NULL) {
-    debugprintf(0, "usm: usmBuildSecurityParameters error coding secparams");
-    return NULL;
-  }
-
-  if (*maxLength < totalLength) {
-    debugprintf(0, "usm: usmBuildSecurityParameters error (length mismatch)");
-    return NULL;
-  }
-  *position += SAFE_INT_CAST(outBufPtr - outBuf);
-  memcpy(outBufPtr, buf.get_ptr(), totalLength);
-  outBufPtr += totalLength;
-  *maxLength -= totalLength;
-
-  debugprintf(21, "bufSecurityData:");
-  debughexprintf(21, outBuf, SAFE_INT_CAST(outBufPtr - outBuf));
-
-  return outBufPtr;
-}
-
-unsigned char *USM::build_whole_msg(
-                         unsigned char *outBuf, int *maxLength,
-			 unsigned char *globalData, long int globalDataLength,
-			 int *positionAuthPar,
-			 struct UsmSecurityParameters  securityParameters,
-			 unsigned char *msgData, long int msgDataLength)
-{
-  Buffer<unsigned char> buf(MAX_SNMP_PACKET);
-  unsigned char *bufPtr = buf.get_ptr();
-  Buffer<unsigned char> secPar(MAX_SNMP_PACKET);
-  unsigned char *secParPtr = secPar.get_ptr();
-  unsigned char *outBufPtr = outBuf;
-  long int secParLength;
-  int length = *maxLength;
-  int totalLength;
-
-  int dummy = *maxLength;
-
-  secParPtr = build_sec_params(secParPtr, &dummy, securityParameters,
-			       positionAuthPar);
-
-  if (!secParPtr)
-    return NULL;
-  secParLength = SAFE_INT_CAST(secParPtr - secPar.get_ptr());
-
-  long int dummyVersion = 3;
-  debugprintf(3, "Coding int snmpVersion = 0x%lx",dummyVersion);
-  bufPtr = asn_build_int(bufPtr, &length, ASN_UNI_PRIM | ASN_INTEGER,
-                         &dummyVersion);
-  if (bufPtr == NULL) {
-    debugprintf(0, "usmBuildWholeMsg error");
-    return NULL;
-  }
-
-  // globalData is encoded as sequence
-  length -= globalDataLength;
-  if (length < 0) {
-    debugprintf(0, "usmBuildWholeMsg error");
-    return NULL;
-  }
-  memcpy(bufPtr, globalData, globalDataLength);
-  bufPtr += globalDataLength;
-
-  *positionAuthPar += SAFE_INT_CAST(bufPtr - buf.get_ptr()) +2;
-  if (secParLength> 0x7f)
-    *positionAuthPar += 2;
-
-  debugprintf(3, "Coding octstr securityParameter, length = 0x%lx",
-              secParLength);
-  bufPtr = asn_build_string(bufPtr, &length, ASN_UNI_PRIM | ASN_OCTET_STR,
-                            secPar.get_ptr(), secParLength);
-
-  if (bufPtr == NULL) {
-    debugprintf(0, "usmBuildWholeMsg error2");
-    return NULL;
-  }
-
-  // msgData (ScopedPduData) is encoded
-  length -=msgDataLength;
-  if (length < 0) {
-    debugprintf(10, "usmBuildWholeMsg error: msgDataLength = %i",
-                msgDataLength);
-    debugprintf(10, "maxLength = %i, encoded = %i", *maxLength,
-                SAFE_INT_CAST(bufPtr - buf.get_ptr()));
-    return NULL;
-  }
-  memcpy(bufPtr, msgData, msgDataLength);
-  bufPtr += msgDataLength;
-
-  totalLength = SAFE_INT_CAST(bufPtr - buf.get_ptr());
-
-  debugprintf(3, "Coding sequence (wholeMsg), length = 0x%x", totalLength);
-
-  outBufPtr = asn_build_sequence(outBufPtr, maxLength, ASN_SEQ_CON,
-                                 totalLength);
-
-  if (outBufPtr == NULL) {
-    debugprintf(0, "usm: usmBuildWholeMsg error");
-    return NULL;
-  }
-
-  if (*maxLength < totalLength) {
-    debugprintf(0, "usm: usmBuildWholeMsg error");
-    return NULL;
-  }
-  *positionAuthPar += SAFE_INT_CAST(outBufPtr - outBuf);
-  memcpy(outBufPtr, buf.get_ptr(), totalLength);
-  outBufPtr += totalLength;
-  *maxLength -= totalLength;
-
-  debugprintf(21,"bufWholeMsg:");
-  debughexprintf(21, outBuf, SAFE_INT_CAST(outBufPtr - outBuf));
-
-  return outBufPtr;
-}
-
 inline void USM::delete_user_ptr(struct UsmUser *user)
 {
   if (!user) return;
@@ -2710,6 +2670,11 @@ inline void USM::delete_user_ptr(struct UsmUser *user)
     delete [] user->privKey;
     user->authKey = NULL;
   }
+  if (user->authHmacState) {
+    memset(user->authHmacState, 0, user->authHmacStateLength);
+    delete [] user->authHmacState;
+    user->authHmacState = NULL;
+  }
 }
 
 // Save all localized users into a file.
@@ -2736,10 +2701,69 @@ int USM::load_users(const char *file)
   return usm_user_name_table->load_from_file(file, auth_priv);
 }
 
+// Save the keys generated from passwords into a file.
+int USM::save_key_cache(const char *file,
+                        const unsigned char *file_key,
+                        const unsigned int   file_key_len)
+{
+  return auth_priv->get_key_cache()->save_to_file(file, auth_priv,
+                                                  file_key, file_key_len);
+}
+
+// Load the keys generated from passwords from a file.
+int USM::load_key_cache(const char *file,
+                        const unsigned char *file_key,
+                        const unsigned int   file_key_len)
+{
+  return auth_priv->get_key_cache()->load_from_file(file, auth_priv,
+                                                    file_key, file_key_len);
+}
+
+// Generate the master keys of all users, in parallel.
+int USM::derive_user_keys(const int threads)
+{
+  // Collect the passwords, the keys are generated without the lock
+  usm_user_name_table->lock_read();
+  int count = 0;
+  const UsmUserNameTableEntry *e;
+  for (e = usm_user_name_table->peek_first(); e;
+       e = usm_user_name_table->peek_next(e))
+    count += 2;
+
+  int *prots = new int[count ? count : 1];
+  OctetStr *passwords = new OctetStr[count ? count : 1];
+  count = 0;
+  for (e = usm_user_name_table->peek_first(); e;
+       e = usm_user_name_table->peek_next(e))
+  {
+    if (e->usmUserAuthProtocol == SNMP_AUTHPROTOCOL_NONE)
+      continue;
+
+    // The privacy key is generated with the authentication protocol
+    prots[count] = e->usmUserAuthProtocol;
+    passwords[count++].set_data(e->authPassword, e->authPasswordLength);
+    if (e->usmUserPrivProtocol != SNMP_PRIVPROTOCOL_NONE)
+    {
+      prots[count] = e->usmUserAuthProtocol;
+      passwords[count++].set_data(e->privPassword, e->privPasswordLength);
+    }
+  }
+  usm_user_name_table->unlock_read();
+
+  int res = auth_priv->derive_master_keys(prots, passwords, count, threads);
+
+  for (int i = 0; i < count; i++)
+    passwords[i].clear();
+  delete [] prots;
+  delete [] passwords;
+
+  return res;
+}
+
 // Lock the UsmUserNameTable for access through peek_first/next_user()
 void USM::lock_user_name_table()
 {
-  usm_user_name_table->lock();
+  usm_user_name_table->lock_read();
 }
 
 // Get a const pointer to the first entry of the UsmUserNameTable.
@@ -2757,13 +2781,13 @@ const UsmUserNameTableEntry *USM::peek_next_user(const UsmUserNameTableEntry *e)
 // Unlock the UsmUserNameTable after access through peek_first/next_user()
 void USM::unlock_user_name_table()
 {
-  usm_user_name_table->unlock();
+  usm_user_name_table->unlock_read();
 }
 
 // Lock the UsmUserTable for access through peek_first/next_luser()
 void USM::lock_user_table()
 {
-  usm_user_table->lock();
+  usm_user_table->lock_read();
 }
 
 // Get a const pointer to the first entry of the UsmUserTable.
@@ -2781,7 +2805,7 @@ const UsmUserTableEntry *USM::peek_next_luser(const UsmUserTableEntry *e)
 // Unlock the UsmUserTable after access through peek_first/next_luser()
 void USM::unlock_user_table()
 {
-  usm_user_table->unlock();
+  usm_user_table->unlock_read();
 }
 
 
@@ -2819,6 +2843,13 @@ USMTimeTable::USMTimeTable(const USM *owner,
   entries = 1;
   max_entries = 5;
 
+  if (!index.resize(max_entries))
+  {
+    result = SNMPv3_USM_ERROR;
+    return;
+  }
+  index.add(0, v3hash(table[0].engine_id, table[0].engine_id_len));
+
   result = SNMPv3_USM_OK;
 }
 
@@ -2857,6 +2888,12 @@ int USMTimeTable::add_entry(const OctetStr &engine_id,
     if (!tmp)
       return SNMPv3_USM_ERROR;
 
+    if (!index.resize(4 * max_entries))
+    {
+      delete [] tmp;
+      return SNMPv3_USM_ERROR;
+    }
+
     memcpy(tmp, table, entries * sizeof(Entry_T));
 
     struct Entry_T *victim = table;
@@ -2877,6 +2914,8 @@ int USMTimeTable::add_entry(const OctetStr &engine_id,
                                      MAXLENGTH_ENGINEID);
   memcpy(table[entries].engine_id,
 	 engine_id.data(), table[entries].engine_id_len);
+  index.add(entries, v3hash(table[entries].engine_id,
+                            table[entries].engine_id_len));
 
   entries++;
 
@@ -2896,17 +2935,19 @@ int USMTimeTable::delete_entry(const OctetStr &engine_id)
 
   BEGIN_REENTRANT_CODE_BLOCK;
 
-  for (int i=1; i < entries; i++) /* start from 1 */
-    if (unsignedCharCompare(table[i].engine_id, table[i].engine_id_len,
-                            engine_id.data(), engine_id.len()))
+  int i = find(engine_id);
+  if (i > 0) /* never delete the local engine id */
+  {
+    if (i != entries - 1)
     {
-      if (i != entries - 1)
-	table[i] = table[entries - 1];
-
-      entries--;
-
-      return SNMPv3_USM_OK;
+      table[i] = table[entries - 1];
+      index.move(entries - 1, i);
     }
+    else
+      index.remove(i);
+
+    entries--;
+  }
 
   return SNMPv3_USM_OK;
 }
@@ -2916,7 +2957,7 @@ unsigned long USMTimeTable::get_local_time()
   if (!table)
     return 0;
 
-  BEGIN_REENTRANT_CODE_BLOCK;
+  BEGIN_READ_CODE_BLOCK;
 
   time_t now;
   time(&now);
@@ -2930,7 +2971,7 @@ int USMTimeTable::get_local_time(long int &engine_boots,
   if (!table)
     return SNMPv3_USM_ERROR;
 
-  BEGIN_REENTRANT_CODE_BLOCK;
+  BEGIN_READ_CODE_BLOCK;
 
   time_t now;
   time(&now);
@@ -2953,28 +2994,27 @@ int USMTimeTable::get_time(const OctetStr &engine_id,
   if (!table)
     return SNMPv3_USM_ERROR;
 
-  BEGIN_REENTRANT_CODE_BLOCK;
+  BEGIN_READ_CODE_BLOCK;
 
-  for (int i=0; i < entries; i++)
-    if (unsignedCharCompare(table[i].engine_id, table[i].engine_id_len,
-                            engine_id.data(), engine_id.len()))
-    {
-      /* Entry found */
-      time_t now;
-      time(&now);
+  int i = find(engine_id);
+  if (i >= 0)
+  {
+    /* Entry found */
+    time_t now;
+    time(&now);
 
-      engine_boots = table[i].engine_boots;
-      engine_time  = table[i].time_diff + SAFE_ULONG_CAST(now);
+    engine_boots = table[i].engine_boots;
+    engine_time  = table[i].time_diff + SAFE_ULONG_CAST(now);
 
-      LOG_BEGIN(INFO_LOG | 4);
-      LOG("USMTimeTable: Returning time (engine id) (boot) (time)");
-      LOG(engine_id.get_printable());
-      LOG(engine_boots);
-      LOG(engine_time);
-      LOG_END;
+    LOG_BEGIN(INFO_LOG | 4);
+    LOG("USMTimeTable: Returning time (engine id) (boot) (time)");
+    LOG(engine_id.get_printable());
+    LOG(engine_boots);
+    LOG(engine_time);
+    LOG_END;
 
-      return SNMPv3_USM_OK;
-    }
+    return SNMPv3_USM_OK;
+  }
 
   /* no entry */
   engine_boots = 0;
@@ -2996,84 +3036,112 @@ int USMTimeTable::check_time(const OctetStr &engine_id,
   if (!table)
     return SNMPv3_USM_ERROR;
 
-  BEGIN_REENTRANT_CODE_BLOCK;
-
   time_t now;
   time(&now);
 
-  /* table[0] contains the local engine_id and time */
-  if (unsignedCharCompare(table[0].engine_id, table[0].engine_id_len,
-                          engine_id.data(), engine_id.len()))
   {
-    /* Entry found, we are authoritative */
-    if ((table[0].engine_boots == 2147483647) ||
-        (table[0].engine_boots != engine_boots) ||
-        (labs(SAFE_ULONG_CAST(now) + table[0].time_diff - engine_time) > 150))
+    // Only check the time window here, so checks do not block each other
+    BEGIN_READ_CODE_BLOCK;
+
+    int i = find(engine_id);
+
+    /* table[0] contains the local engine_id and time */
+    if (i == 0)
+    {
+      /* Entry found, we are authoritative */
+      if ((table[0].engine_boots == 2147483647) ||
+          (table[0].engine_boots != engine_boots) ||
+          (labs(SAFE_ULONG_CAST(now) + table[0].time_diff - engine_time) > 150))
+      {
+        LOG_BEGIN(DEBUG_LOG | 9);
+        LOG("USMTimeTable: Check time failed, authoritative (id) (boot) (time)");
+        LOG(engine_id.get_printable());
+        LOG(engine_boots);
+        LOG(engine_time);
+        LOG_END;
+
+        return SNMPv3_USM_NOT_IN_TIME_WINDOW;
+      }
+      else
+      {
+        LOG_BEGIN(DEBUG_LOG | 9);
+        LOG("USMTimeTable: Check time ok, authoritative (id)");
+        LOG(engine_id.get_printable());
+        LOG_END;
+
+        return SNMPv3_USM_OK;
+      }
+    }
+
+    if (i < 0)
     {
       LOG_BEGIN(DEBUG_LOG | 9);
-      LOG("USMTimeTable: Check time failed, authoritative (id) (boot) (time)");
+      LOG("USMTimeTable: Check time, engine id not found");
       LOG(engine_id.get_printable());
-      LOG(engine_boots);
-      LOG(engine_time);
       LOG_END;
 
-      return SNMPv3_USM_NOT_IN_TIME_WINDOW;
+      return SNMPv3_USM_UNKNOWN_ENGINEID;
     }
-    else
+
+    /* Entry found we are not authoritative */
+    if ((engine_boots < table[i].engine_boots) ||
+        ((engine_boots == table[i].engine_boots) &&
+         (table[i].time_diff + now > engine_time + 150)) ||
+        (table[i].engine_boots == 2147483647))
     {
       LOG_BEGIN(DEBUG_LOG | 9);
-      LOG("USMTimeTable: Check time ok, authoritative (id)");
+      LOG("USMTimeTable: Check time failed, not authoritative (id)");
       LOG(engine_id.get_printable());
       LOG_END;
 
-      return SNMPv3_USM_OK;
+      return SNMPv3_USM_NOT_IN_TIME_WINDOW;
     }
-  }
 
-  for (int i=1; i < entries; i++)
-    if (unsignedCharCompare(table[i].engine_id, table[i].engine_id_len,
-                            engine_id.data(), engine_id.len()))
+    if ((engine_boots < table[i].engine_boots) ||
+        ((engine_boots == table[i].engine_boots) &&
+         (engine_time <= table[i].latest_received_time)))
     {
-      /* Entry found we are not authoritative */
-      if ((engine_boots < table[i].engine_boots) ||
-          ((engine_boots == table[i].engine_boots) &&
-           (table[i].time_diff + now > engine_time + 150)) ||
-          (table[i].engine_boots == 2147483647))
-      {
-	LOG_BEGIN(DEBUG_LOG | 9);
-	LOG("USMTimeTable: Check time failed, not authoritative (id)");
-	LOG(engine_id.get_printable());
-	LOG_END;
+      LOG_BEGIN(DEBUG_LOG | 9);
+      LOG("USMTimeTable: Check time ok, not authoritative (id)");
+      LOG(engine_id.get_printable());
+      LOG_END;
 
-        return SNMPv3_USM_NOT_IN_TIME_WINDOW;
-      }
-      else
-      {
-        if ((engine_boots > table[i].engine_boots) ||
-            ((engine_boots == table[i].engine_boots) &&
-             (engine_time > table[i].latest_received_time)))
-        {
-          /* time ok, update values */
-          table[i].engine_boots = engine_boots;
-          table[i].latest_received_time  = engine_time;
-          table[i].time_diff = engine_time - SAFE_ULONG_CAST(now);
-        }
+      return SNMPv3_USM_OK;
+    }
+  }
 
-	LOG_BEGIN(DEBUG_LOG | 9);
-	LOG("USMTimeTable: Check time ok, not authoritative, updated (id)");
-	LOG(engine_id.get_printable());
-	LOG_END;
+  {
+    // time ok and newer than the latest received time, update values
+    BEGIN_REENTRANT_CODE_BLOCK;
 
-        return SNMPv3_USM_OK;
-      }
+    int i = find(engine_id);
+    if ((i > 0) &&
+        ((engine_boots > table[i].engine_boots) ||
+         ((engine_boots == table[i].engine_boots) &&
+          (engine_time > table[i].latest_received_time))))
+    {
+      table[i].engine_boots = engine_boots;
+      table[i].latest_received_time  = engine_time;
+      table[i].time_diff = engine_time - SAFE_ULONG_CAST(now);
     }
+  }
 
   LOG_BEGIN(DEBUG_LOG | 9);
-  LOG("USMTimeTable: Check time, engine id not found");
+  LOG("USMTimeTable: Check time ok, not authoritative, updated (id)");
   LOG(engine_id.get_printable());
   LOG_END;
 
-  return SNMPv3_USM_UNKNOWN_ENGINEID;
+  return SNMPv3_USM_OK;
+}
+
+int USMTimeTable::find(const OctetStr &engine_id) const
+{
+  for (int i = index.first(v3hash(engine_id.data(), engine_id.len()));
+       i >= 0; i = index.next(i))
+    if (unsignedCharCompare(table[i].engine_id, table[i].engine_id_len,
+                            engine_id.data(), engine_id.len()))
+      return i;
+  return -1;
 }
 
 
@@ -3084,12 +3152,10 @@ int USMTimeTable::check_engine_id(const OctetStr &engine_id)
 
   {
     // Begin reentrant code block
-    BEGIN_REENTRANT_CODE_BLOCK;
+    BEGIN_READ_CODE_BLOCK;
 
-    for (int i=0; i < entries; i++)
-      if (unsignedCharCompare(table[i].engine_id, table[i].engine_id_len,
-			      engine_id.data(), engine_id.len()))
-	return SNMPv3_USM_OK;
+    if (find(engine_id) >= 0)
+      return SNMPv3_USM_OK;
   }
 
   /* if in discovery mode:  accept all EngineID's (rfc2264 page 26) */
@@ -3119,6 +3185,12 @@ USMUserNameTable::USMUserNameTable(int &result)
   }
   max_entries = 10;
   entries = 0;
+  if (!user_name_index.resize(max_entries) ||
+      !security_name_index.resize(max_entries))
+  {
+    result = SNMPv3_USM_ERROR;
+    return;
+  }
   result = SNMPv3_USM_OK;
 }
 
@@ -3159,21 +3231,16 @@ int USMUserNameTable::add_entry(const OctetStr& user_name,
 
   BEGIN_REENTRANT_CODE_BLOCK;
 
-  int found=0;
-  int i;
-  for (i = 0; i < entries; i++)
-    if (table[i].usmUserName == user_name)
-    {
-      found=1;
-      break;
-    }
+  int i = find_user_name(user_name.data(), user_name.len());
 
-  if (found)
+  if (i >= 0)
   {
     /* replace user */
     table[i].usmUserSecurityName = security_name;
     table[i].usmUserAuthProtocol = auth_proto;
     table[i].usmUserPrivProtocol = priv_proto;
+    security_name_index.add(i, v3hash(security_name.data(),
+                                      security_name.len()));
 
     if (table[i].authPassword)
     {
@@ -3200,6 +3267,12 @@ int USMUserNameTable::add_entry(const OctetStr& user_name,
       tmp = new struct UsmUserNameTableEntry[4 * max_entries];
       if (!tmp)
         return SNMPv3_USM_ERROR;
+      if (!user_name_index.resize(4 * max_entries) ||
+          !security_name_index.resize(4 * max_entries))
+      {
+        delete [] tmp;
+        return SNMPv3_USM_ERROR;
+      }
       for (i=0; i < entries; i++)
         tmp[i] = table[i];
 
@@ -3225,6 +3298,9 @@ int USMUserNameTable::add_entry(const OctetStr& user_name,
     if (!table[entries].privPassword)
       return SNMPv3_USM_ERROR;
 
+    user_name_index.add(entries, v3hash(user_name.data(), user_name.len()));
+    security_name_index.add(entries, v3hash(security_name.data(),
+                                            security_name.len()));
     entries++;
   }
 
@@ -3238,36 +3314,74 @@ int USMUserNameTable::delete_security_name(const OctetStr& security_name)
 
   BEGIN_REENTRANT_CODE_BLOCK;
 
-  for (int i = 0; i < entries; i++)
-    if (table[i].usmUserSecurityName == security_name)
-    {
-      memset(table[i].authPassword, 0, table[i].authPasswordLength);
-      delete [] table[i].authPassword;
-      memset(table[i].privPassword, 0, table[i].privPasswordLength);
-      delete [] table[i].privPassword;
-      entries--;
-      if (entries > i)
-        table[i] = table[entries];
-      break;
-    }
+  int i = find_security_name(security_name.data(), security_name.len());
+  if (i >= 0)
+    delete_entry(i);
+
   return SNMPv3_USM_OK;
 }
 
+void USMUserNameTable::delete_entry(const int nr)
+{
+  memset(table[nr].authPassword, 0, table[nr].authPasswordLength);
+  delete [] table[nr].authPassword;
+  memset(table[nr].privPassword, 0, table[nr].privPasswordLength);
+  delete [] table[nr].privPassword;
+
+  entries--;
+  if (entries > nr)
+  {
+    table[nr] = table[entries];
+    user_name_index.move(entries, nr);
+    security_name_index.move(entries, nr);
+  }
+  else
+  {
+    user_name_index.remove(nr);
+    security_name_index.remove(nr);
+  }
+}
+
+int USMUserNameTable::find_user_name(const unsigned char *user_name,
+                                     const long int user_name_len) const
+{
+  for (int i = user_name_index.first(v3hash(user_name, user_name_len));
+       i >= 0; i = user_name_index.next(i))
+    if (unsignedCharCompare(table[i].usmUserName.data(),
+                            table[i].usmUserName.len(),
+                            user_name, user_name_len))
+      return i;
+  return -1;
+}
+
+int USMUserNameTable::find_security_name(const unsigned char *security_name,
+                                         const long int security_name_len) const
+{
+  for (int i = security_name_index.first(v3hash(security_name,
+                                                security_name_len));
+       i >= 0; i = security_name_index.next(i))
+    if (unsignedCharCompare(table[i].usmUserSecurityName.data(),
+                            table[i].usmUserSecurityName.len(),
+                            security_name, security_name_len))
+      return i;
+  return -1;
+}
+
 const struct UsmUserNameTableEntry* USMUserNameTable::get_entry(
                                           const OctetStr &security_name)
 {
   if (!table)
     return NULL;
 
-  for (int i = 0; i < entries; i++)
-    if (table[i].usmUserSecurityName == security_name)
-      return &table[i];
+  int i = find_security_name(security_name.data(), security_name.len());
+  if (i >= 0)
+    return &table[i];
   return NULL;
 }
 
 struct UsmUserNameTableEntry* USMUserNameTable::get_cloned_entry(const OctetStr &security_name)
 {
-  lock();
+  lock_read();
   const struct UsmUserNameTableEntry *e = get_entry(security_name);
   struct UsmUserNameTableEntry *res = 0;
 
@@ -3294,7 +3408,7 @@ struct UsmUserNameTableEntry* USMUserNameTable::get_cloned_entry(const OctetStr
     }
   }
 
-  unlock();
+  unlock_read();
   return res;
 }
 
@@ -3327,23 +3441,21 @@ int USMUserNameTable::get_security_name(const unsigned char *user_name,
   if (!table)
     return SNMPv3_USM_ERROR;
 
-  BEGIN_REENTRANT_CODE_BLOCK;
+  BEGIN_READ_CODE_BLOCK;
 
-  for (int i = 0; i < entries; i++)
-    if (unsignedCharCompare(table[i].usmUserName.data(),
-			    table[i].usmUserName.len(),
-                            user_name, user_name_len))
-    {
-      security_name = table[i].usmUserSecurityName;
+  int i = find_user_name(user_name, user_name_len);
+  if (i >= 0)
+  {
+    security_name = table[i].usmUserSecurityName;
 
-      LOG_BEGIN(INFO_LOG | 9);
-      LOG("USMUserNameTable: Translated (user name) to (security name)");
-      LOG(table[i].usmUserName.get_printable());
-      LOG(security_name.get_printable());
-      LOG_END;
+    LOG_BEGIN(INFO_LOG | 9);
+    LOG("USMUserNameTable: Translated (user name) to (security name)");
+    LOG(table[i].usmUserName.get_printable());
+    LOG(security_name.get_printable());
+    LOG_END;
 
-      return SNMPv3_USM_OK;
-    }
+    return SNMPv3_USM_OK;
+  }
 
   int logclass = WARNING_LOG;
   if (user_name_len == 0) logclass = INFO_LOG;
@@ -3366,35 +3478,33 @@ int USMUserNameTable::get_user_name(unsigned char *user_name,
   if (!table)
     return SNMPv3_USM_ERROR;
 
-  BEGIN_REENTRANT_CODE_BLOCK;
+  BEGIN_READ_CODE_BLOCK;
 
-  for (int i = 0; i < entries; i++)
-    if (unsignedCharCompare(table[i].usmUserSecurityName.data(),
-                            table[i].usmUserSecurityName.len(),
-                            security_name, security_name_len))
+  int i = find_security_name(security_name, security_name_len);
+  if (i >= 0)
+  {
+    if (buf_len < table[i].usmUserName.len())
     {
-      if (buf_len < table[i].usmUserName.len())
-      {
-          LOG_BEGIN(ERROR_LOG | 1);
-          LOG("USMUserNameTable: Buffer for user name too small (is) (should)");
-          LOG(buf_len);
-          LOG(table[i].usmUserName.len());
-          LOG_END;
-
-        return SNMPv3_USM_ERROR;
-      }
-      *user_name_len = table[i].usmUserName.len();
-      memcpy(user_name, table[i].usmUserName.data(),
-	     table[i].usmUserName.len());
+        LOG_BEGIN(ERROR_LOG | 1);
+        LOG("USMUserNameTable: Buffer for user name too small (is) (should)");
+        LOG(buf_len);
+        LOG(table[i].usmUserName.len());
+        LOG_END;
 
-      LOG_BEGIN(INFO_LOG | 9);
-      LOG("USMUserNameTable: Translated (security name) to (user name)");
-      LOG(table[i].usmUserSecurityName.get_printable());
-      LOG(table[i].usmUserName.get_printable());
-      LOG_END;
-
-      return SNMPv3_USM_OK;
+      return SNMPv3_USM_ERROR;
     }
+    *user_name_len = table[i].usmUserName.len();
+    memcpy(user_name, table[i].usmUserName.data(),
+	   table[i].usmUserName.len());
+
+    LOG_BEGIN(INFO_LOG | 9);
+    LOG("USMUserNameTable: Translated (security name) to (user name)");
+    LOG(table[i].usmUserSecurityName.get_printable());
+    LOG(table[i].usmUserName.get_printable());
+    LOG_END;
+
+    return SNMPv3_USM_OK;
+  }
 
   int logclass = WARNING_LOG;
   if (security_name_len == 0) logclass = INFO_LOG;
@@ -3450,7 +3560,7 @@ int USMUserNameTable::save_to_file(const char *name, AuthPriv *ap)
 
   {
     // Begin reentrant code block
-    BEGIN_REENTRANT_CODE_BLOCK;
+    BEGIN_READ_CODE_BLOCK;
 
     for (int i=0; i < entries; ++i)
     {
@@ -3695,7 +3805,8 @@ const UsmUserNameTableEntry *USMUserNameTable::peek_next(
 
 /* ---------------------------- USMUserTable ------------------- */
 
-USMUserTable::USMUserTable(int &result)
+USMUserTable::USMUserTable(AuthPriv *ap, int &result)
+  : auth_priv(ap)
 {
   entries = 0;
 
@@ -3706,6 +3817,12 @@ USMUserTable::USMUserTable(int &result)
     return;
   }
   max_entries = 10;
+
+  if (!engine_sec_name_index.resize(max_entries) ||
+      !engine_user_name_index.resize(max_entries) ||
+      !sec_name_index.resize(max_entries) ||
+      !user_name_index.resize(max_entries))
+    result = SNMPv3_USM_ERROR;
 }
 
 USMUserTable::~USMUserTable()
@@ -3730,6 +3847,11 @@ USMUserTable::~USMUserTable()
 	memset(table[i].usmUserPrivKey, 0, table[i].usmUserPrivKeyLength);
 	delete [] table[i].usmUserPrivKey;
       }
+      if (table[i].authHmacState)
+      {
+	memset(table[i].authHmacState, 0, table[i].authHmacStateLength);
+	delete [] table[i].authHmacState;
+      }
     }
     delete [] table;
     table = NULL;
@@ -3750,34 +3872,32 @@ int USMUserTable::get_user_name(unsigned char       *user_name,
   if (!table)
     return SNMPv3_USM_ERROR;
 
-  BEGIN_REENTRANT_CODE_BLOCK;
+  BEGIN_READ_CODE_BLOCK;
 
-  for (int i=0; i < entries; i++)
-    if (unsignedCharCompare(table[i].usmUserSecurityName,
-			    table[i].usmUserSecurityNameLength,
-			    sec_name, sec_name_len))
+  int i = find_security_name(sec_name, sec_name_len);
+  if (i >= 0)
+  {
+    if (buf_len < table[i].usmUserNameLength)
     {
-      if (buf_len < table[i].usmUserNameLength)
-      {
-	LOG_BEGIN(ERROR_LOG | 1);
-	LOG("USMUserTable: Buffer for user name too small (is) (should)");
-	LOG(buf_len);
-	LOG(table[i].usmUserNameLength);
-	LOG_END;
-
-	return SNMPv3_USM_ERROR;
-      }
-      *user_name_len = table[i].usmUserNameLength;
-      memcpy(user_name, table[i].usmUserName, table[i].usmUserNameLength);
-
-      LOG_BEGIN(INFO_LOG | 9);
-      LOG("USMUserTable: Translated (security name) to (user name)");
-      LOG(OctetStr(sec_name, sec_name_len).get_printable());
-      LOG(OctetStr(table[i].usmUserName, table[i].usmUserNameLength).get_printable());
+      LOG_BEGIN(ERROR_LOG | 1);
+      LOG("USMUserTable: Buffer for user name too small (is) (should)");
+      LOG(buf_len);
+      LOG(table[i].usmUserNameLength);
       LOG_END;
 
-      return SNMPv3_USM_OK;
+      return SNMPv3_USM_ERROR;
     }
+    *user_name_len = table[i].usmUserNameLength;
+    memcpy(user_name, table[i].usmUserName, table[i].usmUserNameLength);
+
+    LOG_BEGIN(INFO_LOG | 9);
+    LOG("USMUserTable: Translated (security name) to (user name)");
+    LOG(OctetStr(sec_name, sec_name_len).get_printable());
+    LOG(OctetStr(table[i].usmUserName, table[i].usmUserNameLength).get_printable());
+    LOG_END;
+
+    return SNMPv3_USM_OK;
+  }
 
   int logclass = WARNING_LOG;
   if (sec_name_len == 0) logclass = INFO_LOG;
@@ -3796,22 +3916,21 @@ int USMUserTable::get_security_name(const unsigned char *user_name,
   if (!table)
     return SNMPv3_USM_ERROR;
 
-  BEGIN_REENTRANT_CODE_BLOCK;
+  BEGIN_READ_CODE_BLOCK;
 
-  for (int i=0; i < entries; i++)
-    if (unsignedCharCompare(table[i].usmUserName, table[i].usmUserNameLength,
-			    user_name, user_name_len))
-    {
-      sec_name.set_data(table[i].usmUserSecurityName,
-			table[i].usmUserSecurityNameLength);
-      LOG_BEGIN(INFO_LOG | 9);
-      LOG("USMUserTable: Translated (user name) to (security name)");
-      LOG(OctetStr(table[i].usmUserName, table[i].usmUserNameLength).get_printable());
-      LOG(sec_name.get_printable());
-      LOG_END;
+  int i = find_user_name(user_name, user_name_len);
+  if (i >= 0)
+  {
+    sec_name.set_data(table[i].usmUserSecurityName,
+		      table[i].usmUserSecurityNameLength);
+    LOG_BEGIN(INFO_LOG | 9);
+    LOG("USMUserTable: Translated (user name) to (security name)");
+    LOG(OctetStr(table[i].usmUserName, table[i].usmUserNameLength).get_printable());
+    LOG(sec_name.get_printable());
+    LOG_END;
 
-      return SNMPv3_USM_OK;
-    }
+    return SNMPv3_USM_OK;
+  }
 
   int logclass = WARNING_LOG;
   if (user_name_len == 0) logclass = INFO_LOG;
@@ -3830,14 +3949,10 @@ int USMUserTable::delete_entries(const OctetStr& user_name)
 
   BEGIN_REENTRANT_CODE_BLOCK;
 
-  for (int i = 0; i < entries; i++)
-    if (unsignedCharCompare(table[i].usmUserName, table[i].usmUserNameLength,
-			    user_name.data(), user_name.len()))
-    {
-      /* delete this entry and recheck this position */
-      delete_entry(i);
-      i--;
-    }
+  int i;
+  while ((i = find_user_name(user_name.data(), user_name.len())) >= 0)
+    delete_entry(i);
+
   return SNMPv3_USM_OK;
 }
 
@@ -3869,17 +3984,11 @@ int USMUserTable::delete_entry(const OctetStr& engine_id,
 
   BEGIN_REENTRANT_CODE_BLOCK;
 
-  for (int i = 0; i < entries; i++)
-    if (unsignedCharCompare(table[i].usmUserName, table[i].usmUserNameLength,
-			    user_name.data(), user_name.len()))
-      if (unsignedCharCompare(table[i].usmUserEngineID,
-			      table[i].usmUserEngineIDLength,
-			      engine_id.data(), engine_id.len()))
-      {
-	/* delete this entry and recheck this position*/
-	delete_entry(i);
-	i--;
-      }
+  int i;
+  while ((i = find_user(engine_id.data(), engine_id.len(),
+                        user_name.data(), user_name.len())) >= 0)
+    delete_entry(i);
+
   return SNMPv3_USM_OK;
 }
 
@@ -3897,14 +4006,10 @@ const struct UsmUserTableEntry *USMUserTable::get_entry(const OctetStr &engine_i
   if (!table)
     return NULL;
 
-  for (int i = 0; i < entries; i++)
-    if (unsignedCharCompare(table[i].usmUserSecurityName,
-			    table[i].usmUserSecurityNameLength,
-			    sec_name.data(), sec_name.len()))
-      if (unsignedCharCompare(table[i].usmUserEngineID,
-			      table[i].usmUserEngineIDLength,
-			      engine_id.data(), engine_id.len()))
-	return &table[i];
+  int i = find(engine_id.data(), engine_id.len(),
+               sec_name.data(), sec_name.len());
+  if (i >= 0)
+    return &table[i];
   return NULL;
 }
 
@@ -3912,7 +4017,7 @@ struct UsmUserTableEntry *USMUserTable::get_cloned_entry(
                                  const OctetStr &engine_id,
 				 const OctetStr &sec_name)
 {
-  lock();
+  lock_read();
   const struct UsmUserTableEntry *e = get_entry(engine_id, sec_name);
   struct UsmUserTableEntry *res = 0;
 
@@ -3940,18 +4045,24 @@ struct UsmUserTableEntry *USMUserTable::get_cloned_entry(
     res->usmUserPrivKey        = v3strcpy(e->usmUserPrivKey,
 					  e->usmUserPrivKeyLength);
     res->usmUserPrivKeyLength  = e->usmUserPrivKeyLength;
+    res->authHmacState         = 0;
+    if (e->authHmacState)
+      res->authHmacState       = v3strcpy(e->authHmacState,
+					  e->authHmacStateLength);
+    res->authHmacStateLength   = e->authHmacStateLength;
 
     if ((res->usmUserEngineIDLength && !res->usmUserEngineID) ||
 	(res->usmUserNameLength && !res->usmUserName) ||
 	(res->usmUserSecurityNameLength && !res->usmUserSecurityName) ||
 	(res->usmUserAuthKeyLength && !res->usmUserAuthKey) ||
-	(res->usmUserPrivKeyLength && !res->usmUserPrivKey))
+	(res->usmUserPrivKeyLength && !res->usmUserPrivKey) ||
+	(res->authHmacStateLength && !res->authHmacState))
     {
       delete_cloned_entry(res);
     }
   }
 
-  unlock();
+  unlock_read();
   return res;
 }
 
@@ -3975,6 +4086,12 @@ void USMUserTable::delete_cloned_entry(struct UsmUserTableEntry* &entry)
     delete [] entry->usmUserPrivKey;
   }
 
+  if (entry->authHmacState)
+  {
+    memset(entry->authHmacState, 0, entry->authHmacStateLength);
+    delete [] entry->authHmacState;
+  }
+
   delete entry;
 
   entry = 0;
@@ -3986,11 +4103,9 @@ const struct UsmUserTableEntry *USMUserTable::get_entry(const OctetStr &sec_name
   if (!table)
     return NULL;
 
-  for (int i = 0; i < entries; i++)
-    if (unsignedCharCompare(table[i].usmUserSecurityName,
-			    table[i].usmUserSecurityNameLength,
-			    sec_name.data(), sec_name.len()))
-      return &table[i];
+  int i = find_security_name(sec_name.data(), sec_name.len());
+  if (i >= 0)
+    return &table[i];
   return NULL;
 }
 
@@ -4019,6 +4134,14 @@ int USMUserTable::add_entry(
     struct UsmUserTableEntry *tmp;
     tmp = new struct UsmUserTableEntry[4 * max_entries];
     if (!tmp) return SNMPv3_USM_ERROR;
+    if (!engine_sec_name_index.resize(4 * max_entries) ||
+        !engine_user_name_index.resize(4 * max_entries) ||
+        !sec_name_index.resize(4 * max_entries) ||
+        !user_name_index.resize(4 * max_entries))
+    {
+      delete [] tmp;
+      return SNMPv3_USM_ERROR;
+    }
     for (int i = 0; i < entries; i++)
       tmp[i] = table[i];
     delete [] table;
@@ -4026,17 +4149,10 @@ int USMUserTable::add_entry(
     max_entries *= 4;
   }
 
-  for (int i = 0; i < entries; i++)
-    if (unsignedCharCompare(table[i].usmUserName, table[i].usmUserNameLength,
-			    user_name.data(), user_name.len()))
-      if (unsignedCharCompare(table[i].usmUserEngineID,
-			      table[i].usmUserEngineIDLength,
-			      engine_id.data(), engine_id.len()))
-      {
-	/* delete this entry */
-	delete_entry(i);
-	break;
-      }
+  int i = find_user(engine_id.data(), engine_id.len(),
+                    user_name.data(), user_name.len());
+  if (i >= 0)
+    delete_entry(i); /* delete this entry */
 
   /* add user at the last position */
   table[entries].usmUserEngineIDLength = engine_id.len();
@@ -4056,6 +4172,10 @@ int USMUserTable::add_entry(
   table[entries].usmUserPrivKeyLength  = priv_key.len();
   table[entries].usmUserPrivKey        = v3strcpy(priv_key.data(),
 						  priv_key.len());
+  table[entries].authHmacState         = 0;
+  table[entries].authHmacStateLength   = 0;
+  set_hmac_state(entries);
+  index_entry(entries);
   entries++;
   return SNMPv3_USM_OK;
 }
@@ -4077,57 +4197,55 @@ int USMUserTable::update_key(const OctetStr &user_name,
 
   BEGIN_REENTRANT_CODE_BLOCK;
 
-  for (int i = 0; i < entries; i++)
-    if (unsignedCharCompare(table[i].usmUserName, table[i].usmUserNameLength,
-			    user_name.data(), user_name.len()))
-      if (unsignedCharCompare(table[i].usmUserEngineID,
-			      table[i].usmUserEngineIDLength,
-			      engine_id.data(), engine_id.len()))
-      {
-	LOG_BEGIN(DEBUG_LOG | 15);
-	LOG("USMUserTable: New key");
-	LOG(new_key.get_printable());
-	LOG_END;
+  int i = find_user(engine_id.data(), engine_id.len(),
+                    user_name.data(), user_name.len());
+  if (i >= 0)
+  {
+    LOG_BEGIN(DEBUG_LOG | 15);
+    LOG("USMUserTable: New key");
+    LOG(new_key.get_printable());
+    LOG_END;
 
-	/* update key: */
-	switch (key_type)
+    /* update key: */
+    switch (key_type)
+    {
+      case AUTHKEY:
+      case OWNAUTHKEY:
+      {
+	if (table[i].usmUserAuthKey)
 	{
-	  case AUTHKEY:
-	  case OWNAUTHKEY:
-	  {
-	    if (table[i].usmUserAuthKey)
-	    {
-	      memset(table[i].usmUserAuthKey, 0,
-		     table[i].usmUserAuthKeyLength);
-	      delete [] table[i].usmUserAuthKey;
-	    }
-	    table[i].usmUserAuthKeyLength = new_key.len();
-	    table[i].usmUserAuthKey = v3strcpy(new_key.data(), new_key.len());
-	    return SNMPv3_USM_OK;
-	  }
-	  case PRIVKEY:
-	  case OWNPRIVKEY:
-	  {
-	    if (table[i].usmUserPrivKey)
-	    {
-	      memset(table[i].usmUserPrivKey, 0,
-		     table[i].usmUserPrivKeyLength);
-	      delete [] table[i].usmUserPrivKey;
-	    }
-	    table[i].usmUserPrivKeyLength = new_key.len();
-	    table[i].usmUserPrivKey = v3strcpy(new_key.data(), new_key.len());
-	    return SNMPv3_USM_OK;
-	  }
-	  default:
-	  {
-	    LOG_BEGIN(WARNING_LOG | 3);
-	    LOG("USMUserTable: setting new key failed (wrong type).");
-	    LOG_END;
-
-	    return SNMPv3_USM_ERROR;
-	  }
+	  memset(table[i].usmUserAuthKey, 0,
+		 table[i].usmUserAuthKeyLength);
+	  delete [] table[i].usmUserAuthKey;
 	}
+	table[i].usmUserAuthKeyLength = new_key.len();
+	table[i].usmUserAuthKey = v3strcpy(new_key.data(), new_key.len());
+	set_hmac_state(i);
+	return SNMPv3_USM_OK;
+      }
+      case PRIVKEY:
+      case OWNPRIVKEY:
+      {
+	if (table[i].usmUserPrivKey)
+	{
+	  memset(table[i].usmUserPrivKey, 0,
+		 table[i].usmUserPrivKeyLength);
+	  delete [] table[i].usmUserPrivKey;
+	}
+	table[i].usmUserPrivKeyLength = new_key.len();
+	table[i].usmUserPrivKey = v3strcpy(new_key.data(), new_key.len());
+	return SNMPv3_USM_OK;
+      }
+      default:
+      {
+	LOG_BEGIN(WARNING_LOG | 3);
+	LOG("USMUserTable: setting new key failed (wrong type).");
+	LOG_END;
+
+	return SNMPv3_USM_ERROR;
       }
+    }
+  }
 
   LOG_BEGIN(INFO_LOG | 7);
   LOG("USMUserTable: setting new key failed (user) not found");
@@ -4137,6 +4255,26 @@ int USMUserTable::update_key(const OctetStr &user_name,
   return SNMPv3_USM_ERROR;
 }
 
+void USMUserTable::set_hmac_state(const int nr)
+{
+  /* Table is locked through caller */
+
+  if (table[nr].authHmacState)
+  {
+    memset(table[nr].authHmacState, 0, table[nr].authHmacStateLength);
+    delete [] table[nr].authHmacState;
+  }
+  table[nr].authHmacState = 0;
+  table[nr].authHmacStateLength = 0;
+
+  if (auth_priv && table[nr].usmUserAuthKey)
+    table[nr].authHmacState =
+      auth_priv->new_hmac_state(table[nr].usmUserAuthProtocol,
+				table[nr].usmUserAuthKey,
+				table[nr].usmUserAuthKeyLength,
+				table[nr].authHmacStateLength);
+}
+
 void USMUserTable::delete_entry(const int nr)
 {
   /* Table is locked through caller, so do NOT lock table!
@@ -4156,6 +4294,11 @@ void USMUserTable::delete_entry(const int nr)
     memset(table[nr].usmUserPrivKey, 0, table[nr].usmUserPrivKeyLength);
     delete [] table[nr].usmUserPrivKey;
   }
+  if (table[nr].authHmacState)
+  {
+    memset(table[nr].authHmacState, 0, table[nr].authHmacStateLength);
+    delete [] table[nr].authHmacState;
+  }
 
   /* We have now one entry less */
   entries--;
@@ -4164,9 +4307,100 @@ void USMUserTable::delete_entry(const int nr)
   {
     /* move the last entry to the deleted position */
     table[nr] = table[entries];
+    engine_sec_name_index.move(entries, nr);
+    engine_user_name_index.move(entries, nr);
+    sec_name_index.move(entries, nr);
+    user_name_index.move(entries, nr);
+  }
+  else
+  {
+    engine_sec_name_index.remove(nr);
+    engine_user_name_index.remove(nr);
+    sec_name_index.remove(nr);
+    user_name_index.remove(nr);
   }
 }
 
+void USMUserTable::index_entry(const int nr)
+{
+  /* Table is locked through caller */
+  unsigned int engine_hash = v3hash(table[nr].usmUserEngineID,
+                                    table[nr].usmUserEngineIDLength);
+
+  engine_sec_name_index.add(nr, v3hash(table[nr].usmUserSecurityName,
+                                       table[nr].usmUserSecurityNameLength,
+                                       engine_hash));
+  engine_user_name_index.add(nr, v3hash(table[nr].usmUserName,
+                                        table[nr].usmUserNameLength,
+                                        engine_hash));
+  sec_name_index.add(nr, v3hash(table[nr].usmUserSecurityName,
+                                table[nr].usmUserSecurityNameLength));
+  user_name_index.add(nr, v3hash(table[nr].usmUserName,
+                                 table[nr].usmUserNameLength));
+}
+
+int USMUserTable::find(const unsigned char *engine_id,
+                       const long engine_id_len,
+                       const unsigned char *sec_name,
+                       const long sec_name_len) const
+{
+  unsigned int hash = v3hash(sec_name, sec_name_len,
+                             v3hash(engine_id, engine_id_len));
+
+  for (int i = engine_sec_name_index.first(hash);
+       i >= 0; i = engine_sec_name_index.next(i))
+    if (unsignedCharCompare(table[i].usmUserSecurityName,
+			    table[i].usmUserSecurityNameLength,
+			    sec_name, sec_name_len) &&
+        unsignedCharCompare(table[i].usmUserEngineID,
+			    table[i].usmUserEngineIDLength,
+			    engine_id, engine_id_len))
+      return i;
+  return -1;
+}
+
+int USMUserTable::find_user(const unsigned char *engine_id,
+                            const long engine_id_len,
+                            const unsigned char *user_name,
+                            const long user_name_len) const
+{
+  unsigned int hash = v3hash(user_name, user_name_len,
+                             v3hash(engine_id, engine_id_len));
+
+  for (int i = engine_user_name_index.first(hash);
+       i >= 0; i = engine_user_name_index.next(i))
+    if (unsignedCharCompare(table[i].usmUserName, table[i].usmUserNameLength,
+			    user_name, user_name_len) &&
+        unsignedCharCompare(table[i].usmUserEngineID,
+			    table[i].usmUserEngineIDLength,
+			    engine_id, engine_id_len))
+      return i;
+  return -1;
+}
+
+int USMUserTable::find_security_name(const unsigned char *sec_name,
+                                     const long sec_name_len) const
+{
+  for (int i = sec_name_index.first(v3hash(sec_name, sec_name_len));
+       i >= 0; i = sec_name_index.next(i))
+    if (unsignedCharCompare(table[i].usmUserSecurityName,
+			    table[i].usmUserSecurityNameLength,
+			    sec_name, sec_name_len))
+      return i;
+  return -1;
+}
+
+int USMUserTable::find_user_name(const unsigned char *user_name,
+                                 const long user_name_len) const
+{
+  for (int i = user_name_index.first(v3hash(user_name, user_name_len));
+       i >= 0; i = user_name_index.next(i))
+    if (unsignedCharCompare(table[i].usmUserName, table[i].usmUserNameLength,
+			    user_name, user_name_len))
+      return i;
+  return -1;
+}
+
 // Save all entries into a file.
 int USMUserTable::save_to_file(const char *name, AuthPriv *ap)
 {
@@ -4211,7 +4445,7 @@ int USMUserTable::save_to_file(const char *name, AuthPriv *ap)
 
   {
     // Begin reentrant code block
-    BEGIN_REENTRANT_CODE_BLOCK;
+    BEGIN_READ_CODE_BLOCK;
 
     for (int i=0; i < entries; ++i)
     {
@@ -179,6 +179,7 @@ struct UsmUserTableEntry {
   unsigned char *usmUserAuthKey;      long int usmUserAuthKeyLength;
   long int  usmUserPrivProtocol;
   unsigned char *usmUserPrivKey;      long int usmUserPrivKeyLength;
+  unsigned char *authHmacState;       long int authHmacStateLength;
 };
 
 struct UsmUser {
@@ -189,6 +190,7 @@ struct UsmUser {
   unsigned char *authKey;      long int authKeyLength;
   long int  privProtocol;
   unsigned char *privKey;      long int privKeyLength;
+  unsigned char *authHmacState; long int authHmacStateLength;
 };
 
 struct UsmUserNameTableEntry {
@@ -428,6 +430,41 @@ public:
    */
   int load_users(const char *file);
 
+  /**
+   * Save the keys generated from the passwords of the users into a
+   * file, encrypted with the given secret.
+   *
+   * @param file         - filename including path
+   * @param file_key     - secret the file is protected with
+   * @param file_key_len - length of the secret
+   *
+   * @return SNMPv3_USM_OK or USM error codes (see KeyCache::save_to_file())
+   */
+  int save_key_cache(const char *file,
+                     const unsigned char *file_key,
+                     const unsigned int   file_key_len);
+
+  /**
+   * Load the keys generated from passwords from a file saved with
+   * save_key_cache() and the same secret.
+   *
+   * @return SNMPv3_USM_OK or USM error codes (see KeyCache::load_from_file())
+   */
+  int load_key_cache(const char *file,
+                     const unsigned char *file_key,
+                     const unsigned int   file_key_len);
+
+  /**
+   * Generate the master keys of the passwords of all users that are
+   * not in the key cache yet, using up to the given number of threads.
+   * Keys for new engine ids are then only localized.
+   *
+   * @param threads - maximum number of threads, including the caller
+   *
+   * @return the number of keys generated
+   */
+  int derive_user_keys(const int threads);
+
   /**
    * Add or replace a localized user in the USM table. Use this method
    * only, if you know what you are doing.
@@ -765,8 +802,13 @@ public:
   //@}
 
   /**
-   * Lock the UsmUserNameTable for access through peek_first_user()
-   * and peek_next_user().
+   * Lock the UsmUserNameTable for read access through peek_first_user()
+   * and peek_next_user(). Readers do not block each other.
+   *
+   * @note The lock is not recursive. Until unlock_user_name_table() is
+   *       called, only use the peek methods of the table: adding,
+   *       deleting or looking up users takes the lock again and can
+   *       deadlock.
    */
   void lock_user_name_table();
 
@@ -793,8 +835,13 @@ public:
   void unlock_user_name_table();
 
   /**
-   * Lock the UsmUserTable for access through peek_first_luser()
-   * and peek_next_luser().
+   * Lock the UsmUserTable for read access through peek_first_luser()
+   * and peek_next_luser(). Readers do not block each other.
+   *
+   * @note The lock is not recursive. Until unlock_user_table() is
+   *       called, only use the peek methods of the table: adding,
+   *       deleting or looking up users takes the lock again and can
+   *       deadlock.
    */
   void lock_user_table();
 
@@ -930,6 +977,46 @@ public:
              unsigned char *wholeMsg,         // OUT complete generated message
              int *wholeMsgLength);            // OUT length of generated message
 
+  /**
+   * Generate a complete message around a scopedPDU that has already
+   * been serialized into the end of the message buffer.
+   *
+   * The message is built in place, back to front, so no temporary
+   * buffers are needed. With privacy, the scopedPDU is encrypted in place.
+   *
+   * @param globalData       - Buffer containing the serialized globalData,
+   *                           ready to be copied into the wholeMsg
+   * @param globalDataLength - The length of this buffer
+   * @param maxMessageSize   - The maximum message size and the length of
+   *                           the wholeMsg buffer
+   * @param securityEngineID - The engineID of the authoritative SNMP entity
+   * @param securityName     - The name of the user
+   * @param securityLevel    - The security Level for this Message
+   * @param scopedPDULength  - The length of the serialized scopedPDU, that
+   *                           fills the last bytes of wholeMsg
+   * @param securityStateReference - The reference that was generated when
+   *                                 the request was parsed. For request, this
+   *                                 param has to be NULL. The reference
+   *                                 is deleted by this function.
+   * @param wholeMsg         - IN:  the buffer with the scopedPDU at its end
+   *                           OUT: the message, starting at wholeMsg
+   * @param wholeMsgLength   - OUT: length of the generated message
+   *
+   * @return - SNMPv3_USM_OK on success. See snmperrs.h for the error codes
+   *           of the USM.
+   */
+  int generate_msg(
+             unsigned char *globalData,       // message header, admin data
+             int globalDataLength,
+             int maxMessageSize,              // of the sending SNMP entity
+             const OctetStr &securityEngineID,// authoritative SNMP entity
+             const OctetStr &securityName,    // on behalf of this principal
+             int  securityLevel,              // Level of Security requested
+             int scopedPDULength,             // at the end of wholeMsg
+             struct SecurityStateReference *securityStateReference,
+             unsigned char *wholeMsg,         // IN/OUT buffer for the message
+             int *wholeMsgLength);            // OUT length of generated message
+
 
 
   /**
@@ -948,9 +1035,10 @@ public:
    * @param msgDataLength          - The length of the messageData buffer
    * @param security_engine_id     - OUT: the authoritative engineID
    * @param security_name          - OUT: the name of the user
-   * @param scopedPDU              - OUT: buffer containing the scopedPDU
-   * @param scopedPDULength        - IN: length of the buffer
-   *                                 OUT: length of the scopedPDU
+   * @param scopedPDU              - OUT: buffer containing the scopedPDU,
+   *                                 at least msgDataLength bytes long
+   * @param scopedPDULength        - OUT: length of the scopedPDU, 0 if
+   *                                 the buffer was not filled
    * @param maxSizeResponseScopedPDU - OUT: maximum size for a scopedPDU in a
    *                                        response message
    * @param securityStateReference - OUT: the securityStateReference
@@ -989,62 +1077,6 @@ private:
   void delete_sec_parameters( struct UsmSecurityParameters *usp);
 
 
-  /**
-   * Serialize the given values into the buffer according to the BER.
-   *
-   *  UsmSecurityParameters ::=
-   *      SEQUENCE {
-   *      -- global User-based security parameters
-   *          msgAuthoritativeEngineID     OCTET STRING (5..32)
-   *          msgAuthoritativeEngineBoots  INTEGER (0..2147483647),
-   *          msgAuthoritativeEngineTime   INTEGER (0..2147483647),
-   *          msgUserName                  OCTET STRING (SIZE(0..32)),
-   *       -- authentication protocol specific parameters
-   *          msgAuthenticationParameters  OCTET STRING,
-   *       -- privacy protocol specific parameters
-   *          msgPrivacyParameters         OCTET STRING
-   *      }
-   *
-   * @param outBuf    - buffer for the serialized values
-   * @param maxLength - before call: length of the buffer
-   *                    after call: bytes left in the buffer
-   * @param sp        - the values to serialize
-   * @param position  - after call: points to the first byte of the
-   *                    field for the authentication parameter
-   *
-   * @return - a pointer to the first free byte in the buffer,
-   *           NULL on error
-   */
-  unsigned char *build_sec_params(unsigned char *outBuf, int *maxLength,
-                                  struct UsmSecurityParameters sp,
-                                  int *position);
-
-  /**
-   * Serialize the given values acording to the BER into the
-   * buffer. On success, the buffer contains a valid SNMPv3 message.
-   *
-   * @param outBuf             - buffer for the serialized values
-   * @param maxLength          - before call: length of the buffer
-   *                             after call: bytes left in the buffer
-   * @param globalData         - Buffer that contains the serialized globalData
-   * @param globalDataLength   - The length of this buffer
-   * @param positionAuthPar    - after call: points to the first byte of the
-   *                             field for the authentication parameter
-   * @param securityParameters - The security parameters
-   * @param msgData            - Buffer that contains the serialized msgData
-   * @param msgDataLength      - The length of this buffer
-   *
-   * @return - a pointer to the first free byte in the buffer,
-   * NULL on error
-   */
-  unsigned char *build_whole_msg(
-                      unsigned char *outBuf, int *maxLength,
-                      unsigned char *globalData, long int globalDataLength,
-                      int *positionAuthPar,
-                      struct UsmSecurityParameters  securityParameters,
-                      unsigned char *msgData, long int msgDataLength);
-
-
   /**
    * Delete the pointers in the structure
    *
@@ -1052,6 +1084,15 @@ private:
    */
   inline void delete_user_ptr(struct UsmUser *user);
 
+  /**
+   * Release the user of an outgoing message: unlock the usmUserTable
+   * if the user refers to its entry, free the copy otherwise.
+   *
+   * @param user         - the user, set to NULL
+   * @param table_locked - true if the usmUserTable is read locked
+   */
+  void release_user(struct UsmUser *&user, const bool table_locked);
+
 
  private:
 
@@ -300,62 +300,67 @@ DLLOPT int send_snmp_request(SnmpSocket sock, unsigned char *send_buf,
   return 0;
 }
 
-//---------[ receive a snmp response ]---------------------------------
-// Receive a response from the specified socket.
-// This function does not set the request id in the pdu if
-// any error occur in receiving or parsing.  This is important
-// because the caller initializes this to zero and checks it to
-// see whether it has been changed to a valid value.  The
-// return value is the normal PDU status or SNMP_CLASS_SUCCESS.
-// when we are successful in receiving a pdu.  Otherwise it
-// is an error status.
-
-int receive_snmp_response(SnmpSocket sock, Snmp &snmp_session,
-                          Pdu &pdu, UdpAddress &fromaddress,
-			  OctetStr &engine_id, bool process_msg = true)
-{
-  unsigned char receive_buffer[MAX_SNMP_PACKET + 1];
-  long receive_buffer_len; // len of received data
 #ifdef SNMP_PP_IPv6
-  struct sockaddr_storage from_addr;
+typedef struct sockaddr_storage snmp_sockaddr;
 #else
-  struct sockaddr_in from_addr;
+typedef struct sockaddr_in snmp_sockaddr;
 #endif
+
 #if !(defined (CPU) && CPU == PPC603) && (defined __GNUC__ || defined __FreeBSD__ || defined _AIX) && ! defined __MINGW32__
-  socklen_t fromlen;
+typedef socklen_t snmp_socklen;
 #else
-  int fromlen;
+typedef int snmp_socklen;
 #endif
-  fromlen = sizeof(from_addr);
 
-  memset(&from_addr, 0, sizeof(from_addr));
-
-  // do the read
-  do {
-    receive_buffer_len = (long) recvfrom(sock, (char *) receive_buffer,
-                                         MAX_SNMP_PACKET + 1, 0,
-                                         (struct sockaddr*) &from_addr,
-                                         &fromlen);
-    debugprintf(2, "++ SNMP++: something received...");
-  } while ((receive_buffer_len < 0) && (EINTR == errno));
+//---------[ socket address conversion ]-------------------------------
+// Fill a sockaddr from the binary representation of the address.
+// Returns the length of the sockaddr or -1 for unusable addresses.
+static int udp_to_sockaddr(const UdpAddress &address, snmp_sockaddr &to)
+{
+  memset(&to, 0, sizeof(to));
 
-  if (receive_buffer_len < 0 )                // error or no data pending
-    return SNMP_CLASS_TL_FAILED;
-  debugprintf(6, "Length received %i from socket %i; fromlen %i",
-              receive_buffer_len, sock, fromlen);
+  if (!address.valid())
+    return -1;
 
-  if (receive_buffer_len == MAX_SNMP_PACKET + 1)
+  if (address.get_ip_version() == Address::version_ipv4)
   {
-    // Message is too long...
-    debugprintf(1, "Received message is ignored (packet too long)");
-    return SNMP_CLASS_ERROR;
+    struct sockaddr_in *addr = (struct sockaddr_in *)&to;
+    unsigned char *bytes = (unsigned char *)&addr->sin_addr;
+
+    addr->sin_family = AF_INET;
+    for (int i = 0; i < 4; i++)
+      bytes[i] = address[i];
+    addr->sin_port = htons(address.get_port());
+    return sizeof(struct sockaddr_in);
   }
+#ifdef SNMP_PP_IPv6
+  struct sockaddr_in6 *addr = (struct sockaddr_in6 *)&to;
+  unsigned char *bytes = (unsigned char *)&addr->sin6_addr;
+
+  addr->sin6_family = AF_INET6;
+  for (int i = 0; i < 16; i++)
+    bytes[i] = address[i];
+  addr->sin6_port = htons(address.get_port());
+  if (address.has_ipv6_scope())
+    addr->sin6_scope_id = address.get_scope();
+  return sizeof(struct sockaddr_in6);
+#else
+  debugprintf(0, "User error: Enable IPv6 and recompile snmp++.");
+  return -1;
+#endif
+}
 
-  if (((sockaddr_in&)from_addr).sin_family == AF_INET)
+// Fill fromaddress with the source address of a received datagram.
+// Returns false for unknown address families.
+static bool sockaddr_to_udp(const snmp_sockaddr &from_addr,
+                            UdpAddress &fromaddress)
+{
+  if (((const sockaddr_in&)from_addr).sin_family == AF_INET)
   {
     // IPv4
-    fromaddress = inet_ntoa(((sockaddr_in&)from_addr).sin_addr);
-    fromaddress.set_port(ntohs(((sockaddr_in&)from_addr).sin_port));
+    fromaddress = inet_ntoa(((const sockaddr_in&)from_addr).sin_addr);
+    fromaddress.set_port(ntohs(((const sockaddr_in&)from_addr).sin_port));
+    return true;
   }
 #ifdef SNMP_PP_IPv6
   else if (from_addr.ss_family == AF_INET6)
@@ -363,22 +368,321 @@ int receive_snmp_response(SnmpSocket sock, Snmp &snmp_session,
     // IPv6
     char tmp_buffer[INET6_ADDRSTRLEN+1];
 
-    inet_ntop(AF_INET6, &(((sockaddr_in6&)from_addr).sin6_addr),
+    inet_ntop(AF_INET6, &(((const sockaddr_in6&)from_addr).sin6_addr),
               tmp_buffer, INET6_ADDRSTRLEN);
 
     fromaddress = tmp_buffer;
-    fromaddress.set_port(ntohs(((sockaddr_in6&)from_addr).sin6_port));
-    if (((sockaddr_in6&)from_addr).sin6_scope_id != 0)
-	fromaddress.set_scope(((sockaddr_in6&)from_addr).sin6_scope_id);
+    fromaddress.set_port(ntohs(((const sockaddr_in6&)from_addr).sin6_port));
+    if (((const sockaddr_in6&)from_addr).sin6_scope_id != 0)
+	fromaddress.set_scope(((const sockaddr_in6&)from_addr).sin6_scope_id);
+    return true;
   }
 #endif // SNMP_PP_IPv6
+
+  debugprintf(0, "Unknown socket address family (%i).",
+              ((const sockaddr_in&)from_addr).sin_family);
+  return false;
+}
+
+//---------[ batched receive ]-----------------------------------------
+SnmpRecvBatch::SnmpRecvBatch(const int slots, const int size)
+  : m_slots(slots > 0 ? slots : 1), m_count(0), m_size(0), m_newSize(size),
+    m_buffers(0), m_hdrs(0), m_iovs(0), m_next(0)
+{
+  m_lengths = new long[m_slots];
+  m_from    = new snmp_sockaddr[m_slots];
+
+#ifdef HAVE_RECVMMSG
+  struct mmsghdr *hdrs = new struct mmsghdr[m_slots];
+  struct iovec   *iovs = new struct iovec[m_slots];
+
+  memset(hdrs, 0, m_slots * sizeof(struct mmsghdr));
+  for (int i = 0; i < m_slots; i++)
+  {
+    hdrs[i].msg_hdr.msg_name   = &((snmp_sockaddr *)m_from)[i];
+    hdrs[i].msg_hdr.msg_iov    = &iovs[i];
+    hdrs[i].msg_hdr.msg_iovlen = 1;
+  }
+  m_hdrs = hdrs;
+  m_iovs = iovs;
+#endif
+  alloc_buffers();
+}
+
+// Each slot has one byte more than the largest datagram, so a longer
+// datagram is noticed by its length.
+void SnmpRecvBatch::alloc_buffers()
+{
+  if (m_newSize < MIN_SNMP_PACKET)
+    m_newSize = MIN_SNMP_PACKET;
+  else if (m_newSize > MAX_SNMP_PACKET_LIMIT)
+    m_newSize = MAX_SNMP_PACKET_LIMIT;
+
+  m_size = m_newSize;
+  delete [] m_buffers;
+  m_buffers = new unsigned char[m_slots * (m_size + 1)];
+  m_count = 0;
+
+#ifdef HAVE_RECVMMSG
+  struct iovec *iovs = (struct iovec *)m_iovs;
+
+  for (int i = 0; i < m_slots; i++)
+  {
+    iovs[i].iov_base = get_data(i);
+    iovs[i].iov_len  = m_size + 1;
+  }
+#endif
+}
+
+SnmpRecvBatch::~SnmpRecvBatch()
+{
+#ifdef HAVE_RECVMMSG
+  delete [] (struct mmsghdr *)m_hdrs;
+  delete [] (struct iovec *)m_iovs;
+#endif
+  delete [] (snmp_sockaddr *)m_from;
+  delete [] m_lengths;
+  delete [] m_buffers;
+}
+
+const void *SnmpRecvBatch::get_from(const int i) const
+{
+  return &((snmp_sockaddr *)m_from)[i];
+}
+
+int SnmpRecvBatch::receive(SnmpSocket sock)
+{
+  if (m_newSize != m_size)
+    alloc_buffers();
+
+  m_count = 0;
+
+#ifdef HAVE_RECVMMSG
+  struct mmsghdr *hdrs = (struct mmsghdr *)m_hdrs;
+  int received;
+
+  for (int i = 0; i < m_slots; i++)
+  {
+    memset(&((snmp_sockaddr *)m_from)[i], 0, sizeof(snmp_sockaddr));
+    hdrs[i].msg_hdr.msg_namelen = sizeof(snmp_sockaddr);
+    hdrs[i].msg_hdr.msg_flags = 0;
+    hdrs[i].msg_len = 0;
+  }
+
+  // The socket is readable, so the first datagram is there. Do not
+  // block waiting for the rest of the batch.
+  do {
+    received = recvmmsg(sock, hdrs, m_slots, MSG_DONTWAIT, 0);
+  } while ((received < 0) && (EINTR == errno));
+
+  if (received < 0)                     // error or no data pending
+    return -1;
+
+  for (int i = 0; i < received; i++)
+  {
+    if (hdrs[i].msg_hdr.msg_flags & MSG_TRUNC)
+      m_lengths[i] = m_size + 1;
+    else
+      m_lengths[i] = (long)hdrs[i].msg_len;
+  }
+  m_count = received;
+#else
+  snmp_socklen fromlen = sizeof(snmp_sockaddr);
+
+  memset(m_from, 0, sizeof(snmp_sockaddr));
+  do {
+    m_lengths[0] = (long) recvfrom(sock, (char *) m_buffers,
+                                   m_size + 1, 0,
+                                   (struct sockaddr*) m_from, &fromlen);
+  } while ((m_lengths[0] < 0) && (EINTR == errno));
+
+  if (m_lengths[0] < 0)                 // error or no data pending
+    return -1;
+  m_count = 1;
+#endif
+  debugprintf(2, "++ SNMP++: %i datagram(s) received from socket %i",
+              m_count, sock);
+  return m_count;
+}
+
+SnmpRecvBatchPool::SnmpRecvBatchPool(const int size)
+  : m_free(0), m_size(size)
+{
+}
+
+SnmpRecvBatchPool::~SnmpRecvBatchPool()
+{
+  while (m_free)
+  {
+    SnmpRecvBatch *batch = m_free;
+    m_free = batch->m_next;
+    delete batch;
+  }
+}
+
+SnmpRecvBatch *SnmpRecvBatchPool::claim()
+{
+  SnmpSynchronize _synchronize(*this);
+  SnmpRecvBatch *batch = m_free;
+
+  if (batch)
+  {
+    m_free = batch->m_next;
+    batch->m_next = 0;
+    batch->set_buffer_size(m_size);
+  }
   else
+    batch = new SnmpRecvBatch(SNMP_PP_BATCH_SIZE, m_size);
+
+  return batch;
+}
+
+void SnmpRecvBatchPool::release(SnmpRecvBatch *batch)
+{
+  SnmpSynchronize _synchronize(*this);
+
+  batch->m_next = m_free;
+  m_free = batch;
+}
+
+void SnmpRecvBatchPool::set_buffer_size(const int size)
+{
+  SnmpSynchronize _synchronize(*this);
+
+  m_size = size;
+}
+
+int SnmpRecvBatchPool::get_buffer_size()
+{
+  SnmpSynchronize _synchronize(*this);
+
+  return m_size;
+}
+
+//---------[ batched send ]--------------------------------------------
+SnmpSendBatch::SnmpSendBatch(const int slots, const int size)
+  : m_slots(slots > 0 ? slots : 1), m_count(0),
+    m_size(size > MAX_SNMP_PACKET_LIMIT ? MAX_SNMP_PACKET_LIMIT : size),
+    m_hdrs(0), m_iovs(0)
+{
+  m_buffers = new unsigned char[m_slots * m_size];
+  m_lengths = new size_t[m_slots];
+  m_to      = new snmp_sockaddr[m_slots];
+  m_tolens  = new int[m_slots];
+
+#ifdef HAVE_SENDMMSG
+  m_hdrs = new struct mmsghdr[m_slots];
+  m_iovs = new struct iovec[m_slots];
+#endif
+}
+
+SnmpSendBatch::~SnmpSendBatch()
+{
+#ifdef HAVE_SENDMMSG
+  delete [] (struct mmsghdr *)m_hdrs;
+  delete [] (struct iovec *)m_iovs;
+#endif
+  delete [] m_tolens;
+  delete [] (snmp_sockaddr *)m_to;
+  delete [] m_lengths;
+  delete [] m_buffers;
+}
+
+int SnmpSendBatch::add(const unsigned char *send_buf, const size_t send_len,
+                       const UdpAddress &address)
+{
+  if ((m_count >= m_slots) || (send_len > (size_t)m_size))
+    return -1;
+
+  int tolen = udp_to_sockaddr(address, ((snmp_sockaddr *)m_to)[m_count]);
+  if (tolen < 0)
+    return -1;
+
+  debugprintf(1, "++ SNMP++: queueing for %s:", address.get_printable());
+  debughexprintf(5, send_buf, SAFE_UINT_CAST(send_len));
+
+  memcpy(m_buffers + m_count * m_size, send_buf, send_len);
+  m_lengths[m_count] = send_len;
+  m_tolens[m_count] = tolen;
+  m_count++;
+  return 0;
+}
+
+int SnmpSendBatch::flush(SnmpSocket sock)
+{
+  int queued = m_count;
+  int sent = 0;
+
+#ifdef HAVE_SENDMMSG
+  struct mmsghdr *hdrs = (struct mmsghdr *)m_hdrs;
+  struct iovec   *iovs = (struct iovec *)m_iovs;
+
+  memset(hdrs, 0, m_count * sizeof(struct mmsghdr));
+  for (int i = 0; i < m_count; i++)
+  {
+    iovs[i].iov_base = m_buffers + i * m_size;
+    iovs[i].iov_len  = m_lengths[i];
+    hdrs[i].msg_hdr.msg_name    = &((snmp_sockaddr *)m_to)[i];
+    hdrs[i].msg_hdr.msg_namelen = m_tolens[i];
+    hdrs[i].msg_hdr.msg_iov     = &iovs[i];
+    hdrs[i].msg_hdr.msg_iovlen  = 1;
+  }
+
+  // sendmmsg() stops at the first datagram that fails, skip it and
+  // continue with the remaining ones
+  int done = 0;
+  while (done < m_count)
+  {
+    int result = sendmmsg(sock, hdrs + done, m_count - done, 0);
+    if (result < 0)
+    {
+      if (EINTR == errno)
+        continue;
+      debugprintf(0, "Error sending packet: %s", strerror(errno));
+      done++;
+      continue;
+    }
+    done += result;
+    sent += result;
+  }
+#else
+  for (int i = 0; i < m_count; i++)
+  {
+    int result = sendto(sock, (char*) m_buffers + i * m_size,
+                        SAFE_INT_CAST(m_lengths[i]), 0,
+                        (struct sockaddr*) &((snmp_sockaddr *)m_to)[i],
+                        m_tolens[i]);
+    if (result < 0)
+      debugprintf(0, "Error sending packet: %s", strerror(errno));
+    else
+      sent++;
+  }
+#endif
+
+  m_count = 0;
+  return ((sent == 0) && (queued > 0)) ? -1 : sent;
+}
+
+//---------[ receive a snmp response ]---------------------------------
+// Decode a received response. See receive_snmp_response() below.
+static int process_snmp_response(unsigned char *receive_buffer,
+                                 long receive_buffer_len,
+                                 long max_len,
+                                 const snmp_sockaddr &from_addr,
+                                 Snmp &snmp_session, Pdu &pdu,
+                                 UdpAddress &fromaddress,
+                                 OctetStr &engine_id, bool process_msg)
+{
+  if (receive_buffer_len > max_len)
   {
-    debugprintf(0, "Unknown socket address family (%i).",
-                ((sockaddr_in&)from_addr).sin_family);
+    // Message is too long...
+    debugprintf(1, "Received message is ignored (packet too long)");
     return SNMP_CLASS_ERROR;
   }
 
+  if (!sockaddr_to_udp(from_addr, fromaddress))
+    return SNMP_CLASS_ERROR;
+
   debugprintf(1, "++ SNMP++: data received from %s.",
               fromaddress.get_printable());
   debughexprintf(5, receive_buffer, receive_buffer_len);
@@ -435,43 +739,75 @@ int receive_snmp_response(SnmpSocket sock, Snmp &snmp_session,
   return SNMP_CLASS_SUCCESS;   // Success! return
 }
 
+// Receive a response from the specified socket.
+// This function does not set the request id in the pdu if
+// any error occur in receiving or parsing.  This is important
+// because the caller initializes this to zero and checks it to
+// see whether it has been changed to a valid value.  The
+// return value is the normal PDU status or SNMP_CLASS_SUCCESS.
+// when we are successful in receiving a pdu.  Otherwise it
+// is an error status.
 
-//---------[ receive a snmp trap ]---------------------------------
-// Receive a trap from the specified socket
-// note: caller has to delete target!
-int receive_snmp_notification(SnmpSocket sock, Snmp &snmp_session,
-                              Pdu &pdu, SnmpTarget **target)
+int receive_snmp_response(SnmpSocket sock, Snmp &snmp_session,
+                          Pdu &pdu, UdpAddress &fromaddress,
+			  OctetStr &engine_id, bool process_msg = true)
 {
-  unsigned char receive_buffer[MAX_SNMP_PACKET + 1];
+  long max_len = snmp_session.get_max_msg_size();
+  Buffer<unsigned char> receive_buffer(max_len + 1);
   long receive_buffer_len; // len of received data
-
-#ifdef SNMP_PP_IPv6
-  struct sockaddr_storage from_addr;
-#else
-  struct sockaddr_in from_addr;
-#endif // SNMP_PP_IPv6
-
-#if !(defined (CPU) && CPU == PPC603) && (defined __GNUC__ || defined __FreeBSD__ || defined _AIX) && ! defined __MINGW32__
-  socklen_t fromlen;
-#else
-  int fromlen;
-#endif
+  snmp_sockaddr from_addr;
+  snmp_socklen fromlen;
   fromlen = sizeof(from_addr);
 
   memset(&from_addr, 0, sizeof(from_addr));
 
   // do the read
   do {
-    receive_buffer_len = (long) recvfrom(sock, (char *) receive_buffer,
-                                         MAX_SNMP_PACKET + 1, 0,
-                                         (struct sockaddr*)&from_addr,
+    receive_buffer_len = (long) recvfrom(sock,
+                                         (char *) receive_buffer.get_ptr(),
+                                         max_len + 1, 0,
+                                         (struct sockaddr*) &from_addr,
                                          &fromlen);
-  } while (receive_buffer_len < 0 && EINTR == errno);
+    debugprintf(2, "++ SNMP++: something received...");
+  } while ((receive_buffer_len < 0) && (EINTR == errno));
 
   if (receive_buffer_len < 0 )                // error or no data pending
     return SNMP_CLASS_TL_FAILED;
+  debugprintf(6, "Length received %i from socket %i; fromlen %i",
+              receive_buffer_len, sock, fromlen);
+
+  return process_snmp_response(receive_buffer.get_ptr(), receive_buffer_len,
+                               max_len, from_addr,
+                               snmp_session, pdu, fromaddress, engine_id,
+                               process_msg);
+}
+
+// Decode the response in slot index of a filled receive batch.
+int receive_snmp_response(SnmpRecvBatch &batch, const int index,
+                          Snmp &snmp_session, Pdu &pdu,
+                          UdpAddress &fromaddress, OctetStr &engine_id)
+{
+  if ((index < 0) || (index >= batch.get_count()))
+    return SNMP_CLASS_TL_FAILED;
 
-  if (receive_buffer_len == MAX_SNMP_PACKET + 1)
+  return process_snmp_response(batch.get_data(index), batch.get_length(index),
+                               batch.get_data_size(),
+                               *(const snmp_sockaddr *)batch.get_from(index),
+                               snmp_session, pdu, fromaddress, engine_id,
+                               true);
+}
+
+
+//---------[ receive a snmp trap ]---------------------------------
+// Decode a received trap. See receive_snmp_notification() below.
+static int process_snmp_notification(unsigned char *receive_buffer,
+                                     long receive_buffer_len,
+                                     long max_len,
+                                     const snmp_sockaddr &from_addr,
+                                     Snmp &snmp_session, Pdu &pdu,
+                                     SnmpTarget **target)
+{
+  if (receive_buffer_len > max_len)
   {
     // Message is too long...
     debugprintf(1, "Received message is ignored (packet too long)");
@@ -481,33 +817,8 @@ int receive_snmp_notification(SnmpSocket sock, Snmp &snmp_session,
   // copy fromaddress and remote port
   UdpAddress fromaddress;
 
-  if (((sockaddr_in&)from_addr).sin_family == AF_INET)
-  {
-    // IPv4
-    fromaddress = inet_ntoa(((sockaddr_in&)from_addr).sin_addr);
-    fromaddress.set_port(ntohs(((sockaddr_in&)from_addr).sin_port));
-  }
-#ifdef SNMP_PP_IPv6
-  else if (from_addr.ss_family == AF_INET6)
-  {
-    // IPv6
-    char tmp_buffer[INET6_ADDRSTRLEN+1];
-
-    inet_ntop(AF_INET6, &(((sockaddr_in6&)from_addr).sin6_addr),
-              tmp_buffer, INET6_ADDRSTRLEN);
-
-    fromaddress = tmp_buffer;
-    fromaddress.set_port(ntohs(((sockaddr_in6&)from_addr).sin6_port));
-    if (((sockaddr_in6&)from_addr).sin6_scope_id != 0)
-	fromaddress.set_scope(((sockaddr_in6&)from_addr).sin6_scope_id);
-  }
-#endif // SNMP_PP_IPv6
-  else
-  {
-    debugprintf(0, "Unknown socket address family (%i).",
-                ((sockaddr_in&)from_addr).sin_family);
+  if (!sockaddr_to_udp(from_addr, fromaddress))
     return SNMP_CLASS_TL_FAILED;
-  }
 
   debugprintf(1, "++ SNMP++: data received from %s.",
               fromaddress.get_printable());
@@ -572,6 +883,53 @@ int receive_snmp_notification(SnmpSocket sock, Snmp &snmp_session,
   return SNMP_CLASS_SUCCESS;   // Success! return
 }
 
+// Receive a trap from the specified socket
+// note: caller has to delete target!
+int receive_snmp_notification(SnmpSocket sock, Snmp &snmp_session,
+                              Pdu &pdu, SnmpTarget **target)
+{
+  long max_len = snmp_session.get_max_msg_size();
+  Buffer<unsigned char> receive_buffer(max_len + 1);
+  long receive_buffer_len; // len of received data
+  snmp_sockaddr from_addr;
+  snmp_socklen fromlen;
+  fromlen = sizeof(from_addr);
+
+  memset(&from_addr, 0, sizeof(from_addr));
+
+  // do the read
+  do {
+    receive_buffer_len = (long) recvfrom(sock,
+                                         (char *) receive_buffer.get_ptr(),
+                                         max_len + 1, 0,
+                                         (struct sockaddr*)&from_addr,
+                                         &fromlen);
+  } while (receive_buffer_len < 0 && EINTR == errno);
+
+  if (receive_buffer_len < 0 )                // error or no data pending
+    return SNMP_CLASS_TL_FAILED;
+
+  return process_snmp_notification(receive_buffer.get_ptr(),
+                                   receive_buffer_len, max_len,
+                                   from_addr, snmp_session, pdu, target);
+}
+
+// Decode the trap in slot index of a filled receive batch.
+// note: caller has to delete target!
+int receive_snmp_notification(SnmpRecvBatch &batch, const int index,
+                              Snmp &snmp_session, Pdu &pdu,
+                              SnmpTarget **target)
+{
+  if ((index < 0) || (index >= batch.get_count()))
+    return SNMP_CLASS_TL_FAILED;
+
+  return process_snmp_notification(batch.get_data(index),
+                                   batch.get_length(index),
+                                   batch.get_data_size(),
+                                   *(const snmp_sockaddr *)batch.get_from(index),
+                                   snmp_session, pdu, target);
+}
+
 
 //--------[ map action ]------------------------------------------------
 // map the snmp++ action to a SMI pdu type
@@ -813,6 +1171,8 @@ void Snmp::init(int& status, IpAddress *addresses[2],
       else
       {
         status = SNMP_CLASS_SUCCESS;
+        eventListHolder->RegisterSocket(iv_snmp_session,
+                                        eventListHolder->snmpEventList());
 #ifdef SNMP_BROADCAST
         int enable_broadcast = 1;
         setsockopt(iv_snmp_session, SOL_SOCKET, SO_BROADCAST,
@@ -924,6 +1284,8 @@ void Snmp::init(int& status, IpAddress *addresses[2],
       else
       {
         status = SNMP_CLASS_SUCCESS;
+        eventListHolder->RegisterSocket(iv_snmp_session_ipv6,
+                                        eventListHolder->snmpEventList());
 #ifdef SNMP_BROADCAST
         int enable_broadcast = 1;
         setsockopt(iv_snmp_session_ipv6, SOL_SOCKET, SO_BROADCAST,
@@ -957,6 +1319,7 @@ Snmp::~Snmp()
     // go through the snmpEventList and delete any outstanding
     // events on this socket
     eventListHolder->snmpEventList()->DeleteSocketEntry(iv_snmp_session);
+    eventListHolder->UnregisterSocket(iv_snmp_session);
 
     close(iv_snmp_session);    // close the dynamic socket
   }
@@ -969,6 +1332,7 @@ Snmp::~Snmp()
     // go through the snmpEventList and delete any outstanding
     // events on this socket
     eventListHolder->snmpEventList()->DeleteSocketEntry(iv_snmp_session_ipv6);
+    eventListHolder->UnregisterSocket(iv_snmp_session_ipv6);
 
     close(iv_snmp_session_ipv6);    // close the dynamic socket
   }
@@ -1162,6 +1526,235 @@ int Snmp::cancel(const unsigned long request_id)
   return status;
 }
 
+//-----------------------[ retransmission timeouts ]---------------------
+void Snmp::set_adaptive_timeout(const bool enable)
+{
+  eventListHolder->snmpEventList()->lock();
+  eventListHolder->snmpEventList()->SetAdaptiveTimeout(enable);
+  eventListHolder->snmpEventList()->unlock();
+}
+
+bool Snmp::get_adaptive_timeout()
+{
+  return eventListHolder->snmpEventList()->GetAdaptiveTimeout();
+}
+
+void Snmp::set_max_msg_size(const int size)
+{
+  int max_size = size;
+
+  if (max_size < MIN_SNMP_PACKET)
+    max_size = MIN_SNMP_PACKET;
+  else if (max_size > MAX_SNMP_PACKET_LIMIT)
+    max_size = MAX_SNMP_PACKET_LIMIT;
+
+  // the receive buffers are reallocated by the thread reading them
+  eventListHolder->snmpEventList()->SetMaxMsgSize(max_size);
+  eventListHolder->notifyEventList()->SetMaxMsgSize(max_size);
+}
+
+int Snmp::get_max_msg_size()
+{
+  return eventListHolder->snmpEventList()->GetMaxMsgSize();
+}
+
+bool Snmp::get_rtt_stats(const GenAddress &address, SnmpRttStats &stats)
+{
+  // same address as the requests of snmp_engine()
+  UdpAddress udp_address(address);
+  if ((address.get_type() == Address::type_ip) || !udp_address.get_port())
+    udp_address.set_port(SNMP_PORT);
+#ifdef SNMP_PP_IPv6
+  if ((udp_address.get_ip_version() == Address::version_ipv4) &&
+      (iv_snmp_session == INVALID_SOCKET))
+    udp_address.map_to_ipv6();
+#endif
+
+  eventListHolder->snmpEventList()->lock();
+  bool found = eventListHolder->snmpEventList()->GetRttStats(udp_address,
+							     stats);
+  eventListHolder->snmpEventList()->unlock();
+
+  return found;
+}
+
+//-----------------------[ async requests with handles ]-----------------
+SnmpRequest *Snmp::get_async(Pdu &pdu, const SnmpTarget &target)
+{
+  return start_request(pdu, target, sNMP_PDU_GET_ASYNC, 0, 0);
+}
+
+SnmpRequest *Snmp::get_next_async(Pdu &pdu, const SnmpTarget &target)
+{
+  return start_request(pdu, target, sNMP_PDU_GETNEXT_ASYNC, 0, 0);
+}
+
+SnmpRequest *Snmp::set_async(Pdu &pdu, const SnmpTarget &target)
+{
+  return start_request(pdu, target, sNMP_PDU_SET_ASYNC, 0, 0);
+}
+
+SnmpRequest *Snmp::get_bulk_async(Pdu &pdu, const SnmpTarget &target,
+				  const int non_repeaters, const int max_reps)
+{
+  return start_request(pdu, target, sNMP_PDU_GETBULK_ASYNC,
+		       non_repeaters, max_reps);
+}
+
+SnmpRequest *Snmp::start_request(Pdu &pdu, const SnmpTarget &target,
+				 const unsigned short action,
+				 const int non_reps, const int max_reps)
+{
+  SnmpRequest *request = new SnmpRequest(this);
+
+  // The id is known before the request is queued, a cancel() from
+  // another thread can find it as soon as it can be dispatched
+  long req_id = MyMakeReqId();
+  request->lock();
+  request->m_requestId = req_id;
+  request->unlock();
+
+  request->ref(); // released when the session calls back
+  pdu.set_type(action);
+  int status = snmp_engine(pdu, non_reps, max_reps, target,
+			   &SnmpRequest::callback, request,
+			   INVALID_SOCKET, 0, req_id);
+  if (status != SNMP_CLASS_SUCCESS)
+  {
+    request->complete(status, 0, 0);
+    request->unref(); // the session will not call back
+  }
+
+  return request;
+}
+
+SnmpRequest::SnmpRequest(Snmp *session)
+  : m_session(session), m_refs(1), m_done(false),
+    m_status(SNMP_CLASS_SUCCESS), m_target(0), m_requestId(0),
+    m_completion(0), m_data(0), m_executor(0)
+{
+}
+
+SnmpRequest::~SnmpRequest()
+{
+  if (m_target) delete m_target;
+}
+
+void SnmpRequest::ref()
+{
+  lock();
+  m_refs++;
+  unlock();
+}
+
+void SnmpRequest::unref()
+{
+  lock();
+  int refs = --m_refs;
+  unlock();
+
+  if (refs == 0)
+    delete this;
+}
+
+void SnmpRequest::then(const snmp_completion completion, void *data,
+		       SnmpExecutor *executor)
+{
+  lock();
+  m_completion = completion;
+  m_data = data;
+  m_executor = executor;
+  bool done = m_done;
+  if (done && completion && executor)
+    m_refs++; // released by run()
+  unlock();
+
+  if (done && completion)
+    dispatch(completion, data, executor);
+}
+
+int SnmpRequest::cancel()
+{
+  // Complete first: if the response arrives meanwhile, callback()
+  // finds the request done and only releases its reference
+  if (!complete(SNMP_CLASS_CANCELLED, 0, 0))
+    return SNMP_CLASS_INVALID_REQID;
+
+  // The entry may be gone already, or have been resent with another
+  // request id after a report. The session then calls back later.
+  lock();
+  unsigned long request_id = m_requestId;
+  unlock();
+
+  if (m_session->cancel(request_id) == SNMP_CLASS_SUCCESS)
+    unref(); // the session will not call back
+
+  return SNMP_CLASS_SUCCESS;
+}
+
+void SnmpRequest::run()
+{
+  lock();
+  snmp_completion completion = m_completion;
+  void *data = m_data;
+  unlock();
+
+  if (completion)
+    completion(this, data);
+
+  unref(); // taken for the executor
+}
+
+// the response pdu is moved into the request
+bool SnmpRequest::complete(const int status, Pdu *pdu,
+			   const SnmpTarget *target)
+{
+  lock();
+  if (m_done)
+  {
+    unlock();
+    return false;
+  }
+  m_done = true;
+  m_status = status;
+  if (pdu) m_pdu = static_cast<Pdu&&>(*pdu);
+  if (target) m_target = target->clone();
+
+  snmp_completion completion = m_completion;
+  void *data = m_data;
+  SnmpExecutor *executor = m_executor;
+  if (completion && executor)
+    m_refs++; // released by run()
+  unlock();
+
+  if (completion)
+    dispatch(completion, data, executor);
+
+  return true;
+}
+
+void SnmpRequest::dispatch(const snmp_completion completion, void *data,
+			   SnmpExecutor *executor)
+{
+  if (executor)
+    executor->post(this);
+  else
+    completion(this, data);
+}
+
+void SnmpRequest::callback(int reason, Snmp * /*session*/,
+			   Pdu &pdu, SnmpTarget &target, void *data)
+{
+  SnmpRequest *request = (SnmpRequest *)data;
+
+  if (reason == SNMP_CLASS_ASYNC_RESPONSE)
+    request->complete(SNMP_CLASS_SUCCESS, &pdu, &target);
+  else
+    request->complete(reason, 0, 0);
+
+  request->unref(); // taken by Snmp::start_request()
+}
+
 
 //----------------------[ sending report, V3 only]-----------------------
 int Snmp::report(Pdu &pdu,                // pdu to send
@@ -1337,7 +1930,7 @@ int Snmp::trap(Pdu &pdu,                        // pdu to send
   else // v2 and v3 use v2TRAP
     pdu.set_type( sNMP_PDU_TRAP);
 
-  SnmpMessage snmpmsg;
+  SnmpMessage snmpmsg(target.get_max_msg_size());
 
 #ifdef _SNMPv3
   if ( version == version3) {
@@ -1490,6 +2083,12 @@ int Snmp::notify_get_listen_port6()
   return eventListHolder->notifyEventList()->get_listen_port6();
 }
 
+// Share the trap ports with other sessions.
+void Snmp::notify_set_reuse_port(const bool reuse)
+{
+  eventListHolder->notifyEventList()->set_reuse_port(reuse);
+}
+
 //-----------------------[ register to get traps]-------------------------
 int Snmp::notify_register(const OidCollection     &trapids,
                           const TargetCollection  &targets,
@@ -1531,10 +2130,11 @@ int Snmp::snmp_engine( Pdu &pdu,              // pdu to use
                        const snmp_callback cb,// callback for async calls
                        const void *cbd,      // callback data
 		       SnmpSocket fd,
-		       int reports_received)
+		       int reports_received,
+		       long req_id)
 
 {
-  long req_id = 0;                   // pdu request id
+  long first_req_id = req_id;        // given by the caller or 0
   int status;                        // send status
 
 #ifdef _SNMPv3
@@ -1742,7 +2342,8 @@ int Snmp::snmp_engine( Pdu &pdu,              // pdu to use
       pdu.set_error_index(0);
 
       // determine request id to use
-      req_id = MyMakeReqId();
+      req_id = first_req_id ? first_req_id : MyMakeReqId();
+      first_req_id = 0;
       pdu.set_request_id(req_id);
     }
 
@@ -1755,7 +2356,14 @@ int Snmp::snmp_engine( Pdu &pdu,              // pdu to use
     }
 
     pdu.set_type( pdu_action);
-    SnmpMessage snmpmsg;
+
+    // make room for the response before the request is sent
+    if ((pdu_action != sNMP_PDU_RESPONSE) &&
+        (pdu_action != sNMP_PDU_REPORT) &&
+        (target.get_max_msg_size() > get_max_msg_size()))
+      set_max_msg_size(target.get_max_msg_size());
+
+    SnmpMessage snmpmsg(target.get_max_msg_size());
 
 #ifdef _SNMPv3
     struct V3CallBackData *v3CallBackData = 0;
@@ -2085,6 +2693,9 @@ int Snmp::engine_id_discovery(OctetStr &engine_id,
 	debugprintf(3, "Response received from (%s) id %s.",
 		    from.get_printable(), engine_id.get_printable());
 	unlock();
+	// more datagrams may be pending, which the event loop would not
+	// notice with edge triggered registrations
+	eventListHolder->RearmSocket(sock);
 	return SNMP_CLASS_SUCCESS;
       }
       else
@@ -2095,6 +2706,7 @@ int Snmp::engine_id_discovery(OctetStr &engine_id,
   } while ((nfound > 0) ||
 	   (fd_timeout.tv_sec > 0) || (fd_timeout.tv_usec > 0));
   unlock();
+  eventListHolder->RearmSocket(sock);
 
   return SNMP_CLASS_TIMEOUT;
 }
@@ -2255,6 +2867,7 @@ int Snmp::broadcast_discovery(UdpAddressCollection &addresses,
   } while ((nfound > 0) ||
 	   (fd_timeout.tv_sec > 0) || (fd_timeout.tv_usec > 0));
   unlock();
+  eventListHolder->RearmSocket(sock);
 
 #ifdef __DEBUG
   for (int i=0; i < addresses.size(); ++i)
@@ -34,6 +34,7 @@
 #include "snmp_pp/target.h"
 #include "snmp_pp/oid.h"
 #include "snmp_pp/address.h"
+#include "snmp_pp/pdu.h"
 
 #ifdef SNMP_PP_NAMESPACE
 namespace Snmp_pp {
@@ -83,6 +84,300 @@ class v3MP;
 typedef void (*snmp_callback)(int reason, Snmp *session,
                                Pdu &pdu, SnmpTarget &target, void *data);
 
+//-----------[ round trip times ]----------------------------------------
+/**
+ * Round trip time statistics of one agent address, see
+ * Snmp::get_rtt_stats(). All times are in milliseconds.
+ */
+struct DLLOPT SnmpRttStats
+{
+  unsigned long samples;          ///< responses to requests sent once
+  unsigned long retransmissions;  ///< requests sent again
+  unsigned long timeouts;         ///< requests without any response
+  unsigned long last_rtt;         ///< last round trip time
+  unsigned long srtt;             ///< smoothed round trip time
+  unsigned long rttvar;           ///< round trip time variation
+  unsigned long rto;              ///< current retransmission timeout
+};
+
+//-----------[ async request handles ]------------------------------------
+class SnmpRequest;
+
+/**
+ * Completion function of a SnmpRequest, see SnmpRequest::then().
+ *
+ * @param request - The completed request
+ * @param data    - Pointer passed to SnmpRequest::then()
+ */
+typedef void (*snmp_completion)(SnmpRequest *request, void *data);
+
+/**
+ * Runs completions in a context chosen by the application, for
+ * example the thread of a GUI event loop.
+ */
+class DLLOPT SnmpExecutor
+{
+ public:
+  virtual ~SnmpExecutor() {};
+
+  /**
+   * Queue a completed request. The executor must call request->run()
+   * once from its own context or, if it drops the request without
+   * running it, request->unref().
+   */
+  virtual void post(SnmpRequest *request) = 0;
+};
+
+/**
+ * Handle of an outstanding request, returned by the *_async() methods
+ * of the class Snmp.
+ *
+ * The request completes exactly once: with the response, with
+ * SNMP_CLASS_TIMEOUT after the retries of the target, with
+ * SNMP_CLASS_CANCELLED or with the error of the send. The handle is
+ * reference counted, the caller owns one reference and releases it
+ * with unref(), which does not cancel the request.
+ */
+class DLLOPT SnmpRequest: public SnmpSynchronized
+{
+ public:
+  void ref();
+  void unref();
+
+  /**
+   * Set the function called on completion. It is called right away
+   * if the request is already done. Without an executor, it is called
+   * from the thread that processes the events of the session.
+   * Passing a null completion detaches the caller: a completion
+   * already posted to an executor does not run anymore.
+   */
+  void then(const snmp_completion completion, void *data = 0,
+	    SnmpExecutor *executor = 0);
+
+  /**
+   * Cancel the request if it is not done yet. The completion runs
+   * with SNMP_CLASS_CANCELLED.
+   *
+   * @return SNMP_CLASS_SUCCESS or SNMP_CLASS_INVALID_REQID if the
+   *         request was already done
+   */
+  int cancel();
+
+  bool is_done() REENTRANT({ return m_done; });
+
+  /**
+   * Status of a completed request: SNMP_CLASS_SUCCESS if a response
+   * was received or a negative error code.
+   */
+  int get_status() REENTRANT({ return m_status; });
+
+  /**
+   * The response, valid once the request completed successfully.
+   */
+  const Pdu &get_pdu() const { return m_pdu; };
+
+  /**
+   * Move the response to pdu, for completions that keep it.
+   * get_pdu() returns an empty Pdu afterwards.
+   */
+  void take_pdu(Pdu &pdu) { pdu = static_cast<Pdu&&>(m_pdu); };
+
+  /**
+   * The source of the response or 0.
+   */
+  const SnmpTarget *get_target() const { return m_target; };
+
+  unsigned long get_request_id() const { return m_requestId; };
+
+  /**
+   * Run the completion, called by the executor.
+   */
+  void run();
+
+ private:
+  friend class Snmp;
+
+  SnmpRequest(Snmp *session);
+  ~SnmpRequest();
+
+  bool complete(const int status, Pdu *pdu, const SnmpTarget *target);
+  void dispatch(const snmp_completion completion, void *data,
+		SnmpExecutor *executor);
+
+  static void callback(int reason, Snmp *session,
+		       Pdu &pdu, SnmpTarget &target, void *data);
+
+  Snmp *m_session;
+  int m_refs;
+  bool m_done;
+  int m_status;
+  Pdu m_pdu;
+  SnmpTarget *m_target;
+  unsigned long m_requestId;
+  snmp_completion m_completion;
+  void *m_data;
+  SnmpExecutor *m_executor;
+};
+
+//-----------[ batched datagram I/O ]-------------------------------------
+/**
+ * A ring of pooled receive buffers, filled by one recvmmsg() call.
+ *
+ * Without HAVE_RECVMMSG, receive() does a single recvfrom(), so the
+ * same loop can be used on all platforms.
+ */
+class DLLOPT SnmpRecvBatch
+{
+ public:
+  SnmpRecvBatch(const int slots = SNMP_PP_BATCH_SIZE,
+                const int size = MAX_SNMP_PACKET);
+  ~SnmpRecvBatch();
+
+  /**
+   * Change the size of the largest datagram that can be received.
+   *
+   * The buffers are reallocated by the next receive(). Longer
+   * datagrams are received truncated and get a length of
+   * get_data_size() + 1. Only the reader owning the batch may call
+   * this, SnmpRecvBatchPool does when the batch is claimed.
+   */
+  void set_buffer_size(const int size) { m_newSize = size; };
+  int get_buffer_size() const { return m_newSize; };
+
+  /**
+   * Read the datagrams pending on the socket, at most one per slot.
+   *
+   * @param sock - socket that select()/poll() reported as readable
+   *
+   * @return the number of datagrams received or -1 on error
+   */
+  int receive(SnmpSocket sock);
+
+  int get_count() const { return m_count; };
+  int get_slots() const { return m_slots; };
+
+  /**
+   * Access a received datagram, 0 <= i < get_count().
+   */
+  unsigned char *get_data(const int i)
+    { return m_buffers + i * (m_size + 1); };
+  long get_length(const int i) const { return m_lengths[i]; };
+  const void *get_from(const int i) const;
+
+  /**
+   * Size of the largest datagram the last receive() could hold.
+   */
+  int get_data_size() const { return m_size; };
+
+ private:
+  void alloc_buffers();
+
+  int            m_slots;
+  int            m_count;
+  int            m_size;     // of the buffers, without the truncation byte
+  int            m_newSize;  // applied by the next receive()
+  unsigned char *m_buffers;
+  long          *m_lengths;
+  void          *m_from;   // array of socket addresses
+  void          *m_hdrs;   // array of struct mmsghdr
+  void          *m_iovs;   // array of struct iovec
+  SnmpRecvBatch *m_next;   // next free batch of the pool
+
+  friend class SnmpRecvBatchPool;
+
+  // not copyable
+  SnmpRecvBatch(const SnmpRecvBatch &);
+  SnmpRecvBatch &operator=(const SnmpRecvBatch &);
+};
+
+/**
+ * The receive batches of one queue.
+ *
+ * A reader claims a batch for as long as it dispatches the datagrams
+ * it received. A callback that processes events again, e.g. with a
+ * synchronous request, claims another batch instead of overwriting
+ * the datagrams that are still being dispatched. Batches are created
+ * on demand and kept: the pool holds one batch per nesting level or
+ * concurrent reader, usually just one.
+ */
+class DLLOPT SnmpRecvBatchPool : public SnmpSynchronized
+{
+ public:
+  SnmpRecvBatchPool(const int size = MAX_SNMP_PACKET);
+  ~SnmpRecvBatchPool();
+
+  /**
+   * Get a batch for receiving. Call release() when its datagrams
+   * have been processed.
+   */
+  SnmpRecvBatch *claim();
+  void release(SnmpRecvBatch *batch);
+
+  /**
+   * Change the size of the largest datagram that can be received.
+   * The size is kept under the lock of the pool, batches in use get
+   * it when they are claimed again.
+   */
+  void set_buffer_size(const int size);
+  int get_buffer_size();
+
+ private:
+  SnmpRecvBatch *m_free;  // list of the batches not in use
+  int            m_size;
+
+  // not copyable
+  SnmpRecvBatchPool(const SnmpRecvBatchPool &);
+  SnmpRecvBatchPool &operator=(const SnmpRecvBatchPool &);
+};
+
+/**
+ * Outgoing datagrams queued for one sendmmsg() call.
+ *
+ * Without HAVE_SENDMMSG, flush() does one sendto() per datagram.
+ */
+class DLLOPT SnmpSendBatch
+{
+ public:
+  SnmpSendBatch(const int slots = SNMP_PP_BATCH_SIZE,
+                const int size = MAX_SNMP_PACKET);
+  ~SnmpSendBatch();
+
+  /**
+   * Queue a copy of the datagram.
+   *
+   * @return 0 on success, -1 if the batch is full, the datagram is
+   *         longer than the size given to the constructor or the
+   *         address could not be used
+   */
+  int add(const unsigned char *send_buf, const size_t send_len,
+          const UdpAddress &address);
+
+  /**
+   * Send all queued datagrams on the given socket and empty the batch.
+   *
+   * @return the number of datagrams sent or -1 on error
+   */
+  int flush(SnmpSocket sock);
+
+  int get_count() const { return m_count; };
+  bool is_full() const { return m_count >= m_slots; };
+
+ private:
+  int            m_slots;
+  int            m_count;
+  int            m_size;   // of each buffer
+  unsigned char *m_buffers;
+  size_t        *m_lengths;
+  void          *m_to;     // array of socket addresses
+  int           *m_tolens;
+  void          *m_hdrs;   // array of struct mmsghdr
+  void          *m_iovs;   // array of struct iovec
+
+  // not copyable
+  SnmpSendBatch(const SnmpSendBatch &);
+  SnmpSendBatch &operator=(const SnmpSendBatch &);
+};
+
 
 //------------[ SNMP Class Def ]---------------------------------------------
 //
@@ -420,6 +715,78 @@ class DLLOPT Snmp: public SnmpSynchronized
    */
   virtual int cancel(const unsigned long rid);
 
+  /** @name Async requests with handles
+   *
+   * Send a request and return a handle that completes with the
+   * response, see SnmpRequest. The caller must release the handle
+   * with SnmpRequest::unref(). A request that could not be sent is
+   * returned already completed with the error.
+   */
+  //@{
+  SnmpRequest *get_async(Pdu &pdu, const SnmpTarget &target);
+  SnmpRequest *get_next_async(Pdu &pdu, const SnmpTarget &target);
+  SnmpRequest *set_async(Pdu &pdu, const SnmpTarget &target);
+  SnmpRequest *get_bulk_async(Pdu &pdu, const SnmpTarget &target,
+			      const int non_repeaters, const int max_reps);
+  //@}
+
+  /** @name Retransmission timeouts
+   *
+   * The round trip time of each agent address is measured on the
+   * responses to requests that were sent once (Karn's algorithm).
+   * With the adaptive timeout enabled, requests to an address that
+   * has answered before wait SRTT + 4 * RTTVAR (RFC 6298) instead of
+   * the timeout of the target, and every resend doubles the timeout
+   * of the request. The estimate of an address is also doubled on
+   * each timeout until its next sample. The target timeout is used
+   * for unknown addresses.
+   */
+  //@{
+  void set_adaptive_timeout(const bool enable);
+  bool get_adaptive_timeout();
+
+  /**
+   * Get the round trip time statistics of an agent address. The
+   * statistics are kept while adaptive timeouts are disabled, too.
+   *
+   * @param address - Address of the agent, as in the target. The
+   *                  port defaults to 161.
+   * @param stats   - Filled with the statistics
+   *
+   * @return false if no request to the address was answered or
+   *         resent yet
+   */
+  bool get_rtt_stats(const GenAddress &address, SnmpRttStats &stats);
+  //@}
+
+  /** @name Message size
+   *
+   * The receive buffers of the session hold messages of up to the
+   * maximum message size, MAX_SNMP_PACKET by default. Sending a
+   * request to a target with a larger SnmpTarget::get_max_msg_size()
+   * raises it, so the response can be received. Longer traps, informs
+   * and responses are dropped.
+   *
+   * The size is not lowered again by itself and costs memory: each of
+   * the receive batches for responses and for notifications holds
+   * SNMP_PP_BATCH_SIZE buffers of it, about 128 KB for 32 buffers of
+   * 4096 bytes and about 2 MB for 32 buffers of 65507 bytes. Callbacks
+   * that process events again use one more batch per nesting level.
+   */
+  //@{
+  /**
+   * Set the size of the largest message the session can receive.
+   *
+   * The new size is used by the batches claimed afterwards, it may
+   * be set while another thread receives.
+   *
+   * @param size - Size in bytes, clamped to the range
+   *               MIN_SNMP_PACKET..MAX_SNMP_PACKET_LIMIT (484..65507)
+   */
+  void set_max_msg_size(const int size);
+  int get_max_msg_size();
+  //@}
+
 
   /** @name Trap and Inform handling
    */
@@ -440,6 +807,14 @@ class DLLOPT Snmp: public SnmpSynchronized
   virtual int notify_get_listen_port();
   virtual int notify_get_listen_port6();
 
+  /**
+   * Let several sessions bind the same trap ports (SO_REUSEPORT).
+   * The received traps and informs are distributed between them.
+   *
+   * @note This function must be called before notify_register().
+   */
+  virtual void notify_set_reuse_port(const bool reuse);
+
   /**
    * Register to get traps and informs.
    *
@@ -577,6 +952,13 @@ protected:
    */
   long MyMakeReqId();
 
+  /**
+   * Send an async request on behalf of the *_async() methods.
+   */
+  SnmpRequest *start_request(Pdu &pdu, const SnmpTarget &target,
+			     const unsigned short action,
+			     const int non_reps, const int max_reps);
+
   /**
    * Common init function used by constructors.
    */
@@ -596,6 +978,9 @@ protected:
    *
    * @note that for a UTarget with an empty engine id the
    *       Utarget::set_engine_id() may be called.
+   *
+   * @param req_id - request id of the first send, made by the caller
+   *                 with MyMakeReqId(), or 0 for a new one
    */
   int snmp_engine( Pdu &pdu,                  // pdu to use
                    long int non_reps,         // get bulk only
@@ -604,7 +989,8 @@ protected:
                    const snmp_callback cb,    // async callback function
                    const void *cbd,          // callback data
 		   SnmpSocket fd = INVALID_SOCKET,
-		   int reports_received = 0);
+		   int reports_received = 0,
+		   long req_id = 0);
 
   //--------[ map action ]------------------------------------------------
   // map the snmp++ action to a SMI pdu type
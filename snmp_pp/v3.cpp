@@ -435,6 +435,132 @@ int saveBootCounter(const char *fileName,
   return SNMPv3_FILEOPEN_ERROR;
 }
 
+unsigned int v3hash(const unsigned char *data, const long int len,
+                    unsigned int hash)
+{
+  for (long int i = 0; i < len; i++)
+    hash = (hash ^ data[i]) * 16777619U;
+  return hash;
+}
+
+/* ------------------------- class HashIndex ----------------------- */
+
+// Positions that are not indexed have this chain value
+#define HASHINDEX_UNUSED -2
+
+HashIndex::HashIndex()
+  : buckets(0), chain(0), hashes(0), mask(0), size(0)
+{
+}
+
+HashIndex::~HashIndex()
+{
+  if (buckets) delete [] buckets;
+  if (chain)   delete [] chain;
+  if (hashes)  delete [] hashes;
+}
+
+bool HashIndex::resize(const int new_size)
+{
+  if (new_size <= size)
+    return true;
+
+  // keep at most one position per bucket on average
+  unsigned int bucket_count = 16;
+  while (bucket_count < (unsigned int)new_size)
+    bucket_count <<= 1;
+
+  int *new_buckets = new int[bucket_count];
+  int *new_chain = new int[new_size];
+  unsigned int *new_hashes = new unsigned int[new_size];
+  if (!new_buckets || !new_chain || !new_hashes)
+  {
+    if (new_buckets) delete [] new_buckets;
+    if (new_chain)   delete [] new_chain;
+    if (new_hashes)  delete [] new_hashes;
+    return false;
+  }
+
+  unsigned int i;
+  for (i = 0; i < bucket_count; i++)
+    new_buckets[i] = -1;
+
+  for (int pos = 0; pos < new_size; pos++)
+  {
+    if ((pos < size) && (chain[pos] != HASHINDEX_UNUSED))
+    {
+      unsigned int b = hashes[pos] & (bucket_count - 1);
+      new_hashes[pos] = hashes[pos];
+      new_chain[pos] = new_buckets[b];
+      new_buckets[b] = pos;
+    }
+    else
+      new_chain[pos] = HASHINDEX_UNUSED;
+  }
+
+  if (buckets) delete [] buckets;
+  if (chain)   delete [] chain;
+  if (hashes)  delete [] hashes;
+
+  buckets = new_buckets;
+  chain = new_chain;
+  hashes = new_hashes;
+  mask = bucket_count - 1;
+  size = new_size;
+
+  return true;
+}
+
+void HashIndex::add(const int pos, const unsigned int hash)
+{
+  if ((pos >= size) && !resize(pos + 1))
+    return;
+
+  if (chain[pos] != HASHINDEX_UNUSED)
+    remove(pos);
+
+  hashes[pos] = hash;
+  chain[pos] = buckets[hash & mask];
+  buckets[hash & mask] = pos;
+}
+
+void HashIndex::remove(const int pos)
+{
+  if ((pos >= size) || (chain[pos] == HASHINDEX_UNUSED))
+    return;
+
+  int *link = &buckets[hashes[pos] & mask];
+
+  while ((*link >= 0) && (*link != pos))
+    link = &chain[*link];
+
+  if (*link == pos)
+    *link = chain[pos];
+  chain[pos] = HASHINDEX_UNUSED;
+}
+
+void HashIndex::move(const int from, const int to)
+{
+  remove(to);
+  if ((from >= size) || (chain[from] == HASHINDEX_UNUSED))
+    return;
+
+  unsigned int hash = hashes[from];
+  remove(from);
+  add(to, hash);
+}
+
+void HashIndex::clear()
+{
+  if (!buckets)
+    return;
+
+  for (unsigned int i = 0; i <= mask; i++)
+    buckets[i] = -1;
+  for (int pos = 0; pos < size; pos++)
+    chain[pos] = HASHINDEX_UNUSED;
+}
+
 #endif
 
 #ifdef SNMP_PP_NAMESPACE
@@ -227,6 +227,99 @@ DLLOPT int getBootCounter(const char *fileName,
 DLLOPT int saveBootCounter(const char *fileName,
                            const OctetStr &engineId, const unsigned int boot);
 
+/**
+ * Hash a byte array (FNV-1a).
+ *
+ * @param data - The byte array
+ * @param len  - Length of the array
+ * @param hash - Result of a previous call to hash several arrays
+ *               into one value
+ *
+ * @return The hash value
+ */
+DLLOPT unsigned int v3hash(const unsigned char *data, const long int len,
+                           unsigned int hash = 2166136261U);
+
+/**
+ * Hash index over the positions of a table that is stored in an array.
+ *
+ * The index does not know the keys of the table: first() and next()
+ * return the positions with the same hash value and the table has to
+ * compare the keys itself. Tables that move their last entry into
+ * the position of a deleted one have to call move(). The index is
+ * not locked, this is up to the table.
+ */
+class DLLOPT HashIndex
+{
+ public:
+  HashIndex();
+  ~HashIndex();
+
+  /**
+   * Make room for the positions 0 to size-1, indexed positions are kept.
+   *
+   * @return false if no memory is available
+   */
+  bool resize(const int size);
+
+  /**
+   * Add a position with the given hash value.
+   */
+  void add(const int pos, const unsigned int hash);
+
+  /**
+   * Remove a position from the index.
+   */
+  void remove(const int pos);
+
+  /**
+   * Remove the position to and index the entry at position from there.
+   */
+  void move(const int from, const int to);
+
+  /**
+   * Remove all positions from the index.
+   */
+  void clear();
+
+  /**
+   * Get the first position with the given hash value.
+   *
+   * @return The position or -1
+   */
+  int first(const unsigned int hash) const
+  {
+    if (!buckets) return -1;
+    int pos = buckets[hash & mask];
+    while ((pos >= 0) && (hashes[pos] != hash))
+      pos = chain[pos];
+    return pos;
+  }
+
+  /**
+   * Get the next position with the same hash value as pos.
+   *
+   * @return The position or -1
+   */
+  int next(const int pos) const
+  {
+    int n = chain[pos];
+    while ((n >= 0) && (hashes[n] != hashes[pos]))
+      n = chain[n];
+    return n;
+  }
+
+ private:
+  HashIndex(const HashIndex &);
+  HashIndex &operator=(const HashIndex &);
+
+  int *buckets;          ///< first position of each bucket or -1
+  int *chain;            ///< next position in the bucket, -1 at the end
+  unsigned int *hashes;  ///< hash value of each position
+  unsigned int mask;     ///< number of buckets - 1
+  int size;              ///< number of positions
+};
+
 
 #endif // _SNMPv3
 
@@ -55,6 +55,9 @@
 =====================================================================*/
 char vb_cpp_version[]="#(@) SNMP++ $Id$";
 
+#include <stdio.h>                 // sprintf
+#include <limits.h>                // LONG_MAX
+
 #include "snmp_pp/vb.h"            // include vb class defs
 
 #ifdef SNMP_PP_NAMESPACE
@@ -96,13 +99,38 @@ Vb& Vb::operator=(const Vb &vb)
 
   //-----[ next set the vb value portion ]
   if (vb.iv_vb_value)
-    iv_vb_value = vb.iv_vb_value->clone();
+    copy_value(*vb.iv_vb_value);
 
   exception_status = vb.exception_status;
 
   return *this; // return self reference
 }
 
+//---------------[ Vb& Vb::operator=(Vb &&vb) ]-------------------------
+// move assignment, takes over the oid and a value on the heap,
+// inline values are small and copied
+Vb& Vb::operator=(Vb &&vb)
+{
+  if (this == &vb) return *this;  // check for self assignment
+
+  free_vb();
+
+  iv_vb_oid = static_cast<Oid&&>(vb.iv_vb_oid);
+
+  if (vb.value_is_inline())
+    copy_value(*vb.iv_vb_value);
+  else
+  {
+    iv_vb_value = vb.iv_vb_value;
+    vb.iv_vb_value = 0;
+  }
+
+  exception_status = vb.exception_status;
+  vb.free_vb();
+
+  return *this;
+}
+
 //----------------[ void Vb::free_vb() ]--------------------------------
 // protected method to free memory
 // this method is used to free memory when assigning new vbs
@@ -112,12 +140,32 @@ void Vb::free_vb()
 {
   if (iv_vb_value)
   {
-    delete iv_vb_value;
+    if (value_is_inline())
+      iv_vb_value->~SnmpSyntax();
+    else
+      delete iv_vb_value;
     iv_vb_value = NULL;
   }
   exception_status = SNMP_CLASS_SUCCESS;
 }
 
+//---------------------[ Vb::set_value(char *ptr) ]-------------------
+// set an octet string value, short strings are stored inline
+void Vb::set_value(const char *ptr)
+{
+  set_value((const unsigned char *)ptr,
+            ptr ? (unsigned int)strlen(ptr) : 0);
+}
+
+void Vb::set_value(const unsigned char *ptr, const unsigned int len)
+{
+  free_vb();
+  if (len <= OCTETSTR_INLINE_LEN)
+    iv_vb_value = new (&iv_inline_value.str) OctetStr(ptr, len);
+  else
+    iv_vb_value = new OctetStr(ptr, len);
+}
+
 //---------------------[ Vb::get_value(int &i) ]----------------------
 // get value int
 // returns 0 on success and value
@@ -306,16 +354,16 @@ void Vb::set_syntax(const SmiUINT32 syntax)
 
 	switch (syntax) {
 	case sNMP_SYNTAX_INT32:
-	  	iv_vb_value = new SnmpInt32();
+	  	iv_vb_value = new (&iv_inline_value.i32) SnmpInt32();
 		break;
 	case sNMP_SYNTAX_TIMETICKS:
-		iv_vb_value = new TimeTicks();
+		iv_vb_value = new (&iv_inline_value.ticks) TimeTicks();
 		break;
 	case sNMP_SYNTAX_CNTR32:
-		iv_vb_value = new Counter32();
+		iv_vb_value = new (&iv_inline_value.c32) Counter32();
 		break;
 	case sNMP_SYNTAX_GAUGE32:
-		iv_vb_value = new Gauge32();
+		iv_vb_value = new (&iv_inline_value.g32) Gauge32();
 		break;
 /* Not distinguishable from Gauge32
 	case sNMP_SYNTAX_UINT32:
@@ -323,14 +371,14 @@ void Vb::set_syntax(const SmiUINT32 syntax)
 		break;
 */
 	case sNMP_SYNTAX_CNTR64:
-	  	iv_vb_value = new Counter64();
+	  	iv_vb_value = new (&iv_inline_value.c64) Counter64();
 		break;
 	case sNMP_SYNTAX_BITS:
 	case sNMP_SYNTAX_OCTETS:
-	  	iv_vb_value = new OctetStr();
+	  	iv_vb_value = new (&iv_inline_value.str) OctetStr();
 		break;
 	case sNMP_SYNTAX_OPAQUE:
-	  	iv_vb_value = new OpaqueStr();
+	  	iv_vb_value = new (&iv_inline_value.opaque) OpaqueStr();
 		break;
 	case sNMP_SYNTAX_IPADDR:
 	  	iv_vb_value = new IpAddress();
@@ -373,6 +421,240 @@ int Vb::get_asn1_length() const
   return iv_vb_oid.get_asn1_length() + 2 + 4;
 }
 
+//=====================[ VbView ]=======================================
+
+SmiUINT32 VbView::get_syntax() const
+{
+  switch (view.type)
+  {
+    case sNMP_SYNTAX_INT:
+    case sNMP_SYNTAX_OCTETS:
+    case sNMP_SYNTAX_OID:
+    case sNMP_SYNTAX_IPADDR:
+    case sNMP_SYNTAX_CNTR32:
+    case sNMP_SYNTAX_GAUGE32:
+    case sNMP_SYNTAX_TIMETICKS:
+    case sNMP_SYNTAX_OPAQUE:
+    case sNMP_SYNTAX_CNTR64:
+    case sNMP_SYNTAX_NOSUCHOBJECT:
+    case sNMP_SYNTAX_NOSUCHINSTANCE:
+    case sNMP_SYNTAX_ENDOFMIBVIEW:
+      return view.type;
+    default:
+      return sNMP_SYNTAX_NULL;
+  }
+}
+
+int VbView::get_oid(Oid &id) const
+{
+  oid subids[ASN_MAX_NAME_LEN];
+  int len = asn_decode_objid(view.name, view.name_len,
+                             subids, ASN_MAX_NAME_LEN);
+  if (len < 0) return SNMP_CLASS_INVALID;
+
+  id.set_data(subids, len);
+  return SNMP_CLASS_SUCCESS;
+}
+
+int VbView::nCompare(const unsigned long n, const Oid &o) const
+{
+  oid subids[ASN_MAX_NAME_LEN];
+  unsigned long len = asn_decode_objid(view.name, view.name_len,
+                                       subids, ASN_MAX_NAME_LEN);
+  const SmiOID &other = o.get_smival().value.oid;
+  unsigned long length = n;
+  bool reduced_len = false;
+
+  // same rules as Oid::nCompare()
+  while ((len < length) && (other.len < length))
+    length--;
+
+  if (length == 0) return 0;
+
+  if (length > len)       { length = len;       reduced_len = true; }
+  if (length > other.len) { length = other.len; reduced_len = true; }
+
+  for (unsigned long z = 0; z < length; ++z)
+  {
+    if (subids[z] < other.ptr[z]) return -1;
+    if (subids[z] > other.ptr[z]) return 1;
+  }
+
+  if (reduced_len)
+  {
+    if (len < other.len) return -1;
+    if (len > other.len) return 1;
+  }
+  return 0;
+}
+
+int VbView::get_value(long &i) const
+{
+  if (view.type != sNMP_SYNTAX_INT)
+    return SNMP_CLASS_INVALID;
+
+  // shift unsigned, a negative long must not be shifted left
+  unsigned long value = 0;
+  for (int z = 0; z < view.val_len; ++z)
+    value = (value << 8) | view.val[z];
+
+  if (view.val_len && (*view.val & 0x80))
+  {
+    // integer is negative, extend the sign bit
+    if (view.val_len < (int)sizeof(value))
+      value |= ~0UL << (8 * view.val_len);
+    i = -(long)(~value & LONG_MAX) - 1;
+  }
+  else
+    i = (long)value;
+  return SNMP_CLASS_SUCCESS;
+}
+
+int VbView::get_value(unsigned long &i) const
+{
+  if ((view.type != sNMP_SYNTAX_CNTR32) &&
+      (view.type != sNMP_SYNTAX_GAUGE32) &&
+      (view.type != sNMP_SYNTAX_TIMETICKS))
+    return SNMP_CLASS_INVALID;
+
+  unsigned long value = 0;
+  for (int z = 0; z < view.val_len; ++z)
+    value = (value << 8) + view.val[z];
+  i = value;
+  return SNMP_CLASS_SUCCESS;
+}
+
+int VbView::get_value(Counter64 &c) const
+{
+  if (view.type != sNMP_SYNTAX_CNTR64)
+    return SNMP_CLASS_INVALID;
+
+  unsigned long low = 0, high = 0;
+  if (view.val_len && (*view.val & 0x80))
+  {
+    low = (unsigned long) -1; // integer is negative
+    high = (unsigned long) -1;
+  }
+  for (int z = 0; z < view.val_len; ++z)
+  {
+    high = (high << 8) | ((low & 0xFF000000) >> 24);
+    low = ((low << 8) | view.val[z]) & 0xFFFFFFFF;
+  }
+  c.set_high(high);
+  c.set_low(low);
+  return SNMP_CLASS_SUCCESS;
+}
+
+int VbView::get_value(Oid &id) const
+{
+  if (view.type != sNMP_SYNTAX_OID)
+    return SNMP_CLASS_INVALID;
+
+  oid subids[ASN_MAX_NAME_LEN];
+  int len = asn_decode_objid(view.val, view.val_len,
+                             subids, ASN_MAX_NAME_LEN);
+  if (len < 0) return SNMP_CLASS_INVALID;
+
+  id.set_data(subids, len);
+  return SNMP_CLASS_SUCCESS;
+}
+
+int VbView::get_value(const unsigned char *&ptr, unsigned long &len) const
+{
+  if ((view.type != sNMP_SYNTAX_OCTETS) &&
+      (view.type != sNMP_SYNTAX_OPAQUE) &&
+      (view.type != sNMP_SYNTAX_IPADDR))
+    return SNMP_CLASS_INVALID;
+
+  ptr = view.val;
+  len = view.val_len;
+  return SNMP_CLASS_SUCCESS;
+}
+
+int VbView::get_vb(Vb &vb) const
+{
+  if (!valid()) return false;
+
+  vb.free_vb();
+  if (get_oid(vb.iv_vb_oid) != SNMP_CLASS_SUCCESS)
+    return false;
+
+  switch (view.type)
+  {
+    case sNMP_SYNTAX_OCTETS:
+      vb.set_value(view.val, view.val_len);
+      break;
+
+    case sNMP_SYNTAX_OPAQUE:
+      if (view.val_len <= OCTETSTR_INLINE_LEN)
+        vb.iv_vb_value = new (&vb.iv_inline_value.opaque)
+                                     OpaqueStr(view.val, view.val_len);
+      else
+        vb.iv_vb_value = new OpaqueStr(view.val, view.val_len);
+      break;
+
+    case sNMP_SYNTAX_OID:
+    {
+      Oid *o = new Oid();
+      get_value(*o);
+      vb.iv_vb_value = o;
+      break;
+    }
+    case sNMP_SYNTAX_TIMETICKS:
+    case sNMP_SYNTAX_CNTR32:
+    case sNMP_SYNTAX_GAUGE32:
+    {
+      unsigned long ul = 0;
+      get_value(ul);
+      if (view.type == sNMP_SYNTAX_TIMETICKS)
+        vb.iv_vb_value = new (&vb.iv_inline_value.ticks) TimeTicks(ul);
+      else if (view.type == sNMP_SYNTAX_CNTR32)
+        vb.iv_vb_value = new (&vb.iv_inline_value.c32) Counter32(ul);
+      else
+        vb.iv_vb_value = new (&vb.iv_inline_value.g32) Gauge32(ul);
+      break;
+    }
+    case sNMP_SYNTAX_IPADDR:
+    {
+      char buffer[42];
+      const unsigned char *v = view.val;
+
+      if (view.val_len == 16)
+        sprintf(buffer, "%02x%02x:%02x%02x:%02x%02x:%02x%02x:"
+                "%02x%02x:%02x%02x:%02x%02x:%02x%02x",
+                v[ 0], v[ 1], v[ 2], v[ 3], v[ 4], v[ 5], v[ 6], v[ 7],
+                v[ 8], v[ 9], v[10], v[11], v[12], v[13], v[14], v[15]);
+      else
+        sprintf(buffer, "%d.%d.%d.%d", v[0], v[1], v[2], v[3]);
+      vb.iv_vb_value = new IpAddress(buffer);
+      break;
+    }
+    case sNMP_SYNTAX_INT:
+    {
+      long l = 0;
+      get_value(l);
+      vb.iv_vb_value = new (&vb.iv_inline_value.i32) SnmpInt32(l);
+      break;
+    }
+    case sNMP_SYNTAX_CNTR64:
+    {
+      Counter64 *c64 = new (&vb.iv_inline_value.c64) Counter64();
+      get_value(*c64);
+      vb.iv_vb_value = c64;
+      break;
+    }
+    case sNMP_SYNTAX_NOSUCHOBJECT:
+    case sNMP_SYNTAX_NOSUCHINSTANCE:
+    case sNMP_SYNTAX_ENDOFMIBVIEW:
+      vb.exception_status = view.type;
+      break;
+
+    default: // NULL, and types SNMP++ has no class for
+      break;
+  }
+  return true;
+}
+
 #ifdef SNMP_PP_NAMESPACE
 }; // end of namespace Snmp_pp
 #endif 
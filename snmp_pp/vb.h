@@ -71,6 +71,7 @@
 #include "snmp_pp/address.h"             // address class def
 #include "snmp_pp/integer.h"             // integer class
 #include "snmp_pp/snmperrs.h"
+#include "snmp_pp/asn1.h"                // encoded vb views
 
 #ifdef SNMP_PP_NAMESPACE
 namespace Snmp_pp {
@@ -86,6 +87,10 @@ namespace Snmp_pp {
  * getting or setting MIB values.  The vb class keeps its own memory
  * for objects and does not utilize pointers to external data
  * structures.
+ *
+ * @note Integers, counters, timeticks and octet strings of up to
+ *       OCTETSTR_INLINE_LEN bytes are stored inside the Vb, other
+ *       values are allocated on the heap.
  */
 class DLLOPT Vb
 {
@@ -114,6 +119,11 @@ class DLLOPT Vb
    */
   Vb(const Vb &vb) : iv_vb_value(0) { *this = vb; };
 
+  /**
+   * Move constructor, the source Vb is empty afterwards.
+   */
+  Vb(Vb &&vb) : iv_vb_value(0) { *this = static_cast<Vb&&>(vb); };
+
   /**
    * Destructor that frees all allocated memory.
    */
@@ -124,6 +134,11 @@ class DLLOPT Vb
    */
   Vb& operator=(const Vb &vb);
 
+  /**
+   * Move assignment, the source Vb is empty afterwards.
+   */
+  Vb& operator=(Vb &&vb);
+
   /**
    * Clone operator.
    */
@@ -158,14 +173,15 @@ class DLLOPT Vb
    * Set the value using any SnmpSyntax object.
    */
   void set_value(const SnmpSyntax &val)
-    { free_vb(); iv_vb_value = val.clone(); };
+    { free_vb(); copy_value(val); };
 
   /**
    * Set the value with an int.
    *
    * The syntax of the Vb will be set to SMI INT32.
    */
-  void set_value(const int i) { free_vb(); iv_vb_value = new SnmpInt32(i); };
+  void set_value(const int i)
+    { free_vb(); iv_vb_value = new (&iv_inline_value.i32) SnmpInt32(i); };
 
   /**
    * Set the value with an unsigned int.
@@ -173,7 +189,7 @@ class DLLOPT Vb
    * The syntax of the Vb will be set to SMI UINT32.
    */
   void set_value(const unsigned int i)
-    { free_vb(); iv_vb_value = new SnmpUInt32(i); };
+    { free_vb(); iv_vb_value = new (&iv_inline_value.u32) SnmpUInt32(i); };
 
   /**
    * Set the value with a long int.
@@ -183,7 +199,7 @@ class DLLOPT Vb
    * The syntax of the Vb will be set to SMI INT32.
    */
   void set_value(const long i)
-    { free_vb(); iv_vb_value = new SnmpInt32(i); };
+    { free_vb(); iv_vb_value = new (&iv_inline_value.i32) SnmpInt32(i); };
 
   /**
    * Set the value with an unsigned long int.
@@ -193,23 +209,21 @@ class DLLOPT Vb
    * The syntax of the Vb will be set to SMI UINT32.
    */
   void set_value(const unsigned long i)
-    { free_vb(); iv_vb_value = new SnmpUInt32(i); };
+    { free_vb(); iv_vb_value = new (&iv_inline_value.u32) SnmpUInt32(i); };
 
   /**
    * Set value using a null terminated string.
    *
    * The syntax of the Vb will be set to SMI octet.
    */
-  void set_value(const char *ptr)
-    { free_vb(); iv_vb_value = new OctetStr(ptr); };
+  void set_value(const char *ptr);
 
   /**
    * Set value using a string and length.
    *
    * The syntax of the Vb will be set to SMI octet.
    */
-  void set_value(const unsigned char *ptr, const unsigned int len)
-    { free_vb(); iv_vb_value = new OctetStr(ptr, len); };
+  void set_value(const unsigned char *ptr, const unsigned int len);
 
   /**
    * Set the value portion of the vb to null, if its not already.
@@ -344,6 +358,15 @@ class DLLOPT Vb
   SnmpSyntax* clone_value() const
       { return ((iv_vb_value) ? iv_vb_value->clone() : 0); };
 
+  /**
+   * Get the value portion of the variable binding without copying it.
+   *
+   * @return
+   *    a pointer to the value, that is valid until the receiver is
+   *    modified, or NULL if no value is set.
+   */
+  const SnmpSyntax *get_value_ptr() const { return iv_vb_value; };
+
 
   //-----[ misc]--------------------------------------------------------
 
@@ -414,14 +437,165 @@ class DLLOPT Vb
 
  //-----[ protected members ]
  protected:
+  friend class VbView;
+
   Oid iv_vb_oid;               // a vb is made up of a oid
   SnmpSyntax *iv_vb_value;     // and a value...
   SmiUINT32 exception_status;  // are there any vb exceptions??
 
+  // Storage for small values. If iv_vb_value points here, the value
+  // is destroyed in place instead of deleted.
+  union InlineValue
+  {
+    InlineValue() {};
+    ~InlineValue() {};
+
+    SnmpInt32  i32;
+    SnmpUInt32 u32;
+    Counter32  c32;
+    Gauge32    g32;
+    TimeTicks  ticks;
+    Counter64  c64;
+    OctetStr   str;
+    OpaqueStr  opaque;
+  } iv_inline_value;
+
   /**
    * Free the value portion.
    */
   void free_vb();
+
+  /**
+   * Set the value to a copy of val, stored inline if it is small.
+   */
+  void copy_value(const SnmpSyntax &val)
+  {
+    iv_vb_value = val.clone_into(&iv_inline_value, sizeof(iv_inline_value));
+    if (!iv_vb_value) iv_vb_value = val.clone();
+  };
+
+  /**
+   * Check if the value is stored inside the Vb.
+   */
+  bool value_is_inline() const
+    { return ((const void *)iv_vb_value == (const void *)&iv_inline_value); };
+};
+
+//------------[ VbView Class Def ]---------------------------------
+/**
+ * Read only view of a received variable binding.
+ *
+ * A VbView refers to the encoded variable binding inside the Pdu it
+ * was taken from (see Pdu::get_vb_view()). Name and value are decoded
+ * on each access, nothing is copied. The view is only valid as long
+ * as the Pdu is neither modified nor destroyed.
+ */
+class DLLOPT VbView
+{
+ public:
+  /**
+   * Constructor no args, creates an invalid view.
+   */
+  VbView() { view.ber = 0; view.ber_len = 0; };
+
+  /**
+   * Return validity of the view.
+   */
+  bool valid() const { return (view.ber != 0); };
+
+  /**
+   * Return the syntax, as Vb::get_syntax() would after get_vb().
+   */
+  SmiUINT32 get_syntax() const;
+
+  /**
+   * Get the number of subids of the oid portion.
+   */
+  unsigned long get_oid_len() const { return view.name_length; };
+
+  /**
+   * Get the oid portion.
+   */
+  int get_oid(Oid &id) const;
+
+  /**
+   * Compare the n leftmost subids of the oid portion with an Oid,
+   * like Oid::nCompare() does.
+   *
+   * @return 0 if equal / -1 if less / 1 if greater
+   */
+  int nCompare(const unsigned long n, const Oid &o) const;
+
+  /**
+   * Get the value of an Integer32.
+   *
+   * @return SNMP_CLASS_SUCCESS or SNMP_CLASS_INVALID on a syntax mismatch
+   */
+  int get_value(long &i) const;
+
+  /**
+   * Get the value of a Counter32, Gauge32 or TimeTicks.
+   *
+   * @return SNMP_CLASS_SUCCESS or SNMP_CLASS_INVALID on a syntax mismatch
+   */
+  int get_value(unsigned long &i) const;
+
+  /**
+   * Get the value of a Counter64.
+   *
+   * @return SNMP_CLASS_SUCCESS or SNMP_CLASS_INVALID on a syntax mismatch
+   */
+  int get_value(Counter64 &c) const;
+
+  /**
+   * Get the value of an object identifier.
+   *
+   * @return SNMP_CLASS_SUCCESS or SNMP_CLASS_INVALID on a syntax mismatch
+   */
+  int get_value(Oid &id) const;
+
+  /**
+   * Get the raw value of an OCTET STRING, Opaque or IpAddress.
+   *
+   * @param ptr - OUT: points to the value inside the Pdu
+   * @param len - OUT: length of the value
+   *
+   * @return SNMP_CLASS_SUCCESS or SNMP_CLASS_INVALID on a syntax mismatch
+   */
+  int get_value(const unsigned char *&ptr, unsigned long &len) const;
+
+  /**
+   * Decode the whole variable binding into a Vb.
+   *
+   * @return TRUE on success
+   */
+  int get_vb(Vb &vb) const;
+
+  /**
+   * Get the BER encoding of the variable binding.
+   */
+  const unsigned char *get_ber() const { return view.ber; };
+
+  /**
+   * Get the length of the BER encoding.
+   */
+  int get_ber_len() const { return view.ber_len; };
+
+ protected:
+  friend class Pdu;
+
+  /**
+   * Move the view to a copy of the encoded vbs.
+   */
+  void rebase(const unsigned char *from, unsigned char *to)
+  {
+    if (!view.ber) return;
+    view.ber  = to + (view.ber  - from);
+    view.name = to + (view.name - from);
+    view.val  = to + (view.val  - from);
+  };
+
+  struct vb_view view;
 };
 
 #ifdef SNMP_PP_NAMESPACE
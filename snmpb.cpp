@@ -27,6 +27,7 @@
 #include "logsnmpb.h"
 #include "mibeditor.h"
 #include "discovery.h"
+#include "trapgen.h"
 
 #include "agentprofile.h"
 #include "usmprofile.h"
@@ -40,6 +41,8 @@
 #define AGENTS_CONFIG_FILE       "agents.conf"
 #define PREFS_CONFIG_FILE        "preferences.conf"
 #define LOG_CONFIG_FILE          "log.conf"
+#define KEY_CACHE_FILE           "usm_keys.cache"
+#define KEY_CACHE_SECRET_FILE    "usm_keys.secret"
 
 #define STANDARD_TRAP_PORT       162 
 
@@ -63,6 +66,7 @@ Snmpb::Snmpb(void)
     // bind on privileged ports (<1024). This is needed to bind on 
     // the RFC-defined trap port number 162 on UNIX machines.
     prefs = new Preferences(this);
+    trapgen = NULL;
 #ifndef WIN32 
     // Allows to bind on privileged ports only if it is the standard trap port...
     if (! (((prefs->GetEnableIPv4() == true) && 
@@ -103,7 +107,7 @@ void Snmpb::BindToGUI(QMainWindow* mw)
         if (start_msg != "")
             QMessageBox::warning ( NULL, "SnmpB", start_msg,
                                    QMessageBox::Ok, Qt::NoButton);
-        agent->StartTrapTimer();
+        agent->StartEvents();
     }
 
     w.setupUi(mw);
@@ -122,6 +126,7 @@ void Snmpb::BindToGUI(QMainWindow* mw)
     graph = new Graph(this);
     editor = new MibEditor(this);
     discovery = new Discovery(this);
+    trapgen = new TrapGenerator(this);
 
     // Connect some signals
     connect( w.TabW, SIGNAL( currentChanged(int) ),
@@ -188,6 +193,11 @@ Preferences* Snmpb::PreferencesObj(void)
     return (prefs);
 }
 
+TrapGenerator* Snmpb::TrapGenObj(void)
+{
+    return (trapgen);
+}
+
 void Snmpb::CheckForConfigFiles(void)
 {
     if (!SnmpbDir.exists())
@@ -254,6 +264,16 @@ QString Snmpb::GetLogConfigFile(void)
     return (SnmpbDir.filePath(LOG_CONFIG_FILE));
 }
 
+QString Snmpb::GetKeyCacheFile(void)
+{
+    return (SnmpbDir.filePath(KEY_CACHE_FILE));
+}
+
+QString Snmpb::GetKeyCacheSecretFile(void)
+{
+    return (SnmpbDir.filePath(KEY_CACHE_SECRET_FILE));
+}
+
 void Snmpb::ManageAgentProfiles(bool)
 {
     apm->Execute();
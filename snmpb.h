@@ -33,6 +33,7 @@ class Graph;
 class MibEditor;
 class LogSnmpb;
 class Discovery;
+class TrapGenerator;
 class AgentProfileManager;
 class USMProfileManager;
 class Preferences;
@@ -53,6 +54,7 @@ public:
     AgentProfileManager* APManagerObj(void);
     USMProfileManager* UPManagerObj(void);
     Preferences* PreferencesObj(void);
+    TrapGenerator* TrapGenObj(void);
 
     void CheckForConfigFiles(void);
     QString GetBootCounterConfigFile(void);
@@ -62,6 +64,8 @@ public:
     QString GetAgentsConfigFile(void);
     QString GetPrefsConfigFile(void);
     QString GetLogConfigFile(void);
+    QString GetKeyCacheFile(void);
+    QString GetKeyCacheSecretFile(void);
 
 public slots:
     void TabSelected(void);
@@ -87,6 +91,7 @@ private:
     MibEditor *editor;
     LogSnmpb *logsnmpb;
     Discovery *discovery;
+    TrapGenerator *trapgen;
 
     QString start_msg;
     bool start_issuccess;
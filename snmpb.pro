@@ -60,6 +60,11 @@ SOURCES	+= \
     mibselection.cpp \
     logsnmpb.cpp \
     discovery.cpp \
+    discprobe.cpp \
+    trapgen.cpp \
+    trapsearch.cpp \
+    trapexport.cpp \
+    snmpevents.cpp \
     agentprofile.cpp \
     usmprofile.cpp \
     preferences.cpp \
@@ -178,6 +183,11 @@ HEADERS	+= \
     mibselection.h \
     logsnmpb.h \
     discovery.h \
+    discprobe.h \
+    trapgen.h \
+    trapsearch.h \
+    trapexport.h \
+    snmpevents.h \
     agentprofile.h \
     usmprofile.h \
     preferences.h \
@@ -327,7 +337,8 @@ FORMS	= mainw.ui \
         gotoline.ui \
         find.ui \
         replace.ui \
-        varbinds.ui
+        varbinds.ui \
+        trapgen.ui
 
 RESOURCES = snmpb.qrc
 
@@ -0,0 +1,487 @@
+/*
+    Copyright (C) 2004-2011 Martin Jolicoeur (snmpb1@gmail.com)
+
+    This file is part of the SnmpB project
+    (http://sourceforge.net/projects/snmpb)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <utility>
+
+#include "snmpevents.h"
+
+SnmpEventNotifier::SnmpEventNotifier(Snmp *session, QObject *parent)
+    :QObject(parent)
+{
+    holder = session->get_eventListHolder();
+    busy = false;
+    stopped = true;
+
+    timer.setSingleShot(true);
+    connect(&timer, SIGNAL(timeout()), this, SLOT(TimerExpired()));
+}
+
+void SnmpEventNotifier::Update(void)
+{
+    SnmpSocket fds[SNMP_EVENTS_MAX_SOCKETS];
+    int count = holder->GetSockets(fds, SNMP_EVENTS_MAX_SOCKETS);
+    QSet<int> current;
+
+    stopped = false;
+
+    // Follow the sockets opened and closed by the session
+    for (int i = 0; i < count; i++)
+    {
+        current.insert((int)fds[i]);
+        if (!notifiers.contains((int)fds[i]))
+        {
+            QSocketNotifier *n = new QSocketNotifier(fds[i],
+                                                     QSocketNotifier::Read,
+                                                     this);
+            connect(n, SIGNAL(activated(int)), this, SLOT(SocketReady(int)));
+            notifiers.insert((int)fds[i], n);
+        }
+    }
+
+    QMutableHashIterator<int, QSocketNotifier*> i(notifiers);
+    while (i.hasNext())
+    {
+        i.next();
+        if (!current.contains(i.key()))
+        {
+            delete i.value();
+            i.remove();
+        }
+    }
+
+    // While the events are handled, the notifiers are enabled again
+    // once the callbacks returned
+    if (busy == false)
+        SetEnabled(true);
+
+    // Next retransmission or timeout, in hundredths of seconds
+    Uint32 next = holder->SNMPGetNextTimeout();
+    if (next == UINT_MAX)
+        timer.stop();
+    else
+        timer.start(next * 10);
+}
+
+void SnmpEventNotifier::Stop(void)
+{
+    stopped = true;
+    SetEnabled(false);
+    timer.stop();
+}
+
+void SnmpEventNotifier::SetEnabled(bool enabled)
+{
+    QHash<int, QSocketNotifier*>::const_iterator i;
+    for (i = notifiers.constBegin(); i != notifiers.constEnd(); ++i)
+        i.value()->setEnabled(enabled);
+}
+
+void SnmpEventNotifier::SocketReady(int fd)
+{
+    // The callbacks may open modal dialogs: snmp++ must not be
+    // entered again from their event loop
+    if (busy || stopped)
+        return;
+
+    busy = true;
+    SetEnabled(false);
+    holder->SNMPProcessSocket(fd);
+    busy = false;
+
+    if (stopped == false)
+        Update();
+}
+
+void SnmpEventNotifier::TimerExpired(void)
+{
+    if (busy || stopped)
+        return;
+
+    busy = true;
+    SetEnabled(false);
+    holder->SNMPProcessPendingEvents();
+    busy = false;
+
+    if (stopped == false)
+        Update();
+}
+
+// Completion of a request, queued to the thread of its reply. A request
+// still queued when the reply is deleted is released with the event.
+class SnmpReplyEvent: public QEvent
+{
+public:
+    static const QEvent::Type ReplyType = QEvent::User;
+
+    SnmpReplyEvent(SnmpRequest *req):QEvent(ReplyType) { request = req; };
+    ~SnmpReplyEvent() { if (request) request->unref(); };
+    SnmpRequest *Take(void) { SnmpRequest *r = request; request = NULL; return r; };
+
+private:
+    SnmpRequest *request;
+};
+
+SnmpReply::SnmpReply(SnmpRequest *req, QObject *parent)
+    :QObject(parent)
+{
+    request = req;
+    done = false;
+    status = SNMP_CLASS_SUCCESS;
+    request->then(Completed, this, this);
+}
+
+SnmpReply::SnmpReply(QObject *parent)
+    :QObject(parent)
+{
+    request = NULL;
+    done = false;
+    status = SNMP_CLASS_SUCCESS;
+}
+
+SnmpReply::~SnmpReply()
+{
+    if (request)
+    {
+        // Nothing may be posted to this object anymore
+        request->then(NULL);
+        request->cancel();
+        request->unref();
+    }
+}
+
+void SnmpReply::Abort(void)
+{
+    if (request)
+        request->cancel();
+    else
+        Finish(SNMP_CLASS_CANCELLED, Pdu());
+}
+
+void SnmpReply::Finish(int st, Pdu &&p)
+{
+    if (done)
+        return;
+
+    done = true;
+    status = st;
+    pdu = std::move(p);
+    QCoreApplication::postEvent(this, new SnmpReplyEvent(NULL));
+}
+
+void SnmpReply::post(SnmpRequest *req)
+{
+    QCoreApplication::postEvent(this, new SnmpReplyEvent(req));
+}
+
+void SnmpReply::customEvent(QEvent *event)
+{
+    if (event->type() != SnmpReplyEvent::ReplyType)
+        return;
+
+    SnmpRequest *req = ((SnmpReplyEvent *)event)->Take();
+    if (req)
+        req->run();
+    else
+        emit finished(this);
+}
+
+void SnmpReply::Completed(SnmpRequest *req, void *data)
+{
+    SnmpReply *reply = (SnmpReply *)data;
+
+    reply->done = true;
+    reply->status = req->get_status();
+    req->take_pdu(reply->pdu);
+    emit reply->finished(reply);
+}
+
+SnmpCoalescer::SnmpCoalescer(Snmp *session, SnmpEventNotifier *notifier,
+                             QObject *parent)
+    :QObject(parent)
+{
+    snmp = session;
+    events = notifier;
+    window = 0;
+    clock.start();
+
+    timer.setSingleShot(true);
+    connect(&timer, SIGNAL(timeout()), this, SLOT(TimerExpired()));
+}
+
+SnmpCoalescer::~SnmpCoalescer()
+{
+    // The requests in flight are children, cancelled with them
+    QList<coalesce_batch*> batches = pending + inflight.values();
+    for (int i = 0; i < batches.size(); i++)
+    {
+        delete batches[i]->target;
+        delete batches[i];
+    }
+}
+
+// Agent, credentials and retry policy: GETs are merged only when
+// sending them one by one would give the same result
+QString SnmpCoalescer::Key(const Pdu &pdu, const SnmpTarget &target)
+{
+    QString key = QString("%1 %2 %3 %4")
+                    .arg(target.get_address().get_printable())
+                    .arg(target.get_version())
+                    .arg(target.get_timeout())
+                    .arg(target.get_retry());
+
+    if (target.get_type() == SnmpTarget::type_utarget)
+    {
+        const UTarget &u = (const UTarget &)target;
+        key += QString(" %1 %2 %3 %4 %5")
+                 .arg(u.get_security_name().get_printable_hex())
+                 .arg(u.get_security_model())
+                 .arg(pdu.get_security_level())
+                 .arg(pdu.get_context_name().get_printable_hex())
+                 .arg(pdu.get_context_engine_id().get_printable_hex());
+    }
+    else if (target.get_type() == SnmpTarget::type_ctarget)
+    {
+        OctetStr community;
+        ((const CTarget &)target).get_readcommunity(community);
+        key += QString(" %1").arg(community.get_printable_hex());
+    }
+
+    return key;
+}
+
+// Upper bound of the BER encoding of a varbind with a NULL value
+int SnmpCoalescer::EncodedSize(const Vb &vb)
+{
+    const Oid &oid = vb.get_oid();
+    int size = 4 + 4 + 2;   // sequence, OID and NULL headers
+
+    for (unsigned int i = 1; i < oid.len(); i++)
+    {
+        unsigned long subid = oid[i];
+        do
+        {
+            size++;
+            subid >>= 7;
+        } while (subid);
+    }
+
+    return size;
+}
+
+SnmpReply *SnmpCoalescer::Get(Pdu &pdu, const SnmpTarget &target,
+                              QObject *parent)
+{
+    // Not merged: coalescing disabled or several varbinds already
+    if ((window <= 0) || (pdu.get_vb_count() != 1))
+    {
+        SnmpReply *reply = new SnmpReply(snmp->get_async(pdu, target), parent);
+        events->Update();
+        return reply;
+    }
+
+    QString key = Key(pdu, target);
+    Vb vb;
+    pdu.get_vb(vb, 0);
+    int size = EncodedSize(vb);
+
+    coalesce_batch *b = open.value(key);
+    if (b && ((b->entries.size() >= maxvbs.value(key, SNMP_COALESCE_MAX_VBS)) ||
+              (b->size + size > SNMP_COALESCE_MAX_PDU)))
+    {
+        Flush(b);
+        b = NULL;
+    }
+
+    if (!b)
+    {
+        b = new coalesce_batch;
+        b->key = key;
+        b->target = target.clone();
+        b->pdu = pdu;
+        b->size = 0;
+        b->deadline = clock.elapsed() + window;
+        open.insert(key, b);
+        pending.append(b);
+        if (!timer.isActive())
+            timer.start(window);
+    }
+
+    SnmpReply *reply = new SnmpReply(parent);
+    coalesce_entry e;
+    e.reply = reply;
+    e.vb = vb;
+    b->entries.append(e);
+    b->size += size;
+
+    return reply;
+}
+
+void SnmpCoalescer::TimerExpired(void)
+{
+    qint64 now = clock.elapsed();
+
+    while (!pending.isEmpty() && (pending.first()->deadline <= now))
+        Flush(pending.first());
+
+    if (!pending.isEmpty())
+        timer.start(pending.first()->deadline - now);
+}
+
+// Same agent and credentials, no varbinds yet
+coalesce_batch *SnmpCoalescer::NewBatch(const coalesce_batch *b)
+{
+    coalesce_batch *nb = new coalesce_batch;
+
+    nb->key = b->key;
+    nb->target = b->target->clone();
+    nb->pdu = b->pdu;
+    nb->size = 0;
+    nb->deadline = 0;
+
+    return nb;
+}
+
+void SnmpCoalescer::Flush(coalesce_batch *b)
+{
+    open.remove(b->key);
+    pending.removeOne(b);
+    Send(b);
+}
+
+void SnmpCoalescer::Send(coalesce_batch *b)
+{
+    // Callers that went away or aborted meanwhile
+    QList<coalesce_entry>::iterator i = b->entries.begin();
+    while (i != b->entries.end())
+    {
+        if (i->reply.isNull() || i->reply->IsFinished())
+            i = b->entries.erase(i);
+        else
+            ++i;
+    }
+
+    if (b->entries.isEmpty())
+    {
+        delete b->target;
+        delete b;
+        return;
+    }
+
+    QVector<Vb> vbs(b->entries.size());
+    for (int v = 0; v < b->entries.size(); v++)
+        vbs[v] = b->entries[v].vb;
+    b->pdu.set_vblist(vbs.data(), vbs.size());
+
+    SnmpReply *r = new SnmpReply(snmp->get_async(b->pdu, *b->target), this);
+    connect(r, SIGNAL(finished(SnmpReply*)), this, SLOT(BatchReply(SnmpReply*)));
+    inflight.insert(r, b);
+    events->Update();
+}
+
+void SnmpCoalescer::BatchReply(SnmpReply *r)
+{
+    coalesce_batch *b = inflight.take(r);
+    r->deleteLater();
+    if (!b)
+        return;
+
+    const Pdu &response = r->GetPdu();
+    int n = b->entries.size();
+    int error = response.get_error_status();
+    int index = response.get_error_index();
+
+    // Response without the varbinds, for the replies of the callers
+    Pdu base(response);
+    base.trim(base.get_vb_count());
+
+    if ((r->GetStatus() == SNMP_CLASS_SUCCESS) && (n > 1) &&
+        (error == SNMP_ERROR_TOO_BIG))
+    {
+        // Remember the limit of the agent and send in halves
+        maxvbs.insert(b->key, n / 2);
+        coalesce_batch *first = NewBatch(b);
+        coalesce_batch *second = NewBatch(b);
+        for (int i = 0; i < n; i++)
+            (i < n / 2 ? first : second)->entries.append(b->entries[i]);
+        Send(first);
+        Send(second);
+    }
+    else if ((r->GetStatus() == SNMP_CLASS_SUCCESS) && (n > 1) &&
+             (error != SNMP_ERROR_SUCCESS) && (index >= 1) && (index <= n))
+    {
+        // The varbind in error gets the error, the agent did not
+        // process the others: send them again
+        coalesce_batch *rest = NewBatch(b);
+        for (int i = 0; i < n; i++)
+        {
+            if (i != index - 1)
+            {
+                rest->entries.append(b->entries[i]);
+                continue;
+            }
+
+            Pdu p(base);
+            p += b->entries[i].vb;
+            p.set_error_status(error);
+            p.set_error_index(1);
+            if (!b->entries[i].reply.isNull())
+                b->entries[i].reply->Finish(SNMP_CLASS_SUCCESS, std::move(p));
+        }
+        Send(rest);
+    }
+    else
+    {
+        for (int i = 0; i < n; i++)
+        {
+            if (b->entries[i].reply.isNull())
+                continue;
+
+            if (r->GetStatus() != SNMP_CLASS_SUCCESS)
+            {
+                b->entries[i].reply->Finish(r->GetStatus(), Pdu(base));
+                continue;
+            }
+
+            Pdu p(base);
+            if (error != SNMP_ERROR_SUCCESS)
+            {
+                // Not attributed to a varbind
+                p += b->entries[i].vb;
+                p.set_error_status(error);
+                p.set_error_index(index == i + 1 ? 1 : 0);
+            }
+            else if (i < response.get_vb_count())
+            {
+                p += response.get_vb(i);
+            }
+            else
+            {
+                // Varbind missing from the response
+                p += b->entries[i].vb;
+                p.set_error_status(SNMP_ERROR_GENERAL_VB_ERR);
+                p.set_error_index(1);
+            }
+            b->entries[i].reply->Finish(SNMP_CLASS_SUCCESS, std::move(p));
+        }
+    }
+
+    delete b->target;
+    delete b;
+}
@@ -0,0 +1,163 @@
+/*
+    Copyright (C) 2004-2011 Martin Jolicoeur (snmpb1@gmail.com)
+
+    This file is part of the SnmpB project
+    (http://sourceforge.net/projects/snmpb)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SNMPEVENTS_H
+#define SNMPEVENTS_H
+
+#include "stdafx.h"
+
+// Sockets watched for one session: its IPv4 and IPv6 sockets and
+// trap ports (see EVENT_LIST_MAX_SOCKETS)
+#define SNMP_EVENTS_MAX_SOCKETS 8
+
+// Drives the event list of a snmp++ session from the Qt event loop.
+// The sockets of the session are watched with socket notifiers and the
+// next retransmission or timeout is a single shot timer, so responses
+// and traps are handled as they arrive and nothing runs while idle.
+class SnmpEventNotifier: public QObject
+{
+    Q_OBJECT
+
+public:
+    SnmpEventNotifier(Snmp *session, QObject *parent);
+
+public slots:
+    // To be called after a request was sent, for its deadline
+    void Update(void);
+    // Stop handling events until the next Update()
+    void Stop(void);
+
+protected slots:
+    void SocketReady(int fd);
+    void TimerExpired(void);
+
+private:
+    void SetEnabled(bool enabled);
+
+private:
+    EventListHolder *holder;
+    QHash<int, QSocketNotifier*> notifiers;
+    QTimer timer;
+    bool busy;
+    bool stopped;
+};
+
+// Qt handle of an async snmp++ request (see Snmp::get_async()).
+// finished() is emitted from the event loop of the thread of the
+// reply once a response was received, the retries of the target are
+// exhausted or the request was aborted. Deleting the reply cancels the
+// request if it is still outstanding.
+class SnmpReply: public QObject, public SnmpExecutor
+{
+    Q_OBJECT
+
+public:
+    SnmpReply(SnmpRequest *req, QObject *parent);
+    ~SnmpReply();
+    bool IsFinished(void) { return done; };
+    int GetStatus(void) { return status; };
+    const Pdu &GetPdu(void) { return pdu; };
+    // Cancel the request, finished() is emitted with SNMP_CLASS_CANCELLED
+    void Abort(void);
+    void post(SnmpRequest *req);
+
+signals:
+    void finished(SnmpReply *reply);
+
+protected:
+    // Reply without its own request, completed with Finish()
+    SnmpReply(QObject *parent);
+    void Finish(int st, Pdu &&p);
+    void customEvent(QEvent *event);
+
+private:
+    static void Completed(SnmpRequest *req, void *data);
+
+private:
+    friend class SnmpCoalescer;
+
+    SnmpRequest *request;
+    bool done;
+    int status;
+    Pdu pdu;
+};
+
+// Largest PDU built by merging GETs: agents must accept 484 octets
+// (RFC 3417) and most accept a full Ethernet frame. An agent answering
+// tooBig gets smaller PDUs from then on.
+#define SNMP_COALESCE_MAX_PDU 1400
+#define SNMP_COALESCE_MAX_VBS 64
+
+typedef struct
+{
+    QPointer<SnmpReply> reply;
+    Vb vb;
+} coalesce_entry;
+
+typedef struct
+{
+    QString key;
+    SnmpTarget *target;
+    Pdu pdu;                    // security parameters and context
+    QList<coalesce_entry> entries;
+    int size;                   // estimated encoding of the varbinds
+    qint64 deadline;
+} coalesce_batch;
+
+// Merges the single varbind GETs sent to the same agent with the same
+// credentials within a short window into one multi-varbind GET. Each
+// caller gets its own reply holding its varbind, or the error of the
+// request. In SNMPv1, the varbind in error gets the error status and
+// the other varbinds are sent again without it.
+class SnmpCoalescer: public QObject
+{
+    Q_OBJECT
+
+public:
+    SnmpCoalescer(Snmp *session, SnmpEventNotifier *notifier,
+                  QObject *parent);
+    ~SnmpCoalescer();
+    // In milliseconds, 0 sends each GET right away
+    void SetWindow(int msecs) { window = msecs; };
+    SnmpReply *Get(Pdu &pdu, const SnmpTarget &target, QObject *parent);
+
+protected slots:
+    void TimerExpired(void);
+    void BatchReply(SnmpReply *r);
+
+private:
+    static QString Key(const Pdu &pdu, const SnmpTarget &target);
+    static int EncodedSize(const Vb &vb);
+    coalesce_batch *NewBatch(const coalesce_batch *b);
+    void Flush(coalesce_batch *b);
+    void Send(coalesce_batch *b);
+
+private:
+    Snmp *snmp;
+    SnmpEventNotifier *events;
+    int window;
+    QElapsedTimer clock;
+    QTimer timer;
+    QHash<QString, coalesce_batch*> open;
+    QList<coalesce_batch*> pending;     // open batches, oldest first
+    QHash<SnmpReply*, coalesce_batch*> inflight;
+    QHash<QString, int> maxvbs;         // learned from tooBig responses
+};
+
+#endif /* SNMPEVENTS_H */
@@ -15,20 +15,35 @@
 #include <snmp_pp/snmp_pp.h>
 #include <snmp_pp/snmpmsg.h>
 
+#include <QtCore/QAtomicInt>
 #include <QtCore/QDate>
 #include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QFile>
 #include <QtCore/QFileInfo>
 #include <QtCore/QHash>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
 #include <QtCore/QList>
+#include <QtCore/QMap>
 #include <QtCore/QMimeData>
+#include <QtCore/QMutex>
+#include <QtCore/QPointer>
+#include <QtCore/QReadWriteLock>
+#include <QtCore/QSet>
 #include <QtCore/QSettings>
+#include <QtCore/QSocketNotifier>
 #include <QtCore/QStandardPaths>
 #include <QtCore/QString>
+#include <QtCore/QSysInfo>
 #include <QtCore/QTextStream>
 #include <QtCore/QThread>
 #include <QtCore/QTimer>
 #include <QtCore/QTimerEvent>
+#include <QtCore/QUuid>
+#include <QtCore/QVector>
+#include <QtCore/QWaitCondition>
 
 #include <QtGui/QContextMenuEvent>
 #include <QtGui/QCursor>
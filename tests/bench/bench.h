@@ -0,0 +1,44 @@
+/*
+    Copyright (C) 2004-2011 Martin Jolicoeur (snmpb1@gmail.com)
+
+    This file is part of the SnmpB project
+    (http://sourceforge.net/projects/snmpb)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <chrono>
+
+// Seconds since an arbitrary start, for measuring intervals
+inline double bench_seconds()
+{
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Heap allocations (malloc() and operator new) since the start
+unsigned long bench_allocations();
+
+// The benchmarks, one function per measured unit
+void bench_recv();
+void bench_probe();
+void bench_msgqueue();
+void bench_oid();
+void bench_usm();
+void bench_encode();
+
+#endif /* BENCH_H */
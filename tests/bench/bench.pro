@@ -0,0 +1,18 @@
+# Benchmarks of the snmp++ hot paths, see "bench_snmp_pp -h"
+
+TEMPLATE	= app
+TARGET          = bench_snmp_pp
+CONFIG         += console
+CONFIG         -= qt app_bundle
+
+include(../snmp_pp.pri)
+
+SOURCES	+= \
+    main.cpp \
+    bench_recv.cpp \
+    bench_probe.cpp \
+    bench_msgqueue.cpp \
+    bench_oid.cpp \
+    bench_usm.cpp \
+    bench_encode.cpp \
+    ../../discprobe.cpp
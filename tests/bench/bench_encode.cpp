@@ -0,0 +1,208 @@
+/*
+    Copyright (C) 2004-2011 Martin Jolicoeur (snmpb1@gmail.com)
+
+    This file is part of the SnmpB project
+    (http://sourceforge.net/projects/snmpb)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+
+#include "snmp_pp/snmp_pp.h"
+#include "snmp_pp/snmpmsg.h"
+#include "bench.h"
+
+#ifdef SNMP_PP_NAMESPACE
+using namespace Snmp_pp;
+#endif
+
+#define BENCH_ENCODE_COUNT 200000
+
+#ifdef _SNMPv3
+// Gives access to the encoder of v3MP for a snmp_pdu and to its cache
+class BenchMP: public v3MP
+{
+ public:
+    BenchMP(const OctetStr &engine_id, int &status)
+        : v3MP(engine_id, 1, status) {}
+
+    using v3MP::snmp_build;
+    using v3MP::delete_from_cache;
+};
+#endif
+
+// Remove the cache entry of a v3 request, as its response would
+static void done(const Pdu &pdu, const snmp_version version)
+{
+#ifdef _SNMPv3
+    if (version == version3) // v3MP::I is the BenchMP of bench_encode()
+        ((BenchMP *)v3MP::I)->delete_from_cache(pdu.get_request_id());
+#endif
+}
+
+// The encoder SnmpMessage::load() used before: the Pdu is copied into
+// a snmp_pdu, which is then encoded layer by layer
+static int load_snmp_pdu(const Pdu &pdu, unsigned char *buf, int *len,
+                         const snmp_version version,
+                         const OctetStr &community,
+                         const OctetStr &engine_id,
+                         const OctetStr &security_name)
+{
+    snmp_pdu *raw = snmp_pdu_create(pdu.get_type());
+    int status = SNMP_CLASS_SUCCESS;
+
+    raw->reqid = pdu.get_request_id();
+    raw->errstat = (unsigned long)pdu.get_error_status();
+    raw->errindex = (unsigned long)pdu.get_error_index();
+
+    for (int z = 0; z < pdu.get_vb_count(); z++)
+    {
+        Vb vb;
+        Oid id;
+        SmiVALUE smival;
+
+        pdu.get_vb(vb, z);
+        vb.get_oid(id);
+        if (pdu.get_type() == sNMP_PDU_GET)
+            vb.set_null();
+        status = convertVbToSmival(vb, &smival);
+        if (status != SNMP_CLASS_SUCCESS)
+            break;
+        snmp_add_var(raw, id.oidval()->ptr, (int)id.len(), &smival);
+        freeSmivalDescriptor(&smival);
+    }
+
+    if (status != SNMP_CLASS_SUCCESS)
+        ;
+#ifdef _SNMPv3
+    else if (version == version3)
+        status = ((BenchMP *)v3MP::I)->snmp_build(raw, buf, len,
+                                     engine_id, security_name,
+                                     SNMP_SECURITY_MODEL_USM,
+                                     pdu.get_security_level(),
+                                     pdu.get_context_engine_id(),
+                                     pdu.get_context_name());
+#endif
+    else
+        status = snmp_build(raw, buf, len, version,
+                            community.data(), (int)community.len());
+
+    snmp_free_pdu(raw);
+    return status;
+}
+
+// Time and heap allocations per message of both encoders
+static void bench_case(const char *name, const Pdu &pdu,
+                       const snmp_version version, const int count)
+{
+    OctetStr community("public"), engine_id("bench_engine"), user("esec");
+    unsigned char buf[MAX_SNMP_PACKET];
+    SnmpMessage *msg = new SnmpMessage;
+    unsigned long old_len = 0, new_len = 0;
+
+    unsigned long allocs = bench_allocations();
+    double start = bench_seconds();
+    for (int i = 0; i < count; i++)
+    {
+        int len = sizeof(buf);
+
+        load_snmp_pdu(pdu, buf, &len, version, community, engine_id, user);
+        done(pdu, version);
+        old_len = len;
+    }
+    double old_time = bench_seconds() - start;
+    unsigned long old_allocs = bench_allocations() - allocs;
+
+    allocs = bench_allocations();
+    start = bench_seconds();
+    for (int i = 0; i < count; i++)
+    {
+#ifdef _SNMPv3
+        if (version == version3)
+            msg->loadv3(pdu, engine_id, user, SNMP_SECURITY_MODEL_USM,
+                        version);
+        else
+#endif
+            msg->load(pdu, community, version);
+        done(pdu, version);
+        new_len = msg->len();
+    }
+    double new_time = bench_seconds() - start;
+    unsigned long new_allocs = bench_allocations() - allocs;
+
+    printf("encode %s: snmp_pdu %6.3f us/msg, %5.2f allocs/msg, "
+           "direct %6.3f us/msg, %5.2f allocs/msg (%lu/%lu bytes)\n", name,
+           old_time * 1e6 / count, (double)old_allocs / count,
+           new_time * 1e6 / count, (double)new_allocs / count,
+           old_len, new_len);
+    delete msg;
+}
+
+// Requests encoded by SnmpMessage::load() straight from the Pdu and
+// through a snmp_pdu copy: a GET of ten interface counters, a SET of
+// every syntax and the GET as authPriv v3 message
+void bench_encode()
+{
+    Pdu get, set;
+
+    for (int i = 0; i < 10; i++)
+    {
+        Oid id("1.3.6.1.2.1.2.2.1");
+
+        id += 10 + i;
+        id += 1;
+        get += Vb(id);
+    }
+    get.set_type(sNMP_PDU_GET);
+    get.set_request_id(1234);
+
+    Vb vb(Oid("1.3.6.1.2.1.1.5.0"));
+    vb.set_value(OctetStr("bench.example.com"));
+    set += vb;
+    vb.set_value(SnmpInt32(-129));
+    set += vb;
+    vb.set_value(Gauge32(100000));
+    set += vb;
+    vb.set_value(Counter32(128));
+    set += vb;
+    vb.set_value(TimeTicks(8640000));
+    set += vb;
+    vb.set_value(Counter64(1, 5));
+    set += vb;
+    vb.set_value(IpAddress("10.1.2.3"));
+    set += vb;
+    vb.set_value(Oid("1.3.6.1.4.1.99999.1.2.3"));
+    set += vb;
+    vb.set_value(OpaqueStr(OctetStr("opaque")));
+    set += vb;
+    set.set_type(sNMP_PDU_SET);
+    set.set_request_id(1235);
+
+    bench_case("v2c get", get, version2c, BENCH_ENCODE_COUNT);
+    bench_case("v2c set", set, version2c, BENCH_ENCODE_COUNT);
+
+#ifdef _SNMPv3
+    int status;
+    BenchMP mp("bench_encode", status);
+
+    mp.get_usm()->add_localized_user("bench_engine", "euser", "esec",
+                                     SNMP_AUTHPROTOCOL_HMACSHA,
+                                     "0123456789abcdef0123",
+                                     SNMP_PRIVPROTOCOL_AES128,
+                                     "0123456789abcdef");
+    get.set_security_level(SNMP_SECURITY_LEVEL_AUTH_PRIV);
+    bench_case("v3 get ", get, version3, BENCH_ENCODE_COUNT / 10);
+#endif
+}
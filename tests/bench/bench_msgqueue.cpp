@@ -0,0 +1,106 @@
+/*
+    Copyright (C) 2004-2011 Martin Jolicoeur (snmpb1@gmail.com)
+
+    This file is part of the SnmpB project
+    (http://sourceforge.net/projects/snmpb)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+
+#include "snmp_pp/snmp_pp.h"
+#include "snmp_pp/msgqueue.h"
+#include "bench.h"
+
+#ifdef SNMP_PP_NAMESPACE
+using namespace Snmp_pp;
+#endif
+
+#ifdef WIN32
+#define close_socket closesocket
+#else
+#define close_socket close
+#endif
+
+#define BENCH_MSGQUEUE_SIZE  10000
+#define BENCH_MSGQUEUE_COUNT 1000000
+
+static unsigned long bench_msgqueue_id(unsigned long i)
+{
+    return (i * 2654435761UL) & 0x7FFFFFFF;
+}
+
+static void bench_msgqueue_print(const char *name, double seconds)
+{
+    printf("msgqueue %-8s %10.0f ops/s, %6.3f us/op\n", name,
+           BENCH_MSGQUEUE_COUNT / seconds,
+           seconds * 1e6 / BENCH_MSGQUEUE_COUNT);
+}
+
+// The request queue with many outstanding requests: looking up a
+// response by request id, finding the next timeout, a retry tick with
+// nothing due, and replacing a request (delete and add)
+void bench_msgqueue()
+{
+    CSNMPMessageQueue queue(0, 0);
+    SnmpSocket sock = socket(AF_INET, SOCK_DGRAM, 0);
+    UdpAddress address("127.0.0.1/9");
+    CTarget target(address);
+    Pdu pdu;
+    unsigned char raw[] = { 0x30, 0x00 };
+    unsigned long found = 0;
+    msec now, next;
+
+    pdu.set_type(sNMP_PDU_GET);
+    target.set_retry(1);
+    for (unsigned long i = 0; i < BENCH_MSGQUEUE_SIZE; i++)
+    {
+        // timeouts of 100 to 200 seconds, nothing is due while running
+        target.set_timeout(10000 + (i * 7919) % 10000);
+        queue.AddEntry(bench_msgqueue_id(i), 0, sock, target, pdu,
+                       raw, sizeof(raw), address, 0, 0);
+    }
+
+    double start = bench_seconds();
+    for (unsigned long i = 0; i < BENCH_MSGQUEUE_COUNT; i++)
+        if (queue.GetEntry(bench_msgqueue_id(i % BENCH_MSGQUEUE_SIZE)))
+            found++;
+    bench_msgqueue_print("lookup", bench_seconds() - start);
+
+    start = bench_seconds();
+    for (unsigned long i = 0; i < BENCH_MSGQUEUE_COUNT; i++)
+        found += queue.GetNextTimeout(next);
+    bench_msgqueue_print("timeout", bench_seconds() - start);
+
+    now.refresh();
+    start = bench_seconds();
+    for (unsigned long i = 0; i < BENCH_MSGQUEUE_COUNT; i++)
+        found += queue.DoRetries(now);
+    bench_msgqueue_print("tick", bench_seconds() - start);
+
+    start = bench_seconds();
+    for (unsigned long i = 0; i < BENCH_MSGQUEUE_COUNT; i++)
+    {
+        queue.DeleteEntry(bench_msgqueue_id(i));
+        target.set_timeout(10000 + (i * 7919) % 10000);
+        queue.AddEntry(bench_msgqueue_id(i + BENCH_MSGQUEUE_SIZE), 0, sock,
+                       target, pdu, raw, sizeof(raw), address, 0, 0);
+    }
+    bench_msgqueue_print("replace", bench_seconds() - start);
+
+    printf("msgqueue %d requests outstanding (%lu)\n", queue.GetCount(),
+           found & 1);
+    close_socket(sock);
+}
@@ -0,0 +1,106 @@
+/*
+    Copyright (C) 2004-2011 Martin Jolicoeur (snmpb1@gmail.com)
+
+    This file is part of the SnmpB project
+    (http://sourceforge.net/projects/snmpb)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+
+#include "snmp_pp/snmp_pp.h"
+#include "bench.h"
+
+#ifdef SNMP_PP_NAMESPACE
+using namespace Snmp_pp;
+#endif
+
+#define BENCH_OID_COUNT 2000000
+#define BENCH_OID_WALK_VBS 50
+
+// Long Oids (beyond OID_INLINE_LEN) reusing one heap buffer: assigning
+// Oids of changing lengths, and a table walk that appends the index of
+// each row to the trimmed column Oid. Then the scope check of a walk
+// callback on inline Oids.
+void bench_oid()
+{
+    unsigned long subids[40];
+    unsigned long check = 0;
+
+    for (int k = 0; k < 40; k++)
+        subids[k] = k + 1;
+
+    Oid a(subids, 40), b(subids, 30), o;
+
+    double start = bench_seconds();
+    for (int i = 0; i < BENCH_OID_COUNT; i++)
+    {
+        o = (i & 1) ? a : b;
+        check += o.len();
+    }
+    double assign = bench_seconds() - start;
+
+    Oid column(subids, 20), index(subids + 20, 10), row;
+
+    start = bench_seconds();
+    for (int i = 0; i < BENCH_OID_COUNT; i++)
+    {
+        row = column;
+        row += index;
+        row += (unsigned long)i;
+        check += row.len();
+    }
+    double append = bench_seconds() - start;
+
+    // The callback of a walk over ifInOctets: each received Oid is
+    // copied out of its Vb and checked against the walked subtree, as
+    // the agent does for every Vb of a response
+    Oid walked("1.3.6.1.2.1.2.2.1.10");
+    Pdu pdu;
+
+    for (int i = 0; i < BENCH_OID_WALK_VBS; i++)
+    {
+        Oid oid(walked);
+        oid += (unsigned long)(i + 1);
+        pdu += Vb(oid);
+    }
+
+    const int responses = BENCH_OID_COUNT / BENCH_OID_WALK_VBS;
+    Vb vb;
+    Oid tmp;
+
+    unsigned long allocs = bench_allocations();
+    start = bench_seconds();
+    for (int i = 0; i < responses; i++)
+        for (int z = 0; z < pdu.get_vb_count(); z++)
+        {
+            pdu.get_vb(vb, z);
+            vb.get_oid(tmp);
+            if (!tmp.nCompare(walked.len(), walked) &&
+                tmp.in_subtree_of(walked))
+                check += tmp.len();
+        }
+    double walk = bench_seconds() - start;
+    allocs = bench_allocations() - allocs;
+    int walk_oids = responses * BENCH_OID_WALK_VBS;
+
+    printf("oid assign: %10.0f oids/s, %6.3f us/oid\n",
+           BENCH_OID_COUNT / assign, assign * 1e6 / BENCH_OID_COUNT);
+    printf("oid append: %10.0f oids/s, %6.3f us/oid\n",
+           BENCH_OID_COUNT / append, append * 1e6 / BENCH_OID_COUNT);
+    printf("oid walk:   %10.0f oids/s, %6.3f us/oid, %5.2f allocs/oid "
+           "(%lu)\n", walk_oids / walk, walk * 1e6 / walk_oids,
+           (double)allocs / walk_oids, check & 1);
+}
@@ -0,0 +1,85 @@
+/*
+    Copyright (C) 2004-2011 Martin Jolicoeur (snmpb1@gmail.com)
+
+    This file is part of the SnmpB project
+    (http://sourceforge.net/projects/snmpb)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "snmp_pp/snmp_pp.h"
+#include "snmp_pp/snmpmsg.h"
+#include "discprobe.h"
+#include "bench.h"
+
+#ifdef SNMP_PP_NAMESPACE
+using namespace Snmp_pp;
+#endif
+
+#define BENCH_PROBE_COUNT 200000
+
+// Preparing the discovery probes of a sweep: encoding each one as
+// before, or patching the request id of a copy of one encoded probe
+void bench_probe()
+{
+    Pdu pdu;
+    Vb vb;
+    unsigned char buf[MAX_SNMP_PACKET];
+    unsigned long check = 0;
+
+    for (int k = 1; k <= 5; k++)
+    {
+        char oid[32];
+        sprintf(oid, "1.3.6.1.2.1.1.%d.0", k);
+        vb.set_oid(Oid(oid));
+        pdu += vb;
+    }
+    pdu.set_type(sNMP_PDU_GET);
+
+    double start = bench_seconds();
+    for (int i = 0; i < BENCH_PROBE_COUNT; i++)
+    {
+        SnmpMessage msg;
+
+        pdu.set_request_id(disc_probe_reqid(i));
+        msg.load(pdu, "public", version2c);
+        check += msg.data()[msg.len() - 1];
+    }
+    double encode = bench_seconds() - start;
+
+    SnmpMessage probe;
+    pdu.set_request_id(DISC_REQID_MARKER);
+    probe.load(pdu, "public", version2c);
+
+    int len = (int)probe.len();
+    int offset = disc_find_reqid(probe.data(), len);
+
+    start = bench_seconds();
+    for (int i = 0; i < BENCH_PROBE_COUNT; i++)
+    {
+        memcpy(buf, probe.data(), len);
+        disc_patch_reqid(buf, offset, disc_probe_reqid(i));
+        check += buf[offset + 3];
+    }
+    double patch = bench_seconds() - start;
+
+    printf("probe encode: %8.0f probes/s, %6.3f us/probe\n",
+           BENCH_PROBE_COUNT / encode, encode * 1e6 / BENCH_PROBE_COUNT);
+    printf("probe patch:  %8.0f probes/s, %6.3f us/probe (%lu)\n",
+           BENCH_PROBE_COUNT / patch, patch * 1e6 / BENCH_PROBE_COUNT,
+           check & 1);
+}
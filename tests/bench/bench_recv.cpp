@@ -0,0 +1,148 @@
+/*
+    Copyright (C) 2004-2011 Martin Jolicoeur (snmpb1@gmail.com)
+
+    This file is part of the SnmpB project
+    (http://sourceforge.net/projects/snmpb)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "snmp_pp/snmp_pp.h"
+#include "snmp_pp/snmpmsg.h"
+#include "bench.h"
+
+#ifdef SNMP_PP_NAMESPACE
+using namespace Snmp_pp;
+#endif
+
+#define BENCH_RECV_PORT    21162
+#define BENCH_RECV_PACKETS 100000
+
+static void count_notification(int reason, Snmp *, Pdu &, SnmpTarget &,
+                               void *data)
+{
+    if (reason == SNMP_CLASS_NOTIFICATION)
+        (*(long *)data)++;
+}
+
+// A SNMPv2c trap as sent by a typical agent, with five varbinds
+static void encode_trap(SnmpMessage &msg)
+{
+    Pdu pdu;
+    Vb vb;
+
+    pdu.set_type(sNMP_PDU_TRAP);
+    pdu.set_notify_id(Oid("1.3.6.1.6.3.1.1.5.3"));
+    pdu.set_notify_timestamp(TimeTicks(123456));
+
+    vb.set_oid(Oid("1.3.6.1.2.1.2.2.1.1.7"));
+    vb.set_value(SnmpInt32(7));
+    pdu += vb;
+    vb.set_oid(Oid("1.3.6.1.2.1.2.2.1.2.7"));
+    vb.set_value(OctetStr("GigabitEthernet0/7"));
+    pdu += vb;
+    vb.set_oid(Oid("1.3.6.1.2.1.2.2.1.3.7"));
+    vb.set_value(SnmpInt32(6));
+    pdu += vb;
+    vb.set_oid(Oid("1.3.6.1.2.1.2.2.1.7.7"));
+    vb.set_value(SnmpInt32(1));
+    pdu += vb;
+    vb.set_oid(Oid("1.3.6.1.2.1.2.2.1.8.7"));
+    vb.set_value(SnmpInt32(2));
+    pdu += vb;
+
+    msg.load(pdu, "public", version2c);
+}
+
+// Send bursts of traps over the loopback interface and process events
+// until all of them reached the callback. Only the processing is
+// timed: the batch receive, the decoding and the dispatch.
+static void bench_burst(const EventListHolder::EventBackend backend,
+                        const int burst)
+{
+    int status;
+    long received = 0;
+    long lost = 0;
+    double elapsed = 0;
+
+    EventListHolder::set_default_backend(backend);
+
+    Snmp snmp(status);
+    SnmpMessage msg;
+    OidCollection trapids;
+    TargetCollection targets;
+
+    encode_trap(msg);
+    snmp.notify_set_listen_port(BENCH_RECV_PORT);
+    if ((status != SNMP_CLASS_SUCCESS) ||
+        (snmp.notify_register(trapids, targets, count_notification,
+                              &received) != SNMP_CLASS_SUCCESS))
+    {
+        printf("recv: cannot listen on port %d\n", BENCH_RECV_PORT);
+        return;
+    }
+
+    SnmpSocket sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in to;
+
+    memset(&to, 0, sizeof(to));
+    to.sin_family = AF_INET;
+    to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    to.sin_port = htons(BENCH_RECV_PORT);
+
+    for (long sent = 0; sent < BENCH_RECV_PACKETS; )
+    {
+        for (int i = 0; i < burst; i++, sent++)
+            sendto(sock, (char *)msg.data(), (int)msg.len(), 0,
+                   (struct sockaddr *)&to, sizeof(to));
+
+        double start = bench_seconds();
+
+        for (int tries = 0; (received < sent) && (tries < 1000); tries++)
+            snmp.get_eventListHolder()->SNMPProcessPendingEvents();
+        elapsed += bench_seconds() - start;
+
+        // a lost datagram must not stall the loop
+        lost += sent - received;
+        received = sent;
+    }
+
+#ifdef WIN32
+    closesocket(sock);
+#else
+    close(sock);
+#endif
+
+    printf("recv %-6s burst %2d: %8.0f packets/s, %5.2f us/packet, "
+           "%ld lost\n",
+           (backend == EventListHolder::backend_epoll) ? "epoll" : "select",
+           burst, BENCH_RECV_PACKETS / elapsed,
+           elapsed * 1e6 / BENCH_RECV_PACKETS, lost);
+}
+
+void bench_recv()
+{
+    static const int bursts[] = { 1, 8, SNMP_PP_BATCH_SIZE };
+
+    for (unsigned i = 0; i < sizeof(bursts) / sizeof(bursts[0]); i++)
+    {
+        bench_burst(EventListHolder::backend_select, bursts[i]);
+#ifdef HAVE_EPOLL
+        bench_burst(EventListHolder::backend_epoll, bursts[i]);
+#endif
+    }
+}
@@ -0,0 +1,139 @@
+/*
+    Copyright (C) 2004-2011 Martin Jolicoeur (snmpb1@gmail.com)
+
+    This file is part of the SnmpB project
+    (http://sourceforge.net/projects/snmpb)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+
+#include "snmp_pp/snmp_pp.h"
+#include "snmp_pp/snmpmsg.h"
+#include "bench.h"
+
+#ifdef SNMP_PP_NAMESPACE
+using namespace Snmp_pp;
+#endif
+
+#define BENCH_USM_ENGINES 10000
+#define BENCH_USM_LOOKUPS 1000000
+
+static OctetStr engine(const int i)
+{
+    char buf[32];
+    sprintf(buf, "engine%d", i);
+    return OctetStr(buf);
+}
+
+static OctetStr host(const int i)
+{
+    char buf[32];
+    sprintf(buf, "10.%d.%d.%d", i / 62500, i / 250 % 250, i % 250 + 1);
+    return OctetStr(buf);
+}
+
+// Lookups in the USM user and time tables and in the engine id table
+// of v3MP with BENCH_USM_ENGINES known engines, each one with a
+// localized user, a time entry and an address
+void bench_usm()
+{
+#ifdef _SNMPv3
+    int status;
+    v3MP mp("bench_usm", 1, status);
+    USM *usm = mp.get_usm();
+    Pdu pdu;
+    Vb vb(Oid("1.3.6.1.2.1.1.1.0"));
+
+    pdu += vb;
+    pdu.set_type(sNMP_PDU_GET);
+    pdu.set_security_level(SNMP_SECURITY_LEVEL_AUTH_NOPRIV);
+
+    OctetStr *engines = new OctetStr[BENCH_USM_ENGINES];
+    OctetStr *hosts = new OctetStr[BENCH_USM_ENGINES];
+
+    for (int i = 0; i < BENCH_USM_ENGINES; i++)
+    {
+        SnmpMessage msg;
+
+        engines[i] = engine(i);
+        hosts[i] = host(i);
+        usm->add_localized_user(engines[i], "buser", "bsec",
+                                SNMP_AUTHPROTOCOL_HMACMD5, "0123456789abcdef",
+                                SNMP_PRIVPROTOCOL_NONE, "");
+        // builds the time entry of the engine
+        pdu.set_request_id(i + 1);
+        pdu.set_context_engine_id(engines[i]);
+        msg.loadv3(pdu, engines[i], "bsec", SNMP_SECURITY_MODEL_USM, version3);
+        mp.add_to_engine_id_table(engines[i], hosts[i], 161);
+    }
+
+    // visit the engines in a scattered order
+    int *order = new int[BENCH_USM_LOOKUPS];
+    for (int i = 0; i < BENCH_USM_LOOKUPS; i++)
+        order[i] = (int)(((unsigned long)i * 7919) % BENCH_USM_ENGINES);
+
+    OctetStr sec("bsec");
+    unsigned long check = 0;
+
+    double start = bench_seconds();
+    for (int i = 0; i < BENCH_USM_LOOKUPS; i++)
+    {
+        struct UsmUser *user =
+            usm->get_user(engines[order[i]], sec);
+        if (user)
+        {
+            check += user->engineIDLength;
+            usm->free_user(user);
+        }
+    }
+    double users = bench_seconds() - start;
+
+    start = bench_seconds();
+    for (int i = 0; i < BENCH_USM_LOOKUPS; i++)
+    {
+        long int boots, time;
+        if (usm->get_time(engines[order[i]],
+                          &boots, &time) == SNMPv3_USM_OK)
+            check += boots;
+    }
+    double times = bench_seconds() - start;
+
+    start = bench_seconds();
+    for (int i = 0; i < BENCH_USM_LOOKUPS; i++)
+    {
+        OctetStr engine_id;
+        if (mp.get_from_engine_id_table(engine_id,
+                                        hosts[order[i]],
+                                        161) == SNMPv3_MP_OK)
+            check += engine_id.len();
+    }
+    double ids = bench_seconds() - start;
+
+    printf("usm user:       %10.0f lookups/s, %6.3f us/lookup\n",
+           BENCH_USM_LOOKUPS / users, users * 1e6 / BENCH_USM_LOOKUPS);
+    printf("usm time:       %10.0f lookups/s, %6.3f us/lookup\n",
+           BENCH_USM_LOOKUPS / times, times * 1e6 / BENCH_USM_LOOKUPS);
+    printf("usm engine id:  %10.0f lookups/s, %6.3f us/lookup (%lu)\n",
+           BENCH_USM_LOOKUPS / ids, ids * 1e6 / BENCH_USM_LOOKUPS,
+           check & 1);
+
+    delete [] order;
+    delete [] engines;
+    delete [] hosts;
+#else
+    printf("usm: built without SNMPv3\n");
+#endif
+}
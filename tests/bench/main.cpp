@@ -0,0 +1,123 @@
+/*
+    Copyright (C) 2004-2011 Martin Jolicoeur (snmpb1@gmail.com)
+
+    This file is part of the SnmpB project
+    (http://sourceforge.net/projects/snmpb)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <new>
+
+#include "snmp_pp/snmp_pp.h"
+#include "bench.h"
+
+#ifdef SNMP_PP_NAMESPACE
+using namespace Snmp_pp;
+#endif
+
+static std::atomic<unsigned long> allocations(0);
+
+#ifdef __GLIBC__
+// operator new of libstdc++ uses malloc() too
+extern "C" void *__libc_malloc(size_t size);
+
+extern "C" void *malloc(size_t size)
+{
+    allocations++;
+    return __libc_malloc(size);
+}
+#else
+void *operator new(size_t size)
+{
+    void *p = malloc(size ? size : 1);
+
+    allocations++;
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    free(p);
+}
+#endif
+
+unsigned long bench_allocations()
+{
+    return allocations;
+}
+
+static struct
+{
+    const char *name;
+    const char *description;
+    void (*run)();
+} benchmarks[] =
+{
+    { "recv", "notifications received and decoded per second", bench_recv },
+    { "probe", "discovery probes prepared per second", bench_probe },
+    { "msgqueue", "request queue operations per second", bench_msgqueue },
+    { "oid", "long Oids assigned and appended per second", bench_oid },
+    { "usm", "USM user, time and engine id lookups per second", bench_usm },
+    { "encode", "requests encoded per second and their allocations",
+      bench_encode },
+    { 0, 0, 0 }
+};
+
+// Run all benchmarks or the ones named on the command line
+int main(int argc, char *argv[])
+{
+    if ((argc > 1) && !strcmp(argv[1], "-h"))
+    {
+        printf("usage: %s [benchmark...]\n", argv[0]);
+        for (int i = 0; benchmarks[i].name; i++)
+            printf("  %-10s %s\n", benchmarks[i].name,
+                   benchmarks[i].description);
+        return 0;
+    }
+
+    for (int i = 1; i <= LOG_TYPES; i++)
+        DefaultLog::log()->set_filter(i << 4, 0);
+
+    Snmp::socket_startup();
+    for (int i = 0; benchmarks[i].name; i++)
+    {
+        bool selected = (argc < 2);
+
+        for (int j = 1; j < argc; j++)
+            if (!strcmp(argv[j], benchmarks[i].name))
+                selected = true;
+
+        if (selected)
+            benchmarks[i].run();
+    }
+    Snmp::socket_cleanup();
+    return 0;
+}
@@ -0,0 +1,51 @@
+# snmp++ as built into snmpb, for the programs in the tests directory
+
+INCLUDEPATH += $$PWD/.. $$PWD/../snmp_pp
+
+gcc*:QMAKE_CXXFLAGS+="-std=c++11"
+clang*:QMAKE_CXXFLAGS+="-std=c++11"
+
+SOURCES	+= \
+    $$PWD/../snmp_pp/address.cpp \
+    $$PWD/../snmp_pp/asn1.cpp \
+    $$PWD/../snmp_pp/auth_priv.cpp \
+    $$PWD/../snmp_pp/counter.cpp \
+    $$PWD/../snmp_pp/ctr64.cpp \
+    $$PWD/../snmp_pp/eventlist.cpp \
+    $$PWD/../snmp_pp/eventlistholder.cpp \
+    $$PWD/../snmp_pp/gauge.cpp \
+    $$PWD/../snmp_pp/idea.cpp \
+    $$PWD/../snmp_pp/integer.cpp \
+    $$PWD/../snmp_pp/log.cpp \
+    $$PWD/../snmp_pp/md5c.cpp \
+    $$PWD/../snmp_pp/mp_v3.cpp \
+    $$PWD/../snmp_pp/msec.cpp \
+    $$PWD/../snmp_pp/msgqueue.cpp \
+    $$PWD/../snmp_pp/notifyqueue.cpp \
+    $$PWD/../snmp_pp/octet.cpp \
+    $$PWD/../snmp_pp/oid.cpp \
+    $$PWD/../snmp_pp/pdu.cpp \
+    $$PWD/../snmp_pp/reentrant.cpp \
+    $$PWD/../snmp_pp/sha.cpp \
+    $$PWD/../snmp_pp/snmpmsg.cpp \
+    $$PWD/../snmp_pp/target.cpp \
+    $$PWD/../snmp_pp/timetick.cpp \
+    $$PWD/../snmp_pp/usm_v3.cpp \
+    $$PWD/../snmp_pp/uxsnmp.cpp \
+    $$PWD/../snmp_pp/v3.cpp \
+    $$PWD/../snmp_pp/vb.cpp \
+    $$PWD/../snmp_pp/IPv6Utility.cpp \
+    $$PWD/../snmp_pp/collect.cpp
+
+LIBS += -ltomcrypt
+
+unix {
+  LIBS += -lpthread
+  OBJECTS_DIR = .obj
+}
+
+win32 {
+  QMAKE_CXX = mingw32-g++
+  QMAKE_LINK = mingw32-g++
+  LIBS	+= -lws2_32
+}
@@ -0,0 +1,59 @@
+/*
+    Copyright (C) 2004-2011 Martin Jolicoeur (snmpb1@gmail.com)
+
+    This file is part of the SnmpB project
+    (http://sourceforge.net/projects/snmpb)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+
+// Number of failed checks of the running program
+extern int check_failures;
+
+// Report a failed condition and continue with the test
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            check_failures++; \
+        } \
+    } while (0)
+
+#define CHECK_EQUAL(a, b) \
+    do { \
+        long _a = (long)(a), _b = (long)(b); \
+        if (_a != _b) { \
+            printf("FAIL %s:%d: %s == %s (%ld != %ld)\n", \
+                   __FILE__, __LINE__, #a, #b, _a, _b); \
+            check_failures++; \
+        } \
+    } while (0)
+
+// The tests, one function per tested unit
+void tst_recvbatch();
+void tst_discprobe();
+void tst_msgqueue();
+void tst_snmpmsg();
+void tst_oid();
+void tst_usm();
+void tst_octet();
+void tst_pdu();
+void tst_keycache();
+
+#endif /* CHECK_H */
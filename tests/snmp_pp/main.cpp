@@ -0,0 +1,78 @@
+/*
+    Copyright (C) 2004-2011 Martin Jolicoeur (snmpb1@gmail.com)
+
+    This file is part of the SnmpB project
+    (http://sourceforge.net/projects/snmpb)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "snmp_pp/snmp_pp.h"
+#include "check.h"
+
+#ifdef SNMP_PP_NAMESPACE
+using namespace Snmp_pp;
+#endif
+
+int check_failures = 0;
+
+static struct
+{
+    const char *name;
+    void (*run)();
+} tests[] =
+{
+    { "recvbatch", tst_recvbatch },
+    { "discprobe", tst_discprobe },
+    { "msgqueue", tst_msgqueue },
+    { "snmpmsg", tst_snmpmsg },
+    { "oid", tst_oid },
+    { "usm", tst_usm },
+    { "octet", tst_octet },
+    { "pdu", tst_pdu },
+    { "keycache", tst_keycache },
+    { 0, 0 }
+};
+
+// Run all tests or the ones named on the command line
+int main(int argc, char *argv[])
+{
+    // only errors, the tests provoke timeouts and unknown responses
+    for (int i = 1; i <= LOG_TYPES; i++)
+        DefaultLog::log()->set_filter(i << 4, 0);
+    DefaultLog::log()->set_filter(ERROR_LOG, 1);
+
+    for (int i = 0; tests[i].name; i++)
+    {
+        bool selected = (argc < 2);
+
+        for (int j = 1; j < argc; j++)
+            if (!strcmp(argv[j], tests[i].name))
+                selected = true;
+
+        if (!selected)
+            continue;
+
+        int failures = check_failures;
+
+        tests[i].run();
+        printf("%s %s\n", (failures == check_failures) ? "PASS" : "FAIL",
+               tests[i].name);
+    }
+
+    printf("%d failed check(s)\n", check_failures);
+    return check_failures ? 1 : 0;
+}
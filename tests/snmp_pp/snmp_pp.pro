@@ -0,0 +1,24 @@
+# Unit tests of snmp++ and of the code using it without Qt,
+# run with "make check"
+
+TEMPLATE	= app
+TARGET          = tst_snmp_pp
+CONFIG         += console testcase
+CONFIG         -= qt app_bundle
+
+include(../snmp_pp.pri)
+
+HEADERS	+= check.h
+
+SOURCES	+= \
+    main.cpp \
+    tst_recvbatch.cpp \
+    tst_discprobe.cpp \
+    tst_msgqueue.cpp \
+    tst_snmpmsg.cpp \
+    tst_oid.cpp \
+    tst_usm.cpp \
+    tst_octet.cpp \
+    tst_pdu.cpp \
+    tst_keycache.cpp \
+    ../../discprobe.cpp
@@ -0,0 +1,221 @@
+/*
+    Copyright (C) 2004-2011 Martin Jolicoeur (snmpb1@gmail.com)
+
+    This file is part of the SnmpB project
+    (http://sourceforge.net/projects/snmpb)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "snmp_pp/snmp_pp.h"
+#include "snmp_pp/snmpmsg.h"
+#include "discprobe.h"
+#include "check.h"
+
+#ifdef SNMP_PP_NAMESPACE
+using namespace Snmp_pp;
+#endif
+
+// The discovery probe, encoded with the marker request id
+static Pdu probe_pdu()
+{
+    static const char *oids[] =
+        { "1.3.6.1.2.1.1.1.0", "1.3.6.1.2.1.1.2.0", "1.3.6.1.2.1.1.3.0",
+          "1.3.6.1.2.1.1.4.0", "1.3.6.1.2.1.1.5.0" };
+    Pdu pdu;
+
+    for (int k = 0; k < 5; k++)
+    {
+        Vb vb((Oid(oids[k])));
+        pdu += vb;
+    }
+    pdu.set_type(sNMP_PDU_GET);
+    pdu.set_request_id(DISC_REQID_MARKER);
+    return pdu;
+}
+
+// Length of the BER header at p, its content length in len
+static int ber_header(const unsigned char *p, int &len)
+{
+    int header = 2;
+
+    len = p[1];
+    if (len & 0x80)
+    {
+        header += len & 0x7f;
+        len = 0;
+        for (int i = 2; i < header; i++)
+            len = (len << 8) | p[i];
+    }
+    return header;
+}
+
+// Request id of a SNMPv3 message with a plaintext scoped PDU
+static unsigned long v3_request_id(const unsigned char *msg)
+{
+    const unsigned char *p = msg;
+    int len;
+    unsigned long reqid = 0;
+
+    p += ber_header(p, len);                    // message
+    for (int field = 0; field < 3; field++)     // version, header, params
+    {
+        int header = ber_header(p, len);
+        p += header + len;
+    }
+    p += ber_header(p, len);                    // scoped PDU
+    for (int field = 0; field < 2; field++)     // context engine id, name
+    {
+        int header = ber_header(p, len);
+        p += header + len;
+    }
+    p += ber_header(p, len);                    // PDU
+    p += ber_header(p, len);                    // request id
+    for (int i = 0; i < len; i++)
+        reqid = (reqid << 8) | p[i];
+    return reqid;
+}
+
+// A patched v1/v2c probe decodes to the patched request id, with the
+// rest of the message unchanged
+static void tst_v1v2c()
+{
+    static const snmp_version versions[] = { version1, version2c };
+    Pdu pdu = probe_pdu();
+
+    for (int v = 0; v < 2; v++)
+    {
+        SnmpMessage msg;
+
+        CHECK_EQUAL(msg.load(pdu, "public", versions[v]), SNMP_CLASS_SUCCESS);
+
+        int len = (int)msg.len();
+        int offset = disc_find_reqid(msg.data(), len);
+
+        CHECK(offset > 0);
+        if (offset <= 0)
+            continue;
+
+        static const unsigned long long ids[] =
+            { 0, 1, DISC_REQID_RANGE - 1, DISC_REQID_RANGE, 0xFFFFFFFFFFULL };
+
+        for (unsigned i = 0; i < sizeof(ids) / sizeof(ids[0]); i++)
+        {
+            unsigned char buf[MAX_SNMP_PACKET];
+            unsigned int reqid = disc_probe_reqid(ids[i]);
+
+            memcpy(buf, msg.data(), len);
+            disc_patch_reqid(buf, offset, reqid);
+
+            SnmpMessage in;
+            Pdu out;
+            OctetStr community;
+            snmp_version version;
+
+            CHECK_EQUAL(in.load(buf, len), SNMP_CLASS_SUCCESS);
+            CHECK_EQUAL(in.unload(out, community, version),
+                        SNMP_CLASS_SUCCESS);
+            CHECK_EQUAL(out.get_request_id(), reqid);
+            CHECK_EQUAL(version, versions[v]);
+            CHECK(community == "public");
+            CHECK_EQUAL(out.get_vb_count(), 5);
+
+            // re-encoding the decoded probe gives the patched message
+            SnmpMessage again;
+            again.load(out, community, version);
+            CHECK(((int)again.len() == len) &&
+                  !memcmp(again.data(), buf, len));
+        }
+    }
+}
+
+// The marker in the community does not hide the request id
+static void tst_marker_in_community()
+{
+    static const char community[] = "\x02\x04\x5A\xA5\xC3\x3C";
+    Pdu pdu = probe_pdu();
+    SnmpMessage msg;
+    unsigned char buf[MAX_SNMP_PACKET];
+
+    msg.load(pdu, community, version2c);
+
+    int len = (int)msg.len();
+    int offset = disc_find_reqid(msg.data(), len);
+
+    CHECK(offset > 0);
+    if (offset <= 0)
+        return;
+
+    memcpy(buf, msg.data(), len);
+    disc_patch_reqid(buf, offset, disc_probe_reqid(7));
+
+    SnmpMessage in;
+    Pdu out;
+    OctetStr c;
+    snmp_version version;
+
+    in.load(buf, len);
+    CHECK_EQUAL(in.unload(out, c, version), SNMP_CLASS_SUCCESS);
+    CHECK_EQUAL(out.get_request_id(), disc_probe_reqid(7));
+    CHECK(c == community);
+}
+
+// SNMPv3 probes: the static one and the engine discovery message
+static void tst_v3()
+{
+    unsigned char buf[MAX_SNMP_PACKET];
+    int offset = disc_find_reqid(disc_v3_probe, disc_v3_probe_len);
+
+    CHECK(offset > 0);
+    CHECK_EQUAL(v3_request_id(disc_v3_probe), DISC_REQID_MARKER);
+    memcpy(buf, disc_v3_probe, disc_v3_probe_len);
+    disc_patch_reqid(buf, offset, disc_probe_reqid(42));
+    CHECK_EQUAL(v3_request_id(buf), disc_probe_reqid(42));
+
+#ifdef _SNMPv3
+    int status;
+    v3MP mp("tst_discprobe", 1, status);
+    Pdu pdu = probe_pdu();
+    SnmpMessage msg;
+
+    CHECK_EQUAL(status, SNMPv3_MP_OK);
+    pdu.set_security_level(SNMP_SECURITY_LEVEL_AUTH_PRIV);
+    CHECK_EQUAL(msg.loadv3(pdu, OctetStr(), "user", SNMP_SECURITY_MODEL_USM,
+                           version3), SNMP_CLASS_SUCCESS);
+
+    int len = (int)msg.len();
+    offset = disc_find_reqid(msg.data(), len);
+
+    CHECK(offset > 0);
+    if (offset <= 0)
+        return;
+    memcpy(buf, msg.data(), len);
+    disc_patch_reqid(buf, offset, disc_probe_reqid(43));
+    CHECK_EQUAL(v3_request_id(buf), disc_probe_reqid(43));
+#endif
+}
+
+void tst_discprobe()
+{
+    // probe request ids are positive and always 4 bytes long
+    CHECK_EQUAL(disc_probe_reqid(0), DISC_REQID_BASE);
+    CHECK_EQUAL(disc_probe_reqid(DISC_REQID_RANGE - 1), 0x7FFFFFFE);
+    CHECK_EQUAL(disc_probe_reqid(DISC_REQID_RANGE), DISC_REQID_BASE);
+
+    tst_v1v2c();
+    tst_marker_in_community();
+    tst_v3();
+}
@@ -0,0 +1,326 @@
+/*
+    Copyright (C) 2004-2011 Martin Jolicoeur (snmpb1@gmail.com)
+
+    This file is part of the SnmpB project
+    (http://sourceforge.net/projects/snmpb)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "snmp_pp/snmp_pp.h"
+#include "snmp_pp/auth_priv.h"
+#include "check.h"
+
+#ifdef SNMP_PP_NAMESPACE
+using namespace Snmp_pp;
+#endif
+
+#ifdef _SNMPv3
+
+#define KEYCACHE_TEST_FILE "tst_keycache.dat"
+
+// RFC 3414 A.3: password "maplesyrup", engine id 00..00 02
+static const unsigned char a3_password[] = "maplesyrup";
+static const unsigned char a3_engine_id[] =
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2 };
+
+static const unsigned char a3_md5_ku[] =
+    { 0x9f, 0xaf, 0x32, 0x83, 0x88, 0x4e, 0x92, 0x83,
+      0x4e, 0xbc, 0x98, 0x47, 0xd8, 0xed, 0xd9, 0x63 };
+static const unsigned char a3_md5_kul[] =
+    { 0x52, 0x6f, 0x5e, 0xed, 0x9f, 0xcc, 0xe2, 0x6f,
+      0x89, 0x64, 0xc2, 0x93, 0x07, 0x87, 0xd8, 0x2b };
+static const unsigned char a3_sha_ku[] =
+    { 0x9f, 0xb5, 0xcc, 0x03, 0x81, 0x49, 0x7b, 0x37, 0x93, 0x52,
+      0x89, 0x39, 0xff, 0x78, 0x8d, 0x5d, 0x79, 0x14, 0x52, 0x11 };
+static const unsigned char a3_sha_kul[] =
+    { 0x66, 0x95, 0xfe, 0xbc, 0x92, 0x88, 0xe3, 0x62, 0x82, 0x23,
+      0x5f, 0xc7, 0x15, 0x1f, 0x12, 0x84, 0x97, 0xb3, 0x8f, 0x3f };
+
+static const unsigned char file_key[] = "tst_keycache secret";
+static const unsigned char other_key[] = "tst_keycache secreT";
+
+static bool has_key(const unsigned char *key, const unsigned int key_len,
+                    const unsigned char *expected,
+                    const unsigned int expected_len)
+{
+    return (key_len == expected_len) && !memcmp(key, expected, key_len);
+}
+
+// Localized key of the A.3 password for engine_id, compared with
+// expected if given
+static bool localize(AuthPriv &ap, const int auth_prot,
+                     const unsigned char *engine_id,
+                     const unsigned char *expected,
+                     const unsigned int expected_len)
+{
+    unsigned char key[SNMPv3_USM_MAX_KEY_LEN];
+    unsigned int key_len = sizeof(key);
+
+    if (ap.password_to_key_auth(auth_prot, a3_password, 10, engine_id,
+                                sizeof(a3_engine_id), key, &key_len) !=
+        SNMPv3_USM_OK)
+        return false;
+    return !expected || has_key(key, key_len, expected, expected_len);
+}
+
+// Cold cache, master key hit and localized key hit all have to give
+// the keys of RFC 3414 A.3
+static void tst_a3_keys()
+{
+    int status;
+    AuthPriv ap(status);
+    KeyCache *cache = ap.get_key_cache();
+    unsigned char digest[SNMPv3_KEYCACHE_DIGEST_LEN];
+    unsigned char key[SNMPv3_USM_MAX_KEY_LEN];
+    unsigned int key_len = sizeof(key);
+
+    ap.add_default_modules();
+
+    // cold: the localized and the master key are missed and added
+    CHECK(localize(ap, SNMP_AUTHPROTOCOL_HMACMD5, a3_engine_id,
+                   a3_md5_kul, sizeof(a3_md5_kul)));
+    CHECK(localize(ap, SNMP_AUTHPROTOCOL_HMACSHA, a3_engine_id,
+                   a3_sha_kul, sizeof(a3_sha_kul)));
+    CHECK_EQUAL(cache->get_misses(), 4);
+    CHECK_EQUAL(cache->get_hits(), 0);
+    CHECK_EQUAL(cache->get_entries(), 4);
+
+    cache->get_digest(SNMP_AUTHPROTOCOL_HMACMD5, a3_password, 10, digest);
+    CHECK(cache->get_master_key(SNMP_AUTHPROTOCOL_HMACMD5, digest,
+                                key, &key_len));
+    CHECK(has_key(key, key_len, a3_md5_ku, sizeof(a3_md5_ku)));
+    key_len = sizeof(key);
+    cache->get_digest(SNMP_AUTHPROTOCOL_HMACSHA, a3_password, 10, digest);
+    CHECK(cache->get_master_key(SNMP_AUTHPROTOCOL_HMACSHA, digest,
+                                key, &key_len));
+    CHECK(has_key(key, key_len, a3_sha_ku, sizeof(a3_sha_ku)));
+
+    // localized hit: nothing is added. The counters are not reset.
+    cache->clear();
+    unsigned long hits = cache->get_hits(), misses = cache->get_misses();
+    CHECK(localize(ap, SNMP_AUTHPROTOCOL_HMACSHA, a3_engine_id,
+                   a3_sha_kul, sizeof(a3_sha_kul)));
+    CHECK(localize(ap, SNMP_AUTHPROTOCOL_HMACSHA, a3_engine_id,
+                   a3_sha_kul, sizeof(a3_sha_kul)));
+    CHECK_EQUAL(cache->get_hits(), hits + 1);
+    CHECK_EQUAL(cache->get_misses(), misses + 2);
+    CHECK_EQUAL(cache->get_entries(), 2);
+
+    // master hit: a cached master key is localized for a new engine.
+    // A wrong master key shows that it is not computed again.
+    int st2;
+    AuthPriv ap2(st2);
+    KeyCache *cache2 = ap2.get_key_cache();
+    unsigned char other_engine_id[sizeof(a3_engine_id)];
+    unsigned char wrong_ku[sizeof(a3_sha_ku)];
+
+    ap2.add_default_modules();
+    cache2->get_digest(SNMP_AUTHPROTOCOL_HMACSHA, a3_password, 10, digest);
+    cache2->add_master_key(SNMP_AUTHPROTOCOL_HMACSHA, digest,
+                           a3_sha_ku, sizeof(a3_sha_ku));
+    CHECK(localize(ap2, SNMP_AUTHPROTOCOL_HMACSHA, a3_engine_id,
+                   a3_sha_kul, sizeof(a3_sha_kul)));
+    CHECK_EQUAL(cache2->get_hits(), 1);
+    CHECK_EQUAL(cache2->get_misses(), 1);
+    CHECK_EQUAL(cache2->get_entries(), 2);
+
+    memcpy(wrong_ku, a3_sha_ku, sizeof(wrong_ku));
+    wrong_ku[0] ^= 1;
+    cache2->add_master_key(SNMP_AUTHPROTOCOL_HMACSHA, digest,
+                           wrong_ku, sizeof(wrong_ku));
+    memcpy(other_engine_id, a3_engine_id, sizeof(other_engine_id));
+    other_engine_id[0] = 1;
+    CHECK(!localize(ap2, SNMP_AUTHPROTOCOL_HMACSHA, other_engine_id,
+                    a3_sha_kul, sizeof(a3_sha_kul)));
+    CHECK_EQUAL(cache2->get_entries(), 3);
+
+    // a cached localized key is returned as it is
+    CHECK(localize(ap2, SNMP_AUTHPROTOCOL_HMACSHA, a3_engine_id,
+                   a3_sha_kul, sizeof(a3_sha_kul)));
+    CHECK_EQUAL(cache2->get_entries(), 3);
+}
+
+// Size of a file or -1
+static long file_size(const char *name)
+{
+    FILE *file = fopen(name, "rb");
+    long size = -1;
+
+    if (!file)
+        return -1;
+    if (fseek(file, 0, SEEK_END) == 0)
+        size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+// Rewrite the first len bytes of a file, with one byte changed if
+// flip >= 0
+static bool rewrite(const char *name, const long len, const long flip)
+{
+    unsigned char buf[65536];
+    FILE *file = fopen(name, "rb");
+
+    if (!file)
+        return false;
+    long n = (long)fread(buf, 1, sizeof(buf), file);
+    fclose(file);
+    if ((len > n) || (flip >= len))
+        return false;
+    if (flip >= 0)
+        buf[flip] ^= 0x10;
+
+    file = fopen(name, "wb");
+    if (!file)
+        return false;
+    bool ok = (len == 0) || (fwrite(buf, len, 1, file) == 1);
+    return (fclose(file) == 0) && ok;
+}
+
+static void tst_file()
+{
+    int status;
+    AuthPriv ap(status);
+    KeyCache *cache = ap.get_key_cache();
+    unsigned char engine_id[sizeof(a3_engine_id)];
+
+    ap.add_default_modules();
+    memcpy(engine_id, a3_engine_id, sizeof(engine_id));
+    for (int i = 0; i < 20; i++)
+    {
+        engine_id[10] = (unsigned char)i;
+        CHECK(localize(ap, (i & 1) ? SNMP_AUTHPROTOCOL_HMACMD5 :
+                                     SNMP_AUTHPROTOCOL_HMACSHA,
+                       engine_id, 0, 0));
+    }
+    int entries = cache->get_entries();
+    CHECK_EQUAL(entries, 22);
+
+    // round trip: every key is found in the loaded cache
+    CHECK_EQUAL(cache->save_to_file(KEYCACHE_TEST_FILE, &ap, file_key,
+                                    sizeof(file_key)), SNMPv3_USM_OK);
+    long size = file_size(KEYCACHE_TEST_FILE);
+    CHECK(size > 0);
+
+    int st2;
+    AuthPriv ap2(st2);
+    KeyCache *cache2 = ap2.get_key_cache();
+
+    ap2.add_default_modules();
+    CHECK_EQUAL(cache2->load_from_file(KEYCACHE_TEST_FILE, &ap2, file_key,
+                                       sizeof(file_key)), SNMPv3_USM_OK);
+    CHECK_EQUAL(cache2->get_entries(), entries);
+    CHECK(localize(ap2, SNMP_AUTHPROTOCOL_HMACSHA, a3_engine_id,
+                   a3_sha_kul, sizeof(a3_sha_kul)));
+    CHECK_EQUAL(cache2->get_misses(), 0);
+
+    // the MD5 key of the first engine was not saved, its master key was
+    CHECK(localize(ap2, SNMP_AUTHPROTOCOL_HMACMD5, a3_engine_id,
+                   a3_md5_kul, sizeof(a3_md5_kul)));
+    CHECK_EQUAL(cache2->get_misses(), 1);
+    CHECK_EQUAL(cache2->get_entries(), entries + 1);
+    for (int i = 0; i < 20; i++)
+    {
+        engine_id[10] = (unsigned char)i;
+        CHECK(localize(ap2, (i & 1) ? SNMP_AUTHPROTOCOL_HMACMD5 :
+                                      SNMP_AUTHPROTOCOL_HMACSHA,
+                       engine_id, 0, 0));
+    }
+    CHECK_EQUAL(cache2->get_misses(), 1);
+
+    // another secret: rejected, the loaded keys are kept
+    int st3;
+    AuthPriv ap3(st3);
+    KeyCache *cache3 = ap3.get_key_cache();
+
+    ap3.add_default_modules();
+    CHECK(localize(ap3, SNMP_AUTHPROTOCOL_HMACSHA, a3_engine_id,
+                   a3_sha_kul, sizeof(a3_sha_kul)));
+    CHECK_EQUAL(cache3->load_from_file(KEYCACHE_TEST_FILE, &ap3, other_key,
+                                       sizeof(other_key)),
+                SNMPv3_USM_AUTHENTICATION_ERROR);
+    CHECK_EQUAL(cache3->get_entries(), 2);
+
+    // one byte changed, in the header, the keys or the MAC
+    long flips[] = { 0, 10, size / 2, size - 1 };
+    for (unsigned int i = 0; i < sizeof(flips) / sizeof(flips[0]); i++)
+    {
+        cache->save_to_file(KEYCACHE_TEST_FILE, &ap, file_key,
+                            sizeof(file_key));
+        CHECK(rewrite(KEYCACHE_TEST_FILE, size, flips[i]));
+        CHECK(cache3->load_from_file(KEYCACHE_TEST_FILE, &ap3, file_key,
+                                     sizeof(file_key)) != SNMPv3_USM_OK);
+        CHECK_EQUAL(cache3->get_entries(), 2);
+    }
+
+    // truncated and empty files
+    long lengths[] = { size - 1, size / 2, 10, 0 };
+    for (unsigned int i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++)
+    {
+        cache->save_to_file(KEYCACHE_TEST_FILE, &ap, file_key,
+                            sizeof(file_key));
+        CHECK(rewrite(KEYCACHE_TEST_FILE, lengths[i], -1));
+        CHECK(cache3->load_from_file(KEYCACHE_TEST_FILE, &ap3, file_key,
+                                     sizeof(file_key)) != SNMPv3_USM_OK);
+        CHECK_EQUAL(cache3->get_entries(), 2);
+    }
+
+    remove(KEYCACHE_TEST_FILE);
+    CHECK_EQUAL(cache3->load_from_file(KEYCACHE_TEST_FILE, &ap3, file_key,
+                                       sizeof(file_key)),
+                SNMPv3_USM_FILEOPEN_ERROR);
+}
+
+// Master keys generated by several threads
+static void tst_derive()
+{
+    int status;
+    AuthPriv ap(status);
+    KeyCache *cache = ap.get_key_cache();
+    int auth_prots[3] = { SNMP_AUTHPROTOCOL_HMACSHA, SNMP_AUTHPROTOCOL_HMACMD5,
+                          SNMP_AUTHPROTOCOL_HMACSHA };
+    OctetStr passwords[3] = { "maplesyrup", "maplesyrup", "0123456789abcdef" };
+    unsigned char digest[SNMPv3_KEYCACHE_DIGEST_LEN];
+    unsigned char key[SNMPv3_USM_MAX_KEY_LEN];
+    unsigned int key_len = sizeof(key);
+
+    ap.add_default_modules();
+    CHECK_EQUAL(ap.derive_master_keys(auth_prots, passwords, 3, 2), 3);
+    CHECK_EQUAL(cache->get_entries(), 3);
+    CHECK_EQUAL(ap.derive_master_keys(auth_prots, passwords, 3, 2), 0);
+
+    cache->get_digest(SNMP_AUTHPROTOCOL_HMACSHA, a3_password, 10, digest);
+    CHECK(cache->get_master_key(SNMP_AUTHPROTOCOL_HMACSHA, digest,
+                                key, &key_len));
+    CHECK(has_key(key, key_len, a3_sha_ku, sizeof(a3_sha_ku)));
+    key_len = sizeof(key);
+    cache->get_digest(SNMP_AUTHPROTOCOL_HMACMD5, a3_password, 10, digest);
+    CHECK(cache->get_master_key(SNMP_AUTHPROTOCOL_HMACMD5, digest,
+                                key, &key_len));
+    CHECK(has_key(key, key_len, a3_md5_ku, sizeof(a3_md5_ku)));
+}
+#endif
+
+void tst_keycache()
+{
+#ifdef _SNMPv3
+    tst_a3_keys();
+    tst_file();
+    tst_derive();
+#endif
+}
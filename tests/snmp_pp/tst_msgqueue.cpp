@@ -0,0 +1,554 @@
+/*
+    Copyright (C) 2004-2011 Martin Jolicoeur (snmpb1@gmail.com)
+
+    This file is part of the SnmpB project
+    (http://sourceforge.net/projects/snmpb)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "snmp_pp/snmp_pp.h"
+#include "snmp_pp/msgqueue.h"
+#include "snmp_pp/eventlistholder.h"
+#include "check.h"
+
+#ifdef SNMP_PP_NAMESPACE
+using namespace Snmp_pp;
+#endif
+
+#ifdef WIN32
+#define close_socket closesocket
+#else
+#define close_socket close
+#endif
+
+#define MSGQUEUE_TEST_OPERATIONS 10000
+
+struct Expired
+{
+    std::vector<unsigned long> ids;
+};
+
+static void expired_callback(int reason, Snmp *, Pdu &pdu, SnmpTarget &,
+                             void *data)
+{
+    if (reason == SNMP_CLASS_TIMEOUT)
+        ((Expired *)data)->ids.push_back(pdu.get_request_id());
+}
+
+// Reproducible pseudo random numbers
+static unsigned long next_random(unsigned long &state)
+{
+    state = state * 1103515245UL + 12345UL;
+    return (state >> 8) & 0xFFFFFF;
+}
+
+// Random adds, deletes and timeouts, checked against a map of the
+// outstanding request ids and their timeouts
+static void tst_operations()
+{
+    CSNMPMessageQueue queue(0, 0);
+    std::map<unsigned long, msec> model;  // id -> timeout
+    Expired expired;
+    unsigned long state = 1;
+    unsigned long next_id = 1;
+    bool consistent = true;
+    bool ordered = true;
+    bool found = true;
+
+    // resent requests go to a socket that nobody reads
+    SnmpSocket sock = socket(AF_INET, SOCK_DGRAM, 0);
+    UdpAddress address("127.0.0.1/9");
+    Pdu pdu;
+    unsigned char raw[] = { 0x30, 0x00 };
+
+    pdu.set_type(sNMP_PDU_GET);
+
+    for (int op = 0; op < MSGQUEUE_TEST_OPERATIONS; op++)
+    {
+        unsigned long r = next_random(state) % 100;
+
+        if ((r < 45) || model.empty())
+        {
+            // ids spread over the whole range, with hash collisions
+            unsigned long id = (next_id++ * 2654435761UL) & 0x7FFFFFFF;
+            CTarget target(address);
+
+            target.set_timeout(1 + next_random(state) % 1000);
+            target.set_retry(next_random(state) % 3);
+
+            CSNMPMessage *msg = queue.AddEntry(id, 0, sock, target, pdu,
+                                               raw, sizeof(raw), address,
+                                               expired_callback, &expired);
+            msg->GetSendTime(model[id]);
+        }
+        else if (r < 75)
+        {
+            std::map<unsigned long, msec>::iterator i = model.begin();
+            std::advance(i, next_random(state) % model.size());
+
+            CHECK_EQUAL(queue.DeleteEntry(i->first), SNMP_CLASS_SUCCESS);
+            model.erase(i);
+        }
+        else
+        {
+            // expire the requests up to the median timeout
+            std::vector<msec> timeouts;
+            std::map<unsigned long, msec>::iterator i;
+
+            for (i = model.begin(); i != model.end(); ++i)
+                timeouts.push_back(i->second);
+            std::nth_element(timeouts.begin(),
+                             timeouts.begin() + timeouts.size() / 2,
+                             timeouts.end());
+            msec now = timeouts[timeouts.size() / 2];
+
+            // requests without retries left time out, the others may be
+            // resent several times as their new send time is taken from
+            // the real clock
+            std::vector<unsigned long> due;
+            std::map<unsigned long, bool> late;
+            for (i = model.begin(); i != model.end(); ++i)
+            {
+                if (i->second > now)
+                    continue;
+                late[i->first] = true;
+                if (queue.GetEntry(i->first)->GetTarget()->get_retry() == 0)
+                    due.push_back(i->first);
+            }
+
+            expired.ids.clear();
+            queue.DoRetries(now);
+
+            // each request without retries expired once, in timeout order
+            std::vector<unsigned long> expired_due;
+            for (size_t k = 0; k < expired.ids.size(); k++)
+            {
+                if (late.find(expired.ids[k]) == late.end())
+                    found = false;
+                else if (queue.GetEntry(expired.ids[k]))
+                    found = false;
+                if (std::find(due.begin(), due.end(), expired.ids[k]) !=
+                    due.end())
+                    expired_due.push_back(expired.ids[k]);
+            }
+            CHECK_EQUAL(expired_due.size(), due.size());
+            for (size_t k = 1; k < expired_due.size(); k++)
+                if (model[expired_due[k]] < model[expired_due[k - 1]])
+                    ordered = false;
+            for (size_t k = 0; k < expired.ids.size(); k++)
+                model.erase(expired.ids[k]);
+
+            // the others are found and are not due anymore
+            for (i = model.begin(); i != model.end(); ++i)
+            {
+                CSNMPMessage *msg = queue.GetEntry(i->first);
+                if (!msg)
+                {
+                    found = false;
+                    continue;
+                }
+                msg->GetSendTime(i->second);
+                if (i->second <= now)
+                    ordered = false;
+            }
+        }
+
+        consistent = consistent && queue.CheckIndexes();
+        CHECK_EQUAL(queue.GetCount(), model.size());
+    }
+
+    CHECK(consistent);
+    CHECK(ordered);
+    CHECK(found);
+
+    // every outstanding id is found, the next timeout is the earliest
+    for (std::map<unsigned long, msec>::iterator i = model.begin();
+         i != model.end(); ++i)
+    {
+        CSNMPMessage *msg = queue.GetEntry(i->first);
+        CHECK(msg && (msg->GetId() == i->first));
+    }
+    if (!model.empty())
+    {
+        msec next, earliest = model.begin()->second;
+        for (std::map<unsigned long, msec>::iterator i = model.begin();
+             i != model.end(); ++i)
+            if (i->second < earliest)
+                earliest = i->second;
+        CHECK_EQUAL(queue.GetNextTimeout(next), 0);
+        CHECK(next == earliest);
+    }
+
+    // ids that were never added or are gone are not found
+    CHECK(queue.GetEntry(0) == 0);
+    CHECK(queue.GetEntry(0x80000000UL) == 0);
+
+    close_socket(sock);
+}
+
+// The handle of an async request carries the id of its queue entry as
+// soon as it is returned, cancel() removes that entry
+static void tst_request_handle()
+{
+    int status;
+    Snmp snmp(status);
+    UdpAddress address("127.0.0.1/9");
+    CTarget target(address);
+    Pdu pdu;
+    Vb vb(Oid("1.3.6.1.2.1.1.1.0"));
+
+    CHECK_EQUAL(status, SNMP_CLASS_SUCCESS);
+    target.set_version(version2c);
+    target.set_timeout(1000);
+    target.set_retry(0);
+    pdu += vb;
+
+    SnmpRequest *request = snmp.get_async(pdu, target);
+    CSNMPMessageQueue *queue = snmp.get_eventListHolder()->snmpEventList();
+    unsigned long id = request->get_request_id();
+
+    CHECK(id != 0);
+    CHECK_EQUAL(id, (unsigned long)pdu.get_request_id());
+    queue->lock();
+    CHECK(queue->GetEntry(id) != 0);
+    queue->unlock();
+
+    CHECK_EQUAL(request->cancel(), SNMP_CLASS_SUCCESS);
+    CHECK(request->is_done());
+    CHECK_EQUAL(request->get_status(), SNMP_CLASS_CANCELLED);
+    queue->lock();
+    CHECK(queue->GetEntry(id) == 0);
+    queue->unlock();
+    CHECK_EQUAL(request->cancel(), SNMP_CLASS_INVALID_REQID);
+
+    request->unref();
+}
+
+// Round trip times as in RFC 6298: the estimator gets samples of known
+// length through messages that were sent the given time ago
+class RttQueue: public CSNMPMessageQueue
+{
+ public:
+  RttQueue() : CSNMPMessageQueue(0, 0) {};
+
+  using CSNMPMessageQueue::RttSample;
+  using CSNMPMessageQueue::RttExpired;
+};
+
+class RttMessage: public CSNMPMessage
+{
+ public:
+  RttMessage(SnmpSocket sock, const CTarget &target, Pdu &pdu,
+             unsigned char *raw, const size_t raw_len,
+             const UdpAddress &address, const long rtt)
+    : CSNMPMessage(1, 0, sock, target, pdu, raw, raw_len, address, 0, 0)
+    { m_firstSendTime.refresh(); m_firstSendTime -= rtt; };
+};
+
+static SnmpRttStats rtt_stats(RttQueue &queue, const UdpAddress &address)
+{
+    SnmpRttStats stats;
+
+    memset(&stats, 0, sizeof(stats));
+    CHECK(queue.GetRttStats(address, stats));
+    return stats;
+}
+
+static void tst_rtt()
+{
+    RttQueue queue;
+    SnmpSocket sock = socket(AF_INET, SOCK_DGRAM, 0);
+    UdpAddress address("127.0.0.1/9"), other("127.0.0.2/9");
+    CTarget target(address);
+    Pdu pdu;
+    unsigned char raw[] = { 0x30, 0x00 };
+    SnmpRttStats stats;
+
+    pdu.set_type(sNMP_PDU_GET);
+    target.set_timeout(150);
+    target.set_retry(1);
+    CHECK(!queue.GetRttStats(address, stats));
+
+    // first sample: SRTT = R, RTTVAR = R/2, RTO = SRTT + 4 * RTTVAR
+    RttMessage r100(sock, target, pdu, raw, sizeof(raw), address, 100);
+    RttMessage r200(sock, target, pdu, raw, sizeof(raw), address, 200);
+
+    queue.RttSample(&r100);
+    stats = rtt_stats(queue, address);
+    CHECK_EQUAL(stats.samples, 1);
+    CHECK_EQUAL(stats.last_rtt, 100);
+    CHECK_EQUAL(stats.srtt, 100);
+    CHECK_EQUAL(stats.rttvar, 50);
+    CHECK_EQUAL(stats.rto, 300);
+
+    // RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|, SRTT = 7/8 SRTT + 1/8 R
+    queue.RttSample(&r200);
+    stats = rtt_stats(queue, address);
+    CHECK_EQUAL(stats.last_rtt, 200);
+    CHECK_EQUAL(stats.srtt, 112);   // 112.5
+    CHECK_EQUAL(stats.rttvar, 62);  // 62.5
+    CHECK_EQUAL(stats.rto, 362);
+
+    queue.RttSample(&r100);
+    stats = rtt_stats(queue, address);
+    CHECK_EQUAL(stats.samples, 3);
+    CHECK_EQUAL(stats.srtt, 111);   // 110.9
+    CHECK_EQUAL(stats.rttvar, 50);
+    CHECK_EQUAL(stats.rto, 311);
+
+    // Karn: no sample from a request that was sent again
+    RttMessage resent(sock, target, pdu, raw, sizeof(raw), address, 1000);
+    CHECK_EQUAL(resent.ResendMessage(), SNMP_CLASS_SUCCESS);
+    CHECK_EQUAL(resent.GetResends(), 1);
+    queue.RttSample(&resent);
+    stats = rtt_stats(queue, address);
+    CHECK_EQUAL(stats.samples, 3);
+    CHECK_EQUAL(stats.last_rtt, 100);
+    CHECK_EQUAL(stats.rto, 311);
+
+    // each expiry doubles the timeout, up to MSGQUEUE_RTO_BACKOFF times
+    queue.RttExpired(&r100, false);
+    stats = rtt_stats(queue, address);
+    CHECK_EQUAL(stats.rto, 622);
+    CHECK_EQUAL(stats.retransmissions, 1);
+    queue.RttExpired(&r100, true);
+    stats = rtt_stats(queue, address);
+    CHECK_EQUAL(stats.rto, 1244);
+    CHECK_EQUAL(stats.timeouts, 1);
+    for (int i = 0; i < 10; i++)
+        queue.RttExpired(&r100, false);
+    stats = rtt_stats(queue, address);
+    CHECK_EQUAL(stats.rto, 311UL << MSGQUEUE_RTO_BACKOFF);
+    CHECK_EQUAL(stats.srtt, 111);
+
+    // a new sample ends the backoff
+    queue.RttSample(&r100);
+    stats = rtt_stats(queue, address);
+    CHECK_EQUAL(stats.srtt, 109);   // 109.7
+    CHECK_EQUAL(stats.rttvar, 40);  // 40.3
+    CHECK_EQUAL(stats.rto, 270);
+
+    // no sample yet: the expired timeout is kept, then doubled
+    RttMessage unknown(sock, target, pdu, raw, sizeof(raw), other, 0);
+    queue.RttExpired(&unknown, false);
+    stats = rtt_stats(queue, other);
+    CHECK_EQUAL(stats.samples, 0);
+    CHECK_EQUAL(stats.rto, 1500);
+    queue.RttExpired(&unknown, false);
+    stats = rtt_stats(queue, other);
+    CHECK_EQUAL(stats.rto, 3000);
+
+    // bounds of the estimate and of the backoff
+    UdpAddress fast("127.0.0.3/9"), slow("127.0.0.4/9");
+    RttMessage r10(sock, target, pdu, raw, sizeof(raw), fast, 10);
+    RttMessage r5000(sock, target, pdu, raw, sizeof(raw), slow, 5000);
+
+    queue.RttSample(&r10);
+    CHECK_EQUAL(rtt_stats(queue, fast).rto, MSGQUEUE_RTO_MIN);
+    queue.RttSample(&r5000);
+    CHECK_EQUAL(rtt_stats(queue, slow).rto, 15000);
+    for (int i = 0; i < 3; i++)
+        queue.RttExpired(&r5000, false);
+    CHECK_EQUAL(rtt_stats(queue, slow).rto, MSGQUEUE_RTO_MAX);
+
+    // adaptive requests start with the estimate and back off on each
+    // resend, up to MSGQUEUE_RTO_MAX
+    queue.SetAdaptiveTimeout(true);
+    target.set_retry(2);
+    CSNMPMessage *msg = queue.AddEntry(1, 0, sock, target, pdu, raw,
+                                       sizeof(raw), address,
+                                       expired_callback, 0);
+    CHECK_EQUAL(msg->GetTimeout(), 270);
+    CHECK_EQUAL(msg->ResendMessage(), SNMP_CLASS_SUCCESS);
+    CHECK_EQUAL(msg->GetTimeout(), 540);
+
+    msg = queue.AddEntry(2, 0, sock, target, pdu, raw, sizeof(raw),
+                         UdpAddress("127.0.0.5/9"), expired_callback, 0);
+    CHECK_EQUAL(msg->GetTimeout(), 1500);
+
+    msg = queue.AddEntry(3, 0, sock, target, pdu, raw, sizeof(raw), slow,
+                         expired_callback, 0);
+    CHECK_EQUAL(msg->GetTimeout(), MSGQUEUE_RTO_MAX);
+    CHECK_EQUAL(msg->ResendMessage(), SNMP_CLASS_SUCCESS);
+    CHECK_EQUAL(msg->GetTimeout(), MSGQUEUE_RTO_MAX);
+
+    close_socket(sock);
+}
+
+#ifdef HAVE_EPOLL
+// Event queue reading at most one datagram per call. It claims to have
+// emptied the socket if empty is set, else reports whether data is left.
+class OneByOne: public CEvents
+{
+ public:
+  OneByOne() : calls(0), received(0), claim_empty(false) {};
+
+  int GetNextTimeout(msec &) { return 1; };
+#ifdef HAVE_POLL_SYSCALL
+  int GetFdCount() { return 0; };
+  bool GetFdArray(struct pollfd *, int &) { return true; };
+  int HandleEvents(const struct pollfd *, const int) { return 0; };
+#else
+  void GetFdSets(int &, fd_set &, fd_set &, fd_set &) {};
+  int HandleEvents(const int, const fd_set &, const fd_set &,
+                   const fd_set &) { return 0; };
+#endif
+  int GetCount() { return 0; };
+  int DoRetries(const msec &) { return 0; };
+  int Done() { return 0; };
+
+  bool HandleSocket(const SnmpSocket fd)
+  {
+      char buf[16];
+
+      calls++;
+      if (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+          received++;
+      return claim_empty || (recv(fd, buf, sizeof(buf),
+                                  MSG_DONTWAIT | MSG_PEEK) < 0);
+  };
+
+  int calls;
+  int received;
+  bool claim_empty;
+};
+
+static SnmpSocket bound_socket()
+{
+    SnmpSocket sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(sock, (struct sockaddr *)&addr, sizeof(addr));
+    return sock;
+}
+
+static void send_to(SnmpSocket from, SnmpSocket to, const int count)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+
+    getsockname(to, (struct sockaddr *)&addr, &addr_len);
+    for (int i = 0; i < count; i++)
+        sendto(from, "x", 1, 0, (struct sockaddr *)&addr, addr_len);
+}
+
+// Registered sockets stay in the epoll set, only those that received
+// something are handed to their queue
+static void tst_epoll()
+{
+    int status;
+    Snmp snmp(status);
+    EventListHolder holder(&snmp);
+    OneByOne queue;
+    SnmpSocket sender = socket(AF_INET, SOCK_DGRAM, 0);
+    SnmpSocket sock = bound_socket(), idle = bound_socket();
+    SnmpSocket fds[EVENT_LIST_MAX_SOCKETS + 1];
+
+    CHECK(holder.set_backend(EventListHolder::backend_epoll));
+    CHECK(holder.get_backend() == EventListHolder::backend_epoll);
+    CHECK(holder.RegisterSocket(sock, &queue));
+    CHECK(holder.RegisterSocket(idle, &queue));
+    CHECK(holder.RegisterSocket(sock, &queue));
+    CHECK_EQUAL(holder.GetSockets(fds, EVENT_LIST_MAX_SOCKETS), 2);
+
+    holder.SNMPProcessPendingEvents();
+    CHECK_EQUAL(queue.calls, 0);
+
+    send_to(sender, sock, 1);
+    holder.SNMPProcessPendingEvents();
+    CHECK_EQUAL(queue.calls, 1);
+    CHECK_EQUAL(queue.received, 1);
+    holder.SNMPProcessPendingEvents();
+    CHECK_EQUAL(queue.calls, 1);
+
+    // a queue that did not empty the socket gets it reported again
+    send_to(sender, sock, 3);
+    for (int i = 0; i < 5; i++)
+        holder.SNMPProcessPendingEvents();
+    CHECK_EQUAL(queue.calls, 4);
+    CHECK_EQUAL(queue.received, 4);
+
+    // data left behind is only reported again after a rearm
+    queue.claim_empty = true;
+    send_to(sender, sock, 2);
+    holder.SNMPProcessPendingEvents();
+    holder.SNMPProcessPendingEvents();
+    CHECK_EQUAL(queue.received, 5);
+    holder.RearmSocket(sock);
+    holder.SNMPProcessPendingEvents();
+    CHECK_EQUAL(queue.received, 6);
+    holder.SNMPProcessPendingEvents();
+    CHECK_EQUAL(queue.calls, 6);
+
+    // switching the backend keeps the registrations
+    CHECK(holder.set_backend(EventListHolder::backend_select));
+    CHECK(holder.set_backend(EventListHolder::backend_epoll));
+    send_to(sender, sock, 1);
+    holder.SNMPProcessPendingEvents();
+    CHECK_EQUAL(queue.received, 7);
+
+    // unregistered sockets are not watched anymore
+    holder.UnregisterSocket(sock);
+    send_to(sender, sock, 1);
+    holder.SNMPProcessPendingEvents();
+    CHECK_EQUAL(queue.calls, 7);
+    CHECK_EQUAL(holder.GetSockets(fds, EVENT_LIST_MAX_SOCKETS), 1);
+
+    // up to EVENT_LIST_MAX_SOCKETS sockets, a freed slot is reused
+    SnmpSocket more[EVENT_LIST_MAX_SOCKETS];
+    for (int i = 0; i < EVENT_LIST_MAX_SOCKETS; i++)
+        more[i] = bound_socket();
+    for (int i = 0; i < EVENT_LIST_MAX_SOCKETS - 1; i++)
+        CHECK(holder.RegisterSocket(more[i], &queue));
+    CHECK(!holder.RegisterSocket(more[EVENT_LIST_MAX_SOCKETS - 1], &queue));
+    CHECK_EQUAL(holder.GetSockets(fds, EVENT_LIST_MAX_SOCKETS + 1),
+                EVENT_LIST_MAX_SOCKETS);
+    holder.UnregisterSocket(more[0]);
+    CHECK(holder.RegisterSocket(more[EVENT_LIST_MAX_SOCKETS - 1], &queue));
+
+    send_to(sender, more[EVENT_LIST_MAX_SOCKETS - 1], 1);
+    holder.SNMPProcessPendingEvents();
+    CHECK_EQUAL(queue.calls, 8);
+
+    for (int i = 0; i < EVENT_LIST_MAX_SOCKETS; i++)
+    {
+        holder.UnregisterSocket(more[i]);
+        close_socket(more[i]);
+    }
+    holder.UnregisterSocket(idle);
+    CHECK_EQUAL(holder.GetSockets(fds, EVENT_LIST_MAX_SOCKETS), 0);
+    close_socket(idle);
+    close_socket(sock);
+    close_socket(sender);
+}
+#endif
+
+void tst_msgqueue()
+{
+    tst_operations();
+    tst_request_handle();
+    tst_rtt();
+#ifdef HAVE_EPOLL
+    tst_epoll();
+#endif
+}
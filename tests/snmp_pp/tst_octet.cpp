@@ -0,0 +1,225 @@
+/*
+    Copyright (C) 2004-2011 Martin Jolicoeur (snmpb1@gmail.com)
+
+    This file is part of the SnmpB project
+    (http://sourceforge.net/projects/snmpb)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "snmp_pp/snmp_pp.h"
+#include "check.h"
+
+#ifdef SNMP_PP_NAMESPACE
+using namespace Snmp_pp;
+#endif
+
+// A string of len bytes 'a', 'b', ... 'z', 'a', ...
+static OctetStr make_str(const unsigned long len)
+{
+    unsigned char buf[256];
+
+    for (unsigned long k = 0; k < len; k++)
+        buf[k] = (unsigned char)('a' + k % 26);
+    return OctetStr(buf, len);
+}
+
+static bool has_values(const OctetStr &s, const unsigned long len)
+{
+    if (s.len() != len)
+        return false;
+    for (unsigned long k = 0; k < len; k++)
+        if (s[k] != (unsigned char)('a' + k % 26))
+            return false;
+    return true;
+}
+
+// Gives access to the size of the buffer
+class SizedStr: public OctetStr
+{
+ public:
+    SizedStr(const OctetStr &s) : OctetStr(s) {}
+
+    unsigned long size() const { return capacity(); }
+};
+
+// The buffer size is kept when the string gets shorter
+static void tst_capacity()
+{
+    SizedStr s(make_str(100));
+
+    CHECK_EQUAL(s.size(), 100);
+    s.set_len(50);
+    CHECK_EQUAL(s.size(), 100);
+    s += "abc";
+    CHECK_EQUAL(s.size(), 100);
+    CHECK_EQUAL(s.len(), 53);
+    s.set_len(150);
+    CHECK_EQUAL(s.size(), 150);
+    s.set_len(0);
+    CHECK_EQUAL(s.size(), 0);
+
+    SizedStr t(make_str(10));
+    CHECK_EQUAL(t.size(), OCTETSTR_INLINE_LEN);
+    t.set_len(OCTETSTR_INLINE_LEN + 1);
+    CHECK_EQUAL(t.size(), OCTETSTR_INLINE_LEN + 1);
+    CHECK_EQUAL(t.len(), OCTETSTR_INLINE_LEN + 1);
+    CHECK_EQUAL(t[5], 'f');
+}
+
+// A heap buffer is reused as long as the new value fits into it, also
+// after the string got shorter
+static void tst_heap_reuse()
+{
+    OctetStr s = make_str(100);
+    OctetStr shorter = make_str(60), longer = make_str(90);
+    OctetStr full = make_str(100);
+    const unsigned char *heap = s.data();
+
+    s.set_len(50);
+    CHECK(has_values(s, 50));
+
+    s = longer;
+    CHECK(s.data() == heap);
+    CHECK(has_values(s, 90));
+
+    s = shorter;
+    s += OctetStr(full.data() + 60, 40);
+    CHECK(s.data() == heap);
+    CHECK(has_values(s, 100));
+
+    s.set_data(full.data(), 40);
+    CHECK(s.set_len(100));
+    CHECK(s.data() == heap);
+    CHECK_EQUAL(s.len(), 100);
+    CHECK_EQUAL(s[99], 0);
+
+    s.set_data(full.data(), 100);
+    CHECK(s.data() == heap);
+    CHECK(has_values(s, 100));
+
+    // a moved heap buffer keeps its size
+    OctetStr moved(static_cast<OctetStr&&>(s));
+    CHECK(moved.data() == heap);
+    CHECK_EQUAL(s.len(), 0);
+    moved.set_len(70);
+    moved = longer;
+    CHECK(moved.data() == heap);
+    CHECK(has_values(moved, 90));
+
+    // growing beyond the buffer allocates a new one
+    moved = make_str(120);
+    CHECK(has_values(moved, 120));
+    moved.set_len(200);
+    CHECK_EQUAL(moved.len(), 200);
+    moved.set_len(120);
+    CHECK(has_values(moved, 120));
+    moved.set_len(200);
+    CHECK_EQUAL(moved[199], 0);
+    s = make_str(10);
+    CHECK(has_values(s, 10));
+}
+
+// Moving takes over a heap buffer and copies an inline value, the
+// source stays a valid empty string
+static void tst_moves()
+{
+    OctetStr a("short"), b;
+    const unsigned char *inline_data = a.data();
+
+    b = static_cast<OctetStr&&>(a);
+    CHECK(b == OctetStr("short"));
+    CHECK(b.data() != inline_data);
+    CHECK_EQUAL(a.len(), 0);
+    CHECK(a.valid());
+    a += "again";
+    CHECK(a == OctetStr("again"));
+
+    a = make_str(100);
+    const unsigned char *heap = a.data();
+    OctetStr c(static_cast<OctetStr&&>(a));
+    CHECK(c.data() == heap);
+    CHECK(has_values(c, 100));
+    CHECK_EQUAL(a.len(), 0);
+    CHECK(a.valid());
+    b = static_cast<OctetStr&&>(c);
+    CHECK(b.data() == heap);
+    CHECK_EQUAL(c.len(), 0);
+    c = "reused";
+    CHECK(c == OctetStr("reused"));
+
+    // self assignment keeps the value and the buffer
+    OctetStr &self = b;
+    b = self;
+    CHECK(b.data() == heap);
+    CHECK(has_values(b, 100));
+    b = static_cast<OctetStr&&>(self);
+    CHECK(b.data() == heap);
+    CHECK(has_values(b, 100));
+    OctetStr &inline_self = c;
+    c = static_cast<OctetStr&&>(inline_self);
+    CHECK(c == OctetStr("reused"));
+}
+
+// Short strings are cloned into the caller's memory, longer ones and
+// too small buffers are refused
+static void tst_clone_into()
+{
+    union
+    {
+        double align;
+        unsigned char data[sizeof(OpaqueStr) + 8];
+    } buf;
+    OctetStr s("inline value");
+
+    SnmpSyntax *clone = s.clone_into(&buf, sizeof(buf));
+    CHECK((void *)clone == (void *)&buf);
+    CHECK(clone && (clone->get_syntax() == sNMP_SYNTAX_OCTETS));
+    if (clone)
+    {
+        CHECK(*(OctetStr *)clone == s);
+        clone->~SnmpSyntax();
+    }
+
+    CHECK(s.clone_into(&buf, sizeof(OctetStr) - 1) == 0);
+    CHECK(make_str(OCTETSTR_INLINE_LEN + 1).clone_into(&buf, sizeof(buf)) == 0);
+
+    SnmpSyntax *full = make_str(OCTETSTR_INLINE_LEN).clone_into(&buf,
+                                                                sizeof(buf));
+    CHECK(full != 0);
+    if (full)
+    {
+        CHECK(has_values(*(OctetStr *)full, OCTETSTR_INLINE_LEN));
+        full->~SnmpSyntax();
+    }
+
+    OpaqueStr o("opaque");
+    clone = o.clone_into(&buf, sizeof(buf));
+    CHECK(clone && (clone->get_syntax() == sNMP_SYNTAX_OPAQUE));
+    if (clone)
+    {
+        CHECK(*(OctetStr *)clone == OctetStr("opaque"));
+        clone->~SnmpSyntax();
+    }
+}
+
+void tst_octet()
+{
+    tst_capacity();
+    tst_heap_reuse();
+    tst_moves();
+    tst_clone_into();
+}
@@ -0,0 +1,191 @@
+/*
+    Copyright (C) 2004-2011 Martin Jolicoeur (snmpb1@gmail.com)
+
+    This file is part of the SnmpB project
+    (http://sourceforge.net/projects/snmpb)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "snmp_pp/snmp_pp.h"
+#include "check.h"
+
+#ifdef SNMP_PP_NAMESPACE
+using namespace Snmp_pp;
+#endif
+
+// An Oid of len subids 1.2.3...
+static Oid make_oid(const unsigned long len)
+{
+    unsigned long subids[128];
+
+    for (unsigned long k = 0; k < len; k++)
+        subids[k] = k + 1;
+    return Oid(subids, (int)len);
+}
+
+static bool has_values(Oid &o, const unsigned long len)
+{
+    if (o.len() != len)
+        return false;
+    for (unsigned long k = 0; k < len; k++)
+        if (o[k] != k + 1)
+            return false;
+    return true;
+}
+
+// A heap buffer is reused as long as the new value fits into it, also
+// after the Oid got shorter
+static void tst_heap_reuse()
+{
+    Oid o = make_oid(100);
+    Oid shorter = make_oid(60), longer = make_oid(90);
+    SmiUINT32 *heap = o.oidval()->ptr;
+
+    o.trim(50);
+    CHECK(has_values(o, 50));
+
+    o = longer;
+    CHECK(o.oidval()->ptr == heap);
+    CHECK(has_values(o, 90));
+
+    o = shorter;
+    o += make_oid(100 - 60);
+    CHECK(o.oidval()->ptr == heap);
+    CHECK_EQUAL(o.len(), 100);
+
+    unsigned long raw[100];
+    for (unsigned long k = 0; k < 100; k++)
+        raw[k] = k + 1;
+    o.set_data(raw, 30);
+    o.set_data(raw, 100);
+    CHECK(o.oidval()->ptr == heap);
+    CHECK(has_values(o, 100));
+
+    // a moved heap buffer keeps its size
+    Oid moved(static_cast<Oid&&>(o));
+    CHECK(moved.oidval()->ptr == heap);
+    CHECK(!o.valid());
+    moved.trim(70);
+    moved = longer;
+    CHECK(moved.oidval()->ptr == heap);
+    CHECK(has_values(moved, 90));
+
+    // growing beyond the buffer allocates a new one
+    moved = make_oid(120);
+    CHECK(has_values(moved, 120));
+    o = make_oid(10);
+    CHECK(has_values(o, 10));
+}
+
+// nCompare() orders the first n subids as unsigned numbers, a prefix
+// before the longer Oid
+static void tst_compare()
+{
+    Oid a("1.3.6.1.2.1.2.2.1.10.5");
+    Oid prefix("1.3.6.1.2.1.2.2.1.10");
+    Oid smaller("1.3.6.1.2.1.2.2.1.9.5");
+    Oid big("1.3.6.1.2.1.2.2.1.4294967295");
+
+    CHECK_EQUAL(a.nCompare(a.len(), Oid(a)), 0);
+    CHECK_EQUAL(prefix.nCompare(a.len(), a), -1);
+    CHECK_EQUAL(a.nCompare(a.len(), prefix), 1);
+    CHECK_EQUAL(a.nCompare(prefix.len(), prefix), 0);
+    CHECK_EQUAL(smaller.nCompare(a.len(), a), -1);
+    CHECK_EQUAL(a.nCompare(a.len(), smaller), 1);
+    CHECK_EQUAL(a.nCompare(9, smaller), 0);
+    CHECK_EQUAL(big.nCompare(big.len(), a), 1);
+    CHECK_EQUAL(a.nCompare(big.len(), big), -1);
+    CHECK_EQUAL(a.nCompare(0, big), 0);
+    CHECK_EQUAL(Oid().nCompare(5, a), -1);
+    CHECK(smaller < a);
+    CHECK(prefix < a);
+    CHECK(!(a < prefix));
+
+    // a difference after a long equal part, inline and on the heap
+    for (unsigned long len = 20; len <= 100; len += 80)
+    {
+        Oid x = make_oid(len), y = make_oid(len);
+
+        y[len - 3] = 0;
+        CHECK_EQUAL(x.nCompare(len, y), 1);
+        CHECK_EQUAL(y.nCompare(len, x), -1);
+        CHECK_EQUAL(x.nCompare(len - 3, y), 0);
+        CHECK(y < x);
+    }
+}
+
+static void tst_subtree()
+{
+    Oid root("1.3.6.1.2.1.2.2");
+    Oid row("1.3.6.1.2.1.2.2.1.10.5");
+    Oid next("1.3.6.1.2.1.2.3.1");
+    Oid sibling("1.3.6.1.2.1.2.20");
+
+    CHECK(row.in_subtree_of(root));
+    CHECK(root.in_subtree_of(root));
+    CHECK(row.in_subtree_of(Oid()));
+    CHECK(!next.in_subtree_of(root));
+    CHECK(!sibling.in_subtree_of(root));
+    CHECK(!root.in_subtree_of(row));
+    CHECK(make_oid(100).in_subtree_of(make_oid(30)));
+    CHECK(!make_oid(30).in_subtree_of(make_oid(100)));
+}
+
+// Appending an Oid to itself, inline, growing onto the heap and on the
+// heap, and appending strings
+static void tst_append()
+{
+    Oid o = make_oid(5);
+
+    o += o;
+    CHECK_EQUAL(o.len(), 10);
+    CHECK(o == Oid("1.2.3.4.5.1.2.3.4.5"));
+
+    o += o;
+    CHECK_EQUAL(o.len(), 20);
+    o += o;
+    CHECK_EQUAL(o.len(), 40);
+    o += o;
+    CHECK_EQUAL(o.len(), 80);
+    bool repeated = true;
+    for (unsigned long k = 0; k < 80; k++)
+        if (o[k] != k % 5 + 1)
+            repeated = false;
+    CHECK(repeated);
+
+    o = make_oid(3);
+    o += ".4.5";
+    CHECK(o == Oid("1.2.3.4.5"));
+    o += "";
+    CHECK(o == Oid("1.2.3.4.5"));
+    o += (const char *)0;
+    CHECK(o == Oid("1.2.3.4.5"));
+
+    // an invalid string makes the Oid invalid
+    o += "6.x.7";
+    CHECK(!o.valid());
+    CHECK_EQUAL(o.len(), 0);
+    o = make_oid(100);
+    o += "1.2.abc";
+    CHECK(!o.valid());
+}
+
+void tst_oid()
+{
+    tst_heap_reuse();
+    tst_compare();
+    tst_subtree();
+    tst_append();
+}
@@ -0,0 +1,312 @@
+/*
+    Copyright (C) 2004-2011 Martin Jolicoeur (snmpb1@gmail.com)
+
+    This file is part of the SnmpB project
+    (http://sourceforge.net/projects/snmpb)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "snmp_pp/snmp_pp.h"
+#include "check.h"
+
+#ifdef SNMP_PP_NAMESPACE
+using namespace Snmp_pp;
+#endif
+
+// Check if the value of vb is stored inside the Vb object
+static bool is_inline(const Vb &vb)
+{
+    const char *value = (const char *)vb.get_value_ptr();
+
+    return value && (value >= (const char *)&vb) &&
+        (value < (const char *)&vb + sizeof(Vb));
+}
+
+// A string of len bytes 'a', 'b', ... 'z', 'a', ...
+static OctetStr make_str(const unsigned long len)
+{
+    unsigned char buf[256];
+
+    for (unsigned long k = 0; k < len; k++)
+        buf[k] = (unsigned char)('a' + k % 26);
+    return OctetStr(buf, len);
+}
+
+// The vb 1.3.6.1.4.1.99999.n with a value depending on n: integers,
+// counters and short strings are stored inline, long strings and Oids
+// on the heap
+static Vb make_vb(const int n)
+{
+    Oid id("1.3.6.1.4.1.99999");
+    id += n;
+    Vb vb(id);
+
+    switch (n % 5)
+    {
+    case 0: vb.set_value(SnmpInt32(-n)); break;
+    case 1: vb.set_value(Counter64(n, n)); break;
+    case 2: vb.set_value(OctetStr(make_str(n % 30 + 1))); break;
+    case 3: vb.set_value(make_str(100 + n)); break;
+    case 4: vb.set_value(Oid("1.3.6.1.2.1.1.1.0")); break;
+    }
+    return vb;
+}
+
+static bool has_value(const Vb &vb, const int n)
+{
+    Oid id("1.3.6.1.4.1.99999");
+    id += n;
+
+    if (vb.get_oid() != id)
+        return false;
+
+    switch (n % 5)
+    {
+    case 0:
+    {
+        int i;
+        return (vb.get_syntax() == sNMP_SYNTAX_INT) &&
+            (vb.get_value(i) == SNMP_CLASS_SUCCESS) && (i == -n);
+    }
+    case 1:
+    {
+        Counter64 c;
+        return (vb.get_syntax() == sNMP_SYNTAX_CNTR64) &&
+            (vb.get_value(c) == SNMP_CLASS_SUCCESS) &&
+            (c.high() == (unsigned long)n) && (c.low() == (unsigned long)n);
+    }
+    case 2:
+    case 3:
+    {
+        OctetStr s;
+        unsigned long len = (n % 5 == 2) ? n % 30 + 1 : 100 + n;
+        return (vb.get_syntax() == sNMP_SYNTAX_OCTETS) &&
+            (vb.get_value(s) == SNMP_CLASS_SUCCESS) && (s == make_str(len));
+    }
+    default:
+    {
+        Oid o;
+        return (vb.get_syntax() == sNMP_SYNTAX_OID) &&
+            (vb.get_value(o) == SNMP_CLASS_SUCCESS) &&
+            (o == Oid("1.3.6.1.2.1.1.1.0"));
+    }
+    }
+}
+
+// Small values are kept in the inline value union of the Vb
+static void tst_vb_values()
+{
+    for (int n = 0; n < 5; n++)
+    {
+        Vb vb = make_vb(n);
+
+        CHECK(has_value(vb, n));
+        CHECK_EQUAL(is_inline(vb), (n % 5 <= 2));
+
+        Vb copy(vb);
+        CHECK(has_value(copy, n));
+        CHECK_EQUAL(is_inline(copy), (n % 5 <= 2));
+        CHECK(copy.get_value_ptr() != vb.get_value_ptr());
+    }
+
+    Vb vb(Oid("1.3.6.1.2.1.1.5.0"));
+    vb.set_value("name");
+    CHECK(is_inline(vb));
+    vb.set_value(make_str(OCTETSTR_INLINE_LEN + 1).get_printable());
+    CHECK(!is_inline(vb));
+    vb.set_value(OpaqueStr("opaque"));
+    CHECK(is_inline(vb));
+    CHECK_EQUAL(vb.get_syntax(), sNMP_SYNTAX_OPAQUE);
+    vb.set_null();
+    CHECK(vb.get_value_ptr() == 0);
+    CHECK_EQUAL(vb.get_syntax(), sNMP_SYNTAX_NULL);
+}
+
+// Moving a Vb takes over the oid and a heap value and copies an inline
+// value, the source is left without oid and value
+static void tst_vb_moves()
+{
+    Vb a = make_vb(1), b;
+
+    CHECK(is_inline(a));
+    b = static_cast<Vb&&>(a);
+    CHECK(has_value(b, 1));
+    CHECK(is_inline(b));
+    CHECK(a.get_value_ptr() == 0);
+    CHECK(!a.valid());
+    CHECK_EQUAL(a.get_syntax(), sNMP_SYNTAX_NULL);
+
+    a = make_vb(3);
+    const SnmpSyntax *heap = a.get_value_ptr();
+    CHECK(!is_inline(a));
+    Vb c(static_cast<Vb&&>(a));
+    CHECK(c.get_value_ptr() == heap);
+    CHECK(has_value(c, 3));
+    CHECK(a.get_value_ptr() == 0);
+    CHECK(!a.valid());
+
+    // a moved-from Vb can be used again
+    a.set_oid(Oid("1.3.6.1.2.1.1.1.0"));
+    a.set_value(SnmpInt32(7));
+    CHECK(a.valid());
+    CHECK_EQUAL(a.get_syntax(), sNMP_SYNTAX_INT);
+
+    // exceptions are moved too
+    Vb e(Oid("1.3.6.1.2.1.1.2.0"));
+    e.set_exception_status(sNMP_SYNTAX_NOSUCHINSTANCE);
+    Vb f(static_cast<Vb&&>(e));
+    CHECK_EQUAL(f.get_syntax(), sNMP_SYNTAX_NOSUCHINSTANCE);
+    CHECK_EQUAL(e.get_syntax(), sNMP_SYNTAX_NULL);
+
+    // self assignment keeps oid and value
+    Vb &self = c;
+    c = self;
+    CHECK(c.get_value_ptr() == heap);
+    CHECK(has_value(c, 3));
+    c = static_cast<Vb&&>(self);
+    CHECK(c.get_value_ptr() == heap);
+    CHECK(has_value(c, 3));
+    Vb &inline_self = b;
+    b = static_cast<Vb&&>(inline_self);
+    CHECK(has_value(b, 1));
+    CHECK(is_inline(b));
+}
+
+// The vbs are stored in one array that grows, trim() and delete_vb()
+// keep the remaining values
+static void tst_pdu_store()
+{
+    Pdu pdu;
+
+    for (int n = 0; n < 50; n++)
+    {
+        if (n & 1)
+            pdu += make_vb(n);
+        else
+        {
+            Vb vb = make_vb(n);
+            pdu += vb;
+        }
+    }
+    CHECK_EQUAL(pdu.get_vb_count(), 50);
+
+    bool all = true;
+    for (int n = 0; n < 50; n++)
+        all = all && has_value(pdu.get_vb(n), n);
+    CHECK(all);
+
+    // growing moves the vbs, heap values stay where they are
+    const SnmpSyntax *heap = pdu.get_vb(3).get_value_ptr();
+    for (int n = 50; n < 100; n++)
+        pdu += make_vb(n);
+    CHECK(pdu.get_vb(3).get_value_ptr() == heap);
+    CHECK(is_inline(pdu.get_vb(2)));
+    all = true;
+    for (int n = 0; n < 100; n++)
+        all = all && has_value(pdu.get_vb(n), n);
+    CHECK(all);
+
+    // trim
+    CHECK(!pdu.trim(-1));
+    CHECK(!pdu.trim(101));
+    CHECK(pdu.trim(40));
+    CHECK_EQUAL(pdu.get_vb_count(), 60);
+    CHECK(has_value(pdu.get_vb(59), 59));
+    CHECK(pdu.trim());
+    CHECK_EQUAL(pdu.get_vb_count(), 59);
+
+    // delete_vb
+    CHECK(!pdu.delete_vb(-1));
+    CHECK(!pdu.delete_vb(59));
+    CHECK(pdu.delete_vb(0));
+    CHECK(pdu.delete_vb(10));
+    CHECK(pdu.delete_vb(56));
+    CHECK_EQUAL(pdu.get_vb_count(), 56);
+    all = true;
+    for (int i = 0; i < 56; i++)
+        all = all && has_value(pdu.get_vb(i), (i < 10) ? i + 1 : i + 2);
+    CHECK(all);
+    CHECK(pdu.get_vb(2).get_value_ptr() == heap);
+
+    // the array is reused after trimming everything
+    CHECK(pdu.trim(56));
+    CHECK_EQUAL(pdu.get_vb_count(), 0);
+    pdu += make_vb(4);
+    CHECK_EQUAL(pdu.get_vb_count(), 1);
+    CHECK(has_value(pdu.get_vb(0), 4));
+}
+
+// Moving a Pdu takes over the vb array, the source is empty and can be
+// used again
+static void tst_pdu_moves()
+{
+    Pdu a, b;
+
+    for (int n = 0; n < 20; n++)
+        a += make_vb(n);
+    a.set_request_id(4711);
+    a.set_type(sNMP_PDU_RESPONSE);
+
+    const Vb *first = &a.get_vb(0);
+    Pdu c(static_cast<Pdu&&>(a));
+    CHECK_EQUAL(c.get_vb_count(), 20);
+    CHECK(&c.get_vb(0) == first);
+    CHECK_EQUAL(c.get_request_id(), 4711);
+    CHECK_EQUAL(c.get_type(), sNMP_PDU_RESPONSE);
+    CHECK_EQUAL(a.get_vb_count(), 0);
+
+    a += make_vb(7);
+    CHECK_EQUAL(a.get_vb_count(), 1);
+    CHECK(has_value(a.get_vb(0), 7));
+
+    // move assignment replaces the vbs of the target
+    b += make_vb(1);
+    b = static_cast<Pdu&&>(c);
+    CHECK_EQUAL(b.get_vb_count(), 20);
+    CHECK(&b.get_vb(0) == first);
+    CHECK_EQUAL(c.get_vb_count(), 0);
+    bool all = true;
+    for (int n = 0; n < 20; n++)
+        all = all && has_value(b.get_vb(n), n);
+    CHECK(all);
+
+    // copies are independent
+    Pdu copy(b);
+    CHECK_EQUAL(copy.get_vb_count(), 20);
+    CHECK(copy.get_vb(3).get_value_ptr() != b.get_vb(3).get_value_ptr());
+    copy.trim(10);
+    CHECK_EQUAL(b.get_vb_count(), 20);
+    CHECK(has_value(b.get_vb(19), 19));
+
+    // self assignment keeps the vbs
+    Pdu &self = b;
+    b = self;
+    CHECK_EQUAL(b.get_vb_count(), 20);
+    b = static_cast<Pdu&&>(self);
+    CHECK_EQUAL(b.get_vb_count(), 20);
+    CHECK(&b.get_vb(0) == first);
+    all = true;
+    for (int n = 0; n < 20; n++)
+        all = all && has_value(b.get_vb(n), n);
+    CHECK(all);
+}
+
+void tst_pdu()
+{
+    tst_vb_values();
+    tst_vb_moves();
+    tst_pdu_store();
+    tst_pdu_moves();
+}
@@ -0,0 +1,310 @@
+/*
+    Copyright (C) 2004-2011 Martin Jolicoeur (snmpb1@gmail.com)
+
+    This file is part of the SnmpB project
+    (http://sourceforge.net/projects/snmpb)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "snmp_pp/snmp_pp.h"
+#include "check.h"
+
+#ifdef SNMP_PP_NAMESPACE
+using namespace Snmp_pp;
+#endif
+
+#ifdef WIN32
+#define close_socket closesocket
+#else
+#define close_socket close
+#endif
+
+// A UDP socket bound to a free port of the loopback interface
+static SnmpSocket loopback_socket(struct sockaddr_in &addr)
+{
+    SnmpSocket sock = socket(AF_INET, SOCK_DGRAM, 0);
+    socklen_t len = sizeof(addr);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(sock, (struct sockaddr *)&addr, sizeof(addr));
+    getsockname(sock, (struct sockaddr *)&addr, &len);
+
+#ifdef WIN32
+    DWORD timeout = 200;
+#else
+    struct timeval timeout = { 0, 200000 };
+#endif
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (char *)&timeout,
+               sizeof(timeout));
+    return sock;
+}
+
+static void send_string(SnmpSocket sock, const struct sockaddr_in &to,
+                        const char *data)
+{
+    sendto(sock, data, (int)strlen(data), 0, (struct sockaddr *)&to,
+           sizeof(to));
+}
+
+static bool batch_has(SnmpRecvBatch &batch, const int i, const char *data)
+{
+    return (i < batch.get_count()) &&
+           (batch.get_length(i) == (long)strlen(data)) &&
+           !memcmp(batch.get_data(i), data, strlen(data));
+}
+
+// A batch that is claimed keeps its datagrams while another one
+// receives, and released batches are reused.
+static void tst_pool()
+{
+    struct sockaddr_in addr;
+    SnmpSocket sock = loopback_socket(addr);
+    SnmpRecvBatchPool pool(1000);
+    SnmpRecvBatch *outer = pool.claim();
+    SnmpRecvBatch *inner = pool.claim();
+
+    CHECK(outer != inner);
+    CHECK_EQUAL(outer->get_buffer_size(), 1000);
+
+    send_string(sock, addr, "outer");
+    CHECK_EQUAL(outer->receive(sock), 1);
+
+    send_string(sock, addr, "inner");
+    CHECK_EQUAL(inner->receive(sock), 1);
+
+    CHECK(batch_has(*outer, 0, "outer"));
+    CHECK(batch_has(*inner, 0, "inner"));
+
+    pool.release(inner);
+    pool.set_buffer_size(2000);
+    CHECK_EQUAL(pool.get_buffer_size(), 2000);
+
+    SnmpRecvBatch *again = pool.claim();
+
+    CHECK(again == inner);
+    CHECK_EQUAL(again->get_buffer_size(), 2000);
+
+    pool.release(again);
+    pool.release(outer);
+    close_socket(sock);
+}
+
+// A new buffer size is used from the next receive() on, longer
+// datagrams are marked as truncated
+static void tst_resize()
+{
+    struct sockaddr_in addr;
+    SnmpSocket sock = loopback_socket(addr);
+    SnmpRecvBatch batch(2, 1000);
+    char data[5000];
+
+    for (int i = 0; i < (int)sizeof(data); i++)
+        data[i] = (char)('a' + i % 26);
+
+    sendto(sock, data, 3000, 0, (struct sockaddr *)&addr, sizeof(addr));
+    CHECK_EQUAL(batch.receive(sock), 1);
+    CHECK_EQUAL(batch.get_data_size(), 1000);
+    CHECK_EQUAL(batch.get_length(0), 1001);
+
+    batch.set_buffer_size(sizeof(data));
+    CHECK_EQUAL(batch.get_buffer_size(), (int)sizeof(data));
+    CHECK_EQUAL(batch.get_data_size(), 1000);
+
+    sendto(sock, data, 3000, 0, (struct sockaddr *)&addr, sizeof(addr));
+    sendto(sock, data, sizeof(data), 0, (struct sockaddr *)&addr,
+           sizeof(addr));
+    CHECK_EQUAL(batch.receive(sock), 2);
+    CHECK_EQUAL(batch.get_data_size(), (int)sizeof(data));
+    CHECK_EQUAL(batch.get_length(0), 3000);
+    CHECK(!memcmp(batch.get_data(0), data, 3000));
+    CHECK_EQUAL(batch.get_length(1), (long)sizeof(data));
+    CHECK(!memcmp(batch.get_data(1), data, sizeof(data)));
+
+    // smaller again, but never below MIN_SNMP_PACKET
+    batch.set_buffer_size(100);
+    send_string(sock, addr, "short");
+    CHECK_EQUAL(batch.receive(sock), 1);
+    CHECK_EQUAL(batch.get_data_size(), MIN_SNMP_PACKET);
+    CHECK(batch_has(batch, 0, "short"));
+
+    close_socket(sock);
+}
+
+// A nested event loop is only possible when the event list mutex is
+// recursive or not there at all.
+#if !defined(_THREADS) || defined(WIN32)
+
+// Turn a SNMPv1/v2c request into its response in place
+static void make_response(unsigned char *msg, const int len)
+{
+    int pos = 0;
+
+    for (int field = 0; (field < 3) && (pos + 1 < len); field++)
+    {
+        int length = msg[pos + 1];
+        int header = 2;
+
+        if (length & 0x80)
+        {
+            header += length & 0x7f;
+            length = 0;
+            for (int i = 2; (i < header) && (pos + i < len); i++)
+                length = (length << 8) | msg[pos + i];
+        }
+        // step into the message sequence, over version and community
+        pos += (field == 0) ? header : header + length;
+    }
+    if (pos < len)
+        msg[pos] = sNMP_PDU_RESPONSE;
+}
+
+// Answers the first two requests together, so that they are received
+// in one batch, and the others immediately.
+struct Agent
+{
+    SnmpSocket sock;
+    struct sockaddr_in addr;
+    std::atomic<bool> held_sent;
+    std::atomic<bool> stop;
+
+    Agent() : held_sent(false), stop(false) { sock = loopback_socket(addr); }
+    ~Agent() { close_socket(sock); }
+
+    void run()
+    {
+        unsigned char held[2][MAX_SNMP_PACKET];
+        int held_len[2];
+        struct sockaddr_in held_from[2];
+        int requests = 0;
+
+        while (!stop)
+        {
+            unsigned char msg[MAX_SNMP_PACKET];
+            struct sockaddr_in from;
+            socklen_t fromlen = sizeof(from);
+            int len = recvfrom(sock, (char *)msg, sizeof(msg), 0,
+                               (struct sockaddr *)&from, &fromlen);
+
+            if (len <= 0)
+                continue;
+
+            make_response(msg, len);
+            if (requests < 2)
+            {
+                memcpy(held[requests], msg, len);
+                held_len[requests] = len;
+                held_from[requests] = from;
+                if (++requests == 2)
+                {
+                    for (int i = 0; i < 2; i++)
+                        sendto(sock, (char *)held[i], held_len[i], 0,
+                               (struct sockaddr *)&held_from[i],
+                               sizeof(held_from[i]));
+                    held_sent = true;
+                }
+                continue;
+            }
+            sendto(sock, (char *)msg, len, 0, (struct sockaddr *)&from,
+                   fromlen);
+        }
+    }
+};
+
+struct NestedState
+{
+    CTarget target;
+    int responses;
+    int nested_status;
+};
+
+static void nested_callback(int reason, Snmp *snmp, Pdu &, SnmpTarget &,
+                            void *data)
+{
+    NestedState *state = (NestedState *)data;
+
+    if (reason != SNMP_CLASS_ASYNC_RESPONSE)
+        return;
+
+    // a synchronous request from the callback of the first response
+    if (state->responses++ == 0)
+    {
+        Pdu pdu;
+        Vb vb(Oid("1.3.6.1.2.1.1.3.0"));
+
+        pdu += vb;
+        state->nested_status = snmp->get(pdu, state->target);
+    }
+}
+
+// Two responses received in one batch both reach their callbacks,
+// though the callback of the first one processes events again.
+static void tst_nested_get()
+{
+    int status;
+    Snmp snmp(status);
+    Agent agent;
+    std::thread agent_thread(&Agent::run, &agent);
+    NestedState state;
+    Pdu pdu;
+    Vb vb(Oid("1.3.6.1.2.1.1.1.0"));
+
+    CHECK_EQUAL(status, SNMP_CLASS_SUCCESS);
+
+    UdpAddress address("127.0.0.1");
+    address.set_port(ntohs(agent.addr.sin_port));
+    state.target = CTarget(address);
+    state.target.set_version(version2c);
+    state.target.set_timeout(200);
+    state.target.set_retry(0);
+    state.responses = 0;
+    state.nested_status = SNMP_CLASS_ERROR;
+
+    pdu += vb;
+    CHECK_EQUAL(snmp.get(pdu, state.target, nested_callback, &state),
+                SNMP_CLASS_SUCCESS);
+    CHECK_EQUAL(snmp.get(pdu, state.target, nested_callback, &state),
+                SNMP_CLASS_SUCCESS);
+
+    for (int i = 0; (i < 100) && !agent.held_sent; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    for (int i = 0; (i < 30) && (state.responses < 2); i++)
+        snmp.get_eventListHolder()->SNMPProcessEvents(100);
+
+    CHECK_EQUAL(state.responses, 2);
+    CHECK_EQUAL(state.nested_status, SNMP_CLASS_SUCCESS);
+
+    agent.stop = true;
+    agent_thread.join();
+}
+
+#endif
+
+void tst_recvbatch()
+{
+    tst_pool();
+    tst_resize();
+#if !defined(_THREADS) || defined(WIN32)
+    tst_nested_get();
+#endif
+}
@@ -0,0 +1,245 @@
+/*
+    Copyright (C) 2004-2011 Martin Jolicoeur (snmpb1@gmail.com)
+
+    This file is part of the SnmpB project
+    (http://sourceforge.net/projects/snmpb)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "snmp_pp/snmp_pp.h"
+#include "snmp_pp/snmpmsg.h"
+#include "check.h"
+
+#ifdef SNMP_PP_NAMESPACE
+using namespace Snmp_pp;
+#endif
+
+// BER encoding of the snmpTrapOID.0 name
+static const unsigned char trap_oid_ber[] =
+    { 0x06, 0x0a, 0x2b, 0x06, 0x01, 0x06, 0x03, 0x01, 0x01, 0x04, 0x01, 0x00 };
+
+static bool contains(const unsigned char *data, int len,
+                     const unsigned char *what, int what_len)
+{
+    for (int i = 0; i + what_len <= len; i++)
+        if (!memcmp(data + i, what, what_len))
+            return true;
+    return false;
+}
+
+// A v2c notification with one vb and the given id, encoded and decoded
+static void notification(const unsigned short type, const Oid &id,
+                         SnmpMessage &msg, Pdu &out)
+{
+    Pdu pdu;
+    Vb vb(Oid("1.3.6.1.2.1.2.2.1.1.3"));
+    OctetStr community;
+    snmp_version version;
+
+    vb.set_value(SnmpInt32(3));
+    pdu += vb;
+    pdu.set_type(type);
+    pdu.set_notify_timestamp(TimeTicks(4200));
+    if (id.valid())
+        pdu.set_notify_id(id);
+
+    CHECK_EQUAL(msg.load(pdu, "public", version2c), SNMP_CLASS_SUCCESS);
+
+    SnmpMessage in;
+    CHECK_EQUAL(in.load(msg.data(), msg.len()), SNMP_CLASS_SUCCESS);
+    CHECK_EQUAL(in.unload(out, community, version), SNMP_CLASS_SUCCESS);
+    CHECK_EQUAL(out.get_type(), type);
+}
+
+// The notification id is sent as the second vb, if one is set
+static void tst_notify_id()
+{
+    static const unsigned short types[] = { sNMP_PDU_TRAP, sNMP_PDU_INFORM };
+
+    for (int t = 0; t < 2; t++)
+    {
+        SnmpMessage msg;
+        Pdu out;
+        TimeTicks timestamp;
+        Oid id;
+
+        notification(types[t], Oid("1.3.6.1.6.3.1.1.5.3"), msg, out);
+        CHECK(contains(msg.data(), (int)msg.len(),
+                       trap_oid_ber, sizeof(trap_oid_ber)));
+        out.get_notify_id(id);
+        CHECK(id == Oid("1.3.6.1.6.3.1.1.5.3"));
+        out.get_notify_timestamp(timestamp);
+        CHECK_EQUAL((unsigned long)timestamp, 4200);
+        CHECK_EQUAL(out.get_vb_count(), 1);
+
+        // without an id there is no snmpTrapOID.0 vb, not even 0.0
+        SnmpMessage anonymous;
+        Pdu none;
+
+        notification(types[t], Oid(), anonymous, none);
+        CHECK(!contains(anonymous.data(), (int)anonymous.len(),
+                        trap_oid_ber, sizeof(trap_oid_ber)));
+        CHECK(!none.get_notify_id().valid());
+        none.get_notify_timestamp(timestamp);
+        CHECK_EQUAL((unsigned long)timestamp, 4200);
+        CHECK_EQUAL(none.get_vb_count(), 1);
+        CHECK(none.get_vb(0).get_oid() == Oid("1.3.6.1.2.1.2.2.1.1.3"));
+    }
+}
+
+// Integers at the boundaries of each encoded length read back through
+// a view on the received encoding
+static void tst_integers()
+{
+    static const long values[] =
+        { 0, 1, -1, 127, 128, -128, -129, 255, -256, 32767, -32768,
+          32768, -32769, 8388607, -8388608, 2147483647L, -2147483647L - 1 };
+    const int count = sizeof(values) / sizeof(values[0]);
+    Pdu pdu, out;
+    SnmpMessage msg, in;
+    OctetStr community;
+    snmp_version version;
+
+    for (int k = 0; k < count; k++)
+    {
+        Vb vb(Oid("1.3.6.1.4.1.1.1"));
+        vb.set_value(SnmpInt32(values[k]));
+        pdu += vb;
+    }
+    pdu.set_type(sNMP_PDU_RESPONSE);
+
+    CHECK_EQUAL(msg.load(pdu, "public", version2c), SNMP_CLASS_SUCCESS);
+    CHECK_EQUAL(in.load(msg.data(), msg.len()), SNMP_CLASS_SUCCESS);
+    CHECK_EQUAL(in.unload(out, community, version), SNMP_CLASS_SUCCESS);
+    CHECK_EQUAL(out.get_vb_count(), count);
+
+    for (int k = 0; k < out.get_vb_count(); k++)
+    {
+        VbView view;
+        long value = 0;
+
+        CHECK(out.get_vb_view(view, k));
+        CHECK_EQUAL(view.get_value(value), SNMP_CLASS_SUCCESS);
+        CHECK_EQUAL(value, values[k]);
+    }
+}
+
+// Gives access to the size of the message buffer
+class SizedMessage: public SnmpMessage
+{
+ public:
+    SizedMessage(const unsigned int size = MAX_SNMP_PACKET)
+        : SnmpMessage(size) {}
+
+    bool resize(const unsigned int size) { return set_max_size(size); }
+};
+
+// Messages beyond MAX_SNMP_PACKET, up to MAX_SNMP_PACKET_LIMIT
+static void tst_max_size()
+{
+    static unsigned char raw[MAX_SNMP_PACKET_LIMIT + 1];
+    SizedMessage msg;
+
+    CHECK_EQUAL(msg.max_size(), MAX_SNMP_PACKET);
+    CHECK(!msg.resize(0));
+    CHECK(!msg.resize(MAX_SNMP_PACKET_LIMIT + 1));
+    CHECK_EQUAL(msg.max_size(), MAX_SNMP_PACKET);
+    CHECK(msg.resize(MAX_SNMP_PACKET_LIMIT));
+    CHECK_EQUAL(msg.max_size(), MAX_SNMP_PACKET_LIMIT);
+
+    // a received message makes room for itself
+    for (int i = 0; i < (int)sizeof(raw); i++)
+        raw[i] = (unsigned char)i;
+
+    SnmpMessage received;
+    CHECK_EQUAL(received.load(raw, 20000), SNMP_CLASS_SUCCESS);
+    CHECK_EQUAL(received.max_size(), 20000);
+    CHECK_EQUAL(received.len(), 20000);
+    CHECK(!memcmp(received.data(), raw, 20000));
+    CHECK_EQUAL(received.load(raw, 100), SNMP_CLASS_SUCCESS);
+    CHECK_EQUAL(received.max_size(), 20000);
+    CHECK(received.load(raw, sizeof(raw)) != SNMP_CLASS_SUCCESS);
+    CHECK(!received.valid());
+
+    // a Pdu that only fits into a larger message
+    Pdu pdu, out;
+    Vb vb(Oid("1.3.6.1.4.1.1.1"));
+    OctetStr community;
+    snmp_version version;
+
+    vb.set_value(OctetStr(raw, 8000));
+    pdu += vb;
+    pdu.set_type(sNMP_PDU_RESPONSE);
+
+    SnmpMessage small;
+    CHECK(small.load(pdu, "public", version2c) != SNMP_CLASS_SUCCESS);
+
+    SnmpMessage large(10000);
+    CHECK_EQUAL(large.max_size(), 10000);
+    CHECK_EQUAL(large.load(pdu, "public", version2c), SNMP_CLASS_SUCCESS);
+    CHECK(large.len() > 8000);
+
+    SnmpMessage in;
+    CHECK_EQUAL(in.load(large.data(), large.len()), SNMP_CLASS_SUCCESS);
+    CHECK_EQUAL(in.unload(out, community, version), SNMP_CLASS_SUCCESS);
+    CHECK(out.get_vb(0).get_syntax() == sNMP_SYNTAX_OCTETS);
+
+    Vb value;
+    OctetStr str;
+    out.get_vb(value, 0);
+    value.get_value(str);
+    CHECK(str == OctetStr(raw, 8000));
+}
+
+// The maximum message size of a target stays in 484..65507
+static void tst_target_size()
+{
+    CTarget target(UdpAddress("127.0.0.1/161"));
+
+    CHECK_EQUAL(target.get_max_msg_size(), MAX_SNMP_PACKET);
+    target.set_max_msg_size(100);
+    CHECK_EQUAL(target.get_max_msg_size(), MIN_SNMP_PACKET);
+    CHECK_EQUAL(target.get_max_msg_size(), 484);
+    target.set_max_msg_size(70000);
+    CHECK_EQUAL(target.get_max_msg_size(), MAX_SNMP_PACKET_LIMIT);
+    CHECK_EQUAL(target.get_max_msg_size(), 65507);
+    target.set_max_msg_size(-1);
+    CHECK_EQUAL(target.get_max_msg_size(), 484);
+    target.set_max_msg_size(8000);
+    CHECK_EQUAL(target.get_max_msg_size(), 8000);
+
+    // copies and clones keep the size
+    CTarget copy(target);
+    CHECK_EQUAL(copy.get_max_msg_size(), 8000);
+    SnmpTarget *clone = target.clone();
+    CHECK_EQUAL(clone->get_max_msg_size(), 8000);
+    delete clone;
+
+    // the default is clamped too and used for new targets
+    SnmpTarget::set_default_max_msg_size(100000);
+    CHECK_EQUAL(CTarget().get_max_msg_size(), 65507);
+    SnmpTarget::set_default_max_msg_size(MAX_SNMP_PACKET);
+    CHECK_EQUAL(CTarget().get_max_msg_size(), MAX_SNMP_PACKET);
+}
+
+void tst_snmpmsg()
+{
+    tst_notify_id();
+    tst_integers();
+    tst_max_size();
+    tst_target_size();
+}
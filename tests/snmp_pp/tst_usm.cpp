@@ -0,0 +1,491 @@
+/*
+    Copyright (C) 2004-2011 Martin Jolicoeur (snmpb1@gmail.com)
+
+    This file is part of the SnmpB project
+    (http://sourceforge.net/projects/snmpb)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "snmp_pp/snmp_pp.h"
+#include "snmp_pp/snmpmsg.h"
+#include "check.h"
+
+#ifdef SNMP_PP_NAMESPACE
+using namespace Snmp_pp;
+#endif
+
+#ifdef WIN32
+#define close_socket closesocket
+#else
+#define close_socket close
+#endif
+
+#ifdef _SNMPv3
+
+#define USM_TEST_ENTRIES 300
+
+// The tables delete an entry by moving their last entry into its
+// position. USM_TEST_ENTRIES entries are added, some of them deleted
+// from the middle and as many again added into the freed positions.
+// Then every entry has to be found through the indexes, the deleted
+// ones not.
+
+static OctetStr name(const char *prefix, const int i)
+{
+    char buf[32];
+    sprintf(buf, "%s%d", prefix, i);
+    return OctetStr(buf);
+}
+
+static OctetStr host(const int i)
+{
+    char buf[32];
+    sprintf(buf, "10.0.%d.%d", i / 250, i % 250 + 1);
+    return OctetStr(buf);
+}
+
+static bool deleted(const int i)
+{
+    return (i < USM_TEST_ENTRIES) &&
+           ((i % 3 == 1) || (i == USM_TEST_ENTRIES / 2));
+}
+
+// usmUserNameTable: user name <-> security name
+static void add_user_names(USM *usm, const int from, const int to)
+{
+    for (int i = from; i < to; i++)
+        CHECK_EQUAL(usm->add_usm_user(name("user", i), name("sec", i),
+                                      SNMP_AUTHPROTOCOL_NONE,
+                                      SNMP_PRIVPROTOCOL_NONE, "", ""),
+                    SNMPv3_USM_OK);
+}
+
+static void tst_user_names(USM *usm)
+{
+    add_user_names(usm, 0, USM_TEST_ENTRIES);
+    for (int i = 0; i < USM_TEST_ENTRIES; i++)
+        if (deleted(i))
+            usm->delete_usm_user(name("sec", i));
+    add_user_names(usm, USM_TEST_ENTRIES, 2 * USM_TEST_ENTRIES);
+
+    bool found = true, gone = true;
+    for (int i = 0; i < 2 * USM_TEST_ENTRIES; i++)
+    {
+        OctetStr user = name("user", i), sec = name("sec", i);
+        OctetStr security_name;
+        unsigned char user_name[64];
+        long int user_name_len = sizeof(user_name);
+
+        int by_user = usm->get_security_name(user.data(), user.len(),
+                                             security_name);
+        int by_sec = usm->get_user_name(user_name, &user_name_len,
+                                        sec.data(), sec.len());
+        const UsmUserNameTableEntry *entry = usm->get_user(sec);
+
+        if (deleted(i))
+        {
+            if ((by_user == SNMPv3_USM_OK) || (by_sec == SNMPv3_USM_OK) ||
+                entry)
+                gone = false;
+        }
+        else if ((by_user != SNMPv3_USM_OK) || !(security_name == sec) ||
+                 (by_sec != SNMPv3_USM_OK) ||
+                 !(OctetStr(user_name, user_name_len) == user) ||
+                 !entry || !(entry->usmUserName == user))
+            found = false;
+    }
+    CHECK(found);
+    CHECK(gone);
+
+    // a known user name replaces the security name of its entry
+    for (int i = 0; i < 2 * USM_TEST_ENTRIES; i++)
+        if (!deleted(i))
+            usm->add_usm_user(name("user", i), name("other", i),
+                              SNMP_AUTHPROTOCOL_NONE, SNMP_PRIVPROTOCOL_NONE,
+                              "", "");
+
+    bool replaced = true;
+    for (int i = 0; i < 2 * USM_TEST_ENTRIES; i++)
+    {
+        const UsmUserNameTableEntry *entry = usm->get_user(name("other", i));
+
+        if (usm->get_user(name("sec", i)) ||
+            (deleted(i) ? (entry != 0) :
+                          (!entry || !(entry->usmUserName == name("user", i)))))
+            replaced = false;
+    }
+    CHECK(replaced);
+
+    for (int i = 0; i < 2 * USM_TEST_ENTRIES; i++)
+        usm->delete_usm_user(name("other", i));
+    CHECK(usm->peek_first_user() == 0);
+}
+
+// usmUserTable: localized users, indexed by engine id and security
+// name and by engine id and user name
+static void add_localized_users(USM *usm, const int from, const int to)
+{
+    for (int i = from; i < to; i++)
+        for (int u = 2 * i; u < 2 * i + 2; u++)
+            CHECK_EQUAL(usm->add_localized_user(name("engine", i),
+                                                name("luser", u),
+                                                name("lsec", u),
+                                                SNMP_AUTHPROTOCOL_NONE, "",
+                                                SNMP_PRIVPROTOCOL_NONE, ""),
+                        SNMPv3_USM_OK);
+}
+
+static void tst_localized_users(USM *usm)
+{
+    int before = usm->get_user_count();
+    int removed = 0;
+
+    add_localized_users(usm, 0, USM_TEST_ENTRIES);
+    CHECK_EQUAL(usm->get_user_count(), before + 2 * USM_TEST_ENTRIES);
+
+    // one or both users of an engine id
+    for (int i = 0; i < USM_TEST_ENTRIES; i++)
+        if (deleted(i))
+        {
+            usm->delete_localized_user(name("engine", i), name("luser", 2 * i));
+            removed++;
+            if (!(i & 1))
+            {
+                usm->delete_localized_user(name("engine", i),
+                                           name("luser", 2 * i + 1));
+                removed++;
+            }
+        }
+    add_localized_users(usm, USM_TEST_ENTRIES, 2 * USM_TEST_ENTRIES);
+    CHECK_EQUAL(usm->get_user_count(),
+                before + 4 * USM_TEST_ENTRIES - removed);
+
+    bool found = true, gone = true;
+    for (int i = 0; i < 2 * USM_TEST_ENTRIES; i++)
+        for (int u = 2 * i; u < 2 * i + 2; u++)
+        {
+            OctetStr engine = name("engine", i);
+            OctetStr luser = name("luser", u), lsec = name("lsec", u);
+            OctetStr security_name;
+            unsigned char user_name[64];
+            long int user_name_len = sizeof(user_name);
+
+            struct UsmUser *user = usm->get_user(engine, lsec);
+            int by_user = usm->get_security_name(luser.data(), luser.len(),
+                                                 security_name);
+            int by_sec = usm->get_user_name(user_name, &user_name_len,
+                                            lsec.data(), lsec.len());
+
+            if (deleted(i) && (!(u & 1) || !(i & 1)))
+            {
+                if (user || (by_user == SNMPv3_USM_OK) ||
+                    (by_sec == SNMPv3_USM_OK))
+                    gone = false;
+            }
+            else if (!user ||
+                     !(OctetStr(user->engineID, user->engineIDLength) ==
+                       engine) ||
+                     !(OctetStr(user->usmUserName, user->usmUserNameLength)
+                       == luser) ||
+                     (by_user != SNMPv3_USM_OK) ||
+                     !(security_name == lsec) ||
+                     (by_sec != SNMPv3_USM_OK) ||
+                     !(OctetStr(user_name, user_name_len) == luser))
+                found = false;
+            if (user)
+                usm->free_user(user);
+        }
+    CHECK(found);
+    CHECK(gone);
+
+    for (int i = 0; i < 2 * USM_TEST_ENTRIES; i++)
+        for (int u = 2 * i; u < 2 * i + 2; u++)
+            usm->delete_localized_user(name("engine", i), name("luser", u));
+    CHECK_EQUAL(usm->get_user_count(), before);
+}
+
+// USM time table: one entry per engine, added when the first message
+// with authentication is built for the engine
+static void add_engine_times(USM *usm, const int from, const int to)
+{
+    Pdu pdu;
+    Vb vb(Oid("1.3.6.1.2.1.1.1.0"));
+
+    pdu += vb;
+    pdu.set_type(sNMP_PDU_GET);
+    pdu.set_security_level(SNMP_SECURITY_LEVEL_AUTH_NOPRIV);
+
+    for (int i = from; i < to; i++)
+    {
+        SnmpMessage msg;
+        OctetStr engine = name("time", i);
+
+        usm->add_localized_user(engine, "tuser", "tuser",
+                                SNMP_AUTHPROTOCOL_HMACMD5,
+                                "0123456789abcdef",
+                                SNMP_PRIVPROTOCOL_NONE, "");
+        pdu.set_request_id(i + 1);
+        pdu.set_context_engine_id(engine);
+        CHECK_EQUAL(msg.loadv3(pdu, engine, "tuser",
+                               SNMP_SECURITY_MODEL_USM, version3),
+                    SNMP_CLASS_SUCCESS);
+    }
+}
+
+static void tst_engine_times(USM *usm)
+{
+    add_engine_times(usm, 0, USM_TEST_ENTRIES);
+    for (int i = 0; i < USM_TEST_ENTRIES; i++)
+        if (deleted(i))
+            usm->remove_time_information(name("time", i));
+    add_engine_times(usm, USM_TEST_ENTRIES, 2 * USM_TEST_ENTRIES);
+
+    bool found = true, gone = true;
+    for (int i = 0; i < 2 * USM_TEST_ENTRIES; i++)
+    {
+        long int boots, time;
+        int status = usm->get_time(name("time", i), &boots, &time);
+
+        if (deleted(i))
+        {
+            if (status != SNMPv3_USM_UNKNOWN_ENGINEID)
+                gone = false;
+        }
+        else if (status != SNMPv3_USM_OK)
+            found = false;
+    }
+    CHECK(found);
+    CHECK(gone);
+
+    // the local engine stays at the first position
+    long int boots, time;
+    CHECK_EQUAL(usm->get_time(usm->get_local_engine_id(), &boots, &time),
+                SNMPv3_USM_OK);
+    CHECK_EQUAL(boots, 1);
+
+    usm->delete_localized_user("tuser");
+}
+
+// v3MP engine id table: engine id <-> host and port
+static void add_engine_ids(v3MP &mp, const int from, const int to)
+{
+    for (int i = from; i < to; i++)
+        CHECK_EQUAL(mp.add_to_engine_id_table(name("peer", i), host(i), 161),
+                    SNMPv3_MP_OK);
+}
+
+static void tst_engine_ids(v3MP &mp)
+{
+    add_engine_ids(mp, 0, USM_TEST_ENTRIES);
+    for (int i = 0; i < USM_TEST_ENTRIES; i++)
+        if (deleted(i))
+        {
+            if (i & 1)
+                mp.remove_from_engine_id_table(host(i), 161);
+            else
+                mp.remove_from_engine_id_table(name("peer", i));
+        }
+    add_engine_ids(mp, USM_TEST_ENTRIES, 2 * USM_TEST_ENTRIES);
+
+    bool found = true, gone = true;
+    for (int i = 0; i < 2 * USM_TEST_ENTRIES; i++)
+    {
+        OctetStr by_host, by_hostport;
+        OctetStr hostport = host(i);
+
+        hostport += "/161";
+
+        int status = mp.get_from_engine_id_table(by_host, host(i), 161);
+        int status2 = mp.get_from_engine_id_table(by_hostport, hostport);
+
+        if (deleted(i))
+        {
+            if ((status == SNMPv3_MP_OK) || (status2 == SNMPv3_MP_OK))
+                gone = false;
+        }
+        else if ((status != SNMPv3_MP_OK) || (status2 != SNMPv3_MP_OK) ||
+                 !(by_host == name("peer", i)) ||
+                 !(by_hostport == name("peer", i)))
+            found = false;
+    }
+    CHECK(found);
+    CHECK(gone);
+
+    CHECK_EQUAL(mp.reset_engine_id_table(), SNMPv3_MP_OK);
+}
+#endif
+
+// Reports to an inform that is not accepted. The request id in the
+// report is taken from the scoped PDU, if the USM could read it.
+static const unsigned char reqid_ber[] = { 0x02, 0x04, 0x12, 0x34, 0x56, 0x78 };
+static const unsigned char no_reqid_ber[] = { 0x02, 0x01, 0x00 };
+static const unsigned char unknown_user_ber[] =
+    { 0x06, 0x0a, 0x2b, 0x06, 0x01, 0x06, 0x03, 0x0f, 0x01, 0x01, 0x03, 0x00 };
+static const unsigned char invalid_msgs_ber[] =
+    { 0x06, 0x0a, 0x2b, 0x06, 0x01, 0x06, 0x03, 0x0b, 0x02, 0x01, 0x02, 0x00 };
+static const unsigned char decryption_error_ber[] =
+    { 0x06, 0x0a, 0x2b, 0x06, 0x01, 0x06, 0x03, 0x0f, 0x01, 0x01, 0x06, 0x00 };
+
+static bool contains(const unsigned char *data, int len,
+                     const unsigned char *what, int what_len)
+{
+    for (int i = 0; i + what_len <= len; i++)
+        if (!memcmp(data + i, what, what_len))
+            return true;
+    return false;
+}
+
+// Receive msg through the session, the report goes to sock
+static int report_for(Snmp &snmp, SnmpSocket sock, const UdpAddress &from,
+                      SnmpMessage &msg, unsigned char *report)
+{
+    SnmpMessage in;
+    Pdu pdu;
+    snmp_version version;
+    OctetStr engine_id, security_name;
+    long int security_model;
+    UdpAddress from_address(from);
+
+    in.load(msg.data(), msg.len());
+    CHECK(in.unloadv3(pdu, version, engine_id, security_name,
+                      security_model, from_address, snmp) !=
+          SNMP_CLASS_SUCCESS);
+
+    fd_set fds;
+    struct timeval tv = { 2, 0 };
+
+    FD_ZERO(&fds);
+    FD_SET(sock, &fds);
+    if (select((int)sock + 1, &fds, 0, 0, &tv) <= 0)
+        return 0;
+    return (int)recv(sock, (char *)report, MAX_SNMP_PACKET, 0);
+}
+
+static void tst_reports(USM *usm)
+{
+    int status;
+    Snmp snmp(status);
+    const OctetStr engine = usm->get_local_engine_id();
+    unsigned char report[MAX_SNMP_PACKET];
+
+    CHECK_EQUAL(status, SNMP_CLASS_SUCCESS);
+
+    // the reports are sent to this socket
+    SnmpSocket sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(sock, (struct sockaddr *)&addr, sizeof(addr));
+    getsockname(sock, (struct sockaddr *)&addr, &addr_len);
+
+    UdpAddress from("127.0.0.1");
+    from.set_port(ntohs(addr.sin_port));
+
+    Pdu pdu;
+    Vb vb(Oid("1.3.6.1.2.1.1.3.0"));
+
+    vb.set_value(TimeTicks(42));
+    pdu += vb;
+    pdu.set_type(sNMP_PDU_INFORM);
+    pdu.set_request_id(0x12345678);
+    pdu.set_context_engine_id(engine);
+
+    // a user that is gone when the inform arrives
+    SnmpMessage unknown;
+
+    usm->add_localized_user(engine, "ghost", "ghost", SNMP_AUTHPROTOCOL_NONE,
+                            "", SNMP_PRIVPROTOCOL_NONE, "");
+    pdu.set_security_level(SNMP_SECURITY_LEVEL_NOAUTH_NOPRIV);
+    CHECK_EQUAL(unknown.loadv3(pdu, engine, "ghost",
+                               SNMP_SECURITY_MODEL_USM, version3),
+                SNMP_CLASS_SUCCESS);
+    usm->delete_localized_user(engine, "ghost");
+
+    int len = report_for(snmp, sock, from, unknown, report);
+    CHECK(len > 0);
+    CHECK(contains(report, len, unknown_user_ber, sizeof(unknown_user_ber)));
+    CHECK(contains(report, len, reqid_ber, sizeof(reqid_ber)));
+
+    // an encrypted inform that is accepted, its scoped PDU buffer is
+    // freed with the request id in it
+    SnmpMessage encrypted, in;
+    Pdu accepted;
+    snmp_version version;
+    OctetStr engine_id, security_name;
+    long int security_model;
+    UdpAddress from_address(from);
+
+    usm->add_localized_user(engine, "spy", "spy", SNMP_AUTHPROTOCOL_HMACMD5,
+                            "0123456789abcdef", SNMP_PRIVPROTOCOL_DES,
+                            "0123456789abcdef");
+    pdu.set_security_level(SNMP_SECURITY_LEVEL_AUTH_PRIV);
+    CHECK_EQUAL(encrypted.loadv3(pdu, engine, "spy",
+                                 SNMP_SECURITY_MODEL_USM, version3),
+                SNMP_CLASS_SUCCESS);
+    in.load(encrypted.data(), encrypted.len());
+    CHECK_EQUAL(in.unloadv3(accepted, version, engine_id, security_name,
+                            security_model, from_address, snmp),
+                SNMP_CLASS_SUCCESS);
+    CHECK_EQUAL(accepted.get_request_id(), 0x12345678);
+
+    // the same inform when the privacy protocol of the user is not
+    // known: nothing is read from the scoped PDU buffer
+    usm->delete_localized_user(engine, "spy");
+    usm->add_localized_user(engine, "spy", "spy", SNMP_AUTHPROTOCOL_HMACMD5,
+                            "0123456789abcdef", 99, "0123456789abcdef");
+
+    len = report_for(snmp, sock, from, encrypted, report);
+    CHECK(len > 0);
+    CHECK(contains(report, len, invalid_msgs_ber, sizeof(invalid_msgs_ber)));
+    CHECK(!contains(report, len, reqid_ber, sizeof(reqid_ber)));
+    CHECK(contains(report, len, no_reqid_ber, sizeof(no_reqid_ber)));
+
+    // a privacy key that changed: the decrypted scoped PDU is not used
+    usm->delete_localized_user(engine, "spy");
+    usm->add_localized_user(engine, "spy", "spy", SNMP_AUTHPROTOCOL_HMACMD5,
+                            "0123456789abcdef", SNMP_PRIVPROTOCOL_DES,
+                            "fedcba9876543210");
+
+    len = report_for(snmp, sock, from, encrypted, report);
+    CHECK(len > 0);
+    CHECK(contains(report, len,
+                   decryption_error_ber, sizeof(decryption_error_ber)));
+    CHECK(!contains(report, len, reqid_ber, sizeof(reqid_ber)));
+    CHECK(contains(report, len, no_reqid_ber, sizeof(no_reqid_ber)));
+
+    usm->delete_localized_user(engine, "spy");
+    close_socket(sock);
+}
+
+void tst_usm()
+{
+#ifdef _SNMPv3
+    int status;
+    v3MP mp("tst_usm", 1, status);
+
+    CHECK_EQUAL(status, SNMPv3_MP_OK);
+    tst_user_names(mp.get_usm());
+    tst_localized_users(mp.get_usm());
+    tst_engine_times(mp.get_usm());
+    tst_engine_ids(mp);
+    tst_reports(mp.get_usm());
+#endif
+}
@@ -0,0 +1,5 @@
+TEMPLATE = subdirs
+
+SUBDIRS = snmp_pp \
+          bench \
+          trapsearch
@@ -0,0 +1,15 @@
+# Tests of the trap history indexes and search, run with "make check"
+
+QT             += testlib widgets
+TEMPLATE	= app
+TARGET          = tst_trapsearch
+CONFIG         += console testcase
+CONFIG         -= app_bundle
+
+include(../snmp_pp.pri)
+
+HEADERS	+= ../../trapsearch.h
+
+SOURCES	+= \
+    tst_trapsearch.cpp \
+    ../../trapsearch.cpp
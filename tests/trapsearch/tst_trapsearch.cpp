@@ -0,0 +1,215 @@
+/*
+    Copyright (C) 2004-2011 Martin Jolicoeur (snmpb1@gmail.com)
+
+    This file is part of the SnmpB project
+    (http://sourceforge.net/projects/snmpb)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+
+#include <QtTest/QtTest>
+
+#include "trapsearch.h"
+
+// Access to the size of the words index
+class WordsHistory: public TrapHistory
+{
+public:
+    int WordCount(void) { return words.size(); };
+};
+
+class TestTrapSearch: public QObject
+{
+    Q_OBJECT
+
+private:
+    TrapPostings Search(TrapHistory &history, const trap_query &q);
+    void AddTrap(TrapHistory &history, const char *source);
+    void AddValueTrap(TrapHistory &history, const QString &value);
+
+private slots:
+    void SourcePrefix_data();
+    void SourcePrefix();
+    void SearchNetwork();
+    void Indexed_data();
+    void Indexed();
+    void WordsPerTrap();
+    void DistinctWords();
+};
+
+TrapPostings TestTrapSearch::Search(TrapHistory &history,
+                                    const trap_query &q)
+{
+    TrapSearchThread search(&history, NULL);
+    QSignalSpy spy(&search, SIGNAL(SearchResults(TrapPostings)));
+    TrapPostings found;
+
+    search.Search(q);
+    search.wait();
+
+    for (int i = 0; i < spy.count(); i++)
+        found += spy.at(i).at(0).value<TrapPostings>();
+    std::sort(found.begin(), found.end());
+
+    return found;
+}
+
+void TestTrapSearch::AddTrap(TrapHistory &history, const char *source)
+{
+    Pdu pdu;
+
+    history.Add(NULL, history.Count(), IpAddress(source),
+                Oid("1.3.6.1.6.3.1.1.5.3"), pdu);
+}
+
+void TestTrapSearch::AddValueTrap(TrapHistory &history, const QString &value)
+{
+    Pdu pdu;
+    Vb vb(Oid("1.3.6.1.2.1.1.1.0"));
+
+    vb.set_value(OctetStr(value.toLatin1().data()));
+    pdu += vb;
+    history.Add(NULL, history.Count(), IpAddress("10.0.0.1"),
+                Oid("1.3.6.1.6.3.1.1.5.3"), pdu);
+}
+
+void TestTrapSearch::SourcePrefix_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<bool>("valid");
+    QTest::addColumn<QString>("network");
+    QTest::addColumn<int>("bits");
+
+    QTest::newRow("canonical") << "10.2.0.0/16" << true << "10.2.0.0" << 112;
+    QTest::newRow("host bits") << "10.2.3.4/16" << true << "10.2.0.0" << 112;
+    QTest::newRow("odd length") << "10.2.255.4/17" << true << "10.2.128.0"
+                                << 113;
+    QTest::newRow("host") << "10.2.3.4" << true << "10.2.3.4" << 128;
+    QTest::newRow("all") << "10.2.3.4/0" << true << "0.0.0.0" << 96;
+    QTest::newRow("ipv6") << "2001:db8::1:2/32" << true << "2001:db8::"
+                          << 32;
+    QTest::newRow("too long") << "10.2.3.4/33" << false << "" << 0;
+    QTest::newRow("bad length") << "10.2.3.4/x" << false << "" << 0;
+    QTest::newRow("no address") << "/16" << false << "" << 0;
+}
+
+void TestTrapSearch::SourcePrefix()
+{
+    QFETCH(QString, text);
+    QFETCH(bool, valid);
+    QFETCH(QString, network);
+    QFETCH(int, bits);
+
+    QByteArray key;
+    int b = -1;
+
+    QCOMPARE(TrapHistory::SourcePrefix(text, key, b), valid);
+    if (valid)
+    {
+        QCOMPARE(key, TrapHistory::AddressKey(
+                          IpAddress(network.toLatin1().data())));
+        QCOMPARE(b, bits);
+    }
+}
+
+// A network given by one of its hosts finds the addresses below it
+void TestTrapSearch::SearchNetwork()
+{
+    TrapHistory history;
+    trap_query q;
+
+    AddTrap(history, "10.1.255.255");
+    AddTrap(history, "10.2.0.0");
+    AddTrap(history, "10.2.3.3");
+    AddTrap(history, "10.2.3.4");
+    AddTrap(history, "10.2.255.255");
+    AddTrap(history, "10.3.0.0");
+
+    q.since = -1;
+    q.until = -1;
+    QVERIFY(TrapHistory::SourcePrefix("10.2.3.4/16", q.source,
+                                      q.source_bits));
+
+    TrapPostings expected;
+    expected << 1 << 2 << 3 << 4;
+    QCOMPARE(Search(history, q), expected);
+}
+
+void TestTrapSearch::Indexed_data()
+{
+    QTest::addColumn<QString>("word");
+    QTest::addColumn<bool>("indexed");
+
+    QTest::newRow("name") << "gigabitethernet0/7" << true;
+    QTest::newRow("small number") << "123456" << true;
+    QTest::newRow("small negative") << "-123456" << true;
+    QTest::newRow("counter") << "1234567" << false;
+    QTest::newRow("negative") << "-1234567" << false;
+    QTest::newRow("address") << "10.2.3.4" << true;
+    QTest::newRow("short hex") << "0a1b2c3" << true;
+    QTest::newRow("hex") << "0a1b2c3d" << false;
+    QTest::newRow("hex word") << "deadbeef" << true;
+    QTest::newRow("long word") << QString(TRAP_INDEX_MAX_LENGTH + 1, 'x')
+                               << false;
+}
+
+void TestTrapSearch::Indexed()
+{
+    QFETCH(QString, word);
+    QFETCH(bool, indexed);
+
+    QCOMPARE(TrapHistory::Indexed(word), indexed);
+}
+
+// Unique ids are not indexed and only the first words of a trap are
+void TestTrapSearch::WordsPerTrap()
+{
+    WordsHistory history;
+    QString value;
+
+    for (int i = 0; i < 2 * TRAP_INDEX_MAX_WORDS; i++)
+        value += QString("word%1 %2 ").arg(i).arg(10000000 + i);
+    AddValueTrap(history, value);
+
+    QCOMPARE(history.WordCount(), TRAP_INDEX_MAX_WORDS);
+}
+
+// New words are not indexed anymore once the index is full, the known
+// ones still are
+void TestTrapSearch::DistinctWords()
+{
+    WordsHistory history;
+    int n = 0;
+
+    while (n < TRAP_INDEX_MAX_DISTINCT + TRAP_INDEX_MAX_WORDS)
+    {
+        QString value("known");
+
+        for (int i = 1; i < TRAP_INDEX_MAX_WORDS; i++)
+            value += QString(" w%1").arg(n++);
+        AddValueTrap(history, value);
+    }
+    QCOMPARE(history.WordCount(), TRAP_INDEX_MAX_DISTINCT);
+
+    trap_query q;
+    q.since = -1;
+    q.until = -1;
+    q.words << "known";
+    QCOMPARE(Search(history, q).size(), history.Count());
+}
+
+QTEST_MAIN(TestTrapSearch)
+#include "tst_trapsearch.moc"
@@ -24,24 +24,90 @@
 #include "agent.h"
 #include "preferences.h"
 
-TrapItem::TrapItem(Oid &id, QTreeWidget *parent, const QStringList &values,
-                   QString community, QString seclevel, 
-                   QString ctxname, QString ctxid, QString msgid, bool expand):
-                   QTreeWidgetItem(parent, values)
+QHash<QString, unsigned int> TrapStrings::index;
+QVector<QString> TrapStrings::strings;
+
+unsigned int TrapStrings::Intern(const QString &str)
 {
-    oid = id;
-    
-    _community = community;
-    _seclevel = seclevel;
-    _ctxname = ctxname;
-    _ctxid = ctxid;
-    _msgid = msgid;
+    QHash<QString, unsigned int>::const_iterator i = index.find(str);
+    if (i != index.end())
+        return i.value();
+
+    unsigned int id = strings.size();
+    strings.append(str);
+    index.insert(str, id);
+    return id;
+}
 
+const QString &TrapStrings::Get(unsigned int id)
+{
+    return strings.at(id);
+}
+
+// Length of a BER header (tag and length octets)
+static int ber_header_len(const unsigned char *data)
+{
+    return (data[1] & ASN_LONG_LEN) ? 2 + (data[1] & ~ASN_LONG_LEN) : 2;
+}
+
+TrapItem::TrapItem(Oid &id, QTreeWidget *parent, const trap_info &info,
+                   bool expand):QTreeWidgetItem(parent, UserType)
+{
+    _nbr = info.nbr;
+    _timestamp = info.timestamp;
+    _received = info.received;
+
+    _oid = TrapStrings::Intern(id.get_printable());
+    _nottype = TrapStrings::Intern(info.nottype);
+    _msgtype = TrapStrings::Intern(info.msgtype);
+    _version = TrapStrings::Intern(info.version);
+    _agtaddr = TrapStrings::Intern(info.agtaddr);
+    _community = TrapStrings::Intern(info.community);
+    _seclevel = TrapStrings::Intern(info.seclevel);
+    _ctxname = TrapStrings::Intern(info.ctxname);
+    _ctxid = TrapStrings::Intern(info.ctxid);
+
+    _msgid = info.msgid;
+    _agtport = info.agtport;
     _expand = expand;
 }
 
+// Column texts are built when the view asks for them
+QVariant TrapItem::data(int column, int role) const
+{
+    if (role != Qt::DisplayRole)
+        return QTreeWidgetItem::data(column, role);
+
+    switch(column)
+    {
+    case 0:
+        return QString("%1").arg(_nbr, 4, 10, QChar('0'));
+    case 1:
+        return QDateTime::fromMSecsSinceEpoch(_received).date()
+               .toString(Qt::ISODate);
+    case 2:
+        return QDateTime::fromMSecsSinceEpoch(_received).time()
+               .toString(Qt::ISODate);
+    case 3:
+        return QString(TimeTicks(_timestamp).get_printable());
+    case 4:
+        return TrapStrings::Get(_nottype);
+    case 5:
+        return TrapStrings::Get(_msgtype);
+    case 6:
+        return TrapStrings::Get(_version);
+    case 7:
+        return TrapStrings::Get(_agtaddr);
+    case 8:
+        return QString("%1").arg(_agtport);
+    default:
+        return QVariant();
+    }
+}
+
 void TrapItem::PrintProperties(QString &text)
 {
+    Oid oid(TrapStrings::Get(_oid).toLatin1().data());
     int oidlen = oid.len();
 
     if (oidlen <= 0)
@@ -92,20 +158,25 @@ void TrapItem::PrintContent(QTreeWidget *TrapContent)
 {
     TrapContent->clear();
 
-    QString com_title = QString("Community: %1").arg(_community);
+    QString com_title = QString("Community: %1")
+                        .arg(TrapStrings::Get(_community));
     new QTreeWidgetItem(TrapContent, QStringList(com_title));
+
+    Pdu pdu;
+    GetVarBinds(pdu);
      
-    QString bd_title = QString("Bindings (%1)").arg(content.count());
+    QString bd_title = QString("Bindings (%1)").arg(pdu.get_vb_count());
     QTreeWidgetItem *bd = new QTreeWidgetItem(TrapContent, QStringList(bd_title));
     bd->setExpanded(_expand);
  
-    Vb *vb;
+    Vb v;
+    Vb *vb = &v;
     Oid id;
     QString bd_val;
    
-    for (int i = 0; i < content.count(); i++) 
+    for (int i = 0; i < pdu.get_vb_count(); i++) 
     {    
-        vb = content[i];
+        pdu.get_vb(v, i);
         bd_val = QString("");
         vb->get_oid(id);
         
@@ -136,9 +207,44 @@ void TrapItem::PrintContent(QTreeWidget *TrapContent)
     }
 }
 
-void TrapItem::AddVarBind(Vb& vb)
+void TrapItem::SetVarBinds(const Pdu &pdu)
 {
-    content.append(new Vb(vb));
+    // Received varbinds are kept in the encoding they arrived in
+    VbView view;
+    QByteArray ber;
+    int i;
+    for (i = 0; (i < pdu.get_vb_count()) && pdu.get_vb_view(view, i); i++)
+        ber.append((const char *)view.get_ber(), view.get_ber_len());
+    if (i == pdu.get_vb_count())
+    {
+        _varbinds = ber;
+        return;
+    }
+
+    // Otherwise let snmp++ encode the varbinds in a response message and
+    // only keep the contents of the varbind list
+    Pdu p = pdu;
+    p.set_type(sNMP_PDU_RESPONSE);
+    p.set_request_id(0);
+    p.set_error_status(0);
+    p.set_error_index(0);
+
+    SnmpMessage msg;
+    if (msg.load(p, OctetStr(""), version2c) != SNMP_CLASS_SUCCESS)
+        return;
+
+    unsigned char *data = msg.data();
+    int skip = ber_header_len(data) + 5;       // message, version, community
+    skip += ber_header_len(data + skip) + 9;   // pdu, request id, errors
+    skip += ber_header_len(data + skip);       // varbind list
+
+    _varbinds = QByteArray((const char *)data + skip, msg.len() - skip);
+}
+
+bool TrapItem::GetVarBinds(Pdu &pdu)
+{
+    return pdu.set_vblist_ber((const unsigned char *)_varbinds.constData(),
+                              _varbinds.size());
 }
    
 Trap::Trap(Snmpb *snmpb)
@@ -153,27 +259,341 @@ Trap::Trap(Snmpb *snmpb)
              this, SLOT( SelectedTrap( QTreeWidgetItem *, QTreeWidgetItem * ) ) );
     connect( this, SIGNAL(TrapProperties(const QString&)),
              (QObject*)s->MainUI()->TrapInfo, SLOT(setHtml(const QString&)) );
+
+    // Trap history search
+    found = 0;
+    search = new TrapSearchThread(&history, this);
+    s->MainUI()->TrapSearchResults->hide();
+
+    connect( s->MainUI()->TrapSearchResults, 
+             SIGNAL( currentItemChanged( QTreeWidgetItem *, QTreeWidgetItem * ) ),
+             this, SLOT( SelectedTrap( QTreeWidgetItem *, QTreeWidgetItem * ) ) );
+    connect( s->MainUI()->TrapSearch, SIGNAL( returnPressed() ), 
+             this, SLOT( Search() ));
+    connect( s->MainUI()->TrapSearchButton, SIGNAL( clicked() ), 
+             this, SLOT( Search() ));
+    connect( s->MainUI()->TrapSearchStop, SIGNAL( clicked() ), 
+             this, SLOT( StopSearch() ));
+    connect( s->MainUI()->TrapSearchClear, SIGNAL( clicked() ), 
+             this, SLOT( ClearSearch() ));
+    connect( search, SIGNAL( SearchResults(TrapPostings) ), 
+             this, SLOT( SearchResults(TrapPostings) ));
+    connect( search, SIGNAL( finished() ), 
+             this, SLOT( SearchFinished() ));
+    connect( qApp, SIGNAL( aboutToQuit() ), this, SLOT( StopSearch() ));
+
+    // Trap export sinks
+    exporter = new TrapExporter(this);
+    ConfigureExport();
+    connect( qApp, SIGNAL( aboutToQuit() ), exporter, SLOT( Shutdown() ));
 }
 
-TrapItem *Trap::Add(Oid &id, const QStringList &values,
-                    QString &community, QString &seclevel,
-                    QString &ctxname, QString &ctxid, QString &msgid)
+TrapItem *Trap::Add(Oid &id, const trap_info &info, const Pdu &pdu)
 {
     // Create the trap item
-    TrapItem *ti = new TrapItem(id, s->MainUI()->TrapLog, 
-                                values, community, seclevel, 
-                                ctxname, ctxid, msgid,
+    TrapItem *ti = new TrapItem(id, s->MainUI()->TrapLog, info,
                                 s->PreferencesObj()->GetExpandTrapBinding());
+    ti->SetVarBinds(pdu);
+
+    history.Add(ti, info.received, info.agent, id, pdu);
+
+    if (exporter->IsEnabled())
+        Export(id, info, pdu);
     
     return (ti);
 }
 
+void Trap::ConfigureExport(void)
+{
+    trap_export_config cfg;
+
+    s->PreferencesObj()->GetTrapExport(cfg);
+    exporter->Configure(cfg);
+}
+
+void Trap::GetExportStats(QString &text)
+{
+    exporter->GetStats(text);
+}
+
+static const char *syntax_name(SmiUINT32 syntax)
+{
+    switch(syntax)
+    {
+    case sNMP_SYNTAX_INT: return "Integer32";
+    case sNMP_SYNTAX_BITS: return "BITS";
+    case sNMP_SYNTAX_OCTETS: return "OCTET STRING";
+    case sNMP_SYNTAX_NULL: return "NULL";
+    case sNMP_SYNTAX_OID: return "OBJECT IDENTIFIER";
+    case sNMP_SYNTAX_IPADDR: return "IpAddress";
+    case sNMP_SYNTAX_CNTR32: return "Counter32";
+    case sNMP_SYNTAX_GAUGE32: return "Gauge32";
+    case sNMP_SYNTAX_TIMETICKS: return "TimeTicks";
+    case sNMP_SYNTAX_OPAQUE: return "Opaque";
+    case sNMP_SYNTAX_CNTR64: return "Counter64";
+    case sNMP_SYNTAX_NOSUCHOBJECT: return "noSuchObject";
+    case sNMP_SYNTAX_NOSUCHINSTANCE: return "noSuchInstance";
+    case sNMP_SYNTAX_ENDOFMIBVIEW: return "endOfMibView";
+    default: return "Unknown";
+    }
+}
+
+// Format the trap once, in this thread as libsmi is not thread safe,
+// and queue it to the export sinks
+void Trap::Export(Oid &id, const trap_info &info, const Pdu &pdu)
+{
+    trap_record r;
+    IpAddress agent(info.agent);
+
+    r.received = info.received;
+    r.nbr = info.nbr;
+    r.timestamp = info.timestamp;
+    r.notification = id.get_printable();
+    r.name = info.nottype;
+    r.msgtype = info.msgtype;
+    r.version = info.version;
+    r.agent = agent.get_printable();
+    r.port = info.agtport;
+    r.community = info.community;
+    r.seclevel = info.seclevel;
+    r.ctxname = info.ctxname;
+    r.ctxid = info.ctxid;
+    r.msgid = info.msgid;
+
+    Vb vb;
+    Oid vbid;
+
+    for (int i = 0; i < pdu.get_vb_count(); i++)
+    {
+        trap_record_vb v;
+
+        pdu.get_vb(vb, i);
+        vb.get_oid(vbid);
+        v.oid = vb.get_printable_oid();
+        v.type = syntax_name(vb.get_syntax());
+
+        SmiNode *node = Agent::GetNodeFromOid(vbid);
+        if (node)
+        {
+            char *b = smiRenderOID(node->oidlen, node->oid, 
+                                   SMI_RENDER_NUMERIC);
+            char *f = (char*)vb.get_printable_oid();
+            while ((*b++ == *f++) && (*b != '\0') && (*f != '\0')) ;
+            /* f is now the remaining part */
+
+            v.name = node->name;
+            if (*f != '\0') v.name += QString(f);
+            v.value = Agent::GetPrintableValue(node, &vb);
+        }
+        else
+            v.value = vb.get_printable_value();
+
+        r.varbinds.append(v);
+    }
+
+    exporter->Export(r);
+}
+
 void Trap::SelectedTrap(QTreeWidgetItem * item, QTreeWidgetItem *)
 {
     TrapItem *trap = (TrapItem*)item;
     QString text;
+
+    if (!trap)
+        return;
     
     trap->PrintContent(s->MainUI()->TrapContent);
     trap->PrintProperties(text);
     emit TrapProperties(text);
 }
+
+// Query syntax: space separated criteria, all of which must match
+//   type:<name|oid>[,<name|oid>...]  notification type (OID prefix)
+//   from:<address>[/<prefix length>] agent address
+//   last:<n>s|m|h|d                  received in the last n seconds, ...
+//   since:<date>, until:<date>       ISO 8601 date and time
+//   value:<word>, <word>             word found in a varbind value
+bool Trap::ParseQuery(const QString &str, trap_query &q, QString &err)
+{
+    QStringList terms = str.split(QRegExp("\\s+"), QString::SkipEmptyParts);
+
+    q.since = -1;
+    q.until = -1;
+    q.source.clear();
+    q.source_bits = 0;
+    q.oids.clear();
+    q.words.clear();
+
+    for (int i = 0; i < terms.size(); i++)
+    {
+        int sep = terms[i].indexOf(':');
+        QString key = (sep > 0) ? terms[i].left(sep).toLower() : QString();
+        QString val = (sep > 0) ? terms[i].mid(sep+1) : terms[i];
+
+        if (key == "type")
+        {
+            QStringList types = val.split(',', QString::SkipEmptyParts);
+            for (int k = 0; k < types.size(); k++)
+            {
+                if (types[k].at(0).isDigit())
+                {
+                    Oid oid(types[k].toLatin1().data());
+                    if (!oid.valid())
+                    {
+                        err = QString("Invalid OID: %1").arg(types[k]);
+                        return false;
+                    }
+                    q.oids << TrapHistory::OidKey(oid.oidval()->ptr, 
+                                                  oid.len());
+                }
+                else
+                {
+                    SmiNode *node = smiGetNode(NULL, 
+                                               types[k].toLatin1().data());
+                    if (!node)
+                    {
+                        err = QString("Unknown notification type: %1")
+                                      .arg(types[k]);
+                        return false;
+                    }
+                    QVector<unsigned long> subids(node->oidlen);
+                    for (unsigned int n = 0; n < node->oidlen; n++)
+                        subids[n] = node->oid[n];
+                    q.oids << TrapHistory::OidKey(subids.data(), 
+                                                  node->oidlen);
+                }
+            }
+        }
+        else if (key == "from")
+        {
+            if (!TrapHistory::SourcePrefix(val, q.source, q.source_bits))
+            {
+                err = QString("Invalid address: %1").arg(val);
+                return false;
+            }
+        }
+        else if (key == "last")
+        {
+            static const QString units("smhd");
+            static const qint64 msecs[] = { 1000, 60000, 3600000, 86400000 };
+            bool ok = false;
+            int u = val.isEmpty() ? -1 : units.indexOf(val.at(val.size()-1));
+            qint64 n = val.left(val.size()-1).toLongLong(&ok);
+
+            if ((u < 0) || !ok)
+            {
+                err = QString("Invalid duration: %1").arg(val);
+                return false;
+            }
+            q.since = QDateTime::currentMSecsSinceEpoch() - n * msecs[u];
+        }
+        else if ((key == "since") || (key == "until"))
+        {
+            QDateTime d = QDateTime::fromString(val, Qt::ISODate);
+            if (!d.isValid())
+            {
+                err = QString("Invalid date: %1").arg(val);
+                return false;
+            }
+            if (key == "since")
+                q.since = d.toMSecsSinceEpoch();
+            else
+                q.until = d.toMSecsSinceEpoch();
+        }
+        else if (key.isEmpty() || (key == "value"))
+        {
+            QStringList w;
+            TrapHistory::Words(val, w);
+            for (int k = 0; k < w.size(); k++)
+            {
+                if (!TrapHistory::Indexed(w[k]))
+                {
+                    err = QString("Long numbers and hex strings are not "
+                                  "indexed: %1").arg(w[k]);
+                    return false;
+                }
+            }
+            q.words << w;
+        }
+        else
+        {
+            err = QString("Unknown search criteria: %1").arg(key);
+            return false;
+        }
+    }
+
+    q.words.removeDuplicates();
+
+    return true;
+}
+
+void Trap::Search()
+{
+    trap_query q;
+    QString err;
+
+    if (ParseQuery(s->MainUI()->TrapSearch->text(), q, err) == false)
+    {
+        QMessageBox::warning ( NULL, "SnmpB", err, 
+                               QMessageBox::Ok, Qt::NoButton);
+        return;
+    }
+
+    // Cancel the previous search, if any
+    StopSearch();
+
+    found = 0;
+    s->MainUI()->TrapSearchResults->clear();
+    s->MainUI()->TrapLog->hide();
+    s->MainUI()->TrapSearchResults->show();
+    s->MainUI()->TrapLogL->setText("Searching...");
+    s->MainUI()->TrapSearchStop->setEnabled(true);
+    s->MainUI()->TrapSearchClear->setEnabled(true);
+
+    search->Search(q);
+}
+
+void Trap::StopSearch()
+{
+    search->Abort();
+    search->wait();
+
+    // Drop the results of the stopped search still in the event queue
+    QCoreApplication::removePostedEvents(this, QEvent::MetaCall);
+    SearchFinished();
+}
+
+void Trap::ClearSearch()
+{
+    StopSearch();
+
+    s->MainUI()->TrapSearchResults->clear();
+    s->MainUI()->TrapSearchResults->hide();
+    s->MainUI()->TrapLog->show();
+    s->MainUI()->TrapLogL->setText("Trap log");
+    found = 0;
+    s->MainUI()->TrapSearchClear->setEnabled(false);
+}
+
+// Results arrive newest first, in batches, while the search goes on
+void Trap::SearchResults(TrapPostings positions)
+{
+    QList<QTreeWidgetItem *> items;
+
+    for (int i = 0; i < positions.size(); i++)
+        items.append(new TrapItem(*history.Item(positions[i])));
+
+    s->MainUI()->TrapSearchResults->addTopLevelItems(items);
+
+    found += positions.size();
+    s->MainUI()->TrapLogL->setText(QString("Searching... %1 traps found")
+                                   .arg(found));
+}
+
+void Trap::SearchFinished()
+{
+    s->MainUI()->TrapSearchStop->setEnabled(false);
+    if (!s->MainUI()->TrapSearchResults->isHidden())
+        s->MainUI()->TrapLogL->setText(QString("Search results: %1 traps")
+                                       .arg(found));
+}
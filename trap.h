@@ -23,29 +23,77 @@
 #include "stdafx.h"
 
 #include "snmpb.h"
+#include "trapsearch.h"
+#include "trapexport.h"
+
+// Trap information collected from the received PDU
+typedef struct
+{
+    unsigned int nbr;
+    qint64 received;            // msecs since epoch
+    unsigned long timestamp;    // sysUpTime of the notification
+    QString nottype;
+    QString msgtype;
+    QString version;
+    QString agtaddr;
+    IpAddress agent;
+    unsigned short agtport;
+    QString community;
+    QString seclevel;
+    QString ctxname;
+    QString ctxid;
+    unsigned long msgid;
+} trap_info;
+
+// Strings repeated across traps (agents, communities, notification
+// types, ...) are stored once and referenced by index.
+class TrapStrings
+{
+public:
+    static unsigned int Intern(const QString &str);
+    static const QString &Get(unsigned int id);
+
+private:
+    static QHash<QString, unsigned int> index;
+    static QVector<QString> strings;
+};
 
 class TrapItem : public QTreeWidgetItem
 {
 public:
-    TrapItem(Oid &id, QTreeWidget *parent, const QStringList &values,
-             QString community, QString seclevel,
-             QString ctxname, QString ctxid, QString msgid, bool expand);
+    TrapItem(Oid &id, QTreeWidget *parent, const trap_info &info, 
+             bool expand);
 
+    QVariant data(int column, int role) const;
     void PrintProperties(QString &text);
     void PrintContent(QTreeWidget *TrapContent);
-    void AddVarBind(Vb& vb);
+    void SetVarBinds(const Pdu &pdu);
     
 private:
-    Oid oid;
-    QString _community;
-    QString _seclevel;
-    QString _ctxname;
-    QString _ctxid;
-    QString _msgid;
+    bool GetVarBinds(Pdu &pdu);
+
+private:
+    unsigned int _nbr;
+    unsigned int _timestamp;
+    qint64 _received;
+
+    // Interned strings
+    unsigned int _oid;
+    unsigned int _nottype;
+    unsigned int _msgtype;
+    unsigned int _version;
+    unsigned int _agtaddr;
+    unsigned int _community;
+    unsigned int _seclevel;
+    unsigned int _ctxname;
+    unsigned int _ctxid;
 
+    unsigned int _msgid;
+    unsigned short _agtport;
     bool _expand;
 
-    QList<Vb*> content;
+    // BER encoded varbinds, decoded when the trap is displayed
+    QByteArray _varbinds;
 };
 
 class Trap: public QObject
@@ -54,18 +102,33 @@ class Trap: public QObject
     
 public:
     Trap(Snmpb *snmpb);
-    TrapItem *Add(Oid &id, const QStringList &values,
-                  QString &community, QString &seclevel,
-                  QString &ctxname, QString &ctxid, QString &msgid);
+    TrapItem *Add(Oid &id, const trap_info &info, const Pdu &pdu);
+    void ConfigureExport(void);
+    void GetExportStats(QString &text);
     
+protected:
+    bool ParseQuery(const QString &str, trap_query &q, QString &err);
+    void Export(Oid &id, const trap_info &info, const Pdu &pdu);
+
 protected slots:
     void SelectedTrap( QTreeWidgetItem * item, QTreeWidgetItem * old);
+    void Search();
+    void StopSearch();
+    void ClearSearch();
+    void SearchResults(TrapPostings positions);
+    void SearchFinished();
     
 signals:
     void TrapProperties(const QString& text);
     
 private:
     Snmpb *s;
+
+    TrapHistory history;
+    TrapSearchThread *search;
+    int found;
+
+    TrapExporter *exporter;
 };
 
 #endif /* TRAP_H */
@@ -0,0 +1,612 @@
+/*
+    Copyright (C) 2004-2011 Martin Jolicoeur (snmpb1@gmail.com)
+
+    This file is part of the SnmpB project
+    (http://sourceforge.net/projects/snmpb)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef WIN32
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#endif
+
+#include "trapexport.h"
+
+// Minimum delay between attempts to reopen a failed sink
+#define TRAP_SINK_RETRY_MSEC 1000
+
+// Send timeout of the syslog socket, so that a stuck receiver cannot
+// block the sink thread forever
+#define TRAP_SYSLOG_TIMEOUT_MSEC 1000
+
+#define TRAP_SYSLOG_PORT 514
+
+// RFC 5426 allows more, but many receivers truncate beyond this
+#define TRAP_SYSLOG_MAX_MSG 8192
+
+// Severity of the messages: notice
+#define TRAP_SYSLOG_SEVERITY 5
+
+// Structured data ID. 32473 is the enterprise number reserved for
+// documentation (RFC 5612), as SnmpB has none of its own.
+#define TRAP_SYSLOG_SDID "snmp@32473"
+
+TrapSink::TrapSink(const QString &name, int capacity, QObject *parent)
+    :QThread(parent)
+{
+    sinkname = name;
+    this->capacity = capacity;
+    aborting = false;
+
+    stats.queued = 0;
+    stats.written = 0;
+    stats.dropped = 0;
+    stats.failed = 0;
+}
+
+// Called from the GUI thread for every trap: must never wait for the sink
+bool TrapSink::Push(const trap_record &r)
+{
+    mutex.lock();
+
+    if (queue.size() >= capacity)
+    {
+        stats.dropped++;
+        mutex.unlock();
+        return false;
+    }
+
+    queue.append(r);
+    cond.wakeOne();
+
+    mutex.unlock();
+    return true;
+}
+
+// Write the records still queued, then close the sink
+void TrapSink::Stop()
+{
+    mutex.lock();
+    aborting = true;
+    cond.wakeOne();
+    mutex.unlock();
+
+    wait();
+}
+
+void TrapSink::GetStats(trap_sink_stats &st)
+{
+    mutex.lock();
+    stats.queued = queue.size();
+    st = stats;
+    mutex.unlock();
+}
+
+QString TrapSink::Timestamp(qint64 msecs)
+{
+    return QDateTime::fromMSecsSinceEpoch(msecs).toUTC()
+           .toString("yyyy-MM-dd'T'HH:mm:ss.zzz'Z'");
+}
+
+void TrapSink::run()
+{
+    QList<trap_record> batch;
+    QElapsedTimer retry;
+    bool opened = false;
+    QString err;
+
+    mutex.lock();
+
+    while (true)
+    {
+        while (queue.isEmpty() && (aborting == false))
+            cond.wait(&mutex);
+
+        if (queue.isEmpty())
+            break;
+
+        // Take everything queued so far and write it without the lock,
+        // the GUI thread keeps queueing meanwhile
+        batch.swap(queue);
+        mutex.unlock();
+
+        int written = 0;
+        int failed = 0;
+
+        if ((opened == false) &&
+            (!retry.isValid() || (retry.elapsed() >= TRAP_SINK_RETRY_MSEC)))
+        {
+            retry.start();
+            err.clear();
+            opened = Open(err);
+        }
+
+        for (int i = 0; i < batch.size(); i++)
+        {
+            if ((opened == true) && Write(batch[i], err))
+            {
+                written++;
+                continue;
+            }
+
+            // Reopened on a later batch
+            if (opened == true)
+            {
+                Close();
+                opened = false;
+            }
+            failed++;
+        }
+
+        if (opened == true)
+            Flush();
+        batch.clear();
+
+        mutex.lock();
+        stats.written += written;
+        stats.failed += failed;
+        if (failed)
+            stats.error = err;
+        else if (written)
+            stats.error.clear();
+    }
+
+    mutex.unlock();
+
+    if (opened == true)
+        Close();
+}
+
+TrapFileSink::TrapFileSink(const QString &name, const QString &path,
+                           int maxsize, int maxfiles, int capacity,
+                           QObject *parent)
+    :TrapSink(name, capacity, parent)
+{
+    file.setFileName(path);
+    this->maxsize = (qint64)maxsize * 1024 * 1024;
+    this->maxfiles = maxfiles;
+}
+
+bool TrapFileSink::Open(QString &err)
+{
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append))
+    {
+        err = QString("Unable to open %1: %2")
+              .arg(file.fileName()).arg(file.errorString());
+        return false;
+    }
+
+    if (file.size() == 0)
+        file.write(Header());
+
+    return true;
+}
+
+bool TrapFileSink::Write(const trap_record &r, QString &err)
+{
+    QByteArray line = Format(r);
+
+    if ((maxsize > 0) && (file.size() > 0) &&
+        (file.size() + line.size() > maxsize) && !Rotate())
+    {
+        err = QString("Unable to rotate %1: %2")
+              .arg(file.fileName()).arg(file.errorString());
+        return false;
+    }
+
+    if (file.write(line) != line.size())
+    {
+        err = QString("Unable to write %1: %2")
+              .arg(file.fileName()).arg(file.errorString());
+        return false;
+    }
+
+    return true;
+}
+
+void TrapFileSink::Flush(void)
+{
+    file.flush();
+}
+
+void TrapFileSink::Close(void)
+{
+    file.close();
+}
+
+// <file> becomes <file>.1, <file>.1 becomes <file>.2, ... and the
+// oldest one is removed
+bool TrapFileSink::Rotate(void)
+{
+    QString path = file.fileName();
+
+    file.close();
+
+    QFile::remove(QString("%1.%2").arg(path).arg(maxfiles));
+    for (int i = maxfiles - 1; i >= 1; i--)
+        QFile::rename(QString("%1.%2").arg(path).arg(i),
+                      QString("%1.%2").arg(path).arg(i+1));
+    if (maxfiles > 0)
+        QFile::rename(path, QString("%1.1").arg(path));
+    else
+        QFile::remove(path);
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append))
+        return false;
+
+    file.write(Header());
+
+    return true;
+}
+
+TrapJsonSink::TrapJsonSink(const QString &path, int maxsize, int maxfiles,
+                           int capacity, QObject *parent)
+    :TrapFileSink("JSON", path, maxsize, maxfiles, capacity, parent)
+{
+}
+
+QByteArray TrapJsonSink::Format(const trap_record &r)
+{
+    QJsonObject o;
+
+    o.insert("received", Timestamp(r.received));
+    o.insert("nbr", (qint64)r.nbr);
+    o.insert("agent", r.agent);
+    o.insert("port", r.port);
+    o.insert("version", r.version);
+    o.insert("type", r.msgtype);
+    o.insert("notification", r.notification);
+    o.insert("name", r.name);
+    o.insert("uptime", (qint64)r.timestamp);
+    if (!r.community.isEmpty())
+        o.insert("community", r.community);
+    if (!r.seclevel.isEmpty())
+    {
+        o.insert("security_level", r.seclevel);
+        o.insert("context_name", r.ctxname);
+        o.insert("context_engine_id", r.ctxid);
+        o.insert("msgid", (qint64)r.msgid);
+    }
+
+    QJsonArray vbs;
+    for (int i = 0; i < r.varbinds.size(); i++)
+    {
+        QJsonObject vb;
+        vb.insert("oid", r.varbinds[i].oid);
+        if (!r.varbinds[i].name.isEmpty())
+            vb.insert("name", r.varbinds[i].name);
+        vb.insert("type", r.varbinds[i].type);
+        vb.insert("value", r.varbinds[i].value);
+        vbs.append(vb);
+    }
+    o.insert("varbinds", vbs);
+
+    return QJsonDocument(o).toJson(QJsonDocument::Compact) + '\n';
+}
+
+TrapCsvSink::TrapCsvSink(const QString &path, int maxsize, int maxfiles,
+                         int capacity, QObject *parent)
+    :TrapFileSink("CSV", path, maxsize, maxfiles, capacity, parent)
+{
+}
+
+QByteArray TrapCsvSink::Field(const QString &f)
+{
+    QByteArray b = f.toUtf8();
+
+    if ((b.indexOf(',') < 0) && (b.indexOf('"') < 0) &&
+        (b.indexOf('\n') < 0) && (b.indexOf('\r') < 0))
+        return b;
+
+    b.replace("\"", "\"\"");
+    return '"' + b + '"';
+}
+
+QByteArray TrapCsvSink::Header(void)
+{
+    return "received,nbr,agent,port,version,type,notification,name,uptime,"
+           "community,security_level,context_name,context_engine_id,msgid,"
+           "varbinds\r\n";
+}
+
+// The varbinds column holds "<oid>=<type>:<value>" items separated
+// by "; "
+QByteArray TrapCsvSink::Format(const trap_record &r)
+{
+    QString vbs;
+
+    for (int i = 0; i < r.varbinds.size(); i++)
+    {
+        if (i)
+            vbs += "; ";
+        vbs += QString("%1=%2:%3").arg(r.varbinds[i].oid)
+               .arg(r.varbinds[i].type).arg(r.varbinds[i].value);
+    }
+
+    QByteArray line;
+    line += Field(Timestamp(r.received)) + ',';
+    line += QByteArray::number(r.nbr) + ',';
+    line += Field(r.agent) + ',';
+    line += QByteArray::number(r.port) + ',';
+    line += Field(r.version) + ',';
+    line += Field(r.msgtype) + ',';
+    line += Field(r.notification) + ',';
+    line += Field(r.name) + ',';
+    line += QByteArray::number((qulonglong)r.timestamp) + ',';
+    line += Field(r.community) + ',';
+    line += Field(r.seclevel) + ',';
+    line += Field(r.ctxname) + ',';
+    line += Field(r.ctxid) + ',';
+    if (!r.seclevel.isEmpty())
+        line += QByteArray::number((qulonglong)r.msgid);
+    line += ',';
+    line += Field(vbs) + "\r\n";
+
+    return line;
+}
+
+TrapSyslogSink::TrapSyslogSink(const QString &dest, int facility,
+                               int capacity, QObject *parent)
+    :TrapSink("Syslog", capacity, parent)
+{
+    destination = dest;
+    this->facility = facility;
+    sock = INVALID_SOCKET;
+
+    // RFC 5424 header fields: printable US-ASCII, no spaces
+    hostname = QSysInfo::machineHostName().toLatin1();
+    if (hostname.isEmpty())
+        hostname = "-";
+    procid = QByteArray::number(QCoreApplication::applicationPid());
+}
+
+bool TrapSyslogSink::Open(QString &err)
+{
+#ifndef WIN32
+    // Local syslog daemon, e.g. /dev/log
+    if (destination.startsWith('/'))
+    {
+        struct sockaddr_un addr;
+        QByteArray path = QFile::encodeName(destination);
+
+        if (path.size() >= (int)sizeof(addr.sun_path))
+        {
+            err = QString("Socket path too long: %1").arg(destination);
+            return false;
+        }
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, path.data());
+
+        sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+        if ((sock == INVALID_SOCKET) ||
+            (::connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0))
+        {
+            err = QString("Unable to connect to %1: %2")
+                  .arg(destination).arg(strerror(errno));
+            Close();
+            return false;
+        }
+    }
+    else
+#endif
+    {
+        // host, host:port, [IPv6 address]:port
+        QString host = destination;
+        QString port = QString::number(TRAP_SYSLOG_PORT);
+        QRegExp hostport("^\\[(.*)\\](?::(\\d+))?$");
+
+        if (hostport.exactMatch(destination))
+        {
+            host = hostport.cap(1);
+            if (!hostport.cap(2).isEmpty())
+                port = hostport.cap(2);
+        }
+        else if (destination.count(':') == 1)
+        {
+            host = destination.section(':', 0, 0);
+            port = destination.section(':', 1, 1);
+        }
+
+        struct addrinfo hints, *res = NULL;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_DGRAM;
+
+        if ((getaddrinfo(host.toLatin1().data(), port.toLatin1().data(),
+                         &hints, &res) != 0) || (res == NULL))
+        {
+            err = QString("Unable to resolve %1").arg(destination);
+            return false;
+        }
+
+        sock = socket(res->ai_family, SOCK_DGRAM, 0);
+        if ((sock == INVALID_SOCKET) ||
+            (::connect(sock, res->ai_addr, res->ai_addrlen) < 0))
+        {
+            err = QString("Unable to connect to %1").arg(destination);
+            freeaddrinfo(res);
+            Close();
+            return false;
+        }
+
+        freeaddrinfo(res);
+    }
+
+#ifdef WIN32
+    DWORD timeout = TRAP_SYSLOG_TIMEOUT_MSEC;
+#else
+    struct timeval timeout;
+    timeout.tv_sec = TRAP_SYSLOG_TIMEOUT_MSEC / 1000;
+    timeout.tv_usec = (TRAP_SYSLOG_TIMEOUT_MSEC % 1000) * 1000;
+#endif
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO,
+               (const char *)&timeout, sizeof(timeout));
+
+    return true;
+}
+
+void TrapSyslogSink::Close(void)
+{
+    if (sock == INVALID_SOCKET)
+        return;
+
+#ifdef WIN32
+    closesocket(sock);
+#else
+    close(sock);
+#endif
+    sock = INVALID_SOCKET;
+}
+
+// Escape a structured data parameter value
+QString TrapSyslogSink::Param(const QString &val)
+{
+    QString v = val;
+
+    v.replace('\\', "\\\\");
+    v.replace('"', "\\\"");
+    v.replace(']', "\\]");
+
+    return QString("\"%1\"").arg(v);
+}
+
+bool TrapSyslogSink::Write(const trap_record &r, QString &err)
+{
+    // <PRI>VERSION TIMESTAMP HOSTNAME APP-NAME PROCID MSGID
+    QByteArray msgid = r.msgtype.toLatin1();
+    msgid.replace("(", "").replace(")", "");
+
+    QByteArray msg = QString("<%1>1 %2 ")
+                     .arg(facility * 8 + TRAP_SYSLOG_SEVERITY)
+                     .arg(Timestamp(r.received)).toLatin1();
+    msg += hostname + " snmpb " + procid + ' ' + msgid + ' ';
+
+    // STRUCTURED-DATA
+    QString sd = QString("[%1 agent=%2 port=\"%3\" version=%4 "
+                         "notification=%5 name=%6 uptime=\"%7\"")
+                 .arg(TRAP_SYSLOG_SDID).arg(Param(r.agent)).arg(r.port)
+                 .arg(Param(r.version)).arg(Param(r.notification))
+                 .arg(Param(r.name)).arg(r.timestamp);
+    if (!r.community.isEmpty())
+        sd += QString(" community=%1").arg(Param(r.community));
+    if (!r.seclevel.isEmpty())
+        sd += QString(" securityLevel=%1 contextName=%2")
+              .arg(Param(r.seclevel)).arg(Param(r.ctxname));
+    sd += ']';
+    msg += sd.toUtf8();
+
+    // MSG, UTF-8 with BOM
+    QString text = QString("%1 from %2").arg(r.name).arg(r.agent);
+    for (int i = 0; i < r.varbinds.size(); i++)
+        text += QString("%1 %2=%3").arg(i ? ',' : ':')
+                .arg(r.varbinds[i].name.isEmpty() ?
+                     r.varbinds[i].oid : r.varbinds[i].name)
+                .arg(r.varbinds[i].value);
+    msg += " \xEF\xBB\xBF" + text.toUtf8();
+
+    // Truncate on a character boundary
+    if (msg.size() > TRAP_SYSLOG_MAX_MSG)
+    {
+        int len = TRAP_SYSLOG_MAX_MSG;
+        while ((len > 0) && ((msg[len] & 0xC0) == 0x80))
+            len--;
+        msg.truncate(len);
+    }
+
+    if (send(sock, msg.data(), msg.size(), 0) != msg.size())
+    {
+#ifdef WIN32
+        err = QString("Unable to send to %1").arg(destination);
+#else
+        err = QString("Unable to send to %1: %2")
+              .arg(destination).arg(strerror(errno));
+#endif
+        return false;
+    }
+
+    return true;
+}
+
+TrapExporter::TrapExporter(QObject *parent)
+    :QObject(parent)
+{
+}
+
+TrapExporter::~TrapExporter()
+{
+    Shutdown();
+}
+
+void TrapExporter::Configure(const trap_export_config &cfg)
+{
+    Shutdown();
+
+    if (cfg.json && !cfg.jsonfile.isEmpty())
+        sinks.append(new TrapJsonSink(cfg.jsonfile, cfg.maxsize,
+                                      cfg.maxfiles, cfg.queuesize, this));
+    if (cfg.csv && !cfg.csvfile.isEmpty())
+        sinks.append(new TrapCsvSink(cfg.csvfile, cfg.maxsize,
+                                     cfg.maxfiles, cfg.queuesize, this));
+    if (cfg.syslog && !cfg.syslogdest.isEmpty())
+        sinks.append(new TrapSyslogSink(cfg.syslogdest, cfg.facility,
+                                        cfg.queuesize, this));
+
+    for (int i = 0; i < sinks.size(); i++)
+        sinks[i]->start();
+}
+
+void TrapExporter::Export(const trap_record &r)
+{
+    for (int i = 0; i < sinks.size(); i++)
+        sinks[i]->Push(r);
+}
+
+void TrapExporter::GetStats(QString &text)
+{
+    trap_sink_stats st;
+
+    text.clear();
+    for (int i = 0; i < sinks.size(); i++)
+    {
+        sinks[i]->GetStats(st);
+        text += QString("%1: %2 written, %3 queued, %4 dropped, %5 failed\n")
+                .arg(sinks[i]->Name()).arg(st.written).arg(st.queued)
+                .arg(st.dropped).arg(st.failed);
+        if (!st.error.isEmpty())
+            text += QString("    %1\n").arg(st.error);
+    }
+
+    if (text.isEmpty())
+        text = "No trap export enabled";
+}
+
+void TrapExporter::Shutdown(void)
+{
+    for (int i = 0; i < sinks.size(); i++)
+    {
+        sinks[i]->Stop();
+        delete sinks[i];
+    }
+    sinks.clear();
+}
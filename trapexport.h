@@ -0,0 +1,205 @@
+/*
+    Copyright (C) 2004-2011 Martin Jolicoeur (snmpb1@gmail.com)
+
+    This file is part of the SnmpB project
+    (http://sourceforge.net/projects/snmpb)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef TRAPEXPORT_H
+#define TRAPEXPORT_H
+
+#include "stdafx.h"
+
+// Export settings, as stored in the preferences
+typedef struct
+{
+    bool json;
+    QString jsonfile;
+    bool csv;
+    QString csvfile;
+    int maxsize;                // MB per file before rotation, 0 to disable
+    int maxfiles;               // rotated files kept
+    bool syslog;
+    QString syslogdest;         // host[:port] or local datagram socket path
+    int facility;
+    int queuesize;              // records queued per sink before dropping
+} trap_export_config;
+
+typedef struct
+{
+    QString oid;
+    QString name;
+    QString type;
+    QString value;
+} trap_record_vb;
+
+// Decoded trap, formatted once in the GUI thread and then shared by all
+// sinks. Only implicitly shared Qt types so that copies are cheap and
+// safe to hand over to the sink threads.
+typedef struct
+{
+    qint64 received;            // msecs since epoch
+    unsigned int nbr;
+    unsigned long timestamp;    // sysUpTime of the notification
+    QString notification;       // numerical OID
+    QString name;
+    QString msgtype;
+    QString version;
+    QString agent;
+    unsigned short port;
+    QString community;
+    QString seclevel;
+    QString ctxname;
+    QString ctxid;
+    unsigned long msgid;
+    QList<trap_record_vb> varbinds;
+} trap_record;
+
+typedef struct
+{
+    int queued;
+    unsigned long written;
+    unsigned long dropped;      // queue full
+    unsigned long failed;       // sink not available or write error
+    QString error;
+} trap_sink_stats;
+
+// A sink writes the records in its own thread, from a bounded queue.
+// Push() never blocks: when the sink falls behind, the queue fills up
+// and new records are dropped and accounted for.
+class TrapSink: public QThread
+{
+    Q_OBJECT
+
+public:
+    TrapSink(const QString &name, int capacity, QObject *parent);
+    bool Push(const trap_record &r);
+    void Stop();
+    void GetStats(trap_sink_stats &st);
+    const QString &Name(void) { return sinkname; };
+    void run();
+
+protected:
+    virtual bool Open(QString &err) = 0;
+    virtual bool Write(const trap_record &r, QString &err) = 0;
+    virtual void Flush(void) {};
+    virtual void Close(void) = 0;
+
+    static QString Timestamp(qint64 msecs);
+
+private:
+    QString sinkname;
+    QMutex mutex;
+    QWaitCondition cond;
+    QList<trap_record> queue;
+    int capacity;
+    bool aborting;
+    trap_sink_stats stats;
+};
+
+// Append only file with size based rotation: <file>, <file>.1, ...
+class TrapFileSink: public TrapSink
+{
+public:
+    TrapFileSink(const QString &name, const QString &path, int maxsize,
+                 int maxfiles, int capacity, QObject *parent);
+
+protected:
+    bool Open(QString &err);
+    bool Write(const trap_record &r, QString &err);
+    void Flush(void);
+    void Close(void);
+
+    virtual QByteArray Format(const trap_record &r) = 0;
+    virtual QByteArray Header(void) { return QByteArray(); };
+
+private:
+    bool Rotate(void);
+
+private:
+    QFile file;
+    qint64 maxsize;
+    int maxfiles;
+};
+
+// One JSON object per line
+class TrapJsonSink: public TrapFileSink
+{
+public:
+    TrapJsonSink(const QString &path, int maxsize, int maxfiles,
+                 int capacity, QObject *parent);
+
+protected:
+    QByteArray Format(const trap_record &r);
+};
+
+// Fixed columns, RFC 4180 quoting, varbinds in the last column
+class TrapCsvSink: public TrapFileSink
+{
+public:
+    TrapCsvSink(const QString &path, int maxsize, int maxfiles,
+                int capacity, QObject *parent);
+
+protected:
+    QByteArray Format(const trap_record &r);
+    QByteArray Header(void);
+
+private:
+    static QByteArray Field(const QString &f);
+};
+
+// RFC 5424 messages over UDP (RFC 5426) or a local datagram socket
+class TrapSyslogSink: public TrapSink
+{
+public:
+    TrapSyslogSink(const QString &dest, int facility,
+                   int capacity, QObject *parent);
+
+protected:
+    bool Open(QString &err);
+    bool Write(const trap_record &r, QString &err);
+    void Close(void);
+
+private:
+    static QString Param(const QString &val);
+
+private:
+    QString destination;
+    int facility;
+    SnmpSocket sock;
+    QByteArray hostname;
+    QByteArray procid;
+};
+
+class TrapExporter: public QObject
+{
+    Q_OBJECT
+
+public:
+    TrapExporter(QObject *parent);
+    ~TrapExporter();
+    void Configure(const trap_export_config &cfg);
+    bool IsEnabled(void) { return !sinks.isEmpty(); };
+    void Export(const trap_record &r);
+    void GetStats(QString &text);
+
+public slots:
+    void Shutdown(void);
+
+private:
+    QList<TrapSink*> sinks;
+};
+
+#endif /* TRAPEXPORT_H */
@@ -0,0 +1,708 @@
+/*
+    Copyright (C) 2004-2011 Martin Jolicoeur (snmpb1@gmail.com)
+
+    This file is part of the SnmpB project
+    (http://sourceforge.net/projects/snmpb)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "trapgen.h"
+#include "agent.h"
+#include "agentprofile.h"
+#include "preferences.h"
+
+// Experimental subtree (RFC 1155), used for generated notifications
+#define TRAPGEN_NOTIFY_OID "1.3.6.1.3.1789.0.1"
+#define TRAPGEN_SEQ_OID    "1.3.6.1.3.1789.1.1.0"
+#define TRAPGEN_DATA_OID   "1.3.6.1.3.1789.1.2"
+#define TRAPGEN_DATA       "SnmpB load generator"
+
+// Markers searched for in the pre-encoded messages
+#define TRAPGEN_REQID_MARKER 0x5AA5C33C
+static const unsigned char reqid_marker[] =
+    { 0x02, 0x04, 0x5A, 0xA5, 0xC3, 0x3C };
+static const unsigned char seq_marker[] =
+    { 0xA5, 'S', 'n', 'm', 'p', 'B', 0x5A, 0xC3 };
+
+// Patched request ids stay in 0x40000000-0x7FFFFFFE so that their
+// encoding always is 4 bytes long, like the marker's.
+#define TRAPGEN_REQID_BASE  0x40000000
+#define TRAPGEN_REQID_RANGE 0x3FFFFFFF
+
+#define TRAPGEN_REFRESH_MSEC 500
+#define TRAPGEN_MAX_SLEEP_USEC 10000
+
+#define PUT_UINT32(p, v)                     \
+    do {                                     \
+        (p)[0] = ((v) >> 24) & 0xFF;         \
+        (p)[1] = ((v) >> 16) & 0xFF;         \
+        (p)[2] = ((v) >> 8) & 0xFF;          \
+        (p)[3] = (v) & 0xFF;                 \
+    } while(0)
+
+#define GET_UINT32(p)                                        \
+    (((unsigned int)(p)[0] << 24) | ((unsigned int)(p)[1] << 16) | \
+     ((unsigned int)(p)[2] << 8) | (unsigned int)(p)[3])
+
+// C Callback function for snmp++
+void callback_trapgen(int reason, Snmp *, Pdu &pdu, SnmpTarget &, void *cd)
+{
+    if (cd)
+    {
+        // just call the real callback member function...
+        ((TrapGeneratorThread*)cd)->InformReply(reason, pdu);
+    }
+}
+
+// The last occurrence: the community and the fields before the marked
+// one may contain the marker bytes, the fields after it are our own
+static int find_marker(const unsigned char *buf, int len,
+                       const unsigned char *marker, int marker_len)
+{
+    for (int i = len - marker_len; i >= 0; i--)
+        if (memcmp(buf + i, marker, marker_len) == 0)
+            return i;
+    return -1;
+}
+
+TrapGenSnmp::TrapGenSnmp(int &status, const UdpAddress &addr)
+    :Snmp(status, addr)
+{
+}
+
+int TrapGenSnmp::send_batch(SnmpSendBatch &batch, const UdpAddress &dest)
+{
+    if (dest.get_ip_version() == Address::version_ipv4)
+        return batch.flush(iv_snmp_session);
+    else
+        return batch.flush(iv_snmp_session_ipv6);
+}
+
+TrapGenerator::TrapGenerator(Snmpb *snmpb)
+{
+    s = snmpb;
+    benchmark = false;
+    runid = 0;
+    received = 0;
+    last_received = 0;
+
+    tgd = new QDialog(s->MainUI()->TabW);
+    tg = new Ui_TrapGen();
+    tg->setupUi(tgd);
+
+    connect( s->MainUI()->actionTrapGenerator, SIGNAL( triggered() ),
+             this, SLOT( Execute() ));
+    connect( tg->TrapGenStart, SIGNAL( clicked() ),
+             this, SLOT( Start() ));
+    connect( tg->TrapGenStop, SIGNAL( clicked() ),
+             this, SLOT( Stop() ));
+    connect( tg->TrapGenBenchmark, SIGNAL( toggled(bool) ),
+             this, SLOT( BenchmarkToggled(bool) ));
+    connect( s->APManagerObj(), SIGNAL( AgentProfileListChanged() ),
+             this, SLOT ( AgentProfileListChange() ) );
+    connect( &timer, SIGNAL( timeout() ), this, SLOT( Refresh() ));
+    connect( qApp, SIGNAL( aboutToQuit() ), this, SLOT( Shutdown() ));
+
+    // Fill-in the list of agent profiles from profiles manager
+    AgentProfileListChange();
+
+    // Create the generator thread (not started)
+    gt = new TrapGeneratorThread(s);
+
+    connect( gt, SIGNAL( finished() ), this, SLOT( Finished() ));
+}
+
+void TrapGenerator::Execute()
+{
+    tgd->show();
+    tgd->raise();
+    tgd->activateWindow();
+}
+
+void TrapGenerator::AgentProfileListChange()
+{
+    QString cap = tg->TrapGenProfile->currentText();
+    tg->TrapGenProfile->clear();
+    tg->TrapGenProfile->addItems(s->APManagerObj()->GetAgentsList());
+    if (cap.isEmpty() == false)
+    {
+        int idx = tg->TrapGenProfile->findText(cap);
+        tg->TrapGenProfile->setCurrentIndex(idx>0?idx:0);
+    }
+}
+
+void TrapGenerator::BenchmarkToggled(bool checked)
+{
+    // In benchmark mode, traps go to our own trap listener
+    tg->TrapGenAddress->setEnabled(!checked);
+    tg->TrapGenPort->setEnabled(!checked);
+}
+
+void TrapGenerator::Start()
+{
+    QString err;
+
+    if (gt->isRunning())
+        return;
+
+    AgentProfile *ap = s->APManagerObj()->GetAgentProfile
+                        (tg->TrapGenProfile->currentText());
+    if (!ap)
+    {
+        QMessageBox::warning ( NULL, "SnmpB",
+                               "Please select a valid agent profile.",
+                               QMessageBox::Ok, Qt::NoButton);
+        return;
+    }
+
+    snmp_version v = (tg->TrapGenVersion->currentIndex() == 2)?version3:
+                     ((tg->TrapGenVersion->currentIndex() == 1)?version2c:
+                      version1);
+    bool inform = (tg->TrapGenType->currentIndex() == 1);
+    if (inform && (v == version1))
+    {
+        QMessageBox::warning ( NULL, "SnmpB",
+                               "Informs are not defined for SNMPv1.",
+                               QMessageBox::Ok, Qt::NoButton);
+        return;
+    }
+
+    QString address_str;
+    benchmark = tg->TrapGenBenchmark->isChecked();
+    if (benchmark)
+    {
+        if (s->PreferencesObj()->GetEnableIPv4())
+            address_str = QString("127.0.0.1/%1")
+                          .arg(s->PreferencesObj()->GetTrapPort());
+        else
+            address_str = QString("::1/%1")
+                          .arg(s->PreferencesObj()->GetTrapPort6());
+    }
+    else
+        address_str = QString("%1/%2").arg(tg->TrapGenAddress->text())
+                                      .arg(tg->TrapGenPort->value());
+
+    UdpAddress dest(address_str.toLatin1().data());
+    if (!dest.valid())
+    {
+        err = QString("Invalid Address or DNS Name: %1\n")
+                      .arg(tg->TrapGenAddress->text());
+        QMessageBox::warning ( NULL, "SnmpB", err,
+                               QMessageBox::Ok, Qt::NoButton);
+        return;
+    }
+
+    // A new run id lets the benchmark ignore traps from earlier runs
+    unsigned int id = (unsigned int)QDateTime::currentDateTime().toTime_t();
+    runid = (id == runid)?id+1:id;
+
+    gt->rate = tg->TrapGenRate->value();
+    gt->count = tg->TrapGenCount->value();
+    gt->varbinds = tg->TrapGenVarbinds->value();
+    gt->runid = runid;
+
+    if (gt->Setup(ap, v, inform, dest,
+                  tg->TrapGenSources->value(), err) == false)
+    {
+        QMessageBox::warning ( NULL, "SnmpB", err,
+                               QMessageBox::Ok, Qt::NoButton);
+        return;
+    }
+
+    received = 0;
+    last_received = 0;
+    started.start();
+
+    tg->TrapGenStart->setEnabled(false);
+    tg->TrapGenStop->setEnabled(true);
+    tg->TrapGenResult->setText("Running...");
+
+    gt->start();
+    timer.start(TRAPGEN_REFRESH_MSEC);
+}
+
+void TrapGenerator::Stop()
+{
+    gt->Abort();
+}
+
+void TrapGenerator::Shutdown()
+{
+    gt->Abort();
+    gt->wait();
+}
+
+void TrapGenerator::Finished()
+{
+    // In benchmark mode, keep counting the traps still being ingested
+    if (benchmark == false)
+        timer.stop();
+    Refresh();
+
+    tg->TrapGenStart->setEnabled(true);
+    tg->TrapGenStop->setEnabled(false);
+}
+
+void TrapGenerator::Refresh()
+{
+    trapgen_stats st;
+    QString result;
+
+    gt->GetStats(st);
+
+    double secs = st.elapsed / 1000000.0;
+    result = QString("Sent: %1 (%2 msg/s)\nErrors: %3")
+             .arg(st.sent)
+             .arg(secs > 0 ? st.sent / secs : 0, 0, 'f', 0)
+             .arg(st.errors);
+
+    if (tg->TrapGenType->currentIndex() == 1)
+    {
+        result += QString("\nAcknowledged: %1").arg(st.acked);
+        if (st.acked)
+            result += QString("\nRound-trip min/avg/max: %1/%2/%3 ms")
+                      .arg(st.rtt_min / 1000.0, 0, 'f', 3)
+                      .arg(st.rtt_total / 1000.0 / st.acked, 0, 'f', 3)
+                      .arg(st.rtt_max / 1000.0, 0, 'f', 3);
+    }
+
+    if (benchmark)
+    {
+        double rsecs = last_received / 1000000.0;
+        result += QString("\nReceived: %1 (%2 msg/s)")
+                  .arg(received)
+                  .arg(rsecs > 0 ? received / rsecs : 0, 0, 'f', 0);
+        if ((st.running == false) && (st.sent >= received))
+            result += QString("\nLost: %1 (%2%)")
+                      .arg(st.sent - received)
+                      .arg(st.sent ? 100.0 * (st.sent - received) / st.sent
+                                   : 0, 0, 'f', 2);
+    }
+
+    tg->TrapGenResult->setText(result);
+}
+
+// Called from Agent::AddTrap, for every trap shown in the trap tab
+void TrapGenerator::Received(Pdu &pdu)
+{
+    if (benchmark == false)
+        return;
+
+    Oid id;
+    pdu.get_notify_id(id);
+    if ((id != Oid(TRAPGEN_NOTIFY_OID)) || (pdu.get_vb_count() < 1))
+        return;
+
+    Vb vb;
+    unsigned char buf[8];
+    unsigned long len = 0;
+    pdu.get_vb(vb, 0);
+    if ((vb.get_oid() != Oid(TRAPGEN_SEQ_OID)) ||
+        (vb.get_value(buf, len, sizeof(buf)) != SNMP_CLASS_SUCCESS) ||
+        (len != sizeof(buf)) || (GET_UINT32(buf) != runid))
+        return;
+
+    received++;
+    last_received = started.nsecsElapsed() / 1000;
+}
+
+TrapGeneratorThread::TrapGeneratorThread(QObject *parent):QThread(parent)
+{
+    s = (Snmpb *)parent;
+    rate = 0;
+    count = 0;
+    varbinds = 0;
+    runid = 0;
+    num_sources = 0;
+    target = NULL;
+    isinform = false;
+    aborting.storeRelease(0);
+    template_len = 0;
+    reqid_offset = -1;
+    seq_offset = -1;
+    outstanding = 0;
+    memset(&current, 0, sizeof(current));
+    memset(&stats, 0, sizeof(stats));
+
+    for (int i = 0; i < TRAPGEN_MAX_SOURCES; i++)
+    {
+        snmp[i] = NULL;
+        templates[i] = NULL;
+    }
+}
+
+TrapGeneratorThread::~TrapGeneratorThread()
+{
+    Cleanup();
+}
+
+void TrapGeneratorThread::Cleanup()
+{
+    for (int i = 0; i < TRAPGEN_MAX_SOURCES; i++)
+    {
+        if (snmp[i])
+        {
+            delete snmp[i];
+            snmp[i] = NULL;
+        }
+        if (templates[i])
+        {
+            delete [] templates[i];
+            templates[i] = NULL;
+        }
+    }
+    num_sources = 0;
+
+    if (target)
+    {
+        delete target;
+        target = NULL;
+    }
+
+    informs.clear();
+}
+
+bool TrapGeneratorThread::Setup(AgentProfile *ap, snmp_version v, bool inform,
+                                const UdpAddress &dest, int sources,
+                                QString &err)
+{
+    int status;
+
+    Cleanup();
+
+    version = v;
+    isinform = inform;
+    destination = dest;
+    aborting.storeRelease(0);
+
+    if (sources < 1)
+        sources = 1;
+    if (sources > TRAPGEN_MAX_SOURCES)
+        sources = TRAPGEN_MAX_SOURCES;
+
+    // Create one session per source. On the loopback network, each
+    // session gets its own source address, elsewhere its own port.
+    bool loopback = ((dest.get_ip_version() == Address::version_ipv4) &&
+                     (dest[0] == 127));
+
+    for (int i = 0; i < sources; i++)
+    {
+        if (dest.get_ip_version() != Address::version_ipv4)
+            bind_addr[i] = UdpAddress("::");
+        else if (loopback)
+            bind_addr[i] = UdpAddress(QString("127.0.0.%1").arg(i+1)
+                                      .toLatin1().data());
+        else
+            bind_addr[i] = UdpAddress("0.0.0.0");
+
+        snmp[i] = new TrapGenSnmp(status, bind_addr[i]);
+        if (status != SNMP_CLASS_SUCCESS)
+        {
+            err = QString("Cannot create session on %1: %2")
+                  .arg(bind_addr[i].get_printable())
+                  .arg(Snmp::error_msg(status));
+            Cleanup();
+            return false;
+        }
+        num_sources++;
+    }
+
+    if (v == version3)
+        target = new UTarget(dest);
+    else
+        target = new CTarget(dest);
+    s->AgentObj()->ConfigTargetFromSettings(v, target, ap);
+
+    s->AgentObj()->ConfigPduFromSettings(v, TRAPGEN_SEQ_OID, &pdu, ap);
+    pdu.set_notify_id(Oid(TRAPGEN_NOTIFY_OID));
+    for (int k = 0; k < varbinds; k++)
+    {
+        Vb vb(Oid(QString("%1.%2").arg(TRAPGEN_DATA_OID).arg(k+1)
+                  .toLatin1().data()));
+        vb.set_value(OctetStr(TRAPGEN_DATA));
+        pdu += vb;
+    }
+
+    // SNMPv3 messages are authenticated/encrypted and informs need
+    // snmp++ to match the responses: both are encoded per message.
+    if ((v != version3) && (inform == false) &&
+        (BuildTemplates(ap) == false))
+    {
+        for (int i = 0; i < TRAPGEN_MAX_SOURCES; i++)
+        {
+            if (templates[i])
+            {
+                delete [] templates[i];
+                templates[i] = NULL;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool TrapGeneratorThread::BuildTemplates(AgentProfile *ap)
+{
+    OctetStr community(ap->GetReadComm().toLatin1().data());
+
+    for (int i = 0; i < num_sources; i++)
+    {
+        Pdu t = pdu;
+        Vb vb;
+
+        t.get_vb(vb, 0);
+        vb.set_value(seq_marker, sizeof(seq_marker));
+        t.set_vb(vb, 0);
+        t.set_request_id(TRAPGEN_REQID_MARKER);
+        t.set_notify_timestamp(TimeTicks(0));
+
+        if (version == version1)
+        {
+            t.set_type(sNMP_PDU_V1TRAP);
+            if (destination[0] == 127)
+                t.set_v1_trap_address(IpAddress(bind_addr[i]));
+        }
+        else
+            t.set_type(sNMP_PDU_TRAP);
+
+        SnmpMessage msg;
+        if (msg.load(t, community, version) != SNMP_CLASS_SUCCESS)
+            return false;
+
+        unsigned char *data = msg.data();
+        int len = msg.len();
+
+        // The sequence number is in the first varbind, the request id
+        // comes before it. SNMPv1 traps have no request id.
+        int q = find_marker(data, len, seq_marker, sizeof(seq_marker));
+        int r = ((version == version1) || (q < 0)) ? -1 :
+                find_marker(data, q, reqid_marker, sizeof(reqid_marker));
+        if ((q < 0) || ((version != version1) && (r < 0)))
+            return false;
+
+        if (i == 0)
+        {
+            template_len = len;
+            reqid_offset = (r < 0) ? -1 : r + 2;
+            seq_offset = q;
+        }
+        else if ((len != template_len) || (q != seq_offset))
+            return false;
+
+        templates[i] = new unsigned char[len];
+        memcpy(templates[i], data, len);
+    }
+
+    return true;
+}
+
+void TrapGeneratorThread::BuildPdu(Pdu &p, unsigned long seq)
+{
+    unsigned char buf[8];
+    Vb vb;
+
+    PUT_UINT32(buf, runid);
+    PUT_UINT32(buf + 4, seq);
+
+    p.get_vb(vb, 0);
+    vb.set_value(buf, sizeof(buf));
+    p.set_vb(vb, 0);
+    p.set_notify_timestamp(TimeTicks(clock.elapsed() / 10));
+}
+
+void TrapGeneratorThread::SendTemplate(int src, unsigned long seq,
+                                       SnmpSendBatch &batch)
+{
+    unsigned char *t = templates[src];
+
+    if (reqid_offset >= 0)
+    {
+        unsigned long reqid = TRAPGEN_REQID_BASE + (seq % TRAPGEN_REQID_RANGE);
+        PUT_UINT32(t + reqid_offset, reqid);
+    }
+    PUT_UINT32(t + seq_offset, runid);
+    PUT_UINT32(t + seq_offset + 4, seq);
+
+    // The batch keeps its own copy of the message
+    batch.add(t, template_len, destination);
+}
+
+void TrapGeneratorThread::FlushBatch(int src, SnmpSendBatch &batch)
+{
+    int queued = batch.get_count();
+    if (queued == 0)
+        return;
+
+    int sent = snmp[src]->send_batch(batch, destination);
+    if (sent < 0)
+        current.errors += queued;
+    else
+    {
+        current.sent += sent;
+        current.errors += queued - sent;
+    }
+}
+
+void TrapGeneratorThread::ProcessEvents()
+{
+    for (int i = 0; i < num_sources; i++)
+        snmp[i]->get_eventListHolder()->SNMPProcessPendingEvents();
+}
+
+void TrapGeneratorThread::PublishStats()
+{
+    current.elapsed = clock.nsecsElapsed() / 1000;
+
+    stats_mutex.lock();
+    stats = current;
+    stats_mutex.unlock();
+}
+
+void TrapGeneratorThread::GetStats(trapgen_stats &st)
+{
+    stats_mutex.lock();
+    st = stats;
+    stats_mutex.unlock();
+}
+
+void TrapGeneratorThread::InformReply(int reason, Pdu &reply)
+{
+    outstanding--;
+
+    QHash<unsigned long, qint64>::iterator i =
+        informs.find(reply.get_request_id());
+
+    if ((reason != SNMP_CLASS_ASYNC_RESPONSE) || reply.get_error_status())
+    {
+        current.errors++;
+        if (i != informs.end())
+            informs.erase(i);
+        return;
+    }
+
+    current.acked++;
+
+    // Request ids change when snmp++ resends after an SNMPv3 report
+    if (i == informs.end())
+        return;
+
+    qint64 rtt = clock.nsecsElapsed() / 1000 - i.value();
+    informs.erase(i);
+
+    if ((current.rtt_min == 0) || (rtt < current.rtt_min))
+        current.rtt_min = rtt;
+    if (rtt > current.rtt_max)
+        current.rtt_max = rtt;
+    current.rtt_total += rtt;
+}
+
+void TrapGeneratorThread::Abort()
+{
+    aborting.storeRelease(1);
+}
+
+void TrapGeneratorThread::run()
+{
+    SnmpSendBatch batch;
+    int batch_src = 0;
+    int status;
+
+    memset(&current, 0, sizeof(current));
+    current.running = true;
+    outstanding = 0;
+    clock.start();
+    PublishStats();
+
+    for (unsigned long seq = 0; (seq < count) && !aborting.loadAcquire(); seq++)
+    {
+        // Pace the messages to the requested rate
+        if (rate > 0)
+        {
+            qint64 due = (qint64)(seq * 1000000.0 / rate);
+            qint64 now = clock.nsecsElapsed() / 1000;
+            while ((due > now) && !aborting.loadAcquire())
+            {
+                FlushBatch(batch_src, batch);
+                if (isinform)
+                    ProcessEvents();
+                QThread::usleep((unsigned long)qMin(due - now,
+                                (qint64)TRAPGEN_MAX_SLEEP_USEC));
+                now = clock.nsecsElapsed() / 1000;
+            }
+        }
+
+        // Consecutive batches of messages go out from each source in turn
+        int src = (seq / SNMP_PP_BATCH_SIZE) % num_sources;
+
+        if (isinform)
+        {
+            BuildPdu(pdu, seq);
+            status = snmp[src]->inform(pdu, *target, callback_trapgen, this);
+            if (status == SNMP_CLASS_SUCCESS)
+            {
+                informs.insert(pdu.get_request_id(),
+                               clock.nsecsElapsed() / 1000);
+                outstanding++;
+                current.sent++;
+            }
+            else
+                current.errors++;
+
+            if ((seq % SNMP_PP_BATCH_SIZE) == 0)
+                ProcessEvents();
+        }
+        else if (templates[0])
+        {
+            if (src != batch_src)
+            {
+                FlushBatch(batch_src, batch);
+                batch_src = src;
+            }
+            SendTemplate(src, seq, batch);
+            if (batch.is_full())
+                FlushBatch(batch_src, batch);
+        }
+        else
+        {
+            BuildPdu(pdu, seq);
+            if (snmp[src]->trap(pdu, *target) == SNMP_CLASS_SUCCESS)
+                current.sent++;
+            else
+                current.errors++;
+        }
+
+        if ((seq % SNMP_PP_BATCH_SIZE) == 0)
+            PublishStats();
+    }
+
+    FlushBatch(batch_src, batch);
+
+    // Wait for the outstanding informs to be acknowledged or timed out
+    if (isinform)
+    {
+        qint64 deadline = clock.elapsed() +
+                          10 * target->get_timeout() * (target->get_retry() + 1);
+        while ((outstanding > 0) && !aborting.loadAcquire() &&
+               (clock.elapsed() < deadline))
+        {
+            ProcessEvents();
+            PublishStats();
+            QThread::usleep(TRAPGEN_MAX_SLEEP_USEC);
+        }
+    }
+
+    current.running = false;
+    PublishStats();
+}
@@ -0,0 +1,142 @@
+/*
+    Copyright (C) 2004-2011 Martin Jolicoeur (snmpb1@gmail.com)
+
+    This file is part of the SnmpB project
+    (http://sourceforge.net/projects/snmpb)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef TRAPGEN_H
+#define TRAPGEN_H
+
+#include "stdafx.h"
+
+#include "snmpb.h"
+#include "ui_trapgen.h"
+
+#define TRAPGEN_MAX_SOURCES 64
+
+class AgentProfile;
+
+class TrapGenSnmp: public Snmp
+{
+public:
+    TrapGenSnmp(int &status, const UdpAddress &addr);
+
+    int send_batch(SnmpSendBatch &batch, const UdpAddress &dest);
+};
+
+typedef struct
+{
+    unsigned long sent;
+    unsigned long errors;
+    unsigned long acked;
+    qint64 rtt_min;      // usec
+    qint64 rtt_max;      // usec
+    qint64 rtt_total;    // usec
+    qint64 elapsed;      // usec
+    bool running;
+} trapgen_stats;
+
+class TrapGeneratorThread: public QThread
+{
+    Q_OBJECT
+
+public:
+    TrapGeneratorThread(QObject *parent);
+    ~TrapGeneratorThread();
+    bool Setup(AgentProfile *ap, snmp_version v, bool inform,
+               const UdpAddress &dest, int sources, QString &err);
+    void run();
+    void Abort();
+    void GetStats(trapgen_stats &st);
+    void InformReply(int reason, Pdu &pdu);
+
+public:
+    int rate;
+    unsigned long count;
+    int varbinds;
+    unsigned int runid;
+
+protected:
+    void Cleanup();
+    void BuildPdu(Pdu &p, unsigned long seq);
+    bool BuildTemplates(AgentProfile *ap);
+    void SendTemplate(int src, unsigned long seq, SnmpSendBatch &batch);
+    void FlushBatch(int src, SnmpSendBatch &batch);
+    void ProcessEvents();
+    void PublishStats();
+
+protected:
+    Snmpb *s;
+    TrapGenSnmp *snmp[TRAPGEN_MAX_SOURCES];
+    int num_sources;
+    SnmpTarget *target;
+    UdpAddress destination;
+    UdpAddress bind_addr[TRAPGEN_MAX_SOURCES];
+    snmp_version version;
+    bool isinform;
+    Pdu pdu;
+    QAtomicInt aborting;        // set by the GUI thread
+
+    // Pre-encoded v1/v2c traps, one per source, patched for each message
+    unsigned char *templates[TRAPGEN_MAX_SOURCES];
+    int template_len;
+    int reqid_offset;
+    int seq_offset;
+
+    QElapsedTimer clock;
+    QHash<unsigned long, qint64> informs;
+    int outstanding;
+
+    // Updated by the generator thread only, published to stats
+    trapgen_stats current;
+    QMutex stats_mutex;
+    trapgen_stats stats;
+};
+
+class TrapGenerator: public QObject
+{
+    Q_OBJECT
+
+public:
+    TrapGenerator(Snmpb *snmpb);
+    void Received(Pdu &pdu);
+
+protected slots:
+    void Execute();
+    void Start();
+    void Stop();
+    void Finished();
+    void Refresh();
+    void AgentProfileListChange();
+    void BenchmarkToggled(bool checked);
+    void Shutdown();
+
+private:
+    Snmpb *s;
+    Ui_TrapGen *tg;
+    QDialog *tgd;
+    TrapGeneratorThread *gt;
+    QTimer timer;
+
+    // Benchmark against our own trap listener
+    bool benchmark;
+    unsigned int runid;
+    unsigned long received;
+    QElapsedTimer started;
+    qint64 last_received;    // usec since started
+};
+
+#endif /* TRAPGEN_H */
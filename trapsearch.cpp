@@ -0,0 +1,327 @@
+/*
+    Copyright (C) 2004-2011 Martin Jolicoeur (snmpb1@gmail.com)
+
+    This file is part of the SnmpB project
+    (http://sourceforge.net/projects/snmpb)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <iterator>
+
+#include "trapsearch.h"
+
+// Number of history positions evaluated per read lock, newest first
+#define TRAP_SEARCH_WINDOW 65536
+
+// The result view does not scale much beyond this
+#define TRAP_SEARCH_MAX_RESULTS 100000
+
+// IPv4 addresses are indexed as IPv4-mapped IPv6 addresses
+static const unsigned char v4mapped[12] =
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF };
+
+QByteArray TrapHistory::AddressKey(const IpAddress &address)
+{
+    QByteArray key;
+
+    if (address.get_ip_version() == Address::version_ipv4)
+    {
+        key = QByteArray((const char *)v4mapped, sizeof(v4mapped));
+        for (int i = 0; i < 4; i++)
+            key.append((char)address[i]);
+    }
+    else
+    {
+        for (int i = 0; i < 16; i++)
+            key.append((char)address[i]);
+    }
+
+    return key;
+}
+
+// Parse an address or network ("10.2.0.0/16") of a query. The host
+// bits are cleared: the search starts at the first address of the
+// network, whatever address was given.
+bool TrapHistory::SourcePrefix(const QString &text, QByteArray &key,
+                               int &bits)
+{
+    QString addr = text.section('/', 0, 0);
+    QString len = text.section('/', 1, 1);
+    IpAddress a(addr.toLatin1().data());
+    bool ok = true;
+    int maxbits = (a.get_ip_version() == Address::version_ipv4) ? 32 : 128;
+    int b = len.isEmpty() ? maxbits : len.toInt(&ok);
+
+    if (!a.valid() || !ok || (b < 0) || (b > maxbits))
+        return false;
+
+    key = AddressKey(a);
+    bits = b + (128 - maxbits);
+    for (int bit = bits; bit < key.size() * 8; bit++)
+        key[bit/8] = key[bit/8] & (char)~(0x80 >> (bit % 8));
+
+    return true;
+}
+
+// Fixed size, big endian subids: OID prefixes are key prefixes and
+// keys sort like OIDs
+QByteArray TrapHistory::OidKey(const unsigned long *subids, int len)
+{
+    QByteArray key(len * 4, '\0');
+
+    for (int i = 0; i < len; i++)
+    {
+        key[i*4]   = (char)((subids[i] >> 24) & 0xFF);
+        key[i*4+1] = (char)((subids[i] >> 16) & 0xFF);
+        key[i*4+2] = (char)((subids[i] >> 8) & 0xFF);
+        key[i*4+3] = (char)(subids[i] & 0xFF);
+    }
+
+    return key;
+}
+
+// Split a varbind value in lowercase words. Dots, colons and dashes
+// are kept so that addresses, OIDs and names stay in one piece.
+void TrapHistory::Words(const QString &text, QStringList &words)
+{
+    static const QRegExp separators("[^\\w.:-]+");
+    QStringList l = text.toLower().split(separators, QString::SkipEmptyParts);
+
+    for (int i = 0; i < l.size(); i++)
+    {
+        QString w = l[i];
+        while (!w.isEmpty() && QString(".:-").contains(w.at(w.size()-1)))
+            w.chop(1);
+        if (!w.isEmpty())
+            words << w;
+    }
+}
+
+// Decimal numbers with more than TRAP_INDEX_MAX_DIGITS digits and hex
+// strings of more than TRAP_INDEX_MAX_HEX digits are not indexed
+bool TrapHistory::Indexed(const QString &word)
+{
+    static const QRegExp hex("[0-9a-f]*[0-9][0-9a-f]*");
+    static const QRegExp number(QString("-?[0-9]{%1,}")
+                                .arg(TRAP_INDEX_MAX_DIGITS + 1));
+
+    if (word.size() > TRAP_INDEX_MAX_LENGTH)
+        return false;
+    if (number.exactMatch(word))
+        return false;
+    if ((word.size() > TRAP_INDEX_MAX_HEX) && hex.exactMatch(word))
+        return false;
+
+    return true;
+}
+
+void TrapHistory::Add(TrapItem *item, qint64 received,
+                      const IpAddress &source, const Oid &id, const Pdu &pdu)
+{
+    QStringList vbwords;
+    Vb vb;
+
+    for (int i = 0; i < pdu.get_vb_count(); i++)
+    {
+        pdu.get_vb(vb, i);
+        Words(vb.get_printable_value(), vbwords);
+    }
+    vbwords.removeDuplicates();
+
+    for (int i = vbwords.size() - 1; i >= 0; i--)
+        if (!Indexed(vbwords[i]))
+            vbwords.removeAt(i);
+    if (vbwords.size() > TRAP_INDEX_MAX_WORDS)
+        vbwords.erase(vbwords.begin() + TRAP_INDEX_MAX_WORDS, vbwords.end());
+
+    QByteArray address = AddressKey(source);
+    SmiLPOID o = ((Oid &)id).oidval();
+    QByteArray notify = OidKey(o->ptr, o->len);
+
+    lock.lockForWrite();
+
+    unsigned int pos = items.size();
+    items.append(item);
+
+    // Keep the times sorted for the binary search, even if the clock
+    // went backwards
+    if (!times.isEmpty() && (received < times.last()))
+        received = times.last();
+    times.append(received);
+
+    sources[address].append(pos);
+    oids[notify].append(pos);
+    for (int i = 0; i < vbwords.size(); i++)
+    {
+        QHash<QString, TrapPostings>::iterator w = words.find(vbwords[i]);
+        if (w == words.end())
+        {
+            if (words.size() >= TRAP_INDEX_MAX_DISTINCT)
+                continue;
+            w = words.insert(vbwords[i], TrapPostings());
+        }
+        w.value().append(pos);
+    }
+
+    lock.unlock();
+}
+
+TrapSearchThread::TrapSearchThread(TrapHistory *history, QObject *parent)
+    :QThread(parent)
+{
+    h = history;
+    aborting.storeRelease(0);
+
+    qRegisterMetaType<TrapPostings>("TrapPostings");
+}
+
+void TrapSearchThread::Search(const trap_query &q)
+{
+    query = q;
+    aborting.storeRelease(0);
+    start();
+}
+
+void TrapSearchThread::Abort()
+{
+    aborting.storeRelease(1);
+}
+
+// Append the positions of p within [lo, hi)
+void TrapSearchThread::Postings(const TrapPostings &p, unsigned int lo,
+                                unsigned int hi, TrapPostings &out)
+{
+    TrapPostings::const_iterator b = std::lower_bound(p.begin(), p.end(), lo);
+    TrapPostings::const_iterator e = std::lower_bound(b, p.end(), hi);
+
+    for (; b != e; ++b)
+        out.append(*b);
+}
+
+void TrapSearchThread::Intersect(TrapPostings &a, const TrapPostings &b)
+{
+    TrapPostings r;
+
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(),
+                          std::back_inserter(r));
+    a = r;
+}
+
+void TrapSearchThread::run()
+{
+    unsigned int lo = 0, hi;
+    int found = 0;
+
+    // Const access only: nothing may detach while the GUI thread adds traps
+    const QVector<qint64> &times = h->times;
+    const QMap<QByteArray, TrapPostings> &sources = h->sources;
+    const QMap<QByteArray, TrapPostings> &oids = h->oids;
+    const QHash<QString, TrapPostings> &words = h->words;
+
+    // Last address of the source prefix
+    QByteArray source_end = query.source;
+    for (int bit = query.source_bits; bit < source_end.size() * 8; bit++)
+        source_end[bit/8] = source_end[bit/8] | (char)(0x80 >> (bit % 8));
+
+    // Receive time index
+    h->lock.lockForRead();
+    hi = times.size();
+    if (query.since >= 0)
+        lo = std::lower_bound(times.begin(), times.end(),
+                              query.since) - times.begin();
+    if (query.until >= 0)
+        hi = std::upper_bound(times.begin(), times.end(),
+                              query.until) - times.begin();
+    h->lock.unlock();
+
+    // Evaluate the other indexes one window at a time, newest first,
+    // so that results are sent as soon as they are found
+    while ((hi > lo) && !aborting.loadAcquire() &&
+           (found < TRAP_SEARCH_MAX_RESULTS))
+    {
+        unsigned int wlo = (hi - lo > TRAP_SEARCH_WINDOW) ?
+                           hi - TRAP_SEARCH_WINDOW : lo;
+        TrapPostings match;
+        bool filtered = false;
+
+        h->lock.lockForRead();
+
+        if (!query.source.isEmpty())
+        {
+            QMap<QByteArray, TrapPostings>::const_iterator i;
+            for (i = sources.lowerBound(query.source);
+                 (i != sources.constEnd()) && (i.key() <= source_end); ++i)
+                Postings(i.value(), wlo, hi, match);
+            std::sort(match.begin(), match.end());
+            filtered = true;
+        }
+
+        if (!query.oids.isEmpty())
+        {
+            TrapPostings u;
+            for (int k = 0; k < query.oids.size(); k++)
+            {
+                QMap<QByteArray, TrapPostings>::const_iterator i;
+                for (i = oids.lowerBound(query.oids[k]);
+                     (i != oids.constEnd()) &&
+                     i.key().startsWith(query.oids[k]); ++i)
+                    Postings(i.value(), wlo, hi, u);
+            }
+            std::sort(u.begin(), u.end());
+            u.erase(std::unique(u.begin(), u.end()), u.end());
+
+            if (filtered)
+                Intersect(match, u);
+            else
+                match = u;
+            filtered = true;
+        }
+
+        for (int k = 0; k < query.words.size(); k++)
+        {
+            TrapPostings w;
+            QHash<QString, TrapPostings>::const_iterator i =
+                words.constFind(query.words[k]);
+            if (i != words.constEnd())
+                Postings(i.value(), wlo, hi, w);
+
+            if (filtered)
+                Intersect(match, w);
+            else
+                match = w;
+            filtered = true;
+        }
+
+        h->lock.unlock();
+
+        if (filtered == false)
+        {
+            for (unsigned int p = wlo; p < hi; p++)
+                match.append(p);
+        }
+
+        if (!match.isEmpty())
+        {
+            std::reverse(match.begin(), match.end());
+            if (found + match.size() > TRAP_SEARCH_MAX_RESULTS)
+                match.resize(TRAP_SEARCH_MAX_RESULTS - found);
+            found += match.size();
+            emit SearchResults(match);
+        }
+
+        hi = wlo;
+    }
+}
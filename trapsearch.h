@@ -0,0 +1,103 @@
+/*
+    Copyright (C) 2004-2011 Martin Jolicoeur (snmpb1@gmail.com)
+
+    This file is part of the SnmpB project
+    (http://sourceforge.net/projects/snmpb)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef TRAPSEARCH_H
+#define TRAPSEARCH_H
+
+#include "stdafx.h"
+
+class TrapItem;
+
+// The varbind words index grows with every distinct word, and the
+// history is never trimmed. Words that are rarely searched for and
+// mostly unique (counters, timestamps, identifiers) are not indexed,
+// and so are the words beyond these limits.
+#define TRAP_INDEX_MAX_WORDS 64         // per trap
+#define TRAP_INDEX_MAX_DISTINCT 250000  // a few tens of MB with postings
+#define TRAP_INDEX_MAX_DIGITS 6         // longest indexed decimal number
+#define TRAP_INDEX_MAX_HEX 7            // longest indexed hex string
+#define TRAP_INDEX_MAX_LENGTH 64        // longest indexed word
+
+// Positions of the matching traps in the history, in increasing order
+typedef QVector<unsigned int> TrapPostings;
+
+// Search criteria, parsed from the query string in the GUI thread
+typedef struct
+{
+    qint64 since;               // msecs since epoch, -1 if not set
+    qint64 until;               // msecs since epoch, -1 if not set
+    QByteArray source;          // address key (see AddressKey), or empty
+    int source_bits;            // prefix length of source
+    QList<QByteArray> oids;     // notification OID key prefixes, or empty
+    QStringList words;          // varbind value words
+} trap_query;
+
+// Every received trap in arrival order, with its search indexes.
+// Only the GUI thread adds traps; the search thread reads the indexes
+// with the read lock held.
+class TrapHistory
+{
+public:
+    void Add(TrapItem *item, qint64 received, const IpAddress &source,
+             const Oid &id, const Pdu &pdu);
+    TrapItem *Item(unsigned int pos) { return items[pos]; };
+    int Count(void) { return items.size(); };
+
+    static QByteArray AddressKey(const IpAddress &address);
+    static bool SourcePrefix(const QString &text, QByteArray &key, int &bits);
+    static QByteArray OidKey(const unsigned long *subids, int len);
+    static void Words(const QString &text, QStringList &words);
+    static bool Indexed(const QString &word);
+
+protected:
+    friend class TrapSearchThread;
+
+    QReadWriteLock lock;
+    QVector<TrapItem*> items;
+    QVector<qint64> times;                  // reception time, by position
+    QMap<QByteArray, TrapPostings> sources; // sorted for prefix lookups
+    QMap<QByteArray, TrapPostings> oids;    // sorted for prefix lookups
+    QHash<QString, TrapPostings> words;
+};
+
+class TrapSearchThread: public QThread
+{
+    Q_OBJECT
+
+public:
+    TrapSearchThread(TrapHistory *history, QObject *parent);
+    void Search(const trap_query &q);
+    void run();
+    void Abort();
+
+signals:
+    void SearchResults(TrapPostings positions);
+
+protected:
+    void Postings(const TrapPostings &p, unsigned int lo, unsigned int hi,
+                  TrapPostings &out);
+    void Intersect(TrapPostings &a, const TrapPostings &b);
+
+protected:
+    TrapHistory *h;
+    trap_query query;
+    QAtomicInt aborting;        // set by the GUI thread
+};
+
+#endif /* TRAPSEARCH_H */
@@ -124,6 +124,10 @@ void USMProfileManager::Execute (void)
 
         // ... then save it to file.    
         usm->save_users(s->GetUsmUsersConfigFile().toLatin1().data());
+
+        // Keys of new or changed passwords are generated now rather than
+        // when each agent is first contacted
+        s->AgentObj()->DeriveUserKeys();
     }
 }
 